@@ -18,7 +18,8 @@ void Application::Initialize(HWND hWnd, std::uint32_t screenWidth,
                              std::uint32_t screenHeight) {
   hWnd_ = hWnd;
   device_ = std::make_unique<dxapp::Device>();
-  device_->Initialize(hWnd, screenWidth, screenHeight);
+  device_->Initialize(hWnd, screenWidth, screenHeight, FramesInFlight_);
+  graphResources_.Initialize(device_.get());
 
   // テクスチャーマネージャー生成
   Singleton<TextureManager>::Create();
@@ -36,8 +37,9 @@ void Application::Initialize(HWND hWnd, std::uint32_t screenWidth,
 }
 
 void Application::Terminate() {
-  SingletonFinalizer::Finalize();
+  // TextureManagerなどが持つリソースをGPUが使い終わってから破棄する
   device_->WaitForGPU();
+  SingletonFinalizer::Finalize();
 }
 
 void Application::Run() {
@@ -49,18 +51,63 @@ void Application::Run() {
 void Application::Update(const DX::StepTimer& timer) {
   auto deltaTime = static_cast<float>(timer.GetElapsedSeconds());
 
+  // 非同期ロードしているテクスチャの転送
+  Singleton<TextureManager>::instance().Update();
+
   // シーンアップデート
   scene_->Update(deltaTime);
 }
 
 void Application::Render() {
   device_->PrepareRendering();
-  ClearRenderTarget();
 
-  // シーンレンダリング
-  scene_->Render(device_.get());
+  // フレームをパスの並びで組み立てる
+  // バックバッファとデプスバッファはDeviceのものを持ち込む
+  renderGraph_.Reset();
+  const auto viewport = device_->screenViewport();
+  const RenderGraphTextureDesc screenDesc{
+      static_cast<std::uint32_t>(viewport.Width),
+      static_cast<std::uint32_t>(viewport.Height)};
+  const auto backBuffer = renderGraph_.ImportTexture(
+      "BackBuffer", screenDesc, ResourceState::Present, ResourceState::Present);
+  const auto depth =
+      renderGraph_.ImportTexture("Depth", screenDesc, ResourceState::DepthWrite,
+                                 ResourceState::DepthWrite);
+
+  const auto clear =
+      renderGraph_.AddPass("Clear", [this]() { ClearRenderTarget(); });
+  renderGraph_.Write(clear, backBuffer, ResourceState::RenderTarget);
+  renderGraph_.Write(clear, depth, ResourceState::DepthWrite);
 
-  device_->Present();
+  // シーンレンダリング
+  // 描画スレッドで積んだリストはQueueCommandListで後から実行されるので、
+  // このパスの後にバリアが要るのは最後のバリアだけにしておく
+  const auto scene = renderGraph_.AddPass(
+      "Scene", [this]() { scene_->Render(device_.get()); });
+  renderGraph_.Write(scene, backBuffer, ResourceState::RenderTarget);
+  renderGraph_.Write(scene, depth, ResourceState::DepthWrite);
+
+  renderGraph_.Compile(
+      [this](const RenderGraphTextureDesc& desc, ResourceState usage) {
+        return graphResources_.QueryMemory(desc, usage);
+      });
+  graphResources_.Prepare(renderGraph_);
+  graphResources_.Import(backBuffer, device_->currentRenderTarget());
+  graphResources_.Import(depth, device_->depthStencil());
+
+  // パスの間のバリアはまとめてメインのコマンドリストに積む
+  auto commandList = device_->graphicsCommandList();
+  renderGraph_.Run([this, commandList](const RenderGraphBarrier* barriers,
+                                       std::uint32_t count) {
+    graphResources_.Record(commandList, barriers, count);
+  });
+
+  // バックバッファをPRESENTに戻すバリアは、描画スレッドのリストの後に積む
+  finalBarriers_.clear();
+  graphResources_.Translate(renderGraph_.finalBarriers(),
+                            renderGraph_.finalBarrierCount(), &finalBarriers_);
+  device_->Present(finalBarriers_.data(),
+                   static_cast<UINT>(finalBarriers_.size()));
 }
 
 void Application::ClearRenderTarget() {
@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include "External/StepTimer.h"
+#include "RenderGraphResources.hpp"
 
 namespace dxapp {
 
@@ -64,6 +65,10 @@ class Application {
    */
   void ClearRenderTarget();
 
+  //! 同時にGPUに送っておけるフレームの数。2か3
+  //! 多いほどCPUとGPUが重なりやすいが、入力から表示までは遅れる
+  static constexpr std::uint32_t FramesInFlight_{2};
+
   //! ウィンドウハンドル
   HWND hWnd_{nullptr};
 
@@ -78,5 +83,12 @@ class Application {
 
   //! 授業用サンプルシーン
   std::unique_ptr<Scene> scene_;
+
+  //! フレームのパスとリソース。毎フレーム組み立てなおす
+  RenderGraph renderGraph_;
+  //! レンダーグラフの一時的なテクスチャとバリアをD3D12にする
+  RenderGraphResources graphResources_;
+  //! Presentに渡す最後のバリア
+  std::vector<D3D12_RESOURCE_BARRIER> finalBarriers_;
 };
 }  // namespace dxapp
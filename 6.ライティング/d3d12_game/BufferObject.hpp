@@ -7,6 +7,7 @@ enum class BufferObjectType {
   VertexBuffer = 0,  //!< 頂点バッファ
   IndexBuffer,       //!< インデックスバッファ
   ConstantBuffer,    //!< 定数バッファ
+  StructuredBuffer,  //!< 構造化バッファ(ルートSRVで直接渡す)
   Max
 };
 
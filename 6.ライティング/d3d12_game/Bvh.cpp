@@ -0,0 +1,642 @@
+﻿#include "Bvh.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace {
+using dxapp::Aabb;
+
+//! Rebuildで重心を分ける区間の数
+constexpr std::uint32_t BuildBinCount = 16;
+
+//! 何も入っていない箱。どの箱と合わせても相手になる
+constexpr Aabb EmptyAabb() {
+  return {std::numeric_limits<float>::max(),
+          std::numeric_limits<float>::max(),
+          std::numeric_limits<float>::max(),
+          -std::numeric_limits<float>::max(),
+          -std::numeric_limits<float>::max(),
+          -std::numeric_limits<float>::max()};
+}
+
+Aabb Union(const Aabb& a, const Aabb& b) {
+  return {std::min(a.minX, b.minX), std::min(a.minY, b.minY),
+          std::min(a.minZ, b.minZ), std::max(a.maxX, b.maxX),
+          std::max(a.maxY, b.maxY), std::max(a.maxZ, b.maxZ)};
+}
+
+bool Contains(const Aabb& outer, const Aabb& inner) {
+  return outer.minX <= inner.minX && outer.minY <= inner.minY &&
+         outer.minZ <= inner.minZ && inner.maxX <= outer.maxX &&
+         inner.maxY <= outer.maxY && inner.maxZ <= outer.maxZ;
+}
+
+bool Overlaps(const Aabb& a, const Aabb& b) {
+  return a.minX <= b.maxX && b.minX <= a.maxX && a.minY <= b.maxY &&
+         b.minY <= a.maxY && a.minZ <= b.maxZ && b.minZ <= a.maxZ;
+}
+
+/*!
+ * @brief 表面積の半分。比べるだけなので半分で足りる
+ */
+float Area(const Aabb& a) {
+  const auto dx = a.maxX - a.minX;
+  const auto dy = a.maxY - a.minY;
+  const auto dz = a.maxZ - a.minZ;
+  return dx * dy + dy * dz + dz * dx;
+}
+
+Aabb Fatten(const Aabb& a, float margin) {
+  return {a.minX - margin, a.minY - margin, a.minZ - margin,
+          a.maxX + margin, a.maxY + margin, a.maxZ + margin};
+}
+
+/*!
+ * @brief 重心の軸の成分の2倍。比べるだけなので2で割らない
+ */
+float Centroid(const Aabb& a, int axis) {
+  switch (axis) {
+    case 0:
+      return a.minX + a.maxX;
+    case 1:
+      return a.minY + a.maxY;
+    default:
+      return a.minZ + a.maxZ;
+  }
+}
+
+/*!
+ * @brief 点から箱までの距離の2乗。中なら0
+ */
+float DistanceSq(float x, float y, float z, const Aabb& a) {
+  const auto dx = std::max({a.minX - x, 0.0f, x - a.maxX});
+  const auto dy = std::max({a.minY - y, 0.0f, y - a.maxY});
+  const auto dz = std::max({a.minZ - z, 0.0f, z - a.maxZ});
+  return dx * dx + dy * dy + dz * dz;
+}
+}  // namespace
+
+namespace dxapp {
+
+void Bvh::Clear() {
+  nodes_.clear();
+  root_ = NullNode;
+  freeList_ = NullNode;
+  leafCount_ = 0;
+}
+
+std::uint32_t Bvh::Insert(const Aabb& box, std::uint32_t object) {
+  const auto leaf = AllocateNode();
+  auto& node = nodes_[leaf];
+  node.box = Fatten(box, margin_);
+  node.tight = box;
+  node.object = object;
+  node.height = 0;
+  InsertLeaf(leaf);
+  ++leafCount_;
+  return leaf;
+}
+
+void Bvh::Remove(std::uint32_t proxy) {
+  assert(proxy < nodes_.size() && nodes_[proxy].IsLeaf());
+  RemoveLeaf(proxy);
+  FreeNode(proxy);
+  --leafCount_;
+}
+
+bool Bvh::Update(std::uint32_t proxy, const Aabb& box) {
+  assert(proxy < nodes_.size() && nodes_[proxy].IsLeaf());
+  auto& node = nodes_[proxy];
+  node.tight = box;
+  if (Contains(node.box, box)) {
+    return false;  // 太らせた箱の中で動いただけ
+  }
+
+  RemoveLeaf(proxy);
+  nodes_[proxy].box = Fatten(box, margin_);
+  InsertLeaf(proxy);
+  return true;
+}
+
+void Bvh::Rebuild() {
+  // 葉の箱と重心を並べて持ち、葉でない節は全部空きに戻す
+  // 分けるときは並べたものだけを動かすので、節をあちこち読まない
+  buildItems_.clear();
+  for (std::uint32_t i = 0; i < nodes_.size(); ++i) {
+    if (nodes_[i].height < 0) {
+      continue;
+    }
+    if (nodes_[i].IsLeaf()) {
+      const auto& box = nodes_[i].box;
+      buildItems_.push_back({box,
+                             {Centroid(box, 0), Centroid(box, 1),
+                              Centroid(box, 2)},
+                             i});
+    } else {
+      FreeNode(i);
+    }
+  }
+  root_ = NullNode;
+  if (buildItems_.empty()) {
+    return;
+  }
+
+  // 上から分けていく。偏った分け方が続いても深くならないよう再帰しない
+  struct Task {
+    std::uint32_t parent;
+    std::uint32_t slot;
+    std::uint32_t begin, end;
+  };
+  std::vector<Task> tasks;
+  tasks.push_back(
+      {NullNode, 0, 0, static_cast<std::uint32_t>(buildItems_.size())});
+  buildOrder_.clear();
+  while (!tasks.empty()) {
+    const auto task = tasks.back();
+    tasks.pop_back();
+
+    std::uint32_t node = NullNode;
+    if (task.end - task.begin == 1) {
+      node = buildItems_[task.begin].leaf;
+    } else {
+      node = AllocateNode();
+      buildOrder_.push_back(node);
+
+      // 重心の広がりが一番大きい軸で分ける
+      const auto begin = buildItems_.begin() + task.begin;
+      const auto end = buildItems_.begin() + task.end;
+      float mins[3], maxs[3];
+      for (int axis = 0; axis < 3; ++axis) {
+        mins[axis] = std::numeric_limits<float>::max();
+        maxs[axis] = -std::numeric_limits<float>::max();
+      }
+      for (auto it = begin; it != end; ++it) {
+        for (int axis = 0; axis < 3; ++axis) {
+          mins[axis] = std::min(mins[axis], it->centroid[axis]);
+          maxs[axis] = std::max(maxs[axis], it->centroid[axis]);
+        }
+      }
+      int axis = 0;
+      for (int a = 1; a < 3; ++a) {
+        if (maxs[a] - mins[a] > maxs[axis] - mins[axis]) {
+          axis = a;
+        }
+      }
+      const auto extent = maxs[axis] - mins[axis];
+
+      auto mid = begin + (end - begin) / 2;
+      if (extent > 0.0f) {
+        // 重心を区間に分けて数え、左右の(数 * 表面積)の和が一番小さい所で分ける
+        const auto scale = BuildBinCount / extent;
+        const auto minCentroid = mins[axis];
+        auto binOf = [axis, scale, minCentroid](const BuildItem& item) {
+          return std::min(BuildBinCount - 1,
+                          static_cast<std::uint32_t>(
+                              (item.centroid[axis] - minCentroid) * scale));
+        };
+        std::uint32_t counts[BuildBinCount]{};
+        Aabb boxes[BuildBinCount];
+        std::fill(std::begin(boxes), std::end(boxes), EmptyAabb());
+        for (auto it = begin; it != end; ++it) {
+          const auto bin = binOf(*it);
+          ++counts[bin];
+          boxes[bin] = Union(boxes[bin], it->box);
+        }
+
+        // 右から足した表面積を先に作っておく
+        float rightCosts[BuildBinCount]{};
+        auto rightBox = EmptyAabb();
+        std::uint32_t rightCount = 0;
+        for (auto bin = BuildBinCount - 1; bin > 0; --bin) {
+          rightBox = Union(rightBox, boxes[bin]);
+          rightCount += counts[bin];
+          rightCosts[bin] = rightCount ? rightCount * Area(rightBox) : 0.0f;
+        }
+        auto leftBox = EmptyAabb();
+        std::uint32_t leftCount = 0;
+        auto bestCost = std::numeric_limits<float>::max();
+        std::uint32_t bestBin = 0;
+        for (std::uint32_t bin = 0; bin + 1 < BuildBinCount; ++bin) {
+          leftBox = Union(leftBox, boxes[bin]);
+          leftCount += counts[bin];
+          const auto cost =
+              (leftCount ? leftCount * Area(leftBox) : 0.0f) +
+              rightCosts[bin + 1];
+          if (cost < bestCost) {
+            bestCost = cost;
+            bestBin = bin;
+          }
+        }
+        mid = std::partition(begin, end, [&](const BuildItem& item) {
+          return binOf(item) <= bestBin;
+        });
+      }
+      if (mid == begin || mid == end) {
+        // 重心が全部同じなどで分けられなければ数で半分にする
+        mid = begin + (end - begin) / 2;
+      }
+
+      const auto split =
+          static_cast<std::uint32_t>(mid - buildItems_.begin());
+      tasks.push_back({node, 0, task.begin, split});
+      tasks.push_back({node, 1, split, task.end});
+    }
+
+    nodes_[node].parent = task.parent;
+    if (task.parent == NullNode) {
+      root_ = node;
+    } else {
+      nodes_[task.parent].child[task.slot] = node;
+    }
+  }
+
+  // 子は親より後に作ったので、逆順にたどれば下から箱と高さが決まる
+  for (auto it = buildOrder_.rbegin(); it != buildOrder_.rend(); ++it) {
+    auto& node = nodes_[*it];
+    const auto& a = nodes_[node.child[0]];
+    const auto& b = nodes_[node.child[1]];
+    node.box = Union(a.box, b.box);
+    node.height = 1 + std::max(a.height, b.height);
+  }
+}
+
+void Bvh::QueryFrustum(const Frustum& frustum,
+                       std::vector<std::uint32_t>* objects) const {
+  if (root_ == NullNode) {
+    return;
+  }
+
+  // まだ外か内か決まっていない平面をビットで持って降りる
+  struct Item {
+    std::uint32_t node;
+    std::uint32_t planeMask;
+  };
+  std::vector<Item> stack;
+  stack.reserve(64);
+  stack.push_back({root_, (1u << 6) - 1});
+  while (!stack.empty()) {
+    const auto item = stack.back();
+    stack.pop_back();
+
+    const auto& node = nodes_[item.node];
+    const auto& box = node.IsLeaf() ? node.tight : node.box;
+    const auto cx = (box.minX + box.maxX) * 0.5f;
+    const auto cy = (box.minY + box.maxY) * 0.5f;
+    const auto cz = (box.minZ + box.maxZ) * 0.5f;
+    const auto ex = (box.maxX - box.minX) * 0.5f;
+    const auto ey = (box.maxY - box.minY) * 0.5f;
+    const auto ez = (box.maxZ - box.minZ) * 0.5f;
+
+    auto mask = item.planeMask;
+    bool outside = false;
+    for (std::uint32_t i = 0; i < 6; ++i) {
+      if (!(mask & (1u << i))) {
+        continue;
+      }
+      // CullBoxesと同じ判定。reachより内側ならこの平面はもう見なくてよい
+      const auto& p = frustum.planes[i];
+      const auto dist = p.nx * cx + p.ny * cy + p.nz * cz + p.d;
+      const auto reach =
+          std::fabs(p.nx) * ex + std::fabs(p.ny) * ey + std::fabs(p.nz) * ez;
+      if (dist < -reach) {
+        outside = true;
+        break;
+      }
+      if (dist >= reach) {
+        mask &= ~(1u << i);
+      }
+    }
+    if (outside) {
+      continue;
+    }
+
+    if (node.IsLeaf()) {
+      objects->push_back(node.object);
+    } else if (mask == 0) {
+      AppendSubtree(item.node, objects);
+    } else {
+      stack.push_back({node.child[0], mask});
+      stack.push_back({node.child[1], mask});
+    }
+  }
+}
+
+void Bvh::QueryBox(const Aabb& box, std::vector<std::uint32_t>* objects) const {
+  if (root_ == NullNode) {
+    return;
+  }
+
+  std::vector<std::uint32_t> stack;
+  stack.reserve(64);
+  stack.push_back(root_);
+  while (!stack.empty()) {
+    const auto& node = nodes_[stack.back()];
+    stack.pop_back();
+    if (node.IsLeaf()) {
+      if (Overlaps(node.tight, box)) {
+        objects->push_back(node.object);
+      }
+    } else if (Overlaps(node.box, box)) {
+      stack.push_back(node.child[0]);
+      stack.push_back(node.child[1]);
+    }
+  }
+}
+
+bool Bvh::QueryNearest(float x, float y, float z, float maxDistance,
+                       std::uint32_t* object, float* distance) const {
+  if (root_ == NullNode) {
+    return false;
+  }
+
+  // 箱までの距離が近い節から調べ、見つけたものより遠い節は見ない
+  using Item = std::pair<float, std::uint32_t>;
+  std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue;
+  auto best = maxDistance * maxDistance;
+  bool found = false;
+  const auto rootDist = DistanceSq(x, y, z, nodes_[root_].box);
+  if (rootDist <= best) {
+    queue.push({rootDist, root_});
+  }
+  while (!queue.empty()) {
+    const auto item = queue.top();
+    queue.pop();
+    if (item.first > best) {
+      break;  // 残りは全部これより遠い
+    }
+
+    const auto& node = nodes_[item.second];
+    if (node.IsLeaf()) {
+      const auto d = DistanceSq(x, y, z, node.tight);
+      if (d <= best) {
+        best = d;
+        *object = node.object;
+        found = true;
+      }
+      continue;
+    }
+    for (const auto child : node.child) {
+      const auto d = DistanceSq(x, y, z, nodes_[child].box);
+      if (d <= best) {
+        queue.push({d, child});
+      }
+    }
+  }
+
+  if (found && distance) {
+    *distance = std::sqrt(best);
+  }
+  return found;
+}
+
+float Bvh::cost() const {
+  if (root_ == NullNode || nodes_[root_].IsLeaf()) {
+    return 0.0f;
+  }
+  float sum = 0.0f;
+  for (const auto& node : nodes_) {
+    if (node.height > 0) {
+      sum += Area(node.box);
+    }
+  }
+  const auto rootArea = Area(nodes_[root_].box);
+  return rootArea > 0.0f ? sum / rootArea : 0.0f;
+}
+
+bool Bvh::Validate() const {
+  std::uint32_t freeCount = 0;
+  for (auto node = freeList_; node != NullNode; node = nodes_[node].parent) {
+    if (node >= nodes_.size() || nodes_[node].height != -1 ||
+        ++freeCount > nodes_.size()) {
+      return false;
+    }
+  }
+  if (root_ == NullNode) {
+    return leafCount_ == 0 && freeCount == nodes_.size();
+  }
+  if (root_ >= nodes_.size() || nodes_[root_].parent != NullNode) {
+    return false;
+  }
+
+  std::uint32_t leafCount = 0;
+  std::uint32_t nodeCount = 0;
+  std::vector<std::uint32_t> stack;
+  stack.push_back(root_);
+  while (!stack.empty()) {
+    const auto index = stack.back();
+    stack.pop_back();
+    const auto& node = nodes_[index];
+    if (node.height < 0 || ++nodeCount > nodes_.size()) {
+      return false;
+    }
+    if (node.IsLeaf()) {
+      if (node.height != 0 || node.child[1] != NullNode ||
+          !Contains(node.box, node.tight)) {
+        return false;
+      }
+      ++leafCount;
+      continue;
+    }
+    for (const auto child : node.child) {
+      if (child >= nodes_.size() || nodes_[child].parent != index ||
+          !Contains(node.box, nodes_[child].box)) {
+        return false;
+      }
+      stack.push_back(child);
+    }
+    const auto& a = nodes_[node.child[0]];
+    const auto& b = nodes_[node.child[1]];
+    if (node.height != 1 + std::max(a.height, b.height)) {
+      return false;
+    }
+  }
+  return leafCount == leafCount_ && nodeCount + freeCount == nodes_.size();
+}
+
+std::uint32_t Bvh::AllocateNode() {
+  std::uint32_t node = NullNode;
+  if (freeList_ != NullNode) {
+    node = freeList_;
+    freeList_ = nodes_[node].parent;
+  } else {
+    node = static_cast<std::uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+  }
+  auto& n = nodes_[node];
+  n.box = EmptyAabb();
+  n.tight = EmptyAabb();
+  n.parent = NullNode;
+  n.child[0] = NullNode;
+  n.child[1] = NullNode;
+  n.object = NullNode;
+  n.height = 0;
+  return node;
+}
+
+void Bvh::FreeNode(std::uint32_t node) {
+  nodes_[node].height = -1;
+  nodes_[node].parent = freeList_;
+  freeList_ = node;
+}
+
+void Bvh::InsertLeaf(std::uint32_t leaf) {
+  if (root_ == NullNode) {
+    root_ = leaf;
+    nodes_[leaf].parent = NullNode;
+    return;
+  }
+
+  // 入れた後の表面積の増え方が一番小さい兄弟を探す
+  // 降りるたびに、上の節が広がる分(inheritance)は必ず払う
+  const auto leafBox = nodes_[leaf].box;
+  auto index = root_;
+  while (!nodes_[index].IsLeaf()) {
+    const auto& node = nodes_[index];
+    const auto area = Area(node.box);
+    const auto combined = Area(Union(node.box, leafBox));
+
+    // ここで兄弟にするなら、新しい親の分だけ
+    const auto cost = 2.0f * combined;
+    const auto inheritance = 2.0f * (combined - area);
+
+    float childCosts[2];
+    for (int i = 0; i < 2; ++i) {
+      const auto& child = nodes_[node.child[i]];
+      const auto grown = Area(Union(leafBox, child.box));
+      childCosts[i] =
+          (child.IsLeaf() ? grown : grown - Area(child.box)) + inheritance;
+    }
+    if (cost < childCosts[0] && cost < childCosts[1]) {
+      break;
+    }
+    index = childCosts[0] < childCosts[1] ? node.child[0] : node.child[1];
+  }
+
+  // 兄弟と葉の親を作って、兄弟のいた所に入れる
+  const auto sibling = index;
+  const auto oldParent = nodes_[sibling].parent;
+  const auto newParent = AllocateNode();
+  auto& parent = nodes_[newParent];
+  parent.parent = oldParent;
+  parent.box = Union(leafBox, nodes_[sibling].box);
+  parent.height = nodes_[sibling].height + 1;
+  parent.child[0] = sibling;
+  parent.child[1] = leaf;
+  if (oldParent == NullNode) {
+    root_ = newParent;
+  } else {
+    auto& p = nodes_[oldParent];
+    p.child[p.child[0] == sibling ? 0 : 1] = newParent;
+  }
+  nodes_[sibling].parent = newParent;
+  nodes_[leaf].parent = newParent;
+
+  FixUpwards(newParent);
+}
+
+void Bvh::RemoveLeaf(std::uint32_t leaf) {
+  if (leaf == root_) {
+    root_ = NullNode;
+    return;
+  }
+
+  // 親を消して、兄弟を親のいた所に上げる
+  const auto parent = nodes_[leaf].parent;
+  const auto grandParent = nodes_[parent].parent;
+  const auto sibling = nodes_[parent].child[nodes_[parent].child[0] == leaf];
+  nodes_[sibling].parent = grandParent;
+  FreeNode(parent);
+  if (grandParent == NullNode) {
+    root_ = sibling;
+    return;
+  }
+  auto& g = nodes_[grandParent];
+  g.child[g.child[0] == parent ? 0 : 1] = sibling;
+  FixUpwards(grandParent);
+}
+
+void Bvh::FixUpwards(std::uint32_t node) {
+  while (node != NullNode) {
+    node = Balance(node);
+    auto& n = nodes_[node];
+    const auto& a = nodes_[n.child[0]];
+    const auto& b = nodes_[n.child[1]];
+    n.height = 1 + std::max(a.height, b.height);
+    n.box = Union(a.box, b.box);
+    node = n.parent;
+  }
+}
+
+std::uint32_t Bvh::Balance(std::uint32_t iA) {
+  auto& a = nodes_[iA];
+  if (a.IsLeaf() || a.height < 2) {
+    return iA;
+  }
+
+  // 高いほうの子(iUp)をaの位置に上げ、その子のうち高いほうを残して
+  // 低いほうをaに渡す。AVL木の回転と同じ
+  const auto iB = a.child[0];
+  const auto iC = a.child[1];
+  const auto balance = nodes_[iC].height - nodes_[iB].height;
+  if (balance >= -1 && balance <= 1) {
+    return iA;
+  }
+  const auto upSlot = balance > 1 ? 1 : 0;
+  const auto iUp = a.child[upSlot];
+  const auto iStay = a.child[1 - upSlot];
+  auto& up = nodes_[iUp];
+  const auto iF = up.child[0];
+  const auto iG = up.child[1];
+
+  // upがaの親の子になる
+  up.child[0] = iA;
+  up.parent = a.parent;
+  a.parent = iUp;
+  if (up.parent == NullNode) {
+    root_ = iUp;
+  } else {
+    auto& p = nodes_[up.parent];
+    p.child[p.child[0] == iA ? 0 : 1] = iUp;
+  }
+
+  // upの高いほうの子を残し、低いほうをaのupがいた所に入れる
+  const auto fHigher = nodes_[iF].height > nodes_[iG].height;
+  const auto iKeep = fHigher ? iF : iG;
+  const auto iMove = fHigher ? iG : iF;
+  up.child[1] = iKeep;
+  a.child[upSlot] = iMove;
+  nodes_[iMove].parent = iA;
+
+  const auto& stay = nodes_[iStay];
+  const auto& move = nodes_[iMove];
+  a.box = Union(stay.box, move.box);
+  a.height = 1 + std::max(stay.height, move.height);
+  const auto& keep = nodes_[iKeep];
+  up.box = Union(a.box, keep.box);
+  up.height = 1 + std::max(a.height, keep.height);
+  return iUp;
+}
+
+void Bvh::AppendSubtree(std::uint32_t node,
+                        std::vector<std::uint32_t>* objects) const {
+  std::vector<std::uint32_t> stack;
+  stack.reserve(64);
+  stack.push_back(node);
+  while (!stack.empty()) {
+    const auto& n = nodes_[stack.back()];
+    stack.pop_back();
+    if (n.IsLeaf()) {
+      objects->push_back(n.object);
+    } else {
+      stack.push_back(n.child[0]);
+      stack.push_back(n.child[1]);
+    }
+  }
+}
+
+}  // namespace dxapp
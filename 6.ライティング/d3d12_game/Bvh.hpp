@@ -0,0 +1,195 @@
+﻿#pragma once
+// オブジェクトの箱を木にまとめて、見えるものや近くのものを全部見ずに探す
+// 葉の箱は少し太らせておき、その中で動くだけなら木は変えない
+// はみ出したら、その葉だけ抜いて入れなおす
+// D3D12には触らないので、Linuxでも動かして確かめられる
+#include <cstdint>
+#include <vector>
+
+#include "FrustumCulling.hpp"
+
+namespace dxapp {
+
+/*!
+ * @brief 軸に沿った箱
+ */
+struct Aabb {
+  float minX, minY, minZ;
+  float maxX, maxY, maxZ;
+};
+
+/*!
+ * @brief 境界の木(BVH)
+ * @details 足すときは表面積の増え方(SAH)が一番小さくなる所に入れ、
+ *          高さが偏れば回転して直す。Rebuildでまとめて作りなおすこともできる。
+ *          番号(プロキシ)は葉の番号で、消すまで変わらない
+ */
+class Bvh {
+ public:
+  //! 何もないことを表す番号
+  static constexpr std::uint32_t NullNode = 0xffffffffu;
+
+  Bvh(const Bvh&) = delete;
+  Bvh& operator=(const Bvh&) = delete;
+
+  /*!
+   * @brief コンストラクタ
+   * @param[in] margin 葉の箱を各方向に太らせる量
+   */
+  explicit Bvh(float margin = 0.1f) : margin_(margin) {}
+
+  /*!
+   * @brief 全部消す
+   */
+  void Clear();
+
+  /*!
+   * @brief オブジェクトを足す
+   * @param[in] object 問い合わせで返す番号
+   * @return プロキシ。Remove・Updateに渡す
+   */
+  std::uint32_t Insert(const Aabb& box, std::uint32_t object);
+
+  /*!
+   * @brief オブジェクトを消す
+   */
+  void Remove(std::uint32_t proxy);
+
+  /*!
+   * @brief オブジェクトの箱を変える
+   * @details 太らせた箱に収まっていれば木はそのまま
+   * @return 入れなおしたらtrue
+   */
+  bool Update(std::uint32_t proxy, const Aabb& box);
+
+  /*!
+   * @brief 今の葉から木をまとめて作りなおす
+   * @details 重心を軸ごとに区間に分け、SAHで分け方を選ぶ。
+   *          最初にたくさん足した後や、動いて木が悪くなったときに呼ぶ
+   */
+  void Rebuild();
+
+  /*!
+   * @brief 視錐台にかかるオブジェクトの番号を足す
+   * @details 全部内側の節はその下を調べずに全部足す
+   */
+  void QueryFrustum(const Frustum& frustum,
+                    std::vector<std::uint32_t>* objects) const;
+
+  /*!
+   * @brief 箱に重なるオブジェクトの番号を足す
+   */
+  void QueryBox(const Aabb& box, std::vector<std::uint32_t>* objects) const;
+
+  /*!
+   * @brief 点に一番近いオブジェクトを探す
+   * @details 距離はオブジェクトの箱までで、中にあれば0
+   * @param[in] maxDistance これより遠いものは探さない
+   * @param[out] object 見つけたオブジェクトの番号
+   * @param[out] distance その距離。nullptrでもよい
+   * @return 見つかればtrue
+   */
+  bool QueryNearest(float x, float y, float z, float maxDistance,
+                    std::uint32_t* object, float* distance) const;
+
+  /*!
+   * @brief オブジェクトの数
+   */
+  std::uint32_t size() const { return leafCount_; }
+
+  /*!
+   * @brief 木の高さ。葉だけなら0
+   */
+  std::int32_t height() const {
+    return root_ == NullNode ? 0 : nodes_[root_].height;
+  }
+
+  /*!
+   * @brief 葉でない節の表面積の和を根の表面積で割ったもの。小さいほど良い木
+   */
+  float cost() const;
+
+  /*!
+   * @brief 葉のオブジェクトの番号
+   */
+  std::uint32_t object(std::uint32_t proxy) const {
+    return nodes_[proxy].object;
+  }
+
+  /*!
+   * @brief 木のつながりを全部調べる。テストで使う
+   * @details 親と子の番号が合っているか、高さが子より1大きいか、
+   *          節の箱が子の箱を、葉の太らせた箱が元の箱を含むか、
+   *          葉と空きの数が合っているかを見る
+   * @return 全部合っていればtrue
+   */
+  bool Validate() const;
+
+ private:
+  /*!
+   * @brief 節
+   * @details 葉はchildが両方NullNodeで、boxは太らせた箱、tightは元の箱。
+   *          使っていない節はheightが-1で、parentが次の空きを指す
+   */
+  struct Node {
+    Aabb box;
+    Aabb tight;
+    std::uint32_t parent;
+    std::uint32_t child[2];
+    std::uint32_t object;
+    std::int32_t height;
+
+    bool IsLeaf() const { return child[0] == NullNode; }
+  };
+
+  std::uint32_t AllocateNode();
+  void FreeNode(std::uint32_t node);
+
+  /*!
+   * @brief 葉を一番安い所に入れる
+   */
+  void InsertLeaf(std::uint32_t leaf);
+
+  /*!
+   * @brief 葉を木から外す。葉の節は残す
+   */
+  void RemoveLeaf(std::uint32_t leaf);
+
+  /*!
+   * @brief nodeから根まで、高さと箱を直しながら回転する
+   */
+  void FixUpwards(std::uint32_t node);
+
+  /*!
+   * @brief nodeの左右の高さが2以上違えば回転する
+   * @return 回転した後にnodeの位置に来た節
+   */
+  std::uint32_t Balance(std::uint32_t node);
+
+  /*!
+   * @brief nodeの下の葉のオブジェクトを全部足す
+   */
+  void AppendSubtree(std::uint32_t node,
+                     std::vector<std::uint32_t>* objects) const;
+
+  std::vector<Node> nodes_{};
+  std::uint32_t root_{NullNode};
+  std::uint32_t freeList_{NullNode};
+  std::uint32_t leafCount_{0};
+  float margin_;
+
+  /*!
+   * @brief Rebuildで並べる葉
+   */
+  struct BuildItem {
+    Aabb box;
+    float centroid[3];  //!< 重心の2倍
+    std::uint32_t leaf;
+  };
+
+  // Rebuildの作業用。呼ぶたびに使いまわす
+  std::vector<BuildItem> buildItems_{};
+  std::vector<std::uint32_t> buildOrder_{};
+};
+
+}  // namespace dxapp
@@ -70,6 +70,16 @@ class FpsCamera {
    */
   DirectX::XMFLOAT3 position() const;
 
+  /*
+   * @brief Z̃jANbv
+   */
+  float nearZ() const { return nearZ_; }
+
+  /*
+   * @brief Z̃t@[Nbv
+   */
+  float farZ() const { return farZ_; }
+
  private:
   DirectX::XMFLOAT3 position_{0.0f, 0.0f, 0.0f};  //!< ʒu
   DirectX::XMFLOAT3 look_{0.0f, 0.0f, 1.0f};      //!< 
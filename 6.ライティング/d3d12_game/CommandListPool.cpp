@@ -0,0 +1,49 @@
+﻿#include "CommandListPool.hpp"
+
+#include "Device.hpp"
+
+namespace dxapp {
+
+void CommandListPool::Initialize(Device* device, std::uint32_t listCount,
+                                 const wchar_t* name) {
+  auto dev = device->device();
+  const auto frameCount = device->frameCount();
+
+  allocators_.resize(std::size_t(frameCount) * listCount);
+  for (auto& alloc : allocators_) {
+    auto hr = dev->CreateCommandAllocator(
+        D3D12_COMMAND_LIST_TYPE_DIRECT,
+        IID_PPV_ARGS(alloc.ReleaseAndGetAddressOf()));
+    if (FAILED(hr)) {
+      throw std::runtime_error(
+          "CommandListPool::CreateCommandAllocator Failed");
+    }
+    alloc->SetName(name);
+  }
+
+  lists_.resize(listCount);
+  for (auto& list : lists_) {
+    auto hr = dev->CreateCommandList(
+        0, D3D12_COMMAND_LIST_TYPE_DIRECT, allocators_[0].Get(), nullptr,
+        IID_PPV_ARGS(list.ReleaseAndGetAddressOf()));
+    if (FAILED(hr)) {
+      throw std::runtime_error("CommandListPool::CreateCommandList Failed");
+    }
+    list->SetName(name);
+
+    // 作ったときは記録中なので閉じておく
+    list->Close();
+  }
+}
+
+ID3D12GraphicsCommandList* CommandListPool::Begin(std::uint32_t list,
+                                                  std::uint32_t frameIndex) {
+  auto& alloc = allocators_[std::size_t(frameIndex) * lists_.size() + list];
+  alloc->Reset();
+  lists_[list]->Reset(alloc.Get(), nullptr);
+  return lists_[list].Get();
+}
+
+void CommandListPool::End(std::uint32_t list) { lists_[list]->Close(); }
+
+}  // namespace dxapp
@@ -0,0 +1,73 @@
+﻿#pragma once
+
+namespace dxapp {
+class Device;
+
+/*!
+ * @brief スレッドごとに記録するコマンドリストと、そのアロケータ
+ * @details アロケータはリストごとにフレームのスロットの数だけ持ち、
+ *          GPUが使い終わったフレームのものだけリセットする。
+ *          番号の違うリストは別々のスレッドから同時に触ってよい
+ */
+class CommandListPool {
+ public:
+  CommandListPool(const CommandListPool&) = delete;
+  CommandListPool& operator=(const CommandListPool&) = delete;
+
+  /*!
+   * @brief デフォルトコンストラクタ
+   */
+  CommandListPool() = default;
+
+  /*!
+   * @brief デストラクタ
+   */
+  ~CommandListPool() = default;
+
+  /*!
+   * @brief リストとアロケータを作る
+   * @param[in] listCount リストの数。同時に記録するスレッドの数だけいる
+   * @param[in] name デバッグ用の名前
+   */
+  void Initialize(Device* device, std::uint32_t listCount,
+                  const wchar_t* name);
+
+  /*!
+   * @brief リストの数
+   */
+  std::uint32_t listCount() const {
+    return static_cast<std::uint32_t>(lists_.size());
+  }
+
+  /*!
+   * @brief このフレームのアロケータをリセットして、リストを記録できるようにする
+   * @details Device::PrepareRenderingの後に呼ぶ。
+   *          そのフレームのGPUの処理はDeviceが待ち終えている
+   * @param[in] list リストの番号
+   * @param[in] frameIndex フレームのスロットの番号(Device::frameIndex)
+   */
+  ID3D12GraphicsCommandList* Begin(std::uint32_t list,
+                                   std::uint32_t frameIndex);
+
+  /*!
+   * @brief 記録を終える(Close)
+   */
+  void End(std::uint32_t list);
+
+  /*!
+   * @brief リストを返す
+   */
+  ID3D12GraphicsCommandList* commandList(std::uint32_t list) const {
+    return lists_[list].Get();
+  }
+
+ private:
+  template <typename T>
+  using ComPtr = Microsoft::WRL::ComPtr<T>;
+
+  //! [フレーム * listCount + リスト]のアロケータ
+  std::vector<ComPtr<ID3D12CommandAllocator>> allocators_{};
+  std::vector<ComPtr<ID3D12GraphicsCommandList>> lists_{};
+};
+
+}  // namespace dxapp
@@ -0,0 +1,292 @@
+﻿#include "DdsLayout.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace dxapp {
+namespace dds {
+
+namespace {
+// DDSTextureLoader12.cppのヘッダと同じ並び
+constexpr std::uint32_t DdsMagic = 0x20534444;  // "DDS "
+
+constexpr std::uint32_t DdsFourCC = 0x00000004;
+constexpr std::uint32_t DdsRgb = 0x00000040;
+constexpr std::uint32_t DdsHeaderFlagsVolume = 0x00800000;
+constexpr std::uint32_t DdsCubeMap = 0x00000200;
+constexpr std::uint32_t DdsCubeMapAllFaces = 0x0000fe00;
+constexpr std::uint32_t DdsMiscTextureCube = 0x4;
+
+constexpr std::uint32_t DimensionTexture1D = 2;
+constexpr std::uint32_t DimensionTexture2D = 3;
+constexpr std::uint32_t DimensionTexture3D = 4;
+
+// DXGI_FORMATの値
+constexpr std::uint32_t FormatR8G8B8A8Unorm = 28;
+constexpr std::uint32_t FormatBC1Unorm = 71;
+constexpr std::uint32_t FormatBC2Unorm = 74;
+constexpr std::uint32_t FormatBC3Unorm = 77;
+constexpr std::uint32_t FormatBC4Unorm = 80;
+constexpr std::uint32_t FormatBC5Unorm = 83;
+constexpr std::uint32_t FormatB8G8R8A8Unorm = 87;
+constexpr std::uint32_t FormatB8G8R8X8Unorm = 88;
+
+struct DdsPixelFormat {
+  std::uint32_t size;
+  std::uint32_t flags;
+  std::uint32_t fourCC;
+  std::uint32_t rgbBitCount;
+  std::uint32_t rBitMask;
+  std::uint32_t gBitMask;
+  std::uint32_t bBitMask;
+  std::uint32_t aBitMask;
+};
+
+struct DdsHeader {
+  std::uint32_t size;
+  std::uint32_t flags;
+  std::uint32_t height;
+  std::uint32_t width;
+  std::uint32_t pitchOrLinearSize;
+  std::uint32_t depth;
+  std::uint32_t mipMapCount;
+  std::uint32_t reserved1[11];
+  DdsPixelFormat ddspf;
+  std::uint32_t caps;
+  std::uint32_t caps2;
+  std::uint32_t caps3;
+  std::uint32_t caps4;
+  std::uint32_t reserved2;
+};
+
+struct DdsHeaderDxt10 {
+  std::uint32_t dxgiFormat;
+  std::uint32_t resourceDimension;
+  std::uint32_t miscFlag;
+  std::uint32_t arraySize;
+  std::uint32_t miscFlags2;
+};
+
+static_assert(sizeof(DdsHeader) == 124, "DDS Header size mismatch");
+static_assert(sizeof(DdsHeaderDxt10) == 20,
+              "DDS DX10 Extended Header size mismatch");
+
+constexpr std::uint32_t MakeFourCC(char a, char b, char c, char d) {
+  return std::uint32_t(std::uint8_t(a)) |
+         (std::uint32_t(std::uint8_t(b)) << 8) |
+         (std::uint32_t(std::uint8_t(c)) << 16) |
+         (std::uint32_t(std::uint8_t(d)) << 24);
+}
+
+/*!
+ * @brief 圧縮形式の1ブロックのバイト数。圧縮形式でなければ0
+ */
+std::uint32_t BytesPerBlock(std::uint32_t format) {
+  if ((format >= 70 && format <= 72) || (format >= 79 && format <= 81)) {
+    return 8;  // BC1とBC4
+  }
+  if ((format >= 73 && format <= 78) || (format >= 82 && format <= 84) ||
+      (format >= 94 && format <= 99)) {
+    return 16;  // BC2、BC3、BC5、BC6H、BC7
+  }
+  return 0;
+}
+
+/*!
+ * @brief 圧縮していない形式の1ピクセルのビット数。対応していなければ0
+ * @details 1ビットやYUVなど、行が単純にならないものは扱わない
+ */
+std::uint32_t BitsPerPixel(std::uint32_t format) {
+  if (format >= 1 && format <= 4) {
+    return 128;  // R32G32B32A32
+  }
+  if (format >= 5 && format <= 8) {
+    return 96;  // R32G32B32
+  }
+  if (format >= 9 && format <= 22) {
+    return 64;  // R16G16B16A16、R32G32、R32G8X24
+  }
+  if ((format >= 23 && format <= 47) || format == 67 ||
+      (format >= 87 && format <= 93)) {
+    return 32;  // R10G10B10A2、R8G8B8A8、R16G16、R32、D24S8、B8G8R8A8など
+  }
+  if ((format >= 48 && format <= 59) || format == 85 || format == 86 ||
+      format == 115) {
+    return 16;  // R8G8、R16、B5G6R5、B5G5R5A1、B4G4R4A4
+  }
+  if (format >= 60 && format <= 65) {
+    return 8;  // R8、A8
+  }
+  return 0;
+}
+
+/*!
+ * @brief DX10拡張ヘッダのないDDSのフォーマットを決める
+ * @details クッカーが書くものと、よく使われるものだけ。ほかは0を返す
+ */
+std::uint32_t GetLegacyFormat(const DdsPixelFormat& pf) {
+  if (pf.flags & DdsFourCC) {
+    switch (pf.fourCC) {
+      case MakeFourCC('D', 'X', 'T', '1'):
+        return FormatBC1Unorm;
+      case MakeFourCC('D', 'X', 'T', '2'):
+      case MakeFourCC('D', 'X', 'T', '3'):
+        return FormatBC2Unorm;
+      case MakeFourCC('D', 'X', 'T', '4'):
+      case MakeFourCC('D', 'X', 'T', '5'):
+        return FormatBC3Unorm;
+      case MakeFourCC('A', 'T', 'I', '1'):
+      case MakeFourCC('B', 'C', '4', 'U'):
+        return FormatBC4Unorm;
+      case MakeFourCC('A', 'T', 'I', '2'):
+      case MakeFourCC('B', 'C', '5', 'U'):
+        return FormatBC5Unorm;
+      default:
+        return 0;
+    }
+  }
+  if ((pf.flags & DdsRgb) && pf.rgbBitCount == 32) {
+    if (pf.rBitMask == 0x000000ff && pf.gBitMask == 0x0000ff00 &&
+        pf.bBitMask == 0x00ff0000 && pf.aBitMask == 0xff000000) {
+      return FormatR8G8B8A8Unorm;
+    }
+    if (pf.rBitMask == 0x00ff0000 && pf.gBitMask == 0x0000ff00 &&
+        pf.bBitMask == 0x000000ff) {
+      return pf.aBitMask == 0xff000000 ? FormatB8G8R8A8Unorm
+                                       : FormatB8G8R8X8Unorm;
+    }
+  }
+  return 0;
+}
+}  // namespace
+
+bool GetSurfaceInfo(std::uint32_t format, std::uint32_t width,
+                    std::uint32_t height, SurfaceInfo& info) {
+  info = {};
+  if (const auto blockBytes = BytesPerBlock(format)) {
+    const auto blocksWide = std::max<std::uint64_t>(1, (width + 3ull) / 4);
+    const auto blocksHigh = std::max<std::uint64_t>(1, (height + 3ull) / 4);
+    info.rowPitch = blocksWide * blockBytes;
+    info.rowCount = static_cast<std::uint32_t>(blocksHigh);
+  } else if (const auto bits = BitsPerPixel(format)) {
+    info.rowPitch = (std::uint64_t(width) * bits + 7) / 8;
+    info.rowCount = height;
+  } else {
+    return false;
+  }
+  info.slicePitch = info.rowPitch * info.rowCount;
+  return true;
+}
+
+bool ParseLayout(const std::uint8_t* header, std::size_t headerSize,
+                 std::uint64_t dataSize, Layout& layout) {
+  layout = {};
+  constexpr std::size_t BaseSize = sizeof(std::uint32_t) + sizeof(DdsHeader);
+  if (!header || headerSize < BaseSize || dataSize < headerSize) {
+    return false;
+  }
+
+  std::uint32_t magic = 0;
+  DdsHeader dds{};
+  std::memcpy(&magic, header, sizeof(magic));
+  std::memcpy(&dds, header + sizeof(magic), sizeof(dds));
+  if (magic != DdsMagic || dds.size != sizeof(DdsHeader) ||
+      dds.ddspf.size != sizeof(DdsPixelFormat)) {
+    return false;
+  }
+
+  layout.width = dds.width;
+  layout.height = dds.height;
+  layout.mipLevels = std::max(1u, dds.mipMapCount);
+  layout.dataOffset = BaseSize;
+
+  const bool hasDxt10 = (dds.ddspf.flags & DdsFourCC) &&
+                        dds.ddspf.fourCC == MakeFourCC('D', 'X', '1', '0');
+  if (hasDxt10) {
+    if (headerSize < BaseSize + sizeof(DdsHeaderDxt10)) {
+      return false;
+    }
+    DdsHeaderDxt10 dxt10{};
+    std::memcpy(&dxt10, header + BaseSize, sizeof(dxt10));
+    layout.dataOffset += sizeof(DdsHeaderDxt10);
+    layout.format = dxt10.dxgiFormat;
+    layout.dimension = dxt10.resourceDimension;
+    layout.arraySize = dxt10.arraySize;
+    if (layout.arraySize == 0) {
+      return false;
+    }
+    switch (layout.dimension) {
+      case DimensionTexture1D:
+        if ((dds.flags & 0x2) && layout.height != 1) {
+          return false;
+        }
+        layout.height = 1;
+        break;
+      case DimensionTexture2D:
+        if (dxt10.miscFlag & DdsMiscTextureCube) {
+          layout.arraySize *= 6;
+          layout.isCubeMap = true;
+        }
+        break;
+      case DimensionTexture3D:
+        if (!(dds.flags & DdsHeaderFlagsVolume) || layout.arraySize != 1) {
+          return false;
+        }
+        layout.depth = dds.depth;
+        break;
+      default:
+        return false;
+    }
+  } else {
+    layout.format = GetLegacyFormat(dds.ddspf);
+    if (dds.flags & DdsHeaderFlagsVolume) {
+      layout.dimension = DimensionTexture3D;
+      layout.depth = dds.depth;
+    } else {
+      layout.dimension = DimensionTexture2D;
+      if (dds.caps2 & DdsCubeMap) {
+        // 面がそろっていないキューブマップは扱わない
+        if ((dds.caps2 & DdsCubeMapAllFaces) != DdsCubeMapAllFaces) {
+          return false;
+        }
+        layout.arraySize = 6;
+        layout.isCubeMap = true;
+      }
+    }
+  }
+  if (layout.width == 0 || layout.height == 0 || layout.depth == 0) {
+    return false;
+  }
+
+  // 配列の要素ごとに、大きいミップから順にすき間なく並んでいる
+  layout.subresources.reserve(std::size_t(layout.arraySize) * layout.mipLevels);
+  auto offset = layout.dataOffset;
+  for (std::uint32_t item = 0; item < layout.arraySize; ++item) {
+    auto width = layout.width;
+    auto height = layout.height;
+    auto depth = layout.depth;
+    for (std::uint32_t mip = 0; mip < layout.mipLevels; ++mip) {
+      Subresource subresource{};
+      subresource.offset = offset;
+      subresource.width = width;
+      subresource.height = height;
+      subresource.depth = depth;
+      if (!GetSurfaceInfo(layout.format, width, height,
+                          subresource.surface)) {
+        return false;
+      }
+      offset += subresource.surface.slicePitch * depth;
+      if (offset > dataSize) {
+        return false;
+      }
+      layout.subresources.push_back(subresource);
+      width = std::max(1u, width / 2);
+      height = std::max(1u, height / 2);
+      depth = std::max(1u, depth / 2);
+    }
+  }
+  return true;
+}
+
+}  // namespace dds
+}  // namespace dxapp
@@ -0,0 +1,72 @@
+﻿#pragma once
+// DDSのヘッダを読み、サブリソースごとの位置と行ピッチを求める
+// D3D12のリソースは作らない。LZコンテナの展開先を決めるのに使う
+// Windows以外でも動くようにPngDecoderと同じく標準ライブラリだけで書いている
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dxapp {
+namespace dds {
+
+/*!
+ * @brief 1枚分の大きさ
+ */
+struct SurfaceInfo {
+  std::uint64_t rowPitch{0};    //!< 1行(圧縮形式ならブロック1行)のバイト数
+  std::uint64_t slicePitch{0};  //!< 1枚のバイト数
+  std::uint32_t rowCount{0};    //!< 行(圧縮形式ならブロックの行)の数
+};
+
+/*!
+ * @brief サブリソース1つの配置
+ */
+struct Subresource {
+  std::uint64_t offset{0};  //!< DDSの先頭からのバイト位置
+  std::uint32_t width{0};   //!< 幅
+  std::uint32_t height{0};  //!< 高さ
+  std::uint32_t depth{1};   //!< 奥行き(ボリュームテクスチャ以外は1)
+  SurfaceInfo surface{};    //!< 1枚分の大きさ
+};
+
+/*!
+ * @brief DDSの中身の並び
+ * @details サブリソースはDDSTextureLoader12と同じく配列の要素ごとにミップを並べる
+ */
+struct Layout {
+  std::uint32_t format{0};     //!< フォーマット。値はDXGI_FORMATと同じ
+  std::uint32_t dimension{0};  //!< 2なら1D、3なら2D、4なら3D
+  std::uint32_t width{0};      //!< 幅
+  std::uint32_t height{0};     //!< 高さ
+  std::uint32_t depth{1};      //!< 奥行き
+  std::uint32_t arraySize{1};  //!< 配列の要素数(キューブマップは面の数を含む)
+  std::uint32_t mipLevels{1};  //!< ミップ数
+  bool isCubeMap{false};       //!< キューブマップか
+  std::uint64_t dataOffset{0};  //!< ピクセルの始まり(ヘッダの大きさ)
+  std::vector<Subresource> subresources{};  //!< サブリソースの配置
+};
+
+/*!
+ * @brief フォーマットと大きさから1枚分の行ピッチと大きさを求める
+ * @details 圧縮形式は4x4ブロック単位で、幅や高さが4未満でも1ブロックある
+ * @param[in] format フォーマット。値はDXGI_FORMATと同じ
+ * @return 対応していないフォーマットならfalse
+ */
+bool GetSurfaceInfo(std::uint32_t format, std::uint32_t width,
+                    std::uint32_t height, SurfaceInfo& info);
+
+/*!
+ * @brief DDSのヘッダを読んで中身の並びを求める
+ * @details DX10拡張ヘッダがなければFourCCやビットマスクからフォーマットを決める。
+ *          ヘッダより後ろは読まないので、headerにはヘッダの分だけあればよい
+ * @param[in] header DDSの先頭(マジックから)
+ * @param[in] headerSize headerのバイト数
+ * @param[in] dataSize DDS全体のバイト数。全サブリソースが収まるか確かめる
+ * @param[out] layout 中身の並び
+ * @return 成否
+ */
+bool ParseLayout(const std::uint8_t* header, std::size_t headerSize,
+                 std::uint64_t dataSize, Layout& layout);
+
+}  // namespace dds
+}  // namespace dxapp
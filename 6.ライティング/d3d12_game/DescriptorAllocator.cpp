@@ -0,0 +1,133 @@
+﻿#include "DescriptorAllocator.hpp"
+
+#include "Device.hpp"
+
+namespace dxapp {
+
+void DescriptorAllocator::Initialize(Device* device,
+                                     D3D12_DESCRIPTOR_HEAP_TYPE type,
+                                     std::uint32_t persistentCount,
+                                     std::uint32_t transientCount,
+                                     bool shaderVisible, const wchar_t* name) {
+  auto dev = device->device();
+
+  D3D12_DESCRIPTOR_HEAP_DESC heapDesc{
+      type, persistentCount + transientCount,
+      shaderVisible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE
+                    : D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
+      0};
+  auto hr = dev->CreateDescriptorHeap(
+      &heapDesc, IID_PPV_ARGS(heap_.ReleaseAndGetAddressOf()));
+  if (FAILED(hr)) {
+    throw std::runtime_error("DescriptorAllocator::Initialize Failed");
+  }
+  heap_->SetName(name);
+
+  device_ = device;
+  type_ = type;
+  descriptorSize_ = dev->GetDescriptorHandleIncrementSize(type);
+  isShaderVisible_ = shaderVisible;
+  persistent_.Reset(0, persistentCount);
+  transient_.Reset(persistentCount, transientCount);
+  failedAllocations_ = 0;
+}
+
+DescriptorHandle DescriptorAllocator::Allocate(std::uint32_t count) {
+  auto index = persistent_.Allocate(count);
+  if (index == InvalidDescriptorIndex) {
+    // 解放待ちが終わっていれば空きができるかもしれない
+    ReleaseCompleted();
+    index = persistent_.Allocate(count);
+  }
+  if (index == InvalidDescriptorIndex) {
+    ++failedAllocations_;
+    return {};
+  }
+  return MakeHandle(index, count);
+}
+
+void DescriptorAllocator::Free(DescriptorHandle& handle) {
+  if (!handle.IsValid()) {
+    return;
+  }
+  persistent_.Free(handle.index, handle.count, device_->currentFenceValue());
+  handle = {};
+}
+
+DescriptorHandle DescriptorAllocator::AllocateTransient(std::uint32_t count) {
+  auto index = transient_.Allocate(count);
+  if (index == InvalidDescriptorIndex) {
+    ReleaseCompleted();
+    index = transient_.Allocate(count);
+  }
+  if (index == InvalidDescriptorIndex) {
+    ++failedAllocations_;
+    return {};
+  }
+  return MakeHandle(index, count);
+}
+
+void DescriptorAllocator::Copy(const DescriptorHandle& dst,
+                               D3D12_CPU_DESCRIPTOR_HANDLE src) {
+  if (!dst.IsValid()) {
+    return;
+  }
+  device_->device()->CopyDescriptorsSimple(dst.count, dst.cpu, src, type_);
+}
+
+void DescriptorAllocator::EndFrame() {
+  transient_.FinishFrame(device_->currentFenceValue());
+  ReleaseCompleted();
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::cpuHandle(
+    std::uint32_t index) const {
+  return CD3DX12_CPU_DESCRIPTOR_HANDLE(
+      heap_->GetCPUDescriptorHandleForHeapStart(), index, descriptorSize_);
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE DescriptorAllocator::gpuHandle(
+    std::uint32_t index) const {
+  if (!isShaderVisible_) {
+    return {};
+  }
+  return CD3DX12_GPU_DESCRIPTOR_HANDLE(
+      heap_->GetGPUDescriptorHandleForHeapStart(), index, descriptorSize_);
+}
+
+DescriptorStats DescriptorAllocator::stats() const {
+  DescriptorStats stats{};
+  stats.persistentCapacity = persistent_.capacity();
+  stats.persistentUsed = persistent_.usedCount();
+  stats.persistentPending = persistent_.pendingCount();
+  stats.freeBlocks = persistent_.freeBlockCount();
+  stats.largestFreeBlock = persistent_.largestFreeBlock();
+  const auto freeCount = stats.persistentCapacity - stats.persistentUsed;
+  if (freeCount > 0) {
+    stats.fragmentation =
+        1.0f - static_cast<float>(stats.largestFreeBlock) / freeCount;
+  }
+  stats.transientCapacity = transient_.capacity();
+  stats.transientUsed = transient_.usedCount();
+  stats.transientPeak = transient_.peakCount();
+  stats.failedAllocations = failedAllocations_;
+  return stats;
+}
+
+void DescriptorAllocator::ReleaseCompleted() {
+  const auto completed = device_->completedFenceValue();
+  persistent_.ReleaseCompleted(completed);
+  transient_.ReleaseCompleted(completed);
+}
+
+DescriptorHandle DescriptorAllocator::MakeHandle(std::uint32_t index,
+                                                 std::uint32_t count) const {
+  DescriptorHandle handle{};
+  handle.cpu = cpuHandle(index);
+  handle.gpu = gpuHandle(index);
+  handle.index = index;
+  handle.count = count;
+  return handle;
+}
+
+}  // namespace dxapp
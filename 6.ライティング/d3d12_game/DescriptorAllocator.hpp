@@ -0,0 +1,148 @@
+﻿#pragma once
+#include "DescriptorRange.hpp"
+
+namespace dxapp {
+class Device;
+
+/*!
+ * @brief 割り当てたデスクリプタの位置
+ */
+struct DescriptorHandle {
+  D3D12_CPU_DESCRIPTOR_HANDLE cpu{};  //!< 先頭のCPUハンドル
+  D3D12_GPU_DESCRIPTOR_HANDLE gpu{};  //!< 先頭のGPUハンドル。シェーダから見えないヒープでは0
+  std::uint32_t index{InvalidDescriptorIndex};  //!< ヒープの先頭からの位置
+  std::uint32_t count{0};                       //!< 連続している個数
+
+  bool IsValid() const { return index != InvalidDescriptorIndex; }
+};
+
+/*!
+ * @brief デスクリプタヒープの使用状況
+ */
+struct DescriptorStats {
+  std::uint32_t persistentCapacity{0};  //!< 長く使う領域の大きさ
+  std::uint32_t persistentUsed{0};      //!< 長く使う領域の使用中(解放待ちも含む)
+  std::uint32_t persistentPending{0};   //!< GPUの終了待ちで解放できていない個数
+  std::uint32_t freeBlocks{0};          //!< 空きの塊の数
+  std::uint32_t largestFreeBlock{0};    //!< 一番大きい空き
+  float fragmentation{0.0f};  //!< 1 - 一番大きい空き / 空きの合計。0なら1か所にまとまっている
+  std::uint32_t transientCapacity{0};  //!< フレームごとの領域の大きさ
+  std::uint32_t transientUsed{0};      //!< フレームごとの領域の使用中
+  std::uint32_t transientPeak{0};      //!< フレームごとの領域の使用中の最大
+  std::uint64_t failedAllocations{0};  //!< 空きがなくて失敗した回数
+};
+
+/*!
+ * @brief デスクリプタヒープ1つを割り当てて使うクラス
+ * @details ヒープの前半はテクスチャのSRVのように長く使うもの(空きリスト)、
+ *          後半は1フレームだけ使うもの(リングバッファ)に分けている。
+ *          どちらもDeviceのフェンス値でGPUが使い終わるのを待ってから再利用する。
+ *          シェーダから見えないヒープは作業用で、CopyでGPUから見えるヒープに写す。
+ *          描画スレッドからだけ呼ぶ
+ */
+class DescriptorAllocator {
+ public:
+  DescriptorAllocator(const DescriptorAllocator&) = delete;
+  DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+  /*!
+   * @brief デフォルトコンストラクタ
+   */
+  DescriptorAllocator() = default;
+
+  /*!
+   * @brief デストラクタ
+   */
+  ~DescriptorAllocator() = default;
+
+  /*!
+   * @brief ヒープを作る
+   * @param[in] type ヒープの種類
+   * @param[in] persistentCount 長く使う領域の個数
+   * @param[in] transientCount フレームごとの領域の個数
+   * @param[in] shaderVisible シェーダから見えるヒープにするか
+   * @param[in] name デバッグ用の名前
+   */
+  void Initialize(Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type,
+                  std::uint32_t persistentCount, std::uint32_t transientCount,
+                  bool shaderVisible, const wchar_t* name);
+
+  /*!
+   * @brief 長く使う位置を取る
+   * @return 空きがなければIsValid()がfalse
+   */
+  DescriptorHandle Allocate(std::uint32_t count = 1);
+
+  /*!
+   * @brief 長く使う位置を返す
+   * @details 今記録しているフレームをGPUが終えてから再利用する。
+   *          handleは無効な値にする
+   */
+  void Free(DescriptorHandle& handle);
+
+  /*!
+   * @brief このフレームだけ使う位置を取る
+   * @details 返す必要はない。EndFrameの後、GPUがそのフレームを終えたら再利用する
+   * @return 空きがなければIsValid()がfalse
+   */
+  DescriptorHandle AllocateTransient(std::uint32_t count = 1);
+
+  /*!
+   * @brief ほかのヒープ(シェーダから見えないもの)からデスクリプタを写す
+   * @param[in] dst このヒープの写し先
+   * @param[in] src 写し元の先頭。dst.count個写す
+   */
+  void Copy(const DescriptorHandle& dst, D3D12_CPU_DESCRIPTOR_HANDLE src);
+
+  /*!
+   * @brief フレームの終わり。コマンドを記録し終えてから呼ぶ
+   * @details このフレームで取った一時的な位置にフェンス値を付け、
+   *          GPUが終わった分を空きに戻す
+   */
+  void EndFrame();
+
+  /*!
+   * @brief ヒープ
+   */
+  ID3D12DescriptorHeap* heap() const { return heap_.Get(); }
+
+  /*!
+   * @brief ヒープの先頭からindex番目のCPUハンドル
+   */
+  D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle(std::uint32_t index) const;
+
+  /*!
+   * @brief ヒープの先頭からindex番目のGPUハンドル
+   */
+  D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle(std::uint32_t index) const;
+
+  /*!
+   * @brief デスクリプタ1個の大きさ
+   */
+  UINT descriptorSize() const { return descriptorSize_; }
+
+  /*!
+   * @brief 使用状況
+   */
+  DescriptorStats stats() const;
+
+ private:
+  /*!
+   * @brief GPUが終えた解放を空きに戻す
+   */
+  void ReleaseCompleted();
+
+  DescriptorHandle MakeHandle(std::uint32_t index, std::uint32_t count) const;
+
+  Device* device_{nullptr};
+  Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> heap_{};
+  D3D12_DESCRIPTOR_HEAP_TYPE type_{D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV};
+  UINT descriptorSize_{0};
+  bool isShaderVisible_{false};
+
+  DescriptorFreeList persistent_{};  //!< 長く使う領域
+  DescriptorRing transient_{};       //!< フレームごとの領域
+  std::uint64_t failedAllocations_{0};
+};
+
+}  // namespace dxapp
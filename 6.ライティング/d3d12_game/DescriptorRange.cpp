@@ -0,0 +1,168 @@
+﻿#include "DescriptorRange.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace dxapp {
+
+//-------------------------------------------------------------------
+// DescriptorFreeList
+//-------------------------------------------------------------------
+void DescriptorFreeList::Reset(std::uint32_t base, std::uint32_t capacity) {
+  base_ = base;
+  capacity_ = capacity;
+  freeCount_ = capacity;
+  pendingCount_ = 0;
+  freeBlocks_.clear();
+  pending_.clear();
+  if (capacity > 0) {
+    freeBlocks_.emplace(base, capacity);
+  }
+}
+
+std::uint32_t DescriptorFreeList::Allocate(std::uint32_t count) {
+  if (count == 0 || count > freeCount_) {
+    return InvalidDescriptorIndex;
+  }
+
+  // 収まる中で一番小さい空き。ぴったりならそこで終わり
+  auto best = std::end(freeBlocks_);
+  for (auto it = std::begin(freeBlocks_); it != std::end(freeBlocks_); ++it) {
+    if (it->second >= count &&
+        (best == std::end(freeBlocks_) || it->second < best->second)) {
+      best = it;
+      if (it->second == count) {
+        break;
+      }
+    }
+  }
+  if (best == std::end(freeBlocks_)) {
+    return InvalidDescriptorIndex;
+  }
+
+  // 前から取って残りを空きに戻す
+  const auto index = best->first;
+  const auto rest = best->second - count;
+  const auto hint = freeBlocks_.erase(best);
+  if (rest > 0) {
+    freeBlocks_.emplace_hint(hint, index + count, rest);
+  }
+  freeCount_ -= count;
+  return index;
+}
+
+void DescriptorFreeList::Free(std::uint32_t index, std::uint32_t count,
+                              std::uint64_t fenceValue) {
+  if (count == 0 || index == InvalidDescriptorIndex) {
+    return;
+  }
+  assert(index >= base_ && index + count <= base_ + capacity_);
+  if (fenceValue == 0) {
+    Insert(index, count);
+    return;
+  }
+  pending_.push_back({index, count, fenceValue});
+  pendingCount_ += count;
+}
+
+void DescriptorFreeList::ReleaseCompleted(std::uint64_t completedFenceValue) {
+  // フェンス値は解放した順に増えていくので、前から見て止まったところで終わり
+  while (!pending_.empty() &&
+         pending_.front().fenceValue <= completedFenceValue) {
+    const auto free = pending_.front();
+    pending_.pop_front();
+    pendingCount_ -= free.count;
+    Insert(free.index, free.count);
+  }
+}
+
+std::uint32_t DescriptorFreeList::largestFreeBlock() const {
+  std::uint32_t largest = 0;
+  for (const auto& block : freeBlocks_) {
+    largest = std::max(largest, block.second);
+  }
+  return largest;
+}
+
+void DescriptorFreeList::Insert(std::uint32_t index, std::uint32_t count) {
+  freeCount_ += count;
+
+  // 後ろの空きとつながるなら取り込む
+  auto next = freeBlocks_.lower_bound(index);
+  assert(next == std::end(freeBlocks_) || next->first >= index + count);
+  if (next != std::end(freeBlocks_) && next->first == index + count) {
+    count += next->second;
+    next = freeBlocks_.erase(next);
+  }
+
+  // 前の空きとつながるならそちらを伸ばす
+  if (next != std::begin(freeBlocks_)) {
+    auto prev = std::prev(next);
+    assert(prev->first + prev->second <= index);
+    if (prev->first + prev->second == index) {
+      prev->second += count;
+      return;
+    }
+  }
+  freeBlocks_.emplace_hint(next, index, count);
+}
+
+//-------------------------------------------------------------------
+// DescriptorRing
+//-------------------------------------------------------------------
+void DescriptorRing::Reset(std::uint32_t base, std::uint32_t capacity) {
+  base_ = base;
+  capacity_ = capacity;
+  head_ = 0;
+  used_ = 0;
+  frameUsed_ = 0;
+  peak_ = 0;
+  frames_.clear();
+}
+
+std::uint32_t DescriptorRing::Allocate(std::uint32_t count) {
+  if (count == 0 || count > capacity_) {
+    return InvalidDescriptorIndex;
+  }
+
+  // 全部空いていれば先頭から取り直す。headが途中にあるままだと、
+  // 空いているのにheadの前後どちらにも収まらない大きさを断ってしまう
+  if (used_ == 0) {
+    head_ = 0;
+  }
+
+  // 解放はフレームの順なので、空きはheadから使用中の先頭までつながっている
+  // 末尾に収まらなければそこは飛ばして先頭から取る
+  const auto padding = head_ + count > capacity_ ? capacity_ - head_ : 0;
+  if (used_ + padding + count > capacity_) {
+    return InvalidDescriptorIndex;
+  }
+  if (padding > 0) {
+    head_ = 0;
+  }
+  const auto index = head_;
+  head_ = (head_ + count) % capacity_;
+  used_ += padding + count;
+  frameUsed_ += padding + count;
+  peak_ = std::max(peak_, used_);
+  return base_ + index;
+}
+
+void DescriptorRing::FinishFrame(std::uint64_t fenceValue) {
+  if (frameUsed_ == 0) {
+    return;
+  }
+  frames_.push_back({fenceValue, frameUsed_});
+  frameUsed_ = 0;
+}
+
+void DescriptorRing::ReleaseCompleted(std::uint64_t completedFenceValue) {
+  while (!frames_.empty() &&
+         frames_.front().fenceValue <= completedFenceValue) {
+    used_ -= frames_.front().count;
+    frames_.pop_front();
+  }
+}
+
+}  // namespace dxapp
@@ -0,0 +1,171 @@
+﻿#pragma once
+// デスクリプタヒープの中の位置の割り当て
+// 長く使うもの(テクスチャのSRVなど)は空きリストから、
+// 1フレームだけ使うものはリングバッファから取る。
+// どちらもGPUが使い終わるまで再利用しないように、解放をフェンス値で遅らせる
+// D3D12には触らないので、Linuxでも動かして確かめられる
+#include <cstdint>
+#include <deque>
+#include <map>
+
+namespace dxapp {
+
+//! 割り当てに失敗したときの位置
+constexpr std::uint32_t InvalidDescriptorIndex = 0xffffffff;
+
+/*!
+ * @brief 空きリストで連続した位置を割り当てる
+ * @details 空きは開始位置順に持っていて、解放したときに前後の空きとつなげる
+ */
+class DescriptorFreeList {
+ public:
+  DescriptorFreeList() = default;
+
+  /*!
+   * @brief コンストラクタ
+   * @param[in] base 管理する範囲の先頭
+   * @param[in] capacity 管理する個数
+   */
+  DescriptorFreeList(std::uint32_t base, std::uint32_t capacity) {
+    Reset(base, capacity);
+  }
+
+  /*!
+   * @brief 全部を空きにする
+   */
+  void Reset(std::uint32_t base, std::uint32_t capacity);
+
+  /*!
+   * @brief count個連続した位置を取る
+   * @details 収まる空きのうち一番小さいものから取る(大きい空きを残す)
+   * @return 先頭の位置。空きがなければInvalidDescriptorIndex
+   */
+  std::uint32_t Allocate(std::uint32_t count);
+
+  /*!
+   * @brief 解放する
+   * @details GPUがfenceValueまで進んでから空きに戻す。0ならすぐに戻す
+   */
+  void Free(std::uint32_t index, std::uint32_t count, std::uint64_t fenceValue);
+
+  /*!
+   * @brief completedFenceValueまで終わった解放を空きに戻す
+   */
+  void ReleaseCompleted(std::uint64_t completedFenceValue);
+
+  std::uint32_t capacity() const { return capacity_; }
+
+  /*!
+   * @brief 使用中の個数。解放待ちも含む
+   */
+  std::uint32_t usedCount() const { return capacity_ - freeCount_; }
+
+  /*!
+   * @brief 解放待ちの個数
+   */
+  std::uint32_t pendingCount() const { return pendingCount_; }
+
+  /*!
+   * @brief 空きの塊の数
+   */
+  std::uint32_t freeBlockCount() const {
+    return static_cast<std::uint32_t>(freeBlocks_.size());
+  }
+
+  /*!
+   * @brief 一番大きい空きの個数。一度に取れる最大の個数
+   */
+  std::uint32_t largestFreeBlock() const;
+
+ private:
+  /*!
+   * @brief 空きに戻して前後とつなげる
+   */
+  void Insert(std::uint32_t index, std::uint32_t count);
+
+  //! 解放待ち
+  struct PendingFree {
+    std::uint32_t index;
+    std::uint32_t count;
+    std::uint64_t fenceValue;  //!< GPUがここまで進んだら空きに戻す
+  };
+
+  std::uint32_t base_{0};
+  std::uint32_t capacity_{0};
+  std::uint32_t freeCount_{0};     //!< 空きの合計
+  std::uint32_t pendingCount_{0};  //!< 解放待ちの合計
+  std::map<std::uint32_t, std::uint32_t> freeBlocks_{};  //!< 開始位置→個数
+  std::deque<PendingFree> pending_{};  //!< 解放した順(フェンス値の小さい順)
+};
+
+/*!
+ * @brief フレームごとに前から詰めて割り当てるリングバッファ
+ * @details 個別には解放しない。FinishFrameでそのフレームの分にフェンス値を付け、
+ *          GPUが終わったらフレーム単位でまとめて空きに戻す
+ */
+class DescriptorRing {
+ public:
+  DescriptorRing() = default;
+
+  /*!
+   * @brief コンストラクタ
+   * @param[in] base 管理する範囲の先頭
+   * @param[in] capacity 管理する個数
+   */
+  DescriptorRing(std::uint32_t base, std::uint32_t capacity) {
+    Reset(base, capacity);
+  }
+
+  /*!
+   * @brief 全部を空きにする
+   */
+  void Reset(std::uint32_t base, std::uint32_t capacity);
+
+  /*!
+   * @brief count個連続した位置を取る
+   * @details 末尾に収まらなければ先頭に戻る。飛ばした分もこのフレームの使用分になる。
+   *          全部空いているときは先頭から取るので、capacity個まで必ず取れる
+   * @return 先頭の位置。空きがなければInvalidDescriptorIndex
+   */
+  std::uint32_t Allocate(std::uint32_t count);
+
+  /*!
+   * @brief このフレームの割り当てを締める
+   * @param[in] fenceValue このフレームのコマンドが終わったときのフェンス値
+   */
+  void FinishFrame(std::uint64_t fenceValue);
+
+  /*!
+   * @brief completedFenceValueまで終わったフレームの分を空きに戻す
+   */
+  void ReleaseCompleted(std::uint64_t completedFenceValue);
+
+  std::uint32_t capacity() const { return capacity_; }
+
+  /*!
+   * @brief 使用中の個数。GPUが終わっていないフレームの分も含む
+   */
+  std::uint32_t usedCount() const { return used_; }
+
+  /*!
+   * @brief 使用中の個数の最大
+   */
+  std::uint32_t peakCount() const { return peak_; }
+
+ private:
+  //! 締めたフレーム
+  struct Frame {
+    std::uint64_t fenceValue;
+    std::uint32_t count;  //!< このフレームで進んだ個数
+  };
+
+  std::uint32_t base_{0};
+  std::uint32_t capacity_{0};
+  std::uint32_t head_{0};       //!< 次に割り当てる位置(baseからの相対)
+  std::uint32_t used_{0};       //!< 使用中の個数
+  std::uint32_t frameUsed_{0};  //!< 締めていないフレームの個数
+  std::uint32_t peak_{0};
+  std::deque<Frame> frames_{};  //!< GPUの終了待ちのフレーム
+};
+
+}  // namespace dxapp
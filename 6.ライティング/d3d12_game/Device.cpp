@@ -21,7 +21,15 @@ Device::~Device() {
 #endif
 }
 
-void Device::Initialize(HWND hWnd, std::uint32_t width, std::uint32_t height) {
+void Device::Initialize(HWND hWnd, std::uint32_t width, std::uint32_t height,
+                        std::uint32_t frameCount) {
+  // フレームのスロットの数だけバックバッファも用意する
+  // フリップモデルのスワップチェインは2枚より少なくできない。
+  // 1スロットだと毎フレーム自分の終わりを待つことになり、CPUとGPUが重ならない
+  frameCount_ = std::clamp(frameCount, 2u, MaxFrameCount);
+  backBufferSize_ = frameCount_;
+  frameIndex_ = 0;
+
   CreateDevice();
 
   // 描画命令を生成・積み込みに使うオブジェクトを作ります
@@ -51,7 +59,8 @@ void Device::Initialize(HWND hWnd, std::uint32_t width, std::uint32_t height) {
   // コマンドリストを作るにはコマンドリストの種類に応じたメモリアロケータがいる
   // コマンド生成時にアロケータがメモリを割り当てていくよ
   {
-    for (auto& alloc : commandAllocators_) {
+    for (std::uint32_t i = 0; i < frameCount_; ++i) {
+      auto& alloc = commandAllocators_[i];
       auto hr = device_->CreateCommandAllocator(
           D3D12_COMMAND_LIST_TYPE_DIRECT,  // 生成するコマンドリストの種類を指定
           IID_PPV_ARGS(alloc.ReleaseAndGetAddressOf()));  // 受け取る変数
@@ -87,6 +96,15 @@ void Device::Initialize(HWND hWnd, std::uint32_t width, std::uint32_t height) {
 
     // コマンドリストは使う前に必ずCloseする必要がある！忘れないでね
     graphicsCommandList_->Close();
+
+    hr = device_->CreateCommandList(
+        0, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocators_[0].Get(), nullptr,
+        IID_PPV_ARGS(presentCommandList_.ReleaseAndGetAddressOf()));
+    if (FAILED(hr)) {
+      throw std::runtime_error("Device::CreateCommandList Failed");
+    }
+    presentCommandList_->SetName(L"Device::PresentCommandList");
+    presentCommandList_->Close();
   }
 
   // フェンスの作成
@@ -263,8 +281,10 @@ void Device::CreateDevice() {
 
 void Device::CreateFence() {
   // フェンスオブジェクトを作ります
+  // まだどのスロットも使っていないので、0から始めてすぐ使えるようにしておく
+  frameFenceValues_.fill(0);
   auto hr = device_->CreateFence(
-      fenceValues_[backBufferIndex_],  // フェンスの初期値
+      0,                      // フェンスの初期値
       D3D12_FENCE_FLAG_NONE,  // 通常はD3D12_FENCE_FLAG_NONEでよい
       IID_PPV_ARGS(fence_.ReleaseAndGetAddressOf()));  // 受け取る変数
   if (FAILED(hr)) {
@@ -273,7 +293,7 @@ void Device::CreateFence() {
   fence_->SetName(L"Device::ID3D12Fence");
 
   // 次回のフェンス値を設定
-  fenceValues_[backBufferIndex_]++;
+  nextFenceValue_ = 1;
 
   // GPUの処理が終わるの待機するために使います
   fenceEvent_.Attach(
@@ -287,10 +307,10 @@ void Device::CreateSwapChain(HWND hWnd, std::uint32_t width,
                              std::uint32_t height, DXGI_FORMAT format) {
   WaitForGPU();
 
-  // レンダーターゲットテクスチャとフェンス値をきれいにしておく
-  for (int i = 0; i < MaxBackBufferSize_; i++) {
-    renderTargets_[i].Reset();
-    fenceValues_[i] = fenceValues_[backBufferIndex_];
+  // レンダーターゲットテクスチャをきれいにしておく
+  // GPUは待ち終えているので、どのスロットのフェンス値ももう通り過ぎている
+  for (auto& renderTarget : renderTargets_) {
+    renderTarget.Reset();
   }
 
   // スワップチェインの定義を記述
@@ -399,7 +419,7 @@ void Device::WaitForGPU() {
   if (commandQueue_ && fence_ && fenceEvent_.IsValid()) {
     // 現在のフェンス値をローカルにコピー
     // ローカルにコピーしたほうが速度面で有利とのうわさ(検証してない)
-    auto currentValue = fenceValues_[backBufferIndex_];
+    auto currentValue = nextFenceValue_;
 
     // キューに積んだコマンドの実行完了を待ちます
 
@@ -415,51 +435,70 @@ void Device::WaitForGPU() {
         WaitForSingleObjectEx(fenceEvent_.Get(), INFINITE, FALSE);
 
         // 次回の処理のためにフェンス値を増やしておく
-        fenceValues_[backBufferIndex_]++;
+        // どのスロットもこの値より前なので、もう待たなくてよい
+        nextFenceValue_++;
       }
     }
   }
 }
 
-void Device::WaitForRenderingCompletion() {
-  // キューにシグナルを送る
-  const auto currentValue = fenceValues_[backBufferIndex_];
+void Device::MoveToNextFrame() {
+  // キューにシグナルを送る。今のスロットはこの値が書かれたら再利用できる
+  const auto currentValue = nextFenceValue_;
   commandQueue_->Signal(fence_.Get(), currentValue);
+  frameFenceValues_[frameIndex_] = currentValue;
+  nextFenceValue_ = currentValue + 1;
 
-  // バックバッファが切り替わっているので新しいインデックスをもらう
+  // 次のスロットに進む。バックバッファも切り替わっているので新しいインデックスをもらう
+  frameIndex_ = (frameIndex_ + 1) % frameCount_;
   backBufferIndex_ = swapChain_->GetCurrentBackBufferIndex();
 
+  // 待つのは次のスロットを前に使ったフレームだけ。frameCount_ - 1フレーム前なので、
+  // その後に送ったフレームはGPUが描いている間にCPUが次のフレームを作れる
   // 処理速度によってはここに到達した時点で描画が終わりフェンス値が更新されている可能性もある
   // その状態でWaitForSingleObjectExをすると無限に待つことになるぞ。
   // そうならないようにGetCompletedValueでフェンスの現在値を確認する。
-  if (fence_->GetCompletedValue() < fenceValues_[backBufferIndex_]) {
+  const auto waitValue = frameFenceValues_[frameIndex_];
+  if (fence_->GetCompletedValue() < waitValue) {
     // まだ描画が終わっていないので待つ必要がある
-    fence_->SetEventOnCompletion(fenceValues_[backBufferIndex_],
-                                 fenceEvent_.Get());
+    fence_->SetEventOnCompletion(waitValue, fenceEvent_.Get());
     WaitForSingleObjectEx(fenceEvent_.Get(), INFINITE, FALSE);
   }
-  // 次のフレームのためにフェンス値更新
-  fenceValues_[backBufferIndex_] = currentValue + 1;
 }
 
-void Device::Present() {
-  D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(
-      renderTargets_[backBufferIndex_].Get(),
-      D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
-  graphicsCommandList_->ResourceBarrier(1, &barrier);
+void Device::Present(const D3D12_RESOURCE_BARRIER* barriers, UINT count) {
+  // ExecuteはID3D12CommandListの配列で渡す
+  std::vector<ID3D12CommandList*> lists{graphicsCommandList_.Get()};
+  if (queuedCommandLists_.empty()) {
+    if (count > 0) {
+      graphicsCommandList_->ResourceBarrier(count, barriers);
+    }
+
+    // コマンドリストはCloseしておかないと実行できませんよ
+    graphicsCommandList_->Close();
+  } else {
+    graphicsCommandList_->Close();
+
+    // 追加されたリストが描き終わってからPRESENTに戻す
+    // アロケータは記録中のリストがなくなったので使いまわせる
+    presentCommandList_->Reset(commandAllocators_[frameIndex_].Get(),
+                               nullptr);
+    if (count > 0) {
+      presentCommandList_->ResourceBarrier(count, barriers);
+    }
+    presentCommandList_->Close();
 
-  // コマンドリストはCloseしておかないと実行できませんよ
-  graphicsCommandList_->Close();
+    lists.insert(std::end(lists), std::begin(queuedCommandLists_),
+                 std::end(queuedCommandLists_));
+    lists.push_back(presentCommandList_.Get());
+    queuedCommandLists_.clear();
+  }
 
   // ここでやっとGPUに描画処理をさせる
-  // ExecuteはID3D12CommandListじゃないとダメなのでキャストしてるだけ
-  auto cl = reinterpret_cast<ID3D12CommandList* const*>(
-      graphicsCommandList_.GetAddressOf());
-
   // キューに積まれたコマンドを実行する
-  commandQueue_->ExecuteCommandLists(
-      1,  // キューには複数のリストが詰めるので実行するリスト数を指定
-      cl);
+  // キューには複数のリストが詰めるので実行するリスト数を指定
+  commandQueue_->ExecuteCommandLists(static_cast<UINT>(lists.size()),
+                                     lists.data());
 
   // スワップチェインの内容を切り替える
   swapChain_->Present(
@@ -467,25 +506,23 @@ void Device::Present() {
       0);  // とりあえず0でよい
 
   // しかしExecuteCommandLists / PresentもGPUに「働け！」と指示しているだけ。
-  // つまり非同期実行なので、描画がおわるのをまって次回のフレームに進む必要がある
-  WaitForRenderingCompletion();
+  // つまり非同期実行なので、次に使うスロットのフレームが終わるのをまって進む
+  MoveToNextFrame();
+}
+
+void Device::QueueCommandList(ID3D12CommandList* commandList) {
+  queuedCommandLists_.push_back(commandList);
 }
 
 void Device::ResetCommandList() {
   // アロケータとコマンドリストをリセットして前の内容を忘れるよ
-  commandAllocators_[backBufferIndex_]->Reset();
-  graphicsCommandList_->Reset(commandAllocators_[backBufferIndex_].Get(),
+  // このスロットのフレームはMoveToNextFrameで待ち終えている
+  commandAllocators_[frameIndex_]->Reset();
+  graphicsCommandList_->Reset(commandAllocators_[frameIndex_].Get(),
                               nullptr);
 }
 
-void Device::PrepareRendering() {
-  ResetCommandList();
-  D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(
-      renderTargets_[backBufferIndex_].Get(), D3D12_RESOURCE_STATE_PRESENT,
-      D3D12_RESOURCE_STATE_RENDER_TARGET);
-  // リソースバリアを設定
-  graphicsCommandList_->ResourceBarrier(1, &barrier);
-}
+void Device::PrepareRendering() { ResetCommandList(); }
 
 ID3D12Device* Device::device() const { return device_.Get(); }
 
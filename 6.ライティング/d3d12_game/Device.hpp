@@ -6,6 +6,10 @@ namespace dxapp {
  */
 class Device {
  public:
+  //! 同時にGPUに送っておけるフレームの数の最大と既定値
+  static constexpr std::uint32_t MaxFrameCount{3};
+  static constexpr std::uint32_t DefaultFrameCount{2};
+
   /*!
    * @brief コンストラクタ
    */
@@ -58,6 +62,31 @@ class Device {
    */
   std::uint32_t backBufferSize() const { return backBufferSize_; }
 
+  /*!
+   * @brief 今記録しているフレームのスロットの番号を返す
+   * @details フレームごとに書き換える定数バッファやアロケータはこの番号で選ぶ。
+   *          バックバッファの番号とは別に、0から順に回る
+   */
+  std::uint32_t frameIndex() const { return frameIndex_; }
+
+  /*!
+   * @brief 同時にGPUに送っておけるフレームの数(フレームのスロットの数)を返す
+   */
+  std::uint32_t frameCount() const { return frameCount_; }
+
+  /*!
+   * @brief 今記録しているフレームのコマンドが終わったときにフェンスに書かれる値
+   * @details GPUが使い終わるのを待ってから再利用したいものに付けておく
+   */
+  std::uint64_t currentFenceValue() const { return nextFenceValue_; }
+
+  /*!
+   * @brief GPUが終えたフェンス値
+   */
+  std::uint64_t completedFenceValue() const {
+    return fence_->GetCompletedValue();
+  }
+
   /*!
    * @brief D3D12デバイスを返す
    */
@@ -73,6 +102,18 @@ class Device {
    */
   CD3DX12_CPU_DESCRIPTOR_HANDLE currentRenderTargetView() const;
 
+  /*!
+   * @brief カレントレンダーターゲット(バックバッファ)を返す
+   */
+  ID3D12Resource* currentRenderTarget() const {
+    return renderTargets_[backBufferIndex_].Get();
+  }
+
+  /*!
+   * @brief デバイスが持ってるデプスバッファを返す
+   */
+  ID3D12Resource* depthStencil() const { return depthStencil_.Get(); }
+
   /*!
    * @brief デバイスが持ってるデプスバッファのビューを返す
    */
@@ -93,13 +134,28 @@ class Device {
    * @pram[in] hWnd  ウィンドウハンドル
    * @pram[in] width クライアントの幅
    * @pram[in] height クライアントの高さ
+   * @pram[in] frameCount 同時にGPUに送っておけるフレームの数。2からMaxFrameCount。
+   *                      範囲の外の値はその範囲に収める
    */
-  void Initialize(HWND hWnd, std::uint32_t width, std::uint32_t height);
+  void Initialize(HWND hWnd, std::uint32_t width, std::uint32_t height,
+                  std::uint32_t frameCount = DefaultFrameCount);
 
   /*!
    * @brief キューのコマンドをGPUに実行させてスワップチェインを切り替える
+   * @details バックバッファをPRESENTに戻すバリアはレンダーグラフが作って渡す。
+   *          QueueCommandListで追加したリストの後に積む
+   * @param[in] barriers 最後に積むバリア
+   * @param[in] count バリアの数
+   */
+  void Present(const D3D12_RESOURCE_BARRIER* barriers, UINT count);
+
+  /*!
+   * @brief Presentで実行するコマンドリストを追加する
+   * @details graphicsCommandListの後に、追加した順で実行する。
+   *          全部まとめて1回のExecuteCommandListsで送る。
+   *          ほかのスレッドで記録してCloseしたリストを渡す
    */
-  void Present();
+  void QueueCommandList(ID3D12CommandList* commandList);
 
   /*!
    * @brief コマンドリストをリセットする
@@ -108,14 +164,10 @@ class Device {
 
   /*!
    * @brief 次回の描画処理ための準備をする
+   * @details バックバッファをレンダーターゲットにするバリアはレンダーグラフが積む
    */
   void PrepareRendering();
 
-  /*!
-   * @brief 描画処理が終わるのを待つ
-   */
-  void WaitForRenderingCompletion();
-
   /*!
    * @brief GPUの処理待ちをする
    */
@@ -128,6 +180,13 @@ class Device {
   CreateNewGraphicsCommandList();
 
  private:
+  /*!
+   * @brief 今のフレームの終わりにフェンスを書かせて、次のスロットに進む
+   * @details 次のスロットを前に使ったフレームをGPUが終えるのだけを待つ。
+   *          それより後に送ったフレームはGPUが進めている間にCPUが次を作れる
+   */
+  void MoveToNextFrame();
+
   /*!
    * @brief D3D12デバイスの作成
    */
@@ -182,9 +241,15 @@ class Device {
   //! 現在使っているバックバッファのインデックス
   std::uint32_t backBufferIndex_{0};
 
-  //! 作成するバックバッファの数
+  //! 作成するバックバッファの数。フレームの数と同じで、2より少なくはしない
   std::uint32_t backBufferSize_{2};
 
+  //! 今記録しているフレームのスロット
+  std::uint32_t frameIndex_{0};
+
+  //! フレームのスロットの数
+  std::uint32_t frameCount_{DefaultFrameCount};
+
   //! レンダーターゲット(バックバッファ)テクスチャを保持する配列
   std::array<Microsoft::WRL::ComPtr<ID3D12Resource>, MaxBackBufferSize_>
       renderTargets_{};
@@ -198,8 +263,11 @@ class Device {
   //---------------------------------------------------------------
   //! GPU処理が終わっているかを確認するために必要なフェンスオブジェクト
   ComPtr<ID3D12Fence> fence_{nullptr};
-  //! フェンスに書き込む値、バックバッファと同じぶんを用意しておく
-  std::array<UINT64, MaxBackBufferSize_> fenceValues_{};
+  //! スロットを最後に使ったフレームが終わったときにフェンスに書かれる値
+  std::array<UINT64, MaxFrameCount> frameFenceValues_{};
+
+  //! 次にフェンスに書かせる値。増えるだけで戻らない
+  UINT64 nextFenceValue_{1};
 
   //! CPU、GPUの同期処理を楽にとるために使います
   Microsoft::WRL::Wrappers::Event fenceEvent_{};
@@ -212,7 +280,8 @@ class Device {
   ComPtr<ID3D12GraphicsCommandList> graphicsCommandList_{nullptr};
 
   //! コマンドを発行するためのアロケータ（メモリを確保してくれるひと）
-  std::array<ComPtr<ID3D12CommandAllocator>, MaxBackBufferSize_>
+  //! フレームのスロットごとに持ち、そのスロットのフレームが終わってからリセットする
+  std::array<ComPtr<ID3D12CommandAllocator>, MaxFrameCount>
       commandAllocators_{};
 
   //! コマンドリストはID3D12CommandQueueに積んでGPUに送るよ
@@ -221,6 +290,13 @@ class Device {
   //! 外部でコマンドリストが必要になったときに使用する
   ComPtr<ID3D12CommandAllocator> subCommandAllcator_{};
 
+  //! QueueCommandListで追加されたリスト。Presentで実行する
+  std::vector<ID3D12CommandList*> queuedCommandLists_{};
+
+  //! 追加されたリストの後に最後のバリアを積むためのリスト
+  //! アロケータはgraphicsCommandList_と同じものを使う
+  ComPtr<ID3D12GraphicsCommandList> presentCommandList_{nullptr};
+
   //---------------------------------------------------------------
   // レンダーターゲットのデスクリプタ
   // rtvは"R"ender "T"arget "View"の略。
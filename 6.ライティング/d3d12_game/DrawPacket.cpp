@@ -0,0 +1,85 @@
+﻿#include "DrawPacket.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace {
+//! 1回に数える桁のビット数
+//! 8bitだと8回、11bitだと6回。数える表(2048個)はまだキャッシュに収まる
+constexpr std::uint32_t RadixBits = 11;
+constexpr std::uint32_t RadixSize = 1 << RadixBits;
+constexpr std::uint32_t RadixPasses = (64 + RadixBits - 1) / RadixBits;
+
+//! これより少なければ数える手間のほうが大きいので普通に並べる
+constexpr std::size_t SmallSortCount = 64;
+}  // namespace
+
+namespace dxapp {
+
+std::uint32_t QuantizeDepth(float viewZ, float nearZ, float farZ) {
+  if (!(farZ > nearZ)) {
+    return 0;
+  }
+  const auto t = (viewZ - nearZ) / (farZ - nearZ);
+  if (!(t > 0.0f)) {
+    return 0;  // 手前とNaN
+  }
+  if (t >= 1.0f) {
+    return DrawSortKeyDepthMax;
+  }
+  return static_cast<std::uint32_t>(t * DrawSortKeyDepthMax);
+}
+
+void DrawPacketSorter::Sort(std::vector<DrawPacket>* packets) {
+  const auto count = packets->size();
+  if (count < SmallSortCount) {
+    std::stable_sort(std::begin(*packets), std::end(*packets),
+                     [](const DrawPacket& a, const DrawPacket& b) {
+                       return a.key < b.key;
+                     });
+    return;
+  }
+
+  // 全部の桁の数を1回読むだけで数える
+  std::array<std::array<std::uint32_t, RadixSize>, RadixPasses> histograms{};
+  for (const auto& packet : *packets) {
+    for (std::uint32_t pass = 0; pass < RadixPasses; ++pass) {
+      ++histograms[pass][(packet.key >> (pass * RadixBits)) & (RadixSize - 1)];
+    }
+  }
+
+  scratch_.resize(count);
+  auto* src = packets;
+  auto* dst = &scratch_;
+  for (std::uint32_t pass = 0; pass < RadixPasses; ++pass) {
+    auto& histogram = histograms[pass];
+    const auto shift = pass * RadixBits;
+
+    // 全部が同じ値の桁は並びが変わらないので飛ばす
+    // 使っていない上の桁や、1種類しかないパイプラインなどがここに当たる
+    const auto digit = ((*src)[0].key >> shift) & (RadixSize - 1);
+    if (histogram[digit] == count) {
+      continue;
+    }
+
+    // 数から各値の書き込み先を決める
+    std::uint32_t offset = 0;
+    for (auto& n : histogram) {
+      const auto c = n;
+      n = offset;
+      offset += c;
+    }
+    for (const auto& packet : *src) {
+      (*dst)[histogram[(packet.key >> shift) & (RadixSize - 1)]++] = packet;
+    }
+    std::swap(src, dst);
+  }
+
+  // 最後に書いたのが作業用の領域なら入れ替える
+  if (src != packets) {
+    packets->swap(scratch_);
+  }
+}
+
+}  // namespace dxapp
@@ -0,0 +1,93 @@
+﻿#pragma once
+// 描画1回分をパス・パイプライン・マテリアル・メッシュ・深度の64bitのキーにして、
+// キーの順に並べ替えてから描く
+// D3D12には触らないので、Linuxでも動かして確かめられる
+#include <cstdint>
+#include <vector>
+
+namespace dxapp {
+
+/*!
+ * @brief 描画1回分
+ */
+struct DrawPacket {
+  std::uint64_t key;     //!< 並べ替えのキー。MakeDrawSortKeyで作る
+  std::uint32_t object;  //!< オブジェクトの番号
+};
+
+//! キーの各項目のビット数。上の項目ほど優先して並ぶ
+//! パス4 | パイプライン8 | マテリアル14 | メッシュ14 | 深度24
+constexpr std::uint32_t DrawSortKeyPassBits = 4;
+constexpr std::uint32_t DrawSortKeyPipelineBits = 8;
+constexpr std::uint32_t DrawSortKeyMaterialBits = 14;
+constexpr std::uint32_t DrawSortKeyMeshBits = 14;
+constexpr std::uint32_t DrawSortKeyDepthBits = 24;
+
+//! 深度より上のビット。ここが同じなら同じ設定で描ける
+constexpr std::uint64_t DrawSortKeyStateMask =
+    ~((std::uint64_t{1} << DrawSortKeyDepthBits) - 1);
+
+//! キーの深度の最大
+constexpr std::uint32_t DrawSortKeyDepthMax =
+    (std::uint32_t{1} << DrawSortKeyDepthBits) - 1;
+
+/*!
+ * @brief 並べ替えのキーを作る
+ * @details 各項目はビット数に収まらない分を切り捨てる。
+ *          マテリアルとメッシュにはポインタではなく小さい番号を渡す
+ * @param[in] depth QuantizeDepthで作った深度。小さいほど先に描く
+ */
+constexpr std::uint64_t MakeDrawSortKey(std::uint32_t pass,
+                                        std::uint32_t pipeline,
+                                        std::uint32_t material,
+                                        std::uint32_t mesh,
+                                        std::uint32_t depth) {
+  std::uint64_t key = pass & ((1u << DrawSortKeyPassBits) - 1);
+  key = (key << DrawSortKeyPipelineBits) |
+        (pipeline & ((1u << DrawSortKeyPipelineBits) - 1));
+  key = (key << DrawSortKeyMaterialBits) |
+        (material & ((1u << DrawSortKeyMaterialBits) - 1));
+  key = (key << DrawSortKeyMeshBits) |
+        (mesh & ((1u << DrawSortKeyMeshBits) - 1));
+  key = (key << DrawSortKeyDepthBits) | (depth & DrawSortKeyDepthMax);
+  return key;
+}
+
+/*!
+ * @brief キーからパイプラインの番号を取り出す
+ */
+constexpr std::uint32_t DrawSortKeyPipeline(std::uint64_t key) {
+  return static_cast<std::uint32_t>(
+      (key >> (DrawSortKeyDepthBits + DrawSortKeyMeshBits +
+               DrawSortKeyMaterialBits)) &
+      ((1u << DrawSortKeyPipelineBits) - 1));
+}
+
+/*!
+ * @brief ビュー空間のZをキーの深度にする
+ * @details nearZからfarZを等間隔に分ける。範囲の外は端にまとめる。
+ *          奥から描きたいパスではDrawSortKeyDepthMax - 深度を渡す
+ */
+std::uint32_t QuantizeDepth(float viewZ, float nearZ, float farZ);
+
+/*!
+ * @brief DrawPacketをキーの小さい順に並べ替える
+ * @details 11bitずつ下の桁から数えて並べる基数ソート(LSD)。
+ *          全部のパケットで同じ桁は飛ばす。
+ *          キーが同じものは入れた順のまま。
+ *          作業用の領域を持っておき、フレームをまたいで使いまわす
+ */
+class DrawPacketSorter {
+ public:
+  DrawPacketSorter() = default;
+
+  /*!
+   * @brief 並べ替える
+   */
+  void Sort(std::vector<DrawPacket>* packets);
+
+ private:
+  std::vector<DrawPacket> scratch_{};
+};
+
+}  // namespace dxapp
@@ -1628,3 +1628,171 @@ HRESULT DirectX::LoadDDSTextureFromFileEx(
 
     return hr;
 }
+
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+HRESULT DirectX::DDSMappedFile::Open(const wchar_t* fileName)
+{
+    Close();
+
+    if (!fileName)
+    {
+        return E_INVALIDARG;
+    }
+
+    // open the file
+    ScopedHandle hFile(safe_handle(CreateFile2(fileName,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        OPEN_EXISTING,
+        nullptr)));
+
+    if (!hFile)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    // Get the file size
+    FILE_STANDARD_INFO fileInfo;
+    if (!GetFileInformationByHandleEx(hFile.get(), FileStandardInfo, &fileInfo, sizeof(fileInfo)))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    // Same limit as LoadTextureDataFromMemory
+    if (fileInfo.EndOfFile.HighPart > 0)
+    {
+        return E_FAIL;
+    }
+
+    // Need at least enough data to fill the header and magic number to be a valid DDS
+    if (fileInfo.EndOfFile.LowPart < (sizeof(DDS_HEADER) + sizeof(uint32_t)))
+    {
+        return E_FAIL;
+    }
+
+    // map the whole file read-only; pages are faulted in as rows are copied
+    ScopedHandle hMapping(CreateFileMappingW(hFile.get(),
+        nullptr,
+        PAGE_READONLY,
+        0, 0,
+        nullptr));
+
+    if (!hMapping)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    auto view = MapViewOfFile(hMapping.get(), FILE_MAP_READ, 0, 0, 0);
+    if (!view)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    m_file = hFile.release();
+    m_mapping = hMapping.release();
+    m_data = static_cast<const uint8_t*>(view);
+    m_size = fileInfo.EndOfFile.LowPart;
+
+    return S_OK;
+}
+
+void DirectX::DDSMappedFile::Close() noexcept
+{
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+        m_data = nullptr;
+    }
+    if (m_mapping)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+    if (m_file)
+    {
+        CloseHandle(m_file);
+        m_file = nullptr;
+    }
+    m_size = 0;
+}
+
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+HRESULT DirectX::CreateDDSTextureFromHeader(
+    ID3D12Device* d3dDevice,
+    const uint8_t* ddsHeader,
+    size_t ddsHeaderSize,
+    size_t ddsDataSize,
+    size_t maxsize,
+    D3D12_RESOURCE_FLAGS resFlags,
+    unsigned int loadFlags,
+    ID3D12Resource** texture,
+    std::vector<D3D12_SUBRESOURCE_DATA>& subresources,
+    DDS_ALPHA_MODE* alphaMode,
+    bool* isCubeMap)
+{
+    if (texture)
+    {
+        *texture = nullptr;
+    }
+    if (alphaMode)
+    {
+        *alphaMode = DDS_ALPHA_MODE_UNKNOWN;
+    }
+    if (isCubeMap)
+    {
+        *isCubeMap = false;
+    }
+    if (!d3dDevice || !ddsHeader || !texture || ddsHeaderSize > ddsDataSize)
+    {
+        return E_INVALIDARG;
+    }
+
+    // Both headers must be present unless the whole DDS data is shorter than that
+    constexpr size_t maxHeaderSize = sizeof(uint32_t) + sizeof(DDS_HEADER) + sizeof(DDS_HEADER_DXT10);
+    if (ddsHeaderSize < std::min(ddsDataSize, maxHeaderSize))
+    {
+        return E_FAIL;
+    }
+
+    // Validation only reads the headers, and the sizes are checked against the whole data
+    const DDS_HEADER* header = nullptr;
+    const uint8_t* bitData = nullptr;
+    size_t bitSize = 0;
+
+    HRESULT hr = LoadTextureDataFromMemory(ddsHeader, ddsDataSize,
+        &header,
+        &bitData,
+        &bitSize
+    );
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // FillInitData only computes pointers from bitData without reading through them,
+    // so they are cleared here
+    hr = CreateTextureFromDDS(d3dDevice,
+        header, bitData, bitSize, maxsize,
+        resFlags, loadFlags,
+        texture, subresources, isCubeMap);
+    if (SUCCEEDED(hr))
+    {
+        for (auto& subresource : subresources)
+        {
+            subresource.pData = nullptr;
+        }
+
+        if (texture && *texture)
+        {
+            SetDebugObjectName(*texture, L"DDSTextureLoader");
+        }
+
+        if (alphaMode)
+            *alphaMode = GetAlphaMode(header);
+    }
+
+    return hr;
+}
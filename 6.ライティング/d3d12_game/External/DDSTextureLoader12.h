@@ -86,4 +86,48 @@ namespace DirectX
         std::vector<D3D12_SUBRESOURCE_DATA>& subresources,
         _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr,
         _Out_opt_ bool* isCubeMap = nullptr);
+
+    // Read-only memory mapping of a DDS file
+    class DDSMappedFile
+    {
+    public:
+        DDSMappedFile() noexcept = default;
+        ~DDSMappedFile() { Close(); }
+
+        DDSMappedFile(const DDSMappedFile&) = delete;
+        DDSMappedFile& operator=(const DDSMappedFile&) = delete;
+
+        HRESULT __cdecl Open(_In_z_ const wchar_t* szFileName);
+        void __cdecl Close() noexcept;
+
+        const uint8_t* data() const noexcept { return m_data; }
+        size_t size() const noexcept { return m_size; }
+
+    private:
+        void*           m_file = nullptr;
+        void*           m_mapping = nullptr;
+        const uint8_t*  m_data = nullptr;
+        size_t          m_size = 0;
+    };
+
+    // Header-only version
+    //
+    // Creates the texture from the DDS headers alone, for pixel data that is never
+    // held in memory as one block (e.g. a compressed container that is decompressed
+    // straight into upload memory). ddsHeader holds the start of the DDS data and
+    // ddsDataSize is the size of the whole DDS data. Each subresource has pData set
+    // to nullptr; the caller locates the pixels itself (see DdsLayout.hpp), and
+    // RowPitch/SlicePitch describe the packed source layout.
+    HRESULT __cdecl CreateDDSTextureFromHeader(
+        _In_ ID3D12Device* d3dDevice,
+        _In_reads_bytes_(ddsHeaderSize) const uint8_t* ddsHeader,
+        size_t ddsHeaderSize,
+        size_t ddsDataSize,
+        size_t maxsize,
+        D3D12_RESOURCE_FLAGS resFlags,
+        unsigned int loadFlags,
+        _Outptr_ ID3D12Resource** texture,
+        std::vector<D3D12_SUBRESOURCE_DATA>& subresources,
+        _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr,
+        _Out_opt_ bool* isCubeMap = nullptr);
 }
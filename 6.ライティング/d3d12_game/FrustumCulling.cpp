@@ -0,0 +1,253 @@
+﻿#include "FrustumCulling.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "SimdLanes.hpp"
+#include "WorkerPool.hpp"
+
+namespace {
+//! これより少なければスレッドに分けない
+constexpr std::uint32_t MinObjectsPerChunk = 4096;
+
+// 何個ずつ調べるかの違いはSimdLanes.hppに閉じ込め、カーネルは1つの書き方にする
+using namespace dxapp::simd;
+
+static_assert(dxapp::CullingBlockSize % LaneCount == 0,
+              "CullingBlockSize must be a multiple of the lane count");
+
+/*!
+ * @brief 平面を各レーンに広げたもの
+ */
+struct PlaneLanes {
+  Lanes nx, ny, nz, d;
+  Lanes absNx, absNy, absNz;  //!< 箱で使う法線の絶対値
+};
+
+/*!
+ * @brief 視錐台の平面を先に広げておく
+ */
+void SplatPlanes(const dxapp::Frustum& frustum, PlaneLanes (&out)[6]) {
+  for (int i = 0; i < 6; ++i) {
+    const auto& p = frustum.planes[i];
+    out[i].nx = Splat(p.nx);
+    out[i].ny = Splat(p.ny);
+    out[i].nz = Splat(p.nz);
+    out[i].d = Splat(p.d);
+    out[i].absNx = Splat(std::fabs(p.nx));
+    out[i].absNy = Splat(std::fabs(p.ny));
+    out[i].absNz = Splat(std::fabs(p.nz));
+  }
+}
+
+/*!
+ * @brief LaneCount個ずつtest(i)で調べ、見えるものの番号を詰めて書く
+ * @details 1つでも見えるまとまりは分岐させずに全部書き、見えなければ次で上書きする
+ */
+template <typename Test>
+std::uint32_t CullRange(std::uint32_t begin, std::uint32_t end,
+                        std::uint32_t* visible, const Test& test) {
+  assert(begin % dxapp::CullingBlockSize == 0);
+  std::uint32_t n = 0;
+  for (auto i = begin; i < end; i += LaneCount) {
+    const auto mask = Mask(test(i));
+    if (mask == 0) {
+      continue;  // ほとんどは全部外なので、書かずに次へ
+    }
+    const auto lanes = std::min(LaneCount, end - i);
+    for (std::uint32_t lane = 0; lane < lanes; ++lane) {
+      visible[n] = i + lane;
+      n += (mask >> lane) & 1;
+    }
+  }
+  return n;
+}
+
+/*!
+ * @brief 配列の数をブロックの倍数にして、count番目からを0で埋める
+ */
+void ResizePadded(std::vector<float>* v, std::uint32_t count) {
+  const auto padded = (count + dxapp::CullingBlockSize - 1) /
+                      dxapp::CullingBlockSize * dxapp::CullingBlockSize;
+  v->resize(padded);
+  std::fill(v->begin() + count, v->end(), 0.0f);
+}
+
+/*!
+ * @brief 平面を長さ1にする
+ */
+dxapp::Plane NormalizePlane(float a, float b, float c, float d) {
+  const auto length = std::sqrt(a * a + b * b + c * c);
+  if (!(length > 0.0f)) {
+    return {a, b, c, d};
+  }
+  const auto inv = 1.0f / length;
+  return {a * inv, b * inv, c * inv, d * inv};
+}
+}  // namespace
+
+namespace dxapp {
+
+Frustum ExtractFrustum(const float (&m)[4][4]) {
+  // クリップ座標は(x, y, z, w) = v * M なので、各成分はMの列との内積になる
+  // -w <= x <= w, -w <= y <= w, 0 <= z <= w を列の足し引きで平面にする
+  auto column = [&m](int j, float s, int k) {
+    // 列jに列kのs倍を足す。kが負なら足さない
+    float c[4];
+    for (int i = 0; i < 4; ++i) {
+      c[i] = m[i][j] + (k < 0 ? 0.0f : s * m[i][k]);
+    }
+    return NormalizePlane(c[0], c[1], c[2], c[3]);
+  };
+
+  Frustum frustum{};
+  frustum.planes[0] = column(3, 1.0f, 0);   // 左   w + x >= 0
+  frustum.planes[1] = column(3, -1.0f, 0);  // 右   w - x >= 0
+  frustum.planes[2] = column(3, 1.0f, 1);   // 下   w + y >= 0
+  frustum.planes[3] = column(3, -1.0f, 1);  // 上   w - y >= 0
+  frustum.planes[4] = column(2, 0.0f, -1);  // 手前 z >= 0
+  frustum.planes[5] = column(3, -1.0f, 2);  // 奥   w - z >= 0
+  return frustum;
+}
+
+void BoundingSphereSoA::Resize(std::uint32_t count) {
+  count_ = count;
+  ResizePadded(&x_, count);
+  ResizePadded(&y_, count);
+  ResizePadded(&z_, count);
+  ResizePadded(&radius_, count);
+}
+
+void BoundingBoxSoA::Resize(std::uint32_t count) {
+  count_ = count;
+  ResizePadded(&centerX_, count);
+  ResizePadded(&centerY_, count);
+  ResizePadded(&centerZ_, count);
+  ResizePadded(&extentX_, count);
+  ResizePadded(&extentY_, count);
+  ResizePadded(&extentZ_, count);
+}
+
+std::uint32_t CullSpheres(const Frustum& frustum,
+                          const BoundingSphereSoA& spheres, std::uint32_t begin,
+                          std::uint32_t end, std::uint32_t* visible) {
+  assert(end <= spheres.size());
+  PlaneLanes planes[6];
+  SplatPlanes(frustum, planes);
+
+  const auto x = spheres.x();
+  const auto y = spheres.y();
+  const auto z = spheres.z();
+  const auto radius = spheres.radius();
+  return CullRange(begin, end, visible, [&](std::uint32_t i) {
+    const auto cx = Load(x + i);
+    const auto cy = Load(y + i);
+    const auto cz = Load(z + i);
+    const auto negRadius = Negate(Load(radius + i));
+
+    // 中心から平面までの距離が-半径より大きければ、その平面の内側にかかっている
+    auto inside = AllTrue();
+    for (const auto& p : planes) {
+      const auto dist =
+          Add(Add(Mul(p.nx, cx), Mul(p.ny, cy)), Add(Mul(p.nz, cz), p.d));
+      inside = And(inside, GreaterEqual(dist, negRadius));
+      if (Mask(inside) == 0) {
+        break;  // 全部外なら残りの平面は見なくてよい
+      }
+    }
+    return inside;
+  });
+}
+
+std::uint32_t CullBoxes(const Frustum& frustum, const BoundingBoxSoA& boxes,
+                        std::uint32_t begin, std::uint32_t end,
+                        std::uint32_t* visible) {
+  assert(end <= boxes.size());
+  PlaneLanes planes[6];
+  SplatPlanes(frustum, planes);
+
+  const auto cxs = boxes.centerX();
+  const auto cys = boxes.centerY();
+  const auto czs = boxes.centerZ();
+  const auto exs = boxes.extentX();
+  const auto eys = boxes.extentY();
+  const auto ezs = boxes.extentZ();
+  return CullRange(begin, end, visible, [&](std::uint32_t i) {
+    const auto cx = Load(cxs + i);
+    const auto cy = Load(cys + i);
+    const auto cz = Load(czs + i);
+    const auto ex = Load(exs + i);
+    const auto ey = Load(eys + i);
+    const auto ez = Load(ezs + i);
+
+    // 箱を法線に投影した半分の長さを半径の代わりにする
+    // 法線の方向に一番出ている頂点が内側なら、箱は平面にかかっている
+    auto inside = AllTrue();
+    for (const auto& p : planes) {
+      const auto dist =
+          Add(Add(Mul(p.nx, cx), Mul(p.ny, cy)), Add(Mul(p.nz, cz), p.d));
+      const auto reach =
+          Add(Add(Mul(p.absNx, ex), Mul(p.absNy, ey)), Mul(p.absNz, ez));
+      inside = And(inside, GreaterEqual(dist, Negate(reach)));
+      if (Mask(inside) == 0) {
+        break;
+      }
+    }
+    return inside;
+  });
+}
+
+template <typename Kernel>
+void FrustumCuller::CullChunks(std::uint32_t count, WorkerPool* workers,
+                               const Kernel& kernel) {
+  // 区間ごとに、一覧の自分の区間の位置から書く。区間は重ならない
+  visible_.resize(count);
+  const auto threadCount = workers ? workers->threadCount() : 1;
+  const auto chunkCount =
+      std::min(threadCount, std::max(1u, count / MinObjectsPerChunk));
+  if (chunkCount <= 1) {
+    visible_.resize(kernel(0, count, visible_.data()));
+    return;
+  }
+
+  // 区間の先頭はブロックの倍数にそろえる
+  auto step = (count + chunkCount - 1) / chunkCount;
+  step = (step + CullingBlockSize - 1) / CullingBlockSize * CullingBlockSize;
+  chunkCounts_.assign(chunkCount, 0);
+  workers->Run(chunkCount, [&](std::uint32_t chunk) {
+    const auto begin = std::min(count, chunk * step);
+    const auto end = std::min(count, begin + step);
+    chunkCounts_[chunk] = kernel(begin, end, visible_.data() + begin);
+  });
+
+  // 区間の結果を前に詰める。書く先は読む先より前なので上書きしない
+  std::uint32_t total = chunkCounts_[0];
+  for (std::uint32_t chunk = 1; chunk < chunkCount; ++chunk) {
+    const auto src = visible_.begin() + std::min(count, chunk * step);
+    std::copy(src, src + chunkCounts_[chunk], visible_.begin() + total);
+    total += chunkCounts_[chunk];
+  }
+  visible_.resize(total);
+}
+
+void FrustumCuller::Cull(const Frustum& frustum,
+                         const BoundingSphereSoA& spheres,
+                         WorkerPool* workers) {
+  CullChunks(spheres.size(), workers,
+             [&](std::uint32_t begin, std::uint32_t end,
+                 std::uint32_t* visible) {
+               return CullSpheres(frustum, spheres, begin, end, visible);
+             });
+}
+
+void FrustumCuller::Cull(const Frustum& frustum, const BoundingBoxSoA& boxes,
+                         WorkerPool* workers) {
+  CullChunks(boxes.size(), workers,
+             [&](std::uint32_t begin, std::uint32_t end,
+                 std::uint32_t* visible) {
+               return CullBoxes(frustum, boxes, begin, end, visible);
+             });
+}
+
+}  // namespace dxapp
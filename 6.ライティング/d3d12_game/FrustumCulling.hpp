@@ -0,0 +1,175 @@
+﻿#pragma once
+// カメラの視錐台の外にあるオブジェクトを描画の前に外す
+// 境界は成分ごとの配列(SoA)で持ち、AVX2なら8個、なければSSEで4個ずつ調べる
+// D3D12には触らないので、Linuxでも動かして確かめられる
+#include <cstdint>
+#include <vector>
+
+namespace dxapp {
+class WorkerPool;
+
+//! 境界の配列はこの数の倍数まで0で埋めておき、まとめて読めるようにする
+//! カリングの範囲の先頭もこの倍数にする
+constexpr std::uint32_t CullingBlockSize = 8;
+
+/*!
+ * @brief 平面。nx * x + ny * y + nz * z + d >= 0 の側が内側
+ */
+struct Plane {
+  float nx, ny, nz, d;
+};
+
+/*!
+ * @brief 視錐台。6枚の平面の法線は内向きで、長さは1
+ */
+struct Frustum {
+  Plane planes[6];  //!< 左・右・下・上・手前・奥
+};
+
+/*!
+ * @brief ビュー射影行列から視錐台の平面を取り出す
+ * @details DirectXMathと同じ行ベクトルの行列(v * M)で、クリップ空間のZは0から1。
+ *          XMFLOAT4X4のmをそのまま渡せる
+ */
+Frustum ExtractFrustum(const float (&viewProj)[4][4]);
+
+/*!
+ * @brief 境界球の配列
+ */
+class BoundingSphereSoA {
+ public:
+  BoundingSphereSoA() = default;
+
+  /*!
+   * @brief 数を変える。増えた分は半径0で、どこにも見えない
+   */
+  void Resize(std::uint32_t count);
+
+  /*!
+   * @brief i番目の球を設定する
+   */
+  void Set(std::uint32_t i, float x, float y, float z, float radius) {
+    x_[i] = x;
+    y_[i] = y;
+    z_[i] = z;
+    radius_[i] = radius;
+  }
+
+  /*!
+   * @brief 球の数
+   */
+  std::uint32_t size() const { return count_; }
+
+  const float* x() const { return x_.data(); }
+  const float* y() const { return y_.data(); }
+  const float* z() const { return z_.data(); }
+  const float* radius() const { return radius_.data(); }
+
+ private:
+  std::uint32_t count_{0};
+  std::vector<float> x_{}, y_{}, z_{}, radius_{};
+};
+
+/*!
+ * @brief 軸に沿った箱(AABB)の配列。中心と各軸の半分の長さで持つ
+ */
+class BoundingBoxSoA {
+ public:
+  BoundingBoxSoA() = default;
+
+  /*!
+   * @brief 数を変える。増えた分は大きさ0
+   */
+  void Resize(std::uint32_t count);
+
+  /*!
+   * @brief i番目の箱を設定する
+   * @param[in] cx,cy,cz 中心
+   * @param[in] ex,ey,ez 各軸の半分の長さ
+   */
+  void Set(std::uint32_t i, float cx, float cy, float cz, float ex, float ey,
+           float ez) {
+    centerX_[i] = cx;
+    centerY_[i] = cy;
+    centerZ_[i] = cz;
+    extentX_[i] = ex;
+    extentY_[i] = ey;
+    extentZ_[i] = ez;
+  }
+
+  /*!
+   * @brief 箱の数
+   */
+  std::uint32_t size() const { return count_; }
+
+  const float* centerX() const { return centerX_.data(); }
+  const float* centerY() const { return centerY_.data(); }
+  const float* centerZ() const { return centerZ_.data(); }
+  const float* extentX() const { return extentX_.data(); }
+  const float* extentY() const { return extentY_.data(); }
+  const float* extentZ() const { return extentZ_.data(); }
+
+ private:
+  std::uint32_t count_{0};
+  std::vector<float> centerX_{}, centerY_{}, centerZ_{};
+  std::vector<float> extentX_{}, extentY_{}, extentZ_{};
+};
+
+/*!
+ * @brief begin番目からend番目の手前までの球を視錐台と比べ、見えるものの番号を詰めて書く
+ * @details 範囲が重ならなければ、ほかのスレッドと同時に呼んでよい
+ * @param[in] begin CullingBlockSizeの倍数
+ * @param[out] visible end - begin個書ける場所。番号は小さい順に入る
+ * @return 見える数
+ */
+std::uint32_t CullSpheres(const Frustum& frustum,
+                          const BoundingSphereSoA& spheres, std::uint32_t begin,
+                          std::uint32_t end, std::uint32_t* visible);
+
+/*!
+ * @brief 箱の版のCullSpheres
+ */
+std::uint32_t CullBoxes(const Frustum& frustum, const BoundingBoxSoA& boxes,
+                        std::uint32_t begin, std::uint32_t end,
+                        std::uint32_t* visible);
+
+/*!
+ * @brief 全部の境界をカリングして、見えるものの番号の一覧を作る
+ * @details 数が多ければ区間に分けてWorkerPoolのスレッドで調べ、最後に詰める。
+ *          一覧の領域はフレームをまたいで使いまわす
+ */
+class FrustumCuller {
+ public:
+  FrustumCuller() = default;
+
+  /*!
+   * @brief 球でカリングする
+   * @param[in] workers nullptrなら呼んだスレッドだけで調べる
+   */
+  void Cull(const Frustum& frustum, const BoundingSphereSoA& spheres,
+            WorkerPool* workers);
+
+  /*!
+   * @brief 箱でカリングする
+   */
+  void Cull(const Frustum& frustum, const BoundingBoxSoA& boxes,
+            WorkerPool* workers);
+
+  /*!
+   * @brief 見えるものの番号。小さい順
+   */
+  const std::vector<std::uint32_t>& visible() const { return visible_; }
+
+ private:
+  /*!
+   * @brief count個を区間に分けてkernel(begin, end, visible)で調べ、結果を詰める
+   */
+  template <typename Kernel>
+  void CullChunks(std::uint32_t count, WorkerPool* workers,
+                  const Kernel& kernel);
+
+  std::vector<std::uint32_t> visible_{};
+  std::vector<std::uint32_t> chunkCounts_{};  //!< 区間ごとの見える数
+};
+
+}  // namespace dxapp
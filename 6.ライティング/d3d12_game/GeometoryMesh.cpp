@@ -132,6 +132,14 @@ class GeometoryMesh::Impl {
   BufferObject ib_{};
   UINT indexCount_{};  // インデクス数
 
+  // 頂点を囲む箱。カリングに使う
+  DirectX::XMFLOAT3 boundsCenter_{};
+  DirectX::XMFLOAT3 boundsExtents_{};
+
+  // CPUに残しておく位置とインデックス。遮蔽カリングの遮蔽物を描くのに使う
+  std::vector<DirectX::XMFLOAT3> positions_{};
+  std::vector<std::uint32_t> indices_{};
+
   // 頂点バッファ・インデックスバッファビュー
   D3D12_VERTEX_BUFFER_VIEW vbView_{};
   D3D12_INDEX_BUFFER_VIEW ibView_{};
@@ -172,6 +180,25 @@ void GeometoryMesh::Impl::Initialize(
   ibView_.BufferLocation = ib_.resource()->GetGPUVirtualAddress();
   ibView_.SizeInBytes = static_cast<UINT>(size);
   ibView_.Format = DXGI_FORMAT_R32_UINT;
+
+  // 頂点を囲む箱を求めておく
+  if (!vertices.empty()) {
+    auto vmin = XMLoadFloat3(&vertices[0].position);
+    auto vmax = vmin;
+    for (const auto& v : vertices) {
+      const auto pos = XMLoadFloat3(&v.position);
+      vmin = XMVectorMin(vmin, pos);
+      vmax = XMVectorMax(vmax, pos);
+    }
+    XMStoreFloat3(&boundsCenter_, (vmin + vmax) * 0.5f);
+    XMStoreFloat3(&boundsExtents_, (vmax - vmin) * 0.5f);
+  }
+
+  positions_.resize(vertices.size());
+  for (std::size_t i = 0; i < vertices.size(); ++i) {
+    positions_[i] = vertices[i].position;
+  }
+  indices_ = indices;
 }
 
 //-------------------------------------------------------------------
@@ -183,15 +210,32 @@ GeometoryMesh::~GeometoryMesh() {
   { Terminate(); }
 }
 
-void GeometoryMesh::Draw(ID3D12GraphicsCommandList* commandList) {
+void GeometoryMesh::Draw(ID3D12GraphicsCommandList* commandList,
+                         UINT instanceCount) {
   commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
   commandList->IASetVertexBuffers(0, 1, &impl_->vbView_);
   commandList->IASetIndexBuffer(&impl_->ibView_);
-  commandList->DrawIndexedInstanced(impl_->indexCount_, 1, 0, 0, 0);
+  commandList->DrawIndexedInstanced(impl_->indexCount_, instanceCount, 0, 0, 0);
 }
 
 void GeometoryMesh::Terminate() {}
 
+const DirectX::XMFLOAT3& GeometoryMesh::boundsCenter() const {
+  return impl_->boundsCenter_;
+}
+
+const DirectX::XMFLOAT3& GeometoryMesh::boundsExtents() const {
+  return impl_->boundsExtents_;
+}
+
+const std::vector<DirectX::XMFLOAT3>& GeometoryMesh::positions() const {
+  return impl_->positions_;
+}
+
+const std::vector<std::uint32_t>& GeometoryMesh::indices() const {
+  return impl_->indices_;
+}
+
 std::unique_ptr<GeometoryMesh> GeometoryMesh::CreateCube(
     ID3D12Device* device, float size, DirectX::XMFLOAT4 color) {
   // 辺の長さが同一のBoxを作る
@@ -16,14 +16,35 @@ class GeometoryMesh {
 
   /*!
    * @brief 描画コマンド発行
+   * @param[in] instanceCount インスタンシングで描く数
    */
-  void Draw(ID3D12GraphicsCommandList* commandList);
+  void Draw(ID3D12GraphicsCommandList* commandList, UINT instanceCount = 1);
 
   /*!
    * @brief 終了処理
    */
   void Terminate();
 
+  /*!
+   * @brief ローカル座標で頂点を囲む箱の中心
+   */
+  const DirectX::XMFLOAT3& boundsCenter() const;
+
+  /*!
+   * @brief ローカル座標で頂点を囲む箱の各軸の半分の長さ
+   */
+  const DirectX::XMFLOAT3& boundsExtents() const;
+
+  /*!
+   * @brief ローカル座標の頂点の位置。CPUで遮蔽物を描くのに使う
+   */
+  const std::vector<DirectX::XMFLOAT3>& positions() const;
+
+  /*!
+   * @brief インデックス。3つで1つの三角形
+   */
+  const std::vector<std::uint32_t>& indices() const;
+
   /*!
    * @brief キューブメッシュを生成してGeometoryMeshを返す
    * @param[in] device d3d12デバイス
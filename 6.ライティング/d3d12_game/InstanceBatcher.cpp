@@ -0,0 +1,25 @@
+﻿#include "InstanceBatcher.hpp"
+
+namespace dxapp {
+
+void InstanceBatcher::Build(const std::vector<DrawPacket>& packets) {
+  batches_.clear();
+  instanceObjects_.clear();
+
+  // 並べ替えてあるので、同じ設定のパケットは隣に並んでいる
+  instanceObjects_.reserve(packets.size());
+  std::uint64_t state = 0;
+  for (const auto& packet : packets) {
+    const auto instance = static_cast<std::uint32_t>(instanceObjects_.size());
+    instanceObjects_.push_back(packet.object);
+    const auto packetState = packet.key & DrawSortKeyStateMask;
+    if (!batches_.empty() && packetState == state) {
+      ++batches_.back().instanceCount;
+      continue;
+    }
+    state = packetState;
+    batches_.push_back({DrawSortKeyPipeline(packet.key), instance, 1});
+  }
+}
+
+}  // namespace dxapp
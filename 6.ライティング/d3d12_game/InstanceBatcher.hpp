@@ -0,0 +1,59 @@
+﻿#pragma once
+// 同じメッシュ・マテリアル・パイプラインで描くオブジェクトをまとめて、
+// インスタンシングの1回の描画にする
+// D3D12には触らないので、Linuxでも動かして確かめられる
+#include <cstdint>
+#include <vector>
+
+#include "DrawPacket.hpp"
+
+namespace dxapp {
+
+/*!
+ * @brief まとめた描画1回分
+ * @details インスタンスの番号firstInstanceからinstanceCount個を描く。
+ *          各インスタンスのオブジェクトはInstanceBatcher::instanceObjectsで引く。
+ *          メッシュとマテリアルは先頭のオブジェクトのものを使えばよい
+ */
+struct InstanceBatch {
+  std::uint32_t pipeline;       //!< パイプラインの番号
+  std::uint32_t firstInstance;  //!< 先頭のインスタンスの番号
+  std::uint32_t instanceCount;  //!< インスタンスの数
+};
+
+/*!
+ * @brief キーの順に並べたDrawPacketを(パス, パイプライン, マテリアル, メッシュ)でまとめる
+ * @details キーの深度より上が同じパケットが1つの描画になる。
+ *          並べ替えはDrawPacketSorterで先にしておく。
+ *          まとめた中ではパケットの順(手前から)を保つ
+ */
+class InstanceBatcher {
+ public:
+  InstanceBatcher() = default;
+
+  /*!
+   * @brief まとめる
+   * @param[in] packets キーの順に並べたパケット
+   */
+  void Build(const std::vector<DrawPacket>& packets);
+
+  /*!
+   * @brief まとめた描画。パケットの順に並ぶ
+   */
+  const std::vector<InstanceBatch>& batches() const { return batches_; }
+
+  /*!
+   * @brief インスタンスの番号→オブジェクトの番号
+   * @details この順でインスタンスのデータを詰めれば、
+   *          各描画のインスタンスが連続して並ぶ
+   */
+  const std::vector<std::uint32_t>& instanceObjects() const {
+    return instanceObjects_;
+  }
+
+ private:
+  std::vector<InstanceBatch> batches_{};
+  std::vector<std::uint32_t> instanceObjects_{};
+};
+
+}  // namespace dxapp
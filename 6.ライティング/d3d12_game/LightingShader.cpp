@@ -6,6 +6,11 @@
 #include "VertexType.hpp"
 
 namespace dxapp {
+	namespace {
+		//! gĂȂ[gp[^̈ʒu
+		constexpr UINT NoRootParam = UINT_MAX;
+	}  // namespace
+
 #pragma region LightingShader::Impl
 	/*!
 	 * @brief LightingShader̎
@@ -28,6 +33,8 @@ namespace dxapp {
 
 		/*!
 		 * @brief [gVOl`
+		 * @details oChXEIuWFNgobt@EÓITvg
+		 *          p[^̕тςBʒurootIndex_ɓ
 		 */
 		void CreatRootSignature(ID3D12Device* device);
 
@@ -45,19 +52,23 @@ namespace dxapp {
 		//! pCvCXe[g
 		Microsoft::WRL::ComPtr<ID3D12PipelineState> pipeline_{};
 
+		//! [gp[^̈ʒuBgȂ̂NoRootParam
+		struct RootIndex {
+			UINT objectParam{ NoRootParam };     // b0: ObjectParam
+			UINT objectIndex{ NoRootParam };     // b4: ObjectIndex([g萔)
+			UINT objectBuffer{ NoRootParam };    // t2: Objects
+			UINT sceneParam{ NoRootParam };      // b1: SceneParam
+			UINT materialParam{ NoRootParam };   // b2: MaterialParam
+			UINT materialIndex{ NoRootParam };   // b3: MaterialIndex([g萔)
+			UINT materialBuffer{ NoRootParam };  // t1: Materials
+			UINT textureTable{ NoRootParam };    // t0(oChXȂt0, space1)
+			UINT samplerTable{ NoRootParam };    // s0
+		};
+		RootIndex rootIndex_{};
+
 		// fXNv^TCỸLbV
 		UINT srvDescriptorSize_{}, samplerDescriptorSize_{};
 
-		// Begin/EndŎgR}hXg
-		ID3D12GraphicsCommandList* commandList{};
-
-		// R}hXgɐςރfXNv^EGPUnh̃LbV
-		ID3D12DescriptorHeap* srvHeap_{}, * samplerHeap_{};
-		CD3DX12_GPU_DESCRIPTOR_HANDLE srv_, sampler_;
-
-		// R}hXgɐςޒ萔obt@ւGPUnh̃LbV
-		D3D12_GPU_VIRTUAL_ADDRESS objParam_, sceneParam_, matParam_;
-
 		// eNX`Ȃ̎łBƃq[vnh͓nKv
 		ID3D12DescriptorHeap* defaultSamplerHeap_{};
 		CD3DX12_GPU_DESCRIPTOR_HANDLE defaultSampler_;
@@ -65,22 +76,41 @@ namespace dxapp {
 		// eNX`Ȃ̎łBƃq[vnh͓nKv
 		ID3D12DescriptorHeap* dammySrvHeap_{};
 		CD3DX12_GPU_DESCRIPTOR_HANDLE dammySrv_;
+
+		// oChXŕ`悷邩
+		bool isBindless_{ false };
+		// IuWFNgƂ̃f[^1̍\obt@œn
+		bool useObjectBuffer_{ false };
+		// s0ÓITvɂ邩BȂTṽe[u͍Ȃ
+		bool hasStaticSampler_{ false };
+		D3D12_STATIC_SAMPLER_DESC staticSampler_{};
 	};
 
 	void LightingShader::Impl::CreateShader() {
 		{
+			// oChXȂǂ̓}NŐ؂ւ
+			std::vector<DxcDefine> defines{
+				{ L"BINDLESS", isBindless_ ? L"1" : L"0" },
+				{ L"OBJECT_BUFFER", useObjectBuffer_ ? L"1" : L"0" } };
 			Microsoft::WRL::ComPtr<ID3DBlob> error;
 			utility::CompileShaderFromFile(L"Shaders/LightingVS.hlsl", L"vs_6_0", vs_,
-				error);
+				error, defines);
 			utility::CompileShaderFromFile(L"Shaders/LightingPS.hlsl", L"ps_6_0", ps_,
-				error);
+				error, defines);
 		}
 	}
 
 	// [gVOl`
 	void LightingShader::Impl::CreatRootSignature(ID3D12Device* device) {
-		// b0, b1, b2, t0, s15̃p[^g
-		CD3DX12_ROOT_PARAMETER rootParams[5];
+		// gp[^Ol߂āAʒurootIndex_ɊoĂ
+		std::vector<CD3DX12_ROOT_PARAMETER> rootParams;
+		rootParams.reserve(8);
+		auto add = [&rootParams](UINT& index) -> CD3DX12_ROOT_PARAMETER& {
+			index = static_cast<UINT>(rootParams.size());
+			rootParams.emplace_back();
+			return rootParams.back();
+		};
+		rootIndex_ = {};
 
 		//-----------------------------------------------------------------
 		// BasicShaderƂ͈Ⴂ萔obt@InitAsConstantBufferViewō쐬B
@@ -90,25 +120,50 @@ namespace dxapp {
 		// ͊wKpȂ̂ŗǂɂB
 		//-----------------------------------------------------------------
 		// ̐̓WX^ԍ.
-		rootParams[0].InitAsConstantBufferView(0);  // b0:ObjectParam
-		rootParams[1].InitAsConstantBufferView(1);  // b1:SceneParam
-		rootParams[2].InitAsConstantBufferView(2);  // b2:MaterialParam
+		if (useObjectBuffer_) {
+			// S̃IuWFNg1̍\obt@ɓA
+			// `悲Ƃɂ͉Ԗڂ32bitl1̃[g萔œn
+			add(rootIndex_.objectIndex).InitAsConstants(
+				1, 4, 0, D3D12_SHADER_VISIBILITY_VERTEX);  // b4:ObjectIndex
+			add(rootIndex_.objectBuffer).InitAsShaderResourceView(
+				2, 0, D3D12_SHADER_VISIBILITY_VERTEX);     // t2:Objects
+		} else {
+			add(rootIndex_.objectParam).InitAsConstantBufferView(0);  // b0:ObjectParam
+		}
+		add(rootIndex_.sceneParam).InitAsConstantBufferView(1);  // b1:SceneParam
+		if (isBindless_) {
+			// }eAŁAԍ̓[g萔A\obt@͒ڃAhXn
+			add(rootIndex_.materialIndex).InitAsConstants(1, 3);     // b3:MaterialIndex
+			add(rootIndex_.materialBuffer).InitAsShaderResourceView(1);  // t1:Materials
+		} else {
+			add(rootIndex_.materialParam).InitAsConstantBufferView(2);  // b2:MaterialParam
+		}
 
 		// eNX`ƃTv[͍܂ŒʂfXNv^e[uœn
+		// oChXł̓eNX`͌߂Ȃ(UINT_MAX)e[uŁA
+		// q[v̏I܂ŌBقt0ƏdȂȂ悤space1ɒu
 		CD3DX12_DESCRIPTOR_RANGE srv, sampler;
-		srv.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
+		if (isBindless_) {
+			srv.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UINT_MAX, 0, 1);
+		} else {
+			srv.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
+		}
 		sampler.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 1, 0);
 
-		rootParams[3].InitAsDescriptorTable(
+		add(rootIndex_.textureTable).InitAsDescriptorTable(
 			1, &srv,                         // t0
 			D3D12_SHADER_VISIBILITY_PIXEL);  // sNZVF[_猩
-		rootParams[4].InitAsDescriptorTable(
-			1, &sampler,                     // s0
-			D3D12_SHADER_VISIBILITY_PIXEL);  // sNZVF[_猩
+		// ÓITvȂ烋[gVOl`ɒړāATṽe[u͍Ȃ
+		if (!hasStaticSampler_) {
+			add(rootIndex_.samplerTable).InitAsDescriptorTable(
+				1, &sampler,                     // s0
+				D3D12_SHADER_VISIBILITY_PIXEL);  // sNZVF[_猩
+		}
 
 		CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc{};
 		rootSigDesc.Init(
-			_countof(rootParams), rootParams, 0, nullptr,
+			static_cast<UINT>(rootParams.size()), rootParams.data(),
+			hasStaticSampler_ ? 1 : 0, hasStaticSampler_ ? &staticSampler_ : nullptr,
 			D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
 		Microsoft::WRL::ComPtr<ID3DBlob> signature;
@@ -150,6 +205,123 @@ namespace dxapp {
 
 		device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&pipeline_));
 	}
+
+#pragma endregion
+
+#pragma region LightingShader::Context::Impl
+	/*!
+	 * @brief LightingShader::Context̎
+	 */
+	class LightingShader::Context::Impl {
+	public:
+		explicit Impl(const LightingShader::Impl* shader) : shader_(shader) {}
+
+		/*!
+		 * @brief OApplyς̂R}hXgɐς
+		 */
+		void Apply();
+
+		// [gp[^ƂɁAOƈႦΐς
+		void ApplyRootCbv(UINT index, D3D12_GPU_VIRTUAL_ADDRESS addr);
+		void ApplyRootSrv(UINT index, D3D12_GPU_VIRTUAL_ADDRESS addr);
+		void ApplyRootConstant(UINT index, std::uint32_t value);
+		void ApplyDescriptorTable(UINT index, D3D12_GPU_DESCRIPTOR_HANDLE handle);
+
+		// [gVOl`ȂǁBقContextƋL̂œǂނ
+		const LightingShader::Impl* shader_;
+
+		// Begin/EndŎgR}hXg
+		ID3D12GraphicsCommandList* commandList{};
+
+		// R}hXgɐςރfXNv^EGPUnh̃LbV
+		ID3D12DescriptorHeap* srvHeap_{}, * samplerHeap_{};
+		CD3DX12_GPU_DESCRIPTOR_HANDLE srv_, sampler_;
+
+		// R}hXgɐςޒ萔obt@ւGPUnh̃LbV
+		D3D12_GPU_VIRTUAL_ADDRESS objParam_, sceneParam_, matParam_;
+
+		// S̃eNX`SRṼe[u
+		ID3D12DescriptorHeap* textureHeap_{};
+		CD3DX12_GPU_DESCRIPTOR_HANDLE textureTable_;
+		// S̃}eA̍\obt@ƁA`Ŏgԍ
+		D3D12_GPU_VIRTUAL_ADDRESS materialBuffer_{};
+		std::uint32_t materialIndex_{ 0 };
+		// S̃IuWFNg̍\obt@ƁA`Ŏgԍ
+		D3D12_GPU_VIRTUAL_ADDRESS objectBuffer_{};
+		std::uint32_t objectIndex_{ 0 };
+
+		// R}hXgɐς񂾂̂oĂÂ͐ς܂Ȃ
+		RootStateCache stateCache_{};
+	};
+
+	void LightingShader::Context::Impl::Apply() {
+		// OApplyς̂ς
+		// q[vςƂ̓e[uς݂ȂɂȂ
+		// ÓITvȂTṽq[v͂Ȃ
+		const auto& rootIndex = shader_->rootIndex_;
+		const auto isBindless = shader_->isBindless_;
+		const auto hasStaticSampler = shader_->hasStaticSampler_;
+		auto srvHeap = isBindless ? textureHeap_ : srvHeap_;
+		auto samplerHeap = hasStaticSampler ? nullptr : samplerHeap_;
+		assert(srvHeap);
+		if (stateCache_.SetDescriptorHeaps(srvHeap, samplerHeap)) {
+			ID3D12DescriptorHeap* heaps[] = { srvHeap, samplerHeap };
+
+			// _countof͐z̗vf𐔂Ă}N
+			commandList->SetDescriptorHeaps(hasStaticSampler ? 1 : _countof(heaps),
+				heaps);
+		}
+
+		// V[Ee[uEoChX̃obt@͕`悲ƂɕςȂ̂
+		// ۂɐςނ̂͂قƂBegin̍ŏ1񂾂ɂȂ
+		ApplyRootCbv(rootIndex.sceneParam, sceneParam_);
+		ApplyRootSrv(rootIndex.materialBuffer, materialBuffer_);
+		ApplyRootSrv(rootIndex.objectBuffer, objectBuffer_);
+		ApplyDescriptorTable(rootIndex.textureTable,
+			isBindless ? textureTable_ : srv_);
+		ApplyDescriptorTable(rootIndex.samplerTable, sampler_);
+
+		// `悲Ƃɕς
+		// IuWFNgobt@ƃoChXȂ32bitl݂̏ɂȂ
+		ApplyRootCbv(rootIndex.objectParam, objParam_);
+		ApplyRootConstant(rootIndex.objectIndex, objectIndex_);
+		ApplyRootCbv(rootIndex.materialParam, matParam_);
+		ApplyRootConstant(rootIndex.materialIndex, materialIndex_);
+	}
+
+	// 萔obt@̓fXNv^e[ugĂȂ
+	// ̏ꍇSetGraphicsRootConstantBufferViewgĒڃAhX𓊂
+	void LightingShader::Context::Impl::ApplyRootCbv(UINT index,
+		D3D12_GPU_VIRTUAL_ADDRESS addr) {
+		if (index != NoRootParam && stateCache_.SetRootView(index, addr)) {
+			commandList->SetGraphicsRootConstantBufferView(
+				index,  // [gp[^̈ʒu
+				addr);  // GPŨAhX
+		}
+	}
+
+	void LightingShader::Context::Impl::ApplyRootSrv(UINT index,
+		D3D12_GPU_VIRTUAL_ADDRESS addr) {
+		if (index != NoRootParam && stateCache_.SetRootView(index, addr)) {
+			commandList->SetGraphicsRootShaderResourceView(index, addr);
+		}
+	}
+
+	void LightingShader::Context::Impl::ApplyRootConstant(UINT index,
+		std::uint32_t value) {
+		if (index != NoRootParam && stateCache_.SetRootConstant(index, value)) {
+			commandList->SetGraphicsRoot32BitConstant(index, value, 0);
+		}
+	}
+
+	// eNX`ƃTvSetGraphicsRootDescriptorTableŐݒ
+	void LightingShader::Context::Impl::ApplyDescriptorTable(UINT index,
+		D3D12_GPU_DESCRIPTOR_HANDLE handle) {
+		if (index != NoRootParam &&
+			stateCache_.SetDescriptorTable(index, handle.ptr)) {
+			commandList->SetGraphicsRootDescriptorTable(index, handle);
+		}
+	}
 #pragma endregion
 
 	//-------------------------------------------------------------------
@@ -159,9 +331,24 @@ namespace dxapp {
 
 	LightingShader::~LightingShader() {}
 
-	void LightingShader::Initialize(Device* device) {
+	void LightingShader::Initialize(Device* device, const Options& options) {
 		auto dev = device->device();
 
+		// Tier1̓e[uSRV128܂łȂ̂ŁAS̃eNX`ׂȂ
+		auto bindless = options.bindless;
+		if (bindless) {
+			D3D12_FEATURE_DATA_D3D12_OPTIONS options{};
+			bindless = SUCCEEDED(dev->CheckFeatureSupport(
+				D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options))) &&
+				options.ResourceBindingTier >= D3D12_RESOURCE_BINDING_TIER_2;
+		}
+		impl_->isBindless_ = bindless;
+		impl_->useObjectBuffer_ = options.objectBuffer;
+		impl_->hasStaticSampler_ = options.staticSampler != nullptr;
+		if (options.staticSampler) {
+			impl_->staticSampler_ = *options.staticSampler;
+		}
+
 		impl_->CreateShader();
 		impl_->CreatRootSignature(dev);
 		impl_->CreatePipelineState(dev);
@@ -172,9 +359,38 @@ namespace dxapp {
 			dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
 	}
 
+	bool LightingShader::bindless() const { return impl_->isBindless_; }
+
+	bool LightingShader::objectBuffer() const { return impl_->useObjectBuffer_; }
+
 	void LightingShader::Terminate() {}
 
-	void LightingShader::Begin(ID3D12GraphicsCommandList* commandList) {
+	void LightingShader::SetDammySrvDescriptorHeap(ID3D12DescriptorHeap* heap,
+		const int offset) {
+		// Ŏ󂯎̂͂Ǝg܂킷
+		impl_->dammySrvHeap_ = heap;
+		impl_->dammySrv_ =
+			CD3DX12_GPU_DESCRIPTOR_HANDLE(heap->GetGPUDescriptorHandleForHeapStart(),
+				offset, impl_->srvDescriptorSize_);
+	}
+
+	void LightingShader::SetDefaultSamplerDescriptorHeap(ID3D12DescriptorHeap* heap,
+		const int offset) {
+		impl_->defaultSamplerHeap_ = heap;
+		impl_->defaultSampler_ =
+			CD3DX12_GPU_DESCRIPTOR_HANDLE(heap->GetGPUDescriptorHandleForHeapStart(),
+				offset, impl_->samplerDescriptorSize_);
+	}
+
+	//-------------------------------------------------------------------
+	// LightingShader::Context
+	//-------------------------------------------------------------------
+	LightingShader::Context::Context(const LightingShader* shader)
+		: impl_(new Impl(shader->impl_.get())) {}
+
+	LightingShader::Context::~Context() {}
+
+	void LightingShader::Context::Begin(ID3D12GraphicsCommandList* commandList) {
 		assert(impl_->commandList == nullptr);
 		impl_->commandList = commandList;
 
@@ -182,91 +398,89 @@ namespace dxapp {
 		// \[X͑KvAŕ`JnɓKȃeNX`
 		// ftHg̃Tv[nĂBƂ肠Ŏ~܂邱Ƃ͂ȂȂB
 		// ۂ̃Q[ŎgȂ炱̕ӂ͂ƍHv
+		const auto shader = impl_->shader_;
 
 		// Ղ[ɃftHglݒ
-		impl_->samplerHeap_ = impl_->defaultSamplerHeap_;
-		impl_->sampler_ = impl_->defaultSampler_;
+		impl_->samplerHeap_ = shader->defaultSamplerHeap_;
+		impl_->sampler_ = shader->defaultSampler_;
 
 		// Ƃ肠_~[nĂ
-		impl_->srvHeap_ = impl_->dammySrvHeap_;
-		impl_->srv_ = impl_->dammySrv_;
-
-		commandList->SetGraphicsRootSignature(impl_->rootSignature_.Get());
-		commandList->SetPipelineState(impl_->pipeline_.Get());
+		impl_->srvHeap_ = shader->dammySrvHeap_;
+		impl_->srv_ = shader->dammySrv_;
+
+		// R}hXgɉς܂Ă邩͂킩Ȃ̂őSY
+		// t[ƂɐȂ
+		impl_->stateCache_.Reset();
+		impl_->stateCache_.ResetStats();
+		if (impl_->stateCache_.SetRootSignature(shader->rootSignature_.Get())) {
+			commandList->SetGraphicsRootSignature(shader->rootSignature_.Get());
+		}
+		if (impl_->stateCache_.SetPipelineState(shader->pipeline_.Get())) {
+			commandList->SetPipelineState(shader->pipeline_.Get());
+		}
 	}
 
-	void LightingShader::End() {
+	void LightingShader::Context::End() {
 		assert(impl_->commandList);
 		impl_->commandList = nullptr;
 	}
 
-	void LightingShader::Apply() {
-		ID3D12DescriptorHeap* heaps[] = { impl_->srvHeap_, impl_->samplerHeap_ };
+	void LightingShader::Context::Apply() { impl_->Apply(); }
 
-		// _countof͐z̗vf𐔂Ă}N
-		impl_->commandList->SetDescriptorHeaps(_countof(heaps), heaps);
+	const RootStateStats& LightingShader::Context::frameStats() const {
+		return impl_->stateCache_.stats();
+	}
 
-		// 萔obt@̓fXNv^e[ugĂȂ
-		// ̏ꍇSetGraphicsRootConstantBufferViewgĒڃAhX𓊂
+	void LightingShader::Context::SetObjectParam(D3D12_GPU_VIRTUAL_ADDRESS addr) {
+		impl_->objParam_ = addr;
+	}
 
-		// b0: ObjectParam
-		impl_->commandList->SetGraphicsRootConstantBufferView(
-			0,                  // VF[_̃WX^ԍ
-			impl_->objParam_);  // GPŨAhX
+	void LightingShader::Context::SetSceneParam(D3D12_GPU_VIRTUAL_ADDRESS addr) {
+		impl_->sceneParam_ = addr;
+	}
 
-		// b1: SceneParam
-		impl_->commandList->SetGraphicsRootConstantBufferView(1, impl_->sceneParam_);
+	void LightingShader::Context::SetMaterialParam(D3D12_GPU_VIRTUAL_ADDRESS addr) {
+		impl_->matParam_ = addr;
+	}
 
-		// b2: MaterialParam
-		impl_->commandList->SetGraphicsRootConstantBufferView(2, impl_->matParam_);
+	void LightingShader::Context::SetMaterialBuffer(D3D12_GPU_VIRTUAL_ADDRESS addr) {
+		impl_->materialBuffer_ = addr;
+	}
 
-		// eNX`ƃTvSetGraphicsRootDescriptorTableŐݒ
-		impl_->commandList->SetGraphicsRootDescriptorTable(3, impl_->srv_);
-		impl_->commandList->SetGraphicsRootDescriptorTable(4, impl_->sampler_);
+	void LightingShader::Context::SetMaterialIndex(std::uint32_t index) {
+		impl_->materialIndex_ = index;
 	}
 
-	void LightingShader::SetObjectParam(D3D12_GPU_VIRTUAL_ADDRESS addr) {
-		impl_->objParam_ = addr;
+	void LightingShader::Context::SetObjectBuffer(D3D12_GPU_VIRTUAL_ADDRESS addr) {
+		impl_->objectBuffer_ = addr;
 	}
 
-	void LightingShader::SetSceneParam(D3D12_GPU_VIRTUAL_ADDRESS addr) {
-		impl_->sceneParam_ = addr;
+	void LightingShader::Context::SetObjectIndex(std::uint32_t index) {
+		impl_->objectIndex_ = index;
 	}
 
-	void LightingShader::SetMaterialParam(D3D12_GPU_VIRTUAL_ADDRESS addr) {
-		impl_->matParam_ = addr;
+	void LightingShader::Context::SetTextureTable(ID3D12DescriptorHeap* heap,
+		const int offset) {
+		impl_->textureHeap_ = heap;
+		impl_->textureTable_ =
+			CD3DX12_GPU_DESCRIPTOR_HANDLE(heap->GetGPUDescriptorHandleForHeapStart(),
+				offset, impl_->shader_->srvDescriptorSize_);
 	}
 
-	void LightingShader::SetSrvDescriptorHeap(ID3D12DescriptorHeap* heap,
+	void LightingShader::Context::SetSrvDescriptorHeap(ID3D12DescriptorHeap* heap,
 		const int offset) {
 		impl_->srvHeap_ = heap;
 		impl_->srv_ =
 			CD3DX12_GPU_DESCRIPTOR_HANDLE(heap->GetGPUDescriptorHandleForHeapStart(),
-				offset, impl_->srvDescriptorSize_);
+				offset, impl_->shader_->srvDescriptorSize_);
 	}
 
-	void LightingShader::SetSamplerDescriptorHeap(ID3D12DescriptorHeap* heap,
+	void LightingShader::Context::SetSamplerDescriptorHeap(ID3D12DescriptorHeap* heap,
 		const int offset) {
 		impl_->samplerHeap_ = heap;
 		impl_->sampler_ =
 			CD3DX12_GPU_DESCRIPTOR_HANDLE(heap->GetGPUDescriptorHandleForHeapStart(),
-				offset, impl_->srvDescriptorSize_);
-	}
-	void LightingShader::SetDammySrvDescriptorHeap(ID3D12DescriptorHeap* heap,
-		const int offset) {
-		// Ŏ󂯎̂͂Ǝg܂킷
-		impl_->dammySrvHeap_ = heap;
-		impl_->dammySrv_ =
-			CD3DX12_GPU_DESCRIPTOR_HANDLE(heap->GetGPUDescriptorHandleForHeapStart(),
-				offset, impl_->srvDescriptorSize_);
-	}
-
-	void LightingShader::SetDefaultSamplerDescriptorHeap(ID3D12DescriptorHeap* heap,
-		const int offset) {
-		impl_->defaultSamplerHeap_ = heap;
-		impl_->defaultSampler_ =
-			CD3DX12_GPU_DESCRIPTOR_HANDLE(heap->GetGPUDescriptorHandleForHeapStart(),
-				offset, impl_->srvDescriptorSize_);
+				offset, impl_->shader_->samplerDescriptorSize_);
 	}
 
 }  // namespace dxapp
\ No newline at end of file
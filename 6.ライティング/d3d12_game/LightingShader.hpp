@@ -1,14 +1,18 @@
 #pragma once
+#include "RootStateCache.hpp"
+
 namespace dxapp {
 	class Device;
 	/*!
 	 * @brief LightingVS / PS𓮂߂̃R[h
+	 * @details [gVOl`ƃpCvCB
+	 *          `ContextAʂăR}hXgɐς
 	 */
 	class LightingShader {
 	public:
 		/*!
 		 * @brief IuWFNgPʂŗpӂׂ\
-		 *       i萔obt@ObjectParamƓj
+		 *       i萔obt@ObjectParamA\obt@ObjectDataƓj
 		 */
 		struct ObjectParam {
 			DirectX::XMFLOAT4X4 world;
@@ -42,6 +46,26 @@ namespace dxapp {
 			Light lights[MaxDirLightNum];  //!< Cg̔z
 		};
 
+		/*!
+		 * @brief ̐ݒ
+		 */
+		struct Options {
+			//! oChXŕ`悷邩
+			//! S̃eNX`SRV1̃e[uAS̃}eA
+			//! 1̍\obt@œnA`悲Ƃɂ̓}eA̔ԍnB
+			//! GPUΉĂȂ(\[XoCfBOTier1)Ȃ畁ʂɕ`悷
+			bool bindless{ false };
+			//! IuWFNgƂ̃f[^(ObjectParam)1̍\obt@œn
+			//! `悲Ƃɂ̓IuWFNg̔ԍn
+			bool objectBuffer{ false };
+			//! s0ɎgÓITvBnullȂe[uœn
+			//! ÓITvgƃTṽe[uƃq[v͐ς܂Ȃ
+			const D3D12_STATIC_SAMPLER_DESC* staticSampler{ nullptr };
+		};
+
+		//! R}hXgɐςނ߂̂́BXbhƂɍ
+		class Context;
+
 	public:
 		/*!
 		 * @brief RXgN^
@@ -55,14 +79,68 @@ namespace dxapp {
 
 		/*!
 		 * @brief 
+		 * @param[in] options oChXȂǂ̐ݒ
+		 */
+		void Initialize(Device* device, const Options& options);
+
+		/*!
+		 * @brief oChXŕ`悵Ă邩
+		 */
+		bool bindless() const;
+
+		/*!
+		 * @brief IuWFNgƂ̃f[^\obt@œnĂ邩
 		 */
-		void Initialize(Device* device);
+		bool objectBuffer() const;
 
 		/*!
 		 * @brief I
 		 */
 		void Terminate();
 
+		/*!
+		 * @brief _~[eNX`̐ݒ
+		 * @param[in] heaps fXNv^q[v
+		 * @param[in] offset q[vł̃ItZbgʒu
+		 */
+		void SetDammySrvDescriptorHeap(ID3D12DescriptorHeap* heap, const int offset);
+
+		/*!
+		 * @brief ftHgƂĎgTṽfXNv^q[v
+		 * @param[in] heaps fXNv^q[v
+		 * @param[in] offset q[vł̃ItZbgʒu
+		 */
+		void SetDefaultSamplerDescriptorHeap(ID3D12DescriptorHeap* heap,
+			const int offset);
+
+	private:
+		//! NX
+		class Impl;
+		std::unique_ptr<Impl> impl_;
+	};
+
+	/*!
+	 * @brief LightingShaderŃR}hXgɐςނ߂̂
+	 * @details `悲ƂɕςƁAς񂾂̂̃LbVB
+	 *          XbhƂ1΁AʁX̃R}hXgɓɐς߂B
+	 *          LightingShader͓ǂނȂ̂ŁAContext蒷Ă΂悢
+	 */
+	class LightingShader::Context {
+	public:
+		Context(const Context&) = delete;
+		Context& operator=(const Context&) = delete;
+
+		/*!
+		 * @brief RXgN^
+		 * @param[in] shader Initialize̍ς񂾃VF[_
+		 */
+		explicit Context(const LightingShader* shader);
+
+		/*!
+		 * @brief fXgN^
+		 */
+		~Context();
+
 		/*!
 		 * @brief t[ŃVF[_gpƂɍŏɌĂяo֐
 		 * @details EndĂԂ܂ł͈̃R}hXgg
@@ -77,14 +155,32 @@ namespace dxapp {
 
 		/*!
 		 * @brief VF[_Ăp[^ŃR}h𔭍s
+		 * @details OApplyƓq[vE͐ς݂ȂȂ
 		 */
 		void Apply();
 
+		/*!
+		 * @brief Begin獡܂łɐς񂾃R}hƏȂR}h̐
+		 */
+		const RootStateStats& frameStats() const;
+
 		/*!
 		 * @brief 萔obt@b0ݒ肷
 		 */
 		void SetObjectParam(D3D12_GPU_VIRTUAL_ADDRESS addr);
 
+		/*!
+		 * @brief S̃IuWFNgObjectParamꂽ\obt@ݒ肷
+		 * @details IuWFNgobt@̂ƂɎgBVF[_t2
+		 */
+		void SetObjectBuffer(D3D12_GPU_VIRTUAL_ADDRESS addr);
+
+		/*!
+		 * @brief gIuWFNg̔ԍݒ肷
+		 * @details SetObjectBufferŐݒ肵obt@̉ԖڂB[g萔œn
+		 */
+		void SetObjectIndex(std::uint32_t index);
+
 		/*!
 		 * @brief 萔obt@b1ݒ肷
 		 */
@@ -96,33 +192,39 @@ namespace dxapp {
 		void SetMaterialParam(D3D12_GPU_VIRTUAL_ADDRESS addr);
 
 		/*!
-		 * @brief QƂSRṼfXNv^q[v
-		 * @param[in] heaps fXNv^q[v
-		 * @param[in] offset q[vł̃ItZbgʒu
+		 * @brief S̃}eAꂽ\obt@ݒ肷(oChXp)
+		 * @details VF[_t1
 		 */
-		void SetSrvDescriptorHeap(ID3D12DescriptorHeap* heap, const int offset);
+		void SetMaterialBuffer(D3D12_GPU_VIRTUAL_ADDRESS addr);
 
 		/*!
-		 * @brief QƂTṽfXNv^q[v
+		 * @brief g}eA̔ԍݒ肷(oChXp)
+		 * @details SetMaterialBufferŐݒ肵obt@̉ԖڂB[g萔œn
+		 */
+		void SetMaterialIndex(std::uint32_t index);
+
+		/*!
+		 * @brief eNX`̃e[uݒ肷(oChXp)
+		 * @details 擪SRV}eÃeNX`ԍ̈ʒuɂȂ
 		 * @param[in] heaps fXNv^q[v
-		 * @param[in] offset q[vł̃ItZbgʒu
+		 * @param[in] offset q[vł̃e[u̐擪
 		 */
-		void SetSamplerDescriptorHeap(ID3D12DescriptorHeap* heap, const int offset);
+		void SetTextureTable(ID3D12DescriptorHeap* heap, const int offset);
 
 		/*!
-		 * @brief _~[eNX`̐ݒ
+		 * @brief QƂSRṼfXNv^q[v
 		 * @param[in] heaps fXNv^q[v
 		 * @param[in] offset q[vł̃ItZbgʒu
 		 */
-		void SetDammySrvDescriptorHeap(ID3D12DescriptorHeap* heap, const int offset);
+		void SetSrvDescriptorHeap(ID3D12DescriptorHeap* heap, const int offset);
 
 		/*!
-		 * @brief ftHgƂĎgTṽfXNv^q[v
+		 * @brief QƂTṽfXNv^q[v
+		 * @details ÓITvgĂƂ̓R}hXgɐς܂Ȃ
 		 * @param[in] heaps fXNv^q[v
 		 * @param[in] offset q[vł̃ItZbgʒu
 		 */
-		void SetDefaultSamplerDescriptorHeap(ID3D12DescriptorHeap* heap,
-			const int offset);
+		void SetSamplerDescriptorHeap(ID3D12DescriptorHeap* heap, const int offset);
 
 	private:
 		//! NX
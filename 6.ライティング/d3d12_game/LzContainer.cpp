@@ -0,0 +1,403 @@
+﻿#include "LzContainer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+namespace dxapp {
+namespace lz {
+
+namespace {
+constexpr std::size_t MinMatch = 4;
+constexpr std::size_t MaxOffset = 65535;
+constexpr unsigned int HashBits = 16;
+
+// LZ4と同じ制限。最後の5バイトは必ずリテラルで、最後の12バイトからは一致を探さない
+constexpr std::size_t LastLiterals = 5;
+constexpr std::size_t MatchFindLimit = 12;
+
+std::uint32_t Read32(const std::uint8_t* p) {
+  std::uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+std::uint32_t Hash(const std::uint8_t* p) {
+  return (Read32(p) * 2654435761u) >> (32 - HashBits);
+}
+
+/*!
+ * @brief 15以上の長さの続きを書く
+ */
+std::uint8_t* WriteLength(std::uint8_t* op, std::size_t length) {
+  while (length >= 255) {
+    *op++ = 255;
+    length -= 255;
+  }
+  *op++ = static_cast<std::uint8_t>(length);
+  return op;
+}
+
+/*!
+ * @brief 15以上の長さの続きを読む
+ */
+bool ReadLength(const std::uint8_t*& ip, const std::uint8_t* end,
+                std::size_t& length) {
+  std::uint8_t b = 0;
+  do {
+    if (ip == end) {
+      return false;
+    }
+    b = *ip++;
+    length += b;
+  } while (b == 255);
+  return true;
+}
+
+/*!
+ * @brief リテラルと一致を1組書く。matchLengthが0ならリテラルだけ
+ */
+std::uint8_t* WriteSequence(std::uint8_t* op, const std::uint8_t* literals,
+                            std::size_t literalLength, std::size_t offset,
+                            std::size_t matchLength) {
+  const auto matchCode = matchLength == 0 ? 0 : matchLength - MinMatch;
+  *op++ = static_cast<std::uint8_t>((std::min<std::size_t>(literalLength, 15)
+                                     << 4) |
+                                    std::min<std::size_t>(matchCode, 15));
+  if (literalLength >= 15) {
+    op = WriteLength(op, literalLength - 15);
+  }
+  if (literalLength > 0) {
+    std::memcpy(op, literals, literalLength);
+    op += literalLength;
+  }
+  if (matchLength == 0) {
+    return op;
+  }
+  *op++ = static_cast<std::uint8_t>(offset);
+  *op++ = static_cast<std::uint8_t>(offset >> 8);
+  if (matchCode >= 15) {
+    op = WriteLength(op, matchCode - 15);
+  }
+  return op;
+}
+
+unsigned int ResolveThreadCount(unsigned int threadCount, std::size_t jobs) {
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return static_cast<unsigned int>(
+      std::max<std::size_t>(1, std::min<std::size_t>(threadCount, jobs)));
+}
+
+/*!
+ * @brief count個の仕事をスレッドで取り合う
+ */
+template <class F>
+void ParallelFor(std::size_t count, unsigned int threadCount, const F& fn) {
+  threadCount = ResolveThreadCount(threadCount, count);
+  std::atomic<std::size_t> next{0};
+  auto worker = [&]() {
+    for (;;) {
+      const auto i = next.fetch_add(1);
+      if (i >= count) {
+        return;
+      }
+      fn(i);
+    }
+  };
+  std::vector<std::thread> threads{};
+  for (unsigned int i = 1; i < threadCount; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+}  // namespace
+
+std::size_t CompressBound(std::size_t size) { return size + size / 255 + 16; }
+
+std::size_t Compress(const std::uint8_t* src, std::size_t size,
+                     std::uint8_t* dst) {
+  auto op = dst;
+  const auto end = src + size;
+  auto anchor = src;
+
+  if (size > MatchFindLimit) {
+    // 4バイトのハッシュから最後に出てきた位置を引く
+    std::vector<std::uint32_t> table(std::size_t(1) << HashBits, 0);
+    const auto matchLimit = end - LastLiterals;
+    const auto findLimit = end - MatchFindLimit;
+    auto ip = src + 1;
+    while (ip < findLimit) {
+      const auto h = Hash(ip);
+      auto ref = src + table[h];
+      table[h] = static_cast<std::uint32_t>(ip - src);
+      if (ref >= ip || std::size_t(ip - ref) > MaxOffset ||
+          Read32(ref) != Read32(ip)) {
+        // 一致しない区間が長いほど大きく飛ばす。圧縮できないデータで遅くならない
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+
+      // 前後に伸ばす
+      while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+        --ip;
+        --ref;
+      }
+      auto length = MinMatch;
+      while (ip + length < matchLimit && ip[length] == ref[length]) {
+        ++length;
+      }
+
+      op = WriteSequence(op, anchor, ip - anchor, ip - ref, length);
+      ip += length;
+      anchor = ip;
+      if (ip < findLimit) {
+        table[Hash(ip - 2)] = static_cast<std::uint32_t>(ip - 2 - src);
+      }
+    }
+  }
+
+  // 残りはリテラルだけの組にする
+  op = WriteSequence(op, anchor, end - anchor, 0, 0);
+  return op - dst;
+}
+
+bool Decompress(const std::uint8_t* src, std::size_t srcSize,
+                std::uint8_t* dst, std::size_t dstSize) {
+  auto ip = src;
+  const auto iend = src + srcSize;
+  auto op = dst;
+  const auto oend = dst + dstSize;
+  while (ip < iend) {
+    const auto token = *ip++;
+
+    std::size_t literalLength = token >> 4;
+    if (literalLength == 15 && !ReadLength(ip, iend, literalLength)) {
+      return false;
+    }
+    if (literalLength > std::size_t(iend - ip) ||
+        literalLength > std::size_t(oend - op)) {
+      return false;
+    }
+    // 短いリテラルは長さによらず16バイトまとめてコピーする
+    // はみ出した分は後で上書きされる
+    if (literalLength <= 16 && iend - ip >= 16 && oend - op >= 16) {
+      std::memcpy(op, ip, 16);
+    } else if (literalLength > 0) {
+      std::memcpy(op, ip, literalLength);
+    }
+    ip += literalLength;
+    op += literalLength;
+    if (ip == iend) {
+      break;  // 最後の組はリテラルだけ
+    }
+
+    if (iend - ip < 2) {
+      return false;
+    }
+    const std::size_t offset = ip[0] | (std::size_t(ip[1]) << 8);
+    ip += 2;
+    if (offset == 0 || offset > std::size_t(op - dst)) {
+      return false;
+    }
+    std::size_t length = token & 15;
+    if (length == 15 && !ReadLength(ip, iend, length)) {
+      return false;
+    }
+    length += MinMatch;
+    if (length > std::size_t(oend - op)) {
+      return false;
+    }
+
+    auto match = op - offset;
+    const auto matchEnd = op + length;
+    if (offset >= 8 && oend - matchEnd >= 8) {
+      // 離れていれば8バイトずつ。リテラルと同じくはみ出してよい
+      do {
+        std::memcpy(op, match, 8);
+        op += 8;
+        match += 8;
+      } while (op < matchEnd);
+      op = matchEnd;
+    } else {
+      // 重なっていれば、コピー済みの範囲が倍々に増えていく
+      while (op < matchEnd) {
+        const auto n = std::min<std::size_t>(op - match, matchEnd - op);
+        std::memcpy(op, match, n);
+        op += n;
+      }
+    }
+  }
+  return op == oend;
+}
+
+bool WriteContainer(const std::filesystem::path& path,
+                    const std::uint8_t* data, std::size_t size,
+                    std::uint32_t chunkSize, unsigned int threadCount) {
+  if (chunkSize == 0) {
+    return false;
+  }
+  const auto count = (size + chunkSize - 1) / chunkSize;
+
+  // チャンクごとに圧縮。縮まなければそのまま入れる
+  std::vector<std::vector<std::uint8_t>> compressed(count);
+  ParallelFor(count, threadCount, [&](std::size_t i) {
+    const auto begin = data + i * chunkSize;
+    const auto rawSize =
+        std::min<std::size_t>(chunkSize, size - i * chunkSize);
+    auto& out = compressed[i];
+    out.resize(CompressBound(rawSize));
+    const auto compressedSize = Compress(begin, rawSize, out.data());
+    if (compressedSize < rawSize) {
+      out.resize(compressedSize);
+    } else {
+      out.assign(begin, begin + rawSize);
+    }
+  });
+
+  ContainerHeader header{};
+  header.chunkSize = chunkSize;
+  header.rawSize = size;
+  header.chunkCount = static_cast<std::uint32_t>(count);
+  std::vector<ChunkEntry> chunks(count);
+  std::uint64_t offset = sizeof(header) + sizeof(ChunkEntry) * count;
+  for (std::size_t i = 0; i < count; ++i) {
+    chunks[i].offset = offset;
+    chunks[i].compressedSize =
+        static_cast<std::uint32_t>(compressed[i].size());
+    chunks[i].rawSize = static_cast<std::uint32_t>(
+        std::min<std::size_t>(chunkSize, size - i * chunkSize));
+    offset += compressed[i].size();
+  }
+
+  std::ofstream outfile(path, std::ios::binary);
+  if (!outfile) {
+    return false;
+  }
+  outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  outfile.write(reinterpret_cast<const char*>(chunks.data()),
+                static_cast<std::streamsize>(sizeof(ChunkEntry) * count));
+  for (const auto& chunk : compressed) {
+    outfile.write(reinterpret_cast<const char*>(chunk.data()),
+                  static_cast<std::streamsize>(chunk.size()));
+  }
+  return static_cast<bool>(outfile);
+}
+
+bool ReadContainer(const std::filesystem::path& path, Container& container) {
+  container = Container{};
+
+  // 圧縮してあるので全部読んでも小さい。読み込みは1回にまとめる
+  std::ifstream infile(path, std::ios::binary);
+  if (!infile) {
+    return false;
+  }
+  auto& file = container.file;
+  file.resize(static_cast<std::size_t>(infile.seekg(0, infile.end).tellg()));
+  infile.seekg(0, infile.beg)
+      .read(reinterpret_cast<char*>(file.data()),
+            static_cast<std::streamsize>(file.size()));
+  if (!infile || file.size() < sizeof(ContainerHeader)) {
+    return false;
+  }
+
+  auto& header = container.header;
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (header.magic != ContainerMagic || header.chunkSize == 0 ||
+      (file.size() - sizeof(header)) / sizeof(ChunkEntry) <
+          header.chunkCount) {
+    return false;
+  }
+  const auto count =
+      (header.rawSize + header.chunkSize - 1) / header.chunkSize;
+  if (count != header.chunkCount) {
+    return false;
+  }
+
+  // 索引が展開先とファイルの範囲に収まっているか
+  container.chunks.resize(header.chunkCount);
+  std::memcpy(container.chunks.data(), file.data() + sizeof(header),
+              sizeof(ChunkEntry) * header.chunkCount);
+  for (std::size_t i = 0; i < container.chunks.size(); ++i) {
+    const auto& chunk = container.chunks[i];
+    const auto expected = std::min<std::uint64_t>(
+        header.chunkSize, header.rawSize - i * header.chunkSize);
+    if (chunk.rawSize != expected || chunk.compressedSize > chunk.rawSize ||
+        chunk.offset > file.size() ||
+        chunk.compressedSize > file.size() - chunk.offset) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DecompressContainer(const Container& container, std::uint8_t* dst,
+                         unsigned int threadCount) {
+  std::atomic<bool> isSucceeded{true};
+  ParallelFor(container.chunks.size(), threadCount, [&](std::size_t i) {
+    const auto& chunk = container.chunks[i];
+    const auto src = container.file.data() + chunk.offset;
+    const auto out = dst + i * container.header.chunkSize;
+    if (chunk.compressedSize == chunk.rawSize) {
+      std::memcpy(out, src, chunk.rawSize);
+    } else if (!Decompress(src, chunk.compressedSize, out, chunk.rawSize)) {
+      isSucceeded = false;
+    }
+  });
+  return isSucceeded;
+}
+
+bool DecompressSpans(const Container& container,
+                     const std::vector<CopySpan>& spans,
+                     unsigned int threadCount) {
+  if (!spans.empty() &&
+      spans.back().offset + spans.back().size > container.header.rawSize) {
+    return false;
+  }
+
+  std::atomic<bool> isSucceeded{true};
+  ParallelFor(container.chunks.size(), threadCount, [&](std::size_t i) {
+    const auto& chunk = container.chunks[i];
+    const auto chunkBegin = std::uint64_t(i) * container.header.chunkSize;
+    const auto chunkEnd = chunkBegin + chunk.rawSize;
+    auto span = std::partition_point(
+        spans.begin(), spans.end(), [chunkBegin](const CopySpan& s) {
+          return s.offset + s.size <= chunkBegin;
+        });
+    if (span == spans.end() || span->offset >= chunkEnd) {
+      return;  // どの範囲にもかからない
+    }
+
+    // 展開はマッチで前の出力を読むので、書き込み結合のメモリには直接展開しない
+    // 圧縮していないチャンクはファイルからそのまま写す
+    const std::uint8_t* raw = container.file.data() + chunk.offset;
+    if (chunk.compressedSize != chunk.rawSize) {
+      thread_local std::vector<std::uint8_t> scratch{};
+      scratch.resize(chunk.rawSize);
+      if (!Decompress(raw, chunk.compressedSize, scratch.data(),
+                      chunk.rawSize)) {
+        isSucceeded = false;
+        return;
+      }
+      raw = scratch.data();
+    }
+
+    for (; span != spans.end() && span->offset < chunkEnd; ++span) {
+      const auto begin = std::max(span->offset, chunkBegin);
+      const auto end = std::min(span->offset + span->size, chunkEnd);
+      std::memcpy(span->dst + (begin - span->offset),
+                  raw + (begin - chunkBegin),
+                  static_cast<std::size_t>(end - begin));
+    }
+  });
+  return isSucceeded;
+}
+
+}  // namespace lz
+}  // namespace dxapp
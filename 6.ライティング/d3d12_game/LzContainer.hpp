@@ -0,0 +1,134 @@
+﻿#pragma once
+// DDSなどをチャンクごとにLZ圧縮して入れておくコンテナ
+// チャンクは独立して圧縮してあるので、展開をスレッドに振り分けられる
+// クッカーでも使うのでPngDecoderと同じく標準ライブラリだけで書いている
+//
+// ファイルの並び(リトルエンディアン):
+//   ContainerHeader
+//   ChunkEntry x chunkCount (チャンクの索引)
+//   チャンクのデータ
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace dxapp {
+namespace lz {
+
+//! ファイルの先頭("DDZ1")
+constexpr std::uint32_t ContainerMagic = 0x315A4444;
+
+//! チャンクの大きさの標準。スレッドに振り分けやすく、索引が大きくなりすぎない
+constexpr std::uint32_t DefaultChunkSize = 256 * 1024;
+
+/*!
+ * @brief コンテナのヘッダ
+ */
+struct ContainerHeader {
+  std::uint32_t magic{ContainerMagic};
+  std::uint32_t chunkSize{0};   //!< 展開後のチャンクの大きさ(最後だけ短い)
+  std::uint64_t rawSize{0};     //!< 展開後の全体の大きさ
+  std::uint32_t chunkCount{0};  //!< チャンクの数
+  std::uint32_t reserved{0};
+};
+
+/*!
+ * @brief チャンクの索引
+ * @details compressedSizeとrawSizeが同じなら圧縮せずにそのまま入っている
+ */
+struct ChunkEntry {
+  std::uint64_t offset{0};          //!< ファイル先頭からの位置
+  std::uint32_t compressedSize{0};  //!< 圧縮後の大きさ
+  std::uint32_t rawSize{0};         //!< 展開後の大きさ
+};
+
+static_assert(sizeof(ContainerHeader) == 24, "ContainerHeader size mismatch");
+static_assert(sizeof(ChunkEntry) == 16, "ChunkEntry size mismatch");
+
+/*!
+ * @brief 圧縮後の最大の大きさ
+ */
+std::size_t CompressBound(std::size_t size);
+
+/*!
+ * @brief LZ4と同じ並びのブロックに圧縮する
+ * @details 64KBの窓から4バイト以上一致するところを貪欲に探す。
+ *          展開の速さを優先していて、圧縮率はそこそこ
+ * @param[out] dst CompressBound(size)以上の大きさが必要
+ * @return 圧縮後の大きさ
+ */
+std::size_t Compress(const std::uint8_t* src, std::size_t size,
+                     std::uint8_t* dst);
+
+/*!
+ * @brief Compressで作ったブロックを展開する
+ * @details 壊れたデータでもdstの外には書かない
+ * @return dstSizeちょうどに展開できればtrue
+ */
+bool Decompress(const std::uint8_t* src, std::size_t srcSize,
+                std::uint8_t* dst, std::size_t dstSize);
+
+/*!
+ * @brief 読み込んだコンテナ
+ * @details ファイル全体を1回で読んでおき、展開はDecompressContainerでやる
+ */
+struct Container {
+  ContainerHeader header{};
+  std::vector<ChunkEntry> chunks{};
+  std::vector<std::uint8_t> file{};  //!< ファイルの中身全部
+};
+
+/*!
+ * @brief データをチャンクに分けて圧縮し、ファイルに書く
+ * @param[in] chunkSize チャンクの大きさ
+ * @param[in] threadCount 使うスレッド数。0ならハードウェアに合わせる
+ * @return 成否
+ */
+bool WriteContainer(const std::filesystem::path& path,
+                    const std::uint8_t* data, std::size_t size,
+                    std::uint32_t chunkSize = DefaultChunkSize,
+                    unsigned int threadCount = 0);
+
+/*!
+ * @brief コンテナを読み込む
+ * @details ヘッダと索引の整合性も確認する。展開はしない
+ * @return 成否
+ */
+bool ReadContainer(const std::filesystem::path& path, Container& container);
+
+/*!
+ * @brief コンテナを並列に展開する
+ * @details チャンク単位でスレッドに振り分けて、dstの決まった位置に直接書く
+ * @param[out] dst container.header.rawSize以上の大きさが必要
+ * @param[in] threadCount 使うスレッド数。0ならハードウェアに合わせる
+ * @return 全部のチャンクを展開できればtrue
+ */
+bool DecompressContainer(const Container& container, std::uint8_t* dst,
+                         unsigned int threadCount = 0);
+
+/*!
+ * @brief 展開後のデータの範囲と、その写し先
+ */
+struct CopySpan {
+  std::uint64_t offset{0};      //!< 展開後のデータの中の位置
+  std::uint64_t size{0};        //!< バイト数
+  std::uint8_t* dst{nullptr};  //!< 写し先
+};
+
+/*!
+ * @brief コンテナを並列に展開し、展開後のデータの決まった範囲だけを写す
+ * @details チャンクはスレッドごとの作業領域(チャンク1つ分)に展開してから、
+ *          チャンクにかかる範囲をdstへコピーする。どの範囲にもかからない
+ *          チャンクは展開しない。アップロードヒープのように行の間隔が違う
+ *          メモリへ、全体の大きさのバッファを作らずに書ける。
+ *          dstは書くだけで読まないので、書き込み結合のメモリでもよい
+ * @param[in] spans offsetの順に並べ、重ならないようにする
+ * @param[in] threadCount 使うスレッド数。0ならハードウェアに合わせる
+ * @return 範囲にかかるチャンクを全部展開できて、範囲が展開後に収まればtrue
+ */
+bool DecompressSpans(const Container& container,
+                     const std::vector<CopySpan>& spans,
+                     unsigned int threadCount = 0);
+
+}  // namespace lz
+}  // namespace dxapp
@@ -0,0 +1,198 @@
+﻿#include "MipGenerator.hpp"
+
+#include "PixelConvert.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// SSE2はx64なら必ず使える。RGBAの1ピクセルがちょうどfloat4になる
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define DXAPP_MIP_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace dxapp {
+namespace mip {
+
+namespace {
+//! 1スレッドに任せる最低の行数。小さいミップはスレッドを立てる方が遅い
+constexpr std::uint32_t MinRowsPerThread = 32;
+
+unsigned int ResolveThreadCount(unsigned int threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::thread::hardware_concurrency();
+  }
+  return std::max(1u, threadCount);
+}
+
+/*!
+ * @brief 行を分割してスレッドで処理する
+ * @param[in] fn fn(開始行, 終了行)
+ */
+template <typename F>
+void ParallelRows(std::uint32_t rows, unsigned int threadCount, const F& fn) {
+  const auto count = std::min<std::uint32_t>(
+      threadCount, std::max(1u, rows / MinRowsPerThread));
+  if (count <= 1) {
+    fn(0u, rows);
+    return;
+  }
+  const auto step = (rows + count - 1) / count;
+  std::vector<std::thread> threads{};
+  for (std::uint32_t i = 1; i < count; ++i) {
+    const auto y0 = std::min(rows, i * step);
+    const auto y1 = std::min(rows, y0 + step);
+    threads.emplace_back([&fn, y0, y1]() { fn(y0, y1); });
+  }
+  fn(0u, std::min(rows, step));  // 最初の分はこのスレッドでやる
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+/*!
+ * @brief 8bitからリニアなfloatにする
+ */
+void Decode(const std::uint8_t* src, std::uint32_t width, std::uint32_t height,
+            std::size_t rowPitch, bool srgb, float* dst,
+            unsigned int threadCount) {
+  ParallelRows(height, threadCount, [&](std::uint32_t y0, std::uint32_t y1) {
+    for (auto y = y0; y < y1; ++y) {
+      pixel::DecodeToFloat(src + y * rowPitch, dst + std::size_t(y) * width * 4,
+                           width, srgb);
+    }
+  });
+}
+
+/*!
+ * @brief 2x2の平均で半分のサイズにする
+ */
+void Downsample(const float* src, std::uint32_t srcWidth,
+                std::uint32_t srcHeight, float* dst, std::uint32_t dstWidth,
+                std::uint32_t dstHeight, unsigned int threadCount) {
+  ParallelRows(dstHeight, threadCount, [&](std::uint32_t y0, std::uint32_t y1) {
+    for (auto y = y0; y < y1; ++y) {
+      const auto row0 =
+          src + std::size_t(std::min(y * 2, srcHeight - 1)) * srcWidth * 4;
+      const auto row1 =
+          src + std::size_t(std::min(y * 2 + 1, srcHeight - 1)) * srcWidth * 4;
+      auto out = dst + std::size_t(y) * dstWidth * 4;
+      for (std::uint32_t x = 0; x < dstWidth; ++x) {
+        const auto x0 = std::size_t(std::min(x * 2, srcWidth - 1)) * 4;
+        const auto x1 = std::size_t(std::min(x * 2 + 1, srcWidth - 1)) * 4;
+#if DXAPP_MIP_USE_SSE2
+        const auto sum = _mm_add_ps(
+            _mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+            _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+        _mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+        for (int c = 0; c < 4; ++c) {
+          out[x * 4 + c] =
+              (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) *
+              0.25f;
+        }
+#endif
+      }
+    }
+  });
+}
+
+/*!
+ * @brief リニアなfloatから8bitに戻す
+ */
+void Encode(const float* src, std::uint32_t width, std::uint32_t height,
+            bool srgb, std::uint8_t* dst, unsigned int threadCount) {
+  ParallelRows(height, threadCount, [&](std::uint32_t y0, std::uint32_t y1) {
+    for (auto y = y0; y < y1; ++y) {
+      const auto offset = std::size_t(y) * width * 4;
+      pixel::EncodeFromFloat(src + offset, dst + offset, width, srgb);
+    }
+  });
+}
+}  // namespace
+
+std::uint32_t CountMips(std::uint32_t width, std::uint32_t height) {
+  std::uint32_t count = 1;
+  while (width > 1 || height > 1) {
+    width = std::max(1u, width / 2);
+    height = std::max(1u, height / 2);
+    ++count;
+  }
+  return count;
+}
+
+void GenerateMipChain(const std::uint8_t* rgba, std::uint32_t width,
+                      std::uint32_t height, std::size_t rowPitch, bool srgb,
+                      std::vector<MipLevel>& mips, unsigned int threadCount) {
+  mips.clear();
+  if (width <= 1 && height <= 1) {
+    return;
+  }
+  threadCount = ResolveThreadCount(threadCount);
+
+  // mip0をリニアにして、そこから順番に半分にしていく
+  std::vector<float> current(std::size_t(width) * height * 4);
+  std::vector<float> next{};
+  Decode(rgba, width, height, rowPitch, srgb, current.data(), threadCount);
+
+  mips.reserve(CountMips(width, height) - 1);
+  while (width > 1 || height > 1) {
+    const auto nextWidth = std::max(1u, width / 2);
+    const auto nextHeight = std::max(1u, height / 2);
+    next.resize(std::size_t(nextWidth) * nextHeight * 4);
+    Downsample(current.data(), width, height, next.data(), nextWidth,
+               nextHeight, threadCount);
+
+    MipLevel level{};
+    level.width = nextWidth;
+    level.height = nextHeight;
+    level.pixels.resize(level.rowPitch() * nextHeight);
+    Encode(next.data(), nextWidth, nextHeight, srgb, level.pixels.data(),
+           threadCount);
+    mips.emplace_back(std::move(level));
+
+    current.swap(next);
+    width = nextWidth;
+    height = nextHeight;
+  }
+}
+
+void GenerateMipChains(const std::vector<MipJob>& jobs,
+                       unsigned int threadCount) {
+  threadCount = ResolveThreadCount(threadCount);
+  if (jobs.size() == 1 || threadCount == 1) {
+    for (const auto& job : jobs) {
+      GenerateMipChain(job.rgba, job.width, job.height, job.rowPitch, job.srgb,
+                       *job.mips, threadCount);
+    }
+    return;
+  }
+
+  // テクスチャ同士は独立しているので1スレッド1テクスチャで取り合う
+  std::atomic<std::size_t> next{0};
+  auto worker = [&]() {
+    for (;;) {
+      const auto i = next.fetch_add(1);
+      if (i >= jobs.size()) {
+        return;
+      }
+      const auto& job = jobs[i];
+      GenerateMipChain(job.rgba, job.width, job.height, job.rowPitch, job.srgb,
+                       *job.mips, 1);
+    }
+  };
+  const auto count =
+      std::min<unsigned int>(threadCount, static_cast<unsigned int>(jobs.size()));
+  std::vector<std::thread> threads{};
+  for (unsigned int i = 1; i < count; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+}  // namespace mip
+}  // namespace dxapp
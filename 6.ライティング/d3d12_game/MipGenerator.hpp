@@ -0,0 +1,71 @@
+﻿#pragma once
+// ミップチェーンをCPUで作る
+// クッカーでも使うのでPngDecoderと同じく標準ライブラリだけで書いている
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dxapp {
+namespace mip {
+
+/*!
+ * @brief 1段分のミップ
+ * @details ピクセルはRGBA各8bit(チャンネルの並びは元画像と同じ)
+ */
+struct MipLevel {
+  std::uint32_t width{0};              //!< 幅
+  std::uint32_t height{0};             //!< 高さ
+  std::vector<std::uint8_t> pixels{};  //!< width * 4 * height
+
+  /*!
+   * @brief 1行のバイト数
+   */
+  std::size_t rowPitch() const { return std::size_t(width) * 4; }
+};
+
+/*!
+ * @brief 1x1までのミップの段数(mip0を含む)
+ */
+std::uint32_t CountMips(std::uint32_t width, std::uint32_t height);
+
+/*!
+ * @brief ミップチェーンを作る
+ * @details 2x2のボックスフィルタ。途中の段はリニアなfloatのまま持って
+ *          次の段を作るので、量子化の誤差が積み重ならない。
+ *          奇数サイズのときは端のピクセルを繰り返す
+ * @param[in] rgba mip0のピクセル(8bit x 4チャンネル)
+ * @param[in] width mip0の幅
+ * @param[in] height mip0の高さ
+ * @param[in] rowPitch mip0の1行のバイト数
+ * @param[in] srgb trueならRGBをリニアに戻してから平均する(アルファはそのまま)
+ * @param[out] mips mip1以降。mips[0]がmip1
+ * @param[in] threadCount 使うスレッド数。0ならハードウェアに合わせる
+ */
+void GenerateMipChain(const std::uint8_t* rgba, std::uint32_t width,
+                      std::uint32_t height, std::size_t rowPitch, bool srgb,
+                      std::vector<MipLevel>& mips,
+                      unsigned int threadCount = 0);
+
+/*!
+ * @brief まとめてミップを作るときの1テクスチャ分
+ */
+struct MipJob {
+  const std::uint8_t* rgba{nullptr};  //!< mip0のピクセル
+  std::uint32_t width{0};             //!< mip0の幅
+  std::uint32_t height{0};            //!< mip0の高さ
+  std::size_t rowPitch{0};            //!< mip0の1行のバイト数
+  bool srgb{false};                   //!< sRGBとして平均するか
+  std::vector<MipLevel>* mips{nullptr};  //!< 出力先
+};
+
+/*!
+ * @brief 複数のテクスチャのミップチェーンを並列で作る
+ * @details テクスチャ単位でスレッドに振り分ける。1枚だけなら行単位で分ける
+ * @param[in] jobs テクスチャの並び
+ * @param[in] threadCount 使うスレッド数。0ならハードウェアに合わせる
+ */
+void GenerateMipChains(const std::vector<MipJob>& jobs,
+                       unsigned int threadCount = 0);
+
+}  // namespace mip
+}  // namespace dxapp
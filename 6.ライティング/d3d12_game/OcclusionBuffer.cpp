@@ -0,0 +1,344 @@
+﻿#include "OcclusionBuffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "SimdLanes.hpp"
+#include "WorkerPool.hpp"
+
+namespace {
+using namespace dxapp::simd;
+
+static_assert(dxapp::OcclusionBuffer::TileWidth % LaneCount == 0,
+              "TileWidth must be a multiple of the lane count");
+
+//! 何も描いていないところの深度
+constexpr float FarDepth = 1.0f;
+
+//! 三角形の辺を外に出す量(ピクセル)
+constexpr float EdgeBias = 1.0f / 256.0f;
+
+/*!
+ * @brief 行ベクトルの行列を掛ける(out = a * b)
+ */
+void Multiply(const float (&a)[4][4], const float (&b)[4][4],
+              float (&out)[4][4]) {
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      out[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j] +
+                  a[i][3] * b[3][j];
+    }
+  }
+}
+
+/*!
+ * @brief 点(x, y, z, 1)を行列で動かす
+ */
+void Transform(const float (&m)[4][4], float x, float y, float z,
+               float (&out)[4]) {
+  for (int j = 0; j < 4; ++j) {
+    out[j] = x * m[0][j] + y * m[1][j] + z * m[2][j] + m[3][j];
+  }
+}
+}  // namespace
+
+namespace dxapp {
+
+void OcclusionBuffer::Initialize(std::uint32_t width, std::uint32_t height) {
+  tilesX_ = (width + TileWidth - 1) / TileWidth;
+  tilesY_ = (height + TileHeight - 1) / TileHeight;
+  width_ = tilesX_ * TileWidth;
+  height_ = tilesY_ * TileHeight;
+  depth_.assign(std::size_t(width_) * height_, FarDepth);
+  tileMaxDepth_.assign(std::size_t(tilesX_) * tilesY_, FarDepth);
+  tileBins_.resize(std::size_t(tilesX_) * tilesY_);
+  triangles_.clear();
+}
+
+void OcclusionBuffer::BeginFrame(const float (&viewProj)[4][4]) {
+  std::memcpy(viewProj_, viewProj, sizeof(viewProj_));
+  triangles_.clear();
+  for (auto& bin : tileBins_) {
+    bin.clear();  // 中身の領域は次のフレームでも使う
+  }
+}
+
+std::uint32_t OcclusionBuffer::AddOccluder(const float* positions,
+                                           std::uint32_t stride,
+                                           const std::uint32_t* indices,
+                                           std::uint32_t indexCount,
+                                           const float (&world)[4][4]) {
+  float m[4][4];
+  Multiply(world, viewProj_, m);
+
+  const auto base = reinterpret_cast<const std::uint8_t*>(positions);
+  std::uint32_t added = 0;
+  for (std::uint32_t i = 0; i + 2 < indexCount; i += 3) {
+    // クリップ空間から画面のピクセルにする。Yは下向き
+    float sx[3], sy[3], sz[3];
+    bool clipped = false;
+    for (int v = 0; v < 3; ++v) {
+      const auto p = reinterpret_cast<const float*>(
+          base + std::size_t(indices[i + v]) * stride);
+      float clip[4];
+      Transform(m, p[0], p[1], p[2], clip);
+      if (!(clip[3] > 0.0f) || clip[2] < 0.0f) {
+        clipped = true;  // 手前のクリップ面にかかる
+        break;
+      }
+      const auto invW = 1.0f / clip[3];
+      sx[v] = (clip[0] * invW * 0.5f + 0.5f) * width_;
+      sy[v] = (0.5f - clip[1] * invW * 0.5f) * height_;
+      sz[v] = clip[2] * invW;
+    }
+    if (clipped) {
+      continue;
+    }
+
+    // 表裏は気にせず、辺の式が内側で正になる向きにそろえる
+    auto area = (sx[1] - sx[0]) * (sy[2] - sy[0]) -
+                (sx[2] - sx[0]) * (sy[1] - sy[0]);
+    if (area == 0.0f || !std::isfinite(area)) {
+      continue;
+    }
+    if (area < 0.0f) {
+      std::swap(sx[1], sx[2]);
+      std::swap(sy[1], sy[2]);
+      std::swap(sz[1], sz[2]);
+      area = -area;
+    }
+
+    Triangle tri{};
+    tri.minX = std::max(0, static_cast<std::int32_t>(
+                               std::floor(std::min({sx[0], sx[1], sx[2]}))));
+    tri.minY = std::max(0, static_cast<std::int32_t>(
+                               std::floor(std::min({sy[0], sy[1], sy[2]}))));
+    tri.maxX = std::min(static_cast<std::int32_t>(width_),
+                        static_cast<std::int32_t>(
+                            std::ceil(std::max({sx[0], sx[1], sx[2]}))));
+    tri.maxY = std::min(static_cast<std::int32_t>(height_),
+                        static_cast<std::int32_t>(
+                            std::ceil(std::max({sy[0], sy[1], sy[2]}))));
+    if (tri.minX >= tri.maxX || tri.minY >= tri.maxY) {
+      continue;  // 画面の外
+    }
+
+    // 式は範囲の左上からの座標で持ち、値を小さくして誤差を抑える
+    for (int v = 0; v < 3; ++v) {
+      sx[v] -= static_cast<float>(tri.minX);
+      sy[v] -= static_cast<float>(tri.minY);
+    }
+
+    // 辺iはv[i]からv[i+1]。左回りなら内側で正
+    // 隣の三角形と共有する辺の上のピクセルが、FMAなどの丸めの違いで
+    // どちらにも入らずひびになるので、辺を1/256ピクセルだけ外に出す
+    for (int e = 0; e < 3; ++e) {
+      const auto n = (e + 1) % 3;
+      const auto dx = sx[n] - sx[e];
+      const auto dy = sy[n] - sy[e];
+      tri.edgeA[e] = -dy;
+      tri.edgeB[e] = dx;
+      tri.edgeC[e] = dy * sx[e] - dx * sy[e] +
+                     (std::fabs(dx) + std::fabs(dy)) * EdgeBias;
+    }
+
+    // 深度の平面
+    const auto invArea = 1.0f / area;
+    const auto dz1 = sz[1] - sz[0];
+    const auto dz2 = sz[2] - sz[0];
+    tri.depthA = (dz1 * (sy[2] - sy[0]) - dz2 * (sy[1] - sy[0])) * invArea;
+    tri.depthB = (dz2 * (sx[1] - sx[0]) - dz1 * (sx[2] - sx[0])) * invArea;
+    tri.depthC = sz[0] - tri.depthA * sx[0] - tri.depthB * sy[0];
+    tri.minDepth = std::min({sz[0], sz[1], sz[2]});
+    tri.maxDepth = std::max({sz[0], sz[1], sz[2]});
+
+    // かかるタイルに入れる
+    const auto index = static_cast<std::uint32_t>(triangles_.size());
+    triangles_.push_back(tri);
+    const auto tx0 = tri.minX / TileWidth;
+    const auto tx1 = (tri.maxX - 1) / TileWidth;
+    const auto ty0 = tri.minY / TileHeight;
+    const auto ty1 = (tri.maxY - 1) / TileHeight;
+    for (auto ty = ty0; ty <= ty1; ++ty) {
+      for (auto tx = tx0; tx <= tx1; ++tx) {
+        tileBins_[ty * tilesX_ + tx].push_back(index);
+      }
+    }
+    ++added;
+  }
+  return added;
+}
+
+void OcclusionBuffer::Rasterize(WorkerPool* workers) {
+  const auto tileCount = tilesX_ * tilesY_;
+  const auto taskCount =
+      workers ? std::min(workers->threadCount(), tileCount) : 1;
+  if (taskCount <= 1) {
+    for (std::uint32_t tile = 0; tile < tileCount; ++tile) {
+      RasterizeTile(tile);
+    }
+    return;
+  }
+
+  // タイルは重ならないので、スレッドごとに飛び飛びに受け持つ
+  // 遮蔽物は画面の一部に集まりやすいので、まとめて分けるより偏りにくい
+  workers->Run(taskCount, [this, tileCount, taskCount](std::uint32_t task) {
+    for (auto tile = task; tile < tileCount; tile += taskCount) {
+      RasterizeTile(tile);
+    }
+  });
+}
+
+void OcclusionBuffer::RasterizeTile(std::uint32_t tile) {
+  const auto tileX = static_cast<std::int32_t>((tile % tilesX_) * TileWidth);
+  const auto tileY = static_cast<std::int32_t>((tile / tilesX_) * TileHeight);
+  for (std::uint32_t y = 0; y < TileHeight; ++y) {
+    auto row = depth_.data() + std::size_t(tileY + y) * width_ + tileX;
+    std::fill(row, row + TileWidth, FarDepth);
+  }
+
+  const auto zero = Splat(0.0f);
+  for (const auto index : tileBins_[tile]) {
+    const auto& tri = triangles_[index];
+    const auto x0 = std::max(tileX, tri.minX) / static_cast<std::int32_t>(
+                                                    LaneCount) *
+                    static_cast<std::int32_t>(LaneCount);
+    const auto x1 = std::min<std::int32_t>(tileX + TileWidth, tri.maxX);
+    const auto y0 = std::max(tileY, tri.minY);
+    const auto y1 = std::min<std::int32_t>(tileY + TileHeight, tri.maxY);
+
+    const Lanes a[3] = {Splat(tri.edgeA[0]), Splat(tri.edgeA[1]),
+                        Splat(tri.edgeA[2])};
+    const auto depthA = Splat(tri.depthA);
+    const auto minDepth = Splat(tri.minDepth);
+    const auto maxDepth = Splat(tri.maxDepth);
+    for (auto y = y0; y < y1; ++y) {
+      // 行の中で変わらない分を先に足しておく。ピクセルの中心で調べる
+      const auto py = static_cast<float>(y - tri.minY) + 0.5f;
+      Lanes rowEdge[3];
+      for (int e = 0; e < 3; ++e) {
+        rowEdge[e] = Splat(tri.edgeB[e] * py + tri.edgeC[e]);
+      }
+      const auto rowDepth = Splat(tri.depthB * py + tri.depthC);
+      auto row = depth_.data() + std::size_t(y) * width_;
+
+      for (auto x = x0; x < x1; x += LaneCount) {
+        const auto px =
+            Add(Splat(static_cast<float>(x - tri.minX) + 0.5f), Ramp());
+        auto inside = GreaterEqual(Add(Mul(a[0], px), rowEdge[0]), zero);
+        inside = And(inside, GreaterEqual(Add(Mul(a[1], px), rowEdge[1]), zero));
+        inside = And(inside, GreaterEqual(Add(Mul(a[2], px), rowEdge[2]), zero));
+        if (Mask(inside) == 0) {
+          continue;
+        }
+
+        // 補間した深度が頂点の範囲を出ないようにして、手前のほうを残す
+        auto z = Add(Mul(depthA, px), rowDepth);
+        z = Min(Max(z, minDepth), maxDepth);
+        const auto old = Load(row + x);
+        Store(row + x, Select(inside, Min(old, z), old));
+      }
+    }
+  }
+
+  // タイルの一番奥を覚えておく
+  auto farthest = Splat(0.0f);
+  for (std::uint32_t y = 0; y < TileHeight; ++y) {
+    const auto row = depth_.data() + std::size_t(tileY + y) * width_ + tileX;
+    for (std::uint32_t x = 0; x < TileWidth; x += LaneCount) {
+      farthest = Max(farthest, Load(row + x));
+    }
+  }
+  float lanes[LaneCount];
+  Store(lanes, farthest);
+  tileMaxDepth_[tile] = *std::max_element(lanes, lanes + LaneCount);
+}
+
+bool OcclusionBuffer::IsOccluded(const Aabb& box) const {
+  // 8つの角を画面に置いて、囲む四角形と一番手前の深度を求める
+  auto minX = static_cast<float>(width_), minY = static_cast<float>(height_);
+  auto maxX = 0.0f, maxY = 0.0f;
+  auto nearest = FarDepth;
+  for (int i = 0; i < 8; ++i) {
+    float clip[4];
+    Transform(viewProj_, (i & 1) ? box.maxX : box.minX,
+              (i & 2) ? box.maxY : box.minY, (i & 4) ? box.maxZ : box.minZ,
+              clip);
+    if (!(clip[3] > 0.0f) || clip[2] < 0.0f) {
+      return false;  // カメラの手前にかかるものは見えるとする
+    }
+    const auto invW = 1.0f / clip[3];
+    const auto sx = (clip[0] * invW * 0.5f + 0.5f) * width_;
+    const auto sy = (0.5f - clip[1] * invW * 0.5f) * height_;
+    minX = std::min(minX, sx);
+    maxX = std::max(maxX, sx);
+    minY = std::min(minY, sy);
+    maxY = std::max(maxY, sy);
+    nearest = std::min(nearest, clip[2] * invW);
+  }
+
+  const auto x0 = std::max(0, static_cast<std::int32_t>(std::floor(minX)));
+  const auto y0 = std::max(0, static_cast<std::int32_t>(std::floor(minY)));
+  const auto x1 = std::min(static_cast<std::int32_t>(width_),
+                           static_cast<std::int32_t>(std::ceil(maxX)));
+  const auto y1 = std::min(static_cast<std::int32_t>(height_),
+                           static_cast<std::int32_t>(std::ceil(maxY)));
+  if (x0 >= x1 || y0 >= y1) {
+    return false;  // 画面の外は視錐台カリングに任せる
+  }
+
+  for (auto ty = y0 / TileHeight; ty <= (y1 - 1) / TileHeight; ++ty) {
+    for (auto tx = x0 / TileWidth; tx <= (x1 - 1) / TileWidth; ++tx) {
+      // タイルの一番奥より奥なら、このタイルでは隠れている
+      if (nearest > tileMaxDepth_[ty * tilesX_ + tx]) {
+        continue;
+      }
+      // 決まらなければ重なるピクセルを見る。1つでも手前なら見える
+      const auto px0 = std::max<std::int32_t>(x0, tx * TileWidth);
+      const auto px1 = std::min<std::int32_t>(x1, (tx + 1) * TileWidth);
+      const auto py0 = std::max<std::int32_t>(y0, ty * TileHeight);
+      const auto py1 = std::min<std::int32_t>(y1, (ty + 1) * TileHeight);
+      for (auto y = py0; y < py1; ++y) {
+        const auto row = depth_.data() + std::size_t(y) * width_;
+        for (auto x = px0; x < px1; ++x) {
+          if (nearest <= row[x]) {
+            return false;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool OcclusionBuffer::WriteDepthImage(const std::string& path) const {
+  // 深度は奥に寄っているので、描いたものの範囲を黒からグレーに広げる
+  auto nearest = FarDepth, farthest = 0.0f;
+  for (const auto d : depth_) {
+    if (d < FarDepth) {
+      nearest = std::min(nearest, d);
+      farthest = std::max(farthest, d);
+    }
+  }
+  const auto range = farthest > nearest ? farthest - nearest : 1.0f;
+
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  file << "P5\n" << width_ << " " << height_ << "\n255\n";
+  std::vector<std::uint8_t> pixels(depth_.size());
+  for (std::size_t i = 0; i < depth_.size(); ++i) {
+    const auto d = depth_[i];
+    pixels[i] = d >= FarDepth ? 255
+                              : static_cast<std::uint8_t>(
+                                    (d - nearest) / range * 200.0f);
+  }
+  file.write(reinterpret_cast<const char*>(pixels.data()),
+             static_cast<std::streamsize>(pixels.size()));
+  return static_cast<bool>(file);
+}
+
+}  // namespace dxapp
@@ -0,0 +1,133 @@
+﻿#pragma once
+// 手前の大きなもの(遮蔽物)をCPUで小さな深度バッファに描き、
+// その後ろに隠れるオブジェクトをGPUに送る前に外す
+// 深度バッファはタイルに分け、タイルごとに一番奥の深度も持つ(2段の階層)
+// D3D12には触らないので、Linuxでも動かして確かめられる
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Bvh.hpp"
+
+namespace dxapp {
+class WorkerPool;
+
+/*!
+ * @brief 1フレームの遮蔽カリングの結果。デバッグ表示や調整に使う
+ */
+struct OcclusionStats {
+  std::uint32_t occluderTriangles{0};  //!< 深度バッファに描いた三角形
+  std::uint32_t testedObjects{0};      //!< 隠れているか調べたオブジェクト
+  std::uint32_t occludedObjects{0};    //!< 隠れていて外したオブジェクト
+  double rasterizeMs{0.0};             //!< 遮蔽物を描くのにかかった時間
+  double testMs{0.0};                  //!< オブジェクトを調べるのにかかった時間
+};
+
+/*!
+ * @brief 遮蔽カリング用の低解像度の深度バッファ
+ * @details 深度はD3Dと同じく0が手前、1が奥。
+ *          BeginFrameの後にAddOccluderで遮蔽物を足し、Rasterizeで描いてから
+ *          IsOccludedで調べる。三角形はタイルごとに分けておき、
+ *          タイルごとに別のスレッドで描く。
+ *          隠れていると言うのは確かなときだけで、迷ったら見えるとする
+ */
+class OcclusionBuffer {
+ public:
+  //! タイルの大きさ(ピクセル)。幅はSIMDのレーン数の倍数
+  static constexpr std::uint32_t TileWidth = 32;
+  static constexpr std::uint32_t TileHeight = 8;
+
+  OcclusionBuffer(const OcclusionBuffer&) = delete;
+  OcclusionBuffer& operator=(const OcclusionBuffer&) = delete;
+
+  /*!
+   * @brief デフォルトコンストラクタ
+   */
+  OcclusionBuffer() = default;
+
+  /*!
+   * @brief 深度バッファを作る
+   * @details 幅と高さはタイルの倍数に切り上げる
+   */
+  void Initialize(std::uint32_t width, std::uint32_t height);
+
+  /*!
+   * @brief フレームを始める。前のフレームの遮蔽物は捨てる
+   * @param[in] viewProj ビュー射影行列。XMFLOAT4X4のmをそのまま渡せる
+   */
+  void BeginFrame(const float (&viewProj)[4][4]);
+
+  /*!
+   * @brief 遮蔽物の三角形を足す
+   * @details 手前のクリップ面にかかる三角形は描かない(隠す量が減るだけ)
+   * @param[in] positions 頂点の位置(float3)の先頭
+   * @param[in] stride 頂点の間のバイト数
+   * @param[in] indices 3つで1つの三角形
+   * @param[in] world ワールド行列
+   * @return 足した三角形の数
+   */
+  std::uint32_t AddOccluder(const float* positions, std::uint32_t stride,
+                            const std::uint32_t* indices,
+                            std::uint32_t indexCount,
+                            const float (&world)[4][4]);
+
+  /*!
+   * @brief 足した遮蔽物を深度バッファに描く
+   * @param[in] workers nullptrなら呼んだスレッドだけで描く
+   */
+  void Rasterize(WorkerPool* workers);
+
+  /*!
+   * @brief 箱が遮蔽物の後ろに完全に隠れているか
+   * @details 先にタイルの一番奥の深度と比べ、決まらないタイルだけピクセルを見る。
+   *          ほかのスレッドと同時に呼んでよい
+   */
+  bool IsOccluded(const Aabb& box) const;
+
+  /*!
+   * @brief 深度をグレーの画像(PGM)で書き出す。手前ほど黒く、何もなければ白
+   * @return 書けたらtrue
+   */
+  bool WriteDepthImage(const std::string& path) const;
+
+  std::uint32_t width() const { return width_; }
+  std::uint32_t height() const { return height_; }
+  const float* depth() const { return depth_.data(); }
+
+  /*!
+   * @brief 足した三角形の数
+   */
+  std::uint32_t triangleCount() const {
+    return static_cast<std::uint32_t>(triangles_.size());
+  }
+
+ private:
+  /*!
+   * @brief 画面に置いた三角形
+   * @details 辺の式 a * x + b * y + c がどれも0以上なら内側。
+   *          深度も z = a * x + b * y + c の平面で持つ。
+   *          x, yは(minX, minY)からのピクセル座標
+   */
+  struct Triangle {
+    float edgeA[3], edgeB[3], edgeC[3];
+    float depthA, depthB, depthC;
+    float minDepth, maxDepth;  //!< 補間した深度をこの範囲に収める
+    std::int32_t minX, minY, maxX, maxY;  //!< 触るピクセルの範囲(maxは含まない)
+  };
+
+  /*!
+   * @brief 1つのタイルをクリアして、そこにかかる三角形を描く
+   */
+  void RasterizeTile(std::uint32_t tile);
+
+  std::uint32_t width_{0}, height_{0};
+  std::uint32_t tilesX_{0}, tilesY_{0};
+  float viewProj_[4][4]{};
+
+  std::vector<float> depth_{};                         //!< ピクセルの深度
+  std::vector<float> tileMaxDepth_{};                  //!< タイルの一番奥
+  std::vector<Triangle> triangles_{};                  //!< 足した三角形
+  std::vector<std::vector<std::uint32_t>> tileBins_{};  //!< タイルごとの三角形
+};
+
+}  // namespace dxapp
@@ -0,0 +1,659 @@
+﻿#include "PixelConvert.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+// SSE2はx64なら必ず使える。AVX2はCPUを調べてから使う
+// MSVCは/arch:AVX2なしでもAVX2の組み込み関数を使えるが、
+// GCCとClangは関数ごとにtarget属性がいる
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define DXAPP_PIXEL_USE_SSE2 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define DXAPP_PIXEL_TARGET_AVX2
+#else
+#define DXAPP_PIXEL_TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#endif
+#endif
+
+namespace dxapp {
+namespace pixel {
+
+namespace {
+//! リニア→sRGBのテーブルの精度。暗部でも1段が8bitの0.2程度になる
+constexpr int EncodeTableBits = 14;
+constexpr int EncodeTableSize = 1 << EncodeTableBits;
+
+/*!
+ * @brief 変換テーブル
+ */
+struct Tables {
+  //! [0, 256)がsRGB→リニア、[256, 512)が8bit→0～1
+  float toFloat[512];
+  //! リニア→sRGB。AVX2のgatherは4バイト読むので3バイト余分に持つ
+  std::uint8_t toSrgb[EncodeTableSize + 3];
+
+  Tables() {
+    for (int i = 0; i < 256; ++i) {
+      const float c = i / 255.0f;
+      toFloat[i] = c <= 0.04045f ? c / 12.92f
+                                 : std::pow((c + 0.055f) / 1.055f, 2.4f);
+      toFloat[256 + i] = c;
+    }
+    for (int i = 0; i < EncodeTableSize; ++i) {
+      const float l = i / float(EncodeTableSize - 1);
+      const float c = l <= 0.0031308f
+                          ? l * 12.92f
+                          : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+      toSrgb[i] = static_cast<std::uint8_t>(
+          std::clamp(std::lround(c * 255.0f), 0l, 255l));
+    }
+    std::fill(toSrgb + EncodeTableSize, toSrgb + EncodeTableSize + 3,
+              toSrgb[EncodeTableSize - 1]);
+  }
+};
+
+const Tables& GetTables() {
+  static const Tables tables{};  // 初回だけ作る(スレッドセーフ)
+  return tables;
+}
+
+SimdLevel DetectSimdLevel() {
+#if DXAPP_PIXEL_USE_SSE2
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4]{};
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return SimdLevel::SSE2;
+  }
+  __cpuid(info, 1);
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx = (info[2] & (1 << 28)) != 0;
+  const bool f16c = (info[2] & (1 << 29)) != 0;
+  // OSがYMMレジスタを保存してくれるか
+  if (!osxsave || !avx || !f16c || (_xgetbv(0) & 6) != 6) {
+    return SimdLevel::SSE2;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0 ? SimdLevel::AVX2 : SimdLevel::SSE2;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")
+             ? SimdLevel::AVX2
+             : SimdLevel::SSE2;
+#endif
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel SupportedLevel() {
+  static const SimdLevel level = DetectSimdLevel();
+  return level;
+}
+
+std::atomic<SimdLevel>& CurrentLevel() {
+  static std::atomic<SimdLevel> level{SupportedLevel()};
+  return level;
+}
+
+//-------------------------------------------------------------------
+// スカラー。SIMDの端数の処理にも使う
+//-------------------------------------------------------------------
+void SwizzleRBScalar(const std::uint8_t* src, std::uint8_t* dst,
+                     std::size_t count) {
+  for (std::size_t i = 0; i < count * 4; i += 4) {
+    const auto r = src[i + 0];
+    const auto b = src[i + 2];
+    dst[i + 0] = b;
+    dst[i + 1] = src[i + 1];
+    dst[i + 2] = r;
+    dst[i + 3] = src[i + 3];
+  }
+}
+
+void ExpandRGBToRGBAScalar(const std::uint8_t* src, std::uint8_t* dst,
+                           std::size_t count) {
+  for (std::size_t i = 0; i < count; ++i) {
+    dst[i * 4 + 0] = src[i * 3 + 0];
+    dst[i * 4 + 1] = src[i * 3 + 1];
+    dst[i * 4 + 2] = src[i * 3 + 2];
+    dst[i * 4 + 3] = 255;
+  }
+}
+
+//! x * a / 255の四捨五入を割り算なしで求める
+inline std::uint8_t MulDiv255(std::uint32_t x, std::uint32_t a) {
+  const auto t = x * a + 128;
+  return static_cast<std::uint8_t>((t + (t >> 8)) >> 8);
+}
+
+void PremultiplyAlphaScalar(const std::uint8_t* src, std::uint8_t* dst,
+                            std::size_t count) {
+  for (std::size_t i = 0; i < count * 4; i += 4) {
+    const auto a = src[i + 3];
+    dst[i + 0] = MulDiv255(src[i + 0], a);
+    dst[i + 1] = MulDiv255(src[i + 1], a);
+    dst[i + 2] = MulDiv255(src[i + 2], a);
+    dst[i + 3] = a;
+  }
+}
+
+void DecodeToFloatScalar(const std::uint8_t* src, float* dst,
+                         std::size_t count, bool srgb) {
+  const auto& tables = GetTables();
+  const auto rgb = tables.toFloat + (srgb ? 0 : 256);
+  const auto alpha = tables.toFloat + 256;
+  for (std::size_t i = 0; i < count * 4; i += 4) {
+    dst[i + 0] = rgb[src[i + 0]];
+    dst[i + 1] = rgb[src[i + 1]];
+    dst[i + 2] = rgb[src[i + 2]];
+    dst[i + 3] = alpha[src[i + 3]];
+  }
+}
+
+void EncodeFromFloatScalar(const float* src, std::uint8_t* dst,
+                           std::size_t count, bool srgb) {
+  const auto& tables = GetTables();
+  // RGBはテーブルの添え字、アルファは8bitの値にする
+  const float rgbScale = srgb ? float(EncodeTableSize - 1) : 255.0f;
+  for (std::size_t i = 0; i < count * 4; i += 4) {
+    for (int c = 0; c < 4; ++c) {
+      // SSEのmax/minと同じ比較にして、NaNは0にする
+      auto v = src[i + c];
+      v = v > 0.0f ? v : 0.0f;
+      v = v < 1.0f ? v : 1.0f;
+      const auto q = static_cast<std::int32_t>(
+          std::nearbyint(v * (c == 3 ? 255.0f : rgbScale)));
+      dst[i + c] = (srgb && c < 3) ? tables.toSrgb[q]
+                                   : static_cast<std::uint8_t>(q);
+    }
+  }
+}
+
+inline std::uint32_t FloatBits(float f) {
+  std::uint32_t u;
+  std::memcpy(&u, &f, 4);
+  return u;
+}
+
+inline float BitsFloat(std::uint32_t u) {
+  float f;
+  std::memcpy(&f, &u, 4);
+  return f;
+}
+
+// halfの変換はSSE2版とビット単位で同じ手順にしてある
+constexpr std::uint32_t HalfOverflow = (127 + 16) << 23;   // これ以上は無限大
+constexpr std::uint32_t HalfMinNormal = (127 - 14) << 23;  // これ未満は非正規化数
+constexpr std::uint32_t HalfSubnormalMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+constexpr std::uint32_t HalfNormalBias = 0xfff - ((127 - 15) << 23);
+constexpr std::uint32_t HalfToFloatMagic = (254 - 15) << 23;
+
+std::uint16_t FloatToHalf1(float f) {
+  auto x = FloatBits(f);
+  const auto sign = x & 0x80000000u;
+  x ^= sign;
+  std::uint32_t h = 0;
+  if (x >= HalfOverflow) {
+    // NaNはF16Cと同じく、仮数の上位10bitを残してクワイエットNaNにする
+    h = x > 0x7f800000u ? 0x7e00 | ((x >> 13) & 0x3ff) : 0x7c00;
+  } else if (x < HalfMinNormal) {
+    // 足し算の丸めで仮数を丸める
+    h = FloatBits(BitsFloat(x) + BitsFloat(HalfSubnormalMagic)) -
+        HalfSubnormalMagic;
+  } else {
+    const auto mantissaOdd = (x >> 13) & 1;
+    h = (x + HalfNormalBias + mantissaOdd) >> 13;
+  }
+  return static_cast<std::uint16_t>(h | (sign >> 16));
+}
+
+float HalfToFloat1(std::uint16_t h) {
+  const std::uint32_t expMantissa = h & 0x7fffu;
+  const std::uint32_t sign = std::uint32_t(h & 0x8000u) << 16;
+  auto bits = FloatBits(BitsFloat(expMantissa << 13) *
+                        BitsFloat(HalfToFloatMagic));
+  if (expMantissa > 0x7bff) {
+    bits |= 255u << 23;  // 無限大とNaN
+  }
+  if (expMantissa > 0x7c00) {
+    bits |= 1u << 22;  // F16Cと同じく、シグナリングNaNはクワイエットNaNにする
+  }
+  return BitsFloat(bits | sign);
+}
+
+void FloatToHalfScalar(const float* src, std::uint16_t* dst,
+                       std::size_t count) {
+  for (std::size_t i = 0; i < count; ++i) {
+    dst[i] = FloatToHalf1(src[i]);
+  }
+}
+
+void HalfToFloatScalar(const std::uint16_t* src, float* dst,
+                       std::size_t count) {
+  for (std::size_t i = 0; i < count; ++i) {
+    dst[i] = HalfToFloat1(src[i]);
+  }
+}
+
+#if DXAPP_PIXEL_USE_SSE2
+//-------------------------------------------------------------------
+// SSE2
+//-------------------------------------------------------------------
+void SwizzleRBSSE2(const std::uint8_t* src, std::uint8_t* dst,
+                   std::size_t count) {
+  // pshufbはSSSE3なので、シフトとマスクで入れ替える
+  const auto ga = _mm_set1_epi32(static_cast<int>(0xff00ff00u));
+  const auto low = _mm_set1_epi32(0xff);
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const auto v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+    const auto r = _mm_slli_epi32(_mm_and_si128(v, low), 16);
+    const auto b = _mm_and_si128(_mm_srli_epi32(v, 16), low);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4),
+                     _mm_or_si128(_mm_and_si128(v, ga), _mm_or_si128(r, b)));
+  }
+  SwizzleRBScalar(src + i * 4, dst + i * 4, count - i);
+}
+
+void ExpandRGBToRGBASSE2(const std::uint8_t* src, std::uint8_t* dst,
+                         std::size_t count) {
+  // 16バイト読んで3バイトずつずらした4ピクセルを並べる
+  const auto alpha = _mm_set1_epi32(static_cast<int>(0xff000000u));
+  std::size_t i = 0;
+  for (; i + 6 <= count; i += 4) {
+    const auto v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+    const auto p01 = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+    const auto p23 =
+        _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4),
+                     _mm_or_si128(_mm_unpacklo_epi64(p01, p23), alpha));
+  }
+  ExpandRGBToRGBAScalar(src + i * 3, dst + i * 4, count - i);
+}
+
+//! 16bitに広げた2ピクセルのRGBにアルファを掛ける
+inline __m128i PremultiplyHalf(__m128i v) {
+  const auto a = _mm_shufflehi_epi16(
+      _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+  const auto t = _mm_add_epi16(_mm_mullo_epi16(v, a), _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+void PremultiplyAlphaSSE2(const std::uint8_t* src, std::uint8_t* dst,
+                          std::size_t count) {
+  const auto alphaMask = _mm_set1_epi32(static_cast<int>(0xff000000u));
+  const auto zero = _mm_setzero_si128();
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const auto v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+    const auto lo = PremultiplyHalf(_mm_unpacklo_epi8(v, zero));
+    const auto hi = PremultiplyHalf(_mm_unpackhi_epi8(v, zero));
+    const auto rgb = _mm_andnot_si128(alphaMask, _mm_packus_epi16(lo, hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4),
+                     _mm_or_si128(rgb, _mm_and_si128(v, alphaMask)));
+  }
+  PremultiplyAlphaScalar(src + i * 4, dst + i * 4, count - i);
+}
+
+void DecodeToFloatSSE2(const std::uint8_t* src, float* dst, std::size_t count,
+                       bool srgb) {
+  // sRGBはテーブルを引くしかないのでスカラーと同じ
+  if (srgb) {
+    DecodeToFloatScalar(src, dst, count, srgb);
+    return;
+  }
+  // テーブルの値と同じになるように掛け算ではなく割り算にする
+  const auto zero = _mm_setzero_si128();
+  const auto scale = _mm_set1_ps(255.0f);
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const auto v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+    const auto lo = _mm_unpacklo_epi8(v, zero);
+    const auto hi = _mm_unpackhi_epi8(v, zero);
+    const __m128i q[4]{_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                       _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)};
+    for (int k = 0; k < 4; ++k) {
+      _mm_storeu_ps(dst + (i + k) * 4,
+                    _mm_div_ps(_mm_cvtepi32_ps(q[k]), scale));
+    }
+  }
+  DecodeToFloatScalar(src + i * 4, dst + i * 4, count - i, srgb);
+}
+
+//! 0～1に収めてscaleを掛けて最近接偶数に丸める
+inline __m128i Quantize(const float* p, __m128 scale) {
+  auto v = _mm_loadu_ps(p);
+  v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+  return _mm_cvtps_epi32(_mm_mul_ps(v, scale));
+}
+
+void EncodeFromFloatSSE2(const float* src, std::uint8_t* dst,
+                         std::size_t count, bool srgb) {
+  const auto& tables = GetTables();
+  const float rgbScale = srgb ? float(EncodeTableSize - 1) : 255.0f;
+  const auto scale = _mm_setr_ps(rgbScale, rgbScale, rgbScale, 255.0f);
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const auto q0 = Quantize(src + i * 4 + 0, scale);
+    const auto q1 = Quantize(src + i * 4 + 4, scale);
+    const auto q2 = Quantize(src + i * 4 + 8, scale);
+    const auto q3 = Quantize(src + i * 4 + 12, scale);
+    if (!srgb) {
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i*>(dst + i * 4),
+          _mm_packus_epi16(_mm_packs_epi32(q0, q1), _mm_packs_epi32(q2, q3)));
+      continue;
+    }
+    alignas(16) std::int32_t q[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(q + 0), q0);
+    _mm_store_si128(reinterpret_cast<__m128i*>(q + 4), q1);
+    _mm_store_si128(reinterpret_cast<__m128i*>(q + 8), q2);
+    _mm_store_si128(reinterpret_cast<__m128i*>(q + 12), q3);
+    for (int k = 0; k < 16; ++k) {
+      dst[i * 4 + k] = (k & 3) == 3 ? static_cast<std::uint8_t>(q[k])
+                                    : tables.toSrgb[q[k]];
+    }
+  }
+  EncodeFromFloatScalar(src + i * 4, dst + i * 4, count - i, srgb);
+}
+
+//! FloatToHalf1の4つ分。結果は32bitの下位16bit(符号拡張してある)
+inline __m128i FloatToHalf4(__m128 f) {
+  const auto signMask = _mm_set1_ps(-0.0f);
+  const auto sign = _mm_and_ps(f, signMask);
+  const auto absF = _mm_xor_ps(f, sign);
+  const auto absBits = _mm_castps_si128(absF);
+
+  // 無限大とNaN
+  const auto isNaN = _mm_castps_si128(_mm_cmpunord_ps(absF, absF));
+  const auto isRegular = _mm_cmpgt_epi32(
+      _mm_set1_epi32(static_cast<int>(HalfOverflow)), absBits);
+  const auto nanMantissa = _mm_or_si128(
+      _mm_set1_epi32(0x200),
+      _mm_and_si128(_mm_srli_epi32(absBits, 13), _mm_set1_epi32(0x3ff)));
+  const auto infOrNaN = _mm_or_si128(_mm_and_si128(isNaN, nanMantissa),
+                                     _mm_set1_epi32(0x7c00));
+
+  // 非正規化数
+  const auto isSubnormal = _mm_cmpgt_epi32(
+      _mm_set1_epi32(static_cast<int>(HalfMinNormal)), absBits);
+  const auto magic = _mm_set1_epi32(static_cast<int>(HalfSubnormalMagic));
+  const auto subnormal = _mm_sub_epi32(
+      _mm_castps_si128(_mm_add_ps(absF, _mm_castsi128_ps(magic))), magic);
+
+  // 正規化数。仮数の最下位ビットが奇数なら切り上げ側に寄せる
+  const auto mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(absBits, 31 - 13), 31);
+  const auto normal = _mm_srli_epi32(
+      _mm_sub_epi32(_mm_add_epi32(absBits, _mm_set1_epi32(static_cast<int>(
+                                               HalfNormalBias))),
+                    mantissaOdd),
+      13);
+
+  const auto finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal),
+                                   _mm_andnot_si128(isSubnormal, normal));
+  const auto joined = _mm_or_si128(_mm_and_si128(isRegular, finite),
+                                   _mm_andnot_si128(isRegular, infOrNaN));
+  // 符号は算術シフトで上位16bitまで埋めておくとpacks_epi32でそのまま詰められる
+  return _mm_or_si128(joined, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+
+//! HalfToFloat1の4つ分。入力は32bitの下位16bit
+inline __m128 HalfToFloat4(__m128i h) {
+  const auto expMantissa = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+  const auto sign = _mm_slli_epi32(_mm_xor_si128(h, expMantissa), 16);
+  const auto scaled =
+      _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMantissa, 13)),
+                 _mm_castsi128_ps(_mm_set1_epi32(
+                     static_cast<int>(HalfToFloatMagic))));
+  const auto isInfNaN = _mm_cmpgt_epi32(expMantissa, _mm_set1_epi32(0x7bff));
+  const auto infNaNExp =
+      _mm_and_si128(isInfNaN, _mm_set1_epi32(static_cast<int>(255u << 23)));
+  const auto isNaN = _mm_cmpgt_epi32(expMantissa, _mm_set1_epi32(0x7c00));
+  const auto quiet = _mm_and_si128(isNaN, _mm_set1_epi32(1 << 22));
+  const auto bits = _mm_or_si128(sign, _mm_or_si128(infNaNExp, quiet));
+  return _mm_or_ps(scaled, _mm_castsi128_ps(bits));
+}
+
+void FloatToHalfSSE2(const float* src, std::uint16_t* dst, std::size_t count) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const auto lo = FloatToHalf4(_mm_loadu_ps(src + i));
+    const auto hi = FloatToHalf4(_mm_loadu_ps(src + i + 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_packs_epi32(lo, hi));
+  }
+  FloatToHalfScalar(src + i, dst + i, count - i);
+}
+
+void HalfToFloatSSE2(const std::uint16_t* src, float* dst, std::size_t count) {
+  const auto zero = _mm_setzero_si128();
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const auto h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_ps(dst + i, HalfToFloat4(_mm_unpacklo_epi16(h, zero)));
+    _mm_storeu_ps(dst + i + 4, HalfToFloat4(_mm_unpackhi_epi16(h, zero)));
+  }
+  HalfToFloatScalar(src + i, dst + i, count - i);
+}
+
+//-------------------------------------------------------------------
+// AVX2
+//-------------------------------------------------------------------
+DXAPP_PIXEL_TARGET_AVX2
+void SwizzleRBAVX2(const std::uint8_t* src, std::uint8_t* dst,
+                   std::size_t count) {
+  const auto shuffle = _mm256_setr_epi8(
+      2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,  //
+      2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const auto v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4),
+                        _mm256_shuffle_epi8(v, shuffle));
+  }
+  SwizzleRBSSE2(src + i * 4, dst + i * 4, count - i);
+}
+
+DXAPP_PIXEL_TARGET_AVX2
+void ExpandRGBToRGBAAVX2(const std::uint8_t* src, std::uint8_t* dst,
+                         std::size_t count) {
+  // 24バイトを12バイトずつ上下のレーンに分けてから、レーンの中で並べ替える
+  const auto permute = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+  const auto shuffle = _mm256_setr_epi8(
+      0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,  //
+      0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const auto alpha = _mm256_set1_epi32(static_cast<int>(0xff000000u));
+  std::size_t i = 0;
+  for (; i + 11 <= count; i += 8) {
+    const auto v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 3));
+    const auto rgb =
+        _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, permute), shuffle);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4),
+                        _mm256_or_si256(rgb, alpha));
+  }
+  ExpandRGBToRGBASSE2(src + i * 3, dst + i * 4, count - i);
+}
+
+DXAPP_PIXEL_TARGET_AVX2
+inline __m256i PremultiplyHalfAVX2(__m256i v) {
+  const auto a = _mm256_shufflehi_epi16(
+      _mm256_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)),
+      _MM_SHUFFLE(3, 3, 3, 3));
+  const auto t =
+      _mm256_add_epi16(_mm256_mullo_epi16(v, a), _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+DXAPP_PIXEL_TARGET_AVX2
+void PremultiplyAlphaAVX2(const std::uint8_t* src, std::uint8_t* dst,
+                          std::size_t count) {
+  // unpackとpackはどちらもレーンの中で閉じているので並びは崩れない
+  const auto alphaMask = _mm256_set1_epi32(static_cast<int>(0xff000000u));
+  const auto zero = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const auto v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+    const auto lo = PremultiplyHalfAVX2(_mm256_unpacklo_epi8(v, zero));
+    const auto hi = PremultiplyHalfAVX2(_mm256_unpackhi_epi8(v, zero));
+    const auto rgb =
+        _mm256_andnot_si256(alphaMask, _mm256_packus_epi16(lo, hi));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4),
+                        _mm256_or_si256(rgb, _mm256_and_si256(v, alphaMask)));
+  }
+  PremultiplyAlphaSSE2(src + i * 4, dst + i * 4, count - i);
+}
+
+DXAPP_PIXEL_TARGET_AVX2
+void DecodeToFloatAVX2(const std::uint8_t* src, float* dst, std::size_t count,
+                       bool srgb) {
+  if (!srgb) {
+    DecodeToFloatSSE2(src, dst, count, srgb);
+    return;
+  }
+  // 2ピクセルずつテーブルをgatherで引く。アルファは後ろ半分のテーブル
+  const auto& tables = GetTables();
+  const auto offset = _mm256_setr_epi32(0, 0, 0, 256, 0, 0, 0, 256);
+  std::size_t i = 0;
+  for (; i + 2 <= count; i += 2) {
+    const auto index = _mm256_add_epi32(
+        _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i * 4))),
+        offset);
+    _mm256_storeu_ps(dst + i * 4,
+                     _mm256_i32gather_ps(tables.toFloat, index, 4));
+  }
+  DecodeToFloatScalar(src + i * 4, dst + i * 4, count - i, srgb);
+}
+
+DXAPP_PIXEL_TARGET_AVX2
+inline __m256i QuantizeAVX2(const float* p, __m256 scale) {
+  auto v = _mm256_loadu_ps(p);
+  v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()),
+                    _mm256_set1_ps(1.0f));
+  return _mm256_cvtps_epi32(_mm256_mul_ps(v, scale));
+}
+
+DXAPP_PIXEL_TARGET_AVX2
+void EncodeFromFloatAVX2(const float* src, std::uint8_t* dst,
+                         std::size_t count, bool srgb) {
+  const auto& tables = GetTables();
+  const float rgbScale = srgb ? float(EncodeTableSize - 1) : 255.0f;
+  const auto scale = _mm256_setr_ps(rgbScale, rgbScale, rgbScale, 255.0f,
+                                    rgbScale, rgbScale, rgbScale, 255.0f);
+  // packはレーンごとなので、並びを[0 2 4 6 | 1 3 5 7]から戻す
+  const auto order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  const auto table = reinterpret_cast<const int*>(tables.toSrgb);
+  const auto byteMask = _mm256_set1_epi32(0xff);
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i q[4];
+    for (int k = 0; k < 4; ++k) {
+      q[k] = QuantizeAVX2(src + i * 4 + k * 8, scale);
+      if (srgb) {
+        // RGBだけテーブルの値に置き換える
+        const auto encoded = _mm256_and_si256(
+            _mm256_i32gather_epi32(table, q[k], 1), byteMask);
+        q[k] = _mm256_blend_epi32(encoded, q[k], 0x88);
+      }
+    }
+    const auto packed = _mm256_packus_epi16(_mm256_packs_epi32(q[0], q[1]),
+                                            _mm256_packs_epi32(q[2], q[3]));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4),
+                        _mm256_permutevar8x32_epi32(packed, order));
+  }
+  EncodeFromFloatSSE2(src + i * 4, dst + i * 4, count - i, srgb);
+}
+
+DXAPP_PIXEL_TARGET_AVX2
+void FloatToHalfAVX2(const float* src, std::uint16_t* dst, std::size_t count) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(dst + i),
+        _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+  FloatToHalfSSE2(src + i, dst + i, count - i);
+}
+
+DXAPP_PIXEL_TARGET_AVX2
+void HalfToFloatAVX2(const std::uint16_t* src, float* dst, std::size_t count) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(
+                                  reinterpret_cast<const __m128i*>(src + i))));
+  }
+  HalfToFloatSSE2(src + i, dst + i, count - i);
+}
+#endif
+}  // namespace
+
+SimdLevel simdLevel() { return CurrentLevel().load(); }
+
+void SetSimdLevel(SimdLevel level) {
+  CurrentLevel() = std::min(level, SupportedLevel());
+}
+
+// 命令セットごとの関数を選ぶ
+#if DXAPP_PIXEL_USE_SSE2
+#define DXAPP_PIXEL_DISPATCH(name, ...)    \
+  switch (simdLevel()) {                   \
+    case SimdLevel::AVX2:                  \
+      return name##AVX2(__VA_ARGS__);      \
+    case SimdLevel::SSE2:                  \
+      return name##SSE2(__VA_ARGS__);      \
+    default:                               \
+      return name##Scalar(__VA_ARGS__);    \
+  }
+#else
+#define DXAPP_PIXEL_DISPATCH(name, ...) return name##Scalar(__VA_ARGS__);
+#endif
+
+void SwizzleRB(const std::uint8_t* src, std::uint8_t* dst, std::size_t count) {
+  DXAPP_PIXEL_DISPATCH(SwizzleRB, src, dst, count)
+}
+
+void ExpandRGBToRGBA(const std::uint8_t* src, std::uint8_t* dst,
+                     std::size_t count) {
+  DXAPP_PIXEL_DISPATCH(ExpandRGBToRGBA, src, dst, count)
+}
+
+void PremultiplyAlpha(const std::uint8_t* src, std::uint8_t* dst,
+                      std::size_t count) {
+  DXAPP_PIXEL_DISPATCH(PremultiplyAlpha, src, dst, count)
+}
+
+void DecodeToFloat(const std::uint8_t* src, float* dst, std::size_t count,
+                   bool srgb) {
+  DXAPP_PIXEL_DISPATCH(DecodeToFloat, src, dst, count, srgb)
+}
+
+void EncodeFromFloat(const float* src, std::uint8_t* dst, std::size_t count,
+                     bool srgb) {
+  DXAPP_PIXEL_DISPATCH(EncodeFromFloat, src, dst, count, srgb)
+}
+
+void FloatToHalf(const float* src, std::uint16_t* dst, std::size_t count) {
+  DXAPP_PIXEL_DISPATCH(FloatToHalf, src, dst, count)
+}
+
+void HalfToFloat(const std::uint16_t* src, float* dst, std::size_t count) {
+  DXAPP_PIXEL_DISPATCH(HalfToFloat, src, dst, count)
+}
+
+#undef DXAPP_PIXEL_DISPATCH
+
+}  // namespace pixel
+}  // namespace dxapp
@@ -0,0 +1,90 @@
+﻿#pragma once
+// ピクセルフォーマットの変換
+// SSE2(x64なら必ず使える)と、CPUが対応していればAVX2を使う。
+// どの関数も結果は命令セットによらず同じになる
+// クッカーでも使うのでPngDecoderと同じく標準ライブラリだけで書いている
+#include <cstddef>
+#include <cstdint>
+
+namespace dxapp {
+namespace pixel {
+
+/*!
+ * @brief 使う命令セット
+ */
+enum class SimdLevel {
+  Scalar,  //!< SIMDを使わない
+  SSE2,    //!< SSE2
+  AVX2,    //!< AVX2とF16C
+};
+
+/*!
+ * @brief 今使っている命令セット
+ * @details 初回の呼び出しでCPUを調べる
+ */
+SimdLevel simdLevel();
+
+/*!
+ * @brief 使う命令セットを変える
+ * @details 命令セットごとの結果や速さを比べるためのもの。
+ *          CPUが対応していないものを指定したら対応している一番上にする
+ */
+void SetSimdLevel(SimdLevel level);
+
+/*!
+ * @brief RとBを入れ替える(RGBA8とBGRA8の相互変換)
+ * @details srcとdstは同じでもよい
+ * @param[in] count ピクセル数
+ */
+void SwizzleRB(const std::uint8_t* src, std::uint8_t* dst, std::size_t count);
+
+/*!
+ * @brief RGB8をRGBA8にする。アルファは255
+ * @details srcとdstは重なってはいけない
+ * @param[in] count ピクセル数
+ */
+void ExpandRGBToRGBA(const std::uint8_t* src, std::uint8_t* dst,
+                     std::size_t count);
+
+/*!
+ * @brief RGBA8のRGBにアルファを掛ける
+ * @details c * a / 255を四捨五入する。srcとdstは同じでもよい
+ * @param[in] count ピクセル数
+ */
+void PremultiplyAlpha(const std::uint8_t* src, std::uint8_t* dst,
+                      std::size_t count);
+
+/*!
+ * @brief RGBA8をリニアなfloat4にする
+ * @param[in] srgb trueならRGBをsRGBとしてリニアに戻す(アルファはそのまま)
+ * @param[in] count ピクセル数
+ */
+void DecodeToFloat(const std::uint8_t* src, float* dst, std::size_t count,
+                   bool srgb);
+
+/*!
+ * @brief リニアなfloat4をRGBA8にする
+ * @details 0～1に収めてから最近接偶数に丸める
+ * @param[in] srgb trueならRGBをsRGBにする(アルファはそのまま)
+ * @param[in] count ピクセル数
+ */
+void EncodeFromFloat(const float* src, std::uint8_t* dst, std::size_t count,
+                     bool srgb);
+
+/*!
+ * @brief floatをhalfにする
+ * @details 最近接偶数に丸める。範囲外は無限大。
+ *          NaNはF16Cと同じく仮数の上位10bitを残したクワイエットNaNにする
+ * @param[in] count 要素数(ピクセル数ではない)
+ */
+void FloatToHalf(const float* src, std::uint16_t* dst, std::size_t count);
+
+/*!
+ * @brief halfをfloatにする
+ * @details NaNはF16Cと同じくクワイエットNaNにする
+ * @param[in] count 要素数(ピクセル数ではない)
+ */
+void HalfToFloat(const std::uint16_t* src, float* dst, std::size_t count);
+
+}  // namespace pixel
+}  // namespace dxapp
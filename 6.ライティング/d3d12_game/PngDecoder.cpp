@@ -0,0 +1,1021 @@
+﻿#include "PngDecoder.hpp"
+
+#include "PixelConvert.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+// SSE2はx64なら必ず使えるのでフィルタ解除に使う
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define DXAPP_PNG_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace dxapp {
+namespace png {
+
+namespace {
+//-------------------------------------------------------------------
+// inflate(zlib/deflate)の展開
+//-------------------------------------------------------------------
+
+/*!
+ * @brief deflateのビット列を下位ビットから読むクラス
+ */
+class BitReader {
+ public:
+  BitReader(const std::uint8_t* data, std::size_t size)
+      : cur_(data), end_(data + size) {}
+
+  /*!
+   * @brief 先読み用のバッファに最低57bit貯める
+   */
+  void Refill() {
+    while (count_ <= 56) {
+      std::uint64_t b = 0;
+      if (cur_ < end_) {
+        b = *cur_++;
+      } else {
+        ++overrun_;  // 終端以降は0として読むが、使ってしまったら壊れたデータ
+      }
+      bits_ |= b << count_;
+      count_ += 8;
+    }
+  }
+
+  std::uint32_t Peek(int n) {
+    if (count_ < n) {
+      Refill();
+    }
+    return static_cast<std::uint32_t>(bits_ & ((std::uint64_t(1) << n) - 1));
+  }
+
+  void Consume(int n) {
+    bits_ >>= n;
+    count_ -= n;
+  }
+
+  std::uint32_t Bits(int n) {
+    if (n == 0) {
+      return 0;
+    }
+    auto v = Peek(n);
+    Consume(n);
+    return v;
+  }
+
+  /*!
+   * @brief 次のバイト境界まで読み飛ばす(非圧縮ブロック用)
+   */
+  void AlignToByte() { Consume(count_ & 7); }
+
+  /*!
+   * @brief 終端を超えて読んだか
+   * @details Refillで先読みした分は使っていなければ問題ない
+   */
+  bool IsOverrun() const { return overrun_ * 8 > count_; }
+
+ private:
+  const std::uint8_t* cur_;
+  const std::uint8_t* end_;
+  std::uint64_t bits_{0};
+  int count_{0};
+  int overrun_{0};
+};
+
+/*!
+ * @brief カノニカルハフマン符号のデコーダ
+ * @details 短い符号はテーブル1回引きで、長い符号だけ1bitずつたどる
+ */
+class Huffman {
+ public:
+  static constexpr int MaxBits = 15;
+  static constexpr int FastBits = 10;
+
+  /*!
+   * @brief 符号長の配列からテーブルを作る
+   */
+  bool Build(const std::uint8_t* lengths, int num) {
+    std::fill(std::begin(count_), std::end(count_), std::uint16_t(0));
+    std::fill(std::begin(fast_), std::end(fast_), std::uint16_t(0));
+    for (int i = 0; i < num; ++i) {
+      count_[lengths[i]]++;
+    }
+    count_[0] = 0;
+
+    // 符号が多すぎないかチェック。足りない分には問題ない
+    int left = 1;
+    for (int len = 1; len <= MaxBits; ++len) {
+      left <<= 1;
+      left -= count_[len];
+      if (left < 0) {
+        return false;
+      }
+    }
+
+    // 符号長ごとの先頭位置
+    std::uint16_t offsets[MaxBits + 1]{};
+    for (int len = 1; len < MaxBits; ++len) {
+      offsets[len + 1] = offsets[len] + count_[len];
+    }
+    for (int i = 0; i < num; ++i) {
+      if (lengths[i] != 0) {
+        symbols_[offsets[lengths[i]]++] = static_cast<std::uint16_t>(i);
+      }
+    }
+
+    // 高速テーブル。deflateは符号を上位ビットから詰めるので反転して引く
+    int code = 0;
+    int index = 0;
+    for (int len = 1; len <= FastBits; ++len) {
+      for (int i = 0; i < count_[len]; ++i, ++code, ++index) {
+        int rev = 0;
+        for (int b = 0; b < len; ++b) {
+          rev |= ((code >> b) & 1) << (len - 1 - b);
+        }
+        const auto entry =
+            static_cast<std::uint16_t>((symbols_[index] << 4) | len);
+        for (int k = rev; k < (1 << FastBits); k += (1 << len)) {
+          fast_[k] = entry;
+        }
+      }
+      code <<= 1;
+    }
+    return true;
+  }
+
+  /*!
+   * @brief 1シンボル読む
+   * @return シンボル。壊れた符号なら-1
+   */
+  int Decode(BitReader& reader) const {
+    const auto bits = reader.Peek(MaxBits);
+    const auto entry = fast_[bits & ((1 << FastBits) - 1)];
+    if (entry != 0) {
+      reader.Consume(entry & 0xF);
+      return entry >> 4;
+    }
+
+    // 長い符号は1bitずつ
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= MaxBits; ++len) {
+      code |= (bits >> (len - 1)) & 1;
+      const int count = count_[len];
+      if (code - count < first) {
+        reader.Consume(len);
+        return symbols_[index + (code - first)];
+      }
+      index += count;
+      first += count;
+      first <<= 1;
+      code <<= 1;
+    }
+    return -1;
+  }
+
+ private:
+  std::uint16_t fast_[1 << FastBits]{};  //!< (シンボル << 4) | 符号長
+  std::uint16_t count_[MaxBits + 1]{};   //!< 符号長ごとの個数
+  std::uint16_t symbols_[288]{};         //!< 符号順に並べたシンボル
+};
+
+// 長さ・距離の基本値と追加ビット数(RFC1951)
+constexpr std::uint16_t LengthBase[]{3,  4,  5,  6,   7,   8,   9,   10,
+                                     11, 13, 15, 17,  19,  23,  27,  31,
+                                     35, 43, 51, 59,  67,  83,  99,  115,
+                                     131, 163, 195, 227, 258};
+constexpr std::uint8_t LengthExtra[]{0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                     1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                     4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr std::uint16_t DistBase[]{
+    1,    2,    3,    4,    5,    7,     9,     13,    17,    25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513,   769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr std::uint8_t DistExtra[]{0, 0, 0, 0, 1, 1, 2, 2,  3,  3,
+                                   4, 4, 5, 5, 6, 6, 7, 7,  8,  8,
+                                   9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+/*!
+ * @brief 1ブロック分のシンボルを展開
+ */
+bool InflateBlock(BitReader& reader, const Huffman& lit, const Huffman& dist,
+                  std::uint8_t* out, std::size_t& pos, std::size_t capacity) {
+  for (;;) {
+    const int sym = lit.Decode(reader);
+    if (sym < 0) {
+      return false;
+    }
+    if (sym < 256) {
+      if (pos >= capacity) {
+        return false;
+      }
+      out[pos++] = static_cast<std::uint8_t>(sym);
+      continue;
+    }
+    if (sym == 256) {
+      return true;  // ブロック終端
+    }
+
+    const int lenIndex = sym - 257;
+    if (lenIndex >= 29) {
+      return false;
+    }
+    const std::size_t length =
+        LengthBase[lenIndex] + reader.Bits(LengthExtra[lenIndex]);
+
+    const int distSym = dist.Decode(reader);
+    if (distSym < 0 || distSym >= 30) {
+      return false;
+    }
+    const std::size_t distance =
+        DistBase[distSym] + reader.Bits(DistExtra[distSym]);
+
+    if (distance > pos || length > capacity - pos) {
+      return false;
+    }
+
+    // 重なっているときは前から1バイトずつコピーしないと結果が変わる
+    auto dst = out + pos;
+    const auto src = dst - distance;
+    if (distance >= length) {
+      std::memcpy(dst, src, length);
+    } else {
+      for (std::size_t i = 0; i < length; ++i) {
+        dst[i] = src[i];
+      }
+    }
+    pos += length;
+  }
+}
+
+/*!
+ * @brief zlibストリームを展開
+ * @param[out] out 展開先。サイズはIHDRから計算済みのものを渡す
+ */
+bool Inflate(const std::uint8_t* data, std::size_t size,
+             std::vector<std::uint8_t>& out, std::string* error) {
+  auto fail = [error](const char* msg) {
+    if (error) {
+      *error = msg;
+    }
+    return false;
+  };
+
+  // zlibヘッダ
+  if (size < 2) {
+    return fail("zlib stream too short");
+  }
+  const auto cmf = data[0];
+  const auto flg = data[1];
+  if ((cmf & 0x0F) != 8 || ((cmf << 8) | flg) % 31 != 0 || (flg & 0x20)) {
+    return fail("unsupported zlib header");
+  }
+
+  BitReader reader(data + 2, size - 2);
+  std::size_t pos = 0;
+  const auto capacity = out.size();
+
+  Huffman lit, dist;
+  bool isFinal = false;
+  do {
+    isFinal = reader.Bits(1) != 0;
+    const auto type = reader.Bits(2);
+
+    if (type == 0) {
+      // 非圧縮ブロック
+      reader.AlignToByte();
+      const auto len = reader.Bits(16);
+      const auto nlen = reader.Bits(16);
+      if ((len ^ 0xFFFF) != nlen) {
+        return fail("corrupt stored block");
+      }
+      if (len > capacity - pos) {
+        return fail("too much image data");
+      }
+      for (std::uint32_t i = 0; i < len; ++i) {
+        out[pos++] = static_cast<std::uint8_t>(reader.Bits(8));
+      }
+    } else if (type == 1) {
+      // 固定ハフマン
+      std::uint8_t lengths[288 + 32];
+      std::fill(lengths, lengths + 144, std::uint8_t(8));
+      std::fill(lengths + 144, lengths + 256, std::uint8_t(9));
+      std::fill(lengths + 256, lengths + 280, std::uint8_t(7));
+      std::fill(lengths + 280, lengths + 288, std::uint8_t(8));
+      std::fill(lengths + 288, lengths + 320, std::uint8_t(5));
+      lit.Build(lengths, 288);
+      dist.Build(lengths + 288, 32);
+      if (!InflateBlock(reader, lit, dist, out.data(), pos, capacity)) {
+        return fail("corrupt deflate data");
+      }
+    } else if (type == 2) {
+      // 動的ハフマン。まず符号長の符号表を読む
+      const int hlit = static_cast<int>(reader.Bits(5)) + 257;
+      const int hdist = static_cast<int>(reader.Bits(5)) + 1;
+      const int hclen = static_cast<int>(reader.Bits(4)) + 4;
+      static constexpr std::uint8_t Order[19]{16, 17, 18, 0, 8,  7, 9,
+                                              6,  10, 5,  11, 4, 12, 3,
+                                              13, 2,  14, 1,  15};
+      std::uint8_t clLengths[19]{};
+      for (int i = 0; i < hclen; ++i) {
+        clLengths[Order[i]] = static_cast<std::uint8_t>(reader.Bits(3));
+      }
+      Huffman cl;
+      if (!cl.Build(clLengths, 19)) {
+        return fail("corrupt code length table");
+      }
+
+      std::uint8_t lengths[288 + 32]{};
+      int n = 0;
+      while (n < hlit + hdist) {
+        const int sym = cl.Decode(reader);
+        if (sym < 0) {
+          return fail("corrupt code lengths");
+        }
+        if (sym < 16) {
+          lengths[n++] = static_cast<std::uint8_t>(sym);
+          continue;
+        }
+        int repeat = 0;
+        std::uint8_t value = 0;
+        if (sym == 16) {
+          if (n == 0) {
+            return fail("corrupt code lengths");
+          }
+          value = lengths[n - 1];
+          repeat = 3 + static_cast<int>(reader.Bits(2));
+        } else if (sym == 17) {
+          repeat = 3 + static_cast<int>(reader.Bits(3));
+        } else {
+          repeat = 11 + static_cast<int>(reader.Bits(7));
+        }
+        if (n + repeat > hlit + hdist) {
+          return fail("corrupt code lengths");
+        }
+        std::fill(lengths + n, lengths + n + repeat, value);
+        n += repeat;
+      }
+
+      // 距離符号は長さ表の直後に並んでいる
+      std::uint8_t distLengths[32]{};
+      std::copy(lengths + hlit, lengths + hlit + hdist, distLengths);
+      std::fill(lengths + hlit, lengths + 288, std::uint8_t(0));
+      if (!lit.Build(lengths, 288) || !dist.Build(distLengths, 32)) {
+        return fail("corrupt huffman table");
+      }
+      if (!InflateBlock(reader, lit, dist, out.data(), pos, capacity)) {
+        return fail("corrupt deflate data");
+      }
+    } else {
+      return fail("invalid deflate block type");
+    }
+
+    if (reader.IsOverrun()) {
+      return fail("truncated deflate data");
+    }
+  } while (!isFinal);
+
+  if (pos != capacity) {
+    return fail("not enough image data");
+  }
+  return true;
+}
+
+//-------------------------------------------------------------------
+// フィルタ解除
+//-------------------------------------------------------------------
+enum FilterType : std::uint8_t {
+  FilterNone = 0,
+  FilterSub = 1,
+  FilterUp = 2,
+  FilterAvg = 3,
+  FilterPaeth = 4,
+};
+
+inline std::uint8_t Paeth(int a, int b, int c) {
+  const int pa = std::abs(b - c);
+  const int pb = std::abs(a - c);
+  const int pc = std::abs(a + b - 2 * c);
+  if (pa <= pb && pa <= pc) {
+    return static_cast<std::uint8_t>(a);
+  }
+  return static_cast<std::uint8_t>(pb <= pc ? b : c);
+}
+
+/*!
+ * @brief 1行のフィルタを解除(どのbppでも動く版)
+ */
+void UnfilterRowScalar(std::uint8_t filter, std::uint8_t* cur,
+                       const std::uint8_t* prev, std::size_t rowBytes,
+                       std::size_t bpp) {
+  switch (filter) {
+    case FilterSub:
+      for (std::size_t i = bpp; i < rowBytes; ++i) {
+        cur[i] = static_cast<std::uint8_t>(cur[i] + cur[i - bpp]);
+      }
+      break;
+    case FilterUp:
+      for (std::size_t i = 0; i < rowBytes; ++i) {
+        cur[i] = static_cast<std::uint8_t>(cur[i] + prev[i]);
+      }
+      break;
+    case FilterAvg:
+      for (std::size_t i = 0; i < bpp; ++i) {
+        cur[i] = static_cast<std::uint8_t>(cur[i] + (prev[i] >> 1));
+      }
+      for (std::size_t i = bpp; i < rowBytes; ++i) {
+        cur[i] = static_cast<std::uint8_t>(cur[i] +
+                                           ((cur[i - bpp] + prev[i]) >> 1));
+      }
+      break;
+    case FilterPaeth:
+      for (std::size_t i = 0; i < bpp; ++i) {
+        cur[i] = static_cast<std::uint8_t>(cur[i] + prev[i]);
+      }
+      for (std::size_t i = bpp; i < rowBytes; ++i) {
+        cur[i] = static_cast<std::uint8_t>(
+            cur[i] + Paeth(cur[i - bpp], prev[i], prev[i - bpp]));
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+#if DXAPP_PNG_USE_SSE2
+inline __m128i Load32(const std::uint8_t* p) {
+  std::int32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return _mm_cvtsi32_si128(v);
+}
+
+inline void Store32(std::uint8_t* p, __m128i v) {
+  const std::int32_t x = _mm_cvtsi128_si32(v);
+  std::memcpy(p, &x, sizeof(x));
+}
+
+/*!
+ * @brief Up: 前の行を足すだけなので16バイトずつ
+ */
+void UnfilterUpSse2(std::uint8_t* cur, const std::uint8_t* prev,
+                    std::size_t rowBytes) {
+  std::size_t i = 0;
+  for (; i + 16 <= rowBytes; i += 16) {
+    const auto a =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur + i));
+    const auto b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(cur + i), _mm_add_epi8(a, b));
+  }
+  for (; i < rowBytes; ++i) {
+    cur[i] = static_cast<std::uint8_t>(cur[i] + prev[i]);
+  }
+}
+
+/*!
+ * @brief Sub: 左のピクセルに依存するので1ピクセル(4バイト)ずつ
+ */
+void UnfilterSub4Sse2(std::uint8_t* cur, std::size_t rowBytes) {
+  auto a = _mm_setzero_si128();
+  for (std::size_t i = 0; i < rowBytes; i += 4) {
+    a = _mm_add_epi8(Load32(cur + i), a);
+    Store32(cur + i, a);
+  }
+}
+
+/*!
+ * @brief Avg: (左 + 上) / 2 を足す
+ */
+void UnfilterAvg4Sse2(std::uint8_t* cur, const std::uint8_t* prev,
+                      std::size_t rowBytes) {
+  const auto one = _mm_set1_epi8(1);
+  auto a = _mm_setzero_si128();
+  for (std::size_t i = 0; i < rowBytes; i += 4) {
+    const auto b = Load32(prev + i);
+    // avg_epu8は切り上げなので、奇数の時の1を引いて切り捨てにする
+    auto avg = _mm_avg_epu8(a, b);
+    avg = _mm_sub_epi8(avg, _mm_and_si128(_mm_xor_si128(a, b), one));
+    a = _mm_add_epi8(Load32(cur + i), avg);
+    Store32(cur + i, a);
+  }
+}
+
+/*!
+ * @brief Paeth: 左・上・左上から一番近いものを16bitで計算して選ぶ
+ */
+void UnfilterPaeth4Sse2(std::uint8_t* cur, const std::uint8_t* prev,
+                        std::size_t rowBytes) {
+  const auto zero = _mm_setzero_si128();
+  auto a = zero;  // 左
+  auto c = zero;  // 左上
+  for (std::size_t i = 0; i < rowBytes; i += 4) {
+    const auto b = _mm_unpacklo_epi8(Load32(prev + i), zero);  // 上
+    const auto x = _mm_unpacklo_epi8(Load32(cur + i), zero);
+
+    // pa = |b - c|, pb = |a - c|, pc = |a + b - 2c|
+    const auto bc = _mm_sub_epi16(b, c);
+    const auto ac = _mm_sub_epi16(a, c);
+    const auto abc = _mm_add_epi16(bc, ac);
+    const auto pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+    const auto pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+    const auto pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));
+
+    const auto smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+    const auto useA = _mm_cmpeq_epi16(smallest, pa);
+    const auto useB = _mm_cmpeq_epi16(smallest, pb);
+    const auto bOrC =
+        _mm_or_si128(_mm_and_si128(useB, b), _mm_andnot_si128(useB, c));
+    const auto pred =
+        _mm_or_si128(_mm_and_si128(useA, a), _mm_andnot_si128(useA, bOrC));
+
+    // 8bitで桁あふれさせる
+    const auto result =
+        _mm_and_si128(_mm_add_epi16(x, pred), _mm_set1_epi16(0xFF));
+    Store32(cur + i, _mm_packus_epi16(result, zero));
+
+    a = result;
+    c = b;
+  }
+}
+#endif
+
+/*!
+ * @brief 1行のフィルタを解除
+ */
+bool UnfilterRow(std::uint8_t filter, std::uint8_t* cur,
+                 const std::uint8_t* prev, std::size_t rowBytes,
+                 std::size_t bpp) {
+  if (filter > FilterPaeth) {
+    return false;
+  }
+#if DXAPP_PNG_USE_SSE2
+  if (filter == FilterUp) {
+    UnfilterUpSse2(cur, prev, rowBytes);
+    return true;
+  }
+  if (bpp == 4) {
+    switch (filter) {
+      case FilterSub:
+        UnfilterSub4Sse2(cur, rowBytes);
+        return true;
+      case FilterAvg:
+        UnfilterAvg4Sse2(cur, prev, rowBytes);
+        return true;
+      case FilterPaeth:
+        UnfilterPaeth4Sse2(cur, prev, rowBytes);
+        return true;
+      default:
+        return true;
+    }
+  }
+#endif
+  UnfilterRowScalar(filter, cur, prev, rowBytes, bpp);
+  return true;
+}
+
+//-------------------------------------------------------------------
+// PNGのチャンク
+//-------------------------------------------------------------------
+enum ColorType : std::uint8_t {
+  ColorGray = 0,
+  ColorRgb = 2,
+  ColorPalette = 3,
+  ColorGrayAlpha = 4,
+  ColorRgba = 6,
+};
+
+/*!
+ * @brief デコードに必要なチャンクの情報
+ */
+struct PngInfo {
+  std::uint32_t width{0};
+  std::uint32_t height{0};
+  std::uint8_t depth{0};
+  std::uint8_t colorType{0};
+  std::uint8_t interlace{0};
+  std::uint8_t palette[256][4]{};  //!< RGBA
+  std::uint32_t paletteSize{0};
+  bool hasColorKey{false};         //!< tRNSのカラーキー(グレー・RGB)
+  std::uint16_t colorKey[3]{};
+
+  std::uint32_t channels() const {
+    switch (colorType) {
+      case ColorRgb:
+        return 3;
+      case ColorGrayAlpha:
+        return 2;
+      case ColorRgba:
+        return 4;
+      default:
+        return 1;
+    }
+  }
+  std::size_t bitsPerPixel() const { return std::size_t(channels()) * depth; }
+  std::size_t bytesPerPixel() const {
+    return std::max<std::size_t>(1, bitsPerPixel() / 8);
+  }
+  std::size_t rowBytes(std::uint32_t w) const {
+    return (std::size_t(w) * bitsPerPixel() + 7) / 8;
+  }
+};
+
+inline std::uint32_t ReadBE32(const std::uint8_t* p) {
+  return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) |
+         (std::uint32_t(p[2]) << 8) | std::uint32_t(p[3]);
+}
+
+inline std::uint16_t ReadBE16(const std::uint8_t* p) {
+  return static_cast<std::uint16_t>((p[0] << 8) | p[1]);
+}
+
+/*!
+ * @brief 1サンプル読む(ビット深度1,2,4,8,16)
+ */
+inline std::uint32_t Sample(const std::uint8_t* row, std::size_t index,
+                            std::uint8_t depth) {
+  switch (depth) {
+    case 8:
+      return row[index];
+    case 16:
+      return ReadBE16(row + index * 2);
+    default: {
+      const auto bit = index * depth;
+      const auto shift = 8 - depth - (bit & 7);
+      return (row[bit >> 3] >> shift) & ((1u << depth) - 1);
+    }
+  }
+}
+
+/*!
+ * @brief フィルタ解除済みの1行をRGBA8に変換
+ */
+void ConvertRow(const PngInfo& info, const std::uint8_t* src,
+                std::uint32_t width, std::uint8_t* dst) {
+  const auto depth = info.depth;
+  const std::uint32_t maxValue = (1u << depth) - 1;
+  // 8bitに合わせる。16bitは上位バイトを使う
+  auto to8 = [depth, maxValue](std::uint32_t v) -> std::uint8_t {
+    if (depth == 16) {
+      return static_cast<std::uint8_t>(v >> 8);
+    }
+    return static_cast<std::uint8_t>(v * 255 / maxValue);
+  };
+
+  switch (info.colorType) {
+    case ColorGray:
+      for (std::uint32_t x = 0; x < width; ++x) {
+        const auto v = Sample(src, x, depth);
+        const auto g = to8(v);
+        dst[x * 4 + 0] = g;
+        dst[x * 4 + 1] = g;
+        dst[x * 4 + 2] = g;
+        dst[x * 4 + 3] =
+            (info.hasColorKey && v == info.colorKey[0]) ? 0 : 255;
+      }
+      break;
+    case ColorRgb:
+      if (depth == 8 && !info.hasColorKey) {
+        pixel::ExpandRGBToRGBA(src, dst, width);
+        break;
+      }
+      for (std::uint32_t x = 0; x < width; ++x) {
+        const auto r = Sample(src, x * 3 + 0, depth);
+        const auto g = Sample(src, x * 3 + 1, depth);
+        const auto b = Sample(src, x * 3 + 2, depth);
+        dst[x * 4 + 0] = to8(r);
+        dst[x * 4 + 1] = to8(g);
+        dst[x * 4 + 2] = to8(b);
+        dst[x * 4 + 3] = (info.hasColorKey && r == info.colorKey[0] &&
+                          g == info.colorKey[1] && b == info.colorKey[2])
+                             ? 0
+                             : 255;
+      }
+      break;
+    case ColorPalette:
+      for (std::uint32_t x = 0; x < width; ++x) {
+        const auto index = Sample(src, x, depth);
+        std::memcpy(dst + x * 4, info.palette[index], 4);
+      }
+      break;
+    case ColorGrayAlpha:
+      for (std::uint32_t x = 0; x < width; ++x) {
+        const auto g = to8(Sample(src, x * 2 + 0, depth));
+        dst[x * 4 + 0] = g;
+        dst[x * 4 + 1] = g;
+        dst[x * 4 + 2] = g;
+        dst[x * 4 + 3] = to8(Sample(src, x * 2 + 1, depth));
+      }
+      break;
+    case ColorRgba:
+      if (depth == 8) {
+        std::memcpy(dst, src, std::size_t(width) * 4);
+        break;
+      }
+      for (std::uint32_t x = 0; x < width * 4; ++x) {
+        dst[x] = to8(Sample(src, x, depth));
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+/*!
+ * @brief 1枚分(インターレースなら1パス分)のフィルタ解除と変換
+ * @param[in,out] raw 展開したデータ。フィルタ解除はその場で行う
+ * @return 消費したバイト数。失敗なら0
+ */
+std::size_t DecodePass(const PngInfo& info, std::uint8_t* raw,
+                       std::uint32_t width, std::uint32_t height,
+                       Image& image, std::uint32_t x0, std::uint32_t y0,
+                       std::uint32_t dx, std::uint32_t dy) {
+  if (width == 0 || height == 0) {
+    return 0;
+  }
+  const auto rowBytes = info.rowBytes(width);
+  const auto bpp = info.bytesPerPixel();
+  const bool isContiguous = (dx == 1 && dy == 1);
+
+  std::vector<std::uint8_t> zeroRow(rowBytes, 0);
+  std::vector<std::uint8_t> rgba(isContiguous ? 0 : std::size_t(width) * 4);
+  const std::uint8_t* prev = zeroRow.data();
+
+  auto p = raw;
+  for (std::uint32_t y = 0; y < height; ++y) {
+    const auto filter = *p++;
+    if (!UnfilterRow(filter, p, prev, rowBytes, bpp)) {
+      return 0;
+    }
+
+    const auto dstY = y0 + y * dy;
+    if (isContiguous) {
+      ConvertRow(info, p, width,
+                 image.pixels.data() + std::size_t(dstY) * image.rowPitch());
+    } else {
+      ConvertRow(info, p, width, rgba.data());
+      auto dstRow = image.pixels.data() + std::size_t(dstY) * image.rowPitch();
+      for (std::uint32_t x = 0; x < width; ++x) {
+        std::memcpy(dstRow + std::size_t(x0 + x * dx) * 4, &rgba[x * 4], 4);
+      }
+    }
+    prev = p;
+    p += rowBytes;
+  }
+  return static_cast<std::size_t>(p - raw);
+}
+
+// Adam7の各パスの開始位置と間隔
+constexpr std::uint32_t Adam7X0[7]{0, 4, 0, 2, 0, 1, 0};
+constexpr std::uint32_t Adam7Y0[7]{0, 0, 4, 0, 2, 0, 1};
+constexpr std::uint32_t Adam7Dx[7]{8, 8, 4, 4, 2, 2, 1};
+constexpr std::uint32_t Adam7Dy[7]{8, 8, 8, 4, 4, 2, 2};
+
+inline std::uint32_t PassSize(std::uint32_t size, std::uint32_t start,
+                              std::uint32_t step) {
+  return size > start ? (size - start + step - 1) / step : 0;
+}
+
+// テクスチャにできる最大サイズ(D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION)
+constexpr std::uint32_t MaxDimension = 16384;
+
+bool ValidateHeader(const PngInfo& info) {
+  if (info.width == 0 || info.height == 0 || info.width > MaxDimension ||
+      info.height > MaxDimension || info.interlace > 1) {
+    return false;
+  }
+  const auto d = info.depth;
+  switch (info.colorType) {
+    case ColorGray:
+      return d == 1 || d == 2 || d == 4 || d == 8 || d == 16;
+    case ColorPalette:
+      return d == 1 || d == 2 || d == 4 || d == 8;
+    case ColorRgb:
+    case ColorGrayAlpha:
+    case ColorRgba:
+      return d == 8 || d == 16;
+    default:
+      return false;
+  }
+}
+}  // namespace
+
+bool DecodeFromMemory(const std::uint8_t* data, std::size_t size, Image& image,
+                      std::string* error) {
+  auto fail = [error](const char* msg) {
+    if (error) {
+      *error = msg;
+    }
+    return false;
+  };
+
+  static constexpr std::uint8_t Signature[8]{0x89, 'P',  'N',  'G',
+                                             '\r', '\n', 0x1A, '\n'};
+  if (size < 8 || std::memcmp(data, Signature, 8) != 0) {
+    return fail("not a PNG file");
+  }
+
+  // チャンクを順番に読む
+  PngInfo info{};
+  std::vector<std::uint8_t> idat{};
+  bool hasHeader = false;
+  std::size_t pos = 8;
+  for (;;) {
+    if (pos + 12 > size) {
+      return fail("truncated chunk");
+    }
+    const auto length = ReadBE32(data + pos);
+    const auto type = data + pos + 4;
+    const auto body = data + pos + 8;
+    if (length > size - pos - 12) {
+      return fail("truncated chunk");
+    }
+
+    if (std::memcmp(type, "IHDR", 4) == 0) {
+      if (length != 13) {
+        return fail("invalid IHDR");
+      }
+      info.width = ReadBE32(body);
+      info.height = ReadBE32(body + 4);
+      info.depth = body[8];
+      info.colorType = body[9];
+      info.interlace = body[12];
+      if (!ValidateHeader(info) || body[10] != 0 || body[11] != 0) {
+        return fail("unsupported PNG format");
+      }
+      hasHeader = true;
+    } else if (std::memcmp(type, "PLTE", 4) == 0) {
+      if (length % 3 != 0 || length / 3 > 256) {
+        return fail("invalid PLTE");
+      }
+      info.paletteSize = length / 3;
+      for (std::uint32_t i = 0; i < info.paletteSize; ++i) {
+        info.palette[i][0] = body[i * 3 + 0];
+        info.palette[i][1] = body[i * 3 + 1];
+        info.palette[i][2] = body[i * 3 + 2];
+        info.palette[i][3] = 255;
+      }
+    } else if (std::memcmp(type, "tRNS", 4) == 0) {
+      if (info.colorType == ColorPalette) {
+        for (std::uint32_t i = 0; i < std::min<std::uint32_t>(length, 256);
+             ++i) {
+          info.palette[i][3] = body[i];
+        }
+      } else if (info.colorType == ColorGray && length >= 2) {
+        info.hasColorKey = true;
+        info.colorKey[0] = ReadBE16(body);
+      } else if (info.colorType == ColorRgb && length >= 6) {
+        info.hasColorKey = true;
+        info.colorKey[0] = ReadBE16(body);
+        info.colorKey[1] = ReadBE16(body + 2);
+        info.colorKey[2] = ReadBE16(body + 4);
+      }
+    } else if (std::memcmp(type, "IDAT", 4) == 0) {
+      idat.insert(std::end(idat), body, body + length);
+    } else if (std::memcmp(type, "IEND", 4) == 0) {
+      break;
+    } else if ((type[0] & 0x20) == 0) {
+      // 大文字で始まるチャンクは読めないとデコードできない
+      return fail("unknown critical chunk");
+    }
+    pos += std::size_t(length) + 12;
+  }
+
+  if (!hasHeader || idat.empty()) {
+    return fail("missing IHDR or IDAT");
+  }
+  if (info.colorType == ColorPalette && info.paletteSize == 0) {
+    return fail("missing PLTE");
+  }
+
+  // 展開後のサイズはヘッダからわかる(各行の先頭にフィルタの1バイト)
+  std::size_t rawSize = 0;
+  if (info.interlace == 0) {
+    rawSize = (info.rowBytes(info.width) + 1) * info.height;
+  } else {
+    for (int i = 0; i < 7; ++i) {
+      const auto w = PassSize(info.width, Adam7X0[i], Adam7Dx[i]);
+      const auto h = PassSize(info.height, Adam7Y0[i], Adam7Dy[i]);
+      if (w != 0 && h != 0) {
+        rawSize += (info.rowBytes(w) + 1) * h;
+      }
+    }
+  }
+
+  std::vector<std::uint8_t> raw(rawSize);
+  if (!Inflate(idat.data(), idat.size(), raw, error)) {
+    return false;
+  }
+
+  image.width = info.width;
+  image.height = info.height;
+  image.pixels.assign(image.rowPitch() * info.height, 0);
+
+  if (info.interlace == 0) {
+    if (!DecodePass(info, raw.data(), info.width, info.height, image, 0, 0, 1,
+                    1)) {
+      return fail("invalid filter type");
+    }
+  } else {
+    auto p = raw.data();
+    for (int i = 0; i < 7; ++i) {
+      const auto w = PassSize(info.width, Adam7X0[i], Adam7Dx[i]);
+      const auto h = PassSize(info.height, Adam7Y0[i], Adam7Dy[i]);
+      if (w == 0 || h == 0) {
+        continue;
+      }
+      const auto used = DecodePass(info, p, w, h, image, Adam7X0[i],
+                                   Adam7Y0[i], Adam7Dx[i], Adam7Dy[i]);
+      if (used == 0) {
+        return fail("invalid filter type");
+      }
+      p += used;
+    }
+  }
+  return true;
+}
+
+bool DecodeFromFile(const std::filesystem::path& path, Image& image,
+                    std::string* error) {
+  std::ifstream infile(path, std::ios::binary);
+  if (!infile) {
+    if (error) {
+      *error = "file not found";
+    }
+    return false;
+  }
+
+  std::vector<std::uint8_t> data;
+  // ファイルサイズに合わせて、動的配列のサイズをなおす
+  data.resize(static_cast<std::size_t>(infile.seekg(0, infile.end).tellg()));
+  infile.seekg(0, infile.beg)
+      .read(reinterpret_cast<char*>(data.data()), data.size());
+
+  return DecodeFromMemory(data.data(), data.size(), image, error);
+}
+
+bool ReadSize(const std::filesystem::path& path, std::uint32_t& width,
+              std::uint32_t& height) {
+  // シグネチャ8バイトの後は必ずIHDR(長さ4 + 種類4 + 幅4 + 高さ4)
+  std::uint8_t header[24]{};
+  std::ifstream infile(path, std::ios::binary);
+  if (!infile.read(reinterpret_cast<char*>(header), sizeof(header))) {
+    return false;
+  }
+  static constexpr std::uint8_t Signature[8]{0x89, 'P',  'N',  'G',
+                                             '\r', '\n', 0x1A, '\n'};
+  if (std::memcmp(header, Signature, 8) != 0 ||
+      std::memcmp(header + 12, "IHDR", 4) != 0) {
+    return false;
+  }
+  width = ReadBE32(header + 16);
+  height = ReadBE32(header + 20);
+  return width != 0 && height != 0;
+}
+
+std::vector<bool> DecodeFiles(const std::vector<std::filesystem::path>& paths,
+                              std::vector<Image>& images,
+                              unsigned int threadCount) {
+  images.clear();
+  images.resize(paths.size());
+
+  // vector<bool>は要素ごとに別スレッドから書けないのでcharで受ける
+  std::vector<char> succeeded(paths.size(), 0);
+
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threadCount =
+      std::min<unsigned int>(threadCount, static_cast<unsigned int>(paths.size()));
+
+  std::atomic<std::size_t> next{0};
+  auto worker = [&]() {
+    for (;;) {
+      const auto i = next.fetch_add(1);
+      if (i >= paths.size()) {
+        return;
+      }
+      succeeded[i] = DecodeFromFile(paths[i], images[i]) ? 1 : 0;
+    }
+  };
+
+  if (threadCount <= 1) {
+    worker();
+  } else {
+    std::vector<std::thread> threads{};
+    for (unsigned int i = 0; i < threadCount; ++i) {
+      threads.emplace_back(worker);
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+
+  return std::vector<bool>(std::begin(succeeded), std::end(succeeded));
+}
+
+}  // namespace png
+}  // namespace dxapp
@@ -0,0 +1,73 @@
+﻿#pragma once
+// WICに頼らないPNGデコーダ
+// Windows以外(ツールやLinuxのビルドマシン)でも動くように標準ライブラリだけで書いている
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace dxapp {
+namespace png {
+
+/*!
+ * @brief デコード結果の画像
+ * @details ピクセルは常にRGBA各8bit。そのままR8G8B8A8テクスチャにできる
+ */
+struct Image {
+  std::uint32_t width{0};              //!< 幅
+  std::uint32_t height{0};             //!< 高さ
+  std::vector<std::uint8_t> pixels{};  //!< RGBA8のピクセル(width * 4 * height)
+
+  /*!
+   * @brief 1行のバイト数
+   */
+  std::size_t rowPitch() const { return std::size_t(width) * 4; }
+};
+
+/*!
+ * @brief メモリ上のPNGをデコード
+ * @param[in] data PNGファイルのバイト列
+ * @param[in] size バイト数
+ * @param[out] image デコードした画像
+ * @param[out] error 失敗したときの理由(不要ならnullptr)
+ * @return 成否
+ */
+bool DecodeFromMemory(const std::uint8_t* data, std::size_t size, Image& image,
+                      std::string* error = nullptr);
+
+/*!
+ * @brief PNGファイルをデコード
+ * @param[in] path ファイルパス
+ * @param[out] image デコードした画像
+ * @param[out] error 失敗したときの理由(不要ならnullptr)
+ * @return 成否
+ */
+bool DecodeFromFile(const std::filesystem::path& path, Image& image,
+                    std::string* error = nullptr);
+
+/*!
+ * @brief PNGファイルのヘッダだけ読んで大きさを取得
+ * @details 先頭のIHDRしか読まないのでデコードよりずっと軽い
+ * @param[in] path ファイルパス
+ * @param[out] width 幅
+ * @param[out] height 高さ
+ * @return 成否
+ */
+bool ReadSize(const std::filesystem::path& path, std::uint32_t& width,
+              std::uint32_t& height);
+
+/*!
+ * @brief 複数のPNGファイルを並列でデコード
+ * @details 画像同士は独立しているのでファイル単位でスレッドに振り分ける
+ * @param[in] paths ファイルパスの配列
+ * @param[out] images pathsと同じ並びでデコード結果を返す
+ * @param[in] threadCount 使うスレッド数。0ならハードウェアに合わせる
+ * @return ファイルごとの成否
+ */
+std::vector<bool> DecodeFiles(const std::vector<std::filesystem::path>& paths,
+                              std::vector<Image>& images,
+                              unsigned int threadCount = 0);
+
+}  // namespace png
+}  // namespace dxapp
@@ -0,0 +1,374 @@
+﻿#include "RenderGraph.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+std::uint64_t AlignUp(std::uint64_t value, std::uint64_t alignment) {
+  return alignment ? (value + alignment - 1) / alignment * alignment : value;
+}
+}  // namespace
+
+namespace dxapp {
+
+void RenderGraph::Reset() {
+  resources_.clear();
+  passes_.clear();
+  accesses_.clear();
+  order_.clear();
+  barriers_.clear();
+  batchBegin_.clear();
+  stats_ = {};
+}
+
+std::uint32_t RenderGraph::ImportTexture(const std::string& name,
+                                         const RenderGraphTextureDesc& desc,
+                                         ResourceState initialState,
+                                         ResourceState finalState) {
+  Resource resource{};
+  resource.name = name;
+  resource.desc = desc;
+  resource.imported = true;
+  resource.initialState = initialState;
+  resource.finalState = finalState;
+  resources_.push_back(resource);
+  return static_cast<std::uint32_t>(resources_.size() - 1);
+}
+
+std::uint32_t RenderGraph::CreateTexture(const std::string& name,
+                                         const RenderGraphTextureDesc& desc) {
+  Resource resource{};
+  resource.name = name;
+  resource.desc = desc;
+  resource.imported = false;
+  resources_.push_back(resource);
+  return static_cast<std::uint32_t>(resources_.size() - 1);
+}
+
+std::uint32_t RenderGraph::AddPass(const std::string& name, Execute execute) {
+  passes_.push_back({name, std::move(execute), false, false});
+  return static_cast<std::uint32_t>(passes_.size() - 1);
+}
+
+void RenderGraph::Read(std::uint32_t pass, std::uint32_t resource,
+                       ResourceState state) {
+  assert(IsReadOnlyState(state));
+  accesses_.push_back({pass, resource, state, false});
+}
+
+void RenderGraph::Write(std::uint32_t pass, std::uint32_t resource,
+                        ResourceState state) {
+  accesses_.push_back({pass, resource, state, true});
+}
+
+void RenderGraph::SetSideEffect(std::uint32_t pass) {
+  passes_[pass].sideEffect = true;
+}
+
+void RenderGraph::Compile(const MemoryQuery& memoryQuery) {
+  stats_ = {};
+  stats_.passes = passCount();
+  CullPasses();
+  ComputeLifetimes();
+  pending_.clear();
+  PlaceTransients(memoryQuery);
+  BuildBarriers();
+}
+
+void RenderGraph::CullPasses() {
+  // パスの順に並べておく。同じパスの中は足した順
+  std::stable_sort(
+      accesses_.begin(), accesses_.end(),
+      [](const Access& a, const Access& b) { return a.pass < b.pass; });
+
+  // 後ろから見て、必要なリソースに書くパスだけ残す
+  // 残したパスが読むリソースは、その前に書くパスも必要になる
+  // 持ち込んだリソースはフレームの後も使われるので最初から必要
+  needed_.assign(resources_.size(), 0);
+  for (std::uint32_t i = 0; i < resources_.size(); ++i) {
+    needed_[i] = resources_[i].imported ? 1 : 0;
+  }
+  auto end = accesses_.size();
+  for (auto pass = passCount(); pass-- > 0;) {
+    auto begin = end;
+    while (begin > 0 && accesses_[begin - 1].pass == pass) {
+      --begin;
+    }
+    auto& p = passes_[pass];
+    p.alive = p.sideEffect;
+    for (auto i = begin; i < end && !p.alive; ++i) {
+      p.alive = accesses_[i].write && needed_[accesses_[i].resource];
+    }
+    if (p.alive) {
+      // 書くのは前の内容も使うものとして扱うので、書いたリソースも必要なまま
+      for (auto i = begin; i < end; ++i) {
+        needed_[accesses_[i].resource] = 1;
+      }
+    }
+    end = begin;
+  }
+
+  order_.clear();
+  passOrder_.assign(passes_.size(), InvalidHandle);
+  for (std::uint32_t pass = 0; pass < passCount(); ++pass) {
+    if (passes_[pass].alive) {
+      passOrder_[pass] = static_cast<std::uint32_t>(order_.size());
+      order_.push_back(pass);
+    }
+  }
+  stats_.culledPasses = passCount() - static_cast<std::uint32_t>(order_.size());
+}
+
+void RenderGraph::ComputeLifetimes() {
+  // 実行するパスのアクセスだけを、リソース・実行順に並べる
+  sorted_.clear();
+  for (const auto& access : accesses_) {
+    const auto order = passOrder_[access.pass];
+    if (order != InvalidHandle) {
+      sorted_.push_back({order, access.resource, access.state, access.write});
+    }
+  }
+  std::stable_sort(sorted_.begin(), sorted_.end(),
+                   [](const Access& a, const Access& b) {
+                     return a.resource != b.resource ? a.resource < b.resource
+                                                     : a.pass < b.pass;
+                   });
+
+  // 同じパスの同じリソースは1つにまとめる
+  std::size_t count = 0;
+  for (const auto& access : sorted_) {
+    if (count > 0 && sorted_[count - 1].resource == access.resource &&
+        sorted_[count - 1].pass == access.pass) {
+      auto& merged = sorted_[count - 1];
+      merged.state = merged.state | access.state;
+      merged.write = merged.write || access.write;
+    } else {
+      sorted_[count++] = access;
+    }
+  }
+  sorted_.resize(count);
+
+  for (auto& resource : resources_) {
+    resource.usage = ResourceState::Common;
+    resource.firstState = resource.initialState;
+    resource.firstPass = InvalidHandle;
+    resource.lastPass = InvalidHandle;
+    resource.offset = InvalidOffset;
+    resource.size = 0;
+  }
+  for (const auto& access : sorted_) {
+    auto& resource = resources_[access.resource];
+    resource.usage = resource.usage | access.state;
+    if (resource.firstPass == InvalidHandle) {
+      resource.firstPass = access.pass;
+    }
+    resource.lastPass = access.pass;
+  }
+}
+
+void RenderGraph::PlaceTransients(const MemoryQuery& memoryQuery) {
+  // 使い始めが早い順に、使い終わった塊があればそこに置く
+  // 合う塊が複数あれば一番小さいものにして、大きな塊を残す
+  std::vector<std::uint32_t> transients;
+  for (std::uint32_t i = 0; i < resources_.size(); ++i) {
+    if (!resources_[i].imported && resources_[i].firstPass != InvalidHandle) {
+      transients.push_back(i);
+    }
+  }
+  std::stable_sort(transients.begin(), transients.end(),
+                   [this](std::uint32_t a, std::uint32_t b) {
+                     return resources_[a].firstPass < resources_[b].firstPass;
+                   });
+
+  blocks_.clear();
+  std::uint64_t heapEnd = 0;
+  for (const auto index : transients) {
+    auto& resource = resources_[index];
+    const auto memory = memoryQuery(resource.desc, resource.usage);
+    const auto size = AlignUp(memory.size, memory.alignment);
+    resource.size = size;
+    stats_.transientBytes += size;
+
+    auto best = blocks_.size();
+    for (std::size_t i = 0; i < blocks_.size(); ++i) {
+      const auto& block = blocks_[i];
+      if (block.lastPass < resource.firstPass && block.size >= size &&
+          AlignUp(block.offset, memory.alignment) == block.offset &&
+          (best == blocks_.size() || block.size < blocks_[best].size)) {
+        best = i;
+      }
+    }
+
+    if (best == blocks_.size()) {
+      resource.offset = AlignUp(heapEnd, memory.alignment);
+      heapEnd = resource.offset + size;
+      blocks_.push_back({resource.offset, size, resource.lastPass, index});
+      continue;
+    }
+
+    // 余った後ろの部分は前のリソースのまま空きとして残す
+    const auto block = blocks_[best];
+    if (block.size > size) {
+      blocks_.push_back({block.offset + size, block.size - size,
+                         block.lastPass, block.resource});
+    }
+    blocks_[best] = {block.offset, size, resource.lastPass, index};
+    resource.offset = block.offset;
+    ++stats_.aliasedTextures;
+
+    RenderGraphBarrier barrier{};
+    barrier.type = RenderGraphBarrier::Type::Aliasing;
+    barrier.resource = index;
+    barrier.aliasBefore = block.resource;
+    AddBarrier(resource.firstPass, barrier);
+  }
+  stats_.heapBytes = heapEnd;
+}
+
+void RenderGraph::BuildBarriers() {
+  const auto orderCount = static_cast<std::uint32_t>(order_.size());
+
+  // lastの後からpassの前までの間に状態を変える
+  // 間に別のパスがあれば分けて、変えている間もGPUが間のパスを進められるようにする
+  auto transition = [this](std::uint32_t resource, ResourceState before,
+                           ResourceState after, std::uint32_t last,
+                           std::uint32_t pass) {
+    RenderGraphBarrier barrier{};
+    barrier.resource = resource;
+    barrier.before = before;
+    barrier.after = after;
+    const auto begin = last == InvalidHandle ? 0 : last + 1;
+    if (pass > begin) {
+      barrier.split = RenderGraphBarrier::Split::Begin;
+      AddBarrier(begin, barrier);
+      barrier.split = RenderGraphBarrier::Split::End;
+      ++stats_.splitBarriers;
+    }
+    AddBarrier(pass, barrier);
+  };
+
+  std::size_t i = 0;
+  while (i < sorted_.size()) {
+    const auto index = sorted_[i].resource;
+    auto& resource = resources_[index];
+    auto state = resource.initialState;
+    auto last = InvalidHandle;
+    auto lastWrite = false;
+    auto first = true;
+
+    while (i < sorted_.size() && sorted_[i].resource == index) {
+      const auto& access = sorted_[i];
+      auto required = access.state;
+      auto groupLast = access.pass;
+      ++i;
+      // 読むだけが続くなら、全部の状態をまとめて1回で変える
+      if (!access.write && IsReadOnlyState(required)) {
+        while (i < sorted_.size() && sorted_[i].resource == index &&
+               !sorted_[i].write && IsReadOnlyState(sorted_[i].state)) {
+          required = required | sorted_[i].state;
+          groupLast = sorted_[i].pass;
+          ++i;
+        }
+      }
+
+      if (first && !resource.imported) {
+        // 一時的なテクスチャは最初に使う状態で作っておくので変えない
+        resource.firstState = required;
+      } else if (required != state) {
+        transition(index, state, required, last, access.pass);
+      } else if ((state & ResourceState::UnorderedAccess) ==
+                     ResourceState::UnorderedAccess &&
+                 (lastWrite || access.write)) {
+        RenderGraphBarrier barrier{};
+        barrier.type = RenderGraphBarrier::Type::Uav;
+        barrier.resource = index;
+        AddBarrier(access.pass, barrier);
+      }
+      state = required;
+      last = groupLast;
+      lastWrite = access.write;
+      first = false;
+    }
+
+    // 持ち込んだものは終わりの状態に、一時的なものは作ったときの状態に戻す
+    // 一時的なものは後で同じメモリに置くものがあるので、使い終わってすぐ戻す
+    if (resource.imported) {
+      if (state != resource.finalState) {
+        transition(index, state, resource.finalState, last, orderCount);
+      }
+    } else if (state != resource.firstState) {
+      RenderGraphBarrier barrier{};
+      barrier.resource = index;
+      barrier.before = state;
+      barrier.after = resource.firstState;
+      AddBarrier(last + 1, barrier);
+    }
+  }
+
+  // 使わなかった持ち込みのリソースも終わりの状態にする
+  for (std::uint32_t index = 0; index < resources_.size(); ++index) {
+    const auto& resource = resources_[index];
+    if (resource.imported && resource.firstPass == InvalidHandle &&
+        resource.initialState != resource.finalState) {
+      transition(index, resource.initialState, resource.finalState,
+                 InvalidHandle, orderCount);
+    }
+  }
+
+  // 積む場所ごとに並べる。同じ場所では、使い終わったものを戻してから
+  // 同じメモリを使い始めるように、エイリアスのバリアを後にする
+  auto key = [](const PendingBarrier& pending) {
+    return pending.batch * 2 +
+           (pending.barrier.type == RenderGraphBarrier::Type::Aliasing ? 1
+                                                                       : 0);
+  };
+  batchBegin_.assign(std::size_t(orderCount) * 2 + 3, 0);
+  for (const auto& pending : pending_) {
+    ++batchBegin_[key(pending) + 1];
+  }
+  for (std::size_t k = 1; k < batchBegin_.size(); ++k) {
+    batchBegin_[k] += batchBegin_[k - 1];
+  }
+  barriers_.resize(pending_.size());
+  {
+    auto cursor = batchBegin_;
+    for (const auto& pending : pending_) {
+      barriers_[cursor[key(pending)]++] = pending.barrier;
+    }
+  }
+  // 以後は実行順ごとの先頭にする
+  for (std::uint32_t batch = 0; batch <= orderCount + 1; ++batch) {
+    batchBegin_[batch] = batchBegin_[std::size_t(batch) * 2];
+  }
+  batchBegin_.resize(std::size_t(orderCount) + 2);
+
+  stats_.barriers = static_cast<std::uint32_t>(barriers_.size());
+  for (std::uint32_t batch = 0; batch <= orderCount; ++batch) {
+    if (batchBegin_[batch + 1] > batchBegin_[batch]) {
+      ++stats_.barrierBatches;
+    }
+  }
+}
+
+void RenderGraph::Run(const BarrierCallback& barrierCallback) const {
+  for (std::uint32_t i = 0; i < order_.size(); ++i) {
+    const auto count = batchBegin_[i + 1] - batchBegin_[i];
+    if (count > 0) {
+      barrierCallback(barriers_.data() + batchBegin_[i], count);
+    }
+    const auto& pass = passes_[order_[i]];
+    if (pass.execute) {
+      pass.execute();
+    }
+  }
+}
+
+const RenderGraphBarrier* RenderGraph::finalBarriers() const {
+  return barriers_.data() + batchBegin_[order_.size()];
+}
+
+std::uint32_t RenderGraph::finalBarrierCount() const {
+  return batchBegin_[order_.size() + 1] - batchBegin_[order_.size()];
+}
+
+}  // namespace dxapp
@@ -0,0 +1,325 @@
+﻿#pragma once
+// フレームをパスの並びで表し、パスが読み書きするリソースから
+// 要らないパスを外し、バリアをまとめ、一時的なテクスチャのメモリを使いまわす
+// D3D12には触らないので、Linuxでも動かして確かめられる
+// D3D12で動かすのはRenderGraphResourcesがする
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace dxapp {
+
+/*!
+ * @brief リソースの状態。読むだけの状態はORで同時に持てる
+ */
+enum class ResourceState : std::uint32_t {
+  Common = 0,
+  RenderTarget = 1 << 0,
+  DepthWrite = 1 << 1,
+  DepthRead = 1 << 2,
+  ShaderResource = 1 << 3,
+  UnorderedAccess = 1 << 4,
+  CopySource = 1 << 5,
+  CopyDest = 1 << 6,
+  Present = 1 << 7,
+};
+
+constexpr ResourceState operator|(ResourceState a, ResourceState b) {
+  return static_cast<ResourceState>(static_cast<std::uint32_t>(a) |
+                                    static_cast<std::uint32_t>(b));
+}
+
+constexpr ResourceState operator&(ResourceState a, ResourceState b) {
+  return static_cast<ResourceState>(static_cast<std::uint32_t>(a) &
+                                    static_cast<std::uint32_t>(b));
+}
+
+/*!
+ * @brief 読むだけの状態か。Commonは含めない
+ */
+constexpr bool IsReadOnlyState(ResourceState state) {
+  constexpr auto read = ResourceState::DepthRead |
+                        ResourceState::ShaderResource |
+                        ResourceState::CopySource | ResourceState::Present;
+  return state != ResourceState::Common && (state & read) == state;
+}
+
+/*!
+ * @brief グラフで使うテクスチャの設定
+ */
+struct RenderGraphTextureDesc {
+  std::uint32_t width{0};
+  std::uint32_t height{0};
+  std::uint32_t format{0};  //!< バックエンドの形式の値(D3D12ならDXGI_FORMAT)
+  std::uint32_t mipLevels{1};
+};
+
+/*!
+ * @brief 一時的なテクスチャが必要なメモリ
+ */
+struct RenderGraphMemory {
+  std::uint64_t size{0};
+  std::uint64_t alignment{0};
+};
+
+/*!
+ * @brief コンパイルで作ったバリア
+ */
+struct RenderGraphBarrier {
+  enum class Type : std::uint8_t {
+    Transition,  //!< 状態を変える
+    Aliasing,    //!< 同じメモリを別のリソースで使い始める
+    Uav,         //!< UAVの書き込みを次の読み書きの前に終わらせる
+  };
+  //! 分けたバリアはBeginで始めてEndで待つ。間のパスとGPUが重なれる
+  enum class Split : std::uint8_t { None, Begin, End };
+
+  Type type{Type::Transition};
+  Split split{Split::None};
+  std::uint32_t resource{0};  //!< Aliasingでは使い始めるリソース
+  std::uint32_t aliasBefore{0};  //!< Aliasingでそれまで使っていたリソース
+  ResourceState before{ResourceState::Common};
+  ResourceState after{ResourceState::Common};
+};
+
+/*!
+ * @brief コンパイルの結果の数
+ */
+struct RenderGraphStats {
+  std::uint32_t passes{0};         //!< 足したパス
+  std::uint32_t culledPasses{0};   //!< 結果が使われないので外したパス
+  std::uint32_t barriers{0};       //!< バリアの数
+  std::uint32_t barrierBatches{0};  //!< ResourceBarrierを呼ぶ回数
+  std::uint32_t splitBarriers{0};  //!< 分けたバリアの組の数
+  std::uint32_t aliasedTextures{0};  //!< ほかのテクスチャのメモリを使いまわしたもの
+  std::uint64_t transientBytes{0};  //!< 一時的なテクスチャを別々に置いたときの大きさ
+  std::uint64_t heapBytes{0};       //!< 使いまわした後のヒープの大きさ
+};
+
+/*!
+ * @brief レンダーグラフ
+ * @details 毎フレームResetしてからリソースとパスを足し、Compileしてから
+ *          Executeする。パスは足した順に実行し、並べ替えはしない。
+ *          外から持ち込んだ(Import)リソースと、副作用があるとしたパスの
+ *          結果につながらないパスは実行しない。
+ *          一時的なテクスチャ(Create)は使う間だけメモリを持ち、
+ *          使う間が重ならないもの同士は同じメモリに置く。
+ *          一時的なテクスチャは最初に使うパスで全部書きなおすこと
+ */
+class RenderGraph {
+ public:
+  //! 何もないことを表す番号
+  static constexpr std::uint32_t InvalidHandle = 0xffffffffu;
+  //! ヒープに置かない一時的なテクスチャのオフセット
+  static constexpr std::uint64_t InvalidOffset = ~0ull;
+
+  //! パスの中身。バリアはその前に積まれている
+  using Execute = std::function<void()>;
+  //! テクスチャに必要なメモリを返す。usageは使うすべての状態のOR
+  using MemoryQuery = std::function<RenderGraphMemory(
+      const RenderGraphTextureDesc& desc, ResourceState usage)>;
+  //! まとめたバリアを受け取る
+  using BarrierCallback =
+      std::function<void(const RenderGraphBarrier* barriers,
+                         std::uint32_t count)>;
+
+  RenderGraph(const RenderGraph&) = delete;
+  RenderGraph& operator=(const RenderGraph&) = delete;
+
+  /*!
+   * @brief デフォルトコンストラクタ
+   */
+  RenderGraph() = default;
+
+  /*!
+   * @brief 足したものを全部消す。作業用の領域は残す
+   */
+  void Reset();
+
+  /*!
+   * @brief 外で作ったリソースを持ち込む
+   * @param[in] initialState フレームの始めの状態
+   * @param[in] finalState フレームの終わりに戻す状態
+   * @return リソースの番号
+   */
+  std::uint32_t ImportTexture(const std::string& name,
+                              const RenderGraphTextureDesc& desc,
+                              ResourceState initialState,
+                              ResourceState finalState);
+
+  /*!
+   * @brief このフレームだけ使うテクスチャを作る
+   * @details 状態は最初に使うパスの状態から始まり、使い終わったらそこに戻す
+   * @return リソースの番号
+   */
+  std::uint32_t CreateTexture(const std::string& name,
+                              const RenderGraphTextureDesc& desc);
+
+  /*!
+   * @brief パスを足す
+   * @return パスの番号
+   */
+  std::uint32_t AddPass(const std::string& name, Execute execute);
+
+  /*!
+   * @brief パスがリソースを読む
+   * @param[in] state 読むときの状態。読むだけの状態にする
+   */
+  void Read(std::uint32_t pass, std::uint32_t resource, ResourceState state);
+
+  /*!
+   * @brief パスがリソースに書く
+   * @details 書く前の内容も使うものとして扱う
+   */
+  void Write(std::uint32_t pass, std::uint32_t resource, ResourceState state);
+
+  /*!
+   * @brief 結果を誰も読まなくても実行するパスにする
+   */
+  void SetSideEffect(std::uint32_t pass);
+
+  /*!
+   * @brief 実行するパス・バリア・メモリの置き場所を決める
+   */
+  void Compile(const MemoryQuery& memoryQuery);
+
+  /*!
+   * @brief 実行するパスを順に呼ぶ。各パスの前にまとめたバリアを渡す
+   * @details 最後のパスの後のバリアはfinalBarriersで受け取って積む
+   */
+  void Run(const BarrierCallback& barrierCallback) const;
+
+  /*!
+   * @brief 最後のパスの後に積むバリア
+   * @details 持ち込んだリソースを終わりの状態にする。
+   *          最後のパスが別のコマンドリストに積むこともあるので分けて返す
+   */
+  const RenderGraphBarrier* finalBarriers() const;
+  std::uint32_t finalBarrierCount() const;
+
+  /*!
+   * @brief パスを実行するか。Compileの後に使う
+   */
+  bool IsPassAlive(std::uint32_t pass) const { return passes_[pass].alive; }
+
+  /*!
+   * @brief 一時的なテクスチャのヒープの中の位置。使わないものはInvalidOffset
+   */
+  std::uint64_t heapOffset(std::uint32_t resource) const {
+    return resources_[resource].offset;
+  }
+
+  /*!
+   * @brief 一時的なテクスチャをヒープに置いたときの大きさ
+   */
+  std::uint64_t heapSize() const { return stats_.heapBytes; }
+
+  /*!
+   * @brief 最初に使うときの状態。一時的なテクスチャはこの状態で作っておく
+   */
+  ResourceState firstState(std::uint32_t resource) const {
+    return resources_[resource].firstState;
+  }
+
+  /*!
+   * @brief 使うすべての状態のOR
+   */
+  ResourceState usage(std::uint32_t resource) const {
+    return resources_[resource].usage;
+  }
+
+  bool IsImported(std::uint32_t resource) const {
+    return resources_[resource].imported;
+  }
+  const RenderGraphTextureDesc& desc(std::uint32_t resource) const {
+    return resources_[resource].desc;
+  }
+  const std::string& resourceName(std::uint32_t resource) const {
+    return resources_[resource].name;
+  }
+  const std::string& passName(std::uint32_t pass) const {
+    return passes_[pass].name;
+  }
+  std::uint32_t resourceCount() const {
+    return static_cast<std::uint32_t>(resources_.size());
+  }
+  std::uint32_t passCount() const {
+    return static_cast<std::uint32_t>(passes_.size());
+  }
+  const RenderGraphStats& stats() const { return stats_; }
+
+ private:
+  struct Resource {
+    std::string name;
+    RenderGraphTextureDesc desc;
+    bool imported;
+    ResourceState initialState;  //!< 持ち込んだリソースの始めの状態
+    ResourceState finalState;    //!< 持ち込んだリソースの終わりの状態
+    // 以下はCompileで決める
+    ResourceState usage;
+    ResourceState firstState;
+    std::uint32_t firstPass;  //!< 使う最初と最後の実行順
+    std::uint32_t lastPass;
+    std::uint64_t offset;
+    std::uint64_t size;
+  };
+
+  struct Access {
+    std::uint32_t pass;
+    std::uint32_t resource;
+    ResourceState state;
+    bool write;
+  };
+
+  struct Pass {
+    std::string name;
+    Execute execute;
+    bool sideEffect;
+    bool alive;
+  };
+
+  /*!
+   * @brief ヒープの中の塊。lastPassまで使われている
+   */
+  struct MemoryBlock {
+    std::uint64_t offset;
+    std::uint64_t size;
+    std::uint32_t lastPass;
+    std::uint32_t resource;  //!< 最後に置いたリソース
+  };
+
+  /*!
+   * @brief バリアとそれを積む場所
+   */
+  struct PendingBarrier {
+    std::uint32_t batch;  //!< この実行順のパスの前。実行するパスの数なら最後
+    RenderGraphBarrier barrier;
+  };
+
+  void CullPasses();
+  void ComputeLifetimes();
+  void PlaceTransients(const MemoryQuery& memoryQuery);
+  void BuildBarriers();
+
+  void AddBarrier(std::uint32_t batch, const RenderGraphBarrier& barrier) {
+    pending_.push_back({batch, barrier});
+  }
+
+  std::vector<Resource> resources_{};
+  std::vector<Pass> passes_{};
+  std::vector<Access> accesses_{};
+
+  // Compileの結果と作業用。Resetしても領域は残す
+  std::vector<std::uint32_t> order_{};  //!< 実行するパスの番号を実行順に
+  std::vector<std::uint32_t> passOrder_{};  //!< パスの番号から実行順
+  std::vector<Access> sorted_{};  //!< リソース・実行順に並べたアクセス
+  std::vector<std::uint8_t> needed_{};
+  std::vector<MemoryBlock> blocks_{};
+  std::vector<PendingBarrier> pending_{};
+  std::vector<RenderGraphBarrier> barriers_{};  //!< 積む順に並べたバリア
+  std::vector<std::uint32_t> batchBegin_{};  //!< 実行順ごとのbarriers_の先頭
+  RenderGraphStats stats_{};
+};
+
+}  // namespace dxapp
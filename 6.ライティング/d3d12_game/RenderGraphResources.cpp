@@ -0,0 +1,213 @@
+﻿#include "RenderGraphResources.hpp"
+
+#include "Device.hpp"
+
+namespace {
+bool IsSame(const dxapp::RenderGraphTextureDesc& a,
+            const dxapp::RenderGraphTextureDesc& b) {
+  return a.width == b.width && a.height == b.height && a.format == b.format &&
+         a.mipLevels == b.mipLevels;
+}
+
+bool Has(dxapp::ResourceState state, dxapp::ResourceState flag) {
+  return (state & flag) == flag;
+}
+}  // namespace
+
+namespace dxapp {
+
+void RenderGraphResources::Initialize(Device* device) { device_ = device; }
+
+D3D12_RESOURCE_DESC RenderGraphResources::MakeDesc(
+    const RenderGraphTextureDesc& desc, ResourceState usage) const {
+  // ヒープはレンダーターゲットかデプスのテクスチャだけを置く設定で作るので、
+  // UAVだけで使うものもレンダーターゲットにできるようにしておく
+  auto flags = D3D12_RESOURCE_FLAG_NONE;
+  if (Has(usage, ResourceState::DepthWrite) ||
+      Has(usage, ResourceState::DepthRead)) {
+    flags |= D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+  } else {
+    flags |= D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+  }
+  if (Has(usage, ResourceState::UnorderedAccess)) {
+    flags |= D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+  }
+  return CD3DX12_RESOURCE_DESC::Tex2D(static_cast<DXGI_FORMAT>(desc.format),
+                                      desc.width, desc.height, 1,
+                                      static_cast<UINT16>(desc.mipLevels), 1, 0,
+                                      flags);
+}
+
+RenderGraphMemory RenderGraphResources::QueryMemory(
+    const RenderGraphTextureDesc& desc, ResourceState usage) const {
+  const auto d3dDesc = MakeDesc(desc, usage);
+  const auto info = device_->device()->GetResourceAllocationInfo(0, 1, &d3dDesc);
+  return {info.SizeInBytes, info.Alignment};
+}
+
+void RenderGraphResources::Import(std::uint32_t resource,
+                                  ID3D12Resource* d3dResource) {
+  if (resources_.size() <= resource) {
+    resources_.resize(std::size_t(resource) + 1, nullptr);
+  }
+  resources_[resource] = d3dResource;
+}
+
+void RenderGraphResources::Prepare(const RenderGraph& graph) {
+  auto dev = device_->device();
+
+  // GPUが使い終わったヒープとテクスチャを捨てる
+  const auto completed = device_->completedFenceValue();
+  retired_.erase(std::remove_if(retired_.begin(), retired_.end(),
+                                [completed](const Retired& retired) {
+                                  return retired.fenceValue <= completed;
+                                }),
+                 retired_.end());
+
+  // 足りなければヒープを作りなおす。前のものは今のフレームが終わるまで残す
+  if (graph.heapSize() > heapSize_) {
+    if (heap_) {
+      retired_.push_back({device_->currentFenceValue(), std::move(heap_),
+                          std::move(transients_)});
+      transients_.clear();
+    }
+    auto desc = CD3DX12_HEAP_DESC(graph.heapSize(), D3D12_HEAP_TYPE_DEFAULT, 0,
+                                  D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES);
+    auto hr = dev->CreateHeap(&desc, IID_PPV_ARGS(heap_.ReleaseAndGetAddressOf()));
+    if (FAILED(hr)) {
+      throw std::runtime_error("RenderGraphResources::CreateHeap Failed");
+    }
+    heap_->SetName(L"RenderGraphResources::TransientHeap");
+    heapSize_ = graph.heapSize();
+  }
+
+  // 同じ場所に同じ設定で作ったものがあれば使いまわす
+  // 一時的なテクスチャは最初に使う状態で作り、グラフがフレームの終わりに戻す
+  resources_.resize(graph.resourceCount(), nullptr);
+  std::vector<Transient> used;
+  for (std::uint32_t i = 0; i < graph.resourceCount(); ++i) {
+    if (graph.IsImported(i)) {
+      continue;
+    }
+    resources_[i] = nullptr;
+    const auto offset = graph.heapOffset(i);
+    if (offset == RenderGraph::InvalidOffset) {
+      continue;  // 実行するパスで使わない
+    }
+    const auto& desc = graph.desc(i);
+    const auto usage = graph.usage(i);
+    const auto firstState = graph.firstState(i);
+    auto found = std::find_if(
+        transients_.begin(), transients_.end(), [&](const Transient& t) {
+          return t.resource && t.offset == offset && t.usage == usage &&
+                 t.firstState == firstState && IsSame(t.desc, desc);
+        });
+    if (found != transients_.end()) {
+      used.push_back(std::move(*found));
+    } else {
+      Transient transient{desc, usage, firstState, offset, nullptr};
+      const auto d3dDesc = MakeDesc(desc, usage);
+      auto hr = dev->CreatePlacedResource(
+          heap_.Get(), offset, &d3dDesc, ToD3D12(firstState), nullptr,
+          IID_PPV_ARGS(transient.resource.ReleaseAndGetAddressOf()));
+      if (FAILED(hr)) {
+        throw std::runtime_error(
+            "RenderGraphResources::CreatePlacedResource Failed");
+      }
+      transient.resource->SetName(
+          std::wstring(graph.resourceName(i).begin(),
+                       graph.resourceName(i).end())
+              .c_str());
+      used.push_back(std::move(transient));
+    }
+    resources_[i] = used.back().resource.Get();
+  }
+
+  // このフレームで使わなかったものは、前のフレームが終わってから捨てる
+  Retired unused{device_->currentFenceValue(), nullptr, {}};
+  for (auto& t : transients_) {
+    if (t.resource) {
+      unused.transients.push_back(std::move(t));
+    }
+  }
+  if (!unused.transients.empty()) {
+    retired_.push_back(std::move(unused));
+  }
+  transients_ = std::move(used);
+}
+
+D3D12_RESOURCE_STATES RenderGraphResources::ToD3D12(ResourceState state) {
+  auto result = D3D12_RESOURCE_STATE_COMMON;
+  if (Has(state, ResourceState::RenderTarget)) {
+    result |= D3D12_RESOURCE_STATE_RENDER_TARGET;
+  }
+  if (Has(state, ResourceState::DepthWrite)) {
+    result |= D3D12_RESOURCE_STATE_DEPTH_WRITE;
+  }
+  if (Has(state, ResourceState::DepthRead)) {
+    result |= D3D12_RESOURCE_STATE_DEPTH_READ;
+  }
+  if (Has(state, ResourceState::ShaderResource)) {
+    result |= D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE |
+              D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+  }
+  if (Has(state, ResourceState::UnorderedAccess)) {
+    result |= D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+  }
+  if (Has(state, ResourceState::CopySource)) {
+    result |= D3D12_RESOURCE_STATE_COPY_SOURCE;
+  }
+  if (Has(state, ResourceState::CopyDest)) {
+    result |= D3D12_RESOURCE_STATE_COPY_DEST;
+  }
+  // PRESENTはCOMMONと同じ0なので足すものはない
+  return result;
+}
+
+void RenderGraphResources::Translate(
+    const RenderGraphBarrier* barriers, std::uint32_t count,
+    std::vector<D3D12_RESOURCE_BARRIER>* out) const {
+  for (std::uint32_t i = 0; i < count; ++i) {
+    const auto& barrier = barriers[i];
+    auto res = resources_[barrier.resource];
+    switch (barrier.type) {
+      case RenderGraphBarrier::Type::Aliasing:
+        out->push_back(CD3DX12_RESOURCE_BARRIER::Aliasing(
+            resources_[barrier.aliasBefore], res));
+        break;
+      case RenderGraphBarrier::Type::Uav:
+        out->push_back(CD3DX12_RESOURCE_BARRIER::UAV(res));
+        break;
+      case RenderGraphBarrier::Type::Transition: {
+        const auto before = ToD3D12(barrier.before);
+        const auto after = ToD3D12(barrier.after);
+        if (before == after) {
+          break;  // PRESENTとCOMMONのように、D3D12では同じ状態
+        }
+        auto flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        if (barrier.split == RenderGraphBarrier::Split::Begin) {
+          flags = D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY;
+        } else if (barrier.split == RenderGraphBarrier::Split::End) {
+          flags = D3D12_RESOURCE_BARRIER_FLAG_END_ONLY;
+        }
+        out->push_back(CD3DX12_RESOURCE_BARRIER::Transition(
+            res, before, after, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+            flags));
+        break;
+      }
+    }
+  }
+}
+
+void RenderGraphResources::Record(ID3D12GraphicsCommandList* commandList,
+                                  const RenderGraphBarrier* barriers,
+                                  std::uint32_t count) {
+  barriers_.clear();
+  Translate(barriers, count, &barriers_);
+  if (!barriers_.empty()) {
+    commandList->ResourceBarrier(static_cast<UINT>(barriers_.size()),
+                                 barriers_.data());
+  }
+}
+
+}  // namespace dxapp
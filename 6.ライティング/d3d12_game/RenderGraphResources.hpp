@@ -0,0 +1,107 @@
+﻿#pragma once
+#include "RenderGraph.hpp"
+
+namespace dxapp {
+class Device;
+
+/*!
+ * @brief RenderGraphをD3D12で動かすためのリソースとバリア
+ * @details 一時的なテクスチャは1つのヒープにPlacedで作り、
+ *          置き場所と設定が同じなら次のフレームでも使いまわす。
+ *          ヒープを大きくするときは、前のヒープをGPUが使い終わるまで残す
+ */
+class RenderGraphResources {
+ public:
+  RenderGraphResources(const RenderGraphResources&) = delete;
+  RenderGraphResources& operator=(const RenderGraphResources&) = delete;
+
+  /*!
+   * @brief デフォルトコンストラクタ
+   */
+  RenderGraphResources() = default;
+
+  /*!
+   * @brief デストラクタ
+   */
+  ~RenderGraphResources() = default;
+
+  void Initialize(Device* device);
+
+  /*!
+   * @brief RenderGraph::Compileに渡すメモリの問い合わせ
+   */
+  RenderGraphMemory QueryMemory(const RenderGraphTextureDesc& desc,
+                                ResourceState usage) const;
+
+  /*!
+   * @brief 持ち込んだリソースの実体を渡す
+   */
+  void Import(std::uint32_t resource, ID3D12Resource* d3dResource);
+
+  /*!
+   * @brief コンパイルしたグラフの一時的なテクスチャを用意する
+   */
+  void Prepare(const RenderGraph& graph);
+
+  /*!
+   * @brief リソースの実体
+   */
+  ID3D12Resource* resource(std::uint32_t resource) const {
+    return resources_[resource];
+  }
+
+  /*!
+   * @brief グラフのバリアをD3D12のバリアにする
+   */
+  void Translate(const RenderGraphBarrier* barriers, std::uint32_t count,
+                 std::vector<D3D12_RESOURCE_BARRIER>* out) const;
+
+  /*!
+   * @brief グラフのバリアを1回のResourceBarrierで積む
+   */
+  void Record(ID3D12GraphicsCommandList* commandList,
+              const RenderGraphBarrier* barriers, std::uint32_t count);
+
+  /*!
+   * @brief グラフの状態をD3D12の状態にする
+   */
+  static D3D12_RESOURCE_STATES ToD3D12(ResourceState state);
+
+ private:
+  template <typename T>
+  using ComPtr = Microsoft::WRL::ComPtr<T>;
+
+  /*!
+   * @brief ヒープに作ったテクスチャ
+   */
+  struct Transient {
+    RenderGraphTextureDesc desc;
+    ResourceState usage;
+    ResourceState firstState;
+    std::uint64_t offset;
+    ComPtr<ID3D12Resource> resource;
+  };
+
+  /*!
+   * @brief GPUが使い終わるのを待っているヒープとテクスチャ
+   */
+  struct Retired {
+    std::uint64_t fenceValue;
+    ComPtr<ID3D12Heap> heap;
+    std::vector<Transient> transients;
+  };
+
+  D3D12_RESOURCE_DESC MakeDesc(const RenderGraphTextureDesc& desc,
+                               ResourceState usage) const;
+
+  Device* device_{nullptr};
+  ComPtr<ID3D12Heap> heap_{};
+  std::uint64_t heapSize_{0};
+  std::vector<Transient> transients_{};  //!< 今のヒープに作ったもの
+  std::vector<Retired> retired_{};
+
+  std::vector<ID3D12Resource*> resources_{};  //!< グラフの番号ごとの実体
+  std::vector<D3D12_RESOURCE_BARRIER> barriers_{};  //!< Recordの作業用
+};
+
+}  // namespace dxapp
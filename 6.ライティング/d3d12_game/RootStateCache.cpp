@@ -0,0 +1,81 @@
+﻿#include "RootStateCache.hpp"
+
+#include <cassert>
+
+namespace dxapp {
+
+void RootStateCache::Reset() {
+  rootSignature_ = nullptr;
+  pipelineState_ = nullptr;
+  cbvSrvUavHeap_ = nullptr;
+  samplerHeap_ = nullptr;
+  hasHeaps_ = false;
+  slots_.fill({});
+}
+
+bool RootStateCache::SetRootSignature(const void* rootSignature) {
+  if (rootSignature == rootSignature_) {
+    return Count(false);
+  }
+  // ルートシグネチャが変わると積んだ引数は全部使えなくなる
+  rootSignature_ = rootSignature;
+  slots_.fill({});
+  return Count(true);
+}
+
+bool RootStateCache::SetPipelineState(const void* pipelineState) {
+  if (pipelineState == pipelineState_) {
+    return Count(false);
+  }
+  pipelineState_ = pipelineState;
+  return Count(true);
+}
+
+bool RootStateCache::SetDescriptorHeaps(const void* cbvSrvUav,
+                                        const void* sampler) {
+  if (hasHeaps_ && cbvSrvUav == cbvSrvUavHeap_ && sampler == samplerHeap_) {
+    return Count(false);
+  }
+  // ヒープが変わるとテーブルは前のヒープを指したままなので積みなおす
+  cbvSrvUavHeap_ = cbvSrvUav;
+  samplerHeap_ = sampler;
+  hasHeaps_ = true;
+  for (auto& slot : slots_) {
+    if (slot.kind == SlotKind::Table) {
+      slot = {};
+    }
+  }
+  return Count(true);
+}
+
+bool RootStateCache::SetDescriptorTable(std::uint32_t slot,
+                                        std::uint64_t gpuHandle) {
+  return Count(Check(slot, SlotKind::Table, gpuHandle));
+}
+
+bool RootStateCache::SetRootView(std::uint32_t slot,
+                                 std::uint64_t gpuAddress) {
+  return Count(Check(slot, SlotKind::View, gpuAddress));
+}
+
+bool RootStateCache::SetRootConstant(std::uint32_t slot, std::uint32_t value,
+                                     std::uint32_t offset) {
+  // 1つのスロットでは最後に積んだ1個だけ覚える
+  // 別のoffsetを交互に積むと省けないが、間違って省くことはない
+  const auto packed = (static_cast<std::uint64_t>(offset) << 32) | value;
+  return Count(Check(slot, SlotKind::Constant, packed));
+}
+
+bool RootStateCache::Check(std::uint32_t slot, SlotKind kind,
+                           std::uint64_t value) {
+  assert(slot < MaxRootParameters);
+  auto& cached = slots_[slot];
+  if (cached.kind == kind && cached.value == value) {
+    return false;
+  }
+  cached.kind = kind;
+  cached.value = value;
+  return true;
+}
+
+}  // namespace dxapp
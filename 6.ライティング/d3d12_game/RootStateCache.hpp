@@ -0,0 +1,112 @@
+﻿#pragma once
+// コマンドリストに積んだルートシグネチャ・ルート引数・デスクリプタヒープを覚えておき、
+// 前と同じ値をもう一度積まないようにする
+// D3D12には触らないので、Linuxでも動かして確かめられる
+#include <array>
+#include <cstdint>
+
+namespace dxapp {
+
+/*!
+ * @brief 積んだコマンドと省いたコマンドの数
+ */
+struct RootStateStats {
+  std::uint64_t issued{0};   //!< コマンドリストに積んだ数
+  std::uint64_t skipped{0};  //!< 前と同じなので省いた数
+};
+
+/*!
+ * @brief ルート引数の重複を省くためのキャッシュ
+ * @details Set〜がtrueを返したときだけコマンドリストに積む。
+ *          D3D12の決まりに合わせて、ルートシグネチャが変わったら全部の引数、
+ *          デスクリプタヒープが変わったらデスクリプタテーブルを忘れる
+ */
+class RootStateCache {
+ public:
+  //! ルートシグネチャに置けるパラメータの最大(64DWORD)
+  static constexpr std::uint32_t MaxRootParameters = 64;
+
+  RootStateCache() = default;
+
+  /*!
+   * @brief 全部を忘れる
+   * @details コマンドリストをリセットしたとき(Begin)に呼ぶ。数は残す
+   */
+  void Reset();
+
+  /*!
+   * @brief 数を0に戻す
+   */
+  void ResetStats() { stats_ = {}; }
+
+  bool SetRootSignature(const void* rootSignature);
+  bool SetPipelineState(const void* pipelineState);
+
+  /*!
+   * @brief デスクリプタヒープ
+   * @param[in] cbvSrvUav CBV/SRV/UAVのヒープ
+   * @param[in] sampler サンプラのヒープ
+   */
+  bool SetDescriptorHeaps(const void* cbvSrvUav, const void* sampler);
+
+  /*!
+   * @brief デスクリプタテーブル
+   * @param[in] gpuHandle テーブルの先頭のGPUハンドル
+   */
+  bool SetDescriptorTable(std::uint32_t slot, std::uint64_t gpuHandle);
+
+  /*!
+   * @brief ルートCBV/SRV/UAV
+   * @param[in] gpuAddress バッファのGPUアドレス
+   */
+  bool SetRootView(std::uint32_t slot, std::uint64_t gpuAddress);
+
+  /*!
+   * @brief ルート定数1個
+   * @param[in] offset スロットの中の何番目の32bit値か
+   */
+  bool SetRootConstant(std::uint32_t slot, std::uint32_t value,
+                       std::uint32_t offset = 0);
+
+  /*!
+   * @brief Resetしてからの数
+   */
+  const RootStateStats& stats() const { return stats_; }
+
+ private:
+  //! スロットに積んだものの種類
+  enum class SlotKind : std::uint8_t {
+    Unknown,   //!< 積んでいない、または忘れた
+    Table,     //!< デスクリプタテーブル
+    View,      //!< ルートCBV/SRV/UAV
+    Constant,  //!< ルート定数
+  };
+
+  struct Slot {
+    SlotKind kind{SlotKind::Unknown};
+    std::uint64_t value{0};
+  };
+
+  /*!
+   * @brief 前と同じならfalse。違えば覚えてtrue
+   */
+  bool Check(std::uint32_t slot, SlotKind kind, std::uint64_t value);
+
+  /*!
+   * @brief 数を数えて、積むならtrueを返す
+   */
+  bool Count(bool changed) {
+    ++(changed ? stats_.issued : stats_.skipped);
+    return changed;
+  }
+
+  const void* rootSignature_{nullptr};
+  const void* pipelineState_{nullptr};
+  const void* cbvSrvUavHeap_{nullptr};
+  const void* samplerHeap_{nullptr};
+  bool hasHeaps_{false};  //!< ヒープを積んだか(nullptrを積むこともある)
+  std::array<Slot, MaxRootParameters> slots_{};
+  RootStateStats stats_{};
+};
+
+}  // namespace dxapp
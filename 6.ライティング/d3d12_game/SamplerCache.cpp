@@ -0,0 +1,181 @@
+﻿#include "SamplerCache.hpp"
+
+#include <cstring>
+
+#include "Device.hpp"
+
+namespace {
+/*!
+ * @brief サンプラの設定のハッシュ(FNV-1a)
+ * @details D3D12_SAMPLER_DESCは4バイトのメンバだけで隙間がないので、
+ *          バイト列としてそのまま混ぜてよい
+ */
+std::uint64_t HashSamplerDesc(const D3D12_SAMPLER_DESC& desc) {
+  static_assert(sizeof(D3D12_SAMPLER_DESC) == 13 * 4,
+                "D3D12_SAMPLER_DESC has padding");
+  auto p = reinterpret_cast<const std::uint8_t*>(&desc);
+  std::uint64_t hash = 14695981039346656037ull;
+  for (std::size_t i = 0; i < sizeof(desc); ++i) {
+    hash = (hash ^ p[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+bool IsSameSamplerDesc(const D3D12_SAMPLER_DESC& a,
+                       const D3D12_SAMPLER_DESC& b) {
+  return std::memcmp(&a, &b, sizeof(D3D12_SAMPLER_DESC)) == 0;
+}
+
+/*!
+ * @brief 境界色を静的サンプラで使える色にする
+ * @return 使えない色ならfalse
+ */
+bool ToStaticBorderColor(const FLOAT (&color)[4],
+                         D3D12_STATIC_BORDER_COLOR* staticColor) {
+  if (color[0] == 0 && color[1] == 0 && color[2] == 0) {
+    if (color[3] == 0) {
+      *staticColor = D3D12_STATIC_BORDER_COLOR_TRANSPARENT_BLACK;
+      return true;
+    }
+    if (color[3] == 1) {
+      *staticColor = D3D12_STATIC_BORDER_COLOR_OPAQUE_BLACK;
+      return true;
+    }
+  }
+  if (color[0] == 1 && color[1] == 1 && color[2] == 1 && color[3] == 1) {
+    *staticColor = D3D12_STATIC_BORDER_COLOR_OPAQUE_WHITE;
+    return true;
+  }
+  return false;
+}
+
+bool UsesBorderColor(const D3D12_SAMPLER_DESC& desc) {
+  return desc.AddressU == D3D12_TEXTURE_ADDRESS_MODE_BORDER ||
+         desc.AddressV == D3D12_TEXTURE_ADDRESS_MODE_BORDER ||
+         desc.AddressW == D3D12_TEXTURE_ADDRESS_MODE_BORDER;
+}
+}  // namespace
+
+namespace dxapp {
+
+void SamplerCache::Initialize(Device* device, std::uint32_t capacity) {
+  // サンプラはフレームごとには作らないので一時的な領域はいらない
+  heap_.Initialize(device, D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER, capacity, 0,
+                   true, L"SamplerCache::Heap");
+  device_ = device;
+  entries_.clear();
+  lookup_.clear();
+  hits_ = 0;
+  misses_ = 0;
+}
+
+DescriptorHandle SamplerCache::Acquire(const D3D12_SAMPLER_DESC& desc) {
+  const auto hash = HashSamplerDesc(desc);
+  auto& bucket = lookup_[hash];
+  for (const auto index : bucket) {
+    auto& entry = entries_[index];
+    if (IsSameSamplerDesc(entry.desc, desc)) {
+      ++entry.refCount;
+      ++hits_;
+      return entry.handle;
+    }
+  }
+
+  auto handle = heap_.Allocate();
+  if (!handle.IsValid()) {
+    if (bucket.empty()) {
+      lookup_.erase(hash);
+    }
+    return {};
+  }
+  device_->device()->CreateSampler(&desc, handle.cpu);
+  ++misses_;
+
+  // 空いている場所があれば使う
+  auto slot = std::find_if(std::begin(entries_), std::end(entries_),
+                           [](const Entry& e) { return e.refCount == 0; });
+  if (slot == std::end(entries_)) {
+    slot = entries_.insert(std::end(entries_), Entry{});
+  }
+  *slot = {desc, hash, handle, 1};
+  bucket.push_back(static_cast<std::uint32_t>(slot - std::begin(entries_)));
+  return handle;
+}
+
+void SamplerCache::Release(DescriptorHandle& handle) {
+  if (!handle.IsValid()) {
+    return;
+  }
+  for (std::uint32_t i = 0; i < entries_.size(); ++i) {
+    auto& entry = entries_[i];
+    if (entry.refCount == 0 || entry.handle.index != handle.index) {
+      continue;
+    }
+    if (--entry.refCount == 0) {
+      auto& bucket = lookup_[entry.hash];
+      bucket.erase(std::remove(std::begin(bucket), std::end(bucket), i),
+                   std::end(bucket));
+      if (bucket.empty()) {
+        lookup_.erase(entry.hash);
+      }
+      heap_.Free(entry.handle);
+    }
+    break;
+  }
+  handle = {};
+}
+
+bool SamplerCache::FindStaticSampler(
+    UINT shaderRegister, D3D12_STATIC_SAMPLER_DESC* staticDesc) const {
+  const Entry* found = nullptr;
+  for (const auto& entry : entries_) {
+    if (entry.refCount == 0) {
+      continue;
+    }
+    if (found) {
+      return false;  // 2種類以上使っている
+    }
+    found = &entry;
+  }
+  if (!found) {
+    return false;
+  }
+
+  const auto& desc = found->desc;
+  D3D12_STATIC_BORDER_COLOR borderColor =
+      D3D12_STATIC_BORDER_COLOR_TRANSPARENT_BLACK;
+  if (UsesBorderColor(desc) &&
+      !ToStaticBorderColor(desc.BorderColor, &borderColor)) {
+    return false;
+  }
+
+  *staticDesc = {};
+  staticDesc->Filter = desc.Filter;
+  staticDesc->AddressU = desc.AddressU;
+  staticDesc->AddressV = desc.AddressV;
+  staticDesc->AddressW = desc.AddressW;
+  staticDesc->MipLODBias = desc.MipLODBias;
+  staticDesc->MaxAnisotropy = desc.MaxAnisotropy;
+  staticDesc->ComparisonFunc = desc.ComparisonFunc;
+  staticDesc->BorderColor = borderColor;
+  staticDesc->MinLOD = desc.MinLOD;
+  staticDesc->MaxLOD = desc.MaxLOD;
+  staticDesc->ShaderRegister = shaderRegister;
+  staticDesc->RegisterSpace = 0;
+  staticDesc->ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+  return true;
+}
+
+SamplerCacheStats SamplerCache::stats() const {
+  SamplerCacheStats stats{};
+  for (const auto& entry : entries_) {
+    if (entry.refCount > 0) {
+      ++stats.samplerCount;
+    }
+  }
+  stats.hits = hits_;
+  stats.misses = misses_;
+  return stats;
+}
+
+}  // namespace dxapp
@@ -0,0 +1,103 @@
+﻿#pragma once
+#include "DescriptorAllocator.hpp"
+
+namespace dxapp {
+class Device;
+
+/*!
+ * @brief サンプラの使用状況
+ */
+struct SamplerCacheStats {
+  std::uint32_t samplerCount{0};  //!< 作ったサンプラの数(同じ設定は1個)
+  std::uint64_t hits{0};          //!< 同じ設定がもうあった回数
+  std::uint64_t misses{0};        //!< 新しく作った回数
+};
+
+/*!
+ * @brief サンプラを設定(D3D12_SAMPLER_DESC)で重複なく作るクラス
+ * @details 設定のハッシュで探し、同じ設定なら同じ位置を返す。
+ *          全部のサンプラは1つのシェーダから見えるヒープに置く。
+ *          返した位置は全部Releaseされるまで変わらない。
+ *          描画スレッドからだけ呼ぶ
+ */
+class SamplerCache {
+ public:
+  SamplerCache(const SamplerCache&) = delete;
+  SamplerCache& operator=(const SamplerCache&) = delete;
+
+  /*!
+   * @brief デフォルトコンストラクタ
+   */
+  SamplerCache() = default;
+
+  /*!
+   * @brief デストラクタ
+   */
+  ~SamplerCache() = default;
+
+  /*!
+   * @brief ヒープを作る
+   * @param[in] capacity 作れるサンプラの数。シェーダから見えるヒープは2048個まで
+   */
+  void Initialize(Device* device, std::uint32_t capacity);
+
+  /*!
+   * @brief 設定にあうサンプラの位置をもらう
+   * @details 同じ設定がなければ作る。使い終わったらReleaseする
+   * @return ヒープがいっぱいならIsValid()がfalse
+   */
+  DescriptorHandle Acquire(const D3D12_SAMPLER_DESC& desc);
+
+  /*!
+   * @brief サンプラを使い終わった
+   * @details 誰も使わなくなったら、GPUが使い終わってから位置を再利用する。
+   *          handleは無効な値にする
+   */
+  void Release(DescriptorHandle& handle);
+
+  /*!
+   * @brief 使っているサンプラが1種類だけなら、静的サンプラとして使える設定を返す
+   * @details ルートシグネチャに静的サンプラとして入れれば、
+   *          サンプラのテーブルもヒープの切り替えもいらなくなる。
+   *          境界色が静的サンプラで使えない色なら昇格しない
+   * @param[in] shaderRegister 静的サンプラのレジスタ(s0なら0)
+   * @param[out] staticDesc 静的サンプラの設定
+   * @return 昇格できるか
+   */
+  bool FindStaticSampler(UINT shaderRegister,
+                         D3D12_STATIC_SAMPLER_DESC* staticDesc) const;
+
+  /*!
+   * @brief フレームの終わり。コマンドを記録し終えてから呼ぶ
+   */
+  void EndFrame() { heap_.EndFrame(); }
+
+  /*!
+   * @brief サンプラのヒープ
+   */
+  ID3D12DescriptorHeap* heap() const { return heap_.heap(); }
+
+  /*!
+   * @brief 使用状況
+   */
+  SamplerCacheStats stats() const;
+
+ private:
+  //! 作ったサンプラ
+  struct Entry {
+    D3D12_SAMPLER_DESC desc;
+    std::uint64_t hash;
+    DescriptorHandle handle;
+    std::uint32_t refCount;
+  };
+
+  Device* device_{nullptr};
+  DescriptorAllocator heap_{};
+  std::vector<Entry> entries_{};  //!< refCountが0のものは空き
+  //! 設定のハッシュ→entries_の位置(ハッシュがぶつかったときのために複数)
+  std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> lookup_{};
+  std::uint64_t hits_{0};
+  std::uint64_t misses_{0};
+};
+
+}  // namespace dxapp
@@ -1,10 +1,22 @@
 ﻿#include "Scene.hpp"
 
+#include <array>
+#include <chrono>
+
 #include "BufferObject.hpp"
+#include "Bvh.hpp"
 #include "Camera.hpp"
+#include "CommandListPool.hpp"
+#include "DescriptorAllocator.hpp"
 #include "Device.hpp"
+#include "DrawPacket.hpp"
+#include "FrustumCulling.hpp"
 #include "GeometoryMesh.hpp"
+#include "InstanceBatcher.hpp"
+#include "OcclusionBuffer.hpp"
+#include "SamplerCache.hpp"
 #include "TextureManager.hpp"
+#include "WorkerPool.hpp"
 #pragma region add_1112
 #include "LightingShader.hpp"
 #pragma endregion
@@ -23,7 +35,12 @@ namespace {
 			DirectX::XMFLOAT4X4 mat;
 #pragma endregion
 			int useTexture = 0;
+			int textureSlice = 0;  //!< テクスチャ配列の何番目か
+			int textureIndex = 0;  //!< バインドレスのときのテクスチャのSRVの位置
+			int pad = 0;           //!< 構造化バッファで16バイト単位にする詰め物
 		};
+		static_assert(sizeof(MaterialParameter) % 16 == 0,
+			"シェーダのMaterialDataと並びを合わせる");
 
 		/*
 		 * @brief コンストラクタ
@@ -37,7 +54,7 @@ namespace {
 		void Initialize(dxapp::Device* device) {
 			// マテリアルは変化しなさそうだけど、、、
 			// 点滅したりテクスチャがスクロールするので一応ダブルバッファ化
-			matCb_.resize(device->backBufferSize());
+			matCb_.resize(device->frameCount());
 			for (auto& cb : matCb_) {
 				cb = std::make_unique<dxapp::BufferObject>();
 				cb->Initialize(device->device(), dxapp::BufferObjectType::ConstantBuffer,
@@ -78,11 +95,15 @@ namespace {
 
 		/*
 		 * @brief テクスチャの設定
+		 * @param[in] slice テクスチャ配列にまとめてあるときの位置
 		 */
-		void SetTexture(ID3D12DescriptorHeap* heap, std::uint32_t offset) {
+		void SetTexture(ID3D12DescriptorHeap* heap, std::uint32_t offset,
+			std::uint32_t slice = 0) {
 			srvHeap_ = heap;
 			srvOffset_ = offset;
 			material_.useTexture = 1;
+			material_.textureSlice = static_cast<int>(slice);
+			material_.textureIndex = static_cast<int>(offset);
 		}
 
 		/*
@@ -92,6 +113,8 @@ namespace {
 			srvHeap_ = nullptr;
 			srvOffset_ = 0;
 			material_.useTexture = 0;
+			material_.textureSlice = 0;
+			material_.textureIndex = 0;
 		}
 
 		/*
@@ -102,11 +125,41 @@ namespace {
 			*offset = srvOffset_;
 		}
 
+		/*
+		 * @brief サンプラの設定
+		 * @param[in] sampler SamplerCacheからもらった位置
+		 */
+		void SetSampler(const dxapp::DescriptorHandle& sampler) {
+			sampler_ = sampler;
+		}
+
+		/*
+		 * @brief サンプラの位置を取得
+		 */
+		const dxapp::DescriptorHandle& sampler() const { return sampler_; }
+
 		/*
 		 * @brief テクスチャの割り当て確認
 		 */
 		bool HasTexture() const { return (material_.useTexture != 0); }
 
+		/*
+		 * @brief 定数バッファに書き込む値
+		 */
+		const MaterialParameter& parameter() const { return material_; }
+
+		/*
+		 * @brief バインドレスのときのマテリアルバッファでの位置
+		 */
+		std::uint32_t bindlessIndex() const { return bindlessIndex_; }
+		void SetBindlessIndex(std::uint32_t index) { bindlessIndex_ = index; }
+
+		/*
+		 * @brief 描画の並べ替えのキーに入れる番号
+		 */
+		std::uint32_t sortId() const { return sortId_; }
+		void SetSortId(std::uint32_t id) { sortId_ = id; }
+
 		/*
 		 * @brief このマテリアルの定数バッファを取得
 		 */
@@ -120,6 +173,9 @@ namespace {
 			matCb_{};  //! MaterialParameterの定数バッファ領域
 		ID3D12DescriptorHeap* srvHeap_{ nullptr };  //! SRVデスクリプタヒープ
 		std::uint32_t srvOffset_{ 0 };              //! アドレスオフセット
+		std::uint32_t bindlessIndex_{ 0 };  //! マテリアルバッファでの位置
+		std::uint32_t sortId_{ 0 };  //! 並べ替えのキーに入れる番号
+		dxapp::DescriptorHandle sampler_{};  //! SamplerCacheのサンプラの位置
 	};
 #pragma endregion
 /*
@@ -144,11 +200,69 @@ struct RenderObject {
 
   // 下のデータはほかのオブジェクトと共有できる情報なのでポインタでもらっておく
   dxapp::GeometoryMesh* mesh;  //! メッシュ
+  std::uint32_t meshId{0};  //! 並べ替えのキーに入れる番号(今はティーポットだけ)
+  std::uint32_t bvhProxy{dxapp::Bvh::NullNode};  //! BVHの葉の番号
+  bool occluder{false};  //! 遮蔽カリングで遮蔽物としてCPUでも描くか
 
 #pragma region add_1112
   Material* material;  //! マテリアル
 #pragma endregion
 };
+
+/*
+ * @brief シェーダに渡すオブジェクト単位のデータを作る
+ */
+dxapp::LightingShader::ObjectParam MakeObjectParam(const Transform& transform) {
+  dxapp::LightingShader::ObjectParam param{};
+  DirectX::XMStoreFloat4x4(&param.world,
+                           DirectX::XMMatrixTranspose(transform.world));
+  DirectX::XMStoreFloat4x4(&param.texTrans,
+                           DirectX::XMMatrixTranspose(transform.texTrans));
+  return param;
+}
+
+/*
+ * @brief オブジェクトのワールドでの箱を作る
+ * @details メッシュの箱をワールド行列で動かし、それを囲む軸に沿った箱にする。
+ *          半分の長さは行列の各行の絶対値で重み付けした和になる
+ */
+dxapp::Aabb ComputeWorldBounds(const RenderObject& obj) {
+  using namespace DirectX;
+  const auto& world = obj.transform.world;
+  const auto center =
+      XMVector3TransformCoord(XMLoadFloat3(&obj.mesh->boundsCenter()), world);
+  const auto e = XMLoadFloat3(&obj.mesh->boundsExtents());
+  const auto extents = XMVectorAbs(world.r[0]) * XMVectorSplatX(e) +
+                       XMVectorAbs(world.r[1]) * XMVectorSplatY(e) +
+                       XMVectorAbs(world.r[2]) * XMVectorSplatZ(e);
+  XMFLOAT3 minPos{}, maxPos{};
+  XMStoreFloat3(&minPos, center - extents);
+  XMStoreFloat3(&maxPos, center + extents);
+  return {minPos.x, minPos.y, minPos.z, maxPos.x, maxPos.y, maxPos.z};
+}
+
+/*
+ * @brief デフォルトのサンプラの設定
+ */
+D3D12_SAMPLER_DESC DefaultSamplerDesc() {
+  // サンプラーの設定を作る
+  // テクスチャ補間の設定やテクスチャアドレッシング設定
+  D3D12_SAMPLER_DESC samplerDesc{};
+  // テクスチャフィルタ
+  samplerDesc.Filter =
+      D3D12_ENCODE_BASIC_FILTER(D3D12_FILTER_TYPE_LINEAR,  // 縮小時
+                                D3D12_FILTER_TYPE_LINEAR,  // 拡大時
+                                D3D12_FILTER_TYPE_LINEAR,  // mipmap
+                                D3D12_FILTER_REDUCTION_TYPE_STANDARD);
+  // テクスチャアドレッシング
+  samplerDesc.AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+  samplerDesc.AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+  samplerDesc.AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+  samplerDesc.MaxLOD = FLT_MAX;
+  samplerDesc.MinLOD = -FLT_MAX;
+  samplerDesc.ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER;
+  return samplerDesc;
+}
 }  // namespace
 
 namespace dxapp {
@@ -178,6 +292,11 @@ class Scene::Impl {
    */
   void Update(float deltaTime);
 
+  /*
+   * @brief 直前のフレームの遮蔽カリングの結果
+   */
+  const OcclusionStats& occlusionStats() const { return occlusionStats_; }
+
  private:
   /*
    * @brief CBV/SRVデスクリプタヒープ生成
@@ -185,15 +304,18 @@ class Scene::Impl {
   void CreateCbvSrvHeap(Device* device);
 
   /*
-   * @brief サンプラーデスクリプタヒープ生成
+   * @brief サンプラーキャッシュとデフォルトサンプラ生成
    */
   void CreateSamplerHeap(Device* device);
 
   /*
    * @brief SRV生成
+   * @param[in] handle SRVを作る位置
+   * @param[in] mostDetailedMip 見せる一番細かいミップ。ストリーミング用
    */
   void CreateSrv(Device* device, ID3D12Resource* tex,
-                 D3D12_CPU_DESCRIPTOR_HANDLE handle, int offset);
+                 D3D12_CPU_DESCRIPTOR_HANDLE handle,
+                 std::uint32_t mostDetailedMip = 0);
 
   /*
    * @brief BufferObject生成
@@ -207,6 +329,24 @@ class Scene::Impl {
   void CreateBufferView(std::unique_ptr<BufferObject>& buffer, Device* device,
                         D3D12_CPU_DESCRIPTOR_HANDLE heapStart, int offset);
 
+  /*
+   * @brief マテリアルにテクスチャを設定
+   * @details ロード中ならダミーを設定して、ロード完了後に差し替える
+   */
+  void BindTexture(Device* device, Material* mat,
+                   const std::string& textureName);
+
+  /*
+   * @brief ロードの終わったテクスチャをマテリアルに設定する
+   */
+  void UpdatePendingTextures(Device* device);
+
+  /*
+   * @brief ストリーミングするテクスチャの必要なミップを伝え、
+   *        使えるミップが変わったマテリアルのSRVを作り直す
+   */
+  void UpdateStreamingTextures(Device* device);
+
 #pragma region add_1112
   /*
    * @brief テクスチャありのRenderObject生成
@@ -218,16 +358,232 @@ class Scene::Impl {
    */
   void CreateMaterial(Device* device);
 #pragma endregion
+
+  /*
+   * @brief バインドレス用に全部のマテリアルを入れるバッファを作る
+   * @details マテリアルに位置を割り当てる。CreateMaterialの後に呼ぶ
+   */
+  void CreateMaterialBuffer(Device* device);
+
   /*
-   * デスクリプタヒープの管理周りは、いろいろと間違っていた！
-   * すまん！！
-   *
-   * なのでいったん今までのようにID3D12DescriptorHeapをそのまま使うよ
+   * @brief バインドレス用のバッファに全部のマテリアルを書き込む
    */
-  // サンプラ デスクリプタヒープ
-  ComPtr<ID3D12DescriptorHeap> samplerHeap_{};
+  void UpdateMaterialBuffer(std::uint32_t index);
+
+  /*
+   * @brief 全部のオブジェクトのObjectParamを入れるバッファを作る
+   * @details CreateRenderObjの後に呼ぶ
+   */
+  void CreateObjectBuffer(Device* device);
+
+  /*
+   * @brief 全部のオブジェクトをBVHに入れて、木をまとめて作る
+   * @details CreateRenderObjの後に呼ぶ
+   */
+  void BuildObjectBvh();
+
+  /*
+   * @brief 動かしたオブジェクトの箱をBVHに伝える
+   * @details 木を直すのは太らせた箱からはみ出したときだけ
+   */
+  void UpdateObjectBounds(std::uint32_t index);
+
+  /*
+   * @brief カメラに見えるオブジェクトを選ぶ
+   * @details 結果はvisibleObjects_に入る
+   */
+  void CullObjects();
+
+  /*
+   * @brief 遮蔽物の後ろに隠れるオブジェクトをvisibleObjects_から外す
+   * @details 見えている遮蔽物をCPUの深度バッファに描き、
+   *          ほかのオブジェクトの箱と比べる。CullObjectsの後に呼ぶ
+   */
+  void OccludeObjects();
+
+  /*
+   * @brief 見えるオブジェクトごとに並べ替えのキーを作り、キーの順に並べる
+   * @details パス・パイプライン・マテリアル・メッシュの順にまとまり、
+   *          同じ設定の中では手前から並ぶ。CullObjectsの後に呼ぶ
+   */
+  void BuildDrawPackets();
+
+  /*
+   * @brief 同じメッシュとマテリアルのオブジェクトをまとめて、
+   *        インスタンスの順にオブジェクトバッファを書く
+   * @details オブジェクトバッファのときに使う。BuildDrawPacketsの後に呼ぶ
+   */
+  void BuildInstanceBatches(std::uint32_t index);
+
+  /*
+   * @brief 描画をコマンドリストに積む
+   * @details 描画が多ければスレッドごとのコマンドリストに分けて積み、
+   *          Deviceに順に実行してもらう
+   */
+  void RecordDraws(Device* device, std::uint32_t index);
+
+  /*
+   * @brief begin番目からend番目の手前までの描画を積む
+   * @details オブジェクトバッファならまとめた描画、そうでなければパケットの番号。
+   *          contextとcommandListが別なら、ほかのスレッドと同時に呼んでよい
+   */
+  void RecordDrawRange(LightingShader::Context* context,
+                       ID3D12GraphicsCommandList* commandList,
+                       std::uint32_t begin, std::uint32_t end,
+                       std::uint32_t index);
+
+  /*
+   * @brief レンダーターゲット・ビューポート・シザーを設定
+   */
+  void SetRenderTarget(Device* device, ID3D12GraphicsCommandList* commandList);
+
+  /*
+   * @brief マテリアルの定数バッファ・テクスチャなどを設定
+   */
+  void SetMaterial(LightingShader::Context* context, Material* material,
+                   std::uint32_t index);
+
+  // デスクリプタヒープ
+  // 位置はDescriptorAllocatorからもらい、使い終わったら返す
+  // 返した位置はGPUがそのフレームを終えてから再利用される
+  // サンプラ
+  // 同じ設定のサンプラはSamplerCacheが1つにまとめる
+  SamplerCache samplerCache_{};
   // CBV/SRV デスクリプタヒープ
-  ComPtr<ID3D12DescriptorHeap> cbvSrvHeap_{};
+  DescriptorAllocator srvHeap_{};
+
+  //! CBV/SRVヒープの長く使う領域(テクスチャのSRVなど)の個数
+  static constexpr std::uint32_t PersistentSrvCount_{1024};
+  //! CBV/SRVヒープのフレームごとの領域の個数
+  static constexpr std::uint32_t TransientSrvCount_{1024};
+
+  //! デフォルトサンプラの位置
+  DescriptorHandle defaultSampler_{};
+
+  //! 使っているサンプラが1種類だけならルートシグネチャの静的サンプラにするか
+  //! サンプラのテーブルとヒープを積まなくてよくなる
+  static constexpr bool EnableStaticSampler_{true};
+
+  //! ダミーテクスチャ(uv_checker)のSRV
+  DescriptorHandle dummySrv_{};
+
+  //! テクスチャの非同期ロードのハンドル
+  std::unordered_map<std::string, TextureLoadHandle> textureRequests_;
+
+  //! テクスチャのロード待ちのマテリアル
+  struct PendingTexture {
+    TextureLoadHandle handle;  //!< ロードのハンドル
+    Material* material;        //!< 設定先のマテリアル
+    DescriptorHandle srv;      //!< SRVを作る位置。先に取っておく
+  };
+  std::vector<PendingTexture> pendingTextures_;
+
+  //! 小さいテクスチャを同じ大きさどうしテクスチャ配列にまとめるか
+  static constexpr bool EnableTexturePacking_{true};
+
+  //! texture_cookerのLZコンテナ(.ddz)を.ddsより先に探すか
+  //! ファイルは1割ほど小さいが、展開の分だけロードは遅い
+  //! (BCで6.1ms対2.7ms、RGBAで46.6ms対18.8ms)。読み込みが遅い媒体向け
+  static constexpr bool EnableCompressedTextures_{false};
+
+  //! バインドレスで描画するか
+  //! 全部のテクスチャのSRVを1つのテーブル、全部のマテリアルを1つのバッファで渡し、
+  //! 描画ごとにはマテリアルの番号だけを渡す。GPUが対応していなければ普通に描画する
+  static constexpr bool EnableBindless_{true};
+
+  //! バインドレス用の全部のマテリアルのバッファ。フレームのスロットの数だけ作る
+  std::vector<std::unique_ptr<BufferObject>> materialBuffers_;
+
+  //! バインドレス用の位置の順のマテリアル
+  std::vector<Material*> bindlessMaterials_;
+
+  //! オブジェクトごとのデータを1つの構造化バッファで渡すか
+  //! 描画ごとにはルート定数でオブジェクトの番号だけを渡し、
+  //! オブジェクトごとの定数バッファは作らない
+  static constexpr bool EnableObjectBuffer_{true};
+
+  //! 全部のオブジェクトのObjectParamのバッファ。フレームのスロットの数だけ作る
+  std::vector<std::unique_ptr<BufferObject>> objectBuffers_;
+
+  //! 視錐台の外のオブジェクトを描画の前に外すか
+  static constexpr bool EnableFrustumCulling_{true};
+
+  //! オブジェクトをBVHに入れて、見えるものを木をたどって選ぶか
+  //! しなければ毎フレーム全部の箱を作り、まとめてSIMDで調べる
+  static constexpr bool EnableBvh_{true};
+
+  //! オブジェクトの箱の木。動いたものだけ更新する
+  Bvh objectBvh_;
+
+  //! オブジェクトのワールドでの箱。番号はrenderObjs_と同じ。BVHなしのとき使う
+  BoundingBoxSoA objectBounds_;
+  //! BVHなしのときに見えるオブジェクトの番号を作る
+  FrustumCuller frustumCuller_;
+
+  //! このフレームで見えるオブジェクトの番号
+  std::vector<std::uint32_t> visibleObjects_;
+
+  //! 遮蔽物に隠れるオブジェクトを描画の前に外すか
+  static constexpr bool EnableOcclusionCulling_{true};
+  //! 遮蔽カリングの深度バッファの大きさ。画面よりずっと小さくてよい
+  static constexpr std::uint32_t OcclusionWidth_{256};
+  static constexpr std::uint32_t OcclusionHeight_{144};
+
+  //! 遮蔽物を描くCPUの深度バッファ
+  OcclusionBuffer occlusionBuffer_;
+  //! 直前のフレームの遮蔽カリングの結果
+  OcclusionStats occlusionStats_;
+
+  //! キーの順に並べた描画。このフレームに描くオブジェクトが入る
+  std::vector<DrawPacket> drawPackets_;
+  DrawPacketSorter drawPacketSorter_;
+
+  //! 同じメッシュとマテリアルのオブジェクトを1回の描画にまとめる
+  InstanceBatcher instanceBatcher_;
+
+  //! カリングと描画を積むスレッド。描画スレッドも入る
+  WorkerPool recordWorkers_;
+  //! スレッドごとのコマンドリスト
+  CommandListPool commandListPool_;
+  //! スレッドごとのLightingShaderのコンテキスト
+  //! 0番は分けないときにDeviceのコマンドリストに積むのにも使う
+  std::vector<std::unique_ptr<LightingShader::Context>> shaderContexts_;
+
+  //! 描画を積むスレッドの最大
+  static constexpr std::uint32_t MaxRecordThreads_{8};
+  //! コマンドリスト1本に入れる最低の描画数
+  //! これより少ないとリストを分ける手間のほうが大きい
+  static constexpr std::uint32_t MinDrawsPerCommandList_{64};
+
+  //! テクスチャごとに作ったSRVの位置
+  //! 同じテクスチャ(配列)を使うマテリアルは同じSRVを使う
+  std::unordered_map<ID3D12Resource*, std::uint32_t> textureSrvOffsets_;
+
+  //! SRVを作ったテクスチャの参照。持っている間はTextureManagerが破棄しない
+  std::vector<TextureRef> textureRefs_;
+
+  //! ストリーミング以外のテクスチャに使ってよいバイト数
+  static constexpr std::uint64_t TextureBudget_{256 * 1024 * 1024};
+
+  //! テクスチャをミップ単位でストリーミングするか
+  static constexpr bool EnableTextureStreaming_{true};
+
+  //! ストリーミングで常駐させてよいバイト数
+  static constexpr std::uint64_t StreamingBudget_{8 * 1024 * 1024};
+
+  //! 画面上の大きさを見積もるときのオブジェクトの半径
+  static constexpr float ObjectRadius_{1.0f};
+
+  //! ストリーミングするテクスチャを使っているマテリアル
+  struct StreamingBinding {
+    Material* material;        //!< 設定先のマテリアル
+    std::string textureName;   //!< テクスチャのアセット名
+    std::uint32_t appliedMip;  //!< SRVに設定しているミップ
+    DescriptorHandle srv;      //!< ミップを変えたときに作ったSRV
+  };
+  std::vector<StreamingBinding> streamingBindings_;
+  //! マテリアル(sortIdの順)を使うオブジェクトの画面上の一番大きい直径
+  std::vector<float> materialScreenPixels_;
 
   // カメラ
   FpsCamera camera_;
@@ -264,41 +620,142 @@ void Scene::Impl::Initialize(Device* device) {
   Mouse::Get().SetMode(Mouse::MODE_RELATIVE);
 
   // テクスチャロード
+  // texture_cookerで作ったDDSがAssets/Cookedにあればそちらを使う
+  // DDSはミップ付きのブロック圧縮で、メモリマップからコピーするだけなので同期で読む
+  // ダミーに使うuv_checkerも先に転送まで終わらせる
+  // 1ファイルずつ転送せずにバッチにまとめて1回で送る
+  auto& manager = Singleton<TextureManager>::instance();
+  manager.SetStreamingBudget(StreamingBudget_);
+  manager.SetMemoryBudget(TextureBudget_);
+  // LZコンテナ(.ddz)はEnableCompressedTextures_のときだけ.ddsより先に探す
+  auto loadCooked = [device, &manager](const std::wstring& name,
+                                       const std::string& assetName) {
+    const auto extensions = EnableCompressedTextures_
+                                ? std::array{L".ddz", L".dds"}
+                                : std::array{L".dds", L".ddz"};
+    for (const auto ext : extensions) {
+      const auto path = L"Assets/Cooked/" + name + ext;
+      if (std::filesystem::exists(path)) {
+        return manager.LoadDDSTextureFromFile(device, path, assetName);
+      }
+    }
+    return false;
+  };
   {
-    Singleton<TextureManager>::instance().LoadWICTextureFromFile(
-        device, L"Assets/bricks.png", "bricks");
+    manager.BeginUploadBatch(device);
 
-    Singleton<TextureManager>::instance().LoadWICTextureFromFile(
-        device, L"Assets/fabric.png", "fabric");
+    if (!loadCooked(L"uv_checker", "uv_checker")) {
+      manager.LoadWICTextureFromFile(device, L"Assets/uv_checker.png",
+                                     "uv_checker");
+    }
+    const std::pair<const wchar_t*, const char*> cookedTextures[]{
+        {L"bricks", "bricks"},
+        {L"fabric", "fabric"},
+        {L"grass", "grass"},
+        {L"travertine", "travertine"}};
+    // クック済みがなければPNGをワーカースレッドでデコードする
+    std::vector<std::wstring> sourceFiles{};
+    std::vector<std::string> sourceNames{};
+    for (const auto& [name, assetName] : cookedTextures) {
+      if (!loadCooked(name, assetName)) {
+        sourceFiles.push_back(L"Assets/" + std::wstring(name) + L".png");
+        sourceNames.push_back(assetName);
+      }
+    }
 
-    Singleton<TextureManager>::instance().LoadWICTextureFromFile(
-        device, L"Assets/grass.png", "grass");
+    manager.EndUploadBatch();
 
-    Singleton<TextureManager>::instance().LoadWICTextureFromFile(
-        device, L"Assets/travertine.png", "travertine");
+    // 残りは非同期ロード。届くまではダミーテクスチャで描画する
+    // ここではヘッダを読むだけで、PNGのデコードとミップの生成はしない
+    // 小さいものは同じ大きさどうし配列にまとめる
+    // SRVが減るのでデスクリプタテーブルの切り替えも減る
+    std::vector<TextureLoadHandle> packed(sourceFiles.size());
+    if (EnableTexturePacking_) {
+      packed = manager.LoadPackedPNGTexturesAsync(device, sourceFiles,
+                                                  sourceNames);
+    }
+    // 残りはミップ単位でストリーミングする
+    // 最初はミップテールだけを転送するので、使えるようになるのも早い
+    for (std::size_t i = 0; i < sourceFiles.size(); ++i) {
+      // travertineは最初のティーポットが使うので優先
+      const int priority = sourceNames[i] == "travertine" ? 1 : 0;
+      auto handle = packed[i];
+      if (!handle) {
+        handle = EnableTextureStreaming_
+                     ? manager.LoadStreamingTextureAsync(
+                           device, sourceFiles[i], sourceNames[i], priority)
+                     : manager.LoadWICTextureAsync(device, sourceFiles[i],
+                                                   sourceNames[i], priority);
+      }
+      textureRequests_.emplace(sourceNames[i], std::move(handle));
+    }
+  }
 
-    Singleton<TextureManager>::instance().LoadWICTextureFromFile(
-        device, L"Assets/uv_checker.png", "uv_checker");
+  // ダミーテクスチャ(uv_checker)のSRVを先に作っておく
+  // uv_checkerを使うマテリアルもこのSRVを使う
+  dummySrv_ = srvHeap_.Allocate();
+  if (auto ref = manager.Acquire("uv_checker")) {
+    CreateSrv(device, ref.resource().Get(), dummySrv_.cpu);
+    textureSrvOffsets_.emplace(ref.resource().Get(), dummySrv_.index);
+    textureRefs_.push_back(std::move(ref));
   }
 
+  // マテリアル作成
+  // どのサンプラを使うかで静的サンプラにできるか決まるので、シェーダより先に作る
+  CreateMaterial(device);
+
   // シェーダー作成
-  lightingShader_ = std::make_unique<LightingShader>();
-  lightingShader_->Initialize(device);
+  {
+    D3D12_STATIC_SAMPLER_DESC staticSampler{};
+    const bool useStaticSampler =
+        EnableStaticSampler_ &&
+        samplerCache_.FindStaticSampler(0, &staticSampler);
+    LightingShader::Options options{};
+    options.bindless = EnableBindless_;
+    options.objectBuffer = EnableObjectBuffer_;
+    options.staticSampler = useStaticSampler ? &staticSampler : nullptr;
+    lightingShader_ = std::make_unique<LightingShader>();
+    lightingShader_->Initialize(device, options);
+  }
 
-  // uv_checkerをダミーテクスチャを設定（uv_checkerはヒープ0にある）
-  lightingShader_->SetDammySrvDescriptorHeap(cbvSrvHeap_.Get(), 0);
+  // uv_checkerをダミーテクスチャを設定
+  lightingShader_->SetDammySrvDescriptorHeap(srvHeap_.heap(), dummySrv_.index);
   // さらについでにデフォルトサンプラも入れておきますね
-  lightingShader_->SetDefaultSamplerDescriptorHeap(samplerHeap_.Get(), 0);
+  lightingShader_->SetDefaultSamplerDescriptorHeap(samplerCache_.heap(),
+                                                   defaultSampler_.index);
+
+  // 描画はスレッドごとに、コンテキストとコマンドリストを分けて積む
+  {
+    recordWorkers_.Initialize(std::clamp(std::thread::hardware_concurrency(),
+                                         1u, MaxRecordThreads_));
+    commandListPool_.Initialize(device, recordWorkers_.threadCount(),
+                                L"Scene::RecordCommandList");
+    shaderContexts_.clear();
+    for (std::uint32_t i = 0; i < recordWorkers_.threadCount(); ++i) {
+      shaderContexts_.push_back(
+          std::make_unique<LightingShader::Context>(lightingShader_.get()));
+    }
+  }
 
 
   // メッシュ作成
   teapotMesh_ = GeometoryMesh::CreateTeapot(device->device());
 
-  // マテリアル作成
-  CreateMaterial(device);
+  if (lightingShader_->bindless()) {
+    CreateMaterialBuffer(device);
+  }
 
   // 描画オブジェクト作成
   CreateRenderObj(device);
+  if (EnableOcclusionCulling_) {
+    occlusionBuffer_.Initialize(OcclusionWidth_, OcclusionHeight_);
+  }
+  if (EnableBvh_) {
+    BuildObjectBvh();
+  }
+  if (lightingShader_->objectBuffer()) {
+    CreateObjectBuffer(device);
+  }
 
   // ライトの設定
   // ライトが3つあるのは3点照明を作りたいから
@@ -328,7 +785,7 @@ void Scene::Impl::Initialize(Device* device) {
 	  sceneParam_.lights[2].strength = { 0.2f, 0.2f, 0.2f };
 
 	  // SceneParamの定数バッファを作成
-	  sceneParamCb_.resize(device->backBufferSize());
+	  sceneParamCb_.resize(device->frameCount());
 	  for (auto& cb : sceneParamCb_) {
 		  CreateBufferObject(cb, device->device(),
 			  sizeof(LightingShader::SceneParam));
@@ -384,6 +841,7 @@ void Scene::Impl::Update(float deltaTime) {
 	  auto fixRot = XMMatrixRotationY(XMConvertToRadians(180.f));
 
 	  transform.world = fixRot * rotY;
+	  UpdateObjectBounds(0);
   }
 #pragma region 追記
   // 2個目
@@ -398,6 +856,7 @@ void Scene::Impl::Update(float deltaTime) {
 	  auto fixRot = XMMatrixRotationY(XMConvertToRadians(180.f));
 
 	  transform.world = fixRot * rotY * trans;
+	  UpdateObjectBounds(1);
   }
 
   // 3個目
@@ -412,6 +871,7 @@ void Scene::Impl::Update(float deltaTime) {
 	  auto fixRot = XMMatrixRotationY(XMConvertToRadians(180.f));
 
 	  transform.world = fixRot * rotY * trans;
+	  UpdateObjectBounds(2);
   }
 #pragma endregion
 
@@ -467,6 +927,7 @@ void Scene::Impl::Update(float deltaTime) {
 	  // y = +2の位置
 	  auto trans = XMMatrixTranslation(0.f, 2.f, 0.f);
 	  transform.world = fixRot * rotY * trans;
+	  UpdateObjectBounds(3);
 
   }
 #pragma endregion
@@ -494,6 +955,7 @@ void Scene::Impl::Update(float deltaTime) {
 	  auto fixRot = XMMatrixRotationY(XMConvertToRadians(180.f));
 	  auto trans = XMMatrixTranslation(2.f, 2.f, 0.f);
 	  transform.world = fixRot * rotY * trans;
+	  UpdateObjectBounds(4);
   }
 
   //追加したマテリアルを動かしてみる
@@ -509,9 +971,14 @@ void Scene::Impl::Update(float deltaTime) {
 }
 
 void Scene::Impl::Render(Device* device) {
-  auto index = device->backBufferIndex();
+  // フレームごとに書き換えるバッファは、GPUが使い終わったスロットのものを使う
+  auto index = device->frameIndex();
 
-  lightingShader_->Begin(device->graphicsCommandList());
+  // ロードの終わったテクスチャがあればダミーから差し替え
+  UpdatePendingTextures(device);
+
+  // ストリーミングのミップが変わっていればSRVを差し替え
+  UpdateStreamingTextures(device);
 
   // SceneParam転送
   {
@@ -525,116 +992,521 @@ void Scene::Impl::Render(Device* device) {
 
 	  sceneParamCb_[index]->Update(&sceneParam_,
 		  sizeof(LightingShader::SceneParam));
-
-	  lightingShader_->SetSceneParam(
-		  sceneParamCb_[index]->resource()->GetGPUVirtualAddress());
   }
 
   // マテリアル転送
-  for (auto& mat : materials_) {
-	  mat.second->Update(index);
+  if (lightingShader_->bindless()) {
+	  // バインドレスではテクスチャのテーブルとマテリアルのバッファを
+	  // 最初に1回渡すだけで、描画ごとにはマテリアルの番号しか変えない
+	  UpdateMaterialBuffer(index);
+  } else {
+	  for (auto& mat : materials_) {
+		  mat.second->Update(index);
+	  }
   }
 
   // オブジェクト描画
-  for (auto& obj : renderObjs_) {
-	  LightingShader::ObjectParam param{};
-	  XMStoreFloat4x4(&param.world, XMMatrixTranspose(obj->transform.world));
-	  XMStoreFloat4x4(&param.texTrans,
-		  XMMatrixTranspose(obj->transform.texTrans));
+  // 見えるものだけを、設定の切り替えが少なく手前から描かれるようにキーの順に描く
+  CullObjects();
+  OccludeObjects();
+  BuildDrawPackets();
+  if (lightingShader_->objectBuffer()) {
+	  BuildInstanceBatches(index);
+  }
+  RecordDraws(device, index);
 
-	  // バッファ転送
-	  auto& cbuffer = obj->transCb[index];
-	  cbuffer->Update(&param, sizeof(LightingShader::ObjectParam));
+  // このフレームで返したデスクリプタは、GPUが終えてから再利用される
+  srvHeap_.EndFrame();
+  samplerCache_.EndFrame();
+};
 
-	  // 定数バッファ・テクスチャなどの設定
-	  {
-		  lightingShader_->SetObjectParam(
-			  cbuffer->resource()->GetGPUVirtualAddress());
+void Scene::Impl::BuildObjectBvh() {
+  objectBvh_.Clear();
+  for (std::uint32_t i = 0; i < renderObjs_.size(); ++i) {
+    auto& obj = renderObjs_[i];
+    obj->bvhProxy = objectBvh_.Insert(ComputeWorldBounds(*obj), i);
+  }
+  // 1つずつ入れた木より、まとめて分けた木のほうが調べる節が少ない
+  objectBvh_.Rebuild();
+}
 
-		  lightingShader_->SetMaterialParam(obj->material->materialCb(index));
+void Scene::Impl::UpdateObjectBounds(std::uint32_t index) {
+  if (!EnableBvh_) {
+    return;  // BVHなしなら毎フレーム全部作るので何もしない
+  }
+  const auto& obj = renderObjs_[index];
+  objectBvh_.Update(obj->bvhProxy, ComputeWorldBounds(*obj));
+}
 
-		  // テクスチャがあれば設定
-		  if (obj->material->HasTexture()) {
-			  ID3D12DescriptorHeap* srv = nullptr;
-			  std::uint32_t srvOffset = 0;
-			  obj->material->textureDescHeap(&srv, &srvOffset);
+void Scene::Impl::CullObjects() {
+  // カリングしないときは、どれも内側になる平面にしておく
+  auto frustum = Frustum{};
+  if (EnableFrustumCulling_) {
+    XMFLOAT4X4 viewProj{};
+    XMStoreFloat4x4(&viewProj, camera_.view() * camera_.proj());
+    frustum = ExtractFrustum(viewProj.m);
+  } else {
+    for (auto& plane : frustum.planes) {
+      plane = {0.0f, 0.0f, 0.0f, 1.0f};
+    }
+  }
 
-			  lightingShader_->SetSrvDescriptorHeap(srv, srvOffset);
-			  lightingShader_->SetSamplerDescriptorHeap(samplerHeap_.Get(), 0);
-		  }
-	  }
-	  // コマンドリスト発行
-	  lightingShader_->Apply();
+  visibleObjects_.clear();
+  if (EnableBvh_) {
+    // 全部外や全部内の節より下は見ないので、静的なものが多くても速い
+    objectBvh_.QueryFrustum(frustum, &visibleObjects_);
+    return;
+  }
 
-	  // メッシュ描画コマンド発行
-	  obj->mesh->Draw(device->graphicsCommandList());
+  const auto count = static_cast<std::uint32_t>(renderObjs_.size());
+  objectBounds_.Resize(count);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    const auto box = ComputeWorldBounds(*renderObjs_[i]);
+    objectBounds_.Set(i, (box.minX + box.maxX) * 0.5f,
+                      (box.minY + box.maxY) * 0.5f,
+                      (box.minZ + box.maxZ) * 0.5f,
+                      (box.maxX - box.minX) * 0.5f,
+                      (box.maxY - box.minY) * 0.5f,
+                      (box.maxZ - box.minZ) * 0.5f);
   }
-  lightingShader_->End();
-};
 
-void Scene::Impl::CreateSamplerHeap(Device* device) {
-  auto dev = device->device();
+  // 数が多ければ描画を積むスレッドで分けて調べる
+  frustumCuller_.Cull(frustum, objectBounds_, &recordWorkers_);
+  visibleObjects_ = frustumCuller_.visible();
+}
 
-  // サンプラー用のデスクリプタヒープを作る
-  D3D12_DESCRIPTOR_HEAP_DESC heapDesc{
-      D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER,  //ヒープタイプはサンプラ
-      1,                                   // 作るのは1個
-      D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE,  // シェーダから見える設定
-      0};                                         // 0でOK
-  dev->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&samplerHeap_));
+void Scene::Impl::OccludeObjects() {
+  if (!EnableOcclusionCulling_) {
+    return;
+  }
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+
+  XMFLOAT4X4 viewProj{};
+  XMStoreFloat4x4(&viewProj, camera_.view() * camera_.proj());
+  occlusionBuffer_.BeginFrame(viewProj.m);
+
+  // 見えている遮蔽物だけを描く
+  auto stats = OcclusionStats{};
+  for (const auto i : visibleObjects_) {
+    const auto& obj = renderObjs_[i];
+    if (!obj->occluder) {
+      continue;
+    }
+    XMFLOAT4X4 world{};
+    XMStoreFloat4x4(&world, obj->transform.world);
+    const auto& positions = obj->mesh->positions();
+    const auto& indices = obj->mesh->indices();
+    stats.occluderTriangles += occlusionBuffer_.AddOccluder(
+        &positions.data()->x, sizeof(XMFLOAT3), indices.data(),
+        static_cast<std::uint32_t>(indices.size()), world.m);
+  }
+  // タイルごとに描画を積むスレッドで分けて描く
+  occlusionBuffer_.Rasterize(&recordWorkers_);
+  const auto rasterized = Clock::now();
+
+  // 遮蔽物そのものは調べない
+  auto end = std::remove_if(
+      visibleObjects_.begin(), visibleObjects_.end(), [&](std::uint32_t i) {
+        const auto& obj = *renderObjs_[i];
+        if (obj.occluder) {
+          return false;
+        }
+        ++stats.testedObjects;
+        return occlusionBuffer_.IsOccluded(ComputeWorldBounds(obj));
+      });
+  stats.occludedObjects =
+      static_cast<std::uint32_t>(visibleObjects_.end() - end);
+  visibleObjects_.erase(end, visibleObjects_.end());
+
+  const auto finished = Clock::now();
+  stats.rasterizeMs =
+      std::chrono::duration<double, std::milli>(rasterized - start).count();
+  stats.testMs =
+      std::chrono::duration<double, std::milli>(finished - rasterized).count();
+  occlusionStats_ = stats;
+}
 
-  // サンプラーの設定を作る
-  // テクスチャ補間の設定やテクスチャアドレッシング設定
-  D3D12_SAMPLER_DESC samplerDesc{};
-  // テクスチャフィルタ
-  samplerDesc.Filter =
-      D3D12_ENCODE_BASIC_FILTER(D3D12_FILTER_TYPE_LINEAR,  // 縮小時
-                                D3D12_FILTER_TYPE_LINEAR,  // 拡大時
-                                D3D12_FILTER_TYPE_LINEAR,  // mipmap
-                                D3D12_FILTER_REDUCTION_TYPE_STANDARD);
-  // テクスチャアドレッシング
-  samplerDesc.AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-  samplerDesc.AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-  samplerDesc.AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-  samplerDesc.MaxLOD = FLT_MAX;
-  samplerDesc.MinLOD = -FLT_MAX;
-  samplerDesc.ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER;
+void Scene::Impl::BuildDrawPackets() {
+  // パスは不透明の1つ、パイプラインはLightingShaderの1つだけなので番号は0
+  const auto view = camera_.view();
+  const auto nearZ = camera_.nearZ();
+  const auto farZ = camera_.farZ();
+  drawPackets_.clear();
+  drawPackets_.reserve(visibleObjects_.size());
+  for (const auto i : visibleObjects_) {
+    const auto& obj = renderObjs_[i];
+    // ワールド行列の4行目がオブジェクトの位置
+    const auto viewPos =
+        XMVector3TransformCoord(obj->transform.world.r[3], view);
+    const auto depth = QuantizeDepth(XMVectorGetZ(viewPos), nearZ, farZ);
+    const auto key = MakeDrawSortKey(0, 0, obj->material->sortId(),
+                                     obj->meshId, depth);
+    drawPackets_.push_back({key, i});
+  }
+  drawPacketSorter_.Sort(&drawPackets_);
+}
+
+void Scene::Impl::BuildInstanceBatches(std::uint32_t index) {
+  instanceBatcher_.Build(drawPackets_);
+
+  // インスタンスの順にオブジェクトのデータを詰める
+  // マップは1回で全部のオブジェクトを書く
+  auto& buffer = objectBuffers_[index];
+  auto params = static_cast<LightingShader::ObjectParam*>(buffer->Map());
+  const auto& instanceObjects = instanceBatcher_.instanceObjects();
+  for (std::size_t i = 0; i < instanceObjects.size(); ++i) {
+    params[i] = MakeObjectParam(renderObjs_[instanceObjects[i]]->transform);
+  }
+  buffer->Unmap();
+}
+
+void Scene::Impl::RecordDraws(Device* device, std::uint32_t index) {
+  const auto drawCount = static_cast<std::uint32_t>(
+      lightingShader_->objectBuffer() ? instanceBatcher_.batches().size()
+                                      : drawPackets_.size());
+
+  // 描画が少ないうちはリストを分けるほうが遅いので、
+  // 1本にMinDrawsPerCommandList_個以上入るだけの本数にする
+  const auto listCount = std::min(
+      recordWorkers_.threadCount(),
+      std::max(1u, drawCount / MinDrawsPerCommandList_));
+  if (listCount <= 1) {
+    // Deviceのコマンドリストにそのまま積む
+    RecordDrawRange(shaderContexts_[0].get(), device->graphicsCommandList(),
+                    0, drawCount, index);
+    return;
+  }
+
+  // 前から同じ数ずつ分けて、スレッドごとに別のリストに積む
+  const auto step = (drawCount + listCount - 1) / listCount;
+  recordWorkers_.Run(listCount, [&](std::uint32_t list) {
+    const auto begin = std::min(drawCount, list * step);
+    const auto end = std::min(drawCount, begin + step);
+    auto commandList = commandListPool_.Begin(list, index);
+    // レンダーターゲットなどはリストをまたいで引き継がれないので積みなおす
+    SetRenderTarget(device, commandList);
+    RecordDrawRange(shaderContexts_[list].get(), commandList, begin, end,
+                    index);
+    commandListPool_.End(list);
+  });
+
+  // 分けた順に実行すれば1本で積んだときと同じ順に描かれる
+  // Deviceのコマンドリスト(クリアなど)の後、1回のExecuteCommandListsで送られる
+  for (std::uint32_t list = 0; list < listCount; ++list) {
+    device->QueueCommandList(commandListPool_.commandList(list));
+  }
+}
+
+void Scene::Impl::RecordDrawRange(LightingShader::Context* context,
+                                  ID3D12GraphicsCommandList* commandList,
+                                  std::uint32_t begin, std::uint32_t end,
+                                  std::uint32_t index) {
+  context->Begin(commandList);
+
+  // フレームで変わらないもの
+  context->SetSceneParam(
+      sceneParamCb_[index]->resource()->GetGPUVirtualAddress());
+  if (lightingShader_->bindless()) {
+    context->SetMaterialBuffer(
+        materialBuffers_[index]->resource()->GetGPUVirtualAddress());
+    context->SetTextureTable(srvHeap_.heap(), 0);
+  }
+
+  if (lightingShader_->objectBuffer()) {
+    context->SetObjectBuffer(
+        objectBuffers_[index]->resource()->GetGPUVirtualAddress());
+
+    // まとめた描画ごとに渡すのは先頭のインスタンスの番号だけ
+    // シェーダはそこからSV_InstanceID個先のデータを読む
+    const auto& batches = instanceBatcher_.batches();
+    const auto& instanceObjects = instanceBatcher_.instanceObjects();
+    for (auto i = begin; i < end; ++i) {
+      const auto& batch = batches[i];
+      const auto& first = renderObjs_[instanceObjects[batch.firstInstance]];
+      context->SetObjectIndex(batch.firstInstance);
+      SetMaterial(context, first->material, index);
+      context->Apply();
+
+      first->mesh->Draw(commandList, batch.instanceCount);
+    }
+  } else {
+    for (auto i = begin; i < end; ++i) {
+      auto& obj = renderObjs_[drawPackets_[i].object];
+
+      // バッファ転送
+      // オブジェクトごとに別のバッファなので、ほかのスレッドと重ならない
+      auto param = MakeObjectParam(obj->transform);
+      auto& cbuffer = obj->transCb[index];
+      cbuffer->Update(&param, sizeof(LightingShader::ObjectParam));
+
+      // 定数バッファ・テクスチャなどの設定
+      context->SetObjectParam(cbuffer->resource()->GetGPUVirtualAddress());
+      SetMaterial(context, obj->material, index);
+
+      // コマンドリスト発行
+      context->Apply();
 
-  auto handleSampler = CD3DX12_CPU_DESCRIPTOR_HANDLE(
-      samplerHeap_->GetCPUDescriptorHandleForHeapStart(),
-      0,  // 1個しかないので決め打ちでよい
-      device->samplerDesctiptorSize());
+      // メッシュ描画コマンド発行
+      obj->mesh->Draw(commandList);
+    }
+  }
 
-  // サンプラー生成
-  dev->CreateSampler(&samplerDesc, handleSampler);
+  context->End();
+}
+
+void Scene::Impl::SetRenderTarget(Device* device,
+                                  ID3D12GraphicsCommandList* commandList) {
+  auto rtv = device->currentRenderTargetView();
+  auto dsv = device->depthStencilView();
+  commandList->OMSetRenderTargets(1, &rtv, FALSE, &dsv);
+
+  auto viewport = device->screenViewport();
+  commandList->RSSetViewports(1, &viewport);
+
+  auto scissorRect = device->scissorRect();
+  commandList->RSSetScissorRects(1, &scissorRect);
+}
+
+void Scene::Impl::SetMaterial(LightingShader::Context* context,
+                              Material* material, std::uint32_t index) {
+  if (lightingShader_->bindless()) {
+    context->SetMaterialIndex(material->bindlessIndex());
+    context->SetSamplerDescriptorHeap(samplerCache_.heap(),
+                                      material->sampler().index);
+    return;
+  }
+
+  context->SetMaterialParam(material->materialCb(index));
+
+  // テクスチャがあれば設定
+  if (material->HasTexture()) {
+    ID3D12DescriptorHeap* srv = nullptr;
+    std::uint32_t srvOffset = 0;
+    material->textureDescHeap(&srv, &srvOffset);
+
+    context->SetSrvDescriptorHeap(srv, srvOffset);
+    context->SetSamplerDescriptorHeap(samplerCache_.heap(),
+                                      material->sampler().index);
+  }
+}
+
+void Scene::Impl::CreateSamplerHeap(Device* device) {
+  // サンプラー用のデスクリプタヒープを作る
+  // シェーダから見えるサンプラのヒープは2048個までなので小さめ
+  samplerCache_.Initialize(device, 16);
+
+  // デフォルトのサンプラ。マテリアルも同じ設定なら同じものを使う
+  defaultSampler_ = samplerCache_.Acquire(DefaultSamplerDesc());
 }
 
 void Scene::Impl::CreateCbvSrvHeap(Device* device) {
-  auto dev = device->device();
+  srvHeap_.Initialize(device, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+                      PersistentSrvCount_, TransientSrvCount_, true,
+                      L"Scene::CbvSrvHeap");
+}
 
-  D3D12_DESCRIPTOR_HEAP_DESC heapDesc{
-      D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
-      2048,  // とりあえずいっぱい作っておきますね
-      D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE, 0};
-  dev->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&cbvSrvHeap_));
+void Scene::Impl::CreateMaterialBuffer(Device* device) {
+  bindlessMaterials_.clear();
+  for (auto& mat : materials_) {
+    mat.second->SetBindlessIndex(
+        static_cast<std::uint32_t>(bindlessMaterials_.size()));
+    bindlessMaterials_.push_back(mat.second.get());
+  }
+
+  // マテリアルは点滅したりするのでダブルバッファ化
+  const auto size =
+      sizeof(Material::MaterialParameter) * bindlessMaterials_.size();
+  materialBuffers_.resize(device->frameCount());
+  for (auto& buffer : materialBuffers_) {
+    buffer = std::make_unique<BufferObject>();
+    if (!buffer->Initialize(device->device(), BufferObjectType::StructuredBuffer,
+                            size)) {
+      throw std::runtime_error("Scene::CreateMaterialBuffer Failed");
+    }
+  }
 }
 
-void Scene::Impl::CreateSrv(Device* device, ID3D12Resource* tex,
-                            D3D12_CPU_DESCRIPTOR_HANDLE handle, int offset) {
-  auto handleSRV = CD3DX12_CPU_DESCRIPTOR_HANDLE(
-      handle, offset,
-      device->srvDescriptorSize());  // SRVデスクリプタサイズ
+void Scene::Impl::UpdateMaterialBuffer(std::uint32_t index) {
+  // マップは1回で全部のマテリアルを書く
+  auto params =
+      static_cast<Material::MaterialParameter*>(materialBuffers_[index]->Map());
+  for (const auto mat : bindlessMaterials_) {
+    params[mat->bindlessIndex()] = mat->parameter();
+  }
+  materialBuffers_[index]->Unmap();
+}
+
+void Scene::Impl::CreateObjectBuffer(Device* device) {
+  const auto size = sizeof(LightingShader::ObjectParam) * renderObjs_.size();
+  objectBuffers_.resize(device->frameCount());
+  for (auto& buffer : objectBuffers_) {
+    buffer = std::make_unique<BufferObject>();
+    if (!buffer->Initialize(device->device(), BufferObjectType::StructuredBuffer,
+                            size)) {
+      throw std::runtime_error("Scene::CreateObjectBuffer Failed");
+    }
+  }
+}
 
+void Scene::Impl::CreateSrv(Device* device, ID3D12Resource* tex,
+                            D3D12_CPU_DESCRIPTOR_HANDLE handle,
+                            std::uint32_t mostDetailedMip) {
   // SRV設定
+  // シェーダは配列で受けるので、まとめていないテクスチャも要素1個の配列にする
   D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
-  srvDesc.Texture2D.MipLevels =
-      tex->GetDesc().MipLevels;            // テクスチャと合わせる
+  // ストリーミングでまだ常駐していないミップは見せない
+  // MinLODClampも合わせておくとサンプラがそれより細かいミップを選ばない
+  srvDesc.Texture2DArray.MostDetailedMip = mostDetailedMip;
+  srvDesc.Texture2DArray.MipLevels =
+      tex->GetDesc().MipLevels - mostDetailedMip;  // テクスチャと合わせる
+  srvDesc.Texture2DArray.ArraySize = tex->GetDesc().DepthOrArraySize;
+  srvDesc.Texture2DArray.ResourceMinLODClamp =
+      static_cast<float>(mostDetailedMip);
   srvDesc.Format = tex->GetDesc().Format;  // テクスチャと合わせる
-  srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+  srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
   srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 
   // SRV生成
-  device->device()->CreateShaderResourceView(tex, &srvDesc, handleSRV);
+  device->device()->CreateShaderResourceView(tex, &srvDesc, handle);
+}
+
+void Scene::Impl::BindTexture(Device* device, Material* mat,
+                              const std::string& textureName) {
+  auto& manager = Singleton<TextureManager>::instance();
+  auto ref = manager.Acquire(textureName);
+  if (ref) {
+    // ロード済みならすぐにSRVを作る
+    // 同じテクスチャ(配列)のSRVがもうあればそれを使う
+    // ストリーミングしているなら常駐しているミップまでに制限する
+    const auto t = ref.resource();
+    const auto mip = manager.streamingMinLod(textureName);
+    const auto it = textureSrvOffsets_.find(t.Get());
+    std::uint32_t index = 0;
+    if (it != std::end(textureSrvOffsets_)) {
+      index = it->second;
+    } else {
+      const auto srv = srvHeap_.Allocate();
+      if (!srv.IsValid()) {
+        // ヒープがいっぱいならダミーのまま
+        mat->SetTexture(srvHeap_.heap(), dummySrv_.index);
+        return;
+      }
+      CreateSrv(device, t.Get(), srv.cpu, mip);
+      index = srv.index;
+      textureSrvOffsets_.emplace(t.Get(), index);
+    }
+    textureRefs_.push_back(std::move(ref));
+    mat->SetTexture(srvHeap_.heap(), index, manager.textureSlice(textureName));
+    // 毎フレーム必要なミップを伝えるので、ストリーミングするものだけ覚えておく
+    if (EnableTextureStreaming_ && manager.IsStreaming(textureName)) {
+      streamingBindings_.push_back({mat, textureName, mip, {}});
+    }
+    return;
+  }
+
+  // ロード中はダミーを見せておく。SRVの位置は先に取っておく
+  mat->SetTexture(srvHeap_.heap(), dummySrv_.index);
+  pendingTextures_.push_back(
+      {textureRequests_[textureName], mat, srvHeap_.Allocate()});
+}
+
+void Scene::Impl::UpdatePendingTextures(Device* device) {
+  auto it = std::begin(pendingTextures_);
+  while (it != std::end(pendingTextures_)) {
+    if (it->handle.IsReady()) {
+      // まだ誰も参照していない位置にSRVを作ってから差し替えるので描画中でも安全
+      // 予算を超えてすでに破棄されていたらダミーのまま
+      // 配列にまとめたものは要素の位置、ストリーミングは常駐しているミップも見る
+      auto& manager = Singleton<TextureManager>::instance();
+      const auto& textureName = it->handle.assetName();
+      auto ref = manager.Acquire(textureName);
+      if (ref && it->srv.IsValid()) {
+        // 同じテクスチャのSRVがもうあれば、取っておいた位置は返す
+        const auto t = ref.resource();
+        const auto mip = manager.streamingMinLod(textureName);
+        const auto slice = manager.textureSlice(textureName);
+        const auto found = textureSrvOffsets_.find(t.Get());
+        if (found != std::end(textureSrvOffsets_)) {
+          it->material->SetTexture(srvHeap_.heap(), found->second, slice);
+          srvHeap_.Free(it->srv);
+        } else {
+          CreateSrv(device, t.Get(), it->srv.cpu, mip);
+          it->material->SetTexture(srvHeap_.heap(), it->srv.index, slice);
+          textureSrvOffsets_.emplace(t.Get(), it->srv.index);
+        }
+        textureRefs_.push_back(std::move(ref));
+        if (EnableTextureStreaming_ && manager.IsStreaming(textureName)) {
+          streamingBindings_.push_back({it->material, textureName, mip, {}});
+        }
+      } else {
+        srvHeap_.Free(it->srv);
+      }
+      it = pendingTextures_.erase(it);
+    } else if (it->handle.IsDone()) {
+      // 失敗・キャンセルならダミーのまま
+      srvHeap_.Free(it->srv);
+      it = pendingTextures_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void Scene::Impl::UpdateStreamingTextures(Device* device) {
+  if (streamingBindings_.empty()) {
+    return;
+  }
+  auto& manager = Singleton<TextureManager>::instance();
+
+  // オブジェクトの画面上の大きさから必要なミップを伝える
+  // 球で近似して、直径が画面の何ピクセルになるかをテクスチャの大きさとみなす
+  // マテリアルごとに一番大きいものだけ覚えて、テクスチャごとに1回だけ伝える
+  {
+    const auto eyePos = camera_.position();
+    const auto eye = XMLoadFloat3(&eyePos);
+    XMFLOAT4X4 proj{};
+    XMStoreFloat4x4(&proj, camera_.proj());
+    const auto viewportHeight = device->screenViewport().Height;
+    materialScreenPixels_.assign(materials_.size(), 0.0f);
+    for (auto& obj : renderObjs_) {
+      // ワールド行列の4行目がオブジェクトの位置
+      const auto distance = std::max(
+          XMVectorGetX(XMVector3Length(obj->transform.world.r[3] - eye)),
+          0.1f);
+      const auto screenPixels =
+          ObjectRadius_ * proj._22 * viewportHeight / distance;
+      auto& pixels = materialScreenPixels_[obj->material->sortId()];
+      pixels = std::max(pixels, screenPixels);
+    }
+    for (const auto& binding : streamingBindings_) {
+      const auto pixels = materialScreenPixels_[binding.material->sortId()];
+      if (pixels > 0.0f) {
+        manager.RequestStreamingMip(binding.textureName, pixels);
+      }
+    }
+  }
+
+  // 使えるミップが変わったら新しい位置にSRVを作って差し替える
+  // 描画中のSRVは書き換えない。前の位置はFreeで返し、
+  // GPUが使い終わってから空きリストで再利用される
+  for (auto& binding : streamingBindings_) {
+    const auto mip = manager.streamingMinLod(binding.textureName);
+    if (mip == binding.appliedMip) {
+      continue;
+    }
+    auto srv = srvHeap_.Allocate();
+    if (!srv.IsValid()) {
+      continue;  // 空くまで今のミップのまま
+    }
+    auto t = manager.texture(binding.textureName);
+    CreateSrv(device, t.Get(), srv.cpu, mip);
+    binding.material->SetTexture(srvHeap_.heap(), srv.index,
+                                 manager.textureSlice(binding.textureName));
+    srvHeap_.Free(binding.srv);
+    binding.srv = srv;
+    binding.appliedMip = mip;
+  }
 }
 
 void Scene::Impl::CreateBufferObject(std::unique_ptr<BufferObject>& buffer,
@@ -661,7 +1533,9 @@ void Scene::Impl::CreateBufferView(std::unique_ptr<BufferObject>& buffer,
 
 void Scene::Impl::CreateRenderObj(Device* device)
 {
-	auto bufferSize = device->backBufferSize();
+	// オブジェクトバッファならオブジェクトごとの定数バッファはいらない
+	auto bufferSize =
+		lightingShader_->objectBuffer() ? 0 : device->frameCount();
 	// とりあえずティーポットを1個だけ作るよ
 	{
 		auto teapot = std::make_unique<RenderObject>();
@@ -674,6 +1548,8 @@ void Scene::Impl::CreateRenderObj(Device* device)
 		}
 		// マテリアルを設定
 		teapot->material = materials_.at("travertine").get();
+		// 真ん中にあって大きいので、後ろのものを隠す遮蔽物にする
+		teapot->occluder = true;
 		renderObjs_.emplace_back(std::move(teapot));
 	}
 
@@ -766,43 +1642,28 @@ void Scene::Impl::CreateMaterial(Device* device)
  // とりあえずすべてマテリアルはデフォルトパラメータ
  // テクスチャだけが違う状態
 
-	int offset = 0; // デスクリプタヒープの位置
 	{
-		auto t = Singleton<TextureManager>::instance().texture("uv_checker");
-
-		CreateSrv(device, t.Get(),
-			cbvSrvHeap_->GetCPUDescriptorHandleForHeapStart(), offset);
 		auto mat = std::make_unique<Material>();
 		mat->Initialize(device);
-		mat->SetTexture(cbvSrvHeap_.Get(), offset);
+		BindTexture(device, mat.get(), "uv_checker");
 
 		materials_.emplace("uv_checker", std::move(mat));
-		offset++;
 	}
 
 	//	bricks
 	{
-		auto t = Singleton<TextureManager>::instance().texture("bricks");
-
-		CreateSrv(device, t.Get(),
-			cbvSrvHeap_->GetCPUDescriptorHandleForHeapStart(), offset);
 		auto mat = std::make_unique<Material>();
 		mat->Initialize(device);
-		mat->SetTexture(cbvSrvHeap_.Get(), offset);
+		BindTexture(device, mat.get(), "bricks");
 
 		materials_.emplace("bricks", std::move(mat));
-		offset++;
 	}
 
 	//	fabric
 	{
-		auto t = Singleton<TextureManager>::instance().texture("fabric");
-
-		CreateSrv(device, t.Get(),
-			cbvSrvHeap_->GetCPUDescriptorHandleForHeapStart(), offset);
 		auto mat = std::make_unique<Material>();
 		mat->Initialize(device);
-		mat->SetTexture(cbvSrvHeap_.Get(), offset);
+		BindTexture(device, mat.get(), "fabric");
 
 #pragma region 追記
 		mat->SetRoughness(0.9f);
@@ -811,80 +1672,55 @@ void Scene::Impl::CreateMaterial(Device* device)
 
 
 		materials_.emplace("fabric", std::move(mat));
-		offset++;
 	}
 
 	//	grass
 	{
-		auto t = Singleton<TextureManager>::instance().texture("grass");
-
-		CreateSrv(device, t.Get(),
-			cbvSrvHeap_->GetCPUDescriptorHandleForHeapStart(), offset);
 		auto mat = std::make_unique<Material>();
 		mat->Initialize(device);
-		mat->SetTexture(cbvSrvHeap_.Get(), offset);
+		BindTexture(device, mat.get(), "grass");
 
 		materials_.emplace("grass", std::move(mat));
-		offset++;
 	}
 
 	//	travertine
 	{
-		auto t = Singleton<TextureManager>::instance().texture("travertine");
-
-		CreateSrv(device, t.Get(),
-			cbvSrvHeap_->GetCPUDescriptorHandleForHeapStart(), offset);
 		auto mat = std::make_unique<Material>();
 		mat->Initialize(device);
-		mat->SetTexture(cbvSrvHeap_.Get(), offset);
+		BindTexture(device, mat.get(), "travertine");
 
 		materials_.emplace("travertine", std::move(mat));
-		offset++;
 	}
 
 #pragma region 課題
 	//sample1
 	{
-		auto t = Singleton<TextureManager>::instance().texture("travertine");
-
-		CreateSrv(device, t.Get(),
-			cbvSrvHeap_->GetCPUDescriptorHandleForHeapStart(), offset);
 		auto mat = std::make_unique<Material>();
 		mat->Initialize(device);
-		mat->SetTexture(cbvSrvHeap_.Get(), offset);
+		BindTexture(device, mat.get(), "travertine");
 
 		mat->SetFresnel({ 0.1f, 0.9f, 0.1f });
 
 		materials_.emplace("sample1", std::move(mat));
-		offset++;
 	}
 
 	//sample2
 	{
-		auto t = Singleton<TextureManager>::instance().texture("travertine");
-
-		CreateSrv(device, t.Get(),
-			cbvSrvHeap_->GetCPUDescriptorHandleForHeapStart(), offset);
 		auto mat = std::make_unique<Material>();
 		mat->Initialize(device);
-		mat->SetTexture(cbvSrvHeap_.Get(), offset);
+		BindTexture(device, mat.get(), "travertine");
 
 		mat->SetDiffuseAlbedo({ 0.2f, 0.2f, 0.2f ,1.0f });
 
 		materials_.emplace("sample2", std::move(mat));
-		offset++;
 	}
 
 	//追加マテリアル1
 	{
-		auto t = Singleton<TextureManager>::instance().texture("uv_checker");
-		CreateSrv(device, t.Get(),
-			cbvSrvHeap_->GetCPUDescriptorHandleForHeapStart(), offset);
 		auto mat = std::make_unique<Material>();
 		mat->Initialize(device);
-		mat->SetTexture(cbvSrvHeap_.Get(), offset);
+		BindTexture(device, mat.get(), "uv_checker");
 		materials_.emplace("add_mat", std::move(mat));
-		offset++;
 	}
 #pragma endregion
 
@@ -896,6 +1732,19 @@ void Scene::Impl::CreateMaterial(Device* device)
 	}
 #pragma endregion
 
+	// サンプラは設定で頼む。同じ設定ならSamplerCacheが同じ位置を返す
+	for (auto& it : materials_)
+	{
+		it.second->SetSampler(samplerCache_.Acquire(DefaultSamplerDesc()));
+	}
+
+	// 描画の並べ替えのキーに入れる番号
+	std::uint32_t sortId = 0;
+	for (auto& it : materials_)
+	{
+		it.second->SetSortId(sortId++);
+	}
+
 }
 
 //-------------------------------------------------------------------
@@ -912,4 +1761,8 @@ void Scene::Update(float deltaTime) { impl_->Update(deltaTime); };
 
 void Scene::Render(Device* device) { impl_->Render(device); };
 
+const OcclusionStats& Scene::occlusionStats() const {
+  return impl_->occlusionStats();
+}
+
 }  // namespace dxapp
@@ -2,6 +2,7 @@
 
 namespace dxapp {
 class Device;
+struct OcclusionStats;
 
 class Scene {
  public:
@@ -35,6 +36,12 @@ class Scene {
    */
   void Render(Device* device);
 
+  /*
+   * @brief 直前のフレームの遮蔽カリングの結果
+   * @details 隠れていて外したオブジェクトの数や、かかった時間を見るのに使う
+   */
+  const OcclusionStats& occlusionStats() const;
+
  private:
   class Impl; //!< 内部実装クラス
   std::unique_ptr<Impl> impl_;
@@ -14,16 +14,18 @@ cbuffer SceneParam : register(b1) {
 	Light Lights[NUM_DIR_LIGHT];  // s3
 };
 
-// }eA(bV̑fސݒ)̒萔obt@
-cbuffer MaterialParam : register(b2) {
-	float4 DiffuseAlbedo;  // fނ̐FƎvĂ悢
-	float3 Fresnel;        // ˌ̐F
-	float Roughness;       // \ʂ̑ei˂̋ςj
-	int useTexture;  // eNX`gptOiintȂ̂ŒӁj
-};
+// }eA(bV̑fސݒ)ShaderCommon.hlsliGetMaterialŎ
 
 // eNX`
-Texture2D<float4> Texture : register(t0);
+// eNX`͔zɂ܂Ƃ߂Ă̂ŔzŎ󂯂
+// ܂Ƃ߂ĂȂeNX`vf1̔zƂSRVĂ
+#if BINDLESS
+// oChXł͑S̃eNX`SRV1̃e[uŎ󂯂āA
+// ǂg̓}eAtextureIndexőI
+Texture2DArray<float4> Textures[] : register(t0, space1);
+#else
+Texture2DArray<float4> Texture : register(t0);
+#endif
 // Tv
 sampler Sampler : register(s0);
 
@@ -97,15 +99,27 @@ float4 ComputeLighting(Light lights[NUM_DIR_LIGHT], Material mat, float3 pos,
 	return float4(result, 0.0f);
 }
 
+// }eÃeNX`TvO
+float4 SampleTexture(MaterialData material, float2 uv) {
+	float3 location = float3(uv, material.textureSlice);
+#if BINDLESS
+	// 1̕`̒ł̓}eA͓Ȃ̂NonUniformResourceIndex͂Ȃ
+	return Textures[material.textureIndex].Sample(Sampler, location);
+#else
+	return Texture.Sample(Sampler, location);
+#endif
+}
+
 // CeBOsNZVF[_[
 float4 main(VSOutputLitTex pIn) : SV_TARGET{
+	MaterialData material = GetMaterial();
 	// gUːF({ƂȂF)
-	float4 diffuse = DiffuseAlbedo;
+	float4 diffuse = material.diffuseAlbedo;
 	// VF[_łifgB
 	// ܂gƘIɒxȂ
-	if (useTexture != 0) {
+	if (material.useTexture != 0) {
 		// eNX`Fƃ}eAJ[
-		diffuse = Texture.Sample(Sampler, pIn.uv) * DiffuseAlbedo;
+		diffuse = SampleTexture(material, pIn.uv) * material.diffuseAlbedo;
 	  }
 
 	// Z
@@ -117,9 +131,9 @@ float4 main(VSOutputLitTex pIn) : SV_TARGET{
 	float3 eyeVec = normalize(EyePos - pIn.posW);
 
 	// Px
-	float shininess = 1.0f - Roughness;
+	float shininess = 1.0f - material.roughness;
 	// }eA
-	Material mat = {diffuse, Fresnel, shininess};
+	Material mat = {diffuse, material.fresnel, shininess};
 
 	// CeBO
 	float3 shadowFactor = 1.0f;
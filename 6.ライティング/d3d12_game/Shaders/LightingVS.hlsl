@@ -2,11 +2,7 @@
 
 // ͒萔obt@Rg
 
-// IuWFNgPʂ̒萔obt@
-cbuffer ObjectParam : register(b0) {
-	float4x4 World;     // [hs
-	float4x4 TexTrans;  // UṼgXtH[p
-};
+// IuWFNgPʂ̃f[^ShaderCommon.hlsliGetObjectDataŎ
 
 // V[Pʂ̒萔obt@
 cbuffer SceneParam : register(b1) {
@@ -21,34 +17,28 @@ cbuffer SceneParam : register(b1) {
 };
 
 //ۑ5
-// }eA(bV̑fސݒ)̒萔obt@
-cbuffer MaterialParam : register(b2) {
-	float4 DiffuseAlbedo;  // fނ̐FƎvĂ悢
-	float3 Fresnel;        // ˌ̐F
-	float Roughness;       // \ʂ̑ei˂̋ςj
-
-	// ACgIɂɒǉ̂ǂ
-	float4x4 MatTrans;  // <=  I}eAgXtH[
-
-	int useTexture;  // eNX`gptOiintȂ̂ŒӁj
-};
+// }eA(bV̑fސݒ)ShaderCommon.hlsliGetMaterialŎ
+// }eAgXtH[MaterialData::matTrans
 
-VSOutputLitTex main(VSInputPCNT vIn) {
+// instanceId̓CX^VOŉڂ̃CX^X
+VSOutputLitTex main(VSInputPCNT vIn, uint instanceId : SV_InstanceID) {
 	VSOutputLitTex vOut = (VSOutputLitTex)0;
+	ObjectData objectData = GetObjectData(instanceId);
+	MaterialData material = GetMaterial();
 
 	// _[JifOjW烏[hWɕϊ
-	float4 posW = mul(float4(vIn.pos, 1.0f), World);
+	float4 posW = mul(float4(vIn.pos, 1.0f), objectData.world);
 	vOut.posW = posW.xyz;
 	// VPWvZ
 	vOut.posVPW = mul(posW, ViewProj);
 
 	// @[J烏[hɕϊ
-	vOut.normal = mul(vIn.normal, (float3x3)World);
+	vOut.normal = mul(vIn.normal, (float3x3)objectData.world);
 
 	// eNX`̃gXtH[
 	// UṼXN[eNX`̉]Ȃǂgĕ֗
-	float4 uv = mul(float4(vIn.uv, 0.0f, 1.0f), TexTrans);
-	uv = mul(uv, MatTrans);       // <= Iuvƃ}eAgXtH[̏Z	vOut.uv = uv.xy;  // .xyxyzw4xyn
+	float4 uv = mul(float4(vIn.uv, 0.0f, 1.0f), objectData.texTrans);
+	uv = mul(uv, material.matTrans);       // <= Iuvƃ}eAgXtH[̏Z	vOut.uv = uv.xy;  // .xyxyzw4xyn
 	vOut.uv = uv.xy;  // .xyxyzw4xyn
 	return vOut;
 }
@@ -53,4 +53,68 @@ struct Light {
 	float pad1;
 	float3 direction;  // fBNViCǧ
 	float pad2;
-};
\ No newline at end of file
+};
+
+// }eA(bV̑fސݒ)
+// C++Material::MaterialParameterƕт킹
+// 萔obt@ł\obt@łтɂȂ悤ɂĂ
+struct MaterialData {
+	float4 diffuseAlbedo;  // fނ̐FƎvĂ悢
+	float3 fresnel;        // ˌ̐F
+	float roughness;       // \ʂ̑ei˂̋ςj
+	float4x4 matTrans;     // }eAgXtH[
+	int useTexture;        // eNX`gptOiintȂ̂ŒӁj
+	int textureSlice;      // eNX`z̉Ԗڂg
+	int textureIndex;      // oChX̂ƂɎgeNX`̈ʒu
+	int pad;               // ̕т𐮂p
+};
+
+#if BINDLESS
+// oChX
+// S̃}eA1̍\obt@ɓĂA
+// `悲Ƃɂ̓[g萔ŉԖڂg炤
+StructuredBuffer<MaterialData> Materials : register(t1);
+
+cbuffer DrawParam : register(b3) {
+	uint MaterialIndex;  // Materials̉Ԗڂg
+};
+
+MaterialData GetMaterial() { return Materials[MaterialIndex]; }
+#else
+// }eA̒萔obt@
+cbuffer MaterialParam : register(b2) {
+	MaterialData MaterialConstants;
+};
+
+MaterialData GetMaterial() { return MaterialConstants; }
+#endif
+
+// IuWFNgPʂ̃f[^
+// C++LightingShader::ObjectParamƕт킹
+struct ObjectData {
+	float4x4 world;     // [hs
+	float4x4 texTrans;  // UṼgXtH[p
+};
+
+#if OBJECT_BUFFER
+// S̃IuWFNg1̍\obt@ɓĂA
+// `悲Ƃɂ̓[g萔ŉԖڂg炤
+// CX^VOł͓`̃CX^Xĕł
+StructuredBuffer<ObjectData> Objects : register(t2);
+
+cbuffer ObjectIndexParam : register(b4) {
+	uint ObjectIndex;  // Objects̉Ԗڂg
+};
+
+ObjectData GetObjectData(uint instanceId) {
+	return Objects[ObjectIndex + instanceId];
+}
+#else
+// IuWFNgPʂ̒萔obt@
+// 萔obt@ł̓CX^VOȂ̂instanceId0
+cbuffer ObjectParam : register(b0) {
+	ObjectData ObjectConstants;
+};
+
+ObjectData GetObjectData(uint instanceId) { return ObjectConstants; }
+#endif
\ No newline at end of file
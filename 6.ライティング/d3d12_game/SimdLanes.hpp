@@ -0,0 +1,111 @@
+﻿#pragma once
+// 何個ずつまとめて計算するかの違いを隠す小さな関数
+// AVX2でビルドしていれば8個ずつ、x64ならSSEで4個ずつ、それ以外は1個ずつ
+// カリングやソフトウェアラスタライザのカーネルを1つの書き方にするために使う
+// DXAPP_SIMD_SCALARを定義してビルドすると、SIMDが使えても1個ずつにする(テスト用)
+// D3D12には触らないので、Linuxでも動かして確かめられる
+#include <cstdint>
+
+#if defined(DXAPP_SIMD_SCALAR)
+// 1個ずつの版を使う
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define DXAPP_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DXAPP_SIMD_SSE 1
+#endif
+
+namespace dxapp {
+namespace simd {
+
+// 比べた結果も同じ型で持ち、全部のビットが立っていれば真
+#if defined(DXAPP_SIMD_AVX2)
+using Lanes = __m256;
+constexpr std::uint32_t LaneCount = 8;
+inline Lanes Load(const float* p) { return _mm256_loadu_ps(p); }
+inline void Store(float* p, Lanes a) { _mm256_storeu_ps(p, a); }
+inline Lanes Splat(float v) { return _mm256_set1_ps(v); }
+//! 0, 1, 2, ...
+inline Lanes Ramp() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+inline Lanes Add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+inline Lanes Sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+inline Lanes Mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+inline Lanes Min(Lanes a, Lanes b) { return _mm256_min_ps(a, b); }
+inline Lanes Max(Lanes a, Lanes b) { return _mm256_max_ps(a, b); }
+inline Lanes Negate(Lanes a) {
+  return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f));
+}
+inline Lanes GreaterEqual(Lanes a, Lanes b) {
+  return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+}
+inline Lanes Less(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline Lanes And(Lanes a, Lanes b) { return _mm256_and_ps(a, b); }
+inline Lanes AllTrue() {
+  return _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+}
+//! maskが真のレーンはa、偽はb
+inline Lanes Select(Lanes mask, Lanes a, Lanes b) {
+  return _mm256_blendv_ps(b, a, mask);
+}
+//! 各レーンの真偽を下のビットから並べたもの
+inline std::uint32_t Mask(Lanes a) {
+  return static_cast<std::uint32_t>(_mm256_movemask_ps(a));
+}
+#elif defined(DXAPP_SIMD_SSE)
+using Lanes = __m128;
+constexpr std::uint32_t LaneCount = 4;
+inline Lanes Load(const float* p) { return _mm_loadu_ps(p); }
+inline void Store(float* p, Lanes a) { _mm_storeu_ps(p, a); }
+inline Lanes Splat(float v) { return _mm_set1_ps(v); }
+inline Lanes Ramp() { return _mm_setr_ps(0, 1, 2, 3); }
+inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+inline Lanes Sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+inline Lanes Mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+inline Lanes Min(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+inline Lanes Max(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+inline Lanes Negate(Lanes a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+inline Lanes GreaterEqual(Lanes a, Lanes b) { return _mm_cmpge_ps(a, b); }
+inline Lanes Less(Lanes a, Lanes b) { return _mm_cmplt_ps(a, b); }
+inline Lanes And(Lanes a, Lanes b) { return _mm_and_ps(a, b); }
+inline Lanes AllTrue() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+// SSE2にはblendがないので、and/andnot/orで選ぶ
+inline Lanes Select(Lanes mask, Lanes a, Lanes b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+inline std::uint32_t Mask(Lanes a) {
+  return static_cast<std::uint32_t>(_mm_movemask_ps(a));
+}
+#else
+// SIMDがなければ1個ずつ。比べた結果は1か0で持つ
+struct Lanes {
+  float v;
+};
+constexpr std::uint32_t LaneCount = 1;
+inline Lanes Load(const float* p) { return {*p}; }
+inline void Store(float* p, Lanes a) { *p = a.v; }
+inline Lanes Splat(float v) { return {v}; }
+inline Lanes Ramp() { return {0.0f}; }
+inline Lanes Add(Lanes a, Lanes b) { return {a.v + b.v}; }
+inline Lanes Sub(Lanes a, Lanes b) { return {a.v - b.v}; }
+inline Lanes Mul(Lanes a, Lanes b) { return {a.v * b.v}; }
+inline Lanes Min(Lanes a, Lanes b) { return {b.v < a.v ? b.v : a.v}; }
+inline Lanes Max(Lanes a, Lanes b) { return {a.v < b.v ? b.v : a.v}; }
+inline Lanes Negate(Lanes a) { return {-a.v}; }
+inline Lanes GreaterEqual(Lanes a, Lanes b) {
+  return {a.v >= b.v ? 1.0f : 0.0f};
+}
+inline Lanes Less(Lanes a, Lanes b) { return {a.v < b.v ? 1.0f : 0.0f}; }
+inline Lanes And(Lanes a, Lanes b) {
+  return {a.v != 0.0f && b.v != 0.0f ? 1.0f : 0.0f};
+}
+inline Lanes AllTrue() { return {1.0f}; }
+inline Lanes Select(Lanes mask, Lanes a, Lanes b) {
+  return mask.v != 0.0f ? a : b;
+}
+inline std::uint32_t Mask(Lanes a) { return a.v != 0.0f ? 1 : 0; }
+#endif
+
+}  // namespace simd
+}  // namespace dxapp
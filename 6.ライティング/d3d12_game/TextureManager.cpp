@@ -4,8 +4,431 @@
 // テクスチャの読み込みにはMicrosoftさんが配布されているコードを使いますね
 #include "External/WICTextureLoader12.h"
 #include "External/DDSTextureLoader12.h"
+#include "DdsLayout.hpp"
+#include "LzContainer.hpp"
+#include "MipGenerator.hpp"
+#include "PngDecoder.hpp"
+#include "TexturePacker.hpp"
+#include "TextureRegistry.hpp"
+#include "TextureResidency.hpp"
+
+#include <cstring>
 
 namespace dxapp {
+namespace {
+/*!
+ * @brief PNGをWICを使わずにデコードしてテクスチャを作る
+ * @details 引数と戻り値はDirectX::LoadWICTextureFromMemoryに合わせてある
+ * @param[in] fileData PNGファイルの中身
+ */
+HRESULT LoadPNGTexture(ID3D12Device* device,
+                       const std::vector<std::uint8_t>& fileData,
+                       ID3D12Resource** texture,
+                       std::unique_ptr<uint8_t[]>& decodedData,
+                       D3D12_SUBRESOURCE_DATA& subresource) {
+  png::Image image{};
+  if (!png::DecodeFromMemory(fileData.data(), fileData.size(), image)) {
+    return E_FAIL;
+  }
+
+  // デコード結果はRGBA8なのでそのままテクスチャにできる
+  // WIC_LOADER_MIP_RESERVEと同じくミップの分も確保しておく
+  auto prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+  auto desc = CD3DX12_RESOURCE_DESC::Tex2D(
+      DXGI_FORMAT_R8G8B8A8_UNORM, image.width, image.height, 1,
+      static_cast<UINT16>(mip::CountMips(image.width, image.height)));
+  auto hr = device->CreateCommittedResource(
+      &prop, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_COPY_DEST,
+      nullptr, IID_PPV_ARGS(texture));
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  decodedData.reset(new uint8_t[image.pixels.size()]);
+  std::memcpy(decodedData.get(), image.pixels.data(), image.pixels.size());
+  subresource.pData = decodedData.get();
+  subresource.RowPitch = static_cast<LONG_PTR>(image.rowPitch());
+  subresource.SlicePitch =
+      static_cast<LONG_PTR>(image.rowPitch() * image.height);
+  return S_OK;
+}
+
+/*!
+ * @brief ミップを作れるフォーマットか
+ * @details 8bit x 4チャンネルならチャンネルの並びに関係なく平均できる
+ * @param[out] srgb sRGBフォーマットならtrue
+ */
+bool CanGenerateMips(DXGI_FORMAT format, bool& srgb) {
+  switch (format) {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8X8_UNORM:
+      srgb = false;
+      return true;
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+      srgb = true;
+      return true;
+    default:
+      return false;
+  }
+}
+
+/*!
+ * @brief ミップ分を確保したテクスチャがミップを作れるか確認する
+ * @details 作れないフォーマットなら、ミップ1段のテクスチャに作り直す。
+ *          中身のないミップが残るとサンプリングでゴミが見えてしまうため。
+ *          ロードのワーカーからも呼ぶので、失敗は例外にせずに返す
+ * @param[in,out] texture WIC_LOADER_MIP_RESERVEなどで作ったテクスチャ。
+ *                失敗したときは元のまま
+ * @param[out] generate ミップを作るならtrue
+ * @param[out] srgb sRGBとしてミップを作るか
+ */
+HRESULT PrepareMipTexture(ID3D12Device* device, ID3D12Resource** texture,
+                          bool& generate, bool& srgb) {
+  generate = false;
+  auto desc = (*texture)->GetDesc();
+  if (desc.MipLevels <= 1) {
+    return S_OK;
+  }
+  if (CanGenerateMips(desc.Format, srgb)) {
+    generate = true;
+    return S_OK;
+  }
+
+  desc.MipLevels = 1;
+  auto prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+  ID3D12Resource* recreated = nullptr;
+  auto hr = device->CreateCommittedResource(
+      &prop, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_COPY_DEST,
+      nullptr, IID_PPV_ARGS(&recreated));
+  if (FAILED(hr)) {
+    return hr;
+  }
+  (*texture)->Release();
+  *texture = recreated;
+  return S_OK;
+}
+
+/*!
+ * @brief mip1以降をサブリソースの後ろに並べる
+ */
+void AppendMipSubresources(const std::vector<mip::MipLevel>& mips,
+                           std::vector<D3D12_SUBRESOURCE_DATA>& subresources) {
+  for (const auto& level : mips) {
+    D3D12_SUBRESOURCE_DATA data{};
+    data.pData = level.pixels.data();
+    data.RowPitch = static_cast<LONG_PTR>(level.rowPitch());
+    data.SlicePitch = static_cast<LONG_PTR>(level.pixels.size());
+    subresources.push_back(data);
+  }
+}
+
+/*!
+ * @brief 予約リソースのタイルをヒープに割り当てる
+ * @details タイルは左上から順に並べる。heapがnullptrなら割り当てを外す
+ * @param[in] subresource 先頭のサブリソース。ミップテールなら最初のパックされたミップ
+ * @param[in] numTiles タイル数
+ */
+void MapTiles(ID3D12CommandQueue* queue, ID3D12Resource* resource,
+              UINT subresource, UINT numTiles, ID3D12Heap* heap) {
+  D3D12_TILED_RESOURCE_COORDINATE coordinate{0, 0, 0, subresource};
+  D3D12_TILE_REGION_SIZE regionSize{numTiles, FALSE, 0, 0, 0};
+  const D3D12_TILE_RANGE_FLAGS flag =
+      heap ? D3D12_TILE_RANGE_FLAG_NONE : D3D12_TILE_RANGE_FLAG_NULL;
+  const UINT heapOffset = 0;
+  queue->UpdateTileMappings(resource, 1, &coordinate, &regionSize, heap, 1,
+                            &flag, heap ? &heapOffset : nullptr, &numTiles,
+                            D3D12_TILE_MAPPING_FLAG_NONE);
+}
+
+/*!
+ * @brief サブリソースのタイル数
+ */
+UINT CountTiles(const D3D12_SUBRESOURCE_TILING& tiling) {
+  return tiling.WidthInTiles * tiling.HeightInTiles * tiling.DepthInTiles;
+}
+
+/*!
+ * @brief タイルを置くヒープを作る
+ */
+Microsoft::WRL::ComPtr<ID3D12Heap> CreateTileHeap(ID3D12Device* device,
+                                                  UINT numTiles) {
+  const auto desc = CD3DX12_HEAP_DESC(
+      UINT64(numTiles) * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES,
+      D3D12_HEAP_TYPE_DEFAULT, 0,
+      D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES);
+  Microsoft::WRL::ComPtr<ID3D12Heap> heap{};
+  if (FAILED(device->CreateHeap(&desc, IID_PPV_ARGS(heap.GetAddressOf())))) {
+    throw std::runtime_error("TextureManager::CreateTileHeap Failed");
+  }
+  return heap;
+}
+
+/*!
+ * @brief 中身の重複を見つけるための64bitハッシュ
+ * @details xxHash64(シードは0)と同じ計算。32バイトずつ4本並列に混ぜるので、
+ *          ファイルの読み込みに比べれば無視できる速さ
+ */
+std::uint64_t HashBytes(const std::uint8_t* data, std::size_t size) {
+  constexpr std::uint64_t P1 = 11400714785074694791ull;
+  constexpr std::uint64_t P2 = 14029467366897019727ull;
+  constexpr std::uint64_t P3 = 1609587929392839161ull;
+  constexpr std::uint64_t P4 = 9650029242287828579ull;
+  constexpr std::uint64_t P5 = 2870177450012600261ull;
+  auto rotl = [](std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+  auto read64 = [](const std::uint8_t* p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+  };
+  auto mix = [&](std::uint64_t acc, std::uint64_t input) {
+    acc += input * P2;
+    return rotl(acc, 31) * P1;
+  };
+
+  auto p = data;
+  const auto end = data + size;
+  std::uint64_t h = 0;
+  if (size >= 32) {
+    std::uint64_t v[4]{P1 + P2, P2, 0, 0 - P1};
+    do {
+      for (int i = 0; i < 4; ++i) {
+        v[i] = mix(v[i], read64(p + i * 8));
+      }
+      p += 32;
+    } while (end - p >= 32);
+    h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+    for (int i = 0; i < 4; ++i) {
+      h = (h ^ mix(0, v[i])) * P1 + P4;
+    }
+  } else {
+    h = P5;
+  }
+  h += size;
+  for (; end - p >= 8; p += 8) {
+    h = rotl(h ^ mix(0, read64(p)), 27) * P1 + P4;
+  }
+  if (end - p >= 4) {
+    std::uint32_t v;
+    std::memcpy(&v, p, 4);
+    h = rotl(h ^ (std::uint64_t(v) * P1), 23) * P2 + P3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h = rotl(h ^ (*p * P5), 11) * P1;
+  }
+  h ^= h >> 33;
+  h *= P2;
+  h ^= h >> 29;
+  h *= P3;
+  h ^= h >> 32;
+  return h;
+}
+
+/*!
+ * @brief ファイルの中身を全部読む
+ * @details 読んだバイト列で中身のハッシュを取り、そのままデコードにも使う
+ * @return 成否
+ */
+bool ReadFileBytes(const std::wstring& fileName,
+                   std::vector<std::uint8_t>& data) {
+  std::ifstream infile(std::filesystem::path(fileName), std::ios::binary);
+  if (!infile) {
+    return false;
+  }
+  data.resize(static_cast<std::size_t>(infile.seekg(0, infile.end).tellg()));
+  infile.seekg(0, infile.beg)
+      .read(reinterpret_cast<char*>(data.data()), data.size());
+  return static_cast<bool>(infile);
+}
+
+/*!
+ * @brief 拡張子がpngか
+ */
+bool IsPNGFile(const std::wstring& fileName) {
+  const auto ext = std::filesystem::path(fileName).extension().wstring();
+  return _wcsicmp(ext.c_str(), L".png") == 0;
+}
+
+/*!
+ * @brief 拡張子がddz(LZコンテナに入れたDDS)か
+ */
+bool IsDDZFile(const std::wstring& fileName) {
+  const auto ext = std::filesystem::path(fileName).extension().wstring();
+  return _wcsicmp(ext.c_str(), L".ddz") == 0;
+}
+
+/*!
+ * @brief LZコンテナに入れたDDSを、アップロードヒープへ直接展開してテクスチャを作る
+ * @details 先にDDSのヘッダだけを展開してテクスチャを作り、アップロードヒープの
+ *          配置(行ピッチは256バイト境界)を求める。ピクセルはチャンクの展開の中で
+ *          1行ずつヒープへ写すので、全体の大きさのCPUバッファは作らない。
+ *          subresourcesは行ピッチなどの数だけで、pDataはnullptr
+ * @param[out] uploadBuffer 展開済みのアップロードヒープ。コピーを記録するまで持っておく
+ */
+HRESULT LoadDDZTexture(ID3D12Device* device, const lz::Container& container,
+                       ID3D12Resource** texture, ID3D12Resource** uploadBuffer,
+                       std::vector<D3D12_SUBRESOURCE_DATA>& subresources) {
+  *texture = nullptr;
+  *uploadBuffer = nullptr;
+  const auto rawSize = container.header.rawSize;
+
+  // マジックとDDS_HEADER、DX10拡張ヘッダの分
+  constexpr std::uint64_t MaxHeaderSize = 4 + 124 + 20;
+  std::uint8_t header[MaxHeaderSize]{};
+  const auto headerSize = std::min(rawSize, MaxHeaderSize);
+  if (!lz::DecompressSpans(container, {{0, headerSize, header}})) {
+    return E_FAIL;
+  }
+
+  // 展開後のDDSのどこに各サブリソースがあるかはヘッダから求める
+  dds::Layout source{};
+  if (!dds::ParseLayout(header, static_cast<std::size_t>(headerSize), rawSize,
+                        source)) {
+    return E_FAIL;
+  }
+
+  Microsoft::WRL::ComPtr<ID3D12Resource> resource{};
+  auto hr = DirectX::CreateDDSTextureFromHeader(
+      device, header, static_cast<std::size_t>(headerSize),
+      static_cast<std::size_t>(rawSize), 0, D3D12_RESOURCE_FLAG_NONE,
+      DirectX::DDS_LOADER_DEFAULT, resource.GetAddressOf(), subresources);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  // ミップを落とさないので、サブリソースの数はヘッダのとおりになる
+  const auto count = static_cast<UINT>(subresources.size());
+  if (count != source.subresources.size()) {
+    return E_FAIL;
+  }
+  const auto desc = resource->GetDesc();
+  std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(count);
+  std::vector<UINT> numRows(count);
+  std::vector<UINT64> rowSizes(count);
+  UINT64 totalSize = 0;
+  device->GetCopyableFootprints(&desc, 0, count, 0, layouts.data(),
+                                numRows.data(), rowSizes.data(), &totalSize);
+
+  Microsoft::WRL::ComPtr<ID3D12Resource> upload{};
+  auto prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+  auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(totalSize);
+  hr = device->CreateCommittedResource(
+      &prop, D3D12_HEAP_FLAG_NONE, &bufferDesc,
+      D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+      IID_PPV_ARGS(upload.GetAddressOf()));
+  if (FAILED(hr)) {
+    return hr;
+  }
+  std::uint8_t* mapped = nullptr;
+  const CD3DX12_RANGE readRange(0, 0);  // CPUからは読まない
+  hr = upload->Map(0, &readRange, reinterpret_cast<void**>(&mapped));
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  // 展開後のDDSの行と、ヒープの行を対応させる。
+  // 行ピッチが同じで続いている行はまとめて1回で写す
+  std::vector<lz::CopySpan> spans{};
+  for (UINT i = 0; i < count; ++i) {
+    const auto& layout = layouts[i];
+    const auto& surface = source.subresources[i].surface;
+    const auto rowSize = std::min<std::uint64_t>(rowSizes[i], surface.rowPitch);
+    for (UINT z = 0; z < layout.Footprint.Depth; ++z) {
+      for (UINT y = 0; y < numRows[i]; ++y) {
+        const std::uint64_t offset = source.subresources[i].offset +
+                                     z * surface.slicePitch +
+                                     y * surface.rowPitch;
+        const auto row = UINT64(z) * numRows[i] + y;
+        const auto dst = mapped + layout.Offset + row * layout.Footprint.RowPitch;
+        const bool isContiguous =
+            !spans.empty() &&
+            spans.back().offset + spans.back().size == offset &&
+            spans.back().dst + spans.back().size == dst;
+        if (isContiguous) {
+          spans.back().size += rowSize;
+        } else {
+          spans.push_back({offset, rowSize, dst});
+        }
+      }
+    }
+  }
+  const bool isDecompressed = lz::DecompressSpans(container, spans);
+  upload->Unmap(0, nullptr);
+  if (!isDecompressed) {
+    return E_FAIL;
+  }
+
+  *texture = resource.Detach();
+  *uploadBuffer = upload.Detach();
+  return S_OK;
+}
+
+/*!
+ * @brief 展開済みのアップロードヒープからテクスチャへのコピーを記録する
+ * @details ヒープの配置はLoadDDZTextureと同じGetCopyableFootprintsで求める
+ */
+void RecordCopyFromUploadBuffer(ID3D12Device* device,
+                                ID3D12GraphicsCommandList* commandList,
+                                ID3D12Resource* texture,
+                                ID3D12Resource* uploadBuffer,
+                                UINT firstSubresource, UINT count) {
+  const auto desc = texture->GetDesc();
+  std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(count);
+  device->GetCopyableFootprints(&desc, firstSubresource, count, 0,
+                                layouts.data(), nullptr, nullptr, nullptr);
+  for (UINT i = 0; i < count; ++i) {
+    const CD3DX12_TEXTURE_COPY_LOCATION dst(texture, firstSubresource + i);
+    const CD3DX12_TEXTURE_COPY_LOCATION src(uploadBuffer, layouts[i]);
+    commandList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+  }
+}
+}  // namespace
+
+/*!
+ * @brief 非同期ロードのリクエスト
+ * @details stateはワーカースレッドとメインスレッドの両方から触るのでatomic
+ */
+struct TextureLoadHandle::Request {
+  //! リクエストの種類
+  enum class Kind {
+    Texture,        //!< 普通のテクスチャ。リソースもワーカーで作る
+    ArraySlice,     //!< テクスチャ配列の要素。組の全員がそろってから転送する
+    StreamingTail,  //!< ストリーミングするテクスチャのミップテール
+    StreamingMip,   //!< ストリーミングで常駐させることにしたミップ1段
+  };
+
+  //! テクスチャ配列にまとめる組
+  struct Group {
+    std::vector<std::weak_ptr<Request>> members;  //!< 配列の並び
+    std::size_t remaining{0};  //!< デコードの終わっていない数(requestMutex_で守る)
+  };
+
+  std::wstring fileName;      //!< ファイル名
+  std::string assetName;      //!< アセット名
+  int priority{0};            //!< 優先度
+  std::uint64_t sequence{0};  //!< 同じ優先度ならリクエスト順
+  Kind kind{Kind::Texture};   //!< 種類
+  std::shared_ptr<Group> group{};  //!< ArraySliceの組
+  //! ストリーミングで残すミップ。StreamingTailはここから下、StreamingMipはここだけ
+  UINT firstMip{0};
+  std::atomic<TextureLoadState> state{TextureLoadState::Pending};
+  std::atomic<bool> cancelRequested{false};  //!< デコード中にキャンセルされた
+  std::uint64_t contentHash{0};  //!< ファイルの中身のハッシュ(ワーカーで計算)
+
+  // ここから下はstateがDecodedになるまではワーカースレッドだけが触る
+  Microsoft::WRL::ComPtr<ID3D12Resource> resource{};  //!< 転送先
+  std::unique_ptr<uint8_t[]> decodedData{};          //!< デコード結果
+  //! Textureではmip1以降、ストリーミングはfirstMipから、ArraySliceはmip0から
+  std::vector<mip::MipLevel> mips{};
+  std::vector<D3D12_SUBRESOURCE_DATA> subresources{};  //!< データの並び
+
+  // ここから下はメインスレッドだけが触る
+  std::uint64_t fenceValue{0};  //!< 転送完了時のフェンス値
+  UINT arraySlice{0};           //!< ArraySliceの配列の何番目か
+};
 
 /*!
  * @brief TextureManagerの実装
@@ -20,145 +443,1825 @@ class TextureManager::Impl {
   /*!
    * @brief デストラクタ
    */
-  ~Impl() = default;
+  ~Impl() {
+    // ワーカースレッドを止めてから、転送中のアップロードヒープを解放する前にGPUを待つ
+    StopWorkers();
+    WaitForUpload(fenceValue_);
+  }
 
   /*!
    * @brief ID3D12Resourceの取得
+   * @details ロックを取らないので、どのスレッドから呼んでもよい
    * @return アセットが存在すればID3D12Resource*を、なければnullptrを返す
    */
   Microsoft::WRL::ComPtr<ID3D12Resource> resource(
       const std::string& assetName) {
-    const auto end = std::end(textures_);  // 連想配列の終わりを取得(つまり)
-    const auto ret = textures_.find(assetName);  // アセットで探して...
-    // 連想配列にデータがないと、std::end(textures_)が返ってくる
-    if (ret == end) {
+    const auto tex = textures_.Find(assetName);  // アセットで探して...
+    if (!tex) {
       return nullptr;  // なかった
     }
-    return ret->second->resource;  // 見つかった
+    tex->unit().lastUsedFrame = frame_.load();  // 使われたのでLRUの先頭へ
+    return tex->resource;  // 見つかった
+  }
+
+  /*!
+   * @brief ロード済みか調べる。ロード済みならヒットとして数える
+   */
+  bool IsLoaded(const std::string& assetName) {
+    if (!resource(assetName)) {
+      return false;
+    }
+    ++stats_.hits;
+    return true;
+  }
+
+  /*!
+   * @brief 同じ中身のテクスチャがあれば別名として登録する
+   * @param[in] contentHash ファイルの中身のハッシュ。0なら探さない
+   * @return 別名として登録したらtrue
+   */
+  bool FindDuplicate(const std::string& assetName, std::uint64_t contentHash);
+
+  /*!
+   * @brief ロードしたテクスチャを登録する
+   * @details VRAMの使用量を数えて、中身のハッシュがあれば重複検出に使う
+   */
+  void RegisterTexture(std::unique_ptr<Texture> tex);
+
+  /*!
+   * @brief 予算を超えていたら、参照のないテクスチャを使われていない順に破棄する
+   */
+  void EvictTextures();
+
+  /*!
+   * @brief ワーカースレッドを起動する。最初の1回だけ
+   */
+  void StartWorkers();
+
+  /*!
+   * @brief ワーカースレッドを止める
+   */
+  void StopWorkers();
+
+  /*!
+   * @brief ワーカースレッドの処理。リクエストを取り出してデコードする
+   */
+  void WorkerMain();
+
+  /*!
+   * @brief リクエストをワーカースレッドのキューに積む
+   */
+  void QueueRequest(Device* device,
+                    std::shared_ptr<TextureLoadHandle::Request> request);
+
+  /*!
+   * @brief ファイルの中身をデコードしてテクスチャのリソースを作る(Texture)
+   * @return 失敗したらfalse。リソースもデータも持たない
+   */
+  bool DecodeTexture(TextureLoadHandle::Request& request,
+                     const std::vector<std::uint8_t>& fileData);
+
+  /*!
+   * @brief PNGをデコードしてミップを作る(Texture以外)
+   * @details チェーンはmip0から作り、ストリーミングはfirstMipの分だけ残す。
+   *          リソースはメインスレッドで作るのでここでは作らない
+   */
+  static bool DecodeMipLevels(TextureLoadHandle::Request& request,
+                              const std::vector<std::uint8_t>& fileData);
+
+  /*!
+   * @brief デコードの終わったリクエストをUpdateに渡す
+   * @details テクスチャ配列の組は全員が終わってからまとめて渡す。
+   *          失敗・キャンセルしたものも組の数には数える
+   */
+  void FinishDecode(std::shared_ptr<TextureLoadHandle::Request> request);
+
+  /*!
+   * @brief デコードの終わったテクスチャ配列の組をまとめて転送待ちに積む
+   * @param[in] members 組のリクエスト。Uploadingにしたもの
+   * @param[out] submitted 転送待ちに積んだリクエスト
+   */
+  void QueueArrayUpload(
+      Device* device,
+      const std::vector<std::shared_ptr<TextureLoadHandle::Request>>& members,
+      std::vector<std::shared_ptr<TextureLoadHandle::Request>>& submitted);
+
+  /*!
+   * @brief ミップテールの転送が終わったストリーミングのテクスチャを登録する
+   */
+  void ActivateStreamingTexture(const TextureLoadHandle::Request& request);
+
+  /*!
+   * @brief ロードをやめたストリーミングのテクスチャを、GPUが使い終わってから捨てる
+   */
+  void DiscardPendingStreamingTexture(const std::string& assetName);
+
+  struct StreamingTexture;
+
+  /*!
+   * @brief デコードの終わったストリーミングのミップを転送待ちに積む
+   * @details 待っている間に破棄や別のロードが決まっていたら捨てる
+   * @return 転送待ちに積んだテクスチャ。捨てたらnullptr
+   */
+  StreamingTexture* QueueStreamingMipUpload(
+      TextureLoadHandle::Request& request);
+
+  /*!
+   * @brief 転送用のフェンスを作る。最初の1回だけ
+   */
+  void CreateFence(Device* device);
+
+  /*!
+   * @brief 転送を記録するコマンドリストを取り出してリセットする
+   * @details GPUが使い終わったものがなければ新しく作る
+   */
+  UploadCommandList& BeginUploadCommandList();
+
+  /*!
+   * @brief バッチに積んだテクスチャの転送コマンドを発行する
+   * @return 転送完了時にフェンスに書き込まれる値
+   */
+  std::uint64_t Submit();
+
+  /*!
+   * @brief 転送の終わったアップロードヒープを解放する
+   */
+  void RetireCompletedUploads();
+
+  /*!
+   * @brief 転送完了を確認
+   */
+  bool IsUploadCompleted(std::uint64_t fenceValue) const {
+    return !fence_ || fence_->GetCompletedValue() >= fenceValue;
   }
 
+  /*!
+   * @brief 転送完了まで待つ
+   */
+  void WaitForUpload(std::uint64_t fenceValue);
+
+  /*!
+   * @brief ストリーミングのミップをロード・破棄する
+   */
+  void UpdateStreaming();
+
   //! テクスチャ管理用の構造体
   struct Texture {
     std::wstring fileName;                            //!< ファイル名
     std::string assetName;                            //<! アセット名
     Microsoft::WRL::ComPtr<ID3D12Resource> resource;  //!< テクスチャの実態
+    UINT arraySlice{0};  //!< テクスチャ配列にまとめたときの位置
+    std::uint64_t contentHash{0};    //!< ファイルの中身のハッシュ。0は不明
+    std::uint64_t sizeBytes{0};      //!< 予算に数えるVRAMの使用量
+    std::atomic<std::uint32_t> refCount{0};       //!< TextureRefの数
+    std::atomic<std::uint64_t> lastUsedFrame{0};  //!< 最後に使われたフレーム
+    bool isEvictable{true};  //!< falseなら破棄しない(ストリーミングは別で管理)
+    //! テクスチャ配列の要素なら、配列全体を持つTexture。名前では登録しない
+    std::shared_ptr<Texture> owner{};
+
+    /*!
+     * @brief 予算・参照・LRUを数える単位
+     * @details テクスチャ配列の要素は、要素を全部捨てないとメモリが減らないので
+     *          配列全体で1つとして数える
+     */
+    Texture& unit() { return owner ? *owner : *this; }
   };
   // テクスチャもロードすると頂点バッファなどと同じにID3D12Resourceになる
   // リソースはGPUからはメモリの塊にしか見えないってことだな
 
+  //! 転送待ちのテクスチャ
+  struct PendingUpload {
+    Microsoft::WRL::ComPtr<ID3D12Resource> resource;  //!< 転送先
+    std::unique_ptr<uint8_t[]> data;  //!< ロードしたデータ(記録が終わるまで保持)
+    std::unique_ptr<DirectX::DDSMappedFile> mappedFile;  //!< DDSのマップ
+    //! 展開済みのアップロードヒープ(ddz)。あればSubmitはコピーを記録するだけ
+    Microsoft::WRL::ComPtr<ID3D12Resource> uploadBuffer;
+    std::vector<mip::MipLevel> mips;  //!< 生成したmip1以降
+    std::vector<D3D12_SUBRESOURCE_DATA> subresources;  //!< データの並び
+    bool generateMips{false};  //!< Submitでミップを作るか
+    bool srgb{false};          //!< ミップをsRGBとして作るか
+    UINT firstSubresource{0};  //!< subresources[0]を書き込むサブリソース
+    //! 転送前の状態。COPY_DEST以外なら転送する範囲だけ行き来させる
+    D3D12_RESOURCE_STATES stateBefore{D3D12_RESOURCE_STATE_COPY_DEST};
+  };
+
+  //! ミップ単位でストリーミングするテクスチャ
+  //! 予約リソースのミップごとにヒープを作ってタイルを割り当てる
+  //! CPU側にピクセルは持たず、ミップをロードするたびにワーカーでデコードする
+  struct StreamingTexture {
+    std::uint32_t residencyId{0};  //!< TextureResidencyのID
+    std::wstring fileName{};       //!< デコードし直すファイル
+    std::string assetName{};       //!< streamingTextures_のキー
+    Microsoft::WRL::ComPtr<ID3D12Resource> resource{};  //!< 予約リソース
+    std::vector<D3D12_SUBRESOURCE_TILING> tilings{};     //!< ミップのタイル数
+    UINT standardMips{0};  //!< 個別に割り当てるミップの数
+    UINT tailTiles{0};     //!< ミップテールのタイル数
+    std::vector<Microsoft::WRL::ComPtr<ID3D12Heap>> heaps{};  //!< ミップごと
+    std::vector<std::uint64_t> mipFences{};  //!< 転送完了のフェンス値。0は未割り当て
+    //! デコード中のミップのリクエスト。破棄が決まったら外して結果を捨てる
+    std::vector<std::shared_ptr<TextureLoadHandle::Request>> mipRequests{};
+    Microsoft::WRL::ComPtr<ID3D12Heap> tailHeap{};  //!< ミップテール
+  };
+
+  //! 割り当てを外したヒープや破棄したテクスチャ。GPUが使い終わるまで持っておく
+  struct RetiredObject {
+    std::uint64_t fenceValue;  //!< 使い終わったときのフェンス値
+    Microsoft::WRL::ComPtr<ID3D12Pageable> object;
+  };
+
+  //! GPUで転送中のバッチ
+  struct InFlightUpload {
+    std::uint64_t fenceValue;  //!< 転送完了時のフェンス値
+    std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> uploadHeaps;
+  };
+
+  //! 転送に使うアロケータとコマンドリスト。使い回す
+  struct UploadCommandList {
+    std::uint64_t fenceValue{0};  //!< 最後に使った転送のフェンス値
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> allocator{};
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList{};
+  };
+
+  using RequestPtr = std::shared_ptr<TextureLoadHandle::Request>;
+
+  //! 優先度の高いリクエストから取り出すための比較
+  struct RequestCompare {
+    bool operator()(const RequestPtr& a, const RequestPtr& b) const {
+      if (a->priority != b->priority) {
+        return a->priority < b->priority;
+      }
+      return a->sequence > b->sequence;
+    }
+  };
+
+  //! デコードに使うワーカースレッドの最大数
+  static constexpr unsigned int MaxWorkerThreads_{4};
+
+  //! 1つのアップロードヒープにまとめる最大サイズ
+  //! これより大きいテクスチャは単独のヒープになる
+  static constexpr UINT64 MaxUploadHeapSize_{64 * 1024 * 1024};
+
+  //! テクスチャ配列にまとめる最大の幅・高さ
+  static constexpr std::uint32_t MaxPackedTextureSize_{512};
+
+  //! ストリーミングの予算の初期値
+  static constexpr std::uint64_t DefaultStreamingBudget_{64 * 1024 * 1024};
+
+  //! 1フレームで始めるミップのロードの最大数
+  static constexpr std::uint32_t MaxStreamingLoadsPerFrame_{4};
+
+  //! ストリーミングのミップのデコードの優先度。初めてのロードを先にする
+  static constexpr int StreamingMipPriority_{-1};
+
   //! テクスチャを格納しておくコンテナ
-  std::unordered_map<std::string, std::unique_ptr<Texture>> textures_{};
-  // unordered_mapはいわゆる連想配列
-  // unordered_map<キーの型, 格納したい型>になる。
+  //! 中身が同じなら別のアセット名でも同じTextureを指す
+  TextureRegistry<Texture> textures_{};
+  // 中身はunordered_map(いわゆる連想配列)
   // キーの値は重複できないので、同じテクスチャを二回以上ロードしない仕組みに使える
-};
+  // 描画スレッドがロード中に引いても大丈夫なように、書き換えは表ごと差し替える
 
-//-------------------------------------------------------------------
-// TextureManager
-//-------------------------------------------------------------------
-TextureManager::TextureManager() : impl_(new Impl()) {}
+  //! 中身のハッシュからテクスチャを引く
+  std::unordered_map<std::uint64_t, std::shared_ptr<Texture>> contentIndex_{};
 
-TextureManager::~TextureManager() {}
+  std::uint64_t memoryBudget_{UINT64_MAX};  //!< VRAMの予算。初期値は無制限
+  std::uint64_t residentBytes_{0};          //!< 予算に数えている使用量
+  std::atomic<std::uint64_t> frame_{0};     //!< Updateを呼んだ回数
+  TextureCacheStats stats_{};               //!< ヒット・ミスなどの回数
 
-bool TextureManager::LoadWICTextureFromFile(Device* device,
-                                            const std::wstring& fileName,
-                                            const std::string& assetName) {
-  // テクスチャの存在チェック
-  if (impl_->resource(assetName)) {
-    return true;
-  }
+  Device* device_{};       //!< バッチ中のデバイス
+  bool isBatching_{false};  //!< BeginUploadBatch～EndUploadBatchの間か
+  std::vector<PendingUpload> pendingUploads_{};    //!< 転送待ち
+  std::vector<InFlightUpload> inFlightUploads_{};  //!< 転送中
+  //! 転送用のコマンドリスト。同時に転送中のバッチの数だけに増える
+  std::vector<UploadCommandList> uploadCommandLists_{};
 
-  // ロード時に必要な変数を確保
-  ID3D12Resource* resource;
-  std::unique_ptr<uint8_t[]> decodedData{};
-  D3D12_SUBRESOURCE_DATA subresource{};
+  //---------------------------------------------------------------
+  // 非同期ロード
+  //---------------------------------------------------------------
+  Device* asyncDevice_{};  //!< 非同期ロードで使うデバイス
+  std::vector<std::thread> workers_{};  //!< デコード用のワーカースレッド
+  std::mutex requestMutex_{};  //!< 下の2つのコンテナとstopWorkers_を守る
+  std::condition_variable requestCv_{};
+  std::priority_queue<RequestPtr, std::vector<RequestPtr>, RequestCompare>
+      requestQueue_{};                             //!< デコード待ち
+  std::vector<RequestPtr> decodedRequests_{};      //!< デコード済み
+  bool stopWorkers_{false};                        //!< ワーカー終了フラグ
+  std::uint64_t requestSequence_{0};               //!< リクエストの通し番号
+  std::vector<RequestPtr> uploadingRequests_{};    //!< 転送中
+  std::unordered_map<std::string, RequestPtr> requests_{};  //!< 処理中のもの
 
-  // LoadWICTextureFromFileでWICをつかってbmp,png,jpgとかが読める
-  // とりあえずファイルからメモリに読み込み
-  auto hr = DirectX::LoadWICTextureFromFile(
-      device->device(),  // デバイス
-      fileName.c_str(),  // ファイル名
-      &resource,     // D3Dで使用可能になったテクスチャデータ
-      decodedData,   // ファイルから読み込まれたバイトデータ
-      subresource);  // テクスチャデータのアドレスとデータの並びが返ってくる
+  //---------------------------------------------------------------
+  // ストリーミング
+  //---------------------------------------------------------------
+  Device* streamingDevice_{};  //!< ストリーミングで使うデバイス
+  TextureResidency residency_{DefaultStreamingBudget_};  //!< 常駐の判断
+  std::unordered_map<std::string, std::unique_ptr<StreamingTexture>>
+      streamingTextures_{};
+  //! ミップテールの転送待ち。終わったらstreamingTextures_に移す
+  std::unordered_map<std::string, std::unique_ptr<StreamingTexture>>
+      pendingStreamingTextures_{};
+  std::vector<StreamingTexture*> streamingIds_{};  //!< residencyIdから引く
+  std::vector<RetiredObject> retiredObjects_{};  //!< 解放待ちのヒープとテクスチャ
 
-  if (FAILED(hr)) {
-    return false;
+  // Device::WaitForGPUはDeviceクラスためのものなので自前で持つ
+  Microsoft::WRL::ComPtr<ID3D12Fence> fence_{};  //!< 転送完了確認用
+  Microsoft::WRL::Wrappers::Event fenceEvent_{};
+  std::uint64_t fenceValue_{0};  //!< 最後に発行したフェンス値
+};
+
+/*!
+ * @brief TextureRefの実態
+ * @details 作ったときに参照カウントを増やし、最後のコピーが消えたら減らす
+ */
+struct TextureRef::Pin {
+  explicit Pin(std::shared_ptr<TextureManager::Impl::Texture> tex)
+      : texture(std::move(tex)) {
+    ++texture->unit().refCount;
   }
+  ~Pin() { --texture->unit().refCount; }
 
-  // VRAMに送るサイズを取得
-  const auto uploadBufferSize = GetRequiredIntermediateSize(resource, 0, 1);
+  std::shared_ptr<TextureManager::Impl::Texture> texture;
+};
 
-  auto prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-  auto desc = CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize);
-  Microsoft::WRL::ComPtr<ID3D12Resource> uploadHeap;
-
-  // アップロード先のメモリを確保
-  device->device()->CreateCommittedResource(
-      &prop, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_GENERIC_READ,
-      nullptr, IID_PPV_ARGS(uploadHeap.GetAddressOf()));
-
-  // アップロードコマンドの生成
-  // テクスチャの転送はコマンドリストを経由する必要がある
-  auto cl = device->CreateNewGraphicsCommandList();
-  {
-    // VRAMへの転送コマンド発行
-    // d3dx12のヘルパー関数を利用します。便利便利
-    UpdateSubresources(
-        cl.Get(),
-        resource,          // テクスチャリソース
-        uploadHeap.Get(),  // 送り先
-        0, 0, 1,           // とりあえずこの設定でOK
-        &subresource);  // ロード時に得たD3D12_SUBRESOURCE_DATAを設定
-
-    // 転送可能からピクセルシェーダになるまで待つ
-    auto barrier = CD3DX12_RESOURCE_BARRIER::Transition(
-        resource, D3D12_RESOURCE_STATE_COPY_DEST,
-        D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-    cl->ResourceBarrier(1, &barrier);
+void TextureManager::Impl::StartWorkers() {
+  if (!workers_.empty()) {
+    return;
+  }
+  // 描画するメインスレッドの分は残しておく
+  auto count = std::thread::hardware_concurrency();
+  count = std::clamp(count > 1 ? count - 1 : 1u, 1u, MaxWorkerThreads_);
+  for (unsigned int i = 0; i < count; ++i) {
+    workers_.emplace_back([this]() { WorkerMain(); });
   }
+}
 
-  // 転送開始
-  // 当然だが1ファイルずつ実行するより、まとまった単位でExexしたほうがいいよ
-  // いまは簡単のために1個ずつやっています。
+void TextureManager::Impl::StopWorkers() {
   {
-    cl->Close();
-    ID3D12CommandList* lists[]{cl.Get()};
-    device->commandQueue()->ExecuteCommandLists(1, lists);
+    std::lock_guard<std::mutex> lock(requestMutex_);
+    stopWorkers_ = true;
+  }
+  requestCv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+}
+
+void TextureManager::Impl::WorkerMain() {
+  // WICはCOMなのでスレッドごとに初期化がいる
+  Microsoft::WRL::Wrappers::RoInitializeWrapper initialize(
+      RO_INIT_MULTITHREADED);
 
-    // コマンドリストで転送するのでGPUの処理待ちをします
+  for (;;) {
+    RequestPtr request{};
     {
-      // Device::WaitForGPUはDeviceクラスためのものなので自前で作る
-      Microsoft::WRL::ComPtr<ID3D12Fence> fence;
-      UINT64 value = 0;
-      device->device()->CreateFence(
-          value++, D3D12_FENCE_FLAG_NONE,
-          IID_PPV_ARGS(fence.ReleaseAndGetAddressOf()));
-
-      Microsoft::WRL::Wrappers::Event fenceEvent{};
-      fenceEvent.Attach(
-          CreateEventEx(nullptr, nullptr, 0, EVENT_MODIFY_STATE | SYNCHRONIZE));
-      if (SUCCEEDED(device->commandQueue()->Signal(fence.Get(), value))) {
-        if (SUCCEEDED(fence->SetEventOnCompletion(value, fenceEvent.Get()))) {
-          WaitForSingleObjectEx(fenceEvent.Get(), INFINITE, FALSE);
-        }
+      std::unique_lock<std::mutex> lock(requestMutex_);
+      requestCv_.wait(lock, [this]() {
+        return stopWorkers_ || !requestQueue_.empty();
+      });
+      if (stopWorkers_) {
+        return;
       }
+      request = requestQueue_.top();
+      requestQueue_.pop();
     }
 
-    // 終わったのでデータを格納
-    auto tex = std::make_unique<Impl::Texture>();
-    tex->fileName = fileName;
-    tex->assetName = assetName;
-    tex->resource.Attach(resource);
-    impl_->textures_.emplace(assetName, std::move(tex));
+    // キャンセル済みなら何もしない
+    auto expected = TextureLoadState::Pending;
+    if (!request->state.compare_exchange_strong(expected,
+                                                TextureLoadState::Decoding)) {
+      FinishDecode(std::move(request));
+      continue;
+    }
+
+    // ファイルは1回だけ読み、中身のハッシュもワーカーで計算しておく
+    // 重複の判定はUpdateでやる
+    std::vector<std::uint8_t> fileData{};
+    bool isDecoded = ReadFileBytes(request->fileName, fileData);
+    if (isDecoded) {
+      request->contentHash = HashBytes(fileData.data(), fileData.size());
+      isDecoded =
+          request->kind == TextureLoadHandle::Request::Kind::Texture
+              ? DecodeTexture(*request, fileData)
+              : DecodeMipLevels(*request, fileData);
+    }
+    if (!isDecoded) {
+      request->state = TextureLoadState::Failed;
+      FinishDecode(std::move(request));
+      continue;
+    }
+    request->state = TextureLoadState::Decoded;
+
+    // デコード中にキャンセルされていたらここで捨てる
+    if (request->cancelRequested) {
+      expected = TextureLoadState::Decoded;
+      if (request->state.compare_exchange_strong(expected,
+                                                 TextureLoadState::Canceled)) {
+        request->resource.Reset();
+        request->decodedData.reset();
+        request->mips.clear();
+        request->subresources.clear();
+      }
+    }
+    FinishDecode(std::move(request));
   }
+}
 
-  // ちなみにテクスチャの削除は用意してない
-  return true;
+void TextureManager::Impl::QueueRequest(Device* device, RequestPtr request) {
+  CreateFence(device);
+  asyncDevice_ = device;
+  StartWorkers();
+
+  request->sequence = requestSequence_++;
+  // ストリーミングのミップはテクスチャ本体のロードとは別に数える
+  if (request->kind != TextureLoadHandle::Request::Kind::StreamingMip) {
+    requests_.emplace(request->assetName, request);
+  }
+  {
+    std::lock_guard<std::mutex> lock(requestMutex_);
+    requestQueue_.push(std::move(request));
+  }
+  requestCv_.notify_one();
+}
+
+bool TextureManager::Impl::DecodeTexture(
+    TextureLoadHandle::Request& request,
+    const std::vector<std::uint8_t>& fileData) {
+  // リソースの作成はスレッドセーフなのでワーカーでやってしまう
+  // PNGはWICを通さずに自前のデコーダで読む
+  ID3D12Resource* resource = nullptr;
+  D3D12_SUBRESOURCE_DATA subresource{};
+  HRESULT hr = S_OK;
+  if (IsPNGFile(request.fileName)) {
+    hr = LoadPNGTexture(asyncDevice_->device(), fileData, &resource,
+                        request.decodedData, subresource);
+  } else {
+    hr = DirectX::LoadWICTextureFromMemoryEx(
+        asyncDevice_->device(), fileData.data(), fileData.size(), 0,
+        D3D12_RESOURCE_FLAG_NONE, DirectX::WIC_LOADER_MIP_RESERVE, &resource,
+        request.decodedData, subresource);
+  }
+  if (FAILED(hr)) {
+    return false;
+  }
+
+  // ミップもワーカーで作る。ワーカー同士で並列になるので1スレッドで
+  // VRAMが足りずに作り直せなかったら、読めなかったときと同じにする
+  bool generateMips = false;
+  bool srgb = false;
+  hr = PrepareMipTexture(asyncDevice_->device(), &resource, generateMips, srgb);
+  if (FAILED(hr)) {
+    resource->Release();
+    request.decodedData.reset();
+    return false;
+  }
+  if (generateMips) {
+    const auto desc = resource->GetDesc();
+    mip::GenerateMipChain(static_cast<const std::uint8_t*>(subresource.pData),
+                          static_cast<std::uint32_t>(desc.Width), desc.Height,
+                          static_cast<std::size_t>(subresource.RowPitch), srgb,
+                          request.mips, 1);
+  }
+  request.subresources.push_back(subresource);
+  AppendMipSubresources(request.mips, request.subresources);
+  request.resource.Attach(resource);
+  return true;
+}
+
+bool TextureManager::Impl::DecodeMipLevels(
+    TextureLoadHandle::Request& request,
+    const std::vector<std::uint8_t>& fileData) {
+  png::Image image{};
+  if (!png::DecodeFromMemory(fileData.data(), fileData.size(), image)) {
+    return false;
+  }
+  // ワーカー同士で並列になるので1スレッドで作る
+  // 細かいミップは粗いミップから作るので、どの段が欲しくてもmip0から
+  std::vector<mip::MipLevel> chain{};
+  mip::GenerateMipChain(image.pixels.data(), image.width, image.height,
+                        image.rowPitch(), false, chain, 1);
+  mip::MipLevel mip0{};
+  mip0.width = image.width;
+  mip0.height = image.height;
+  mip0.pixels = std::move(image.pixels);
+  chain.insert(std::begin(chain), std::move(mip0));
+  if (request.firstMip >= chain.size()) {
+    return false;  // ヘッダを読んだ後にファイルが変わった
+  }
+
+  // 予約リソースへ送る分だけ残し、ほかはここで手放す
+  using Kind = TextureLoadHandle::Request::Kind;
+  const auto last = request.kind == Kind::StreamingMip
+                        ? std::begin(chain) + request.firstMip + 1
+                        : std::end(chain);
+  request.mips.assign(std::make_move_iterator(std::begin(chain) +
+                                              request.firstMip),
+                      std::make_move_iterator(last));
+  request.subresources.clear();
+  AppendMipSubresources(request.mips, request.subresources);
+  return true;
+}
+
+void TextureManager::Impl::FinishDecode(RequestPtr request) {
+  std::lock_guard<std::mutex> lock(requestMutex_);
+  const auto& group = request->group;
+  if (!group) {
+    if (request->state == TextureLoadState::Decoded) {
+      decodedRequests_.push_back(std::move(request));
+    }
+    return;
+  }
+  // 組の最後の1つが終わったら、組の全員をまとめて渡す
+  // 失敗・キャンセルしたものはUpdateで状態を見て抜く
+  if (--group->remaining > 0) {
+    return;
+  }
+  for (const auto& member : group->members) {
+    if (auto locked = member.lock()) {
+      decodedRequests_.push_back(std::move(locked));
+    }
+  }
+}
+
+void TextureManager::Impl::QueueArrayUpload(
+    Device* device, const std::vector<RequestPtr>& members,
+    std::vector<RequestPtr>& submitted) {
+  // 大きさはヘッダで組み分けしてあるが、中身が違っていたら抜く
+  const auto width = members[0]->mips[0].width;
+  const auto height = members[0]->mips[0].height;
+  std::vector<RequestPtr> slices{};
+  for (const auto& request : members) {
+    if (request->mips[0].width == width && request->mips[0].height == height) {
+      slices.push_back(request);
+    } else {
+      request->state = TextureLoadState::Failed;
+    }
+  }
+
+  auto prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+  auto desc = CD3DX12_RESOURCE_DESC::Tex2D(
+      DXGI_FORMAT_R8G8B8A8_UNORM, width, height,
+      static_cast<UINT16>(slices.size()),
+      static_cast<UINT16>(slices[0]->mips.size()));
+  Microsoft::WRL::ComPtr<ID3D12Resource> resource{};
+  auto hr = device->device()->CreateCommittedResource(
+      &prop, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_COPY_DEST,
+      nullptr, IID_PPV_ARGS(resource.GetAddressOf()));
+  if (FAILED(hr)) {
+    for (auto& request : slices) {
+      request->mips.clear();
+      request->subresources.clear();
+      request->state = TextureLoadState::Failed;
+    }
+    return;
+  }
+
+  // サブリソースは要素ごとにmip0から並ぶ(D3D12CalcSubresourceの順)
+  PendingUpload upload{};
+  upload.resource = resource;
+  for (std::size_t s = 0; s < slices.size(); ++s) {
+    auto& request = slices[s];
+    for (auto& level : request->mips) {
+      upload.mips.emplace_back(std::move(level));
+    }
+    request->mips.clear();
+    request->subresources.clear();
+    request->resource = resource;
+    request->arraySlice = static_cast<UINT>(s);
+    submitted.push_back(request);
+  }
+  AppendMipSubresources(upload.mips, upload.subresources);
+  pendingUploads_.emplace_back(std::move(upload));
+}
+
+void TextureManager::Impl::ActivateStreamingTexture(
+    const TextureLoadHandle::Request& request) {
+  const auto it = pendingStreamingTextures_.find(request.assetName);
+  auto tex = std::move(it->second);
+  pendingStreamingTextures_.erase(it);
+
+  // 同じ中身が先にロードされていたらそちらを共有する
+  // 転送は終わっているので、このテクスチャはすぐに捨ててよい
+  if (FindDuplicate(request.assetName, request.contentHash)) {
+    return;
+  }
+
+  // 常駐の判断はミップのタイル数で行う
+  {
+    std::vector<std::uint64_t> mipBytes{};
+    for (UINT m = 0; m < tex->standardMips; ++m) {
+      mipBytes.push_back(std::uint64_t(CountTiles(tex->tilings[m])) *
+                         D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES);
+    }
+    tex->residencyId = residency_.Register(
+        mipBytes, std::uint64_t(tex->tailTiles) *
+                      D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES);
+    if (streamingIds_.size() <= tex->residencyId) {
+      streamingIds_.resize(tex->residencyId + 1);
+    }
+    streamingIds_[tex->residencyId] = tex.get();
+  }
+
+  {
+    // タイルの常駐は別で管理するので、予算による破棄の対象にしない
+    auto texture = std::make_unique<Texture>();
+    texture->fileName = request.fileName;
+    texture->assetName = request.assetName;
+    texture->resource = tex->resource;
+    texture->contentHash = request.contentHash;
+    texture->isEvictable = false;
+    RegisterTexture(std::move(texture));
+  }
+  streamingTextures_.emplace(request.assetName, std::move(tex));
+}
+
+void TextureManager::Impl::DiscardPendingStreamingTexture(
+    const std::string& assetName) {
+  const auto it = pendingStreamingTextures_.find(assetName);
+  if (it == std::end(pendingStreamingTextures_)) {
+    return;
+  }
+  // タイルの割り当てはキューに積んであるので、そこを過ぎてから解放する
+  const auto value = ++fenceValue_;
+  streamingDevice_->commandQueue()->Signal(fence_.Get(), value);
+  retiredObjects_.push_back({value, it->second->resource});
+  retiredObjects_.push_back({value, it->second->tailHeap});
+  pendingStreamingTextures_.erase(it);
+}
+
+TextureManager::Impl::StreamingTexture*
+TextureManager::Impl::QueueStreamingMipUpload(
+    TextureLoadHandle::Request& request) {
+  const auto it = streamingTextures_.find(request.assetName);
+  const auto m = request.firstMip;
+  if (it == std::end(streamingTextures_) ||
+      it->second->mipRequests[m].get() != &request) {
+    return nullptr;  // 待っている間に破棄された
+  }
+  auto tex = it->second.get();
+  tex->mipRequests[m].reset();
+
+  // タイルはロードを決めたときに割り当ててある
+  PendingUpload upload{};
+  upload.resource = tex->resource;
+  upload.mips = std::move(request.mips);
+  upload.subresources = std::move(request.subresources);
+  upload.firstSubresource = m;
+  upload.stateBefore = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+  pendingUploads_.emplace_back(std::move(upload));
+  return tex;
+}
+
+void TextureManager::Impl::CreateFence(Device* device) {
+  if (fence_) {
+    return;
+  }
+  auto hr = device->device()->CreateFence(
+      fenceValue_, D3D12_FENCE_FLAG_NONE,
+      IID_PPV_ARGS(fence_.ReleaseAndGetAddressOf()));
+  if (FAILED(hr)) {
+    throw std::runtime_error("TextureManager::CreateFence Failed");
+  }
+  fence_->SetName(L"TextureManager::ID3D12Fence");
+
+  fenceEvent_.Attach(
+      CreateEventEx(nullptr, nullptr, 0, EVENT_MODIFY_STATE | SYNCHRONIZE));
+  if (!fenceEvent_.IsValid()) {
+    throw std::runtime_error("CreateEventEx Failed");
+  }
+}
+
+TextureManager::Impl::UploadCommandList&
+TextureManager::Impl::BeginUploadCommandList() {
+  // アロケータのリセットはGPUがそのコマンドを実行し終えてから
+  const auto completed = fence_->GetCompletedValue();
+  auto it = std::find_if(std::begin(uploadCommandLists_),
+                         std::end(uploadCommandLists_),
+                         [completed](const UploadCommandList& list) {
+                           return list.fenceValue <= completed;
+                         });
+  if (it != std::end(uploadCommandLists_)) {
+    it->allocator->Reset();
+    it->commandList->Reset(it->allocator.Get(), nullptr);
+    return *it;
+  }
+
+  // 全部転送中なら増やす。作ったリストは記録中になっている
+  UploadCommandList list{};
+  auto dev = device_->device();
+  auto hr = dev->CreateCommandAllocator(
+      D3D12_COMMAND_LIST_TYPE_DIRECT,
+      IID_PPV_ARGS(list.allocator.ReleaseAndGetAddressOf()));
+  if (FAILED(hr)) {
+    throw std::runtime_error("TextureManager::CreateCommandAllocator Failed");
+  }
+  list.allocator->SetName(L"TextureManager::uploadCommandLists_");
+  hr = dev->CreateCommandList(
+      0, D3D12_COMMAND_LIST_TYPE_DIRECT, list.allocator.Get(), nullptr,
+      IID_PPV_ARGS(list.commandList.ReleaseAndGetAddressOf()));
+  if (FAILED(hr)) {
+    throw std::runtime_error("TextureManager::CreateCommandList Failed");
+  }
+  list.commandList->SetName(L"TextureManager::uploadCommandLists_");
+  uploadCommandLists_.push_back(std::move(list));
+  return uploadCommandLists_.back();
+}
+
+std::uint64_t TextureManager::Impl::Submit() {
+  RetireCompletedUploads();
+  if (pendingUploads_.empty()) {
+    return fenceValue_;
+  }
+
+  // ミップチェーンがまだのテクスチャは、ここでまとめて並列に作る
+  {
+    std::vector<mip::MipJob> jobs{};
+    for (auto& upload : pendingUploads_) {
+      if (!upload.generateMips) {
+        continue;
+      }
+      const auto& mip0 = upload.subresources[0];
+      const auto desc = upload.resource->GetDesc();
+      mip::MipJob job{};
+      job.rgba = static_cast<const std::uint8_t*>(mip0.pData);
+      job.width = static_cast<std::uint32_t>(desc.Width);
+      job.height = desc.Height;
+      job.rowPitch = static_cast<std::size_t>(mip0.RowPitch);
+      job.srgb = upload.srgb;
+      job.mips = &upload.mips;
+      jobs.push_back(job);
+    }
+    mip::GenerateMipChains(jobs);
+    for (auto& upload : pendingUploads_) {
+      if (upload.generateMips) {
+        AppendMipSubresources(upload.mips, upload.subresources);
+        upload.generateMips = false;
+      }
+    }
+  }
+
+  InFlightUpload inFlight{};
+
+  // 転送コマンドは全テクスチャで1つのコマンドリストにまとめる
+  auto& uploadList = BeginUploadCommandList();
+  auto cl = uploadList.commandList;
+
+  // ストリーミングのミップはシェーダから読める状態なので転送先の状態に戻す
+  {
+    std::vector<D3D12_RESOURCE_BARRIER> barriers{};
+    for (auto& upload : pendingUploads_) {
+      if (upload.stateBefore == D3D12_RESOURCE_STATE_COPY_DEST) {
+        continue;
+      }
+      for (UINT i = 0; i < upload.subresources.size(); ++i) {
+        barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(
+            upload.resource.Get(), upload.stateBefore,
+            D3D12_RESOURCE_STATE_COPY_DEST, upload.firstSubresource + i));
+      }
+    }
+    if (!barriers.empty()) {
+      cl->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+    }
+  }
+
+  // アップロードヒープにテクスチャを詰めていく
+  // ヒープを作る回数が減るし、転送も1回のExecuteで済む
+  {
+    std::size_t first = 0;
+    while (first < pendingUploads_.size()) {
+      // 1つのヒープに入る分だけ詰める
+      std::vector<UINT64> offsets{};
+      UINT64 heapSize = 0;
+      std::size_t last = first;
+      for (; last < pendingUploads_.size(); ++last) {
+        auto& upload = pendingUploads_[last];
+        if (upload.uploadBuffer) {
+          offsets.push_back(0);  // 自分のヒープを使うので場所を取らない
+          continue;
+        }
+        const auto size = GetRequiredIntermediateSize(
+            upload.resource.Get(), upload.firstSubresource,
+            static_cast<UINT>(upload.subresources.size()));
+        // テクスチャの配置は512バイト境界にそろえる必要がある
+        const auto offset =
+            (heapSize + D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1) &
+            ~UINT64(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1);
+        if (last != first && offset + size > MaxUploadHeapSize_) {
+          break;  // 次のヒープに回す
+        }
+        offsets.push_back(offset);
+        heapSize = offset + size;
+      }
+
+      // アップロード先のメモリを確保
+      // 展開済みのヒープを持つものだけなら作らない
+      Microsoft::WRL::ComPtr<ID3D12Resource> uploadHeap;
+      if (heapSize > 0) {
+        auto prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+        auto desc = CD3DX12_RESOURCE_DESC::Buffer(heapSize);
+        auto hr = device_->device()->CreateCommittedResource(
+            &prop, D3D12_HEAP_FLAG_NONE, &desc,
+            D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+            IID_PPV_ARGS(uploadHeap.GetAddressOf()));
+        if (FAILED(hr)) {
+          throw std::runtime_error("TextureManager::CreateUploadHeap Failed");
+        }
+        inFlight.uploadHeaps.push_back(uploadHeap);
+      }
+
+      // VRAMへの転送コマンド発行
+      // オフセット付きのUpdateSubresourcesで同じヒープの別の位置に書き込む
+      for (auto i = first; i < last; ++i) {
+        auto& upload = pendingUploads_[i];
+        const auto count = static_cast<UINT>(upload.subresources.size());
+        if (upload.uploadBuffer) {
+          RecordCopyFromUploadBuffer(device_->device(), cl.Get(),
+                                     upload.resource.Get(),
+                                     upload.uploadBuffer.Get(),
+                                     upload.firstSubresource, count);
+          inFlight.uploadHeaps.push_back(upload.uploadBuffer);
+          continue;
+        }
+        UpdateSubresources(cl.Get(), upload.resource.Get(), uploadHeap.Get(),
+                           offsets[i - first], upload.firstSubresource, count,
+                           upload.subresources.data());
+      }
+      first = last;
+    }
+  }
+
+  // 転送可能からピクセルシェーダになるまで待つ
+  // バリアも1回のResourceBarrierでまとめて積む
+  {
+    std::vector<D3D12_RESOURCE_BARRIER> barriers{};
+    barriers.reserve(pendingUploads_.size());
+    for (auto& upload : pendingUploads_) {
+      if (upload.stateBefore == D3D12_RESOURCE_STATE_COPY_DEST) {
+        barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(
+            upload.resource.Get(), D3D12_RESOURCE_STATE_COPY_DEST,
+            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+        continue;
+      }
+      for (UINT i = 0; i < upload.subresources.size(); ++i) {
+        barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(
+            upload.resource.Get(), D3D12_RESOURCE_STATE_COPY_DEST,
+            upload.stateBefore, upload.firstSubresource + i));
+      }
+    }
+    cl->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+  }
+
+  // 転送開始
+  cl->Close();
+  ID3D12CommandList* lists[]{cl.Get()};
+  device_->commandQueue()->ExecuteCommandLists(1, lists);
+
+  // 転送が終わったらフェンスの値が更新される
+  const auto value = ++fenceValue_;
+  device_->commandQueue()->Signal(fence_.Get(), value);
+
+  // アップロードヒープとアロケータは転送が終わるまで再利用できない
+  inFlight.fenceValue = value;
+  inFlightUploads_.emplace_back(std::move(inFlight));
+  uploadList.fenceValue = value;
+
+  // CPU側のデータはコマンド記録時にヒープへコピー済みなのでもういらない
+  // DDSのファイルマップもここで閉じる
+  pendingUploads_.clear();
+  return value;
+}
+
+void TextureManager::Impl::RetireCompletedUploads() {
+  if (!fence_) {
+    return;
+  }
+  const auto completed = fence_->GetCompletedValue();
+  inFlightUploads_.erase(
+      std::remove_if(std::begin(inFlightUploads_), std::end(inFlightUploads_),
+                     [completed](const InFlightUpload& upload) {
+                       return upload.fenceValue <= completed;
+                     }),
+      std::end(inFlightUploads_));
+  retiredObjects_.erase(
+      std::remove_if(std::begin(retiredObjects_), std::end(retiredObjects_),
+                     [completed](const RetiredObject& retired) {
+                       return retired.fenceValue <= completed;
+                     }),
+      std::end(retiredObjects_));
+}
+
+void TextureManager::Impl::WaitForUpload(std::uint64_t fenceValue) {
+  if (!fence_ || !fenceEvent_.IsValid()) {
+    return;
+  }
+
+  // 処理速度によってはすでに終わっていることもあるので確認してから待つ
+  if (fence_->GetCompletedValue() < fenceValue) {
+    if (SUCCEEDED(fence_->SetEventOnCompletion(fenceValue, fenceEvent_.Get()))) {
+      WaitForSingleObjectEx(fenceEvent_.Get(), INFINITE, FALSE);
+    }
+  }
+  RetireCompletedUploads();
+}
+
+void TextureManager::Impl::UpdateStreaming() {
+  if (streamingTextures_.empty()) {
+    return;
+  }
+  const auto changes = residency_.Update(MaxStreamingLoadsPerFrame_);
+  residency_.BeginFrame();  // ここから次のUpdateまでのリクエストを集める
+  if (changes.empty()) {
+    return;
+  }
+
+  auto queue = streamingDevice_->commandQueue();
+  std::vector<Microsoft::WRL::ComPtr<ID3D12Heap>> evictedHeaps{};
+  std::vector<RequestPtr> loads{};
+  for (const auto& change : changes) {
+    auto tex = streamingIds_[change.id];
+    if (change.newMip > change.oldMip) {
+      // 破棄。割り当ての解除はキュー上で描画済みのコマンドの後に実行される
+      // 描画側は次の描画までにstreamingMinLodを見てSRVを作り直すこと
+      for (auto m = change.oldMip; m < change.newMip; ++m) {
+        MapTiles(queue, tex->resource.Get(), m, CountTiles(tex->tilings[m]),
+                 nullptr);
+        evictedHeaps.push_back(std::move(tex->heaps[m]));
+        tex->mipFences[m] = 0;
+        // デコード中ならやめさせる。終わっていても転送はしない
+        if (auto& pending = tex->mipRequests[m]) {
+          auto expected = TextureLoadState::Pending;
+          if (!pending->state.compare_exchange_strong(
+                  expected, TextureLoadState::Canceled)) {
+            pending->cancelRequested = true;
+          }
+          pending.reset();
+        }
+      }
+      continue;
+    }
+
+    // ロード。タイルを割り当ててから、そのミップをワーカーでデコードする
+    // 転送はデコードが終わったUpdateで行う
+    const auto m = change.newMip;
+    tex->heaps[m] = CreateTileHeap(streamingDevice_->device(),
+                                   CountTiles(tex->tilings[m]));
+    MapTiles(queue, tex->resource.Get(), m, CountTiles(tex->tilings[m]),
+             tex->heaps[m].Get());
+    auto request = std::make_shared<TextureLoadHandle::Request>();
+    request->fileName = tex->fileName;
+    request->assetName = tex->assetName;
+    request->priority = StreamingMipPriority_;
+    request->kind = TextureLoadHandle::Request::Kind::StreamingMip;
+    request->firstMip = m;
+    tex->mipRequests[m] = request;
+    loads.push_back(std::move(request));
+  }
+
+  // 外したヒープはGPUが割り当て解除を終えてから解放する
+  if (!evictedHeaps.empty()) {
+    const auto value = ++fenceValue_;
+    queue->Signal(fence_.Get(), value);
+    for (auto& heap : evictedHeaps) {
+      retiredObjects_.push_back({value, std::move(heap)});
+    }
+  }
+
+  for (auto& request : loads) {
+    QueueRequest(streamingDevice_, std::move(request));
+  }
+}
+
+bool TextureManager::Impl::FindDuplicate(const std::string& assetName,
+                                         std::uint64_t contentHash) {
+  if (contentHash == 0) {
+    return false;
+  }
+  const auto it = contentIndex_.find(contentHash);
+  if (it == std::end(contentIndex_)) {
+    return false;
+  }
+  if (!textures_.Insert(assetName, it->second)) {
+    return true;  // 別のスレッドが先に登録した
+  }
+  it->second->unit().lastUsedFrame = frame_.load();
+  ++stats_.dedupHits;
+  return true;
+}
+
+void TextureManager::Impl::RegisterTexture(std::unique_ptr<Texture> tex) {
+  std::shared_ptr<Texture> shared = std::move(tex);
+  auto& unit = shared->unit();
+  unit.lastUsedFrame = frame_.load();
+  if (!textures_.Insert(shared->assetName, shared)) {
+    return;  // 同じ名前で先に登録されていた
+  }
+  ++stats_.misses;
+
+  // テクスチャ配列は最初の要素を登録したときに、配列全体の大きさを1回だけ数える
+  if (unit.isEvictable && unit.sizeBytes == 0) {
+    Microsoft::WRL::ComPtr<ID3D12Device> device{};
+    unit.resource->GetDevice(IID_PPV_ARGS(device.GetAddressOf()));
+    const auto desc = unit.resource->GetDesc();
+    unit.sizeBytes = device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+    residentBytes_ += unit.sizeBytes;
+  }
+  if (shared->contentHash != 0) {
+    contentIndex_.emplace(shared->contentHash, std::move(shared));
+  }
+}
+
+void TextureManager::Impl::EvictTextures() {
+  const auto frame = ++frame_;
+  const bool isOverBudget =
+      device_ && fence_ && residentBytes_ > memoryBudget_;
+
+  // 参照されているものは毎フレーム使われているとみなす
+  // 別名やテクスチャ配列の要素は、まとめて数える単位(unit)で見る
+  std::vector<std::shared_ptr<Texture>> candidates{};
+  textures_.ForEach(
+      [&](const std::string&, const std::shared_ptr<Texture>& tex) {
+        auto& unit = tex->unit();
+        if (unit.refCount > 0) {
+          unit.lastUsedFrame = frame;
+        } else if (isOverBudget && unit.isEvictable) {
+          candidates.push_back(tex->owner ? tex->owner : tex);
+        }
+      });
+  if (!isOverBudget) {
+    return;
+  }
+
+  // 別名や同じ配列の要素で同じものが何度も入っているので1つにする
+  std::sort(std::begin(candidates), std::end(candidates));
+  candidates.erase(std::unique(std::begin(candidates), std::end(candidates)),
+                   std::end(candidates));
+  // 集めている間に別のスレッドが参照を取ったものは残す
+  candidates.erase(
+      std::remove_if(std::begin(candidates), std::end(candidates),
+                     [](const std::shared_ptr<Texture>& tex) {
+                       return tex->refCount > 0;
+                     }),
+      std::end(candidates));
+
+  std::sort(std::begin(candidates), std::end(candidates),
+            [](const std::shared_ptr<Texture>& a,
+               const std::shared_ptr<Texture>& b) {
+              return a->lastUsedFrame < b->lastUsedFrame;
+            });
+
+  std::vector<std::shared_ptr<Texture>> victims{};
+  for (auto& tex : candidates) {
+    if (residentBytes_ <= memoryBudget_) {
+      break;
+    }
+    const auto it = contentIndex_.find(tex->contentHash);
+    if (it != std::end(contentIndex_) && it->second == tex) {
+      contentIndex_.erase(it);
+    }
+    residentBytes_ -= tex->sizeBytes;
+    ++stats_.evictions;
+    victims.push_back(std::move(tex));
+  }
+  if (victims.empty()) {
+    return;  // 全部参照されている
+  }
+
+  // 別名や配列の要素も一緒に消す
+  textures_.Modify([&victims](TextureRegistry<Texture>::Map& map) {
+    for (auto it = std::begin(map); it != std::end(map);) {
+      const auto unit = &it->second->unit();
+      if (std::find_if(std::begin(victims), std::end(victims),
+                       [unit](const std::shared_ptr<Texture>& victim) {
+                         return victim.get() == unit;
+                       }) != std::end(victims)) {
+        it = map.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  });
+
+  // 描画済みのコマンドが使い終わってから解放する
+  // 消す直前に別のスレッドが参照を取っていたら、その参照が消えるまで生きている
+  const auto value = ++fenceValue_;
+  device_->commandQueue()->Signal(fence_.Get(), value);
+  for (const auto& tex : victims) {
+    retiredObjects_.push_back({value, tex->resource});
+  }
+}
+
+//-------------------------------------------------------------------
+// TextureManager
+//-------------------------------------------------------------------
+TextureManager::TextureManager() : impl_(new Impl()) {}
+
+TextureManager::~TextureManager() {}
+
+bool TextureManager::LoadWICTextureFromFile(Device* device,
+                                            const std::wstring& fileName,
+                                            const std::string& assetName) {
+  // テクスチャの存在チェック
+  if (impl_->IsLoaded(assetName)) {
+    return true;
+  }
+
+  // ファイルは1回だけ読み、そのバイト列でハッシュを取ってデコードする
+  // 中身が同じテクスチャがロード済みなら別名にして共有する
+  std::vector<std::uint8_t> fileData{};
+  if (!ReadFileBytes(fileName, fileData)) {
+    return false;
+  }
+  const auto contentHash = HashBytes(fileData.data(), fileData.size());
+  if (impl_->FindDuplicate(assetName, contentHash)) {
+    return true;
+  }
+
+  // バッチの外で呼ばれたら、1個だけのバッチにして転送完了まで待つ
+  const bool isImmediate = !impl_->isBatching_;
+  if (isImmediate) {
+    BeginUploadBatch(device);
+  }
+
+  // ロード時に必要な変数を確保
+  ID3D12Resource* resource;
+  std::unique_ptr<uint8_t[]> decodedData{};
+  D3D12_SUBRESOURCE_DATA subresource{};
+
+  // LoadWICTextureFromMemoryでWICをつかってbmp,png,jpgとかが読める
+  // 読み込んでおいたファイルの中身をデコード
+  // WIC_LOADER_MIP_RESERVEでミップの分もテクスチャを確保しておく
+  auto hr = DirectX::LoadWICTextureFromMemoryEx(
+      device->device(),  // デバイス
+      fileData.data(),   // ファイルの中身
+      fileData.size(),   // ファイルの大きさ
+      0,                 // サイズ制限なし
+      D3D12_RESOURCE_FLAG_NONE,
+      DirectX::WIC_LOADER_MIP_RESERVE,
+      &resource,     // D3Dで使用可能になったテクスチャデータ
+      decodedData,   // ファイルから読み込まれたバイトデータ
+      subresource);  // テクスチャデータのアドレスとデータの並びが返ってくる
+
+  if (FAILED(hr)) {
+    if (isImmediate) {
+      EndUploadBatch();
+    }
+    return false;
+  }
+
+  // 転送待ちに積む
+  // 実際のコマンド記録はEndUploadBatchでまとめてやる
+  {
+    // ミップはEndUploadBatchでほかのテクスチャとまとめて作る
+    Impl::PendingUpload upload{};
+    hr = PrepareMipTexture(device->device(), &resource, upload.generateMips,
+                           upload.srgb);
+    if (FAILED(hr)) {
+      resource->Release();
+      if (isImmediate) {
+        EndUploadBatch();
+      }
+      return false;
+    }
+    upload.resource = resource;
+    upload.data = std::move(decodedData);
+    upload.subresources.push_back(subresource);
+    impl_->pendingUploads_.emplace_back(std::move(upload));
+  }
+
+  // データを格納
+  // 同じキューで後から積むコマンドは転送後に実行されるので先に登録してOK
+  {
+    auto tex = std::make_unique<Impl::Texture>();
+    tex->fileName = fileName;
+    tex->assetName = assetName;
+    tex->resource.Attach(resource);
+    tex->contentHash = contentHash;
+    impl_->RegisterTexture(std::move(tex));
+  }
+
+  if (isImmediate) {
+    EndUploadBatch();
+  }
+
+  // 使われなくなったテクスチャは予算を超えたときにUpdateで破棄する
+  return true;
+}
+
+bool TextureManager::LoadDDSTextureFromFile(Device* device,
+                                            const std::wstring& fileName,
+                                            const std::string& assetName) {
+  // テクスチャの存在チェック
+  if (impl_->IsLoaded(assetName)) {
+    return true;
+  }
+
+  // ddzはコンテナを読み、ddsはファイルをマップする
+  // そのバイト列で中身のハッシュを取るので、ファイルを読むのは1回だけ
+  lz::Container container{};
+  std::unique_ptr<DirectX::DDSMappedFile> mappedFile{};
+  std::uint64_t contentHash = 0;
+  if (IsDDZFile(fileName)) {
+    if (!lz::ReadContainer(fileName, container)) {
+      return false;
+    }
+    contentHash = HashBytes(container.file.data(), container.file.size());
+  } else {
+    mappedFile = std::make_unique<DirectX::DDSMappedFile>();
+    if (FAILED(mappedFile->Open(fileName.c_str()))) {
+      return false;
+    }
+    contentHash = HashBytes(mappedFile->data(), mappedFile->size());
+  }
+
+  // 中身が同じテクスチャがロード済みなら別名にして共有する
+  if (impl_->FindDuplicate(assetName, contentHash)) {
+    return true;
+  }
+
+  const bool isImmediate = !impl_->isBatching_;
+  if (isImmediate) {
+    BeginUploadBatch(device);
+  }
+
+  // ddsのサブリソースはファイルマップを直接指していて、
+  // UpdateSubresourcesが行ごとにマップからアップロードヒープへコピーする。
+  // ddzはここでアップロードヒープへ直接展開してしまう
+  ID3D12Resource* resource;
+  Microsoft::WRL::ComPtr<ID3D12Resource> uploadBuffer{};
+  std::vector<D3D12_SUBRESOURCE_DATA> subresources{};
+  HRESULT hr = S_OK;
+  if (mappedFile) {
+    hr = DirectX::LoadDDSTextureFromMemoryEx(
+        device->device(), mappedFile->data(), mappedFile->size(), 0,
+        D3D12_RESOURCE_FLAG_NONE, DirectX::DDS_LOADER_DEFAULT, &resource,
+        subresources);
+  } else {
+    hr = LoadDDZTexture(device->device(), container, &resource,
+                        uploadBuffer.GetAddressOf(), subresources);
+  }
+
+  if (FAILED(hr)) {
+    if (isImmediate) {
+      EndUploadBatch();
+    }
+    return false;
+  }
+
+  // 転送待ちに積む。マップはコマンドを記録するまで開いたまま
+  {
+    Impl::PendingUpload upload{};
+    upload.resource = resource;
+    upload.mappedFile = std::move(mappedFile);
+    upload.uploadBuffer = std::move(uploadBuffer);
+    upload.subresources = std::move(subresources);
+    impl_->pendingUploads_.emplace_back(std::move(upload));
+  }
+
+  {
+    auto tex = std::make_unique<Impl::Texture>();
+    tex->fileName = fileName;
+    tex->assetName = assetName;
+    tex->resource.Attach(resource);
+    tex->contentHash = contentHash;
+    impl_->RegisterTexture(std::move(tex));
+  }
+
+  if (isImmediate) {
+    EndUploadBatch();
+  }
+  return true;
+}
+
+bool TextureManager::LoadPNGTextureFromFile(Device* device,
+                                            const std::wstring& fileName,
+                                            const std::string& assetName) {
+  // テクスチャの存在チェック
+  if (impl_->IsLoaded(assetName)) {
+    return true;
+  }
+
+  // ファイルは1回だけ読み、そのバイト列でハッシュを取ってデコードする
+  // 中身が同じテクスチャがロード済みなら別名にして共有する
+  std::vector<std::uint8_t> fileData{};
+  if (!ReadFileBytes(fileName, fileData)) {
+    return false;
+  }
+  const auto contentHash = HashBytes(fileData.data(), fileData.size());
+  if (impl_->FindDuplicate(assetName, contentHash)) {
+    return true;
+  }
+
+  const bool isImmediate = !impl_->isBatching_;
+  if (isImmediate) {
+    BeginUploadBatch(device);
+  }
+
+  ID3D12Resource* resource;
+  std::unique_ptr<uint8_t[]> decodedData{};
+  D3D12_SUBRESOURCE_DATA subresource{};
+  auto hr = LoadPNGTexture(device->device(), fileData, &resource, decodedData,
+                           subresource);
+
+  if (FAILED(hr)) {
+    if (isImmediate) {
+      EndUploadBatch();
+    }
+    return false;
+  }
+
+  // ここから先はWICのときと同じ
+  {
+    // ミップはEndUploadBatchでほかのテクスチャとまとめて作る
+    Impl::PendingUpload upload{};
+    hr = PrepareMipTexture(device->device(), &resource, upload.generateMips,
+                           upload.srgb);
+    if (FAILED(hr)) {
+      resource->Release();
+      if (isImmediate) {
+        EndUploadBatch();
+      }
+      return false;
+    }
+    upload.resource = resource;
+    upload.data = std::move(decodedData);
+    upload.subresources.push_back(subresource);
+    impl_->pendingUploads_.emplace_back(std::move(upload));
+  }
+
+  {
+    auto tex = std::make_unique<Impl::Texture>();
+    tex->fileName = fileName;
+    tex->assetName = assetName;
+    tex->resource.Attach(resource);
+    tex->contentHash = contentHash;
+    impl_->RegisterTexture(std::move(tex));
+  }
+
+  if (isImmediate) {
+    EndUploadBatch();
+  }
+  return true;
+}
+
+std::vector<TextureLoadHandle> TextureManager::LoadPackedPNGTexturesAsync(
+    Device* device, const std::vector<std::wstring>& fileNames,
+    const std::vector<std::string>& assetNames) {
+  // 組み分けはヘッダの大きさだけで決める
+  // 対象外のものは大きさを最大にして組に入らないようにしておく
+  std::vector<pack::TextureDesc> descs(fileNames.size());
+  for (std::size_t i = 0; i < fileNames.size(); ++i) {
+    auto& desc = descs[i];
+    desc.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    if (impl_->resource(assetNames[i]) ||
+        impl_->requests_.count(assetNames[i]) != 0 ||
+        !png::ReadSize(fileNames[i], desc.width, desc.height)) {
+      desc.width = desc.height = UINT32_MAX;
+    }
+  }
+  const auto groups =
+      pack::GroupForArrays(descs, Impl::MaxPackedTextureSize_);
+
+  // デコードとミップの生成はワーカーで要素ごとに行い、
+  // 組の全員がそろったらUpdateで1つの配列にして転送する
+  std::vector<TextureLoadHandle> handles(fileNames.size());
+  for (const auto& group : groups) {
+    auto shared = std::make_shared<TextureLoadHandle::Request::Group>();
+    shared->remaining = group.size();
+    std::vector<Impl::RequestPtr> members{};
+    for (const auto i : group) {
+      auto request = std::make_shared<TextureLoadHandle::Request>();
+      request->fileName = fileNames[i];
+      request->assetName = assetNames[i];
+      request->kind = TextureLoadHandle::Request::Kind::ArraySlice;
+      request->group = shared;
+      shared->members.push_back(request);
+      handles[i].request_ = request;
+      members.push_back(std::move(request));
+    }
+    // 数をそろえてから積む。途中で組の最後と判断されないように
+    for (auto& request : members) {
+      impl_->QueueRequest(device, std::move(request));
+    }
+  }
+  return handles;
+}
+
+TextureLoadHandle TextureManager::LoadStreamingTextureAsync(
+    Device* device, const std::wstring& fileName, const std::string& assetName,
+    int priority) {
+  // ロード済み・リクエスト中なら普通の非同期ロードと同じハンドルを返す
+  // 予約リソースが使えないときやPNG以外も普通にロードする
+  D3D12_FEATURE_DATA_D3D12_OPTIONS options{};
+  const bool isTiledSupported =
+      SUCCEEDED(device->device()->CheckFeatureSupport(
+          D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options))) &&
+      options.TiledResourcesTier != D3D12_TILED_RESOURCES_TIER_NOT_SUPPORTED;
+  std::uint32_t width = 0;
+  std::uint32_t height = 0;
+  if (impl_->resource(assetName) || impl_->requests_.count(assetName) != 0 ||
+      !IsPNGFile(fileName) || !isTiledSupported ||
+      !png::ReadSize(fileName, width, height)) {
+    return LoadWICTextureAsync(device, fileName, assetName, priority);
+  }
+
+  // 予約リソースはアドレスだけ確保してメモリは持たない
+  // メモリはミップごとにヒープを作ってタイル単位で割り当てる
+  auto tex = std::make_unique<Impl::StreamingTexture>();
+  const auto mipCount = mip::CountMips(width, height);
+  auto desc = CD3DX12_RESOURCE_DESC::Tex2D(
+      DXGI_FORMAT_R8G8B8A8_UNORM, width, height, 1,
+      static_cast<UINT16>(mipCount), 1, 0, D3D12_RESOURCE_FLAG_NONE,
+      D3D12_TEXTURE_LAYOUT_64KB_UNDEFINED_SWIZZLE);
+  auto hr = device->device()->CreateReservedResource(
+      &desc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+      IID_PPV_ARGS(tex->resource.GetAddressOf()));
+  if (FAILED(hr)) {
+    return LoadWICTextureAsync(device, fileName, assetName, priority);
+  }
+
+  UINT numTiles = 0;
+  D3D12_PACKED_MIP_INFO packedMipInfo{};
+  D3D12_TILE_SHAPE tileShape{};
+  UINT numSubresourceTilings = mipCount;
+  tex->tilings.resize(mipCount);
+  device->device()->GetResourceTiling(tex->resource.Get(), &numTiles,
+                                      &packedMipInfo, &tileShape,
+                                      &numSubresourceTilings, 0,
+                                      tex->tilings.data());
+  // ミップテールのないテクスチャは常駐させる最小単位がないので普通にロードする
+  if (packedMipInfo.NumPackedMips == 0) {
+    return LoadWICTextureAsync(device, fileName, assetName, priority);
+  }
+  tex->standardMips = packedMipInfo.NumStandardMips;
+  tex->tailTiles = packedMipInfo.NumTilesForPackedMips;
+  tex->fileName = fileName;
+  tex->assetName = assetName;
+  tex->heaps.resize(tex->standardMips);
+  tex->mipFences.assign(tex->standardMips, 0);
+  tex->mipRequests.resize(tex->standardMips);
+
+  // ミップテールのタイルは先に割り当てておく。中身はデコードの後で転送する
+  impl_->CreateFence(device);
+  impl_->streamingDevice_ = device;
+  tex->tailHeap = CreateTileHeap(device->device(), tex->tailTiles);
+  MapTiles(device->commandQueue(), tex->resource.Get(), tex->standardMips,
+           tex->tailTiles, tex->tailHeap.Get());
+
+  auto request = std::make_shared<TextureLoadHandle::Request>();
+  request->fileName = fileName;
+  request->assetName = assetName;
+  request->priority = priority;
+  request->kind = TextureLoadHandle::Request::Kind::StreamingTail;
+  request->firstMip = tex->standardMips;
+  impl_->pendingStreamingTextures_.emplace(assetName, std::move(tex));
+  impl_->QueueRequest(device, request);
+
+  TextureLoadHandle handle{};
+  handle.request_ = std::move(request);
+  return handle;
+}
+
+void TextureManager::SetStreamingBudget(std::uint64_t budgetBytes) {
+  impl_->residency_.SetBudget(budgetBytes);
+}
+
+void TextureManager::RequestStreamingMip(const std::string& assetName,
+                                         float screenPixels) {
+  const auto it = impl_->streamingTextures_.find(assetName);
+  if (it == std::end(impl_->streamingTextures_)) {
+    return;
+  }
+  const auto desc = it->second->resource->GetDesc();
+  const auto size = std::max(static_cast<std::uint32_t>(desc.Width),
+                             static_cast<std::uint32_t>(desc.Height));
+  impl_->residency_.RequestMip(
+      it->second->residencyId,
+      TextureResidency::ComputeRequiredMip(size, screenPixels));
+}
+
+bool TextureManager::IsStreaming(const std::string& assetName) const {
+  return impl_->streamingTextures_.count(assetName) != 0;
+}
+
+std::uint32_t TextureManager::streamingMinLod(
+    const std::string& assetName) const {
+  const auto it = impl_->streamingTextures_.find(assetName);
+  if (it == std::end(impl_->streamingTextures_)) {
+    return 0;
+  }
+  // 転送の終わったミップが上から途切れずに並んでいるところまで使える
+  const auto& tex = *it->second;
+  auto mip = tex.standardMips;
+  while (mip > 0 && tex.mipFences[mip - 1] != 0 &&
+         impl_->IsUploadCompleted(tex.mipFences[mip - 1])) {
+    --mip;
+  }
+  return mip;
+}
+
+std::uint64_t TextureManager::streamingResidentBytes() const {
+  return impl_->residency_.residentBytes();
+}
+
+TextureLoadHandle TextureManager::LoadWICTextureAsync(
+    Device* device, const std::wstring& fileName, const std::string& assetName,
+    int priority) {
+  TextureLoadHandle handle{};
+
+  // ロード済みならすぐに使えるハンドルを返す
+  if (impl_->IsLoaded(assetName)) {
+    handle.request_ = std::make_shared<TextureLoadHandle::Request>();
+    handle.request_->fileName = fileName;
+    handle.request_->assetName = assetName;
+    handle.request_->state = TextureLoadState::Ready;
+    return handle;
+  }
+
+  // 同じアセットをリクエスト中ならそのハンドルを返す
+  {
+    auto it = impl_->requests_.find(assetName);
+    if (it != std::end(impl_->requests_)) {
+      handle.request_ = it->second;
+      return handle;
+    }
+  }
+
+  auto request = std::make_shared<TextureLoadHandle::Request>();
+  request->fileName = fileName;
+  request->assetName = assetName;
+  request->priority = priority;
+  impl_->QueueRequest(device, request);
+
+  handle.request_ = std::move(request);
+  return handle;
+}
+
+void TextureManager::Update() {
+  assert(!impl_->isBatching_);
+
+  // 転送の終わったテクスチャを使えるようにする
+  // フェンス値を見るだけなのでGPUは待たない
+  using Kind = TextureLoadHandle::Request::Kind;
+  impl_->RetireCompletedUploads();
+  {
+    // テクスチャ配列の要素は、同じ配列全体を持つownerを共有する
+    std::unordered_map<ID3D12Resource*, std::shared_ptr<Impl::Texture>>
+        owners{};
+    auto& uploading = impl_->uploadingRequests_;
+    auto it = std::begin(uploading);
+    while (it != std::end(uploading)) {
+      auto& request = *it;
+      if (!impl_->IsUploadCompleted(request->fenceValue)) {
+        ++it;
+        continue;
+      }
+      if (request->kind == Kind::StreamingTail) {
+        impl_->ActivateStreamingTexture(*request);
+      } else if (request->kind == Kind::ArraySlice) {
+        auto& owner = owners[request->resource.Get()];
+        if (!owner) {
+          owner = std::make_shared<Impl::Texture>();
+          owner->resource = request->resource;
+        }
+        auto tex = std::make_unique<Impl::Texture>();
+        tex->fileName = request->fileName;
+        tex->assetName = request->assetName;
+        tex->resource = request->resource;
+        tex->arraySlice = request->arraySlice;
+        tex->owner = owner;
+        impl_->RegisterTexture(std::move(tex));
+      } else if (!impl_->FindDuplicate(request->assetName,
+                                       request->contentHash)) {
+        // 同じ中身が先に転送を終えていたら、そちらを共有してこちらは捨てる
+        auto tex = std::make_unique<Impl::Texture>();
+        tex->fileName = request->fileName;
+        tex->assetName = request->assetName;
+        tex->resource = std::move(request->resource);
+        tex->contentHash = request->contentHash;
+        impl_->RegisterTexture(std::move(tex));
+      }
+      request->resource.Reset();
+      request->state = TextureLoadState::Ready;
+      impl_->requests_.erase(request->assetName);
+      it = uploading.erase(it);
+    }
+  }
+
+  // デコードの終わったテクスチャをまとめて転送する
+  {
+    std::vector<Impl::RequestPtr> decoded{};
+    {
+      std::lock_guard<std::mutex> lock(impl_->requestMutex_);
+      decoded.swap(impl_->decodedRequests_);
+    }
+
+    std::vector<Impl::RequestPtr> submitted{};
+    std::vector<std::vector<Impl::RequestPtr>> arrays{};
+    std::vector<std::pair<Impl::StreamingTexture*, UINT>> streamedMips{};
+    for (auto& request : decoded) {
+      // キャンセル・失敗していたら捨てる
+      auto expected = TextureLoadState::Decoded;
+      if (!request->state.compare_exchange_strong(
+              expected, TextureLoadState::Uploading)) {
+        continue;
+      }
+      // ストリーミングのミップは予約リソースのタイルへ転送するだけ
+      if (request->kind == Kind::StreamingMip) {
+        if (auto tex = impl_->QueueStreamingMipUpload(*request)) {
+          streamedMips.emplace_back(tex, request->firstMip);
+        }
+        request->mips.clear();
+        request->state = TextureLoadState::Ready;
+        continue;
+      }
+      // テクスチャ配列は組ごとに集めてから転送する
+      // 組の全員はワーカーが同じ回にまとめて渡してくる
+      if (request->kind == Kind::ArraySlice) {
+        auto found = std::find_if(
+            std::begin(arrays), std::end(arrays),
+            [&request](const std::vector<Impl::RequestPtr>& members) {
+              return members[0]->group == request->group;
+            });
+        if (found == std::end(arrays)) {
+          arrays.emplace_back();
+          found = std::prev(std::end(arrays));
+        }
+        found->push_back(request);
+        continue;
+      }
+      // 同じ中身がロード済みなら転送しない
+      if (impl_->FindDuplicate(request->assetName, request->contentHash)) {
+        if (request->kind == Kind::StreamingTail) {
+          impl_->DiscardPendingStreamingTexture(request->assetName);
+        }
+        request->resource.Reset();
+        request->decodedData.reset();
+        request->mips.clear();
+        request->state = TextureLoadState::Ready;
+        impl_->requests_.erase(request->assetName);
+        continue;
+      }
+      Impl::PendingUpload upload{};
+      if (request->kind == Kind::StreamingTail) {
+        // ワーカーはミップテールだけ残してくる。ほかはロードするときにデコードする
+        auto& tex = impl_->pendingStreamingTextures_[request->assetName];
+        upload.resource = tex->resource;
+        upload.firstSubresource = tex->standardMips;
+      } else {
+        upload.resource = request->resource;
+        upload.data = std::move(request->decodedData);
+      }
+      upload.mips = std::move(request->mips);
+      upload.subresources = std::move(request->subresources);
+      impl_->pendingUploads_.emplace_back(std::move(upload));
+      submitted.push_back(request);
+    }
+    for (const auto& members : arrays) {
+      impl_->QueueArrayUpload(impl_->asyncDevice_, members, submitted);
+    }
+
+    if (!submitted.empty() || !streamedMips.empty()) {
+      impl_->device_ = impl_->asyncDevice_;
+      const auto value = impl_->Submit();  // ここでは待たない
+      for (auto& request : submitted) {
+        request->fenceValue = value;
+        impl_->uploadingRequests_.push_back(request);
+      }
+      for (auto& [tex, m] : streamedMips) {
+        tex->mipFences[m] = value;
+      }
+    }
+  }
+
+  // 失敗・キャンセルしたリクエストは忘れる。もう一度リクエストできるように
+  {
+    auto& requests = impl_->requests_;
+    for (auto it = std::begin(requests); it != std::end(requests);) {
+      const auto state = it->second->state.load();
+      if (state == TextureLoadState::Canceled ||
+          state == TextureLoadState::Failed) {
+        if (it->second->kind == Kind::StreamingTail) {
+          impl_->DiscardPendingStreamingTexture(it->first);
+        }
+        it = requests.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  // ストリーミングするテクスチャのミップを入れ替える
+  impl_->UpdateStreaming();
+
+  // 予算を超えていたら使われていないテクスチャを捨てる
+  impl_->EvictTextures();
+}
+
+void TextureManager::BeginUploadBatch(Device* device) {
+  assert(!impl_->isBatching_);  // 入れ子にはできない
+  impl_->CreateFence(device);
+  impl_->device_ = device;
+  impl_->isBatching_ = true;
+}
+
+std::uint64_t TextureManager::EndUploadBatch(bool waitForCompletion) {
+  assert(impl_->isBatching_);
+  const auto value = impl_->Submit();
+  impl_->isBatching_ = false;
+
+  if (waitForCompletion) {
+    impl_->WaitForUpload(value);
+  }
+  return value;
+}
+
+bool TextureManager::IsUploadCompleted(std::uint64_t fenceValue) const {
+  return impl_->IsUploadCompleted(fenceValue);
+}
+
+void TextureManager::WaitForUpload(std::uint64_t fenceValue) {
+  impl_->WaitForUpload(fenceValue);
 }
 
 Microsoft::WRL::ComPtr<ID3D12Resource> TextureManager::texture(
     const std::string& assetName) {
   return impl_->resource(assetName);
 }
+
+TextureRef TextureManager::Acquire(const std::string& assetName) {
+  TextureRef ref{};
+  auto tex = impl_->textures_.Find(assetName);
+  if (!tex) {
+    return ref;
+  }
+  tex->unit().lastUsedFrame = impl_->frame_.load();
+  ref.pin_ = std::make_shared<TextureRef::Pin>(std::move(tex));
+  return ref;
+}
+
+void TextureManager::SetMemoryBudget(std::uint64_t budgetBytes) {
+  impl_->memoryBudget_ = budgetBytes;
+}
+
+TextureCacheStats TextureManager::cacheStats() const {
+  auto stats = impl_->stats_;
+  stats.residentBytes = impl_->residentBytes_;
+  stats.textureCount = impl_->textures_.size();
+  return stats;
+}
+
+std::uint32_t TextureManager::textureSlice(const std::string& assetName) const {
+  const auto tex = impl_->textures_.Find(assetName);
+  return tex ? tex->arraySlice : 0;
+}
+
+//-------------------------------------------------------------------
+// TextureRef
+//-------------------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D12Resource> TextureRef::resource() const {
+  return pin_ ? pin_->texture->resource : nullptr;
+}
+
+//-------------------------------------------------------------------
+// TextureLoadHandle
+//-------------------------------------------------------------------
+TextureLoadState TextureLoadHandle::state() const {
+  if (!request_) {
+    return TextureLoadState::Failed;
+  }
+  return request_->state.load();
+}
+
+bool TextureLoadHandle::IsDone() const {
+  const auto s = state();
+  return s == TextureLoadState::Ready || s == TextureLoadState::Canceled ||
+         s == TextureLoadState::Failed;
+}
+
+bool TextureLoadHandle::Cancel() {
+  if (!request_) {
+    return false;
+  }
+  // デコード中ならワーカーがデコード後にこのフラグを見て捨てる
+  request_->cancelRequested = true;
+
+  auto expected = TextureLoadState::Pending;
+  if (request_->state.compare_exchange_strong(expected,
+                                              TextureLoadState::Canceled)) {
+    return true;
+  }
+  expected = TextureLoadState::Decoded;
+  if (request_->state.compare_exchange_strong(expected,
+                                              TextureLoadState::Canceled)) {
+    return true;
+  }
+  expected = request_->state.load();
+  return expected == TextureLoadState::Decoding ||
+         expected == TextureLoadState::Canceled;
+}
+
+const std::string& TextureLoadHandle::assetName() const {
+  static const std::string empty{};
+  return request_ ? request_->assetName : empty;
+}
 }  // namespace dxapp
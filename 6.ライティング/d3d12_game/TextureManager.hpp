@@ -4,6 +4,109 @@
 namespace dxapp {
 class Device;
 
+/*!
+ * @brief 非同期ロードの進み具合
+ */
+enum class TextureLoadState {
+  Pending = 0,  //!< ワーカースレッドの順番待ち
+  Decoding,     //!< ワーカースレッドでデコード中
+  Decoded,      //!< デコード済み。GPUへの転送待ち
+  Uploading,    //!< GPUへ転送中
+  Ready,        //!< 使用可能
+  Canceled,     //!< キャンセルされた
+  Failed,       //!< ロード失敗
+};
+
+/*!
+ * @brief 非同期ロードのハンドル
+ * @details コピーしても同じリクエストを指す。状態の確認は待ちが発生しない
+ */
+class TextureLoadHandle {
+ public:
+  /*!
+   * @brief コンストラクタ
+   */
+  TextureLoadHandle() = default;
+
+  /*!
+   * @brief ロードの状態を取得
+   */
+  TextureLoadState state() const;
+
+  /*!
+   * @brief テクスチャが使用可能か
+   */
+  bool IsReady() const { return state() == TextureLoadState::Ready; }
+
+  /*!
+   * @brief 処理が終わったか(成功・失敗・キャンセルのどれか)
+   */
+  bool IsDone() const;
+
+  /*!
+   * @brief ロードをキャンセルする
+   * @return GPUへの転送前ならtrue。転送が始まっていたらキャンセルできない
+   */
+  bool Cancel();
+
+  /*!
+   * @brief リクエストしたアセット名
+   */
+  const std::string& assetName() const;
+
+  /*!
+   * @brief 有効なハンドルか
+   */
+  explicit operator bool() const { return request_ != nullptr; }
+
+  struct Request;  //!< リクエストの実態。TextureManager.cppで定義
+
+ private:
+  friend class TextureManager;
+  std::shared_ptr<Request> request_{};
+};
+
+/*!
+ * @brief テクスチャの参照
+ * @details 参照が1つでも残っている間はテクスチャは破棄されない。
+ *          コピーしても同じ参照を指す
+ */
+class TextureRef {
+ public:
+  /*!
+   * @brief コンストラクタ
+   */
+  TextureRef() = default;
+
+  /*!
+   * @brief テクスチャの実態
+   */
+  Microsoft::WRL::ComPtr<ID3D12Resource> resource() const;
+
+  /*!
+   * @brief 有効な参照か
+   */
+  explicit operator bool() const { return pin_ != nullptr; }
+
+  struct Pin;  //!< 参照カウントを持つ実態。TextureManager.cppで定義
+
+ private:
+  friend class TextureManager;
+  std::shared_ptr<Pin> pin_{};
+};
+
+/*!
+ * @brief テクスチャキャッシュの統計
+ */
+struct TextureCacheStats {
+  std::uint64_t hits{0};       //!< ロード済みのアセット名でロードされた回数
+  std::uint64_t dedupHits{0};  //!< 別名で同じ中身がロード済みだった回数
+  std::uint64_t misses{0};     //!< 実際にデコード・転送した回数
+  std::uint64_t evictions{0};  //!< 予算を超えて破棄した回数
+  std::uint64_t residentBytes{0};  //!< 予算に数えているVRAMの使用量
+  std::size_t textureCount{0};     //!< 保持しているアセット名の数(別名を含む)
+};
+
 class TextureManager {
  public:
   /*!
@@ -23,16 +126,181 @@ class TextureManager {
 
   /*!
    * @brief WICフォーマットの画像をテクスチャとしてロード
+   * @details BeginUploadBatch～EndUploadBatchの間で呼ぶと転送はまとめて行う。
+   *          バッチの外で呼んだときは今まで通り転送完了まで待つ。
+   *          ミップチェーンはEndUploadBatchでCPUで作って一緒に転送する
    */
   bool LoadWICTextureFromFile(Device* device, const std::wstring& fileName,
                               const std::string& assetName);
 
   /*!
-   * @brief オブジェクトの破棄。SingletonFinalizerが呼び出す
+   * @brief DDSファイルをテクスチャとしてロード
+   * @details ファイルはメモリマップして、マップした領域からアップロードヒープへ
+   *          直接コピーする。途中でヒープにファイルを読み込まない。
+   *          拡張子が.ddzならLZコンテナとして読み、チャンクを並列に展開する
+   */
+  bool LoadDDSTextureFromFile(Device* device, const std::wstring& fileName,
+                              const std::string& assetName);
+
+  /*!
+   * @brief PNGファイルをテクスチャとしてロード
+   * @details WICを使わずPngDecoderでデコードする。結果はR8G8B8A8_UNORM
+   */
+  bool LoadPNGTextureFromFile(Device* device, const std::wstring& fileName,
+                              const std::string& assetName);
+
+  /*!
+   * @brief 小さいPNGを同じ大きさのものどうしテクスチャ配列にまとめて非同期でロード
+   * @details 組み分けはファイルのヘッダの大きさだけで決め、デコードとミップの
+   *          生成はワーカースレッドで行う。組の全員のデコードが終わってから
+   *          Updateで1つの配列にして転送する。デコードに失敗した要素は抜いて
+   *          残りでまとめる。まとめたテクスチャは各アセット名のtextureで配列が返り、
+   *          textureSliceで配列の何番目かがわかる。
+   *          まとめる相手がいないものや大きいもの、ロード済みのものは何もしない
+   * @param[in] device デバイス
+   * @param[in] fileNames ファイル名
+   * @param[in] assetNames fileNamesと同じ並びのアセット名
+   * @return fileNamesと同じ並びのハンドル。まとめなかったものは無効なハンドル
+   */
+  std::vector<TextureLoadHandle> LoadPackedPNGTexturesAsync(
+      Device* device, const std::vector<std::wstring>& fileNames,
+      const std::vector<std::string>& assetNames);
+
+  /*!
+   * @brief PNGファイルをミップ単位でストリーミングするテクスチャとして非同期でロード
+   * @details 予約リソースとミップテールのタイルはすぐに用意し、デコードと
+   *          ミップの生成はワーカースレッドで行う。ミップテールの転送が
+   *          終わったらReadyになり、細かいミップはRequestStreamingMipで
+   *          必要とされたものを予算内でロードする。
+   *          CPU側にはピクセルを残さず、ミップをロードするたびにワーカーで
+   *          デコードし直す。
+   *          予約リソース(タイルリソース)に対応していないハードウェアや
+   *          PNG以外のファイルはLoadWICTextureAsyncでロードする
+   * @param[in] priority 優先度。大きいほど先にデコードする
+   */
+  TextureLoadHandle LoadStreamingTextureAsync(Device* device,
+                                              const std::wstring& fileName,
+                                              const std::string& assetName,
+                                              int priority = 0);
+
+  /*!
+   * @brief ストリーミングで常駐させてよいバイト数を設定する
+   */
+  void SetStreamingBudget(std::uint64_t budgetBytes);
+
+  /*!
+   * @brief ストリーミングするテクスチャの必要な解像度を伝える
+   * @details 毎フレーム、描画するたびに呼ぶ。同じフレームで何度呼んでもよい。
+   *          ストリーミングしないテクスチャなら何もしない
+   * @param[in] assetName アセット名
+   * @param[in] screenPixels UVの0～1が画面上で占めるピクセル数
+   */
+  void RequestStreamingMip(const std::string& assetName, float screenPixels);
+
+  /*!
+   * @brief ミップ単位でストリーミングしているテクスチャか
+   */
+  bool IsStreaming(const std::string& assetName) const;
+
+  /*!
+   * @brief サンプリングしてよい一番細かいミップ
+   * @details SRVのMostDetailedMipとResourceMinLODClampに使う。
+   *          ストリーミングしないテクスチャは0
+   */
+  std::uint32_t streamingMinLod(const std::string& assetName) const;
+
+  /*!
+   * @brief ストリーミングで常駐しているバイト数
+   */
+  std::uint64_t streamingResidentBytes() const;
+
+  /*!
+   * @brief WICフォーマットの画像を非同期でロードする
+   * @details デコードはワーカースレッドで行い、GPUへの転送はUpdateで行う。
+   *          pngはWICを通さずPngDecoderでデコードする。
+   *          転送が終わるまではtextureはnullptrを返すのでダミーを使うこと
+   * @param[in] device デバイス
+   * @param[in] fileName ファイル名
+   * @param[in] assetName アセット名
+   * @param[in] priority 優先度。大きいほど先にデコードする
+   * @return ロード状態を確認するためのハンドル
+   */
+  TextureLoadHandle LoadWICTextureAsync(Device* device,
+                                        const std::wstring& fileName,
+                                        const std::string& assetName,
+                                        int priority = 0);
+
+  /*!
+   * @brief 非同期ロードの更新。毎フレーム呼ぶ
+   * @details デコードの終わったテクスチャをまとめてGPUに送り、
+   *          転送の終わったテクスチャを使用可能にする。
+   *          ストリーミングするテクスチャのミップのロードと破棄もここで行う。
+   *          GPUは待たない
+   */
+  void Update();
+
+  /*!
+   * @brief テクスチャ転送のバッチを開始する
+   * @details EndUploadBatchを呼ぶまでのロードはコマンドの記録待ちになる
+   * @param[in] device デバイス
+   */
+  void BeginUploadBatch(Device* device);
+
+  /*!
+   * @brief バッチに積んだテクスチャを1つのコマンドリストでGPUに転送する
+   * @param[in] waitForCompletion trueなら転送完了まで待つ
+   * @return 転送完了の確認に使うフェンス値
+   */
+  std::uint64_t EndUploadBatch(bool waitForCompletion = true);
+
+  /*!
+   * @brief 転送が完了しているかを調べる。待ちはしない
+   * @param[in] fenceValue EndUploadBatchが返したフェンス値
+   */
+  bool IsUploadCompleted(std::uint64_t fenceValue) const;
+
+  /*!
+   * @brief 転送完了まで待つ
+   * @param[in] fenceValue EndUploadBatchが返したフェンス値
+   */
+  void WaitForUpload(std::uint64_t fenceValue);
+
+  /*!
+   * @brief テクスチャの取得
+   * @details ロード中でも待たないので、どのスレッドから呼んでもよい
+   * @return ロードされていなければnullptr
    */
   Microsoft::WRL::ComPtr<ID3D12Resource> texture(const std::string& assetName);
 
+  /*!
+   * @brief テクスチャ配列の何番目か。まとめていないテクスチャは0
+   * @details textureと同じく、どのスレッドから呼んでもよい
+   */
+  std::uint32_t textureSlice(const std::string& assetName) const;
+
+  /*!
+   * @brief テクスチャの参照を取得する
+   * @details 参照を持っている間は予算を超えても破棄されない。
+   *          textureと同じく、どのスレッドから呼んでもよい
+   * @return ロードされていなければ無効な参照
+   */
+  TextureRef Acquire(const std::string& assetName);
+
+  /*!
+   * @brief テクスチャに使ってよいVRAMの予算を設定する
+   * @details 超えたらUpdateで、参照のないテクスチャを使われていない順に破棄する。
+   *          ストリーミングするテクスチャはSetStreamingBudgetの方で管理する
+   */
+  void SetMemoryBudget(std::uint64_t budgetBytes);
+
+  /*!
+   * @brief キャッシュの統計を取得
+   */
+  TextureCacheStats cacheStats() const;
+
  private:
+  friend struct TextureRef::Pin;
+
   // これはpImplパターン
   // 詳細な実装は内部クラスImplになげる
   // これにより外部のプログラム対してがっつり隠蔽できる
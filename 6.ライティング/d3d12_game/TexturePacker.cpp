@@ -0,0 +1,226 @@
+﻿#include "TexturePacker.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace dxapp {
+namespace pack {
+
+namespace {
+std::uint32_t AlignUp(std::uint32_t value, std::uint32_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+std::uint32_t NextPowerOfTwo(std::uint64_t value) {
+  std::uint32_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+}  // namespace
+
+std::vector<std::vector<std::size_t>> GroupForArrays(
+    const std::vector<TextureDesc>& descs, std::uint32_t maxSize) {
+  std::vector<std::vector<std::size_t>> groups{};
+  std::vector<bool> isGrouped(descs.size(), false);
+  for (std::size_t i = 0; i < descs.size(); ++i) {
+    const auto& desc = descs[i];
+    if (isGrouped[i] || desc.width > maxSize || desc.height > maxSize) {
+      continue;
+    }
+    std::vector<std::size_t> group{i};
+    for (auto j = i + 1; j < descs.size(); ++j) {
+      const auto& other = descs[j];
+      if (!isGrouped[j] && other.width == desc.width &&
+          other.height == desc.height && other.format == desc.format) {
+        group.push_back(j);
+        isGrouped[j] = true;
+      }
+    }
+    if (group.size() >= 2) {
+      groups.emplace_back(std::move(group));
+    }
+  }
+  return groups;
+}
+
+//-------------------------------------------------------------------
+// SkylinePacker
+//-------------------------------------------------------------------
+SkylinePacker::SkylinePacker(std::uint32_t width, std::uint32_t height)
+    : width_(width), height_(height) {
+  skyline_.push_back({0, 0, width});
+}
+
+bool SkylinePacker::Fit(std::size_t index, std::uint32_t width,
+                        std::uint32_t height, std::uint32_t& y) const {
+  const auto x = skyline_[index].x;
+  if (x + width > width_) {
+    return false;
+  }
+  // 置く幅にかかる区間の一番高いところに乗せる
+  y = 0;
+  std::uint32_t remaining = width;
+  for (auto i = index; remaining > 0; ++i) {
+    y = std::max(y, skyline_[i].y);
+    if (y + height > height_) {
+      return false;
+    }
+    remaining -= std::min(remaining, skyline_[i].width);
+  }
+  return true;
+}
+
+bool SkylinePacker::Insert(std::uint32_t width, std::uint32_t height,
+                           PackRect& rect) {
+  if (width == 0 || height == 0) {
+    return false;
+  }
+
+  // 下端が一番低くなる場所、同じなら左
+  auto best = skyline_.size();
+  std::uint32_t bestY = 0;
+  for (std::size_t i = 0; i < skyline_.size(); ++i) {
+    std::uint32_t y = 0;
+    if (Fit(i, width, height, y) &&
+        (best == skyline_.size() || y + height < bestY + height)) {
+      best = i;
+      bestY = y;
+    }
+  }
+  if (best == skyline_.size()) {
+    return false;
+  }
+
+  rect = {skyline_[best].x, bestY, width, height};
+  usedArea_ += std::uint64_t(width) * height;
+
+  // 置いた矩形の上端を新しい区間にして、隠れた区間を削る
+  skyline_.insert(skyline_.begin() + best, {rect.x, bestY + height, width});
+  const auto right = rect.x + width;
+  auto i = best + 1;
+  while (i < skyline_.size() && skyline_[i].x < right) {
+    auto& node = skyline_[i];
+    const auto nodeRight = node.x + node.width;
+    if (nodeRight <= right) {
+      skyline_.erase(skyline_.begin() + i);
+      continue;
+    }
+    node.width = nodeRight - right;
+    node.x = right;
+    break;
+  }
+
+  // 同じ高さの隣り合う区間はつなげる
+  for (std::size_t j = 0; j + 1 < skyline_.size();) {
+    if (skyline_[j].y == skyline_[j + 1].y) {
+      skyline_[j].width += skyline_[j + 1].width;
+      skyline_.erase(skyline_.begin() + j + 1);
+    } else {
+      ++j;
+    }
+  }
+  return true;
+}
+
+//-------------------------------------------------------------------
+// アトラス
+//-------------------------------------------------------------------
+bool PackAtlas(const std::vector<TextureDesc>& sizes, std::uint32_t maxSize,
+               std::uint32_t gutter, std::uint32_t alignment,
+               AtlasLayout& layout) {
+  layout = AtlasLayout{};
+  if (sizes.empty()) {
+    return true;
+  }
+  alignment = std::max(1u, alignment);
+
+  // 余白込みの大きさ
+  std::vector<TextureDesc> cells(sizes.size());
+  std::uint64_t cellArea = 0;
+  std::uint64_t textureArea = 0;
+  std::uint32_t maxCell = 0;
+  for (std::size_t i = 0; i < sizes.size(); ++i) {
+    cells[i].width = AlignUp(sizes[i].width + gutter * 2, alignment);
+    cells[i].height = AlignUp(sizes[i].height + gutter * 2, alignment);
+    cellArea += std::uint64_t(cells[i].width) * cells[i].height;
+    textureArea += std::uint64_t(sizes[i].width) * sizes[i].height;
+    maxCell = std::max({maxCell, cells[i].width, cells[i].height});
+  }
+
+  // 高いものから置くと隙間ができにくい
+  std::vector<std::size_t> order(sizes.size());
+  std::iota(order.begin(), order.end(), std::size_t(0));
+  std::stable_sort(order.begin(), order.end(),
+                   [&cells](std::size_t a, std::size_t b) {
+                     if (cells[a].height != cells[b].height) {
+                       return cells[a].height > cells[b].height;
+                     }
+                     return cells[a].width > cells[b].width;
+                   });
+
+  // 面積から見積もった大きさから、幅と高さを交互に倍にしていく
+  std::uint32_t side = NextPowerOfTwo(maxCell);
+  while (std::uint64_t(side) * side < cellArea) {
+    side <<= 1;
+  }
+  std::uint32_t width = side;
+  std::uint32_t height = std::uint64_t(side) * side / 2 >= cellArea &&
+                                 side / 2 >= maxCell
+                             ? side / 2
+                             : side;
+  while (width <= maxSize && height <= maxSize) {
+    SkylinePacker packer(width, height);
+    std::vector<PackRect> rects(sizes.size());
+    bool isPacked = true;
+    for (const auto i : order) {
+      PackRect cell{};
+      if (!packer.Insert(cells[i].width, cells[i].height, cell)) {
+        isPacked = false;
+        break;
+      }
+      rects[i] = {cell.x + gutter, cell.y + gutter, sizes[i].width,
+                  sizes[i].height};
+    }
+    if (isPacked) {
+      layout.width = width;
+      layout.height = height;
+      layout.rects = std::move(rects);
+      layout.efficiency =
+          double(textureArea) / (double(width) * double(height));
+      return true;
+    }
+    if (height < width) {
+      height <<= 1;
+    } else {
+      width <<= 1;
+    }
+  }
+  return false;
+}
+
+void BlitWithGutter(const std::uint8_t* src, std::size_t srcRowPitch,
+                    std::uint8_t* atlas, std::size_t atlasRowPitch,
+                    const PackRect& rect, std::uint32_t gutter) {
+  const auto width = static_cast<std::int64_t>(rect.width);
+  const auto height = static_cast<std::int64_t>(rect.height);
+  const auto g = static_cast<std::int64_t>(gutter);
+  for (auto y = -g; y < height + g; ++y) {
+    const auto sy = ((y % height) + height) % height;
+    const auto in = src + sy * srcRowPitch;
+    auto out = atlas + (rect.y + y) * atlasRowPitch + rect.x * 4;
+    // 中身はそのまま、左右の余白は反対側の端から持ってくる
+    std::memcpy(out, in, rect.width * 4);
+    for (std::int64_t x = 1; x <= g; ++x) {
+      const auto left = (((-x) % width) + width) % width;
+      const auto right = (x - 1) % width;
+      std::memcpy(out - x * 4, in + left * 4, 4);
+      std::memcpy(out + (width + x - 1) * 4, in + right * 4, 4);
+    }
+  }
+}
+
+}  // namespace pack
+}  // namespace dxapp
@@ -0,0 +1,132 @@
+﻿#pragma once
+// 小さいテクスチャをまとめる
+// テクスチャ配列にまとめる組み分けと、アトラスに詰めるスカイラインパッカー
+// クッカーでも使うので標準ライブラリだけで書いている
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dxapp {
+namespace pack {
+
+/*!
+ * @brief 詰めた位置
+ */
+struct PackRect {
+  std::uint32_t x{0};       //!< 左上のX
+  std::uint32_t y{0};       //!< 左上のY
+  std::uint32_t width{0};   //!< 幅
+  std::uint32_t height{0};  //!< 高さ
+};
+
+/*!
+ * @brief 詰めるテクスチャの情報
+ */
+struct TextureDesc {
+  std::uint32_t width{0};   //!< 幅
+  std::uint32_t height{0};  //!< 高さ
+  std::uint32_t format{0};  //!< フォーマット(比較にしか使わないので何の値でもよい)
+};
+
+/*!
+ * @brief テクスチャ配列にまとめられる組を作る
+ * @details 大きさとフォーマットが同じものを1組にする。
+ *          1つしかないものや、maxSizeより大きいものは組にしない
+ * @param[in] descs テクスチャの並び
+ * @param[in] maxSize まとめる最大の幅・高さ
+ * @return descsの添え字の組。組の中は入力順
+ */
+std::vector<std::vector<std::size_t>> GroupForArrays(
+    const std::vector<TextureDesc>& descs, std::uint32_t maxSize);
+
+/*!
+ * @brief スカイライン法で矩形を詰める
+ * @details 詰めた矩形の上端を折れ線(スカイライン)で持ち、
+ *          一番下に置ける場所に左から置いていく
+ */
+class SkylinePacker {
+ public:
+  /*!
+   * @brief コンストラクタ
+   * @param[in] width 詰める領域の幅
+   * @param[in] height 詰める領域の高さ
+   */
+  SkylinePacker(std::uint32_t width, std::uint32_t height);
+
+  /*!
+   * @brief 矩形を1つ置く
+   * @param[out] rect 置いた位置
+   * @return 置けなければfalse
+   */
+  bool Insert(std::uint32_t width, std::uint32_t height, PackRect& rect);
+
+  /*!
+   * @brief 置いた矩形の面積の合計
+   */
+  std::uint64_t usedArea() const { return usedArea_; }
+
+ private:
+  //! スカイラインの1区間
+  struct Node {
+    std::uint32_t x;      //!< 左端
+    std::uint32_t y;      //!< 高さ
+    std::uint32_t width;  //!< 幅
+  };
+
+  /*!
+   * @brief index番目の区間から置いたときの下端を求める
+   * @return 置けなければfalse
+   */
+  bool Fit(std::size_t index, std::uint32_t width, std::uint32_t height,
+           std::uint32_t& y) const;
+
+  std::uint32_t width_;
+  std::uint32_t height_;
+  std::vector<Node> skyline_{};
+  std::uint64_t usedArea_{0};
+};
+
+/*!
+ * @brief アトラスの配置
+ */
+struct AtlasLayout {
+  std::uint32_t width{0};         //!< アトラスの幅
+  std::uint32_t height{0};        //!< アトラスの高さ
+  std::vector<PackRect> rects{};  //!< 入力順の配置(ガターを除いた位置)
+  double efficiency{0};           //!< テクスチャの面積 / アトラスの面積
+};
+
+/*!
+ * @brief アトラスの配置を決める
+ * @details 面積から見積もった2のべき乗の大きさから始めて、入らなければ広げる。
+ *          各テクスチャの周りにはgutterピクセルの余白を付け、
+ *          余白込みの位置をalignmentの倍数にそろえる。
+ *          alignmentが2^nならmip nまでは隣のテクスチャが混ざらない
+ * @param[in] sizes 各テクスチャの大きさ(formatは見ない)
+ * @param[in] maxSize アトラスの最大の幅・高さ
+ * @param[in] gutter 余白のピクセル数
+ * @param[in] alignment 配置の単位(1以上)
+ * @param[out] layout 配置
+ * @return maxSizeに収まらなければfalse
+ */
+bool PackAtlas(const std::vector<TextureDesc>& sizes, std::uint32_t maxSize,
+               std::uint32_t gutter, std::uint32_t alignment,
+               AtlasLayout& layout);
+
+/*!
+ * @brief アトラスにRGBA8のテクスチャを書き込む
+ * @details 余白には反対側の端のピクセルを繰り返して書く。
+ *          ラップのサンプリングで端をまたいでも見た目が変わらない
+ * @param[in] src テクスチャのピクセル
+ * @param[in] srcRowPitch テクスチャの1行のバイト数
+ * @param[out] atlas アトラスのピクセル
+ * @param[in] atlasRowPitch アトラスの1行のバイト数
+ * @param[in] rect PackAtlasが返した位置
+ * @param[in] gutter 余白のピクセル数
+ */
+void BlitWithGutter(const std::uint8_t* src, std::size_t srcRowPitch,
+                    std::uint8_t* atlas, std::size_t atlasRowPitch,
+                    const PackRect& rect, std::uint32_t gutter);
+
+}  // namespace pack
+}  // namespace dxapp
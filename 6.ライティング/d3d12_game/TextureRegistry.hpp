@@ -0,0 +1,242 @@
+﻿#pragma once
+// アセット名からテクスチャを引く表
+// 描画スレッドが毎フレーム引き、ロードしたスレッドが登録する。
+// 書く側は表をコピーして書き換えてから、ポインタを差し替えて公開する
+// (read-copy-update)。読む側は今の表のポインタをハザードポインタとして
+// 自分のスロットに書いてから引くだけで、ロックを取らず書く側も待たない。
+// 古い表は、どのスロットにも書かれていないことを確かめてから消す。
+// 書くのはロードと破棄のときだけなので、コピーの手間は問題にならない
+// D3D12には触らないので、Linuxでもスレッドを立てて動かせる
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dxapp {
+
+namespace registry {
+
+//! ロックを取らずに読めるスレッドの数。これを超えたスレッドは書く側と排他で読む
+constexpr std::size_t MaxReaderThreads = 64;
+
+//! スロットを持っていないことを表す番号
+constexpr std::size_t NoReaderSlot = MaxReaderThreads;
+
+//! 使用中のスロット。プロセスで1つで、すべての表が同じ番号を使う
+inline std::atomic<bool> readerSlotUsed[MaxReaderThreads]{};
+
+/*!
+ * @brief スレッドごとのスロット番号
+ * @details 最初に読むときに空いている番号を取り、スレッドが終わったら返す
+ */
+class ReaderSlot {
+ public:
+  ReaderSlot() {
+    for (std::size_t i = 0; i < MaxReaderThreads; ++i) {
+      bool expected = false;
+      if (readerSlotUsed[i].compare_exchange_strong(expected, true)) {
+        index_ = i;
+        return;
+      }
+    }
+  }
+  ~ReaderSlot() {
+    if (index_ != NoReaderSlot) {
+      readerSlotUsed[index_].store(false);
+    }
+  }
+  ReaderSlot(const ReaderSlot&) = delete;
+  ReaderSlot& operator=(const ReaderSlot&) = delete;
+
+  std::size_t index() const { return index_; }
+
+ private:
+  std::size_t index_{NoReaderSlot};
+};
+
+/*!
+ * @brief 呼んだスレッドのスロット番号
+ * @return 空きがなければNoReaderSlot
+ */
+inline std::size_t ThisThreadReaderSlot() {
+  thread_local ReaderSlot slot{};
+  return slot.index();
+}
+
+}  // namespace registry
+
+/*!
+ * @brief 読み込みがロックを取らないアセット名の表
+ * @details 引いた値はshared_ptrなので、表から消されても持っている間は生きている
+ * @tparam T 登録する値の型
+ */
+template <class T>
+class TextureRegistry {
+ public:
+  //! 表の実態。一度公開したら書き換えない
+  using Map = std::unordered_map<std::string, std::shared_ptr<T>>;
+
+  /*!
+   * @brief コンストラクタ
+   */
+  TextureRegistry() : map_(new Map()) {}
+
+  /*!
+   * @brief デストラクタ
+   * @details 読んでいるスレッドがいないときに呼ぶこと
+   */
+  ~TextureRegistry() {
+    delete map_.load();
+    for (const auto map : retired_) {
+      delete map;
+    }
+  }
+
+  TextureRegistry(const TextureRegistry&) = delete;
+  TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+  /*!
+   * @brief 探す。どのスレッドから呼んでもよい
+   * @return なければnullptr
+   */
+  std::shared_ptr<T> Find(const std::string& name) const {
+    return Read([&name](const Map& map) -> std::shared_ptr<T> {
+      const auto it = map.find(name);
+      return it != map.end() ? it->second : nullptr;
+    });
+  }
+
+  /*!
+   * @brief 登録されている名前の数。どのスレッドから呼んでもよい
+   */
+  std::size_t size() const {
+    return Read([](const Map& map) { return map.size(); });
+  }
+
+  /*!
+   * @brief 今の表を読む。どのスレッドから呼んでもよい
+   * @details funcが返るまで表は消されない。
+   *          funcの中で同じ表を読むと、外側の表が守られなくなるので読まないこと
+   * @param[in] func R(const Map&)
+   * @return funcの戻り値
+   */
+  template <class Func>
+  auto Read(Func&& func) const {
+    const auto slot = registry::ThisThreadReaderSlot();
+    if (slot == registry::NoReaderSlot) {
+      // スロットが足りないときだけ書く側と排他にする
+      std::lock_guard<std::mutex> lock(writeMutex_);
+      return func(*map_.load(std::memory_order_relaxed));
+    }
+
+    // ハザードを書いた後に表が差し替わっていなければ、書く側がそれを見てくれる
+    auto& hazard = hazards_[slot].map;
+    auto map = map_.load(std::memory_order_acquire);
+    for (;;) {
+      hazard.store(map, std::memory_order_seq_cst);
+      const auto latest = map_.load(std::memory_order_seq_cst);
+      if (latest == map) {
+        break;
+      }
+      map = latest;
+    }
+
+    // funcが例外を投げてもハザードは消す
+    struct Clear {
+      std::atomic<const Map*>& hazard;
+      ~Clear() { hazard.store(nullptr, std::memory_order_release); }
+    } clear{hazard};
+    return func(*map);
+  }
+
+  /*!
+   * @brief すべての名前と値を順に渡す
+   * @details 書く側と排他で回す。読む側は待たせないので描画スレッドから呼んでもよい
+   * @param[in] func void(const std::string&, const std::shared_ptr<T>&)
+   */
+  template <class Func>
+  void ForEach(Func&& func) const {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    for (const auto& [name, value] : *map_.load(std::memory_order_relaxed)) {
+      func(name, value);
+    }
+  }
+
+  /*!
+   * @brief 登録する
+   * @return 同じ名前がもうあれば登録せずにfalse
+   */
+  bool Insert(const std::string& name, std::shared_ptr<T> value) {
+    bool isInserted = false;
+    Modify([&](Map& map) {
+      isInserted = map.emplace(name, std::move(value)).second;
+    });
+    return isInserted;
+  }
+
+  /*!
+   * @brief 表をまとめて書き換える
+   * @details 書き込み同士は順番に実行される。funcには表のコピーが渡され、
+   *          funcが返った後に読む側へ公開される
+   * @param[in] func void(Map&)
+   */
+  template <class Func>
+  void Modify(Func&& func) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    auto map = std::make_unique<Map>(*map_.load(std::memory_order_relaxed));
+    func(*map);
+    const auto old = map_.exchange(map.release(), std::memory_order_seq_cst);
+    retired_.push_back(old);
+    Reclaim();
+  }
+
+  /*!
+   * @brief 消すのを待っている古い表の数
+   * @details 読んでいるスレッドの数より多くはならない
+   */
+  std::size_t retiredCount() const {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    return retired_.size();
+  }
+
+ private:
+  /*!
+   * @brief 読む側のスロット。ほかのスロットと同じキャッシュラインに載せない
+   */
+  struct alignas(64) Hazard {
+    std::atomic<const Map*> map{nullptr};  //!< 読んでいる表
+  };
+
+  /*!
+   * @brief どのスロットにも書かれていない古い表を消す。writeMutex_の中で呼ぶ
+   */
+  void Reclaim() {
+    std::vector<const Map*> used{};
+    for (const auto& hazard : hazards_) {
+      if (const auto map = hazard.map.load(std::memory_order_seq_cst)) {
+        used.push_back(map);
+      }
+    }
+    auto it = retired_.begin();
+    while (it != retired_.end()) {
+      if (std::find(used.begin(), used.end(), *it) == used.end()) {
+        delete *it;
+        it = retired_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  std::atomic<const Map*> map_;  //!< 公開中の表
+  mutable std::array<Hazard, registry::MaxReaderThreads> hazards_{};
+  mutable std::mutex writeMutex_{};  //!< 書き込み同士の排他
+  std::vector<const Map*> retired_{};  //!< 読まれているかもしれない古い表
+};
+
+}  // namespace dxapp
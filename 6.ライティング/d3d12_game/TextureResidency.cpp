@@ -0,0 +1,185 @@
+﻿#include "TextureResidency.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace dxapp {
+
+TextureResidency::TextureResidency(std::uint64_t budgetBytes)
+    : budgetBytes_(budgetBytes) {}
+
+std::uint32_t TextureResidency::Register(
+    const std::vector<std::uint64_t>& mipBytes, std::uint64_t tailBytes) {
+  Entry entry{};
+  entry.isUsed = true;
+  entry.mipBytes = mipBytes;
+  entry.tailBytes = tailBytes;
+  entry.residentMip = static_cast<std::uint32_t>(mipBytes.size());
+  entry.requestedMip = entry.residentMip;
+  entry.lastRequestFrame = frame_;
+  residentBytes_ += tailBytes;
+
+  if (!freeIds_.empty()) {
+    const auto id = freeIds_.back();
+    freeIds_.pop_back();
+    entries_[id] = std::move(entry);
+    return id;
+  }
+  entries_.emplace_back(std::move(entry));
+  return static_cast<std::uint32_t>(entries_.size() - 1);
+}
+
+void TextureResidency::Unregister(std::uint32_t id) {
+  if (id >= entries_.size() || !entries_[id].isUsed) {
+    return;
+  }
+  residentBytes_ -= BytesFrom(entries_[id], entries_[id].residentMip);
+  entries_[id] = Entry{};
+  freeIds_.emplace_back(id);
+}
+
+void TextureResidency::BeginFrame() { ++frame_; }
+
+void TextureResidency::RequestMip(std::uint32_t id, float mip) {
+  if (id >= entries_.size() || !entries_[id].isUsed) {
+    return;
+  }
+  auto& entry = entries_[id];
+  const auto tailMip = static_cast<std::uint32_t>(entry.mipBytes.size());
+  const auto m = std::min(
+      tailMip, static_cast<std::uint32_t>(std::max(0.0f, std::floor(mip))));
+  if (entry.lastRequestFrame != frame_) {
+    entry.requestedMip = m;
+    entry.lastRequestFrame = frame_;
+  } else {
+    entry.requestedMip = std::min(entry.requestedMip, m);
+  }
+}
+
+std::vector<ResidencyChange> TextureResidency::Update(std::uint32_t maxLoads) {
+  // 目標のミップを決める
+  // 今フレーム使われたものは要求通り、しばらく使われていないものはテールだけ、
+  // それ以外は今のまま(視界から一瞬外れただけで捨てない)
+  std::vector<std::uint32_t> targets(entries_.size(), 0);
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < entries_.size(); ++i) {
+    const auto& entry = entries_[i];
+    if (!entry.isUsed) {
+      continue;
+    }
+    const auto tailMip = static_cast<std::uint32_t>(entry.mipBytes.size());
+    if (entry.lastRequestFrame == frame_) {
+      targets[i] = entry.requestedMip;
+    } else if (frame_ - entry.lastRequestFrame > EvictAfterFrames) {
+      targets[i] = tailMip;
+    } else {
+      targets[i] = entry.residentMip;
+    }
+    total += BytesFrom(entry, targets[i]);
+  }
+
+  // 予算に収まるまで目標を粗くする
+  // 長く使われていないもの、同じならそのとき一番大きいミップを持つものから
+  while (total > budgetBytes_) {
+    std::size_t victim = entries_.size();
+    for (std::size_t i = 0; i < entries_.size(); ++i) {
+      const auto& entry = entries_[i];
+      if (!entry.isUsed || targets[i] >= entry.mipBytes.size()) {
+        continue;
+      }
+      if (victim == entries_.size()) {
+        victim = i;
+        continue;
+      }
+      const auto& best = entries_[victim];
+      if (entry.lastRequestFrame != best.lastRequestFrame) {
+        if (entry.lastRequestFrame < best.lastRequestFrame) {
+          victim = i;
+        }
+      } else if (entry.mipBytes[targets[i]] >
+                 best.mipBytes[targets[victim]]) {
+        victim = i;
+      }
+    }
+    if (victim == entries_.size()) {
+      break;  // テールだけで予算を超えている
+    }
+    total -= entries_[victim].mipBytes[targets[victim]];
+    ++targets[victim];
+  }
+
+  std::vector<ResidencyChange> changes{};
+
+  // 破棄はすぐに反映する
+  for (std::size_t i = 0; i < entries_.size(); ++i) {
+    auto& entry = entries_[i];
+    if (!entry.isUsed || entry.residentMip >= targets[i]) {
+      continue;
+    }
+    residentBytes_ -=
+        BytesFrom(entry, entry.residentMip) - BytesFrom(entry, targets[i]);
+    changes.push_back({static_cast<std::uint32_t>(i), entry.residentMip,
+                       targets[i]});
+    entry.residentMip = targets[i];
+  }
+
+  // ロードは目標との差が大きいものから1段ずつ
+  std::vector<std::uint32_t> loads{};
+  for (std::size_t i = 0; i < entries_.size(); ++i) {
+    if (entries_[i].isUsed && entries_[i].residentMip > targets[i]) {
+      loads.emplace_back(static_cast<std::uint32_t>(i));
+    }
+  }
+  std::stable_sort(loads.begin(), loads.end(),
+                   [&](std::uint32_t a, std::uint32_t b) {
+                     return entries_[a].residentMip - targets[a] >
+                            entries_[b].residentMip - targets[b];
+                   });
+  std::uint32_t started = 0;
+  for (const auto id : loads) {
+    if (started >= maxLoads) {
+      break;
+    }
+    auto& entry = entries_[id];
+    const auto newMip = entry.residentMip - 1;
+    const auto bytes = entry.mipBytes[newMip];
+    if (residentBytes_ + bytes > budgetBytes_) {
+      continue;
+    }
+    residentBytes_ += bytes;
+    changes.push_back({id, entry.residentMip, newMip});
+    entry.residentMip = newMip;
+    ++started;
+  }
+  return changes;
+}
+
+std::uint32_t TextureResidency::residentMip(std::uint32_t id) const {
+  if (id >= entries_.size() || !entries_[id].isUsed) {
+    return 0;
+  }
+  return entries_[id].residentMip;
+}
+
+float TextureResidency::ComputeRequiredMip(std::uint32_t textureSize,
+                                           float screenPixels) {
+  if (textureSize == 0) {
+    return 0.0f;
+  }
+  if (screenPixels <= 1.0f) {
+    return std::log2(static_cast<float>(textureSize));
+  }
+  return std::max(0.0f,
+                  std::log2(static_cast<float>(textureSize) / screenPixels));
+}
+
+std::uint64_t TextureResidency::BytesFrom(const Entry& entry,
+                                          std::uint32_t mip) {
+  std::uint64_t bytes = entry.tailBytes;
+  for (auto i = mip; i < entry.mipBytes.size(); ++i) {
+    bytes += entry.mipBytes[i];
+  }
+  return bytes;
+}
+
+}  // namespace dxapp
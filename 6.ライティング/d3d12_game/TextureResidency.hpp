@@ -0,0 +1,125 @@
+﻿#pragma once
+// テクスチャストリーミングのミップ常駐の判断
+// D3D12には触らないので、カメラの動きを作ってLinuxでも動かせる
+#include <cstdint>
+#include <vector>
+
+namespace dxapp {
+
+/*!
+ * @brief ミップの常駐状態の変化
+ * @details residentMipより細かいミップがVRAMにある状態。
+ *          newMip < oldMip ならロード、newMip > oldMip なら破棄
+ */
+struct ResidencyChange {
+  std::uint32_t id{0};      //!< テクスチャのID
+  std::uint32_t oldMip{0};  //!< 変化前の常駐ミップ
+  std::uint32_t newMip{0};  //!< 変化後の常駐ミップ
+};
+
+/*!
+ * @brief ミップ単位の常駐を予算内で決めるクラス
+ * @details 毎フレームRequestMipで必要なミップを集めてUpdateを呼ぶ。
+ *          予算を超えるときは、しばらく使われていないテクスチャから
+ *          一番細かいミップを手放していく。
+ *          ミップテール(それ以上細かく分けられない小さいミップ)は常に常駐
+ */
+class TextureResidency {
+ public:
+  /*!
+   * @brief コンストラクタ
+   * @param[in] budgetBytes 常駐させてよいバイト数
+   */
+  explicit TextureResidency(std::uint64_t budgetBytes);
+
+  /*!
+   * @brief テクスチャを登録する
+   * @details 最初はミップテールだけが常駐している状態になる
+   * @param[in] mipBytes 個別に常駐を切り替えられるミップのバイト数(mip0から)
+   * @param[in] tailBytes ミップテールのバイト数
+   * @return テクスチャのID
+   */
+  std::uint32_t Register(const std::vector<std::uint64_t>& mipBytes,
+                         std::uint64_t tailBytes);
+
+  /*!
+   * @brief 登録を解除する
+   */
+  void Unregister(std::uint32_t id);
+
+  /*!
+   * @brief 予算を変える
+   */
+  void SetBudget(std::uint64_t budgetBytes) { budgetBytes_ = budgetBytes; }
+
+  /*!
+   * @brief フレームの開始。RequestMipの前に呼ぶ
+   */
+  void BeginFrame();
+
+  /*!
+   * @brief このフレームで必要なミップを伝える
+   * @details 同じフレームで複数回呼ばれたら一番細かいものを使う
+   * @param[in] id テクスチャのID
+   * @param[in] mip 必要なミップ(小数で渡してよい。切り捨てて使う)
+   */
+  void RequestMip(std::uint32_t id, float mip);
+
+  /*!
+   * @brief 常駐させるミップを決める
+   * @details 破棄はすぐに反映する。ロードは1回に1段だけ進める
+   * @param[in] maxLoads 1回で始めるロードの最大数
+   * @return 常駐が変わったテクスチャ
+   */
+  std::vector<ResidencyChange> Update(std::uint32_t maxLoads = 4);
+
+  /*!
+   * @brief 常駐している一番細かいミップ
+   */
+  std::uint32_t residentMip(std::uint32_t id) const;
+
+  /*!
+   * @brief 常駐しているバイト数の合計
+   */
+  std::uint64_t residentBytes() const { return residentBytes_; }
+
+  /*!
+   * @brief 予算
+   */
+  std::uint64_t budgetBytes() const { return budgetBytes_; }
+
+  /*!
+   * @brief 画面上の大きさから必要なミップを求める
+   * @details テクセルとピクセルが1対1になるミップを返す
+   * @param[in] textureSize テクスチャの幅と高さの大きい方
+   * @param[in] screenPixels UVの0～1が画面上で占めるピクセル数
+   */
+  static float ComputeRequiredMip(std::uint32_t textureSize,
+                                  float screenPixels);
+
+  //! これだけのフレーム使われなかったらミップテールまで手放す
+  static constexpr std::uint32_t EvictAfterFrames{60};
+
+ private:
+  struct Entry {
+    bool isUsed{false};                  //!< 登録されているか
+    std::vector<std::uint64_t> mipBytes{};
+    std::uint64_t tailBytes{0};
+    std::uint32_t residentMip{0};        //!< 今の常駐ミップ
+    std::uint32_t requestedMip{0};       //!< このフレームで必要なミップ
+    std::uint64_t lastRequestFrame{0};   //!< 最後に必要とされたフレーム
+  };
+
+  /*!
+   * @brief mip以上を常駐させたときのバイト数
+   */
+  static std::uint64_t BytesFrom(const Entry& entry, std::uint32_t mip);
+
+  std::vector<Entry> entries_{};
+  std::vector<std::uint32_t> freeIds_{};  //!< 解除されて空いたID
+  std::uint64_t budgetBytes_{0};
+  std::uint64_t residentBytes_{0};
+  std::uint64_t frame_{0};
+};
+
+}  // namespace dxapp
@@ -10,7 +10,8 @@ using namespace Microsoft::WRL;
 HRESULT CompileShaderFromFile(const std::wstring& fileName,
                               const std::wstring& profile,
                               Microsoft::WRL::ComPtr<ID3DBlob>& shaderBlob,
-                              Microsoft::WRL::ComPtr<ID3DBlob>& errorBlob) {
+                              Microsoft::WRL::ComPtr<ID3DBlob>& errorBlob,
+                              const std::vector<DxcDefine>& defines) {
   std::filesystem::path filePath(fileName);
   std::ifstream infile(filePath);
   if (!infile) {
@@ -61,8 +62,8 @@ HRESULT CompileShaderFromFile(const std::wstring& fileName,
                     profile.c_str(),  // シェーダのプロファイル
                     compilerFlags,    // コンパイルフラグ
                     _countof(compilerFlags),  // フラグの要素数
-                    nullptr,                  // 基本的にはnullでOK
-                    0,                        // 0でOK
+                    defines.data(),           // マクロ。なければnullでOK
+                    UINT32(defines.size()),   // マクロの数
                     includeHandler.Get(),     // IDxcIncludeHandler
                     &dxcResult);              // IDxcOperationResult
 
@@ -15,11 +15,13 @@ namespace utility {
  * @pram[in] profile シェーダプロファイル(シェーダの種類、バージョン)
  * @pram[out] shaderBlob コンパイルされたシェーダーコードを返す
  * @pram[out] errorBlob コンパイル失敗時にエラー内容を返す
+ * @pram[in] defines シェーダに渡すマクロ(#define)
  * @return 実行の成否をHRESULTで戻します
  */
 HRESULT CompileShaderFromFile(const std::wstring& fileName,
                               const std::wstring& profile,
                               Microsoft::WRL::ComPtr<ID3DBlob>& shaderBlob,
-                              Microsoft::WRL::ComPtr<ID3DBlob>& errorBlob);
+                              Microsoft::WRL::ComPtr<ID3DBlob>& errorBlob,
+                              const std::vector<DxcDefine>& defines = {});
 }  // namespace utility
 }  // namespace dxapp
@@ -0,0 +1,111 @@
+﻿#include "WorkerPool.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace dxapp {
+
+WorkerPool::~WorkerPool() { Stop(); }
+
+void WorkerPool::Initialize(std::uint32_t threadCount) {
+  Stop();
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  stop_ = false;
+  // 作る前のRunの分は拾わないように、今の回数から数える
+  const auto generation = generation_;
+  for (std::uint32_t i = 1; i < threadCount; ++i) {
+    workers_.emplace_back(
+        [this, i, generation]() { WorkerMain(i, generation); });
+  }
+}
+
+void WorkerPool::Run(std::uint32_t count, const Task& task) {
+  assert(count <= threadCount());
+  count = std::min(count, threadCount());
+  if (count == 0) {
+    return;
+  }
+
+  if (count > 1) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = &task;
+      taskCount_ = count;
+      pending_ = count - 1;
+      ++generation_;
+    }
+    startCv_.notify_all();
+  }
+
+  // 0番はこのスレッドでやる
+  Invoke(task, 0);
+
+  if (count > 1) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    doneCv_.wait(lock, [this]() { return pending_ == 0; });
+    task_ = nullptr;
+  }
+  if (error_) {
+    auto error = error_;
+    error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+void WorkerPool::WorkerMain(std::uint32_t taskIndex, std::uint64_t seen) {
+  for (;;) {
+    const Task* task = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      startCv_.wait(lock, [this, seen]() {
+        return stop_ || generation_ != seen;
+      });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+      if (taskIndex >= taskCount_) {
+        continue;  // 今回は仕事が少なくて受け持ちがない
+      }
+      task = task_;
+    }
+
+    Invoke(*task, taskIndex);
+
+    bool done = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done = --pending_ == 0;
+    }
+    if (done) {
+      doneCv_.notify_one();
+    }
+  }
+}
+
+void WorkerPool::Invoke(const Task& task, std::uint32_t taskIndex) {
+  try {
+    task(taskIndex);
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_) {
+      error_ = std::current_exception();
+    }
+  }
+}
+
+void WorkerPool::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  startCv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+}
+
+}  // namespace dxapp
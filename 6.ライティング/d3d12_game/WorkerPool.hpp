@@ -0,0 +1,89 @@
+﻿#pragma once
+// フレームごとの仕事を決まった数のスレッドで分けて動かす
+// スレッドは最初に作っておき、毎フレーム作り直さない
+// D3D12には触らないので、Linuxでも動かして確かめられる
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dxapp {
+
+/*!
+ * @brief 呼んだスレッドとワーカースレッドで仕事を分けるクラス
+ * @details Runで渡した仕事の0番は呼んだスレッド、i番はi-1番目のワーカーが動かす。
+ *          同じ番号はいつも同じスレッドなので、番号ごとの持ち物は
+ *          そのスレッドだけが触る。Runは1つのスレッドからだけ呼ぶ
+ */
+class WorkerPool {
+ public:
+  //! 仕事。引数は仕事の番号
+  using Task = std::function<void(std::uint32_t)>;
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  /*!
+   * @brief デフォルトコンストラクタ
+   */
+  WorkerPool() = default;
+
+  /*!
+   * @brief デストラクタ。ワーカーを止める
+   */
+  ~WorkerPool();
+
+  /*!
+   * @brief ワーカーを作る
+   * @param[in] threadCount 呼んだスレッドも入れた数。0ならコアの数
+   */
+  void Initialize(std::uint32_t threadCount);
+
+  /*!
+   * @brief 同時に動かせる仕事の数(呼んだスレッドも入れたスレッドの数)
+   */
+  std::uint32_t threadCount() const {
+    return static_cast<std::uint32_t>(workers_.size()) + 1;
+  }
+
+  /*!
+   * @brief 仕事を0番からcount-1番まで同時に動かし、全部終わるまで待つ
+   * @details 仕事が例外を投げたら、全部終わってから最初の1つを投げなおす
+   * @param[in] count threadCount以下
+   */
+  void Run(std::uint32_t count, const Task& task);
+
+ private:
+  /*!
+   * @brief ワーカーの本体
+   * @param[in] taskIndex このワーカーが受け持つ仕事の番号
+   * @param[in] seen 作ったときのRunの回数
+   */
+  void WorkerMain(std::uint32_t taskIndex, std::uint64_t seen);
+
+  /*!
+   * @brief 仕事を動かして、例外なら覚えておく
+   */
+  void Invoke(const Task& task, std::uint32_t taskIndex);
+
+  /*!
+   * @brief ワーカーを止める
+   */
+  void Stop();
+
+  std::vector<std::thread> workers_{};
+  std::mutex mutex_{};  //!< 下のメンバを守る
+  std::condition_variable startCv_{};  //!< 仕事が来たか止めるとき
+  std::condition_variable doneCv_{};   //!< ワーカーの仕事が終わったとき
+  const Task* task_{nullptr};          //!< 今の仕事。Runの間だけ有効
+  std::uint32_t taskCount_{0};         //!< 今の仕事の数
+  std::uint64_t generation_{0};        //!< Runを呼んだ回数
+  std::uint32_t pending_{0};           //!< 終わっていないワーカーの仕事の数
+  std::exception_ptr error_{};         //!< 最初に起きた例外
+  bool stop_{false};                   //!< ワーカー終了フラグ
+};
+
+}  // namespace dxapp
@@ -26,13 +26,17 @@
 // C/C++
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstdint>
 #include <filesystem>  // C++17
 #include <fstream>
 #include <memory>
 #include <mutex>
+#include <queue>
 #include <stdexcept>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
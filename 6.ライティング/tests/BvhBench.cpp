@@ -0,0 +1,184 @@
+// Bvhの問い合わせの速さを測る
+// 1万個と10万個の箱を広い範囲に置き、QueryFrustum・QueryBox・QueryNearestを
+// 位置を変えながら繰り返して、1ミリ秒あたりの問い合わせの数を出す。
+// 視錐台は全部の箱を見る総当たりとも比べる。少しずつ動かすUpdateも測る
+//
+// 使い方: BvhBench [組み合わせごとに測る時間(ミリ秒)]
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include "Bvh.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+using dxapp::Aabb;
+using dxapp::Frustum;
+
+/*!
+ * @brief 原点からyawの方向を見る視錐台
+ * @details 行列を通さず、視野角から6枚の平面を直接作る
+ */
+Frustum MakeFrustum(float yaw) {
+  const float nearZ = 0.5f;
+  const float farZ = 300.0f;
+  const float halfY = 0.5f;
+  const float halfX = std::atan(std::tan(halfY) * 16.0f / 9.0f);
+  const float forward[3]{std::sin(yaw), 0.0f, std::cos(yaw)};
+  const float right[3]{forward[2], 0.0f, -forward[0]};
+  const float up[3]{0.0f, 1.0f, 0.0f};
+  auto side = [&](float sign, float half, const float (&axis)[3]) {
+    const auto c = std::cos(half);
+    const auto s = std::sin(half);
+    return dxapp::Plane{forward[0] * s - sign * axis[0] * c,
+                        forward[1] * s - sign * axis[1] * c,
+                        forward[2] * s - sign * axis[2] * c, 0.0f};
+  };
+  Frustum frustum{};
+  frustum.planes[0] = side(-1.0f, halfX, right);
+  frustum.planes[1] = side(1.0f, halfX, right);
+  frustum.planes[2] = side(-1.0f, halfY, up);
+  frustum.planes[3] = side(1.0f, halfY, up);
+  frustum.planes[4] = {forward[0], forward[1], forward[2], -nearZ};
+  frustum.planes[5] = {-forward[0], -forward[1], -forward[2], farZ};
+  return frustum;
+}
+
+/*!
+ * @brief queryを時間いっぱい繰り返し、1ミリ秒あたりの回数を返す
+ * @param[in] query 何回目かを受け取り、見つけた数を返す
+ * @param[out] found 1回あたりに見つけた数の平均
+ */
+double Measure(const std::function<std::size_t(int)>& query, int durationMs,
+               double* found) {
+  const dxapp::test::Stopwatch stopwatch{};
+  int iterations = 0;
+  std::size_t total = 0;
+  do {
+    total += query(iterations);
+    ++iterations;
+  } while (stopwatch.milliseconds() < durationMs);
+  *found = double(total) / iterations;
+  return iterations / stopwatch.milliseconds();
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  const auto durationMs = argc > 1 ? std::atoi(argv[1]) : 500;
+
+  for (const std::uint32_t count : {10000u, 100000u}) {
+    std::uint32_t seed = 1;
+    auto next = [&seed](float lo, float hi) {
+      seed = seed * 1664525u + 1013904223u;
+      return lo + (hi - lo) * ((seed >> 8) / 16777216.0f);
+    };
+    std::vector<Aabb> boxes(count);
+    for (auto& box : boxes) {
+      const auto x = next(-500.0f, 500.0f);
+      const auto y = next(-50.0f, 50.0f);
+      const auto z = next(-500.0f, 500.0f);
+      const auto r = next(0.5f, 4.0f);
+      box = {x - r, y - r * 0.5f, z - r, x + r, y + r * 0.5f, z + r};
+    }
+
+    dxapp::Bvh bvh{};
+    std::vector<std::uint32_t> proxies(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+      proxies[i] = bvh.Insert(boxes[i], i);
+    }
+    std::printf("%6u objects  inserted height %d cost %.1f", count,
+                bvh.height(), bvh.cost());
+    bvh.Rebuild();
+    std::printf("  rebuilt height %d cost %.1f\n", bvh.height(), bvh.cost());
+
+    std::vector<std::uint32_t> objects;
+    double found = 0.0;
+    auto rate = Measure(
+        [&](int i) {
+          objects.clear();
+          bvh.QueryFrustum(MakeFrustum(i * 0.1f), &objects);
+          return objects.size();
+        },
+        durationMs, &found);
+    std::printf("  QueryFrustum %10.1f queries/ms (%.0f found)\n", rate,
+                found);
+
+    // 同じ判定で全部の箱を見る
+    rate = Measure(
+        [&](int i) {
+          const auto frustum = MakeFrustum(i * 0.1f);
+          std::size_t visible = 0;
+          for (const auto& box : boxes) {
+            const auto cx = (box.minX + box.maxX) * 0.5f;
+            const auto cy = (box.minY + box.maxY) * 0.5f;
+            const auto cz = (box.minZ + box.maxZ) * 0.5f;
+            const auto ex = (box.maxX - box.minX) * 0.5f;
+            const auto ey = (box.maxY - box.minY) * 0.5f;
+            const auto ez = (box.maxZ - box.minZ) * 0.5f;
+            bool inside = true;
+            for (const auto& p : frustum.planes) {
+              const auto dist = p.nx * cx + p.ny * cy + p.nz * cz + p.d;
+              const auto reach = std::fabs(p.nx) * ex + std::fabs(p.ny) * ey +
+                                 std::fabs(p.nz) * ez;
+              if (dist < -reach) {
+                inside = false;
+                break;
+              }
+            }
+            visible += inside ? 1 : 0;
+          }
+          return visible;
+        },
+        durationMs, &found);
+    std::printf("  brute force  %10.1f queries/ms (%.0f found)\n", rate,
+                found);
+
+    rate = Measure(
+        [&](int i) {
+          const auto& center = boxes[i % count];
+          objects.clear();
+          bvh.QueryBox({center.minX - 20.0f, center.minY - 20.0f,
+                        center.minZ - 20.0f, center.maxX + 20.0f,
+                        center.maxY + 20.0f, center.maxZ + 20.0f},
+                       &objects);
+          return objects.size();
+        },
+        durationMs, &found);
+    std::printf("  QueryBox     %10.1f queries/ms (%.1f found)\n", rate,
+                found);
+
+    rate = Measure(
+        [&](int i) {
+          std::uint32_t object = 0;
+          const auto x = std::sin(i * 0.37f) * 500.0f;
+          const auto z = std::cos(i * 0.53f) * 500.0f;
+          return std::size_t{
+              bvh.QueryNearest(x, 0.0f, z, 50.0f, &object, nullptr) ? 1u
+                                                                    : 0u};
+        },
+        durationMs, &found);
+    std::printf("  QueryNearest %10.1f queries/ms (%.2f found)\n", rate,
+                found);
+
+    // 1フレームで全部を少しずつ動かす。たまに太らせた箱からはみ出す
+    rate = Measure(
+        [&](int i) {
+          std::size_t reinserted = 0;
+          const auto dx = (i % 2 ? 0.04f : -0.04f) * (i % 7);
+          for (std::uint32_t j = 0; j < count; ++j) {
+            auto box = boxes[j];
+            box.minX += dx;
+            box.maxX += dx;
+            reinserted += bvh.Update(proxies[j], box) ? 1 : 0;
+          }
+          return reinserted;
+        },
+        durationMs, &found);
+    std::printf("  Update       %10.3f frames/ms  (%.0f reinserted)\n", rate,
+                found);
+  }
+  return 0;
+}
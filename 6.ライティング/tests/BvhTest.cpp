@@ -0,0 +1,465 @@
+// Bvhを全部の箱を見る総当たりと比べて確かめる
+// 乱数で足す・消す・動かすを繰り返し、途中でRebuildも挟みながら、
+// QueryBox・QueryFrustum・QueryNearestの答えが総当たりと同じかを見る。
+// 毎回Validateで親子のつながり・高さ・箱の包含を調べ、
+// 木の高さが葉の数のlogくらいに収まっているかも見る
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+#include "Bvh.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+using dxapp::Aabb;
+using dxapp::Bvh;
+using dxapp::Frustum;
+
+//! 葉の箱を太らせる量
+constexpr float Margin = 0.5f;
+
+/*!
+ * @brief 0から1の乱数
+ */
+float Next(std::uint32_t& seed) {
+  seed = seed * 1664525u + 1013904223u;
+  return (seed >> 8) / 16777216.0f;
+}
+
+float Range(std::uint32_t& seed, float lo, float hi) {
+  return lo + (hi - lo) * Next(seed);
+}
+
+Aabb RandomBox(std::uint32_t& seed, float extent) {
+  const auto x = Range(seed, -extent, extent);
+  const auto y = Range(seed, -extent * 0.2f, extent * 0.2f);
+  const auto z = Range(seed, -extent, extent);
+  const auto sx = Range(seed, 0.1f, 3.0f);
+  const auto sy = Range(seed, 0.1f, 3.0f);
+  const auto sz = Range(seed, 0.1f, 3.0f);
+  return {x - sx, y - sy, z - sz, x + sx, y + sy, z + sz};
+}
+
+Aabb Move(const Aabb& box, float dx, float dy, float dz) {
+  return {box.minX + dx, box.minY + dy, box.minZ + dz,
+          box.maxX + dx, box.maxY + dy, box.maxZ + dz};
+}
+
+bool Contains(const Aabb& outer, const Aabb& inner) {
+  return outer.minX <= inner.minX && outer.minY <= inner.minY &&
+         outer.minZ <= inner.minZ && inner.maxX <= outer.maxX &&
+         inner.maxY <= outer.maxY && inner.maxZ <= outer.maxZ;
+}
+
+bool Overlaps(const Aabb& a, const Aabb& b) {
+  return a.minX <= b.maxX && b.minX <= a.maxX && a.minY <= b.maxY &&
+         b.minY <= a.maxY && a.minZ <= b.maxZ && b.minZ <= a.maxZ;
+}
+
+float DistanceSq(float x, float y, float z, const Aabb& a) {
+  const auto dx = std::max({a.minX - x, 0.0f, x - a.maxX});
+  const auto dy = std::max({a.minY - y, 0.0f, y - a.maxY});
+  const auto dz = std::max({a.minZ - z, 0.0f, z - a.maxZ});
+  return dx * dx + dy * dy + dz * dz;
+}
+
+/*!
+ * @brief eyeからyawの方向を見る視錐台
+ * @details 行列を通さず、視野角から6枚の平面を直接作る
+ */
+Frustum MakeFrustum(const float (&eye)[3], float yaw) {
+  const float nearZ = 0.5f;
+  const float farZ = 60.0f;
+  const float halfY = 0.5f;
+  const float halfX = std::atan(std::tan(halfY) * 16.0f / 9.0f);
+  const float forward[3]{std::sin(yaw), 0.0f, std::cos(yaw)};
+  const float right[3]{forward[2], 0.0f, -forward[0]};
+  const float up[3]{0.0f, 1.0f, 0.0f};
+  // eyeを通る平面
+  auto through = [&eye](float nx, float ny, float nz) {
+    return dxapp::Plane{nx, ny, nz,
+                        -(nx * eye[0] + ny * eye[1] + nz * eye[2])};
+  };
+  auto side = [&](float sign, float half, const float (&axis)[3]) {
+    const auto c = std::cos(half);
+    const auto s = std::sin(half);
+    return through(forward[0] * s - sign * axis[0] * c,
+                   forward[1] * s - sign * axis[1] * c,
+                   forward[2] * s - sign * axis[2] * c);
+  };
+  Frustum frustum{};
+  frustum.planes[0] = side(-1.0f, halfX, right);
+  frustum.planes[1] = side(1.0f, halfX, right);
+  frustum.planes[2] = side(-1.0f, halfY, up);
+  frustum.planes[3] = side(1.0f, halfY, up);
+  frustum.planes[4] = through(forward[0], forward[1], forward[2]);
+  frustum.planes[4].d -= nearZ;
+  frustum.planes[5] = through(-forward[0], -forward[1], -forward[2]);
+  frustum.planes[5].d += farZ;
+  return frustum;
+}
+
+/*!
+ * @brief CullBoxesと同じ判定。どれかの平面の完全に外側ならfalse
+ */
+bool IntersectsFrustum(const Frustum& frustum, const Aabb& box) {
+  const auto cx = (box.minX + box.maxX) * 0.5f;
+  const auto cy = (box.minY + box.maxY) * 0.5f;
+  const auto cz = (box.minZ + box.maxZ) * 0.5f;
+  const auto ex = (box.maxX - box.minX) * 0.5f;
+  const auto ey = (box.maxY - box.minY) * 0.5f;
+  const auto ez = (box.maxZ - box.minZ) * 0.5f;
+  for (const auto& p : frustum.planes) {
+    const auto dist = p.nx * cx + p.ny * cy + p.nz * cz + p.d;
+    const auto reach =
+        std::fabs(p.nx) * ex + std::fabs(p.ny) * ey + std::fabs(p.nz) * ez;
+    if (dist < -reach) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*!
+ * @brief 総当たりで答えを出すための、木の外に持つ写し
+ */
+class Reference {
+ public:
+  struct Item {
+    Aabb tight;
+    Aabb fat;  //!< 最後に入れなおしたときの太らせた箱
+    std::uint32_t proxy;
+    std::uint32_t object;
+    bool alive;
+  };
+
+  std::vector<Item> items;
+
+  std::uint32_t aliveCount() const {
+    return static_cast<std::uint32_t>(
+        std::count_if(std::begin(items), std::end(items),
+                      [](const Item& item) { return item.alive; }));
+  }
+
+  std::vector<std::uint32_t> QueryBox(const Aabb& box) const {
+    std::vector<std::uint32_t> objects;
+    for (const auto& item : items) {
+      if (item.alive && Overlaps(item.tight, box)) {
+        objects.push_back(item.object);
+      }
+    }
+    return objects;
+  }
+
+  std::vector<std::uint32_t> QueryFrustum(const Frustum& frustum) const {
+    std::vector<std::uint32_t> objects;
+    for (const auto& item : items) {
+      if (item.alive && IntersectsFrustum(frustum, item.tight)) {
+        objects.push_back(item.object);
+      }
+    }
+    return objects;
+  }
+
+  /*!
+   * @brief 一番近い箱までの距離の2乗。なければfloatの最大
+   */
+  float NearestSq(float x, float y, float z) const {
+    auto best = std::numeric_limits<float>::max();
+    for (const auto& item : items) {
+      if (item.alive) {
+        best = std::min(best, DistanceSq(x, y, z, item.tight));
+      }
+    }
+    return best;
+  }
+};
+
+/*!
+ * @brief 並べ替えて、総当たりと同じ番号の集まりか比べる
+ * @details 同じ番号が2回入っていても見つかるよう、重複は消さない
+ */
+bool SameObjects(std::vector<std::uint32_t> actual,
+                 std::vector<std::uint32_t> expected) {
+  std::sort(std::begin(actual), std::end(actual));
+  std::sort(std::begin(expected), std::end(expected));
+  return actual == expected;
+}
+
+/*!
+ * @brief 葉の数に対して木が高すぎないか
+ * @details AVL木なら1.44 * log2(n)くらいまで。回転が葉の高さだけで
+ *          決まらないので少し余裕を持たせる
+ */
+bool HeightIsBalanced(const Bvh& bvh) {
+  if (bvh.size() < 2) {
+    return bvh.height() == 0;
+  }
+  const auto limit = 2.0 * std::log2(double(bvh.size())) + 2.0;
+  return bvh.height() <= limit;
+}
+
+/*!
+ * @brief 3種類の問い合わせを総当たりと比べる
+ * @return 合わなかった問い合わせの数
+ */
+int CompareQueries(const Bvh& bvh, const Reference& reference,
+                   std::uint32_t& seed, float extent) {
+  int mismatches = 0;
+  std::vector<std::uint32_t> objects;
+  for (int i = 0; i < 8; ++i) {
+    // 小さい箱から全体を覆う箱まで
+    auto box = RandomBox(seed, extent);
+    const auto grow = Range(seed, 0.0f, extent * (i == 0 ? 2.0f : 0.3f));
+    box = {box.minX - grow, box.minY - grow, box.minZ - grow,
+           box.maxX + grow, box.maxY + grow, box.maxZ + grow};
+    objects.clear();
+    bvh.QueryBox(box, &objects);
+    mismatches += SameObjects(objects, reference.QueryBox(box)) ? 0 : 1;
+
+    const float eye[3]{Range(seed, -extent, extent),
+                       Range(seed, -2.0f, 2.0f),
+                       Range(seed, -extent, extent)};
+    const auto frustum = MakeFrustum(eye, Range(seed, 0.0f, 6.3f));
+    objects.clear();
+    bvh.QueryFrustum(frustum, &objects);
+    mismatches += SameObjects(objects, reference.QueryFrustum(frustum)) ? 0 : 1;
+
+    const auto x = Range(seed, -extent * 1.2f, extent * 1.2f);
+    const auto y = Range(seed, -extent * 0.5f, extent * 0.5f);
+    const auto z = Range(seed, -extent * 1.2f, extent * 1.2f);
+    const auto maxDistance = i % 2 ? extent * 10.0f : Range(seed, 0.0f, 4.0f);
+    const auto expectedSq = reference.NearestSq(x, y, z);
+    const auto expectFound = expectedSq <= maxDistance * maxDistance;
+    std::uint32_t object = Bvh::NullNode;
+    float distance = -1.0f;
+    const auto found = bvh.QueryNearest(x, y, z, maxDistance, &object,
+                                        &distance);
+    if (found != expectFound) {
+      ++mismatches;
+    } else if (found) {
+      // 同じ距離のものが2つあればどちらでもよいので、距離で比べる
+      const auto it = std::find_if(
+          std::begin(reference.items), std::end(reference.items),
+          [object](const Reference::Item& item) {
+            return item.alive && item.object == object;
+          });
+      const auto expected = std::sqrt(expectedSq);
+      if (it == std::end(reference.items) ||
+          DistanceSq(x, y, z, it->tight) != expectedSq ||
+          std::fabs(distance - expected) > 1e-4f * (1.0f + expected)) {
+        ++mismatches;
+      }
+    }
+  }
+  return mismatches;
+}
+
+/*!
+ * @brief 空の木と、1つだけの木
+ */
+void TestEmptyAndSingle() {
+  Bvh bvh(Margin);
+  TEST_CHECK(bvh.Validate());
+  TEST_CHECK_EQUAL(bvh.size(), 0u);
+  TEST_CHECK_EQUAL(bvh.height(), 0);
+  TEST_CHECK_EQUAL(bvh.cost(), 0.0f);
+  std::vector<std::uint32_t> objects;
+  bvh.QueryBox({-1e6f, -1e6f, -1e6f, 1e6f, 1e6f, 1e6f}, &objects);
+  TEST_CHECK(objects.empty());
+  std::uint32_t object = 0;
+  TEST_CHECK(!bvh.QueryNearest(0.0f, 0.0f, 0.0f, 1e6f, &object, nullptr));
+  bvh.Rebuild();
+  TEST_CHECK(bvh.Validate());
+
+  const auto proxy = bvh.Insert({0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f}, 42);
+  TEST_CHECK(bvh.Validate());
+  TEST_CHECK_EQUAL(bvh.object(proxy), 42u);
+  TEST_CHECK_EQUAL(bvh.height(), 0);
+  float distance = -1.0f;
+  TEST_CHECK(bvh.QueryNearest(0.5f, 0.5f, 0.5f, 0.0f, &object, &distance));
+  TEST_CHECK_EQUAL(object, 42u);
+  TEST_CHECK_EQUAL(distance, 0.0f);
+  TEST_CHECK(bvh.QueryNearest(4.0f, 1.0f, 1.0f, 3.0f, &object, &distance));
+  TEST_CHECK_EQUAL(distance, 3.0f);
+  TEST_CHECK(!bvh.QueryNearest(4.0f, 1.0f, 1.0f, 2.9f, &object, nullptr));
+
+  // 太らせた箱の外の問い合わせには、元の箱で答える
+  objects.clear();
+  bvh.QueryBox({1.2f, 0.0f, 0.0f, 2.0f, 1.0f, 1.0f}, &objects);
+  TEST_CHECK(objects.empty());
+
+  bvh.Remove(proxy);
+  TEST_CHECK(bvh.Validate());
+  TEST_CHECK_EQUAL(bvh.size(), 0u);
+  bvh.Insert({0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f}, 1);
+  bvh.Insert({5.0f, 0.0f, 0.0f, 6.0f, 1.0f, 1.0f}, 2);
+  bvh.Clear();
+  TEST_CHECK(bvh.Validate());
+  TEST_CHECK_EQUAL(bvh.size(), 0u);
+}
+
+/*!
+ * @brief 太らせた箱の中で動くだけなら入れなおさない
+ */
+void TestUpdateMargin() {
+  Bvh bvh(Margin);
+  const Aabb box{0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+  const auto proxy = bvh.Insert(box, 7);
+  bvh.Insert({10.0f, 0.0f, 0.0f, 11.0f, 1.0f, 1.0f}, 8);
+
+  TEST_CHECK(!bvh.Update(proxy, Move(box, 0.4f, -0.4f, 0.5f)));
+  TEST_CHECK(bvh.Validate());
+  // 木はそのままでも、問い合わせは動いた後の箱で答える
+  std::vector<std::uint32_t> objects;
+  bvh.QueryBox({1.2f, -1.0f, -1.0f, 1.3f, 2.0f, 2.0f}, &objects);
+  TEST_CHECK_EQUAL(objects.size(), 1u);
+
+  TEST_CHECK(bvh.Update(proxy, Move(box, 0.6f, 0.0f, 0.0f)));
+  TEST_CHECK(bvh.Validate());
+  // 入れなおした所から測りなおす
+  TEST_CHECK(!bvh.Update(proxy, Move(box, 1.0f, 0.0f, 0.0f)));
+  TEST_CHECK(bvh.Update(proxy, Move(box, 20.0f, 0.0f, 0.0f)));
+  TEST_CHECK(bvh.Validate());
+  std::uint32_t object = 0;
+  TEST_CHECK(bvh.QueryNearest(21.5f, 0.5f, 0.5f, 1.0f, &object, nullptr));
+  TEST_CHECK_EQUAL(object, 7u);
+}
+
+/*!
+ * @brief 乱数で足す・消す・動かすを繰り返し、総当たりと比べる
+ */
+void TestRandomOperations() {
+  const float extent = 100.0f;
+  std::uint32_t seed = 5;
+  Bvh bvh(Margin);
+  Reference reference{};
+  std::uint32_t nextObject = 0;
+  int invalid = 0;
+  int unbalanced = 0;
+  int mismatches = 0;
+  int wrongUpdates = 0;
+  int wrongObjects = 0;
+  std::uint32_t maxSize = 0;
+  for (int step = 0; step < 20000; ++step) {
+    const auto op = Next(seed);
+    // 前半は増やし、後半は減らす
+    const auto insertRate = step < 10000 ? 0.45f : 0.15f;
+    const auto removeRate = step < 10000 ? 0.2f : 0.35f;
+    std::vector<std::size_t> alive;
+    if (op >= insertRate) {
+      for (std::size_t i = 0; i < reference.items.size(); ++i) {
+        if (reference.items[i].alive) {
+          alive.push_back(i);
+        }
+      }
+    }
+    if (op < insertRate || alive.empty()) {
+      const auto box = RandomBox(seed, extent);
+      const auto object = nextObject++;
+      const auto proxy = bvh.Insert(box, object);
+      reference.items.push_back(
+          {box,
+           {box.minX - Margin, box.minY - Margin, box.minZ - Margin,
+            box.maxX + Margin, box.maxY + Margin, box.maxZ + Margin},
+           proxy,
+           object,
+           true});
+    } else if (op < insertRate + removeRate) {
+      auto& item = reference.items[alive[seed % alive.size()]];
+      bvh.Remove(item.proxy);
+      item.alive = false;
+    } else {
+      auto& item = reference.items[alive[seed % alive.size()]];
+      // たいていは少しだけ、たまに遠くへ動かす
+      const auto jump = Next(seed) < 0.1f ? extent : 0.4f;
+      const auto box = Move(item.tight, Range(seed, -jump, jump),
+                            Range(seed, -jump, jump) * 0.2f,
+                            Range(seed, -jump, jump));
+      const auto expected = !Contains(item.fat, box);
+      wrongUpdates += bvh.Update(item.proxy, box) != expected ? 1 : 0;
+      item.tight = box;
+      if (expected) {
+        item.fat = {box.minX - Margin, box.minY - Margin, box.minZ - Margin,
+                    box.maxX + Margin, box.maxY + Margin, box.maxZ + Margin};
+      }
+    }
+
+    maxSize = std::max(maxSize, bvh.size());
+    if (step % 97 == 0) {
+      invalid += bvh.Validate() ? 0 : 1;
+      unbalanced += HeightIsBalanced(bvh) ? 0 : 1;
+      mismatches += CompareQueries(bvh, reference, seed, extent);
+      for (const auto& item : reference.items) {
+        if (item.alive && bvh.object(item.proxy) != item.object) {
+          ++wrongObjects;
+        }
+      }
+    }
+    if (step % 2500 == 2499) {
+      // 作りなおしても同じ答えで、プロキシも変わらない
+      bvh.Rebuild();
+      invalid += bvh.Validate() ? 0 : 1;
+      unbalanced += HeightIsBalanced(bvh) ? 0 : 1;
+      mismatches += CompareQueries(bvh, reference, seed, extent);
+    }
+    TEST_CHECK_EQUAL(bvh.size(), reference.aliveCount());
+  }
+  if (invalid || unbalanced || mismatches || wrongUpdates || wrongObjects) {
+    std::printf("invalid %d, unbalanced %d, mismatches %d, updates %d, "
+                "objects %d\n",
+                invalid, unbalanced, mismatches, wrongUpdates, wrongObjects);
+  }
+  TEST_CHECK_EQUAL(invalid, 0);
+  TEST_CHECK_EQUAL(unbalanced, 0);
+  TEST_CHECK_EQUAL(mismatches, 0);
+  TEST_CHECK_EQUAL(wrongUpdates, 0);
+  TEST_CHECK_EQUAL(wrongObjects, 0);
+  // 数千個まで増えてから減っている
+  TEST_CHECK(maxSize > 2000);
+  TEST_CHECK(bvh.size() < maxSize / 2);
+}
+
+/*!
+ * @brief 足した順が偏っていても、高さはlogに収まる
+ * @details x軸に沿って並べて足すと、回転しなければ一本の鎖になる
+ */
+void TestSortedInsertStaysBalanced() {
+  Bvh bvh(Margin);
+  std::vector<std::uint32_t> proxies;
+  for (std::uint32_t i = 0; i < 4096; ++i) {
+    const auto x = static_cast<float>(i) * 2.0f;
+    proxies.push_back(bvh.Insert({x, 0.0f, 0.0f, x + 1.0f, 1.0f, 1.0f}, i));
+  }
+  TEST_CHECK(bvh.Validate());
+  TEST_CHECK(HeightIsBalanced(bvh));
+
+  // 片側だけ消しても偏らない
+  for (std::uint32_t i = 0; i < 3000; ++i) {
+    bvh.Remove(proxies[i]);
+  }
+  TEST_CHECK(bvh.Validate());
+  TEST_CHECK(HeightIsBalanced(bvh));
+
+  // 作りなおすと、並んだ箱はほぼ完全な二分木になり、重なりも小さい
+  const auto costBefore = bvh.cost();
+  bvh.Rebuild();
+  TEST_CHECK(bvh.Validate());
+  TEST_CHECK(bvh.height() <= 12);
+  TEST_CHECK(bvh.cost() <= costBefore * 1.01f);
+  std::uint32_t object = 0;
+  TEST_CHECK(bvh.QueryNearest(5990.0f, 0.5f, 0.5f, 100.0f, &object, nullptr));
+  TEST_CHECK_EQUAL(object, 3000u);
+}
+}  // namespace
+
+int main() {
+  TestEmptyAndSingle();
+  TestUpdateMargin();
+  TestRandomOperations();
+  TestSortedInsertStaysBalanced();
+  return dxapp::test::Finish("BvhTest");
+}
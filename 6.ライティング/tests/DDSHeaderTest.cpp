@@ -0,0 +1,409 @@
+// DdsLayoutがDDSのヘッダから求める行ピッチ・大きさ・位置を確かめる
+// ヘッダはメモリ上で組み立てる。DX10拡張ヘッダ付きのもの、FourCCやビットマスクで
+// フォーマットを表す古いもの、配列・キューブマップ・ボリュームを並べて、
+// 圧縮形式(BC1/BC3/BC7)と非圧縮形式の両方で期待値と比べる。
+// クッカーのSerializeDdsが書いたDDSも同じように読めることを見る
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "DdsLayout.hpp"
+#include "DdsWriter.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+namespace dds = dxapp::dds;
+namespace cooker = dxapp::cooker;
+
+// DXGI_FORMATの値
+constexpr std::uint32_t FormatR32G32B32A32Float = 2;
+constexpr std::uint32_t FormatR16G16B16A16Float = 10;
+constexpr std::uint32_t FormatR8G8B8A8Unorm = 28;
+constexpr std::uint32_t FormatR8Unorm = 61;
+constexpr std::uint32_t FormatBC1Unorm = 71;
+constexpr std::uint32_t FormatBC2Unorm = 74;
+constexpr std::uint32_t FormatBC3Unorm = 77;
+constexpr std::uint32_t FormatBC5Unorm = 83;
+constexpr std::uint32_t FormatB5G6R5Unorm = 85;
+constexpr std::uint32_t FormatB8G8R8A8Unorm = 87;
+constexpr std::uint32_t FormatBC7Unorm = 98;
+
+constexpr std::uint32_t HeaderSize = 4 + 124;
+constexpr std::uint32_t Dxt10HeaderSize = 20;
+
+constexpr std::uint32_t MakeFourCC(char a, char b, char c, char d) {
+  return std::uint32_t(std::uint8_t(a)) |
+         (std::uint32_t(std::uint8_t(b)) << 8) |
+         (std::uint32_t(std::uint8_t(c)) << 16) |
+         (std::uint32_t(std::uint8_t(d)) << 24);
+}
+
+/*!
+ * @brief DDSのヘッダを組み立てる
+ * @details 値はDDS_HEADERの並びで書く。ピクセルは置かず、全体の大きさだけ渡す
+ */
+class DdsBuilder {
+ public:
+  DdsBuilder(std::uint32_t width, std::uint32_t height,
+             std::uint32_t mipCount) {
+    Write(0, 0x20534444);  // "DDS "
+    Write(4, 124);         // size
+    Write(8, 0x1007);      // flags
+    Write(12, height);     // height
+    Write(16, width);      // width
+    Write(28, mipCount);   // mipMapCount
+    Write(4 + 72, 32);     // ddspf.size
+  }
+
+  //! DX10拡張ヘッダを付ける
+  DdsBuilder& Dxt10(std::uint32_t format, std::uint32_t dimension,
+                    std::uint32_t arraySize, std::uint32_t miscFlag = 0) {
+    Write(4 + 76, 0x4);  // ddspf.flags = FOURCC
+    Write(4 + 80, MakeFourCC('D', 'X', '1', '0'));
+    bytes_.resize(HeaderSize + Dxt10HeaderSize);
+    Write(HeaderSize + 0, format);
+    Write(HeaderSize + 4, dimension);
+    Write(HeaderSize + 8, miscFlag);
+    Write(HeaderSize + 12, arraySize);
+    return *this;
+  }
+
+  //! FourCCで圧縮形式を表す
+  DdsBuilder& FourCC(std::uint32_t fourCC) {
+    Write(4 + 76, 0x4);
+    Write(4 + 80, fourCC);
+    return *this;
+  }
+
+  //! ビットマスクで32bitの非圧縮形式を表す
+  DdsBuilder& Masks(std::uint32_t r, std::uint32_t g, std::uint32_t b,
+                    std::uint32_t a) {
+    Write(4 + 76, 0x40 | (a ? 0x1 : 0));  // RGB | ALPHAPIXELS
+    Write(4 + 84, 32);
+    Write(4 + 88, r);
+    Write(4 + 92, g);
+    Write(4 + 96, b);
+    Write(4 + 100, a);
+    return *this;
+  }
+
+  //! ボリュームテクスチャにする
+  DdsBuilder& Volume(std::uint32_t depth) {
+    Write(8, Read(8) | 0x00800000);
+    Write(24, depth);
+    return *this;
+  }
+
+  //! キューブマップの面を指定する(古い形式)
+  DdsBuilder& CubeFaces(std::uint32_t faces) {
+    Write(4 + 108, 0x200 | faces);  // caps2
+    return *this;
+  }
+
+  std::size_t headerSize() const { return bytes_.size(); }
+  const std::uint8_t* data() const { return bytes_.data(); }
+
+ private:
+  void Write(std::size_t offset, std::uint32_t value) {
+    std::memcpy(bytes_.data() + offset, &value, 4);
+  }
+  std::uint32_t Read(std::size_t offset) const {
+    std::uint32_t value;
+    std::memcpy(&value, bytes_.data() + offset, 4);
+    return value;
+  }
+
+  std::vector<std::uint8_t> bytes_ = std::vector<std::uint8_t>(HeaderSize);
+};
+
+/*!
+ * @brief 1枚分の大きさをフォーマットごとに確かめる
+ * @details 圧縮形式は4未満の辺でも1ブロックある
+ */
+void TestSurfaceInfo() {
+  struct Case {
+    std::uint32_t format, width, height;
+    std::uint64_t rowPitch;
+    std::uint32_t rowCount;
+  };
+  const Case cases[] = {
+      {FormatBC1Unorm, 256, 256, 64 * 8, 64},
+      {FormatBC1Unorm, 5, 3, 2 * 8, 1},
+      {FormatBC1Unorm, 1, 1, 8, 1},
+      {FormatBC3Unorm, 6, 9, 2 * 16, 3},
+      {FormatBC5Unorm, 2, 2, 16, 1},
+      {FormatBC7Unorm, 1024, 4, 256 * 16, 1},
+      {FormatBC7Unorm, 13, 1, 4 * 16, 1},
+      {FormatR8G8B8A8Unorm, 7, 3, 28, 3},
+      {FormatB8G8R8A8Unorm, 1, 1, 4, 1},
+      {FormatR16G16B16A16Float, 3, 5, 24, 5},
+      {FormatR32G32B32A32Float, 2, 2, 32, 2},
+      {FormatB5G6R5Unorm, 5, 2, 10, 2},
+      {FormatR8Unorm, 3, 7, 3, 7},
+  };
+  for (const auto& c : cases) {
+    dds::SurfaceInfo info{};
+    TEST_CHECK(dds::GetSurfaceInfo(c.format, c.width, c.height, info));
+    TEST_CHECK_EQUAL(info.rowPitch, c.rowPitch);
+    TEST_CHECK_EQUAL(info.rowCount, c.rowCount);
+    TEST_CHECK_EQUAL(info.slicePitch, c.rowPitch * c.rowCount);
+  }
+
+  // 行が単純にならないものは扱わない
+  dds::SurfaceInfo info{};
+  TEST_CHECK(!dds::GetSurfaceInfo(0, 4, 4, info));    // UNKNOWN
+  TEST_CHECK(!dds::GetSurfaceInfo(66, 8, 8, info));   // R1
+  TEST_CHECK(!dds::GetSurfaceInfo(103, 4, 4, info));  // NV12
+}
+
+/*!
+ * @brief DX10拡張ヘッダ付きの2Dテクスチャのミップを確かめる
+ */
+void TestDxt10MipChain() {
+  // 10x6のBC7を4ミップ: 3x2, 2x1, 1x1, 1x1ブロック
+  DdsBuilder builder(10, 6, 4);
+  builder.Dxt10(FormatBC7Unorm, 3, 1);
+  const std::uint64_t dataBytes = (6 + 2 + 1 + 1) * 16;
+  const auto total = builder.headerSize() + dataBytes;
+
+  dds::Layout layout{};
+  TEST_CHECK(dds::ParseLayout(builder.data(), builder.headerSize(), total,
+                              layout));
+  TEST_CHECK_EQUAL(layout.format, FormatBC7Unorm);
+  TEST_CHECK_EQUAL(layout.dataOffset, HeaderSize + Dxt10HeaderSize);
+  TEST_CHECK_EQUAL(layout.mipLevels, 4u);
+  TEST_CHECK_EQUAL(layout.subresources.size(), 4u);
+  if (layout.subresources.size() == 4) {
+    const std::uint32_t widths[] = {10, 5, 2, 1};
+    const std::uint32_t heights[] = {6, 3, 1, 1};
+    const std::uint64_t rowPitches[] = {3 * 16, 2 * 16, 16, 16};
+    const std::uint32_t rowCounts[] = {2, 1, 1, 1};
+    auto offset = layout.dataOffset;
+    for (int i = 0; i < 4; ++i) {
+      const auto& sub = layout.subresources[i];
+      TEST_CHECK_EQUAL(sub.width, widths[i]);
+      TEST_CHECK_EQUAL(sub.height, heights[i]);
+      TEST_CHECK_EQUAL(sub.offset, offset);
+      TEST_CHECK_EQUAL(sub.surface.rowPitch, rowPitches[i]);
+      TEST_CHECK_EQUAL(sub.surface.rowCount, rowCounts[i]);
+      offset += sub.surface.slicePitch;
+    }
+    TEST_CHECK_EQUAL(offset, total);
+  }
+
+  // 1バイト足りなければ読めない
+  TEST_CHECK(!dds::ParseLayout(builder.data(), builder.headerSize(),
+                               total - 1, layout));
+  // 拡張ヘッダが途中で切れていても読めない
+  TEST_CHECK(!dds::ParseLayout(builder.data(), HeaderSize + 4, total, layout));
+}
+
+/*!
+ * @brief 配列とキューブマップは要素ごとにミップが並ぶ
+ */
+void TestArrays() {
+  // RGBA8の4x4を3ミップ、3要素
+  {
+    DdsBuilder builder(4, 4, 3);
+    builder.Dxt10(FormatR8G8B8A8Unorm, 3, 3);
+    const std::uint64_t perItem = 64 + 16 + 4;
+    dds::Layout layout{};
+    TEST_CHECK(dds::ParseLayout(builder.data(), builder.headerSize(),
+                                builder.headerSize() + perItem * 3, layout));
+    TEST_CHECK_EQUAL(layout.arraySize, 3u);
+    TEST_CHECK_EQUAL(layout.subresources.size(), 9u);
+    if (layout.subresources.size() == 9) {
+      // 2つ目の要素のmip0は1つ目のミップ全部の後ろ
+      TEST_CHECK_EQUAL(layout.subresources[3].offset,
+                       layout.dataOffset + perItem);
+      TEST_CHECK_EQUAL(layout.subresources[3].width, 4u);
+      TEST_CHECK_EQUAL(layout.subresources[5].surface.rowPitch, 4u);
+      TEST_CHECK_EQUAL(layout.subresources[8].offset,
+                       layout.dataOffset + perItem * 2 + 64 + 16);
+    }
+  }
+
+  // DX10のキューブマップは要素数が6倍になる
+  {
+    DdsBuilder builder(8, 8, 1);
+    builder.Dxt10(FormatBC1Unorm, 3, 1, 0x4);
+    const std::uint64_t face = 2 * 2 * 8;
+    dds::Layout layout{};
+    TEST_CHECK(dds::ParseLayout(builder.data(), builder.headerSize(),
+                                builder.headerSize() + face * 6, layout));
+    TEST_CHECK(layout.isCubeMap);
+    TEST_CHECK_EQUAL(layout.arraySize, 6u);
+    TEST_CHECK_EQUAL(layout.subresources.size(), 6u);
+    TEST_CHECK(!dds::ParseLayout(builder.data(), builder.headerSize(),
+                                 builder.headerSize() + face * 5, layout));
+  }
+
+  // 古い形式のキューブマップは全部の面がそろっていなければ読まない
+  {
+    DdsBuilder builder(4, 4, 1);
+    builder.FourCC(MakeFourCC('D', 'X', 'T', '5')).CubeFaces(0xfc00);
+    dds::Layout layout{};
+    TEST_CHECK(dds::ParseLayout(builder.data(), builder.headerSize(),
+                                builder.headerSize() + 16 * 6, layout));
+    TEST_CHECK_EQUAL(layout.arraySize, 6u);
+    TEST_CHECK_EQUAL(layout.format, FormatBC3Unorm);
+
+    DdsBuilder partial(4, 4, 1);
+    partial.FourCC(MakeFourCC('D', 'X', 'T', '5')).CubeFaces(0x0c00);
+    TEST_CHECK(!dds::ParseLayout(partial.data(), partial.headerSize(),
+                                 partial.headerSize() + 16 * 6, layout));
+  }
+}
+
+/*!
+ * @brief ボリュームテクスチャはミップごとに奥行きも半分になる
+ */
+void TestVolume() {
+  // BGRA8の8x4x4を3ミップ: 8x4x4, 4x2x2, 2x1x1
+  DdsBuilder builder(8, 4, 3);
+  builder.Masks(0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000).Volume(4);
+  const std::uint64_t slices[] = {32 * 4, 16 * 2, 8 * 1};
+  const std::uint32_t depths[] = {4, 2, 1};
+  const std::uint64_t dataBytes =
+      slices[0] * depths[0] + slices[1] * depths[1] + slices[2] * depths[2];
+
+  dds::Layout layout{};
+  TEST_CHECK(dds::ParseLayout(builder.data(), builder.headerSize(),
+                              builder.headerSize() + dataBytes, layout));
+  TEST_CHECK_EQUAL(layout.format, FormatB8G8R8A8Unorm);
+  TEST_CHECK_EQUAL(layout.dimension, 4u);
+  TEST_CHECK_EQUAL(layout.dataOffset, HeaderSize);
+  TEST_CHECK_EQUAL(layout.subresources.size(), 3u);
+  if (layout.subresources.size() == 3) {
+    auto offset = layout.dataOffset;
+    for (int i = 0; i < 3; ++i) {
+      const auto& sub = layout.subresources[i];
+      TEST_CHECK_EQUAL(sub.offset, offset);
+      TEST_CHECK_EQUAL(sub.depth, depths[i]);
+      TEST_CHECK_EQUAL(sub.surface.slicePitch, slices[i]);
+      offset += sub.surface.slicePitch * sub.depth;
+    }
+  }
+
+  // DX10の3Dはボリュームのフラグが必要
+  DdsBuilder noFlag(8, 4, 1);
+  noFlag.Dxt10(FormatR8G8B8A8Unorm, 4, 1);
+  TEST_CHECK(!dds::ParseLayout(noFlag.data(), noFlag.headerSize(),
+                               noFlag.headerSize() + 4096, layout));
+}
+
+/*!
+ * @brief 拡張ヘッダのないDDSのフォーマットを確かめる
+ */
+void TestLegacyFormats() {
+  struct Case {
+    std::uint32_t fourCC;
+    std::uint32_t format;
+    std::uint64_t blockBytes;
+  };
+  const Case cases[] = {
+      {MakeFourCC('D', 'X', 'T', '1'), FormatBC1Unorm, 8},
+      {MakeFourCC('D', 'X', 'T', '3'), FormatBC2Unorm, 16},
+      {MakeFourCC('D', 'X', 'T', '5'), FormatBC3Unorm, 16},
+      {MakeFourCC('A', 'T', 'I', '2'), FormatBC5Unorm, 16},
+  };
+  for (const auto& c : cases) {
+    DdsBuilder builder(12, 4, 0);  // mipMapCountが0なら1ミップ
+    builder.FourCC(c.fourCC);
+    dds::Layout layout{};
+    TEST_CHECK(dds::ParseLayout(builder.data(), builder.headerSize(),
+                                builder.headerSize() + 3 * c.blockBytes,
+                                layout));
+    TEST_CHECK_EQUAL(layout.format, c.format);
+    TEST_CHECK_EQUAL(layout.mipLevels, 1u);
+    TEST_CHECK_EQUAL(layout.dataOffset, HeaderSize);
+    TEST_CHECK_EQUAL(layout.subresources.size(), 1u);
+    if (!layout.subresources.empty()) {
+      TEST_CHECK_EQUAL(layout.subresources[0].surface.rowPitch,
+                       3 * c.blockBytes);
+    }
+  }
+
+  // RGBAの並びのマスクはR8G8B8A8
+  DdsBuilder rgba(3, 2, 1);
+  rgba.Masks(0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
+  dds::Layout layout{};
+  TEST_CHECK(dds::ParseLayout(rgba.data(), rgba.headerSize(),
+                              rgba.headerSize() + 24, layout));
+  TEST_CHECK_EQUAL(layout.format, FormatR8G8B8A8Unorm);
+  if (!layout.subresources.empty()) {
+    TEST_CHECK_EQUAL(layout.subresources[0].surface.rowPitch, 12u);
+  }
+
+  // 知らないFourCCやマジックの違うものは読まない
+  DdsBuilder unknown(4, 4, 1);
+  unknown.FourCC(MakeFourCC('A', 'B', 'C', 'D'));
+  TEST_CHECK(!dds::ParseLayout(unknown.data(), unknown.headerSize(),
+                               unknown.headerSize() + 64, layout));
+  std::vector<std::uint8_t> badMagic(rgba.data(),
+                                     rgba.data() + rgba.headerSize());
+  badMagic[0] = 'X';
+  TEST_CHECK(!dds::ParseLayout(badMagic.data(), badMagic.size(),
+                               badMagic.size() + 24, layout));
+}
+
+/*!
+ * @brief クッカーが書いたDDSをそのまま読めるか
+ * @details ミップのデータの位置がクッカーの並べた位置と同じになること
+ */
+void TestCookerOutput() {
+  for (const auto format : {cooker::DdsFormat::BC1_UNORM_SRGB,
+                            cooker::DdsFormat::BC7_UNORM,
+                            cooker::DdsFormat::R8G8B8A8_UNORM}) {
+    const bool isBC1 = format == cooker::DdsFormat::BC1_UNORM_SRGB;
+    const bool isRaw = format == cooker::DdsFormat::R8G8B8A8_UNORM;
+    std::vector<cooker::DdsMip> mips{};
+    std::uint8_t value = 0;
+    for (std::uint32_t w = 20, h = 12;; w = w > 1 ? w / 2 : 1,
+                       h = h > 1 ? h / 2 : 1) {
+      cooker::DdsMip mip{};
+      mip.width = w;
+      mip.height = h;
+      const std::size_t bytes =
+          isRaw ? std::size_t(w) * h * 4
+                : std::size_t((w + 3) / 4) * ((h + 3) / 4) * (isBC1 ? 8 : 16);
+      mip.data.assign(bytes, ++value);
+      mips.push_back(std::move(mip));
+      if (w == 1 && h == 1) {
+        break;
+      }
+    }
+
+    std::vector<std::uint8_t> file{};
+    TEST_CHECK(cooker::SerializeDds(format, mips, file));
+    dds::Layout layout{};
+    TEST_CHECK(dds::ParseLayout(file.data(), file.size(), file.size(),
+                                layout));
+    TEST_CHECK_EQUAL(layout.format, static_cast<std::uint32_t>(format));
+    TEST_CHECK_EQUAL(layout.subresources.size(), mips.size());
+    if (layout.subresources.size() != mips.size()) {
+      continue;
+    }
+    for (std::size_t i = 0; i < mips.size(); ++i) {
+      const auto& sub = layout.subresources[i];
+      TEST_CHECK_EQUAL(sub.surface.slicePitch, mips[i].data.size());
+      // ミップの先頭と最後のバイトがクッカーの書いた値
+      TEST_CHECK_EQUAL(file[sub.offset], mips[i].data.front());
+      TEST_CHECK_EQUAL(file[sub.offset + sub.surface.slicePitch - 1],
+                       mips[i].data.back());
+    }
+    const auto& last = layout.subresources.back();
+    TEST_CHECK_EQUAL(last.offset + last.surface.slicePitch, file.size());
+  }
+}
+}  // namespace
+
+int main() {
+  TestSurfaceInfo();
+  TestDxt10MipChain();
+  TestArrays();
+  TestVolume();
+  TestLegacyFormats();
+  TestCookerOutput();
+  return dxapp::test::Finish("DDSHeaderTest");
+}
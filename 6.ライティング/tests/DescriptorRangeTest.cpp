@@ -0,0 +1,293 @@
+// DescriptorFreeListとDescriptorRingの割り当てを確かめる
+// 空きリストは空きのつなぎ方とフェンス値での解放の遅れ、
+// リングは末尾で先頭に戻るときの飛ばし方を見る。
+// 最後に乱数で割り当てと解放を続け、使用中の位置が重ならないことを見る
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "DescriptorRange.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+using dxapp::DescriptorFreeList;
+using dxapp::DescriptorRing;
+using dxapp::InvalidDescriptorIndex;
+
+/*!
+ * @brief 空きリストの割り当てと、解放した空きのつなぎ方
+ */
+void TestFreeListCoalescing() {
+  DescriptorFreeList list(100, 16);
+  TEST_CHECK_EQUAL(list.largestFreeBlock(), 16u);
+
+  const auto a = list.Allocate(4);
+  const auto b = list.Allocate(4);
+  const auto c = list.Allocate(4);
+  const auto d = list.Allocate(4);
+  TEST_CHECK_EQUAL(a, 100u);
+  TEST_CHECK_EQUAL(b, 104u);
+  TEST_CHECK_EQUAL(c, 108u);
+  TEST_CHECK_EQUAL(d, 112u);
+  TEST_CHECK_EQUAL(list.usedCount(), 16u);
+  TEST_CHECK_EQUAL(list.Allocate(1), InvalidDescriptorIndex);
+  TEST_CHECK_EQUAL(list.Allocate(0), InvalidDescriptorIndex);
+
+  // 離れた2つは別の塊のまま
+  list.Free(a, 4, 0);
+  list.Free(c, 4, 0);
+  TEST_CHECK_EQUAL(list.freeBlockCount(), 2u);
+  TEST_CHECK_EQUAL(list.largestFreeBlock(), 4u);
+  TEST_CHECK_EQUAL(list.Allocate(5), InvalidDescriptorIndex);
+
+  // 間を返すと前後とつながって1つになる
+  list.Free(b, 4, 0);
+  TEST_CHECK_EQUAL(list.freeBlockCount(), 1u);
+  TEST_CHECK_EQUAL(list.largestFreeBlock(), 12u);
+
+  // 最後の塊も後ろからつながる
+  list.Free(d, 4, 0);
+  TEST_CHECK_EQUAL(list.freeBlockCount(), 1u);
+  TEST_CHECK_EQUAL(list.largestFreeBlock(), 16u);
+  TEST_CHECK_EQUAL(list.usedCount(), 0u);
+
+  // 収まる中で一番小さい空きから取る。前にある大きい空きは残す
+  const auto p = list.Allocate(5);  // 100..104
+  list.Allocate(1);                 // 105
+  const auto q = list.Allocate(3);  // 106..108
+  list.Allocate(7);                 // 109..115
+  list.Free(p, 5, 0);
+  list.Free(q, 3, 0);
+  TEST_CHECK_EQUAL(list.Allocate(3), q);
+  TEST_CHECK_EQUAL(list.Allocate(4), p);
+  TEST_CHECK_EQUAL(list.freeBlockCount(), 1u);
+  TEST_CHECK_EQUAL(list.usedCount(), 15u);
+}
+
+/*!
+ * @brief フェンス値を付けた解放は、GPUがそこまで進むまで空きに戻らない
+ */
+void TestFreeListDeferredRelease() {
+  DescriptorFreeList list(0, 8);
+  const auto a = list.Allocate(4);
+  const auto b = list.Allocate(4);
+
+  list.Free(a, 4, 5);
+  list.Free(b, 4, 6);
+  TEST_CHECK_EQUAL(list.pendingCount(), 8u);
+  TEST_CHECK_EQUAL(list.usedCount(), 8u);
+  TEST_CHECK_EQUAL(list.Allocate(1), InvalidDescriptorIndex);
+
+  list.ReleaseCompleted(4);
+  TEST_CHECK_EQUAL(list.pendingCount(), 8u);
+  TEST_CHECK_EQUAL(list.Allocate(1), InvalidDescriptorIndex);
+
+  list.ReleaseCompleted(5);
+  TEST_CHECK_EQUAL(list.pendingCount(), 4u);
+  TEST_CHECK_EQUAL(list.usedCount(), 4u);
+  TEST_CHECK_EQUAL(list.Allocate(4), a);
+
+  // 先に進んだフェンス値でまとめて戻り、前の空きとつながる
+  list.Free(a, 4, 7);
+  list.ReleaseCompleted(10);
+  TEST_CHECK_EQUAL(list.pendingCount(), 0u);
+  TEST_CHECK_EQUAL(list.usedCount(), 0u);
+  TEST_CHECK_EQUAL(list.freeBlockCount(), 1u);
+
+  // 無効な位置を返しても何も起きない
+  list.Free(InvalidDescriptorIndex, 4, 0);
+  TEST_CHECK_EQUAL(list.usedCount(), 0u);
+}
+
+/*!
+ * @brief リングはフレームの順に詰め、フレーム単位で空きに戻す
+ */
+void TestRingFrames() {
+  DescriptorRing ring(50, 10);
+  TEST_CHECK_EQUAL(ring.Allocate(3), 50u);
+  TEST_CHECK_EQUAL(ring.Allocate(3), 53u);
+  ring.FinishFrame(1);
+  TEST_CHECK_EQUAL(ring.Allocate(2), 56u);
+  ring.FinishFrame(2);
+  TEST_CHECK_EQUAL(ring.usedCount(), 8u);
+
+  // 割り当てのないフレームは何も積まない
+  ring.FinishFrame(3);
+
+  // 空きは2つなので3は取れない
+  TEST_CHECK_EQUAL(ring.Allocate(3), InvalidDescriptorIndex);
+  TEST_CHECK_EQUAL(ring.Allocate(11), InvalidDescriptorIndex);
+  TEST_CHECK_EQUAL(ring.Allocate(0), InvalidDescriptorIndex);
+
+  ring.ReleaseCompleted(0);
+  TEST_CHECK_EQUAL(ring.usedCount(), 8u);
+  ring.ReleaseCompleted(1);
+  TEST_CHECK_EQUAL(ring.usedCount(), 2u);
+  ring.ReleaseCompleted(3);
+  TEST_CHECK_EQUAL(ring.usedCount(), 0u);
+  TEST_CHECK_EQUAL(ring.peakCount(), 8u);
+}
+
+/*!
+ * @brief 末尾に収まらない割り当ては、残りを飛ばして先頭から取る
+ */
+void TestRingWrapPadding() {
+  DescriptorRing ring(0, 10);
+  TEST_CHECK_EQUAL(ring.Allocate(6), 0u);
+  ring.FinishFrame(1);
+  TEST_CHECK_EQUAL(ring.Allocate(3), 6u);  // headは9
+  ring.FinishFrame(2);
+  ring.ReleaseCompleted(1);
+  TEST_CHECK_EQUAL(ring.usedCount(), 3u);
+
+  // 末尾の1つは飛ばす。飛ばした分もこのフレームの使用分になる
+  TEST_CHECK_EQUAL(ring.Allocate(4), 0u);
+  TEST_CHECK_EQUAL(ring.usedCount(), 8u);
+  // 先頭側には6..8の使用中の手前まで(4と5)しか空いていない
+  TEST_CHECK_EQUAL(ring.Allocate(3), InvalidDescriptorIndex);
+  TEST_CHECK_EQUAL(ring.Allocate(2), 4u);
+  ring.FinishFrame(3);
+  TEST_CHECK_EQUAL(ring.usedCount(), 10u);
+
+  // フレーム3が終われば、飛ばした分も含めて全部空く
+  ring.ReleaseCompleted(2);
+  TEST_CHECK_EQUAL(ring.usedCount(), 7u);
+  ring.ReleaseCompleted(3);
+  TEST_CHECK_EQUAL(ring.usedCount(), 0u);
+}
+
+/*!
+ * @brief 全部空いたリングは、headが途中にあっても全体を取れる
+ * @details 以前はheadの前(6)にも後ろ(4)にも収まらない8を断っていた
+ */
+void TestRingEmptyResetsHead() {
+  DescriptorRing ring(20, 10);
+  TEST_CHECK_EQUAL(ring.Allocate(6), 20u);
+  ring.FinishFrame(1);
+  ring.ReleaseCompleted(1);
+  TEST_CHECK_EQUAL(ring.usedCount(), 0u);
+
+  TEST_CHECK_EQUAL(ring.Allocate(8), 20u);
+  TEST_CHECK_EQUAL(ring.usedCount(), 8u);
+  ring.FinishFrame(2);
+  ring.ReleaseCompleted(2);
+
+  TEST_CHECK_EQUAL(ring.Allocate(10), 20u);
+  TEST_CHECK_EQUAL(ring.usedCount(), 10u);
+}
+
+/*!
+ * @brief 乱数で割り当てと解放を続けても、使用中の位置が重ならない
+ * @details 位置ごとに使用中かどうかを別に持って照らし合わせる
+ */
+void TestRandomized() {
+  constexpr std::uint32_t Base = 1000;
+  constexpr std::uint32_t Capacity = 256;
+  std::uint32_t seed = 2024;
+  auto next = [&seed](std::uint32_t range) {
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) % range;
+  };
+
+  int overlaps = 0;
+  int mismatches = 0;
+
+  // 空きリスト
+  {
+    DescriptorFreeList list(Base, Capacity);
+    std::vector<bool> used(Capacity, false);
+    struct Block {
+      std::uint32_t index;
+      std::uint32_t count;
+    };
+    std::vector<Block> live{};
+    std::deque<std::pair<Block, std::uint64_t>> pending{};
+    std::uint64_t fence = 0;
+    for (int step = 0; step < 20000; ++step) {
+      if (next(3) != 0 || live.empty()) {
+        const auto count = 1 + next(16);
+        const auto index = list.Allocate(count);
+        if (index == InvalidDescriptorIndex) {
+          mismatches += list.largestFreeBlock() >= count;
+          continue;
+        }
+        for (auto i = index - Base; i < index - Base + count; ++i) {
+          overlaps += used[i] ? 1 : 0;
+          used[i] = true;
+        }
+        live.push_back({index, count});
+      } else {
+        const auto k = next(static_cast<std::uint32_t>(live.size()));
+        const auto block = live[k];
+        live.erase(live.begin() + k);
+        list.Free(block.index, block.count, ++fence);
+        pending.push_back({block, fence});
+      }
+      // GPUは少し遅れて進む
+      if (fence > 4 && next(2) == 0) {
+        const auto completed = fence - next(4);
+        list.ReleaseCompleted(completed);
+        while (!pending.empty() && pending.front().second <= completed) {
+          const auto block = pending.front().first;
+          for (auto i = block.index - Base;
+               i < block.index - Base + block.count; ++i) {
+            used[i] = false;
+          }
+          pending.pop_front();
+        }
+      }
+      std::uint32_t usedCount = 0;
+      for (const bool u : used) {
+        usedCount += u ? 1 : 0;
+      }
+      mismatches += list.usedCount() != usedCount;
+    }
+  }
+
+  // リング
+  {
+    DescriptorRing ring(Base, Capacity);
+    // 位置ごとに使っているフレーム。0は空き
+    std::vector<std::uint64_t> owner(Capacity, 0);
+    std::uint64_t frame = 1;
+    std::uint64_t completed = 0;
+    for (int step = 0; step < 20000; ++step) {
+      const auto count = 1 + next(40);
+      const auto index = ring.Allocate(count);
+      if (index != InvalidDescriptorIndex) {
+        for (auto i = index - Base; i < index - Base + count; ++i) {
+          overlaps += owner[i] > completed ? 1 : 0;
+          owner[i] = frame;
+        }
+      }
+      if (next(4) == 0) {
+        ring.FinishFrame(frame++);
+      }
+      if (frame > 3 && next(3) == 0) {
+        completed = std::max<std::uint64_t>(completed, frame - 1 - next(3));
+        ring.ReleaseCompleted(completed);
+      }
+      mismatches += ring.usedCount() > Capacity;
+    }
+    ring.FinishFrame(frame);
+    ring.ReleaseCompleted(frame);
+    mismatches += ring.usedCount() != 0;
+    mismatches += ring.Allocate(Capacity) != Base;
+  }
+
+  TEST_CHECK_EQUAL(overlaps, 0);
+  TEST_CHECK_EQUAL(mismatches, 0);
+}
+}  // namespace
+
+int main() {
+  TestFreeListCoalescing();
+  TestFreeListDeferredRelease();
+  TestRingFrames();
+  TestRingWrapPadding();
+  TestRingEmptyResetsHead();
+  TestRandomized();
+  return dxapp::test::Finish("DescriptorRangeTest");
+}
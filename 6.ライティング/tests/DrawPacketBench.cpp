@@ -0,0 +1,80 @@
+// DrawPacketSorterの基数ソートとstd::stable_sortの速さを比べる
+// 1万・10万・100万個のパケットを、64bit全部が乱数のキーと、
+// 描画で多い「状態は少なく深度だけばらばら」のキーで並べる。
+// 毎回並べる前の並びに戻してから測るので、コピーの時間も含む
+//
+// 使い方: DrawPacketBench [組み合わせごとに測る時間(ミリ秒)]
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include "DrawPacket.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+using dxapp::DrawPacket;
+
+/*!
+ * @brief funcを時間いっぱい繰り返し、1回あたりのミリ秒を返す
+ */
+double Measure(const std::function<void()>& func, int durationMs) {
+  func();  // 作業用の領域の確保を済ませておく
+  const dxapp::test::Stopwatch stopwatch{};
+  int iterations = 0;
+  do {
+    func();
+    ++iterations;
+  } while (stopwatch.milliseconds() < durationMs);
+  return stopwatch.milliseconds() / iterations;
+}
+
+std::vector<DrawPacket> MakePackets(std::size_t count, bool fewStates) {
+  std::vector<DrawPacket> packets(count);
+  std::uint64_t seed = 1;
+  for (std::size_t i = 0; i < count; ++i) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    const auto key =
+        fewStates ? dxapp::MakeDrawSortKey(0, seed >> 60 & 3, seed >> 50 & 31,
+                                           seed >> 40 & 63,
+                                           seed & dxapp::DrawSortKeyDepthMax)
+                  : seed;
+    packets[i] = {key, static_cast<std::uint32_t>(i)};
+  }
+  return packets;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  const auto durationMs = argc > 1 ? std::atoi(argv[1]) : 500;
+
+  dxapp::DrawPacketSorter sorter{};
+  for (const bool fewStates : {false, true}) {
+    for (const std::size_t count : {10000, 100000, 1000000}) {
+      const auto source = MakePackets(count, fewStates);
+      auto packets = source;
+      const auto radix = Measure(
+          [&]() {
+            packets = source;
+            sorter.Sort(&packets);
+          },
+          durationMs);
+      const auto stable = Measure(
+          [&]() {
+            packets = source;
+            std::stable_sort(std::begin(packets), std::end(packets),
+                             [](const DrawPacket& a, const DrawPacket& b) {
+                               return a.key < b.key;
+                             });
+          },
+          durationMs);
+      std::printf("%-10s %8zu radix %8.3f ms (%6.1f M/s)  stable_sort "
+                  "%8.3f ms (%6.1f M/s)\n",
+                  fewStates ? "fewStates" : "random64", count, radix,
+                  count / radix / 1000.0, stable, count / stable / 1000.0);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,176 @@
+// DrawPacketSorterの基数ソートをstd::stable_sortと比べて確かめる
+// 64bit全部が乱数のキー(6回の桁が全部動く)、同じキーが多いもの、
+// 一部の桁しか違わないもの(桁を飛ばす)を、少ないときの普通の並べ替えとの
+// 境目をまたぐ数で並べる。オブジェクトの番号で同じキーの順番も見る。
+// キーの項目の並びと深度の量子化も見る
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+#include "DrawPacket.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+using dxapp::DrawPacket;
+using dxapp::DrawPacketSorter;
+
+std::uint64_t Next(std::uint64_t& seed) {
+  seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+  return seed;
+}
+
+/*!
+ * @brief std::stable_sortと同じ並びになるか
+ * @return 違っていた位置の数
+ */
+int CountMismatches(DrawPacketSorter& sorter, std::vector<DrawPacket> packets) {
+  auto expected = packets;
+  std::stable_sort(std::begin(expected), std::end(expected),
+                   [](const DrawPacket& a, const DrawPacket& b) {
+                     return a.key < b.key;
+                   });
+  sorter.Sort(&packets);
+  if (packets.size() != expected.size()) {
+    return 1;
+  }
+  int mismatches = 0;
+  for (std::size_t i = 0; i < packets.size(); ++i) {
+    if (packets[i].key != expected[i].key ||
+        packets[i].object != expected[i].object) {
+      ++mismatches;
+    }
+  }
+  return mismatches;
+}
+
+/*!
+ * @brief makeKeyで作ったキーのパケットを並べる
+ */
+std::vector<DrawPacket> MakePackets(
+    std::size_t count, const std::function<std::uint64_t()>& makeKey) {
+  std::vector<DrawPacket> packets(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    packets[i] = {makeKey(), static_cast<std::uint32_t>(i)};
+  }
+  return packets;
+}
+
+/*!
+ * @brief 色々なキーと数で比べる。同じソーターを使いまわす
+ */
+void TestAgainstStableSort() {
+  std::uint64_t seed = 12;
+  DrawPacketSorter sorter{};
+  const std::size_t counts[]{0,   1,    2,    63,    64,   65,
+                             100, 1000, 4096, 30000, 777, 50000};
+  const std::function<std::uint64_t()> makers[]{
+      // 64bit全部。6回の桁が全部動く
+      [&seed]() { return Next(seed); },
+      // 同じキーがたくさんある
+      [&seed]() { return (Next(seed) >> 61) * 0x0123456789abcdefull; },
+      // 一番上の桁だけ違う。下の5回は飛ばす
+      [&seed]() { return (Next(seed) >> 55) << 55 | 0x1234; },
+      // 深度だけ違う。同じ状態のパケットが多い普通の描画
+      [&seed]() {
+        return dxapp::MakeDrawSortKey(1, 3, 17, 5,
+                                      Next(seed) >> 40 & 0xffffff);
+      },
+      // 状態も深度も少しずつ違う
+      [&seed]() {
+        const auto r = Next(seed);
+        return dxapp::MakeDrawSortKey(r & 3, r >> 2 & 7, r >> 5 & 63,
+                                      r >> 11 & 63, r >> 17 & 0xff);
+      },
+      // ほとんど同じで、たまに違う。どの桁も飛ばせない
+      [&seed]() {
+        return Next(seed) % 16 == 0 ? Next(seed) : 0x5555aaaa5555aaaaull;
+      },
+      // 全部同じ
+      []() { return std::uint64_t{0xfedcba9876543210ull}; },
+  };
+  int caseIndex = 0;
+  for (const auto& makeKey : makers) {
+    for (const auto count : counts) {
+      const auto mismatches =
+          CountMismatches(sorter, MakePackets(count, makeKey));
+      if (mismatches != 0) {
+        std::printf("keys %d, count %zu: %d mismatches\n", caseIndex, count,
+                    mismatches);
+      }
+      TEST_CHECK_EQUAL(mismatches, 0);
+    }
+    ++caseIndex;
+  }
+
+  // 並べ済みと逆順
+  auto packets = MakePackets(5000, [&seed]() { return Next(seed); });
+  std::sort(std::begin(packets), std::end(packets),
+            [](const DrawPacket& a, const DrawPacket& b) {
+              return a.key < b.key;
+            });
+  TEST_CHECK_EQUAL(CountMismatches(sorter, packets), 0);
+  std::reverse(std::begin(packets), std::end(packets));
+  TEST_CHECK_EQUAL(CountMismatches(sorter, packets), 0);
+}
+
+/*!
+ * @brief キーの項目は上から パス > パイプライン > マテリアル > メッシュ > 深度
+ */
+void TestKeyLayout() {
+  using dxapp::MakeDrawSortKey;
+  constexpr auto depthMax = dxapp::DrawSortKeyDepthMax;
+  TEST_CHECK(MakeDrawSortKey(0, 255, 16383, 16383, depthMax) <
+             MakeDrawSortKey(1, 0, 0, 0, 0));
+  TEST_CHECK(MakeDrawSortKey(0, 0, 16383, 16383, depthMax) <
+             MakeDrawSortKey(0, 1, 0, 0, 0));
+  TEST_CHECK(MakeDrawSortKey(0, 0, 0, 16383, depthMax) <
+             MakeDrawSortKey(0, 0, 1, 0, 0));
+  TEST_CHECK(MakeDrawSortKey(0, 0, 0, 0, depthMax) <
+             MakeDrawSortKey(0, 0, 0, 1, 0));
+  TEST_CHECK_EQUAL(MakeDrawSortKey(15, 255, 16383, 16383, depthMax), ~0ull);
+
+  // はみ出した分は隣の項目に混ざらない
+  TEST_CHECK_EQUAL(MakeDrawSortKey(0, 0, 1u << 14, 0, 0), 0u);
+  TEST_CHECK_EQUAL(
+      dxapp::DrawSortKeyPipeline(MakeDrawSortKey(3, 200, 5, 6, 7)), 200u);
+
+  // 状態のマスクは深度だけを外す
+  const auto key = MakeDrawSortKey(2, 9, 8, 7, 12345);
+  TEST_CHECK_EQUAL(key & dxapp::DrawSortKeyStateMask,
+                   MakeDrawSortKey(2, 9, 8, 7, 0));
+}
+
+/*!
+ * @brief 深度の量子化は単調で、範囲の外とNaNは端にまとめる
+ */
+void TestQuantizeDepth() {
+  using dxapp::QuantizeDepth;
+  TEST_CHECK_EQUAL(QuantizeDepth(0.1f, 0.1f, 100.0f), 0u);
+  TEST_CHECK_EQUAL(QuantizeDepth(-5.0f, 0.1f, 100.0f), 0u);
+  TEST_CHECK_EQUAL(QuantizeDepth(100.0f, 0.1f, 100.0f),
+                   dxapp::DrawSortKeyDepthMax);
+  TEST_CHECK_EQUAL(QuantizeDepth(1e9f, 0.1f, 100.0f),
+                   dxapp::DrawSortKeyDepthMax);
+  TEST_CHECK_EQUAL(QuantizeDepth(std::nanf(""), 0.1f, 100.0f), 0u);
+  TEST_CHECK_EQUAL(QuantizeDepth(5.0f, 10.0f, 10.0f), 0u);
+
+  int decreasing = 0;
+  std::uint32_t previous = 0;
+  for (float z = 0.1f; z < 100.0f; z += 0.37f) {
+    const auto depth = QuantizeDepth(z, 0.1f, 100.0f);
+    decreasing += depth < previous ? 1 : 0;
+    previous = depth;
+  }
+  TEST_CHECK_EQUAL(decreasing, 0);
+}
+}  // namespace
+
+int main() {
+  TestAgainstStableSort();
+  TestKeyLayout();
+  TestQuantizeDepth();
+  return dxapp::test::Finish("DrawPacketTest");
+}
@@ -0,0 +1,108 @@
+// FrustumCullingのカリングの速さを測る
+// 10万個と100万個の球・箱を広い範囲に置き、カメラを回しながら
+// FrustumCuller::Cullを繰り返して、1ミリ秒あたりに調べた数を出す。
+// 1スレッドとWorkerPool(コアの数)で比べる。SIMDの経路ごとに別のバイナリになる
+//
+// 使い方: FrustumCullingBench [組み合わせごとに測る時間(ミリ秒)]
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "FrustumCulling.hpp"
+#include "SimdLanes.hpp"
+#include "TestCommon.hpp"
+#include "WorkerPool.hpp"
+
+namespace {
+using dxapp::Frustum;
+
+/*!
+ * @brief 原点から+Zをyawだけ回した方向を見る視錐台
+ * @details 行列を通さず、視野角から6枚の平面を直接作る
+ */
+Frustum MakeFrustum(float yaw) {
+  const float nearZ = 0.5f;
+  const float farZ = 300.0f;
+  const float halfY = 0.5f;
+  const float halfX = std::atan(std::tan(halfY) * 16.0f / 9.0f);
+  const auto fx = std::sin(yaw);
+  const auto fz = std::cos(yaw);
+  // 前と右(Y軸まわり)の向き
+  const float forward[3]{fx, 0.0f, fz};
+  const float right[3]{fz, 0.0f, -fx};
+  auto side = [&](float sign, float half, const float (&axis)[3]) {
+    // 前に傾けた横向きの法線
+    const auto c = std::cos(half);
+    const auto s = std::sin(half);
+    return dxapp::Plane{forward[0] * s - sign * axis[0] * c,
+                        forward[1] * s - sign * axis[1] * c,
+                        forward[2] * s - sign * axis[2] * c, 0.0f};
+  };
+  const float up[3]{0.0f, 1.0f, 0.0f};
+  Frustum frustum{};
+  frustum.planes[0] = side(-1.0f, halfX, right);
+  frustum.planes[1] = side(1.0f, halfX, right);
+  frustum.planes[2] = side(-1.0f, halfY, up);
+  frustum.planes[3] = side(1.0f, halfY, up);
+  frustum.planes[4] = {forward[0], forward[1], forward[2], -nearZ};
+  frustum.planes[5] = {-forward[0], -forward[1], -forward[2], farZ};
+  return frustum;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  const auto durationMs = argc > 1 ? std::atoi(argv[1]) : 500;
+  std::printf("lanes %u\n", dxapp::simd::LaneCount);
+
+  dxapp::WorkerPool workers{};
+  workers.Initialize(0);
+  dxapp::FrustumCuller culler{};
+  for (const std::uint32_t count : {100000u, 1000000u}) {
+    dxapp::BoundingSphereSoA spheres{};
+    dxapp::BoundingBoxSoA boxes{};
+    spheres.Resize(count);
+    boxes.Resize(count);
+    std::uint32_t seed = 1;
+    auto next = [&seed](float lo, float hi) {
+      seed = seed * 1664525u + 1013904223u;
+      return lo + (hi - lo) * ((seed >> 8) / 16777216.0f);
+    };
+    for (std::uint32_t i = 0; i < count; ++i) {
+      const auto x = next(-500.0f, 500.0f);
+      const auto y = next(-50.0f, 50.0f);
+      const auto z = next(-500.0f, 500.0f);
+      const auto r = next(0.5f, 4.0f);
+      spheres.Set(i, x, y, z, r);
+      boxes.Set(i, x, y, z, r, r * 0.5f, r);
+    }
+
+    for (const bool useWorkers : {false, true}) {
+      auto pool = useWorkers ? &workers : nullptr;
+      for (const bool useBoxes : {false, true}) {
+        const dxapp::test::Stopwatch stopwatch{};
+        std::uint64_t culled = 0;
+        std::uint64_t visible = 0;
+        float yaw = 0.0f;
+        do {
+          const auto frustum = MakeFrustum(yaw);
+          if (useBoxes) {
+            culler.Cull(frustum, boxes, pool);
+          } else {
+            culler.Cull(frustum, spheres, pool);
+          }
+          culled += count;
+          visible += culler.visible().size();
+          yaw += 0.1f;
+        } while (stopwatch.milliseconds() < durationMs);
+        std::printf("%-7s %8u threads %-2u %10.0f objects/ms "
+                    "(%.1f%% visible)\n",
+                    useBoxes ? "boxes" : "spheres", count,
+                    pool ? workers.threadCount() : 1u,
+                    culled / stopwatch.milliseconds(),
+                    100.0 * visible / culled);
+      }
+    }
+  }
+  return 0;
+}
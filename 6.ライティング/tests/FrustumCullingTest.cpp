@@ -0,0 +1,286 @@
+// FrustumCullingのカリングを1個ずつ調べる参照の実装と比べる
+// CMakeLists.txtでSimdLanes.hppの経路(1個ずつ・SSE2・AVX2)ごとにビルドし、
+// どの経路でもCullSpheres・CullBoxes・FrustumCullerの結果が参照と同じになることを見る。
+// ブロックの途中で終わる範囲(埋めた末尾を読む)と、WorkerPoolで区間に分けて
+// 詰めるところも通す
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "FrustumCulling.hpp"
+#include "SimdLanes.hpp"
+#include "TestCommon.hpp"
+#include "WorkerPool.hpp"
+
+namespace {
+using dxapp::BoundingBoxSoA;
+using dxapp::BoundingSphereSoA;
+using dxapp::Frustum;
+
+using Matrix = float[4][4];
+
+float NextFloat(std::uint32_t& seed, float lo, float hi) {
+  seed = seed * 1664525u + 1013904223u;
+  return lo + (hi - lo) * ((seed >> 8) / 16777216.0f);
+}
+
+void Multiply(const Matrix& a, const Matrix& b, Matrix& out) {
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      out[i][j] = 0.0f;
+      for (int k = 0; k < 4; ++k) {
+        out[i][j] += a[i][k] * b[k][j];
+      }
+    }
+  }
+}
+
+/*!
+ * @brief DirectXMathと同じ左手系・行ベクトルのビュー射影行列を作る
+ * @param[in] eye カメラの位置
+ * @param[in] yaw Y軸まわりの向き(ラジアン)。0なら+Zを見る
+ */
+Frustum MakeFrustum(float eyeX, float eyeY, float eyeZ, float yaw) {
+  const auto c = std::cos(yaw);
+  const auto s = std::sin(yaw);
+  // ワールドからビューへは、平行移動してからカメラの回転の逆をかける
+  const Matrix view{
+      {c, 0.0f, s, 0.0f},
+      {0.0f, 1.0f, 0.0f, 0.0f},
+      {-s, 0.0f, c, 0.0f},
+      {-(eyeX * c - eyeZ * s), -eyeY, -(eyeX * s + eyeZ * c), 1.0f},
+  };
+  const float nearZ = 0.5f;
+  const float farZ = 150.0f;
+  const float ys = 1.0f / std::tan(0.5f * 1.0f);
+  const float xs = ys / (16.0f / 9.0f);
+  const float q = farZ / (farZ - nearZ);
+  const Matrix proj{
+      {xs, 0.0f, 0.0f, 0.0f},
+      {0.0f, ys, 0.0f, 0.0f},
+      {0.0f, 0.0f, q, 1.0f},
+      {0.0f, 0.0f, -nearZ * q, 0.0f},
+  };
+  Matrix viewProj{};
+  Multiply(view, proj, viewProj);
+  return dxapp::ExtractFrustum(viewProj);
+}
+
+/*!
+ * @brief 平面までの距離。カーネルと同じ順で足す
+ */
+float Distance(const dxapp::Plane& p, float x, float y, float z) {
+  return (p.nx * x + p.ny * y) + (p.nz * z + p.d);
+}
+
+//! 1個ずつ調べる参照の実装
+std::vector<std::uint32_t> ReferenceSpheres(const Frustum& frustum,
+                                            const BoundingSphereSoA& spheres,
+                                            std::uint32_t begin,
+                                            std::uint32_t end) {
+  std::vector<std::uint32_t> visible{};
+  for (auto i = begin; i < end; ++i) {
+    bool inside = true;
+    for (const auto& p : frustum.planes) {
+      inside = inside && Distance(p, spheres.x()[i], spheres.y()[i],
+                                  spheres.z()[i]) >= -spheres.radius()[i];
+    }
+    if (inside) {
+      visible.push_back(i);
+    }
+  }
+  return visible;
+}
+
+std::vector<std::uint32_t> ReferenceBoxes(const Frustum& frustum,
+                                          const BoundingBoxSoA& boxes,
+                                          std::uint32_t begin,
+                                          std::uint32_t end) {
+  std::vector<std::uint32_t> visible{};
+  for (auto i = begin; i < end; ++i) {
+    bool inside = true;
+    for (const auto& p : frustum.planes) {
+      const auto reach = (std::fabs(p.nx) * boxes.extentX()[i] +
+                          std::fabs(p.ny) * boxes.extentY()[i]) +
+                         std::fabs(p.nz) * boxes.extentZ()[i];
+      inside = inside && Distance(p, boxes.centerX()[i], boxes.centerY()[i],
+                                  boxes.centerZ()[i]) >= -reach;
+    }
+    if (inside) {
+      visible.push_back(i);
+    }
+  }
+  return visible;
+}
+
+/*!
+ * @brief 乱数で球と箱を置く。いくつかは原点に大きさ0で置く
+ */
+void Fill(std::uint32_t count, std::uint32_t seed, BoundingSphereSoA& spheres,
+          BoundingBoxSoA& boxes) {
+  spheres.Resize(count);
+  boxes.Resize(count);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    const auto x = NextFloat(seed, -120.0f, 120.0f);
+    const auto y = NextFloat(seed, -40.0f, 40.0f);
+    const auto z = NextFloat(seed, -120.0f, 120.0f);
+    const auto size = i % 17 == 0 ? 0.0f : NextFloat(seed, 0.0f, 6.0f);
+    spheres.Set(i, x, y, z, size);
+    boxes.Set(i, x, y, z, size, size * 0.5f, size * 2.0f);
+  }
+}
+
+/*!
+ * @brief 視錐台の平面が内向きで、カメラの前は中、後ろは外
+ */
+void TestExtractFrustum() {
+  const auto frustum = MakeFrustum(10.0f, 2.0f, -5.0f, 0.0f);
+  auto inside = [&frustum](float x, float y, float z) {
+    for (const auto& p : frustum.planes) {
+      if (Distance(p, x, y, z) < 0.0f) {
+        return false;
+      }
+      TEST_CHECK(std::fabs(p.nx * p.nx + p.ny * p.ny + p.nz * p.nz - 1.0f) <
+                 1e-5f);
+    }
+    return true;
+  };
+  TEST_CHECK(inside(10.0f, 2.0f, 5.0f));
+  TEST_CHECK(!inside(10.0f, 2.0f, -10.0f));    // 後ろ
+  TEST_CHECK(!inside(10.0f, 2.0f, -4.8f));     // 手前の面より近い
+  TEST_CHECK(!inside(10.0f, 2.0f, 200.0f));    // 奥の面より遠い
+  TEST_CHECK(!inside(100.0f, 2.0f, 5.0f));     // 右の外
+  TEST_CHECK(!inside(10.0f, -100.0f, 5.0f));   // 下の外
+
+  // 右を向けば+Xが前になる
+  const auto right = MakeFrustum(0.0f, 0.0f, 0.0f, 1.5707963f);
+  auto rightInside = [&right](float x, float y, float z) {
+    for (const auto& p : right.planes) {
+      if (Distance(p, x, y, z) < 0.0f) {
+        return false;
+      }
+    }
+    return true;
+  };
+  TEST_CHECK(rightInside(20.0f, 0.0f, 0.0f));
+  TEST_CHECK(!rightInside(0.0f, 0.0f, 20.0f));
+}
+
+/*!
+ * @brief 範囲を指定したカーネル。末尾がブロックの途中でも参照と同じ
+ */
+void TestKernels() {
+  int mismatches = 0;
+  std::uint64_t visibleTotal = 0;
+  std::uint32_t seed = 5;
+  const std::uint32_t counts[]{1, 7, 8, 9, 15, 16, 17, 63, 100, 1001};
+  for (const auto count : counts) {
+    BoundingSphereSoA spheres{};
+    BoundingBoxSoA boxes{};
+    Fill(count, count * 31, spheres, boxes);
+    for (int camera = 0; camera < 8; ++camera) {
+      const auto frustum =
+          MakeFrustum(NextFloat(seed, -30.0f, 30.0f), 0.0f,
+                      NextFloat(seed, -30.0f, 30.0f), camera * 0.8f);
+      // 先頭はブロックの倍数、終わりはどこでもよい
+      for (std::uint32_t begin = 0; begin < count;
+           begin += dxapp::CullingBlockSize) {
+        for (auto end = begin + 1; end <= count;
+             end += 1 + (end - begin) / 3) {
+          std::vector<std::uint32_t> visible(end - begin);
+          visible.resize(
+              dxapp::CullSpheres(frustum, spheres, begin, end, visible.data()));
+          mismatches +=
+              visible != ReferenceSpheres(frustum, spheres, begin, end) ? 1 : 0;
+          visibleTotal += visible.size();
+
+          visible.assign(end - begin, 0);
+          visible.resize(
+              dxapp::CullBoxes(frustum, boxes, begin, end, visible.data()));
+          mismatches +=
+              visible != ReferenceBoxes(frustum, boxes, begin, end) ? 1 : 0;
+        }
+      }
+    }
+  }
+  TEST_CHECK_EQUAL(mismatches, 0);
+  TEST_CHECK(visibleTotal > 0);
+}
+
+/*!
+ * @brief 埋めた末尾は見えるものとして返さない
+ * @details 埋めた分は原点に大きさ0なので、原点が見えるカメラで調べる
+ */
+void TestPaddingIsNeverVisible() {
+  const auto frustum = MakeFrustum(0.0f, 0.0f, -10.0f, 0.0f);
+  BoundingSphereSoA spheres{};
+  BoundingBoxSoA boxes{};
+  for (std::uint32_t count = 1; count <= 3 * dxapp::CullingBlockSize;
+       ++count) {
+    spheres.Resize(count);
+    boxes.Resize(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+      spheres.Set(i, 0.0f, 0.0f, 0.0f, 1.0f);
+      boxes.Set(i, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
+    }
+    std::vector<std::uint32_t> visible(count + dxapp::CullingBlockSize);
+    TEST_CHECK_EQUAL(
+        dxapp::CullSpheres(frustum, spheres, 0, count, visible.data()), count);
+    TEST_CHECK_EQUAL(visible[count - 1], count - 1);
+    TEST_CHECK_EQUAL(dxapp::CullBoxes(frustum, boxes, 0, count, visible.data()),
+                     count);
+  }
+  // 縮めてから増やした分は、前の値が残らず大きさ0になる
+  spheres.Resize(4);
+  spheres.Resize(20);
+  TEST_CHECK(spheres.radius()[10] == 0.0f && spheres.x()[10] == 0.0f);
+}
+
+/*!
+ * @brief FrustumCullerで区間に分けたときも、分けないときと参照と同じ
+ */
+void TestCullerChunks() {
+  dxapp::WorkerPool workers{};
+  workers.Initialize(4);
+  dxapp::FrustumCuller culler{};
+  int mismatches = 0;
+  // 1区間、区間の数がスレッドより少ない、ブロックの途中で終わる、など
+  const std::uint32_t counts[]{0, 5, 4095, 8192, 3 * 4096 + 13, 40003};
+  for (const auto count : counts) {
+    BoundingSphereSoA spheres{};
+    BoundingBoxSoA boxes{};
+    Fill(count, count + 1, spheres, boxes);
+    for (int camera = 0; camera < 4; ++camera) {
+      const auto frustum = MakeFrustum(0.0f, 0.0f, 0.0f, camera * 1.6f);
+      const auto sphereRef = ReferenceSpheres(frustum, spheres, 0, count);
+      const auto boxRef = ReferenceBoxes(frustum, boxes, 0, count);
+      for (auto pool : {static_cast<dxapp::WorkerPool*>(nullptr), &workers}) {
+        culler.Cull(frustum, spheres, pool);
+        mismatches += culler.visible() != sphereRef ? 1 : 0;
+        culler.Cull(frustum, boxes, pool);
+        mismatches += culler.visible() != boxRef ? 1 : 0;
+      }
+    }
+  }
+  TEST_CHECK_EQUAL(mismatches, 0);
+}
+}  // namespace
+
+int main() {
+#if defined(DXAPP_SIMD_AVX2) && (defined(__GNUC__) || defined(__clang__))
+  if (!__builtin_cpu_supports("avx2")) {
+    std::printf("FrustumCullingTest: skipped (no AVX2)\n");
+    return 0;
+  }
+#endif
+#if defined(EXPECTED_SIMD_LANES)
+  // CMakeLists.txtで選んだ経路でビルドされているか
+  TEST_CHECK_EQUAL(dxapp::simd::LaneCount, EXPECTED_SIMD_LANES);
+#endif
+  TestExtractFrustum();
+  TestKernels();
+  TestPaddingIsNeverVisible();
+  TestCullerChunks();
+  return dxapp::test::Finish("FrustumCullingTest");
+}
@@ -0,0 +1,139 @@
+// LZコンテナの書き込みと展開を確かめる
+// DecompressSpansはddzをアップロードヒープへ行ごとに展開するのに使うので、
+// チャンクをまたぐ行や、圧縮せずに入っているチャンク、壊れたチャンクも見る
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "LzContainer.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+namespace lz = dxapp::lz;
+
+//! 小さいチャンクにして、行がチャンクをまたぐようにする
+constexpr std::uint32_t ChunkSize = 4096;
+
+/*!
+ * @brief 圧縮できる部分とできない部分を交互に持つデータ
+ */
+std::vector<std::uint8_t> MakeData(std::size_t size) {
+  std::vector<std::uint8_t> data(size);
+  std::uint32_t seed = 12345;
+  for (std::size_t i = 0; i < size; ++i) {
+    if ((i / ChunkSize) % 3 == 2) {
+      seed = seed * 1664525u + 1013904223u;
+      data[i] = static_cast<std::uint8_t>(seed >> 24);
+    } else {
+      data[i] = static_cast<std::uint8_t>((i / 7) & 0x3F);
+    }
+  }
+  return data;
+}
+
+/*!
+ * @brief 書いて読み直したコンテナ
+ */
+lz::Container WriteAndRead(const std::vector<std::uint8_t>& data,
+                           const std::string& name) {
+  const auto path = std::filesystem::temp_directory_path() / name;
+  lz::Container container{};
+  TEST_CHECK(lz::WriteContainer(path, data.data(), data.size(), ChunkSize));
+  TEST_CHECK(lz::ReadContainer(path, container));
+  std::filesystem::remove(path);
+  return container;
+}
+
+/*!
+ * @brief 全体の展開が元と一致する
+ */
+void TestRoundTrip() {
+  const auto data = MakeData(ChunkSize * 10 + 123);
+  const auto container = WriteAndRead(data, "lz_round_trip.ddz");
+  TEST_CHECK_EQUAL(container.header.rawSize, data.size());
+  TEST_CHECK_EQUAL(container.chunks.size(), 11u);
+
+  // 乱数のチャンクは圧縮せずに入っている
+  bool hasStored = false;
+  for (const auto& chunk : container.chunks) {
+    hasStored |= chunk.compressedSize == chunk.rawSize;
+  }
+  TEST_CHECK(hasStored);
+  TEST_CHECK(container.file.size() < data.size());
+
+  std::vector<std::uint8_t> out(data.size());
+  TEST_CHECK(lz::DecompressContainer(container, out.data()));
+  TEST_CHECK(out == data);
+}
+
+/*!
+ * @brief 行ごとに間隔を空けて展開する
+ * @details アップロードヒープと同じく、行ピッチを256バイト境界にした先へ写す
+ */
+void TestPitchedSpans() {
+  constexpr std::size_t HeaderSize = 148;
+  constexpr std::size_t RowSize = 1000;  // チャンクの境界と合わない
+  constexpr std::size_t RowCount = 50;
+  constexpr std::size_t Pitch = (RowSize + 255) & ~std::size_t(255);
+  const auto data = MakeData(HeaderSize + RowSize * RowCount);
+  const auto container = WriteAndRead(data, "lz_pitched.ddz");
+
+  for (const unsigned int threadCount : {1u, 4u}) {
+    std::vector<std::uint8_t> header(HeaderSize);
+    TEST_CHECK(lz::DecompressSpans(container, {{0, HeaderSize, header.data()}},
+                                   threadCount));
+    TEST_CHECK(std::memcmp(header.data(), data.data(), HeaderSize) == 0);
+
+    // 行の間は書かれないままになる
+    std::vector<std::uint8_t> out(Pitch * RowCount, 0xCD);
+    std::vector<lz::CopySpan> spans{};
+    for (std::size_t y = 0; y < RowCount; ++y) {
+      spans.push_back({HeaderSize + y * RowSize, RowSize, &out[y * Pitch]});
+    }
+    TEST_CHECK(lz::DecompressSpans(container, spans, threadCount));
+    int mismatches = 0;
+    for (std::size_t y = 0; y < RowCount; ++y) {
+      const auto row = &out[y * Pitch];
+      mismatches += std::memcmp(row, &data[HeaderSize + y * RowSize],
+                                RowSize) != 0;
+      for (std::size_t x = RowSize; x < Pitch; ++x) {
+        mismatches += row[x] != 0xCD;
+      }
+    }
+    TEST_CHECK_EQUAL(mismatches, 0);
+  }
+}
+
+/*!
+ * @brief 範囲が展開後からはみ出すか、チャンクが壊れていれば失敗する
+ */
+void TestFailures() {
+  const auto data = MakeData(ChunkSize * 2 + 10);
+  auto container = WriteAndRead(data, "lz_failures.ddz");
+
+  std::vector<std::uint8_t> out(64);
+  TEST_CHECK(!lz::DecompressSpans(container,
+                                  {{data.size() - 32, out.size(), out.data()}}));
+  TEST_CHECK(lz::DecompressSpans(container, {}));
+
+  // 最初のチャンクの圧縮データを壊す
+  const auto& chunk = container.chunks[0];
+  TEST_CHECK(chunk.compressedSize < chunk.rawSize);
+  std::memset(container.file.data() + chunk.offset, 0xFF,
+              chunk.compressedSize);
+  TEST_CHECK(!lz::DecompressSpans(container, {{0, out.size(), out.data()}}));
+  // 壊れたチャンクにかからない範囲は展開できる
+  TEST_CHECK(lz::DecompressSpans(
+      container, {{ChunkSize + 16, out.size(), out.data()}}));
+  TEST_CHECK(std::memcmp(out.data(), &data[ChunkSize + 16], out.size()) == 0);
+}
+}  // namespace
+
+int main() {
+  TestRoundTrip();
+  TestPitchedSpans();
+  TestFailures();
+  return dxapp::test::Finish("LzContainerTest");
+}
@@ -0,0 +1,84 @@
+// MipGeneratorでミップチェーンを作る速さを測る
+// 1024x1024のRGBAからチェーンを何度も作り、1秒あたりのmip0のピクセル数を出す。
+// sRGBとリニア、1スレッドとハードウェアに合わせたスレッド数で比べる。
+// 256x256を16枚まとめて作るGenerateMipChainsも測る
+//
+// 使い方: MipGeneratorBench [組み合わせごとに測る時間(ミリ秒)]
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include "MipGenerator.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+namespace mip = dxapp::mip;
+
+/*!
+ * @brief funcを時間いっぱい繰り返し、1秒あたりのメガピクセル数を返す
+ */
+double Measure(const std::function<void()>& func, std::size_t pixels,
+               int durationMs) {
+  func();  // 出力先の確保を済ませておく
+  const dxapp::test::Stopwatch stopwatch{};
+  int iterations = 0;
+  do {
+    func();
+    ++iterations;
+  } while (stopwatch.milliseconds() < durationMs);
+  return pixels * iterations / (stopwatch.milliseconds() / 1000.0) / 1e6;
+}
+
+std::vector<std::uint8_t> RandomImage(std::uint32_t width,
+                                      std::uint32_t height) {
+  std::vector<std::uint8_t> rgba(std::size_t(width) * height * 4);
+  std::uint32_t seed = 1;
+  for (auto& value : rgba) {
+    seed = seed * 1664525u + 1013904223u;
+    value = static_cast<std::uint8_t>(seed >> 24);
+  }
+  return rgba;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  const auto durationMs = argc > 1 ? std::atoi(argv[1]) : 500;
+
+  constexpr std::uint32_t Size = 1024;
+  const auto image = RandomImage(Size, Size);
+  std::vector<mip::MipLevel> mips{};
+  for (const bool srgb : {false, true}) {
+    for (const unsigned int threads : {1u, 0u}) {
+      const auto rate = Measure(
+          [&]() {
+            mip::GenerateMipChain(image.data(), Size, Size, Size * 4, srgb,
+                                  mips, threads);
+          },
+          std::size_t(Size) * Size, durationMs);
+      std::printf("%ux%u %-6s threads %-3s %7.1f MP/s\n", Size, Size,
+                  srgb ? "sRGB" : "linear", threads ? "1" : "hw", rate);
+    }
+  }
+
+  constexpr std::uint32_t SmallSize = 256;
+  constexpr std::uint32_t JobCount = 16;
+  const auto small = RandomImage(SmallSize, SmallSize);
+  std::vector<std::vector<mip::MipLevel>> outputs(JobCount);
+  std::vector<mip::MipJob> jobs(JobCount);
+  for (std::uint32_t i = 0; i < JobCount; ++i) {
+    jobs[i].rgba = small.data();
+    jobs[i].width = SmallSize;
+    jobs[i].height = SmallSize;
+    jobs[i].rowPitch = SmallSize * 4;
+    jobs[i].srgb = true;
+    jobs[i].mips = &outputs[i];
+  }
+  const auto rate =
+      Measure([&]() { mip::GenerateMipChains(jobs); },
+              std::size_t(SmallSize) * SmallSize * JobCount, durationMs);
+  std::printf("%ux%u x%u sRGB batched    %7.1f MP/s\n", SmallSize, SmallSize,
+              JobCount, rate);
+  return 0;
+}
@@ -0,0 +1,309 @@
+// MipGeneratorのミップチェーンを確かめる
+// 各段をdoubleで計算した参照(sRGBは式どおりにリニアへ戻して平均)と比べる。
+// 途中の段をfloatで持つので、参照との差は丸めの境目での1まで許す。
+// 1xNや3x5のような奇数サイズ、スレッド数による違いがないことも見る
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "MipGenerator.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+namespace mip = dxapp::mip;
+
+double SrgbToLinear(double c) {
+  return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+}
+
+double LinearToSrgb(double c) {
+  return c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
+}
+
+std::uint8_t Quantize(double value) {
+  return static_cast<std::uint8_t>(
+      std::nearbyint(std::clamp(value, 0.0, 1.0) * 255.0));
+}
+
+/*!
+ * @brief doubleで作ったミップ1段
+ */
+struct ReferenceLevel {
+  std::uint32_t width{0};
+  std::uint32_t height{0};
+  std::vector<double> linear{};       //!< リニアな値(RGBA)
+  std::vector<std::uint8_t> pixels{};  //!< 8bitに戻したもの
+};
+
+/*!
+ * @brief 参照のミップチェーン
+ * @details 2x2の平均。奇数サイズの端は最後の行や列を繰り返す
+ */
+std::vector<ReferenceLevel> ReferenceChain(const std::vector<std::uint8_t>& rgba,
+                                           std::uint32_t width,
+                                           std::uint32_t height, bool srgb) {
+  std::vector<double> current(rgba.size());
+  for (std::size_t i = 0; i < rgba.size(); ++i) {
+    const auto c = rgba[i] / 255.0;
+    current[i] = (srgb && i % 4 != 3) ? SrgbToLinear(c) : c;
+  }
+
+  std::vector<ReferenceLevel> chain{};
+  while (width > 1 || height > 1) {
+    ReferenceLevel level{};
+    level.width = std::max(1u, width / 2);
+    level.height = std::max(1u, height / 2);
+    level.linear.resize(std::size_t(level.width) * level.height * 4);
+    level.pixels.resize(level.linear.size());
+    for (std::uint32_t y = 0; y < level.height; ++y) {
+      const auto y0 = std::min(y * 2, height - 1);
+      const auto y1 = std::min(y * 2 + 1, height - 1);
+      for (std::uint32_t x = 0; x < level.width; ++x) {
+        const auto x0 = std::min(x * 2, width - 1);
+        const auto x1 = std::min(x * 2 + 1, width - 1);
+        for (int c = 0; c < 4; ++c) {
+          auto at = [&](std::uint32_t px, std::uint32_t py) {
+            return current[(std::size_t(py) * width + px) * 4 + c];
+          };
+          const auto average =
+              (at(x0, y0) + at(x1, y0) + at(x0, y1) + at(x1, y1)) / 4;
+          const auto index = (std::size_t(y) * level.width + x) * 4 + c;
+          level.linear[index] = average;
+          level.pixels[index] = Quantize(
+              (srgb && c != 3) ? LinearToSrgb(average) : average);
+        }
+      }
+    }
+    current = level.linear;
+    width = level.width;
+    height = level.height;
+    chain.push_back(std::move(level));
+  }
+  return chain;
+}
+
+std::vector<std::uint8_t> RandomImage(std::uint32_t width,
+                                      std::uint32_t height,
+                                      std::uint32_t seed) {
+  std::vector<std::uint8_t> rgba(std::size_t(width) * height * 4);
+  for (auto& value : rgba) {
+    seed = seed * 1664525u + 1013904223u;
+    value = static_cast<std::uint8_t>(seed >> 24);
+  }
+  return rgba;
+}
+
+/*!
+ * @brief 1枚のミップチェーンを参照と比べる
+ * @return 1より大きくずれたサンプルの数
+ */
+int CompareWithReference(std::uint32_t width, std::uint32_t height, bool srgb,
+                         std::uint32_t seed) {
+  const auto rgba = RandomImage(width, height, seed);
+  std::vector<mip::MipLevel> mips{};
+  mip::GenerateMipChain(rgba.data(), width, height, std::size_t(width) * 4,
+                        srgb, mips, 1);
+  const auto reference = ReferenceChain(rgba, width, height, srgb);
+
+  TEST_CHECK_EQUAL(mips.size() + 1, mip::CountMips(width, height));
+  TEST_CHECK_EQUAL(mips.size(), reference.size());
+  if (mips.size() != reference.size()) {
+    return 1;
+  }
+  int errors = 0;
+  for (std::size_t level = 0; level < mips.size(); ++level) {
+    const auto& actual = mips[level];
+    const auto& expected = reference[level];
+    TEST_CHECK_EQUAL(actual.width, expected.width);
+    TEST_CHECK_EQUAL(actual.height, expected.height);
+    TEST_CHECK_EQUAL(actual.pixels.size(), expected.pixels.size());
+    if (actual.pixels.size() != expected.pixels.size()) {
+      return errors + 1;
+    }
+    for (std::size_t i = 0; i < expected.pixels.size(); ++i) {
+      const auto diff = std::abs(int(actual.pixels[i]) - expected.pixels[i]);
+      if (diff > 1) {
+        if (errors == 0) {
+          std::printf("%ux%u %s mip%zu sample %zu: %d != %d\n", width,
+                      height, srgb ? "sRGB" : "linear", level + 1, i,
+                      actual.pixels[i], expected.pixels[i]);
+        }
+        ++errors;
+      }
+    }
+  }
+  return errors;
+}
+
+/*!
+ * @brief 段の数
+ */
+void TestCountMips() {
+  TEST_CHECK_EQUAL(mip::CountMips(1, 1), 1u);
+  TEST_CHECK_EQUAL(mip::CountMips(2, 1), 2u);
+  TEST_CHECK_EQUAL(mip::CountMips(1, 7), 3u);
+  TEST_CHECK_EQUAL(mip::CountMips(3, 5), 3u);
+  TEST_CHECK_EQUAL(mip::CountMips(1024, 1024), 11u);
+  TEST_CHECK_EQUAL(mip::CountMips(1024, 1), 11u);
+  TEST_CHECK_EQUAL(mip::CountMips(640, 480), 10u);
+
+  // 1x1にはmip1がない
+  const std::uint8_t pixel[4]{1, 2, 3, 4};
+  std::vector<mip::MipLevel> mips(3);
+  mip::GenerateMipChain(pixel, 1, 1, 4, true, mips);
+  TEST_CHECK(mips.empty());
+}
+
+/*!
+ * @brief sRGBはリニアに戻してから平均する
+ * @details 黒と白の平均は、リニアなら128、sRGBなら188になる。
+ *          アルファはsRGBでもそのまま平均する
+ */
+void TestSrgbAveraging() {
+  const std::uint8_t rgba[]{0, 0, 0, 0, 255, 255, 255, 255};
+  std::vector<mip::MipLevel> mips{};
+  mip::GenerateMipChain(rgba, 2, 1, 8, true, mips);
+  TEST_CHECK_EQUAL(mips.size(), 1u);
+  if (!mips.empty()) {
+    TEST_CHECK_EQUAL(mips[0].pixels[0], 188);
+    TEST_CHECK_EQUAL(mips[0].pixels[3], 128);
+  }
+  mip::GenerateMipChain(rgba, 2, 1, 8, false, mips);
+  TEST_CHECK_EQUAL(mips.size(), 1u);
+  if (!mips.empty()) {
+    TEST_CHECK_EQUAL(mips[0].pixels[0], 128);
+    TEST_CHECK_EQUAL(mips[0].pixels[3], 128);
+  }
+
+  // 一様な色はどの段でも変わらない
+  std::vector<std::uint8_t> flat(16 * 8 * 4);
+  for (std::size_t i = 0; i < flat.size(); i += 4) {
+    flat[i + 0] = 10;
+    flat[i + 1] = 128;
+    flat[i + 2] = 250;
+    flat[i + 3] = 77;
+  }
+  mip::GenerateMipChain(flat.data(), 16, 8, 16 * 4, true, mips);
+  int changed = 0;
+  for (const auto& level : mips) {
+    for (std::size_t i = 0; i < level.pixels.size(); ++i) {
+      changed += level.pixels[i] != flat[i % 4];
+    }
+  }
+  TEST_CHECK_EQUAL(changed, 0);
+}
+
+/*!
+ * @brief 奇数や1xNを含む大きさで、参照と比べる
+ */
+void TestSizes() {
+  const std::uint32_t sizes[][2] = {
+      {2, 2},  {3, 5},  {5, 3},   {1, 2},  {1, 9},   {9, 1},  {1, 64},
+      {64, 1}, {7, 7},  {17, 31}, {6, 10}, {33, 16}, {64, 64}};
+  std::uint32_t seed = 31;
+  for (const auto& size : sizes) {
+    for (const bool srgb : {false, true}) {
+      TEST_CHECK_EQUAL(CompareWithReference(size[0], size[1], srgb, seed++),
+                       0);
+    }
+  }
+
+  // 3x5は1x2、1x1になる。右端の列はmip1で捨てられる
+  std::vector<std::uint8_t> rgba(3 * 5 * 4, 0);
+  for (std::uint32_t y = 0; y < 5; ++y) {
+    rgba[(y * 3 + 2) * 4] = 255;  // x = 2の列だけ赤
+  }
+  std::vector<mip::MipLevel> mips{};
+  mip::GenerateMipChain(rgba.data(), 3, 5, 3 * 4, false, mips);
+  TEST_CHECK_EQUAL(mips.size(), 2u);
+  if (mips.size() == 2) {
+    TEST_CHECK_EQUAL(mips[0].width, 1u);
+    TEST_CHECK_EQUAL(mips[0].height, 2u);
+    TEST_CHECK_EQUAL(mips[0].pixels[0], 0);
+    TEST_CHECK_EQUAL(mips[0].pixels[4], 0);
+  }
+}
+
+/*!
+ * @brief 行ピッチに余りがあっても読む位置がずれない
+ */
+void TestRowPitch() {
+  const std::uint32_t width = 5;
+  const std::uint32_t height = 4;
+  const auto tight = RandomImage(width, height, 3);
+  const std::size_t pitch = 32;  // 20バイトの行の後ろに12バイトのすき間
+  std::vector<std::uint8_t> padded(pitch * height, 0xCD);
+  for (std::uint32_t y = 0; y < height; ++y) {
+    std::copy_n(tight.begin() + y * width * 4, width * 4,
+                padded.begin() + y * pitch);
+  }
+  std::vector<mip::MipLevel> a{};
+  std::vector<mip::MipLevel> b{};
+  mip::GenerateMipChain(tight.data(), width, height, width * 4, true, a);
+  mip::GenerateMipChain(padded.data(), width, height, pitch, true, b);
+  TEST_CHECK_EQUAL(a.size(), b.size());
+  for (std::size_t i = 0; i < std::min(a.size(), b.size()); ++i) {
+    TEST_CHECK(a[i].pixels == b[i].pixels);
+  }
+}
+
+/*!
+ * @brief スレッド数やまとめ方で結果が変わらない
+ */
+void TestThreads() {
+  const auto rgba = RandomImage(129, 67, 9);
+  std::vector<mip::MipLevel> single{};
+  mip::GenerateMipChain(rgba.data(), 129, 67, 129 * 4, true, single, 1);
+  for (const unsigned int threads : {2u, 3u, 8u}) {
+    std::vector<mip::MipLevel> parallel{};
+    mip::GenerateMipChain(rgba.data(), 129, 67, 129 * 4, true, parallel,
+                          threads);
+    TEST_CHECK_EQUAL(parallel.size(), single.size());
+    for (std::size_t i = 0; i < std::min(parallel.size(), single.size());
+         ++i) {
+      TEST_CHECK(parallel[i].pixels == single[i].pixels);
+    }
+  }
+
+  // 何枚かまとめても1枚ずつと同じ
+  std::vector<std::vector<std::uint8_t>> images{};
+  std::vector<std::vector<mip::MipLevel>> outputs(5);
+  std::vector<mip::MipJob> jobs{};
+  for (std::uint32_t i = 0; i < 5; ++i) {
+    images.push_back(RandomImage(16 + i * 7, 9 + i, 100 + i));
+  }
+  for (std::uint32_t i = 0; i < 5; ++i) {
+    mip::MipJob job{};
+    job.rgba = images[i].data();
+    job.width = 16 + i * 7;
+    job.height = 9 + i;
+    job.rowPitch = std::size_t(job.width) * 4;
+    job.srgb = i % 2 == 0;
+    job.mips = &outputs[i];
+    jobs.push_back(job);
+  }
+  mip::GenerateMipChains(jobs, 3);
+  for (std::uint32_t i = 0; i < 5; ++i) {
+    std::vector<mip::MipLevel> expected{};
+    mip::GenerateMipChain(jobs[i].rgba, jobs[i].width, jobs[i].height,
+                          jobs[i].rowPitch, jobs[i].srgb, expected, 1);
+    TEST_CHECK_EQUAL(outputs[i].size(), expected.size());
+    for (std::size_t m = 0; m < std::min(outputs[i].size(), expected.size());
+         ++m) {
+      TEST_CHECK(outputs[i][m].pixels == expected[m].pixels);
+    }
+  }
+}
+}  // namespace
+
+int main() {
+  TestCountMips();
+  TestSrgbAveraging();
+  TestSizes();
+  TestRowPitch();
+  TestThreads();
+  return dxapp::test::Finish("MipGeneratorTest");
+}
@@ -0,0 +1,305 @@
+// OcclusionBufferの遮蔽カリングを、ピクセルの中心で光線を飛ばす参照と比べる
+// CMakeLists.txtでSimdLanes.hppの経路(1個ずつ・SSE2・AVX2)ごとにビルドする。
+// 壁の後ろに箱を並べた決まった場面で外す数を確かめ、
+// 乱数の壁と箱では、参照で1ピクセルでも見える箱を隠れているとしないこと
+// (間違って消さないこと)と、参照で隠れている箱を十分に外せることを見る。
+// WorkerPoolでタイルを分けて描いても深度が同じになることも見る
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "OcclusionBuffer.hpp"
+#include "SimdLanes.hpp"
+#include "TestCommon.hpp"
+#include "WorkerPool.hpp"
+
+namespace {
+using dxapp::Aabb;
+using dxapp::OcclusionBuffer;
+
+//! Sceneと同じ深度バッファの大きさ
+constexpr std::uint32_t Width = 256;
+constexpr std::uint32_t Height = 144;
+
+constexpr float NearZ = 0.5f;
+constexpr float FarZ = 150.0f;
+//! 射影の縦と横の倍率。縦の視野角は1ラジアン、16:9
+const float YScale = 1.0f / std::tan(0.5f);
+const float XScale = YScale / (16.0f / 9.0f);
+
+constexpr float Identity[4][4]{{1.0f, 0.0f, 0.0f, 0.0f},
+                               {0.0f, 1.0f, 0.0f, 0.0f},
+                               {0.0f, 0.0f, 1.0f, 0.0f},
+                               {0.0f, 0.0f, 0.0f, 1.0f}};
+
+/*!
+ * @brief 原点から+Zを見るカメラのビュー射影行列
+ * @details ビューは単位行列なので、射影行列だけになる
+ */
+void MakeViewProj(float (&viewProj)[4][4]) {
+  const float q = FarZ / (FarZ - NearZ);
+  const float m[4][4]{{XScale, 0.0f, 0.0f, 0.0f},
+                      {0.0f, YScale, 0.0f, 0.0f},
+                      {0.0f, 0.0f, q, 1.0f},
+                      {0.0f, 0.0f, -NearZ * q, 0.0f}};
+  std::memcpy(viewProj, m, sizeof(m));
+}
+
+/*!
+ * @brief カメラに正面を向けた長方形の遮蔽物。深度zで(x0, y0)-(x1, y1)
+ */
+struct Wall {
+  float x0, y0, x1, y1, z;
+};
+
+/*!
+ * @brief 壁を2つの三角形にして足す
+ * @return 足した三角形の数
+ */
+std::uint32_t AddWall(OcclusionBuffer& buffer, const Wall& wall) {
+  const float positions[4][3]{{wall.x0, wall.y0, wall.z},
+                              {wall.x1, wall.y0, wall.z},
+                              {wall.x1, wall.y1, wall.z},
+                              {wall.x0, wall.y1, wall.z}};
+  const std::uint32_t indices[6]{0, 1, 2, 0, 2, 3};
+  return buffer.AddOccluder(&positions[0][0], sizeof(positions[0]), indices, 6,
+                            Identity);
+}
+
+/*!
+ * @brief 1ピクセルずつ中心に光線を飛ばして、箱が見えるかを決める参照
+ */
+class PointSampler {
+ public:
+  explicit PointSampler(const std::vector<Wall>& walls) : walls_(walls) {}
+
+  /*!
+   * @brief 箱が1つのピクセルの中心でも、どの壁より手前に見えるか
+   * @param[out] covered 箱がかかるピクセルの中心の数
+   */
+  bool IsVisible(const Aabb& box, std::uint32_t* covered) const {
+    *covered = 0;
+    for (std::uint32_t py = 0; py < Height; ++py) {
+      for (std::uint32_t px = 0; px < Width; ++px) {
+        // ピクセルの中心を通る光線。向きのzを1にすると、進んだ量がビューのz
+        const auto ndcX = (px + 0.5f) / Width * 2.0f - 1.0f;
+        const auto ndcY = 1.0f - (py + 0.5f) / Height * 2.0f;
+        const float dir[3]{ndcX / XScale, ndcY / YScale, 1.0f};
+        float enter = 0.0f;
+        if (!HitBox(box, dir, &enter)) {
+          continue;
+        }
+        ++*covered;
+        // 深度の丸めで迷うところは隠れているほうに倒す
+        if (enter < WallDepth(px, py) * (1.0f - 1e-4f)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+ private:
+  /*!
+   * @brief ピクセルの中心にかかる壁の一番手前のz。なければ無限
+   * @details ラスタライザは辺を1/256ピクセル外に出すので、少し広めにとる
+   */
+  float WallDepth(std::uint32_t px, std::uint32_t py) const {
+    const auto cx = px + 0.5f;
+    const auto cy = py + 0.5f;
+    auto nearest = INFINITY;
+    for (const auto& wall : walls_) {
+      const auto sx0 = (wall.x0 / wall.z * XScale * 0.5f + 0.5f) * Width;
+      const auto sx1 = (wall.x1 / wall.z * XScale * 0.5f + 0.5f) * Width;
+      const auto sy0 = (0.5f - wall.y1 / wall.z * YScale * 0.5f) * Height;
+      const auto sy1 = (0.5f - wall.y0 / wall.z * YScale * 0.5f) * Height;
+      const auto eps = 1.0f / 64.0f;
+      if (sx0 - eps <= cx && cx <= sx1 + eps && sy0 - eps <= cy &&
+          cy <= sy1 + eps) {
+        nearest = std::min(nearest, wall.z);
+      }
+    }
+    return nearest;
+  }
+
+  /*!
+   * @brief 原点からdirへの光線が箱に入るか。入るzをenterに返す
+   */
+  static bool HitBox(const Aabb& box, const float (&dir)[3], float* enter) {
+    const float mins[3]{box.minX, box.minY, box.minZ};
+    const float maxs[3]{box.maxX, box.maxY, box.maxZ};
+    auto t0 = 0.0f;
+    auto t1 = INFINITY;
+    for (int axis = 0; axis < 3; ++axis) {
+      const auto a = mins[axis] / dir[axis];
+      const auto b = maxs[axis] / dir[axis];
+      t0 = std::max(t0, std::min(a, b));
+      t1 = std::min(t1, std::max(a, b));
+    }
+    *enter = t0;
+    return t0 <= t1;
+  }
+
+  const std::vector<Wall>& walls_;
+};
+
+Aabb MakeBox(float x, float y, float z, float half) {
+  return {x - half, y - half, z - half, x + half, y + half, z + half};
+}
+
+/*!
+ * @brief 壁の後ろに並べた箱は外し、手前・横・はみ出す箱は残す
+ */
+void TestWallScene() {
+  float viewProj[4][4];
+  MakeViewProj(viewProj);
+  OcclusionBuffer buffer{};
+  buffer.Initialize(Width, Height);
+  TEST_CHECK_EQUAL(buffer.width() % OcclusionBuffer::TileWidth, 0u);
+  TEST_CHECK_EQUAL(buffer.height() % OcclusionBuffer::TileHeight, 0u);
+
+  // 遮蔽物がなければ何も隠れない
+  buffer.BeginFrame(viewProj);
+  buffer.Rasterize(nullptr);
+  TEST_CHECK(!buffer.IsOccluded(MakeBox(0.0f, 0.0f, 40.0f, 1.0f)));
+
+  buffer.BeginFrame(viewProj);
+  TEST_CHECK_EQUAL(AddWall(buffer, {-10.0f, -10.0f, 10.0f, 10.0f, 20.0f}),
+                   2u);
+  // 後から足した奥の壁で、手前の壁の深度を上書きしない
+  TEST_CHECK_EQUAL(AddWall(buffer, {-90.0f, -50.0f, 90.0f, 50.0f, 145.0f}),
+                   2u);
+  // カメラの後ろにかかる遮蔽物は描かない
+  TEST_CHECK_EQUAL(AddWall(buffer, {-1.0f, -1.0f, 1.0f, 1.0f, -5.0f}), 0u);
+  TEST_CHECK_EQUAL(buffer.triangleCount(), 4u);
+  buffer.Rasterize(nullptr);
+
+  // z = 40では手前の壁が x, yとも±20まで隠す
+  std::vector<Aabb> boxes;
+  for (int y = -2; y <= 2; ++y) {
+    for (int x = -2; x <= 2; ++x) {
+      boxes.push_back(MakeBox(x * 6.0f, y * 6.0f, 40.0f, 1.0f));
+    }
+  }
+  boxes.push_back(MakeBox(80.0f, 0.0f, 147.0f, 1.0f));  // 奥の壁の後ろ
+  const auto hiddenCount = static_cast<std::uint32_t>(boxes.size());
+  for (int i = 0; i < 5; ++i) {
+    boxes.push_back(MakeBox(i * 2.0f - 4.0f, 0.0f, 10.0f, 0.5f));  // 手前
+    boxes.push_back(MakeBox(30.0f, i * 4.0f - 8.0f, 40.0f, 1.0f));  // 横
+  }
+  boxes.push_back(MakeBox(20.0f, 0.0f, 40.0f, 1.0f));  // 端にかかる
+  boxes.push_back(MakeBox(0.0f, 0.0f, 20.0f, 1.0f));   // 壁を貫く
+  boxes.push_back(MakeBox(0.0f, 0.0f, -10.0f, 1.0f));  // カメラの後ろ
+  boxes.push_back(MakeBox(200.0f, 0.0f, 40.0f, 1.0f));  // 画面の外
+  boxes.push_back({-1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 80.0f});  // 手前の面にかかる
+
+  std::uint32_t occluded = 0;
+  for (std::size_t i = 0; i < boxes.size(); ++i) {
+    const auto hidden = buffer.IsOccluded(boxes[i]);
+    TEST_CHECK_EQUAL(hidden, i < hiddenCount);
+    occluded += hidden ? 1 : 0;
+  }
+  TEST_CHECK_EQUAL(occluded, hiddenCount);
+
+  // 次のフレームでは前の遮蔽物は残らない
+  buffer.BeginFrame(viewProj);
+  TEST_CHECK_EQUAL(buffer.triangleCount(), 0u);
+  buffer.Rasterize(nullptr);
+  TEST_CHECK(!buffer.IsOccluded(boxes[0]));
+}
+
+/*!
+ * @brief 乱数の壁と箱で、間違って外さないことと、外せる数を見る
+ */
+void TestRandomScenes() {
+  float viewProj[4][4];
+  MakeViewProj(viewProj);
+  OcclusionBuffer buffer{};
+  buffer.Initialize(Width, Height);
+  OcclusionBuffer single{};
+  single.Initialize(Width, Height);
+  dxapp::WorkerPool workers{};
+  workers.Initialize(4);
+
+  std::uint32_t seed = 3;
+  auto next = [&seed](float lo, float hi) {
+    seed = seed * 1664525u + 1013904223u;
+    return lo + (hi - lo) * ((seed >> 8) / 16777216.0f);
+  };
+  int falseOcclusions = 0;
+  int depthMismatches = 0;
+  std::uint32_t hiddenByReference = 0;
+  std::uint32_t culled = 0;
+  std::uint32_t culledTotal = 0;
+  for (int scene = 0; scene < 6; ++scene) {
+    std::vector<Wall> walls;
+    for (int i = 0; i < 10; ++i) {
+      const auto z = next(8.0f, 60.0f);
+      const auto x = next(-0.6f, 0.6f) * z;
+      const auto y = next(-0.4f, 0.4f) * z;
+      const auto w = next(0.05f, 0.3f) * z;
+      const auto h = next(0.05f, 0.3f) * z;
+      walls.push_back({x - w, y - h, x + w, y + h, z});
+    }
+
+    // 1スレッドで描いた深度と、タイルを分けて描いた深度は同じ
+    buffer.BeginFrame(viewProj);
+    single.BeginFrame(viewProj);
+    for (const auto& wall : walls) {
+      AddWall(buffer, wall);
+      AddWall(single, wall);
+    }
+    buffer.Rasterize(&workers);
+    single.Rasterize(nullptr);
+    for (std::uint32_t i = 0; i < Width * Height; ++i) {
+      depthMismatches += buffer.depth()[i] != single.depth()[i] ? 1 : 0;
+    }
+
+    const PointSampler sampler(walls);
+    for (int i = 0; i < 400; ++i) {
+      const auto z = next(5.0f, 100.0f);
+      const auto box = MakeBox(next(-0.7f, 0.7f) * z, next(-0.4f, 0.4f) * z,
+                               z, next(0.2f, 3.0f));
+      std::uint32_t covered = 0;
+      const auto visible = sampler.IsVisible(box, &covered);
+      const auto occluded = buffer.IsOccluded(box);
+      culledTotal += occluded ? 1 : 0;
+      if (occluded && visible) {
+        std::printf("scene %d: box %d at z %.2f is visible but occluded\n",
+                    scene, i, z);
+        ++falseOcclusions;
+      }
+      if (!visible && covered > 0) {
+        ++hiddenByReference;
+        culled += occluded ? 1 : 0;
+      }
+    }
+  }
+  std::printf("occluded %u of %u hidden boxes (%u culled)\n", culled,
+              hiddenByReference, culledTotal);
+  TEST_CHECK_EQUAL(falseOcclusions, 0);
+  TEST_CHECK_EQUAL(depthMismatches, 0);
+  // 箱の一番手前の角の深度で比べるので全部は外せないが、大半は外せる
+  TEST_CHECK(hiddenByReference > 100);
+  TEST_CHECK(culled >= hiddenByReference * 9 / 10);
+}
+}  // namespace
+
+int main() {
+#if defined(DXAPP_SIMD_AVX2) && (defined(__GNUC__) || defined(__clang__))
+  if (!__builtin_cpu_supports("avx2")) {
+    std::printf("OcclusionBufferTest: skipped (no AVX2)\n");
+    return 0;
+  }
+#endif
+#if defined(EXPECTED_SIMD_LANES)
+  // CMakeLists.txtで選んだ経路でビルドされているか
+  TEST_CHECK_EQUAL(dxapp::simd::LaneCount, EXPECTED_SIMD_LANES);
+#endif
+  TestWallScene();
+  TestRandomScenes();
+  return dxapp::test::Finish("OcclusionBufferTest");
+}
@@ -0,0 +1,121 @@
+// PixelConvertの関数ごとの速さを命令セットごとに測る
+// 1024x1024のRGBAを何度も変換して、1秒あたりのピクセル数を出す
+// (halfの変換はfloat4を1ピクセルとして数える)
+//
+// 使い方: PixelConvertBench [関数ごとに測る時間(ミリ秒)]
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include "PixelConvert.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+namespace pixel = dxapp::pixel;
+using pixel::SimdLevel;
+
+constexpr std::size_t PixelCount = 1024 * 1024;
+
+/*!
+ * @brief funcを時間いっぱい繰り返し、1秒あたりのピクセル数を返す
+ */
+double Measure(const std::function<void()>& func, int durationMs) {
+  func();  // テーブルの初期化やページの割り当てを済ませておく
+  const dxapp::test::Stopwatch stopwatch{};
+  int iterations = 0;
+  do {
+    func();
+    ++iterations;
+  } while (stopwatch.milliseconds() < durationMs);
+  return PixelCount * iterations / (stopwatch.milliseconds() / 1000.0);
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  const auto durationMs = argc > 1 ? std::atoi(argv[1]) : 300;
+
+  std::vector<std::uint8_t> bytes(PixelCount * 4);
+  std::uint32_t seed = 1;
+  for (auto& b : bytes) {
+    seed = seed * 1664525u + 1013904223u;
+    b = static_cast<std::uint8_t>(seed >> 24);
+  }
+  std::vector<std::uint8_t> bytesOut(PixelCount * 4);
+  std::vector<float> floats(PixelCount * 4);
+  pixel::DecodeToFloat(bytes.data(), floats.data(), PixelCount, false);
+  std::vector<std::uint16_t> halves(PixelCount * 4);
+  pixel::FloatToHalf(floats.data(), halves.data(), floats.size());
+  std::vector<float> floatsOut(PixelCount * 4);
+
+  const struct {
+    const char* name;
+    std::function<void()> func;
+  } kernels[] = {
+      {"SwizzleRB",
+       [&]() { pixel::SwizzleRB(bytes.data(), bytesOut.data(), PixelCount); }},
+      {"ExpandRGBToRGBA",
+       [&]() {
+         pixel::ExpandRGBToRGBA(bytes.data(), bytesOut.data(), PixelCount);
+       }},
+      {"PremultiplyAlpha",
+       [&]() {
+         pixel::PremultiplyAlpha(bytes.data(), bytesOut.data(), PixelCount);
+       }},
+      {"DecodeToFloat",
+       [&]() {
+         pixel::DecodeToFloat(bytes.data(), floatsOut.data(), PixelCount,
+                              false);
+       }},
+      {"DecodeToFloat(sRGB)",
+       [&]() {
+         pixel::DecodeToFloat(bytes.data(), floatsOut.data(), PixelCount,
+                              true);
+       }},
+      {"EncodeFromFloat",
+       [&]() {
+         pixel::EncodeFromFloat(floats.data(), bytesOut.data(), PixelCount,
+                                false);
+       }},
+      {"EncodeFromFloat(sRGB)",
+       [&]() {
+         pixel::EncodeFromFloat(floats.data(), bytesOut.data(), PixelCount,
+                                true);
+       }},
+      {"FloatToHalf",
+       [&]() {
+         pixel::FloatToHalf(floats.data(), halves.data(), floats.size());
+       }},
+      {"HalfToFloat",
+       [&]() {
+         pixel::HalfToFloat(halves.data(), floatsOut.data(), halves.size());
+       }},
+  };
+
+  // このCPUで使える命令セットだけを測る
+  std::vector<SimdLevel> levels{};
+  for (const auto level :
+       {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+    pixel::SetSimdLevel(level);
+    if (pixel::simdLevel() == level) {
+      levels.push_back(level);
+    }
+  }
+  const char* levelNames[] = {"Scalar", "SSE2", "AVX2"};
+
+  std::printf("million pixels per second, %zu pixels\n", PixelCount);
+  std::printf("%-22s", "kernel");
+  for (const auto level : levels) {
+    std::printf(" %10s", levelNames[static_cast<int>(level)]);
+  }
+  std::printf("\n");
+  for (const auto& kernel : kernels) {
+    std::printf("%-22s", kernel.name);
+    for (const auto level : levels) {
+      pixel::SetSimdLevel(level);
+      std::printf(" %10.1f", Measure(kernel.func, durationMs) / 1e6);
+    }
+    std::printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,350 @@
+// PixelConvertの変換を確かめる
+// プリマルチプライは(c, a)の全組み合わせ、halfは全65536値を式で求めた値と比べ、
+// sRGBは8bit→float→8bitで元に戻ることを見る。
+// SetSimdLevelで命令セットを変えて、どれもスカラーとビット単位で同じになることも見る
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include "PixelConvert.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+namespace pixel = dxapp::pixel;
+using pixel::SimdLevel;
+
+const char* LevelName(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::AVX2:
+      return "AVX2";
+    case SimdLevel::SSE2:
+      return "SSE2";
+    default:
+      return "Scalar";
+  }
+}
+
+//! このCPUで使える命令セット
+std::vector<SimdLevel> SupportedLevels() {
+  std::vector<SimdLevel> levels{};
+  for (const auto level : {SimdLevel::Scalar, SimdLevel::SSE2,
+                           SimdLevel::AVX2}) {
+    pixel::SetSimdLevel(level);
+    if (pixel::simdLevel() == level) {
+      levels.push_back(level);
+    }
+  }
+  return levels;
+}
+
+std::uint32_t FloatBits(float f) {
+  std::uint32_t u;
+  std::memcpy(&u, &f, 4);
+  return u;
+}
+
+float BitsFloat(std::uint32_t u) {
+  float f;
+  std::memcpy(&f, &u, 4);
+  return f;
+}
+
+/*!
+ * @brief halfの値を式で求める
+ */
+float ReferenceHalfToFloat(std::uint16_t h) {
+  const int exponent = (h >> 10) & 0x1f;
+  const int mantissa = h & 0x3ff;
+  const float sign = (h & 0x8000) ? -1.0f : 1.0f;
+  if (exponent == 0x1f) {
+    return mantissa == 0 ? sign * INFINITY : NAN;
+  }
+  if (exponent == 0) {
+    return sign * std::ldexp(float(mantissa), -24);
+  }
+  return sign * std::ldexp(float(1024 + mantissa), exponent - 25);
+}
+
+/*!
+ * @brief floatを最近接偶数に丸めたhalfを式で求める
+ * @details NaNはF16Cと同じく、仮数の上位10bitを残したクワイエットNaNにする
+ */
+std::uint16_t ReferenceFloatToHalf(float f) {
+  const std::uint16_t sign = std::signbit(f) ? 0x8000 : 0;
+  if (std::isnan(f)) {
+    return static_cast<std::uint16_t>(0x7e00 | ((FloatBits(f) >> 13) & 0x3ff) |
+                                      sign);
+  }
+  if (std::isinf(f)) {
+    return 0x7c00 | sign;
+  }
+  const double a = std::fabs(double(f));
+  std::uint32_t bits = 0;
+  if (a < std::ldexp(1.0, -14)) {
+    // 非正規化数。1024になったら最小の正規化数になる
+    bits = static_cast<std::uint32_t>(std::nearbyint(std::ldexp(a, 24)));
+  } else {
+    int e = 0;
+    const double m = std::frexp(a, &e) * 2.0;  // [1, 2)
+    --e;
+    const auto q = static_cast<std::uint32_t>(
+        std::nearbyint((m - 1.0) * 1024.0));
+    // 丸めで仮数があふれたら指数に繰り上がる
+    bits = e > 15 ? 0x7c00u : (std::uint32_t(e + 15) << 10) + q;
+  }
+  return static_cast<std::uint16_t>(std::min(bits, 0x7c00u) | sign);
+}
+
+/*!
+ * @brief プリマルチプライの全組み合わせが四捨五入したc * a / 255になる
+ * @details c * a / 255はちょうど.5にならないので、整数で丸められる
+ */
+void TestPremultiplyExhaustive(SimdLevel level) {
+  pixel::SetSimdLevel(level);
+  std::vector<std::uint8_t> src(256 * 256 * 4);
+  for (int a = 0; a < 256; ++a) {
+    for (int c = 0; c < 256; ++c) {
+      auto p = &src[(a * 256 + c) * 4];
+      p[0] = static_cast<std::uint8_t>(c);
+      p[1] = static_cast<std::uint8_t>(255 - c);
+      p[2] = static_cast<std::uint8_t>(c ^ 0x55);
+      p[3] = static_cast<std::uint8_t>(a);
+    }
+  }
+  std::vector<std::uint8_t> dst(src.size());
+  pixel::PremultiplyAlpha(src.data(), dst.data(), 256 * 256);
+
+  int mismatches = 0;
+  for (std::size_t i = 0; i < src.size(); i += 4) {
+    const int a = src[i + 3];
+    for (int k = 0; k < 3; ++k) {
+      const int expected = (2 * src[i + k] * a + 255) / 510;
+      mismatches += dst[i + k] != expected;
+    }
+    mismatches += dst[i + 3] != a;
+  }
+  TEST_CHECK_EQUAL(mismatches, 0);
+
+  // 同じバッファに書いてもよい
+  pixel::PremultiplyAlpha(src.data(), src.data(), 256 * 256);
+  TEST_CHECK(src == dst);
+}
+
+/*!
+ * @brief 全halfのfloatへの変換と、floatからhalfへの戻り
+ */
+void TestHalfExhaustive(SimdLevel level) {
+  pixel::SetSimdLevel(level);
+  std::vector<std::uint16_t> halves(65536);
+  for (std::uint32_t h = 0; h < 65536; ++h) {
+    halves[h] = static_cast<std::uint16_t>(h);
+  }
+  std::vector<float> floats(halves.size());
+  pixel::HalfToFloat(halves.data(), floats.data(), halves.size());
+
+  int mismatches = 0;
+  for (std::uint32_t h = 0; h < 65536; ++h) {
+    const auto expected = ReferenceHalfToFloat(static_cast<std::uint16_t>(h));
+    // NaNはF16Cと同じく、仮数を残してクワイエットNaNにする
+    const auto expectedBits =
+        std::isnan(expected)
+            ? ((h & 0x8000u) << 16) | 0x7fc00000u | ((h & 0x3ffu) << 13)
+            : FloatBits(expected);
+    mismatches += FloatBits(floats[h]) != expectedBits;
+  }
+  TEST_CHECK_EQUAL(mismatches, 0);
+
+  // 元のhalfに戻る。NaNはクワイエットNaNになる
+  std::vector<std::uint16_t> back(halves.size());
+  pixel::FloatToHalf(floats.data(), back.data(), floats.size());
+  mismatches = 0;
+  for (std::uint32_t h = 0; h < 65536; ++h) {
+    const bool isNaN = (h & 0x7c00) == 0x7c00 && (h & 0x3ff) != 0;
+    mismatches += back[h] != (isNaN ? h | 0x200 : h);
+  }
+  TEST_CHECK_EQUAL(mismatches, 0);
+}
+
+/*!
+ * @brief floatからhalfへの丸め
+ * @details 捨てる13ビットがちょうど半分の前後になるfloatを、
+ *          上位のビットを全部変えながら試す。非正規化数の丸めも含まれる
+ */
+void TestFloatToHalfRounding(SimdLevel level) {
+  pixel::SetSimdLevel(level);
+  constexpr std::uint32_t LowBits[] = {0x0000, 0x0001, 0x0fff, 0x1000,
+                                       0x1001, 0x1fff, 0x0800, 0x17ff};
+  std::vector<float> floats{};
+  floats.reserve((1u << 19) * std::size(LowBits));
+  for (std::uint32_t high = 0; high < (1u << 19); ++high) {
+    for (const auto low : LowBits) {
+      floats.push_back(BitsFloat((high << 13) | low));
+    }
+  }
+  std::vector<std::uint16_t> halves(floats.size());
+  pixel::FloatToHalf(floats.data(), halves.data(), floats.size());
+
+  int mismatches = 0;
+  for (std::size_t i = 0; i < floats.size(); ++i) {
+    const auto expected = ReferenceFloatToHalf(floats[i]);
+    if (halves[i] != expected) {
+      if (mismatches < 4) {
+        std::printf("  %08x -> %04x (expected %04x)\n", FloatBits(floats[i]),
+                    halves[i], expected);
+      }
+      ++mismatches;
+    }
+  }
+  TEST_CHECK_EQUAL(mismatches, 0);
+}
+
+/*!
+ * @brief sRGBとリニアの8bit→float→8bitが元に戻る
+ */
+void TestSrgbRoundTrip(SimdLevel level) {
+  pixel::SetSimdLevel(level);
+  std::vector<std::uint8_t> src(256 * 4);
+  for (int i = 0; i < 256; ++i) {
+    src[i * 4 + 0] = static_cast<std::uint8_t>(i);
+    src[i * 4 + 1] = static_cast<std::uint8_t>(255 - i);
+    src[i * 4 + 2] = static_cast<std::uint8_t>(i * 7);
+    src[i * 4 + 3] = static_cast<std::uint8_t>(i * 13);
+  }
+  for (const bool srgb : {false, true}) {
+    std::vector<float> linear(src.size());
+    pixel::DecodeToFloat(src.data(), linear.data(), 256, srgb);
+
+    // 式で求めたリニアの値と比べる。アルファはsRGBにしない
+    int mismatches = 0;
+    for (std::size_t i = 0; i < src.size(); ++i) {
+      const double c = src[i] / 255.0;
+      const bool isColor = srgb && (i % 4) != 3;
+      const double expected =
+          !isColor ? c
+          : c <= 0.04045 ? c / 12.92
+                         : std::pow((c + 0.055) / 1.055, 2.4);
+      mismatches += std::fabs(linear[i] - expected) > 1e-6;
+    }
+    TEST_CHECK_EQUAL(mismatches, 0);
+
+    std::vector<std::uint8_t> back(src.size());
+    pixel::EncodeFromFloat(linear.data(), back.data(), 256, srgb);
+    TEST_CHECK(back == src);
+  }
+}
+
+/*!
+ * @brief 端数や範囲外の値を含む入力で、全部の関数がスカラーと同じ結果になる
+ * @details SIMDは端数をスカラーで処理するので、いろいろな数と位置で試す
+ */
+void TestMatchesScalar(SimdLevel level) {
+  constexpr std::size_t MaxCount = 1000;
+  std::uint32_t seed = 987654321;
+  auto next = [&seed]() {
+    seed = seed * 1664525u + 1013904223u;
+    return seed;
+  };
+
+  std::vector<std::uint8_t> bytes(MaxCount * 4 + 16);
+  for (auto& b : bytes) {
+    b = static_cast<std::uint8_t>(next() >> 24);
+  }
+  // 範囲外やNaN、無限大も混ぜる
+  std::vector<float> floats(MaxCount * 4 + 16);
+  for (std::size_t i = 0; i < floats.size(); ++i) {
+    switch (next() % 8) {
+      case 0:
+        floats[i] = BitsFloat(next() | 0x7f800001u);  // いろいろなNaN
+        break;
+      case 1:
+        floats[i] = (next() & 1) ? INFINITY : -INFINITY;
+        break;
+      case 2:
+        floats[i] = BitsFloat(next());
+        break;
+      default:
+        floats[i] = (next() >> 8) / float(1 << 24) * 1.5f - 0.25f;
+        break;
+    }
+  }
+  std::vector<std::uint16_t> halves(MaxCount * 4 + 16);
+  for (auto& h : halves) {
+    h = static_cast<std::uint16_t>(next() >> 16);
+  }
+
+  // levelとスカラーで同じ関数を呼び、出力をバイト単位で比べる
+  int mismatches = 0;
+  auto compare = [&](const char* name, std::size_t bytesOut,
+                     const auto& call) {
+    std::vector<std::uint8_t> expected(bytesOut, 0xCD);
+    std::vector<std::uint8_t> actual(bytesOut, 0xCD);
+    pixel::SetSimdLevel(SimdLevel::Scalar);
+    call(expected.data());
+    pixel::SetSimdLevel(level);
+    call(actual.data());
+    if (expected != actual && mismatches < 4) {
+      std::printf("  %s differs from scalar (%zu bytes)\n", name, bytesOut);
+    }
+    mismatches += expected != actual;
+  };
+
+  for (std::size_t count = 0; count <= MaxCount;
+       count += count < 70 ? 1 : 131) {
+    for (std::size_t offset = 0; offset < 4; offset += 3) {
+      const auto b = bytes.data() + offset;
+      const auto f = floats.data() + offset;
+      const auto h = halves.data() + offset;
+      compare("SwizzleRB", count * 4, [&](std::uint8_t* out) {
+        pixel::SwizzleRB(b, out, count);
+      });
+      compare("ExpandRGBToRGBA", count * 4, [&](std::uint8_t* out) {
+        pixel::ExpandRGBToRGBA(b, out, count);
+      });
+      compare("PremultiplyAlpha", count * 4, [&](std::uint8_t* out) {
+        pixel::PremultiplyAlpha(b, out, count);
+      });
+      for (const bool srgb : {false, true}) {
+        compare("DecodeToFloat", count * 16, [&](std::uint8_t* out) {
+          pixel::DecodeToFloat(b, reinterpret_cast<float*>(out), count, srgb);
+        });
+        compare("EncodeFromFloat", count * 4, [&](std::uint8_t* out) {
+          pixel::EncodeFromFloat(f, out, count, srgb);
+        });
+      }
+      compare("FloatToHalf", count * 8, [&](std::uint8_t* out) {
+        pixel::FloatToHalf(f, reinterpret_cast<std::uint16_t*>(out),
+                           count * 4);
+      });
+      compare("HalfToFloat", count * 16, [&](std::uint8_t* out) {
+        pixel::HalfToFloat(h, reinterpret_cast<float*>(out), count * 4);
+      });
+    }
+  }
+  TEST_CHECK_EQUAL(mismatches, 0);
+
+  // SwizzleRBは同じバッファに書いてもよい
+  std::vector<std::uint8_t> inPlace(bytes.begin(), bytes.begin() + 4 * 333);
+  std::vector<std::uint8_t> expected(inPlace.size());
+  pixel::SetSimdLevel(SimdLevel::Scalar);
+  pixel::SwizzleRB(inPlace.data(), expected.data(), 333);
+  pixel::SetSimdLevel(level);
+  pixel::SwizzleRB(inPlace.data(), inPlace.data(), 333);
+  TEST_CHECK(inPlace == expected);
+}
+}  // namespace
+
+int main() {
+  for (const auto level : SupportedLevels()) {
+    std::printf("  %s\n", LevelName(level));
+    TestPremultiplyExhaustive(level);
+    TestHalfExhaustive(level);
+    TestFloatToHalfRounding(level);
+    TestSrgbRoundTrip(level);
+    TestMatchesScalar(level);
+  }
+  return dxapp::test::Finish("PixelConvertTest");
+}
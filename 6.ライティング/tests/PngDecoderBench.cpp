@@ -0,0 +1,88 @@
+// PngDecoderのデコードの速さを画像の種類ごとに測る
+// 1024x1024の画像をPngEncoder.hppで書き、何度もデコードして
+// 1秒あたりのピクセル数とファイルのバイト数を出す。
+// フィルタは行ごとに0から4を混ぜる
+//
+// 使い方: PngDecoderBench [画像ごとに測る時間(ミリ秒)]
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "PngDecoder.hpp"
+#include "PngEncoder.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+using dxapp::test::PngEncodeOptions;
+using dxapp::test::PngSource;
+
+constexpr std::uint32_t Size = 1024;
+
+/*!
+ * @brief なめらかな模様に少しノイズを足した画像
+ */
+PngSource MakeSource(std::uint8_t colorType, std::uint8_t depth,
+                     bool interlace) {
+  PngSource source{};
+  source.width = Size;
+  source.height = Size;
+  source.colorType = colorType;
+  source.depth = depth;
+  source.interlace = interlace;
+  const auto channels = source.channels();
+  const std::uint32_t range = 1u << depth;
+  source.samples.resize(std::size_t(Size) * Size * channels);
+  std::uint32_t seed = 1;
+  for (std::uint32_t y = 0; y < Size; ++y) {
+    for (std::uint32_t x = 0; x < Size; ++x) {
+      for (std::uint32_t c = 0; c < channels; ++c) {
+        seed = seed * 1664525u + 1013904223u;
+        const auto v = (x + y * 2 + c * 64) * (range / 256) + (seed >> 28);
+        source.samples[(std::size_t(y) * Size + x) * channels + c] =
+            static_cast<std::uint16_t>(v % range);
+      }
+    }
+  }
+  return source;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  const auto durationMs = argc > 1 ? std::atoi(argv[1]) : 500;
+
+  const struct {
+    const char* name;
+    std::uint8_t colorType, depth;
+    bool interlace;
+  } cases[] = {
+      {"RGBA8", 6, 8, false},      {"RGB8", 2, 8, false},
+      {"RGBA16", 6, 16, false},    {"Gray8", 0, 8, false},
+      {"RGBA8 Adam7", 6, 8, true},
+  };
+
+  PngEncodeOptions options{};
+  options.filters = {0, 1, 2, 3, 4};
+  for (const auto& c : cases) {
+    const auto file = dxapp::test::EncodePng(
+        MakeSource(c.colorType, c.depth, c.interlace), options);
+
+    dxapp::png::Image image{};
+    if (!dxapp::png::DecodeFromMemory(file.data(), file.size(), image)) {
+      std::printf("%-12s decode failed\n", c.name);
+      return 1;
+    }
+    const dxapp::test::Stopwatch stopwatch{};
+    int iterations = 0;
+    do {
+      dxapp::png::DecodeFromMemory(file.data(), file.size(), image);
+      ++iterations;
+    } while (stopwatch.milliseconds() < durationMs);
+    const auto seconds = stopwatch.milliseconds() / 1000.0;
+    std::printf("%-12s %7.1f MP/s %7.1f MB/s of file (%.1f MB)\n", c.name,
+                double(Size) * Size * iterations / seconds / 1e6,
+                double(file.size()) * iterations / seconds / 1e6,
+                file.size() / 1e6);
+  }
+  return 0;
+}
@@ -0,0 +1,330 @@
+// PngDecoderのデコード結果をピクセル単位で確かめる
+// PngEncoder.hppで画像を書き、サンプルから直接求めたRGBA8と比べる。
+// フィルタ0から4(行ごとに混ぜたものも)、Adam7のインターレース、パレット
+// (1/2/4/8bitとtRNS)、グレーの低ビット深度、16bit、カラーキーを並べる。
+// フィルタ解除はbppが4ならSSE2、ほかはスカラーを通るので、どちらも見る
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "PngDecoder.hpp"
+#include "PngEncoder.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+namespace png = dxapp::png;
+using dxapp::test::EncodePng;
+using dxapp::test::PngEncodeOptions;
+using dxapp::test::PngSource;
+
+enum ColorType : std::uint8_t {
+  Gray = 0,
+  Rgb = 2,
+  Palette = 3,
+  GrayAlpha = 4,
+  Rgba = 6,
+};
+
+std::uint32_t NextRandom(std::uint32_t& seed) {
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+/*!
+ * @brief サンプルを埋めた画像を作る
+ * @details smoothなら近いピクセルが似た値になり、deflateの一致も出る
+ */
+PngSource MakeSource(std::uint32_t width, std::uint32_t height,
+                     std::uint8_t colorType, std::uint8_t depth,
+                     bool interlace, bool smooth, std::uint32_t seed) {
+  PngSource source{};
+  source.width = width;
+  source.height = height;
+  source.colorType = colorType;
+  source.depth = depth;
+  source.interlace = interlace;
+
+  std::uint32_t range = 1u << depth;
+  if (colorType == Palette) {
+    // 1bitなら2色、ほかは深度いっぱいより少し少なくして端も確かめる
+    const std::uint32_t colors = depth == 1 ? 2 : range - range / 4;
+    for (std::uint32_t i = 0; i < colors * 3; ++i) {
+      source.palette.push_back(static_cast<std::uint8_t>(NextRandom(seed)));
+    }
+    range = colors;
+  }
+
+  const auto channels = source.channels();
+  source.samples.resize(std::size_t(width) * height * channels);
+  for (std::uint32_t y = 0; y < height; ++y) {
+    for (std::uint32_t x = 0; x < width; ++x) {
+      for (std::uint32_t c = 0; c < channels; ++c) {
+        std::uint32_t v = NextRandom(seed);
+        if (smooth) {
+          v = (x * 3 + y * 5 + c * 40) * (range / 256 + 1) + v % 4;
+        }
+        source.samples[(std::size_t(y) * width + x) * channels + c] =
+            static_cast<std::uint16_t>(v % range);
+      }
+    }
+  }
+  return source;
+}
+
+/*!
+ * @brief サンプルからデコード結果のRGBA8を求める
+ * @details 16bitは上位バイト、低ビット深度はv * 255 / 最大値
+ */
+std::vector<std::uint8_t> Expected(const PngSource& source) {
+  const std::uint32_t maxValue = (1u << source.depth) - 1;
+  auto to8 = [&source, maxValue](std::uint32_t v) {
+    return static_cast<std::uint8_t>(source.depth == 16 ? v >> 8
+                                                         : v * 255 / maxValue);
+  };
+  auto keyAt = [&source](std::size_t i) -> std::uint32_t {
+    return (std::uint32_t(source.trns[i * 2]) << 8) | source.trns[i * 2 + 1];
+  };
+
+  const auto channels = source.channels();
+  const auto count = std::size_t(source.width) * source.height;
+  std::vector<std::uint8_t> rgba(count * 4);
+  for (std::size_t i = 0; i < count; ++i) {
+    const auto s = &source.samples[i * channels];
+    auto dst = &rgba[i * 4];
+    switch (source.colorType) {
+      case Gray:
+        dst[0] = dst[1] = dst[2] = to8(s[0]);
+        dst[3] = !source.trns.empty() && s[0] == keyAt(0) ? 0 : 255;
+        break;
+      case Rgb:
+        for (int c = 0; c < 3; ++c) {
+          dst[c] = to8(s[c]);
+        }
+        dst[3] = !source.trns.empty() && s[0] == keyAt(0) &&
+                         s[1] == keyAt(1) && s[2] == keyAt(2)
+                     ? 0
+                     : 255;
+        break;
+      case Palette:
+        for (int c = 0; c < 3; ++c) {
+          dst[c] = source.palette[s[0] * 3 + c];
+        }
+        dst[3] = s[0] < source.trns.size() ? source.trns[s[0]] : 255;
+        break;
+      case GrayAlpha:
+        dst[0] = dst[1] = dst[2] = to8(s[0]);
+        dst[3] = to8(s[1]);
+        break;
+      default:
+        for (int c = 0; c < 4; ++c) {
+          dst[c] = to8(s[c]);
+        }
+        break;
+    }
+  }
+  return rgba;
+}
+
+/*!
+ * @brief エンコードしてデコードし、期待値とピクセルごとに比べる
+ */
+void Check(const std::string& name, const PngSource& source,
+           const PngEncodeOptions& options = {}) {
+  const auto file = EncodePng(source, options);
+  png::Image image{};
+  std::string error{};
+  if (!png::DecodeFromMemory(file.data(), file.size(), image, &error)) {
+    std::printf("%s: decode failed (%s)\n", name.c_str(), error.c_str());
+    TEST_CHECK(false);
+    return;
+  }
+  TEST_CHECK_EQUAL(image.width, source.width);
+  TEST_CHECK_EQUAL(image.height, source.height);
+
+  const auto expected = Expected(source);
+  if (image.pixels.size() != expected.size()) {
+    TEST_CHECK_EQUAL(image.pixels.size(), expected.size());
+    return;
+  }
+  int mismatches = 0;
+  for (std::size_t i = 0; i < expected.size(); i += 4) {
+    for (int c = 0; c < 4; ++c) {
+      if (image.pixels[i + c] != expected[i + c]) {
+        if (mismatches == 0) {
+          std::printf("%s: pixel %zu channel %d: %d != %d\n", name.c_str(),
+                      i / 4, c, image.pixels[i + c], expected[i + c]);
+        }
+        ++mismatches;
+      }
+    }
+  }
+  TEST_CHECK_EQUAL(mismatches, 0);
+}
+
+std::string Describe(const PngSource& source, const char* what) {
+  char buffer[96];
+  std::snprintf(buffer, sizeof(buffer), "type%d depth%d %ux%u %s",
+                source.colorType, source.depth, source.width, source.height,
+                what);
+  return buffer;
+}
+
+/*!
+ * @brief 0から4の各フィルタと、行ごとに混ぜたもの
+ * @details チャンネル数とビット深度でbppを1、2、3、4、6、8と変える
+ */
+void TestFilters() {
+  const struct {
+    std::uint8_t colorType, depth;
+  } formats[] = {{Rgba, 8}, {Rgb, 8},  {Gray, 8},      {GrayAlpha, 8},
+                 {Rgba, 16}, {Rgb, 16}, {Gray, 16}, {GrayAlpha, 16}};
+  std::uint32_t seed = 29;
+  for (const auto& format : formats) {
+    for (const bool smooth : {false, true}) {
+      const auto source = MakeSource(37, 19, format.colorType, format.depth,
+                                     false, smooth, seed++);
+      for (std::uint8_t filter = 0; filter <= 4; ++filter) {
+        PngEncodeOptions options{};
+        options.filters = {filter};
+        Check(Describe(source, ("filter" + std::to_string(filter)).c_str()),
+              source, options);
+      }
+      PngEncodeOptions mixed{};
+      mixed.filters = {4, 0, 3, 1, 2, 4, 4, 1};
+      Check(Describe(source, "mixed filters"), source, mixed);
+    }
+  }
+
+  // SSE2の版は16バイト単位で進むので、端数の幅を一通り見る
+  for (std::uint32_t width = 1; width <= 9; ++width) {
+    const auto source = MakeSource(width, 5, Rgba, 8, false, false, seed++);
+    PngEncodeOptions options{};
+    options.filters = {1, 2, 3, 4, 0};
+    Check(Describe(source, "narrow"), source, options);
+  }
+}
+
+/*!
+ * @brief Adam7のインターレース
+ * @details 8未満の大きさでは空のパスができる
+ */
+void TestInterlace() {
+  const std::uint32_t sizes[][2] = {{1, 1}, {2, 3},  {5, 1},   {7, 7},
+                                    {8, 8}, {9, 13}, {33, 17}, {64, 3}};
+  const struct {
+    std::uint8_t colorType, depth;
+  } formats[] = {{Rgba, 8}, {Rgb, 16}, {Palette, 4}, {Gray, 2}};
+  std::uint32_t seed = 7;
+  for (const auto& size : sizes) {
+    for (const auto& format : formats) {
+      const auto source = MakeSource(size[0], size[1], format.colorType,
+                                     format.depth, true, false, seed++);
+      PngEncodeOptions options{};
+      options.filters = {0, 1, 2, 3, 4};
+      Check(Describe(source, "interlaced"), source, options);
+    }
+  }
+}
+
+/*!
+ * @brief パレットとtRNS、グレーの低ビット深度
+ * @details 1行のバイト数が半端になる幅にする
+ */
+void TestPaletteAndLowDepth() {
+  std::uint32_t seed = 3;
+  for (const std::uint8_t depth : {1, 2, 4, 8}) {
+    auto source = MakeSource(13, 6, Palette, depth, false, false, seed++);
+    Check(Describe(source, "palette"), source);
+
+    // tRNSはパレットより短くてもよく、残りは不透明
+    const auto colors = source.palette.size() / 3;
+    for (std::size_t i = 0; i < (colors + 1) / 2; ++i) {
+      source.trns.push_back(static_cast<std::uint8_t>(i * 37));
+    }
+    PngEncodeOptions options{};
+    options.filters = {1, 4};
+    Check(Describe(source, "palette trns"), source, options);
+  }
+  for (const std::uint8_t depth : {1, 2, 4}) {
+    const auto source = MakeSource(11, 7, Gray, depth, false, false, seed++);
+    PngEncodeOptions options{};
+    options.filters = {0, 2, 3};
+    Check(Describe(source, "low depth gray"), source, options);
+  }
+}
+
+/*!
+ * @brief tRNSのカラーキー
+ * @details 画像にある色をキーにして、透明になるピクセルを必ず作る
+ */
+void TestColorKey() {
+  auto rgb = MakeSource(16, 4, Rgb, 8, false, true, 11);
+  for (int c = 0; c < 3; ++c) {
+    rgb.trns.push_back(0);
+    rgb.trns.push_back(static_cast<std::uint8_t>(rgb.samples[c]));
+  }
+  Check(Describe(rgb, "color key"), rgb);
+
+  auto gray = MakeSource(9, 9, Gray, 16, false, false, 12);
+  gray.trns.push_back(static_cast<std::uint8_t>(gray.samples[5] >> 8));
+  gray.trns.push_back(static_cast<std::uint8_t>(gray.samples[5]));
+  Check(Describe(gray, "color key"), gray);
+}
+
+/*!
+ * @brief deflateの書き方とIDATの分け方によらず同じになる
+ */
+void TestStreams() {
+  const auto source = MakeSource(300, 20, Rgba, 8, false, true, 5);
+  PngEncodeOptions options{};
+  options.filters = {0, 1, 2, 3, 4};
+  options.compress = false;
+  Check(Describe(source, "stored blocks"), source, options);  // 65535超え
+  options.idatSize = 7;
+  Check(Describe(source, "stored, small IDAT"), source, options);
+  options.compress = true;
+  Check(Describe(source, "fixed huffman, small IDAT"), source, options);
+}
+
+/*!
+ * @brief 壊れたファイルは失敗を返す
+ */
+void TestErrors() {
+  const auto source = MakeSource(8, 8, Rgba, 8, false, false, 1);
+  png::Image image{};
+
+  // 範囲外のフィルタ
+  PngEncodeOptions badFilter{};
+  badFilter.filters = {0, 5};
+  auto file = EncodePng(source, badFilter);
+  TEST_CHECK(!png::DecodeFromMemory(file.data(), file.size(), image));
+
+  // 途中で切れている
+  file = EncodePng(source);
+  TEST_CHECK(!png::DecodeFromMemory(file.data(), file.size() / 2, image));
+
+  // パレットがない
+  auto palette = MakeSource(4, 4, Palette, 8, false, false, 2);
+  palette.palette.clear();
+  file = EncodePng(palette);
+  TEST_CHECK(!png::DecodeFromMemory(file.data(), file.size(), image));
+
+  // 16bitのパレットはない
+  palette = MakeSource(4, 4, Palette, 8, false, false, 2);
+  palette.depth = 16;
+  palette.samples.assign(16, 0);
+  file = EncodePng(palette);
+  TEST_CHECK(!png::DecodeFromMemory(file.data(), file.size(), image));
+}
+}  // namespace
+
+int main() {
+  TestFilters();
+  TestInterlace();
+  TestPaletteAndLowDepth();
+  TestColorKey();
+  TestStreams();
+  TestErrors();
+  return dxapp::test::Finish("PngDecoderTest");
+}
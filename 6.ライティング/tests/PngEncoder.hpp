@@ -0,0 +1,324 @@
+#pragma once
+// テストとベンチマークで使う小さなPNGエンコーダ
+// フィルタの種類を行ごとに選べ、Adam7のインターレースにも対応する。
+// deflateは非圧縮ブロックか、固定ハフマン(近くの繰り返しだけ一致にする)で書く
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+namespace dxapp {
+namespace test {
+
+/*!
+ * @brief PNGにする画像
+ * @details samplesはピクセルごとにチャンネルを並べたもの。
+ *          パレットならインデックス、16bitなら0から65535
+ */
+struct PngSource {
+  std::uint32_t width{0};
+  std::uint32_t height{0};
+  std::uint8_t depth{8};      //!< ビット深度
+  std::uint8_t colorType{6};  //!< 0:グレー 2:RGB 3:パレット 4:グレーα 6:RGBA
+  bool interlace{false};      //!< Adam7にするか
+  std::vector<std::uint16_t> samples{};
+  std::vector<std::uint8_t> palette{};  //!< RGBの並び
+  std::vector<std::uint8_t> trns{};     //!< tRNSチャンクの中身(なければ空)
+
+  std::uint32_t channels() const {
+    switch (colorType) {
+      case 2:
+        return 3;
+      case 4:
+        return 2;
+      case 6:
+        return 4;
+      default:
+        return 1;
+    }
+  }
+};
+
+/*!
+ * @brief PNGを書くときの設定
+ */
+struct PngEncodeOptions {
+  //! 行ごとのフィルタ。行の番号(パスをまたいで通し)で繰り返して使う
+  std::vector<std::uint8_t> filters{0};
+  bool compress{true};  //!< falseなら非圧縮ブロックだけで書く
+  std::size_t idatSize{65536};  //!< IDATチャンク1つの最大バイト数
+};
+
+namespace png_encoder {
+
+inline std::uint32_t Crc32(const std::uint8_t* data, std::size_t size,
+                           std::uint32_t crc = 0) {
+  crc = ~crc;
+  for (std::size_t i = 0; i < size; ++i) {
+    crc ^= data[i];
+    for (int k = 0; k < 8; ++k) {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+inline void PutBE32(std::vector<std::uint8_t>& out, std::uint32_t v) {
+  out.push_back(static_cast<std::uint8_t>(v >> 24));
+  out.push_back(static_cast<std::uint8_t>(v >> 16));
+  out.push_back(static_cast<std::uint8_t>(v >> 8));
+  out.push_back(static_cast<std::uint8_t>(v));
+}
+
+inline void PutChunk(std::vector<std::uint8_t>& out, const char* type,
+                     const std::uint8_t* body, std::size_t size) {
+  PutBE32(out, static_cast<std::uint32_t>(size));
+  const auto start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), body, body + size);
+  PutBE32(out, Crc32(out.data() + start, size + 4));
+}
+
+/*!
+ * @brief deflateのビット列を下位ビットから書く
+ */
+class BitWriter {
+ public:
+  explicit BitWriter(std::vector<std::uint8_t>& out) : out_(out) {}
+
+  void Bits(std::uint32_t value, int n) {
+    for (int i = 0; i < n; ++i) {
+      if (count_ == 0) {
+        out_.push_back(0);
+      }
+      out_.back() |= static_cast<std::uint8_t>(((value >> i) & 1) << count_);
+      count_ = (count_ + 1) & 7;
+    }
+  }
+
+  //! ハフマン符号は上位ビットから書く
+  void Code(std::uint32_t code, int n) {
+    for (int i = n - 1; i >= 0; --i) {
+      Bits((code >> i) & 1, 1);
+    }
+  }
+
+  void Align() { count_ = 0; }
+
+ private:
+  std::vector<std::uint8_t>& out_;
+  int count_{0};
+};
+
+//! 固定ハフマンのリテラル・長さの符号
+inline void PutFixedSymbol(BitWriter& writer, std::uint32_t symbol) {
+  if (symbol < 144) {
+    writer.Code(0x30 + symbol, 8);
+  } else if (symbol < 256) {
+    writer.Code(0x190 + symbol - 144, 9);
+  } else if (symbol < 280) {
+    writer.Code(symbol - 256, 7);
+  } else {
+    writer.Code(0xC0 + symbol - 280, 8);
+  }
+}
+
+/*!
+ * @brief zlibストリームにする
+ * @details 圧縮するときは距離1から4、長さ3から10の一致だけを探す。
+ *          どちらも拡張ビットのいらない範囲なので符号が単純になる
+ */
+inline std::vector<std::uint8_t> Deflate(const std::vector<std::uint8_t>& data,
+                                         bool compress) {
+  std::vector<std::uint8_t> out{0x78, 0x01};
+  BitWriter writer(out);
+  if (!compress) {
+    std::size_t pos = 0;
+    do {
+      const auto len = std::min<std::size_t>(data.size() - pos, 65535);
+      const bool isFinal = pos + len == data.size();
+      writer.Bits(isFinal ? 1 : 0, 1);
+      writer.Bits(0, 2);
+      writer.Align();
+      out.push_back(static_cast<std::uint8_t>(len));
+      out.push_back(static_cast<std::uint8_t>(len >> 8));
+      out.push_back(static_cast<std::uint8_t>(~len));
+      out.push_back(static_cast<std::uint8_t>(~len >> 8));
+      out.insert(out.end(), data.begin() + pos, data.begin() + pos + len);
+      pos += len;
+    } while (pos < data.size());
+  } else {
+    writer.Bits(1, 1);
+    writer.Bits(1, 2);
+    std::size_t pos = 0;
+    while (pos < data.size()) {
+      std::size_t bestLength = 0;
+      std::size_t bestDistance = 0;
+      for (std::size_t distance = 1; distance <= 4 && distance <= pos;
+           ++distance) {
+        std::size_t length = 0;
+        while (length < 10 && pos + length < data.size() &&
+               data[pos + length] == data[pos + length - distance]) {
+          ++length;
+        }
+        if (length > bestLength) {
+          bestLength = length;
+          bestDistance = distance;
+        }
+      }
+      if (bestLength >= 3) {
+        PutFixedSymbol(writer, static_cast<std::uint32_t>(254 + bestLength));
+        writer.Code(static_cast<std::uint32_t>(bestDistance - 1), 5);
+        pos += bestLength;
+      } else {
+        PutFixedSymbol(writer, data[pos++]);
+      }
+    }
+    PutFixedSymbol(writer, 256);
+  }
+
+  // Adler-32
+  std::uint32_t a = 1;
+  std::uint32_t b = 0;
+  for (const auto byte : data) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  PutBE32(out, (b << 16) | a);
+  return out;
+}
+
+inline std::uint8_t Paeth(int a, int b, int c) {
+  const int pa = std::abs(b - c);
+  const int pb = std::abs(a - c);
+  const int pc = std::abs(a + b - 2 * c);
+  if (pa <= pb && pa <= pc) {
+    return static_cast<std::uint8_t>(a);
+  }
+  return static_cast<std::uint8_t>(pb <= pc ? b : c);
+}
+
+/*!
+ * @brief 1行分のサンプルをPNGのバイト列に詰める
+ */
+inline std::vector<std::uint8_t> PackRow(const PngSource& source,
+                                         std::uint32_t y, std::uint32_t x0,
+                                         std::uint32_t dx,
+                                         std::uint32_t width) {
+  const auto channels = source.channels();
+  const auto bits = std::size_t(width) * channels * source.depth;
+  std::vector<std::uint8_t> row((bits + 7) / 8, 0);
+  std::size_t bit = 0;
+  for (std::uint32_t i = 0; i < width; ++i) {
+    const auto x = x0 + i * dx;
+    for (std::uint32_t c = 0; c < channels; ++c) {
+      const auto v =
+          source.samples[(std::size_t(y) * source.width + x) * channels + c];
+      if (source.depth == 16) {
+        row[bit / 8] = static_cast<std::uint8_t>(v >> 8);
+        row[bit / 8 + 1] = static_cast<std::uint8_t>(v);
+      } else if (source.depth == 8) {
+        row[bit / 8] = static_cast<std::uint8_t>(v);
+      } else {
+        const auto shift = 8 - source.depth - (bit & 7);
+        row[bit / 8] |= static_cast<std::uint8_t>(v << shift);
+      }
+      bit += source.depth;
+    }
+  }
+  return row;
+}
+}  // namespace png_encoder
+
+/*!
+ * @brief PNGファイルの中身をメモリに作る
+ */
+inline std::vector<std::uint8_t> EncodePng(
+    const PngSource& source, const PngEncodeOptions& options = {}) {
+  using namespace png_encoder;
+  const std::size_t bpp =
+      std::max<std::size_t>(1, source.channels() * source.depth / 8);
+
+  // フィルタをかけた行を並べる
+  std::vector<std::uint8_t> raw{};
+  std::size_t rowIndex = 0;
+  auto addPass = [&](std::uint32_t x0, std::uint32_t y0, std::uint32_t dx,
+                     std::uint32_t dy) {
+    if (source.width <= x0 || source.height <= y0) {
+      return;
+    }
+    const auto width = (source.width - x0 + dx - 1) / dx;
+    std::vector<std::uint8_t> prev{};
+    for (auto y = y0; y < source.height; y += dy) {
+      const auto row = PackRow(source, y, x0, dx, width);
+      if (prev.empty()) {
+        prev.assign(row.size(), 0);
+      }
+      const auto filter = options.filters[rowIndex++ % options.filters.size()];
+      raw.push_back(filter);
+      for (std::size_t i = 0; i < row.size(); ++i) {
+        const int a = i >= bpp ? row[i - bpp] : 0;
+        const int b = prev[i];
+        const int c = i >= bpp ? prev[i - bpp] : 0;
+        int predictor = 0;
+        switch (filter) {
+          case 1:
+            predictor = a;
+            break;
+          case 2:
+            predictor = b;
+            break;
+          case 3:
+            predictor = (a + b) >> 1;
+            break;
+          case 4:
+            predictor = Paeth(a, b, c);
+            break;
+          default:
+            break;
+        }
+        raw.push_back(static_cast<std::uint8_t>(row[i] - predictor));
+      }
+      prev = row;
+    }
+  };
+  if (source.interlace) {
+    static constexpr std::uint32_t X0[7]{0, 4, 0, 2, 0, 1, 0};
+    static constexpr std::uint32_t Y0[7]{0, 0, 4, 0, 2, 0, 1};
+    static constexpr std::uint32_t Dx[7]{8, 8, 4, 4, 2, 2, 1};
+    static constexpr std::uint32_t Dy[7]{8, 8, 8, 4, 4, 2, 2};
+    for (int i = 0; i < 7; ++i) {
+      addPass(X0[i], Y0[i], Dx[i], Dy[i]);
+    }
+  } else {
+    addPass(0, 0, 1, 1);
+  }
+
+  std::vector<std::uint8_t> out{0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  std::vector<std::uint8_t> ihdr{};
+  PutBE32(ihdr, source.width);
+  PutBE32(ihdr, source.height);
+  ihdr.push_back(source.depth);
+  ihdr.push_back(source.colorType);
+  ihdr.push_back(0);
+  ihdr.push_back(0);
+  ihdr.push_back(source.interlace ? 1 : 0);
+  PutChunk(out, "IHDR", ihdr.data(), ihdr.size());
+  if (!source.palette.empty()) {
+    PutChunk(out, "PLTE", source.palette.data(), source.palette.size());
+  }
+  if (!source.trns.empty()) {
+    PutChunk(out, "tRNS", source.trns.data(), source.trns.size());
+  }
+  // IDATは複数のチャンクに分けてもつながったものとして読まれる
+  const auto zlib = Deflate(raw, options.compress);
+  for (std::size_t pos = 0; pos < zlib.size(); pos += options.idatSize) {
+    const auto size = std::min(options.idatSize, zlib.size() - pos);
+    PutChunk(out, "IDAT", zlib.data() + pos, size);
+  }
+  PutChunk(out, "IEND", nullptr, 0);
+  return out;
+}
+
+}  // namespace test
+}  // namespace dxapp
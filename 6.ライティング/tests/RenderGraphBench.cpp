@@ -0,0 +1,96 @@
+// RenderGraphを50パスのグラフで組み立ててコンパイルする時間を測る
+// パスごとに一時的なテクスチャを1つ書き、次のパスが読む。
+// 最後のパスはバックバッファに書く。途中に誰も読まないパスも混ぜる。
+// 使う間が重ならないので、一時的なテクスチャは2つ分のメモリで足りるはず
+//
+// 使い方: RenderGraphBench [測る時間(ミリ秒)]
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "RenderGraph.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+using dxapp::RenderGraph;
+using dxapp::RenderGraphMemory;
+using dxapp::RenderGraphTextureDesc;
+using dxapp::ResourceState;
+
+constexpr std::uint32_t PassCount = 50;
+
+RenderGraphMemory QueryMemory(const RenderGraphTextureDesc& desc,
+                              ResourceState) {
+  return {std::uint64_t(desc.width) * desc.height * 4, 64 * 1024};
+}
+
+/*!
+ * @brief グラフを組み立てる。毎フレームと同じくResetから始める
+ */
+void Build(RenderGraph& graph, const std::vector<std::string>& names) {
+  graph.Reset();
+  RenderGraphTextureDesc desc{};
+  desc.width = 1280;
+  desc.height = 720;
+  const auto backbuffer = graph.ImportTexture(
+      "backbuffer", desc, ResourceState::Present, ResourceState::Present);
+
+  auto previous = RenderGraph::InvalidHandle;
+  for (std::uint32_t i = 0; i < PassCount; ++i) {
+    const auto pass = graph.AddPass(names[i], nullptr);
+    if (previous != RenderGraph::InvalidHandle) {
+      graph.Read(pass, previous, ResourceState::ShaderResource);
+    }
+    if (i + 1 == PassCount) {
+      graph.Write(pass, backbuffer, ResourceState::RenderTarget);
+      break;
+    }
+    const auto texture = graph.CreateTexture(names[i], desc);
+    graph.Write(pass, texture,
+                i % 2 ? ResourceState::UnorderedAccess
+                      : ResourceState::RenderTarget);
+    // 5パスごとに、誰も読まないデバッグ表示のパスを足す
+    if (i % 5 == 4) {
+      const auto debugPass = graph.AddPass("debug", nullptr);
+      graph.Read(debugPass, texture, ResourceState::ShaderResource);
+      graph.Write(debugPass, graph.CreateTexture("debug", desc),
+                  ResourceState::RenderTarget);
+    }
+    previous = texture;
+  }
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  const auto durationMs = argc > 1 ? std::atoi(argv[1]) : 500;
+
+  std::vector<std::string> names{};
+  for (std::uint32_t i = 0; i < PassCount; ++i) {
+    names.push_back("pass" + std::to_string(i));
+  }
+
+  RenderGraph graph{};
+  Build(graph, names);
+  graph.Compile(QueryMemory);  // 配列の確保を済ませておく
+
+  const dxapp::test::Stopwatch stopwatch{};
+  int iterations = 0;
+  do {
+    Build(graph, names);
+    graph.Compile(QueryMemory);
+    ++iterations;
+  } while (stopwatch.milliseconds() < durationMs);
+  const auto microseconds = stopwatch.milliseconds() * 1000.0 / iterations;
+
+  const auto& stats = graph.stats();
+  std::printf("build + compile: %.2f us (%d iterations)\n", microseconds,
+              iterations);
+  std::printf("passes %u, culled %u\n", stats.passes, stats.culledPasses);
+  std::printf("barriers %u in %u batches, split %u\n", stats.barriers,
+              stats.barrierBatches, stats.splitBarriers);
+  std::printf("aliased textures %u, heap %.1f MB (separately %.1f MB)\n",
+              stats.aliasedTextures, stats.heapBytes / 1048576.0,
+              stats.transientBytes / 1048576.0);
+  return 0;
+}
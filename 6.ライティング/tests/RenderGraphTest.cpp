@@ -0,0 +1,484 @@
+// RenderGraphのコンパイル結果を、乱数で作ったグラフで確かめる
+// Runで渡されるバリアを順に当ててリソースごとの状態を追い、
+// パスを実行するときに欲しい状態になっているかを見る。あわせて
+//  - 外したパスの結果は誰も使わず、残したパスの結果は誰かが使う
+//  - 分けたバリアは前に使ったパスの直後に始まり、終わるまで誰も使わない
+//  - 同じメモリに置いたテクスチャは使う間が重ならず、
+//    後から使う方はエイリアスのバリアの後に使い始める
+//  - フレームの終わりに、持ち込んだものは終わりの状態、
+//    一時的なものは作ったときの状態に戻っている
+// を見る
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "RenderGraph.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+using dxapp::RenderGraph;
+using dxapp::RenderGraphBarrier;
+using dxapp::RenderGraphMemory;
+using dxapp::RenderGraphTextureDesc;
+using dxapp::ResourceState;
+
+constexpr std::uint64_t Alignment = 64 * 1024;
+
+//! 1ピクセル4バイトで、D3D12と同じく64KB単位に置く
+RenderGraphMemory QueryMemory(const RenderGraphTextureDesc& desc,
+                              ResourceState) {
+  return {std::uint64_t(desc.width) * desc.height * 4, Alignment};
+}
+
+bool Contains(ResourceState state, ResourceState bits) {
+  return (state & bits) == bits;
+}
+
+/*!
+ * @brief グラフを作った側で覚えておく内容と、実行中の状態
+ */
+class Simulation {
+ public:
+  explicit Simulation(RenderGraph& graph) : graph_(graph) {}
+
+  /*!
+   * @brief 乱数でリソースとパスを足す
+   */
+  void Build(std::uint32_t& seed) {
+    auto next = [&seed](std::uint32_t range) {
+      seed = seed * 1664525u + 1013904223u;
+      return (seed >> 8) % range;
+    };
+    const ResourceState readStates[] = {ResourceState::ShaderResource,
+                                        ResourceState::CopySource,
+                                        ResourceState::DepthRead};
+    const ResourceState writeStates[] = {
+        ResourceState::RenderTarget, ResourceState::DepthWrite,
+        ResourceState::UnorderedAccess, ResourceState::CopyDest};
+    const ResourceState importStates[] = {
+        ResourceState::Common, ResourceState::Present,
+        ResourceState::ShaderResource, ResourceState::RenderTarget};
+
+    graph_.Reset();
+    resources_.clear();
+    accesses_.clear();
+    sideEffects_.clear();
+
+    const auto resourceCount = 2 + next(12);
+    for (std::uint32_t i = 0; i < resourceCount; ++i) {
+      RenderGraphTextureDesc desc{};
+      desc.width = 64u << next(4);
+      desc.height = 64u << next(4);
+      Resource resource{};
+      if (next(4) == 0) {
+        resource.imported = true;
+        resource.initialState = importStates[next(4)];
+        resource.finalState = importStates[next(4)];
+        graph_.ImportTexture("import" + std::to_string(i), desc,
+                             resource.initialState, resource.finalState);
+      } else {
+        graph_.CreateTexture("transient" + std::to_string(i), desc);
+      }
+      resources_.push_back(resource);
+    }
+
+    const auto passCount = 1 + next(20);
+    for (std::uint32_t pass = 0; pass < passCount; ++pass) {
+      graph_.AddPass("pass" + std::to_string(pass),
+                     [this, pass]() { Execute(pass); });
+      const bool sideEffect = next(8) == 0;
+      if (sideEffect) {
+        graph_.SetSideEffect(pass);
+      }
+      sideEffects_.push_back(sideEffect);
+      // 1つのパスで同じリソースは1回だけ使う
+      std::vector<std::uint32_t> used{};
+      const auto accessCount = 1 + next(4);
+      for (std::uint32_t a = 0; a < accessCount; ++a) {
+        const auto resource = next(resourceCount);
+        if (std::find(used.begin(), used.end(), resource) != used.end()) {
+          continue;
+        }
+        used.push_back(resource);
+        if (next(2) == 0) {
+          auto state = readStates[next(3)];
+          if (next(3) == 0) {
+            state = state | readStates[next(3)];
+          }
+          graph_.Read(pass, resource, state);
+          accesses_.push_back({pass, resource, state, false});
+        } else {
+          const auto state = writeStates[next(4)];
+          graph_.Write(pass, resource, state);
+          accesses_.push_back({pass, resource, state, true});
+        }
+      }
+    }
+  }
+
+  /*!
+   * @brief コンパイルして実行し、おかしかった数を返す
+   */
+  int CompileAndRun() {
+    errors_ = 0;
+    splitBegins_ = 0;
+    graph_.Compile(QueryMemory);
+    CheckCulling();
+    CheckPlacement();
+
+    for (std::uint32_t r = 0; r < resources_.size(); ++r) {
+      auto& resource = resources_[r];
+      // 一時的なテクスチャは最初に使う状態で作ってある
+      resource.state = resource.imported ? resource.initialState
+                                         : graph_.firstState(r);
+      resource.splitPending = false;
+      resource.uavPending = false;
+      resource.aliasActivated = false;
+      resource.firstUse = RenderGraph::InvalidHandle;
+      resource.lastUse = RenderGraph::InvalidHandle;
+    }
+    order_ = 0;
+    lastPass_ = RenderGraph::InvalidHandle;
+    graph_.Run([this](const RenderGraphBarrier* barriers,
+                      std::uint32_t count) {
+      for (std::uint32_t i = 0; i < count; ++i) {
+        Apply(barriers[i]);
+      }
+    });
+    const auto* finalBarriers = graph_.finalBarriers();
+    for (std::uint32_t i = 0; i < graph_.finalBarrierCount(); ++i) {
+      Apply(finalBarriers[i]);
+    }
+
+    CheckFinalStates();
+    CheckAliasing();
+    if (splitBegins_ != graph_.stats().splitBarriers) {
+      Error("split barrier count", 0);
+    }
+    return errors_;
+  }
+
+ private:
+  //! リソースの設定と、実行中の状態
+  struct Resource {
+    bool imported{false};
+    ResourceState initialState{ResourceState::Common};
+    ResourceState finalState{ResourceState::Common};
+
+    ResourceState state{ResourceState::Common};
+    bool splitPending{false};  //!< 分けたバリアを始めて、まだ終えていない
+    ResourceState splitBefore{ResourceState::Common};
+    ResourceState splitAfter{ResourceState::Common};
+    bool uavPending{false};      //!< UAVに書いた後、まだUAVバリアがない
+    bool aliasActivated{false};  //!< エイリアスのバリアで使い始めた
+    std::uint32_t firstUse{RenderGraph::InvalidHandle};  //!< 実行順
+    std::uint32_t lastUse{RenderGraph::InvalidHandle};
+  };
+
+  struct Access {
+    std::uint32_t pass;
+    std::uint32_t resource;
+    ResourceState state;
+    bool write;
+  };
+
+  void Error(const char* what, std::uint32_t index) {
+    if (errors_ < 4) {
+      std::printf("  %s: %u, order %u\n", what, index, order_);
+    }
+    ++errors_;
+  }
+
+  /*!
+   * @brief 残したパスは副作用があるか、持ち込んだリソースか後で実行する
+   *        パスが使うリソースに書く。外したパスはそのどれでもない
+   */
+  void CheckCulling() {
+    std::uint32_t culled = 0;
+    for (std::uint32_t pass = 0; pass < graph_.passCount(); ++pass) {
+      bool needed = sideEffects_[pass];
+      for (const auto& write : accesses_) {
+        if (write.pass != pass || !write.write) {
+          continue;
+        }
+        needed = needed || resources_[write.resource].imported;
+        for (const auto& later : accesses_) {
+          needed = needed || (later.pass > pass &&
+                              later.resource == write.resource &&
+                              graph_.IsPassAlive(later.pass));
+        }
+      }
+      if (needed != graph_.IsPassAlive(pass)) {
+        Error(needed ? "needed pass culled" : "unneeded pass kept", pass);
+      }
+      culled += graph_.IsPassAlive(pass) ? 0 : 1;
+    }
+    if (graph_.stats().culledPasses != culled) {
+      Error("culled pass count", 0);
+    }
+  }
+
+  /*!
+   * @brief 一時的なテクスチャはヒープに収まり、そろった位置に置く
+   */
+  void CheckPlacement() {
+    for (std::uint32_t r = 0; r < resources_.size(); ++r) {
+      const auto offset = graph_.heapOffset(r);
+      if (resources_[r].imported || offset == RenderGraph::InvalidOffset) {
+        continue;
+      }
+      const auto size = QueryMemory(graph_.desc(r), graph_.usage(r)).size;
+      if (offset % Alignment != 0 || offset + size > graph_.heapSize()) {
+        Error("placed outside the heap", r);
+      }
+    }
+    if (graph_.stats().heapBytes > graph_.stats().transientBytes) {
+      Error("heap larger than placing separately", 0);
+    }
+  }
+
+  /*!
+   * @brief バリアを1つ当てる。order_番目のパスの前のバッチとして呼ばれる
+   */
+  void Apply(const RenderGraphBarrier& barrier) {
+    using Type = RenderGraphBarrier::Type;
+    using Split = RenderGraphBarrier::Split;
+    auto& resource = resources_[barrier.resource];
+    if (barrier.type == Type::Uav) {
+      resource.uavPending = false;
+      return;
+    }
+    if (barrier.type == Type::Aliasing) {
+      // 前のリソースは使い終わっていて、こちらはまだ使っていない
+      const auto& before = resources_[barrier.aliasBefore];
+      if (before.lastUse == RenderGraph::InvalidHandle ||
+          before.lastUse >= order_) {
+        Error("aliased while the previous texture is alive",
+              barrier.resource);
+      }
+      if (resource.firstUse != RenderGraph::InvalidHandle) {
+        Error("aliasing barrier after first use", barrier.resource);
+      }
+      resource.aliasActivated = true;
+      return;
+    }
+
+    if (barrier.split == Split::End) {
+      if (!resource.splitPending || resource.splitBefore != barrier.before ||
+          resource.splitAfter != barrier.after) {
+        Error("split end does not match its begin", barrier.resource);
+      }
+      resource.splitPending = false;
+      resource.state = barrier.after;
+      resource.uavPending = false;
+      return;
+    }
+    if (resource.splitPending) {
+      Error("transition during a split barrier", barrier.resource);
+    }
+    if (resource.state != barrier.before) {
+      Error("transition from a wrong state", barrier.resource);
+    }
+    if (barrier.split == Split::Begin) {
+      // 前に使ったパスの直後、使っていなければ最初から始める
+      const auto expected = resource.lastUse == RenderGraph::InvalidHandle
+                                ? 0
+                                : resource.lastUse + 1;
+      if (order_ != expected) {
+        Error("split begin not right after the last use", barrier.resource);
+      }
+      resource.splitPending = true;
+      resource.splitBefore = barrier.before;
+      resource.splitAfter = barrier.after;
+      ++splitBegins_;
+      return;
+    }
+    resource.state = barrier.after;
+    resource.uavPending = false;
+  }
+
+  /*!
+   * @brief パスの中身。使うリソースが欲しい状態になっているかを見る
+   */
+  void Execute(std::uint32_t pass) {
+    if (!graph_.IsPassAlive(pass)) {
+      Error("culled pass executed", pass);
+    }
+    if (lastPass_ != RenderGraph::InvalidHandle && lastPass_ >= pass) {
+      Error("passes out of order", pass);
+    }
+    lastPass_ = pass;
+
+    for (const auto& access : accesses_) {
+      if (access.pass != pass) {
+        continue;
+      }
+      auto& resource = resources_[access.resource];
+      if (resource.splitPending) {
+        Error("used during a split barrier", access.resource);
+      }
+      const bool stateOk =
+          access.write ? resource.state == access.state
+                       : Contains(resource.state, access.state) &&
+                             dxapp::IsReadOnlyState(resource.state);
+      if (!stateOk) {
+        Error("wrong state", access.resource);
+      }
+      if (resource.uavPending &&
+          Contains(access.state, ResourceState::UnorderedAccess)) {
+        Error("missing UAV barrier", access.resource);
+      }
+      if (resource.firstUse == RenderGraph::InvalidHandle) {
+        resource.firstUse = order_;
+      }
+      resource.lastUse = order_;
+      if (access.write && access.state == ResourceState::UnorderedAccess) {
+        resource.uavPending = true;
+      }
+    }
+    ++order_;
+  }
+
+  /*!
+   * @brief 持ち込んだものは終わりの状態、一時的なものは作ったときの状態
+   */
+  void CheckFinalStates() {
+    for (std::uint32_t r = 0; r < resources_.size(); ++r) {
+      const auto& resource = resources_[r];
+      if (resource.splitPending) {
+        Error("split barrier not ended", r);
+      }
+      const auto expected =
+          resource.imported ? resource.finalState : graph_.firstState(r);
+      if (resource.state != expected) {
+        Error("wrong state at the end of the frame", r);
+      }
+    }
+  }
+
+  /*!
+   * @brief 同じメモリに置いたテクスチャは使う間が重ならず、
+   *        後から使う方はエイリアスのバリアで使い始める
+   */
+  void CheckAliasing() {
+    for (std::uint32_t a = 0; a < resources_.size(); ++a) {
+      for (std::uint32_t b = 0; b < resources_.size(); ++b) {
+        const auto offsetA = graph_.heapOffset(a);
+        const auto offsetB = graph_.heapOffset(b);
+        if (a == b || resources_[a].imported || resources_[b].imported ||
+            offsetA == RenderGraph::InvalidOffset ||
+            offsetB == RenderGraph::InvalidOffset) {
+          continue;
+        }
+        const auto endA =
+            offsetA + QueryMemory(graph_.desc(a), graph_.usage(a)).size;
+        const auto endB =
+            offsetB + QueryMemory(graph_.desc(b), graph_.usage(b)).size;
+        if (offsetA >= endB || offsetB >= endA) {
+          continue;
+        }
+        const auto& first = resources_[a];
+        const auto& second = resources_[b];
+        if (first.lastUse >= second.firstUse &&
+            second.lastUse >= first.firstUse) {
+          Error("aliased textures alive at the same time", a);
+        }
+        if (first.lastUse < second.firstUse && !second.aliasActivated) {
+          Error("missing aliasing barrier", b);
+        }
+      }
+    }
+  }
+
+  RenderGraph& graph_;
+  std::vector<Resource> resources_{};
+  std::vector<Access> accesses_{};
+  std::vector<bool> sideEffects_{};
+  std::uint32_t order_{0};  //!< 次に実行するパスの実行順
+  std::uint32_t lastPass_{RenderGraph::InvalidHandle};
+  std::uint32_t splitBegins_{0};
+  int errors_{0};
+};
+
+/*!
+ * @brief 手で作った小さなグラフで、外すパス、分けたバリア、使いまわしを見る
+ * @details gbufferはlightingの後は使わないので、postと同じメモリに置ける。
+ *          誰も読まないdebugのパスは外す。backbufferは最初のパスで使わず、
+ *          lightingで書いた後も最後まで使わないので、RenderTargetにする
+ *          バリアもPresentへ戻すバリアも分ける
+ */
+void TestSmallGraph() {
+  RenderGraph graph{};
+  RenderGraphTextureDesc desc{};
+  desc.width = 256;
+  desc.height = 256;
+  const auto backbuffer = graph.ImportTexture(
+      "backbuffer", desc, ResourceState::Present, ResourceState::Present);
+  const auto gbuffer = graph.CreateTexture("gbuffer", desc);
+  const auto debug = graph.CreateTexture("debug", desc);
+  const auto post = graph.CreateTexture("post", desc);
+
+  const auto geometry = graph.AddPass("geometry", nullptr);
+  graph.Write(geometry, gbuffer, ResourceState::RenderTarget);
+  const auto debugPass = graph.AddPass("debug", nullptr);
+  graph.Read(debugPass, gbuffer, ResourceState::ShaderResource);
+  graph.Write(debugPass, debug, ResourceState::RenderTarget);
+  const auto lighting = graph.AddPass("lighting", nullptr);
+  graph.Read(lighting, gbuffer, ResourceState::ShaderResource);
+  graph.Write(lighting, backbuffer, ResourceState::RenderTarget);
+  const auto postPass = graph.AddPass("post", nullptr);
+  graph.Write(postPass, post, ResourceState::UnorderedAccess);
+  graph.SetSideEffect(postPass);
+  graph.Compile(QueryMemory);
+
+  TEST_CHECK(graph.IsPassAlive(geometry));
+  TEST_CHECK(!graph.IsPassAlive(debugPass));
+  TEST_CHECK(graph.IsPassAlive(lighting));
+  TEST_CHECK(graph.IsPassAlive(postPass));
+  TEST_CHECK_EQUAL(graph.stats().culledPasses, 1u);
+  TEST_CHECK(graph.heapOffset(debug) == RenderGraph::InvalidOffset);
+  TEST_CHECK_EQUAL(graph.heapOffset(post), graph.heapOffset(gbuffer));
+  TEST_CHECK_EQUAL(graph.stats().aliasedTextures, 1u);
+  TEST_CHECK_EQUAL(graph.heapSize(), 256u * 256 * 4);
+  TEST_CHECK_EQUAL(graph.stats().splitBarriers, 2u);
+  TEST_CHECK_EQUAL(graph.finalBarrierCount(), 1u);
+  TEST_CHECK(graph.finalBarriers()[0].split ==
+             RenderGraphBarrier::Split::End);
+}
+
+/*!
+ * @brief 乱数で作ったグラフを実行して確かめる
+ * @details 外したパス、分けたバリア、使いまわしがどれも起きていることも見る
+ */
+void TestRandomGraphs() {
+  RenderGraph graph{};
+  Simulation simulation(graph);
+  std::uint32_t seed = 49;
+  int errors = 0;
+  std::uint64_t culled = 0;
+  std::uint64_t splits = 0;
+  std::uint64_t aliased = 0;
+  for (int i = 0; i < 2000; ++i) {
+    simulation.Build(seed);
+    const auto graphErrors = simulation.CompileAndRun();
+    if (graphErrors > 0) {
+      std::printf("graph %d: %d errors\n", i, graphErrors);
+    }
+    errors += graphErrors;
+    culled += graph.stats().culledPasses;
+    splits += graph.stats().splitBarriers;
+    aliased += graph.stats().aliasedTextures;
+  }
+  TEST_CHECK_EQUAL(errors, 0);
+  TEST_CHECK(culled > 0);
+  TEST_CHECK(splits > 0);
+  TEST_CHECK(aliased > 0);
+}
+}  // namespace
+
+int main() {
+  TestSmallGraph();
+  TestRandomGraphs();
+  return dxapp::test::Finish("RenderGraphTest");
+}
@@ -0,0 +1,472 @@
+// RootStateCacheを、LightingShader::Contextと同じ順で呼んで確かめる
+// コマンドリストの代わりに積まれたコマンドを記録するモックを使い、
+// D3D12と同じく、ルートシグネチャを変えたら全部の引数、ヒープを変えたら
+// デスクリプタテーブルが使えなくなるものとして、描画のたびに
+// 「シェーダから見える値」が欲しい値と一致しているかを見る。
+// 省いたせいで古い値のまま描画していればここで見つかる
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "RootStateCache.hpp"
+#include "TestCommon.hpp"
+
+namespace {
+using dxapp::RootStateCache;
+
+constexpr std::uint32_t NoRootParam = 0xffffffff;
+constexpr std::uint32_t SlotCount = RootStateCache::MaxRootParameters;
+
+/*!
+ * @brief 積まれたコマンドを記録するコマンドリスト
+ * @details D3D12と同じく、ルートシグネチャを積むと全部の引数、
+ *          ヒープを積むとテーブルを使えない状態にする
+ */
+class RecordingCommandList {
+ public:
+  //! コマンドの種類
+  enum class Kind {
+    RootSignature,
+    PipelineState,
+    DescriptorHeaps,
+    RootCbv,
+    RootSrv,
+    RootConstant,
+    DescriptorTable,
+  };
+
+  //! スロットに積まれた値
+  struct Bound {
+    Kind kind{Kind::RootSignature};  //!< RootSignatureなら何も積まれていない
+    std::uint64_t value{0};
+  };
+
+  void SetGraphicsRootSignature(const void* rootSignature) {
+    Record(Kind::RootSignature);
+    rootSignature_ = rootSignature;
+    slots_.fill({});
+  }
+  void SetPipelineState(const void* pipelineState) {
+    Record(Kind::PipelineState);
+    pipelineState_ = pipelineState;
+  }
+  void SetDescriptorHeaps(std::uint32_t count, const void* const* heaps) {
+    Record(Kind::DescriptorHeaps);
+    cbvSrvUavHeap_ = heaps[0];
+    samplerHeap_ = count > 1 ? heaps[1] : nullptr;
+    for (auto& slot : slots_) {
+      if (slot.kind == Kind::DescriptorTable) {
+        slot = {};
+      }
+    }
+  }
+  void SetGraphicsRootConstantBufferView(std::uint32_t index,
+                                         std::uint64_t address) {
+    Bind(Kind::RootCbv, index, address);
+  }
+  void SetGraphicsRootShaderResourceView(std::uint32_t index,
+                                         std::uint64_t address) {
+    Bind(Kind::RootSrv, index, address);
+  }
+  void SetGraphicsRoot32BitConstant(std::uint32_t index, std::uint32_t value,
+                                    std::uint32_t offset) {
+    Bind(Kind::RootConstant, index,
+         (static_cast<std::uint64_t>(offset) << 32) | value);
+  }
+  void SetGraphicsRootDescriptorTable(std::uint32_t index,
+                                      std::uint64_t handle) {
+    Bind(Kind::DescriptorTable, index, handle);
+  }
+
+  std::size_t commandCount() const { return commands_.size(); }
+  std::size_t count(Kind kind) const {
+    std::size_t n = 0;
+    for (const auto command : commands_) {
+      n += command == kind ? 1 : 0;
+    }
+    return n;
+  }
+  const Bound& slot(std::uint32_t index) const { return slots_[index]; }
+  const void* rootSignature() const { return rootSignature_; }
+  const void* pipelineState() const { return pipelineState_; }
+  const void* cbvSrvUavHeap() const { return cbvSrvUavHeap_; }
+  const void* samplerHeap() const { return samplerHeap_; }
+
+ private:
+  void Record(Kind kind) { commands_.push_back(kind); }
+  void Bind(Kind kind, std::uint32_t index, std::uint64_t value) {
+    Record(kind);
+    slots_[index] = {kind, value};
+  }
+
+  std::vector<Kind> commands_{};
+  std::array<Bound, SlotCount> slots_{};
+  const void* rootSignature_{nullptr};
+  const void* pipelineState_{nullptr};
+  const void* cbvSrvUavHeap_{nullptr};
+  const void* samplerHeap_{nullptr};
+};
+using Kind = RecordingCommandList::Kind;
+
+/*!
+ * @brief ルートパラメータの位置。LightingShader::Impl::RootIndexと同じ
+ */
+struct RootIndex {
+  std::uint32_t objectParam{NoRootParam};
+  std::uint32_t objectIndex{NoRootParam};
+  std::uint32_t objectBuffer{NoRootParam};
+  std::uint32_t sceneParam{NoRootParam};
+  std::uint32_t materialParam{NoRootParam};
+  std::uint32_t materialIndex{NoRootParam};
+  std::uint32_t materialBuffer{NoRootParam};
+  std::uint32_t textureTable{NoRootParam};
+  std::uint32_t samplerTable{NoRootParam};
+};
+
+/*!
+ * @brief シェーダの設定。LightingShader::Impl::CreatRootSignatureと同じ並びにする
+ */
+struct Shader {
+  Shader(bool bindless, bool objectBuffer, bool staticSampler)
+      : isBindless(bindless), hasStaticSampler(staticSampler) {
+    std::uint32_t count = 0;
+    if (objectBuffer) {
+      rootIndex.objectIndex = count++;
+      rootIndex.objectBuffer = count++;
+    } else {
+      rootIndex.objectParam = count++;
+    }
+    rootIndex.sceneParam = count++;
+    if (bindless) {
+      rootIndex.materialIndex = count++;
+      rootIndex.materialBuffer = count++;
+    } else {
+      rootIndex.materialParam = count++;
+    }
+    rootIndex.textureTable = count++;
+    if (!staticSampler) {
+      rootIndex.samplerTable = count++;
+    }
+  }
+
+  RootIndex rootIndex{};
+  bool isBindless;
+  bool hasStaticSampler;
+  int rootSignature{0};  //!< アドレスをルートシグネチャの代わりに使う
+  int pipelineState{0};
+};
+
+/*!
+ * @brief LightingShader::Context::Implと同じ順でキャッシュを通して積む
+ */
+class Context {
+ public:
+  explicit Context(const Shader* shader) : shader_(shader) {}
+
+  //! LightingShader::Context::Beginと同じ
+  void Begin(RecordingCommandList* commandList) {
+    commandList_ = commandList;
+    stateCache_.Reset();
+    stateCache_.ResetStats();
+    BindShader(shader_);
+  }
+
+  /*!
+   * @brief 同じコマンドリストのまま別のシェーダにする
+   * @details キャッシュは忘れずに、ルートシグネチャの変化で引数を忘れる
+   */
+  void BindShader(const Shader* shader) {
+    shader_ = shader;
+    if (stateCache_.SetRootSignature(&shader->rootSignature)) {
+      commandList_->SetGraphicsRootSignature(&shader->rootSignature);
+    }
+    if (stateCache_.SetPipelineState(&shader->pipelineState)) {
+      commandList_->SetPipelineState(&shader->pipelineState);
+    }
+  }
+
+  //! LightingShader::Context::Impl::Applyと同じ
+  void Apply() {
+    const auto& rootIndex = shader_->rootIndex;
+    const auto isBindless = shader_->isBindless;
+    const auto hasStaticSampler = shader_->hasStaticSampler;
+    auto srvHeap = isBindless ? textureHeap : srvHeap_;
+    auto samplerHeap = hasStaticSampler ? nullptr : samplerHeap_;
+    if (stateCache_.SetDescriptorHeaps(srvHeap, samplerHeap)) {
+      const void* heaps[] = {srvHeap, samplerHeap};
+      commandList_->SetDescriptorHeaps(hasStaticSampler ? 1 : 2, heaps);
+    }
+
+    ApplyRootCbv(rootIndex.sceneParam, sceneParam);
+    ApplyRootSrv(rootIndex.materialBuffer, materialBuffer);
+    ApplyRootSrv(rootIndex.objectBuffer, objectBuffer);
+    ApplyDescriptorTable(rootIndex.textureTable,
+                         isBindless ? textureTable : srv);
+    ApplyDescriptorTable(rootIndex.samplerTable, sampler);
+
+    ApplyRootCbv(rootIndex.objectParam, objParam);
+    ApplyRootConstant(rootIndex.objectIndex, objectIndex);
+    ApplyRootCbv(rootIndex.materialParam, matParam);
+    ApplyRootConstant(rootIndex.materialIndex, materialIndex);
+  }
+
+  /*!
+   * @brief 描画するときに、シェーダから見える値が欲しい値と同じか
+   * @return 違っていた引数の数
+   */
+  int CheckBound() const {
+    const auto& list = *commandList_;
+    const auto& rootIndex = shader_->rootIndex;
+    int errors = 0;
+    errors += list.rootSignature() != &shader_->rootSignature;
+    errors += list.pipelineState() != &shader_->pipelineState;
+    errors += list.cbvSrvUavHeap() !=
+              (shader_->isBindless ? textureHeap : srvHeap_);
+    if (!shader_->hasStaticSampler) {
+      errors += list.samplerHeap() != samplerHeap_;
+    }
+    auto expect = [&](std::uint32_t index, Kind kind, std::uint64_t value) {
+      if (index == NoRootParam) {
+        return;
+      }
+      const auto& bound = list.slot(index);
+      errors += bound.kind != kind || bound.value != value;
+    };
+    expect(rootIndex.sceneParam, Kind::RootCbv, sceneParam);
+    expect(rootIndex.materialBuffer, Kind::RootSrv, materialBuffer);
+    expect(rootIndex.objectBuffer, Kind::RootSrv, objectBuffer);
+    expect(rootIndex.textureTable, Kind::DescriptorTable,
+           shader_->isBindless ? textureTable : srv);
+    expect(rootIndex.samplerTable, Kind::DescriptorTable, sampler);
+    expect(rootIndex.objectParam, Kind::RootCbv, objParam);
+    expect(rootIndex.objectIndex, Kind::RootConstant, objectIndex);
+    expect(rootIndex.materialParam, Kind::RootCbv, matParam);
+    expect(rootIndex.materialIndex, Kind::RootConstant, materialIndex);
+    return errors;
+  }
+
+  const dxapp::RootStateStats& stats() const { return stateCache_.stats(); }
+
+  // 描画ごとに変えてよい値
+  const void* srvHeap_{nullptr};
+  const void* samplerHeap_{nullptr};
+  const void* textureHeap{nullptr};
+  std::uint64_t srv{0}, sampler{0}, textureTable{0};
+  std::uint64_t objParam{0}, sceneParam{0}, matParam{0};
+  std::uint64_t materialBuffer{0}, objectBuffer{0};
+  std::uint32_t materialIndex{0}, objectIndex{0};
+
+ private:
+  void ApplyRootCbv(std::uint32_t index, std::uint64_t address) {
+    if (index != NoRootParam && stateCache_.SetRootView(index, address)) {
+      commandList_->SetGraphicsRootConstantBufferView(index, address);
+    }
+  }
+  void ApplyRootSrv(std::uint32_t index, std::uint64_t address) {
+    if (index != NoRootParam && stateCache_.SetRootView(index, address)) {
+      commandList_->SetGraphicsRootShaderResourceView(index, address);
+    }
+  }
+  void ApplyRootConstant(std::uint32_t index, std::uint32_t value) {
+    if (index != NoRootParam && stateCache_.SetRootConstant(index, value)) {
+      commandList_->SetGraphicsRoot32BitConstant(index, value, 0);
+    }
+  }
+  void ApplyDescriptorTable(std::uint32_t index, std::uint64_t handle) {
+    if (index != NoRootParam &&
+        stateCache_.SetDescriptorTable(index, handle)) {
+      commandList_->SetGraphicsRootDescriptorTable(index, handle);
+    }
+  }
+
+  const Shader* shader_;
+  RecordingCommandList* commandList_{nullptr};
+  RootStateCache stateCache_{};
+};
+
+int heapA = 0, heapB = 0, samplerHeapA = 0;
+
+//! 普通の描画の値を入れる
+void SetupNonBindless(Context& context) {
+  context.srvHeap_ = &heapA;
+  context.samplerHeap_ = &samplerHeapA;
+  context.srv = 0x1000;
+  context.sampler = 0x2000;
+  context.sceneParam = 0x10000;
+}
+
+/*!
+ * @brief 値が変わらなければ2回目からは積まない。数も合う
+ */
+void TestSkipsRepeatedState() {
+  Shader shader(false, false, false);
+  Context context(&shader);
+  RecordingCommandList list{};
+  context.Begin(&list);
+  SetupNonBindless(context);
+
+  for (int i = 0; i < 10; ++i) {
+    context.objParam = 0x20000 + (i / 2) * 256;  // 2回に1回変わる
+    context.matParam = 0x30000;
+    context.Apply();
+    TEST_CHECK_EQUAL(context.CheckBound(), 0);
+  }
+
+  // ルートシグネチャとPSO、ヒープ、scene・テーブル2つ・matParamは1回ずつ、
+  // objParamは5回だけ積む
+  TEST_CHECK_EQUAL(list.count(Kind::RootSignature), 1u);
+  TEST_CHECK_EQUAL(list.count(Kind::PipelineState), 1u);
+  TEST_CHECK_EQUAL(list.count(Kind::DescriptorHeaps), 1u);
+  TEST_CHECK_EQUAL(list.count(Kind::DescriptorTable), 2u);
+  TEST_CHECK_EQUAL(list.count(Kind::RootCbv), 2u + 5u);
+
+  // 積んだ数はコマンドの数と同じ。呼んだ数は積んだ数と省いた数の和
+  const auto& stats = context.stats();
+  TEST_CHECK_EQUAL(stats.issued, list.commandCount());
+  // Beginで2回、Applyごとにヒープと引数5つで6回
+  TEST_CHECK_EQUAL(stats.issued + stats.skipped, 2u + 10u * 6u);
+  TEST_CHECK_EQUAL(stats.skipped, 62u - list.commandCount());
+
+  // Beginは全部忘れて数えなおす
+  RecordingCommandList next{};
+  context.Begin(&next);
+  context.Apply();
+  TEST_CHECK_EQUAL(context.CheckBound(), 0);
+  TEST_CHECK_EQUAL(context.stats().skipped, 0u);
+  TEST_CHECK_EQUAL(context.stats().issued, next.commandCount());
+}
+
+/*!
+ * @brief ヒープを変えたら、同じハンドルでもテーブルを積みなおす
+ * @details ルートCBVやルート定数はヒープに関係ないので積まない
+ */
+void TestHeapChangeInvalidatesTables() {
+  Shader shader(false, false, false);
+  Context context(&shader);
+  RecordingCommandList list{};
+  context.Begin(&list);
+  SetupNonBindless(context);
+  context.Apply();
+  const auto tables = list.count(Kind::DescriptorTable);
+  const auto views = list.count(Kind::RootCbv);
+  TEST_CHECK_EQUAL(tables, 2u);
+
+  context.srvHeap_ = &heapB;  // テーブルのハンドルは同じまま
+  context.Apply();
+  TEST_CHECK_EQUAL(context.CheckBound(), 0);
+  TEST_CHECK_EQUAL(list.count(Kind::DescriptorHeaps), 2u);
+  TEST_CHECK_EQUAL(list.count(Kind::DescriptorTable), tables + 2u);
+  TEST_CHECK_EQUAL(list.count(Kind::RootCbv), views);
+
+  // 同じヒープのままなら積まない
+  context.Apply();
+  TEST_CHECK_EQUAL(list.count(Kind::DescriptorHeaps), 2u);
+  TEST_CHECK_EQUAL(list.count(Kind::DescriptorTable), tables + 2u);
+
+  // 静的サンプラのシェーダはヒープが1つで、nullptrのサンプラヒープも覚える
+  Shader staticShader(true, true, true);
+  Context bindless(&staticShader);
+  RecordingCommandList list2{};
+  bindless.Begin(&list2);
+  bindless.textureHeap = &heapA;
+  bindless.textureTable = 0x4000;
+  bindless.Apply();
+  bindless.Apply();
+  TEST_CHECK_EQUAL(bindless.CheckBound(), 0);
+  TEST_CHECK_EQUAL(list2.count(Kind::DescriptorHeaps), 1u);
+  TEST_CHECK_EQUAL(list2.count(Kind::DescriptorTable), 1u);
+}
+
+/*!
+ * @brief ルートシグネチャを変えたら、同じ値でも全部の引数を積みなおす
+ */
+void TestRootSignatureChangeInvalidatesAll() {
+  Shader shaderA(false, false, false);
+  Shader shaderB(false, false, false);  // 並びは同じでもルートシグネチャは別
+  Context context(&shaderA);
+  RecordingCommandList list{};
+  context.Begin(&list);
+  SetupNonBindless(context);
+  context.objParam = 0x20000;
+  context.matParam = 0x30000;
+  context.Apply();
+  const auto first = list.commandCount();
+
+  context.BindShader(&shaderB);
+  TEST_CHECK_EQUAL(list.commandCount(), first + 2u);
+  context.Apply();
+  TEST_CHECK_EQUAL(context.CheckBound(), 0);
+  // ヒープは残るので積まない。引数5つは全部積みなおす
+  TEST_CHECK_EQUAL(list.count(Kind::DescriptorHeaps), 1u);
+  TEST_CHECK_EQUAL(list.commandCount(), first + 2u + 5u);
+
+  // 同じシェーダをもう一度選んでも何も積まない
+  const auto before = list.commandCount();
+  context.BindShader(&shaderB);
+  context.Apply();
+  TEST_CHECK_EQUAL(list.commandCount(), before);
+  TEST_CHECK_EQUAL(context.stats().issued, list.commandCount());
+}
+
+/*!
+ * @brief 乱数で値・ヒープ・シェーダを変えながら描画し、毎回正しい値が見えている
+ */
+void TestRandomDraws() {
+  const Shader shaders[] = {
+      Shader(false, false, false), Shader(true, true, false),
+      Shader(true, true, true), Shader(false, true, false)};
+  int errors = 0;
+  std::uint32_t seed = 77;
+  auto next = [&seed](std::uint32_t range) {
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) % range;
+  };
+
+  for (int frame = 0; frame < 50; ++frame) {
+    Context context(&shaders[next(4)]);
+    RecordingCommandList list{};
+    context.Begin(&list);
+    for (int draw = 0; draw < 200; ++draw) {
+      switch (next(16)) {
+        case 0:
+          context.BindShader(&shaders[next(4)]);
+          break;
+        case 1:
+          context.srvHeap_ = next(2) ? &heapA : &heapB;
+          context.textureHeap = next(2) ? &heapA : &heapB;
+          break;
+        case 2:
+          context.samplerHeap_ = next(2) ? &samplerHeapA : nullptr;
+          break;
+        default:
+          break;
+      }
+      // 値は少ない種類から選んで、同じ値が続くようにする
+      context.srv = 0x1000 + next(3) * 32;
+      context.sampler = 0x2000 + next(2) * 32;
+      context.textureTable = 0x4000;
+      context.sceneParam = 0x10000 + next(2) * 256;
+      context.objParam = 0x20000 + next(4) * 256;
+      context.matParam = 0x30000 + next(3) * 256;
+      context.materialBuffer = 0x40000;
+      context.objectBuffer = 0x50000;
+      context.objectIndex = next(4);
+      context.materialIndex = next(3);
+      context.Apply();
+      errors += context.CheckBound();
+    }
+    const auto& stats = context.stats();
+    errors += stats.issued != list.commandCount();
+    errors += stats.skipped == 0;
+  }
+  TEST_CHECK_EQUAL(errors, 0);
+}
+}  // namespace
+
+int main() {
+  TestSkipsRepeatedState();
+  TestHeapChangeInvalidatesTables();
+  TestRootSignatureChangeInvalidatesAll();
+  TestRandomDraws();
+  return dxapp::test::Finish("RootStateCacheTest");
+}
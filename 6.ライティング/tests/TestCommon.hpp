@@ -0,0 +1,67 @@
+﻿#pragma once
+// テストとベンチマークで使う小さな道具
+// 失敗してもそこで止めずに数えて、最後にまとめて終了コードにする
+#include <chrono>
+#include <cstdio>
+
+namespace dxapp {
+namespace test {
+
+//! 失敗したチェックの数
+inline int failureCount = 0;
+
+/*!
+ * @brief テストの終わり。失敗がなければ0を返す
+ */
+inline int Finish(const char* name) {
+  if (failureCount == 0) {
+    std::printf("%s: OK\n", name);
+    return 0;
+  }
+  std::printf("%s: %d FAILED\n", name, failureCount);
+  return 1;
+}
+
+/*!
+ * @brief 経過時間をミリ秒で測る
+ */
+class Stopwatch {
+ public:
+  Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+
+  double milliseconds() const {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start_)
+        .count();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace test
+}  // namespace dxapp
+
+//! 条件が成り立たなければ場所を表示して失敗を数える
+#define TEST_CHECK(condition)                                          \
+  do {                                                                 \
+    if (!(condition)) {                                                \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,     \
+                  #condition);                                         \
+      ++dxapp::test::failureCount;                                     \
+    }                                                                  \
+  } while (false)
+
+//! 2つの値が等しくなければ値も表示して失敗を数える
+#define TEST_CHECK_EQUAL(actual, expected)                                   \
+  do {                                                                       \
+    const auto actualValue = (actual);                                       \
+    const auto expectedValue = (expected);                                   \
+    if (!(actualValue == expectedValue)) {                                   \
+      std::printf("%s:%d: CHECK_EQUAL(%s, %s) failed: %lld != %lld\n",       \
+                  __FILE__, __LINE__, #actual, #expected,                    \
+                  static_cast<long long>(actualValue),                       \
+                  static_cast<long long>(expectedValue));                    \
+      ++dxapp::test::failureCount;                                           \
+    }                                                                        \
+  } while (false)
@@ -0,0 +1,73 @@
+// TexturePackerで矩形を詰める速さを測る
+// 乱数の大きさを数百から数千個PackAtlasで詰め、1秒あたりの矩形の数と
+// そのときの効率を出す。スカイラインに直接入れる速さも測る
+//
+// 使い方: TexturePackerBench [組み合わせごとに測る時間(ミリ秒)]
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "TestCommon.hpp"
+#include "TexturePacker.hpp"
+
+namespace {
+namespace pack = dxapp::pack;
+
+/*!
+ * @brief 小さいものが多く、たまに大きいものがある大きさの並び
+ */
+std::vector<pack::TextureDesc> RandomSizes(std::size_t count) {
+  std::vector<pack::TextureDesc> sizes(count);
+  std::uint32_t seed = 1;
+  auto next = [&seed]() {
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+  };
+  for (auto& size : sizes) {
+    const auto scale = next() % 8 == 0 ? 256 : 64;
+    size.width = 4 + next() % scale;
+    size.height = 4 + next() % scale;
+  }
+  return sizes;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  const auto durationMs = argc > 1 ? std::atoi(argv[1]) : 500;
+
+  for (const std::size_t count : {256, 1024, 4096}) {
+    const auto sizes = RandomSizes(count);
+    pack::AtlasLayout layout{};
+    if (!pack::PackAtlas(sizes, 16384, 2, 4, layout)) {
+      std::printf("%5zu rects: pack failed\n", count);
+      return 1;
+    }
+    const dxapp::test::Stopwatch stopwatch{};
+    int iterations = 0;
+    do {
+      pack::PackAtlas(sizes, 16384, 2, 4, layout);
+      ++iterations;
+    } while (stopwatch.milliseconds() < durationMs);
+    const auto seconds = stopwatch.milliseconds() / 1000.0;
+    std::printf("PackAtlas %5zu rects %8.3f ms %9.0f rects/s  %ux%u %.2f\n",
+                count, stopwatch.milliseconds() / iterations,
+                double(count) * iterations / seconds, layout.width,
+                layout.height, layout.efficiency);
+  }
+
+  // 並べ替えも広げ直しもなく、入るまで入れるだけ
+  const auto sizes = RandomSizes(4096);
+  const dxapp::test::Stopwatch stopwatch{};
+  std::uint64_t inserted = 0;
+  do {
+    pack::SkylinePacker packer(4096, 4096);
+    pack::PackRect rect{};
+    for (const auto& size : sizes) {
+      inserted += packer.Insert(size.width, size.height, rect) ? 1 : 0;
+    }
+  } while (stopwatch.milliseconds() < durationMs);
+  std::printf("Skyline 4096x4096 %9.0f inserts/s\n",
+              inserted / (stopwatch.milliseconds() / 1000.0));
+  return 0;
+}
@@ -0,0 +1,242 @@
+// TexturePackerの組み分けとアトラスの配置を確かめる
+// 乱数で作った大きさを詰め、置いた矩形が領域からはみ出さないこと、
+// 余白込みで互いに重ならないこと、詰め方が悪くなっていないことを
+// 余白込みの占有率のしきい値で見る。余白の書き込みとテクスチャ配列の組み分けも見る
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "TestCommon.hpp"
+#include "TexturePacker.hpp"
+
+namespace {
+namespace pack = dxapp::pack;
+
+std::uint32_t Next(std::uint32_t& seed) {
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+/*!
+ * @brief 2つの矩形が重なるか
+ */
+bool Overlaps(const pack::PackRect& a, const pack::PackRect& b) {
+  return a.x < b.x + b.width && b.x < a.x + a.width &&
+         a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+/*!
+ * @brief 領域に収まっていて、互いに重ならないか
+ * @return 問題のあった矩形の数
+ */
+int CountBadRects(const std::vector<pack::PackRect>& rects,
+                  std::uint32_t width, std::uint32_t height) {
+  int bad = 0;
+  for (std::size_t i = 0; i < rects.size(); ++i) {
+    const auto& r = rects[i];
+    if (r.x + r.width > width || r.y + r.height > height) {
+      ++bad;
+      continue;
+    }
+    for (auto j = i + 1; j < rects.size(); ++j) {
+      if (Overlaps(r, rects[j])) {
+        ++bad;
+        break;
+      }
+    }
+  }
+  return bad;
+}
+
+/*!
+ * @brief スカイラインに乱数の矩形を入らなくなるまで詰める
+ */
+void TestSkylineRandom() {
+  std::uint32_t seed = 33;
+  for (int round = 0; round < 50; ++round) {
+    const std::uint32_t width = 256 + Next(seed) % 768;
+    const std::uint32_t height = 256 + Next(seed) % 768;
+    pack::SkylinePacker packer(width, height);
+    std::vector<pack::PackRect> rects{};
+    std::uint64_t area = 0;
+    int failures = 0;
+    // 何度か置けなくても、小さいものなら隙間に入ることがある
+    while (failures < 20) {
+      const auto w = 1 + Next(seed) % 96;
+      const auto h = 1 + Next(seed) % 96;
+      pack::PackRect rect{};
+      if (!packer.Insert(w, h, rect)) {
+        ++failures;
+        continue;
+      }
+      TEST_CHECK_EQUAL(rect.width, w);
+      TEST_CHECK_EQUAL(rect.height, h);
+      rects.push_back(rect);
+      area += std::uint64_t(w) * h;
+    }
+    TEST_CHECK_EQUAL(CountBadRects(rects, width, height), 0);
+    TEST_CHECK_EQUAL(packer.usedArea(), area);
+    // 置けなくなるまで詰めたら、領域の7割は埋まっている
+    TEST_CHECK(area * 10 >= std::uint64_t(width) * height * 7);
+  }
+
+  // 大きすぎるものと大きさ0は置かない
+  pack::SkylinePacker packer(64, 64);
+  pack::PackRect rect{};
+  TEST_CHECK(!packer.Insert(65, 1, rect));
+  TEST_CHECK(!packer.Insert(1, 65, rect));
+  TEST_CHECK(!packer.Insert(0, 8, rect));
+  TEST_CHECK(packer.Insert(64, 64, rect));
+  TEST_CHECK(!packer.Insert(1, 1, rect));
+}
+
+/*!
+ * @brief アトラスの配置。余白込みの位置がそろい、重ならず、よく詰まっている
+ * @details 大きさは2のべき乗なので、面積がぎりぎり入らないと半分近く空く。
+ *          余白込みの面積 / アトラスの面積がそれより大きく下がらないことを見る
+ */
+void TestAtlasRandom() {
+  constexpr double MinOccupancy = 0.4;
+  std::uint32_t seed = 7;
+  const struct {
+    std::uint32_t gutter, alignment;
+  } cases[] = {
+      {0, 1},
+      {2, 4},
+      {4, 16},
+  };
+  for (const auto& c : cases) {
+    for (int round = 0; round < 30; ++round) {
+      std::vector<pack::TextureDesc> sizes(20 + Next(seed) % 200);
+      for (auto& size : sizes) {
+        // 小さいものが多く、たまに大きいものがある
+        const auto scale = Next(seed) % 8 == 0 ? 256 : 64;
+        size.width = 4 + Next(seed) % scale;
+        size.height = 4 + Next(seed) % scale;
+      }
+      pack::AtlasLayout layout{};
+      TEST_CHECK(pack::PackAtlas(sizes, 8192, c.gutter, c.alignment, layout));
+      TEST_CHECK_EQUAL(layout.rects.size(), sizes.size());
+      if (layout.rects.size() != sizes.size()) {
+        continue;
+      }
+
+      std::vector<pack::PackRect> cells{};
+      std::uint64_t area = 0;
+      std::uint64_t cellArea = 0;
+      int misaligned = 0;
+      for (std::size_t i = 0; i < sizes.size(); ++i) {
+        const auto& rect = layout.rects[i];
+        TEST_CHECK_EQUAL(rect.width, sizes[i].width);
+        TEST_CHECK_EQUAL(rect.height, sizes[i].height);
+        // 余白はアトラスの内側に取る
+        TEST_CHECK(rect.x >= c.gutter && rect.y >= c.gutter);
+        const pack::PackRect cell{rect.x - c.gutter, rect.y - c.gutter,
+                                  rect.width + c.gutter * 2,
+                                  rect.height + c.gutter * 2};
+        if (cell.x % c.alignment != 0 || cell.y % c.alignment != 0) {
+          ++misaligned;
+        }
+        cells.push_back(cell);
+        area += std::uint64_t(rect.width) * rect.height;
+        // 配置の単位にそろえた分も余白として数える
+        cellArea +=
+            std::uint64_t((cell.width + c.alignment - 1) / c.alignment) *
+            ((cell.height + c.alignment - 1) / c.alignment) * c.alignment *
+            c.alignment;
+      }
+      TEST_CHECK_EQUAL(misaligned, 0);
+      TEST_CHECK_EQUAL(CountBadRects(cells, layout.width, layout.height), 0);
+
+      // 大きさは2のべき乗で、効率は実際の面積と合う
+      TEST_CHECK((layout.width & (layout.width - 1)) == 0);
+      TEST_CHECK((layout.height & (layout.height - 1)) == 0);
+      const auto atlasArea = double(layout.width) * layout.height;
+      TEST_CHECK(std::abs(layout.efficiency - area / atlasArea) < 1e-9);
+      const auto occupancy = cellArea / atlasArea;
+      if (occupancy < MinOccupancy) {
+        std::printf("gutter %u alignment %u: occupancy %.3f (%zu rects)\n",
+                    c.gutter, c.alignment, occupancy, sizes.size());
+      }
+      TEST_CHECK(occupancy >= MinOccupancy);
+    }
+  }
+
+  // 空なら何もせず成功、最大の大きさに入らなければ失敗
+  pack::AtlasLayout layout{};
+  TEST_CHECK(pack::PackAtlas({}, 1024, 0, 1, layout));
+  TEST_CHECK_EQUAL(layout.rects.size(), 0u);
+  TEST_CHECK(!pack::PackAtlas({{1000, 1000, 0}}, 1024, 16, 1, layout));
+  TEST_CHECK(pack::PackAtlas({{1000, 1000, 0}}, 1024, 12, 1, layout));
+  TEST_CHECK(!pack::PackAtlas(
+      std::vector<pack::TextureDesc>(5, {512, 512, 0}), 1024, 0, 1, layout));
+}
+
+/*!
+ * @brief 余白には反対側の端のピクセルが入る
+ */
+void TestBlitWithGutter() {
+  constexpr std::uint32_t Width = 3;
+  constexpr std::uint32_t Height = 2;
+  constexpr std::uint32_t Gutter = 2;
+  constexpr std::uint32_t AtlasSize = 8;
+  std::vector<std::uint8_t> src(Width * Height * 4);
+  for (std::uint32_t y = 0; y < Height; ++y) {
+    for (std::uint32_t x = 0; x < Width; ++x) {
+      src[(y * Width + x) * 4] = static_cast<std::uint8_t>(x);
+      src[(y * Width + x) * 4 + 1] = static_cast<std::uint8_t>(y);
+      src[(y * Width + x) * 4 + 2] = 1;  // 書かれた印
+    }
+  }
+  std::vector<std::uint8_t> atlas(AtlasSize * AtlasSize * 4, 0);
+  const pack::PackRect rect{3, 2, Width, Height};
+  pack::BlitWithGutter(src.data(), Width * 4, atlas.data(), AtlasSize * 4,
+                       rect, Gutter);
+
+  int wrong = 0;
+  for (std::uint32_t y = 0; y < AtlasSize; ++y) {
+    for (std::uint32_t x = 0; x < AtlasSize; ++x) {
+      const auto pixel = &atlas[(y * AtlasSize + x) * 4];
+      const auto dx = int(x) - int(rect.x);
+      const auto dy = int(y) - int(rect.y);
+      const bool inside = dx >= -int(Gutter) && dx < int(Width + Gutter) &&
+                          dy >= -int(Gutter) && dy < int(Height + Gutter);
+      if (!inside) {
+        wrong += pixel[2] != 0 ? 1 : 0;  // 余白の外は書かない
+        continue;
+      }
+      const auto sx = (dx % int(Width) + Width) % Width;
+      const auto sy = (dy % int(Height) + Height) % Height;
+      wrong += pixel[0] != sx || pixel[1] != sy || pixel[2] != 1 ? 1 : 0;
+    }
+  }
+  TEST_CHECK_EQUAL(wrong, 0);
+}
+
+/*!
+ * @brief テクスチャ配列の組み分け
+ */
+void TestGroupForArrays() {
+  const std::vector<pack::TextureDesc> descs{
+      {64, 64, 1},   {128, 64, 1}, {64, 64, 1},    {64, 64, 2},
+      {128, 64, 1},  {64, 64, 1},  {1024, 1024, 1}, {1024, 1024, 1},
+      {32, 32, 1},
+  };
+  const auto groups = pack::GroupForArrays(descs, 512);
+  TEST_CHECK_EQUAL(groups.size(), 2u);
+  if (groups.size() == 2) {
+    TEST_CHECK(groups[0] == (std::vector<std::size_t>{0, 2, 5}));
+    TEST_CHECK(groups[1] == (std::vector<std::size_t>{1, 4}));
+  }
+}
+}  // namespace
+
+int main() {
+  TestSkylineRandom();
+  TestAtlasRandom();
+  TestBlitWithGutter();
+  TestGroupForArrays();
+  return dxapp::test::Finish("TexturePackerTest");
+}
@@ -0,0 +1,158 @@
+﻿// TextureRegistryの検索の速さを、読むスレッドを増やしながら測る
+// 比べるのは、mutexで守った表と、std::atomic_loadで差し替えるshared_ptrの表
+// (以前のTextureRegistryのやり方)。書く側は1つで、一定の間隔で登録し続ける
+//
+// 使い方: TextureRegistryBench [測る時間(ミリ秒)] [読むスレッドの最大数]
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "TestCommon.hpp"
+#include "TextureRegistry.hpp"
+
+namespace {
+struct Value {
+  int id;
+};
+using Map = std::unordered_map<std::string, std::shared_ptr<Value>>;
+
+/*!
+ * @brief mutexで守った表
+ */
+class MutexMap {
+ public:
+  std::shared_ptr<Value> Find(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = map_.find(name);
+    return it != map_.end() ? it->second : nullptr;
+  }
+  void Insert(const std::string& name, std::shared_ptr<Value> value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    map_.emplace(name, std::move(value));
+  }
+
+ private:
+  mutable std::mutex mutex_{};
+  Map map_{};
+};
+
+/*!
+ * @brief std::atomic_load/atomic_storeでshared_ptrを差し替える表
+ * @details 標準ライブラリの実装はshared_ptrごとのロックを使う
+ */
+class AtomicSharedPtrMap {
+ public:
+  AtomicSharedPtrMap() : map_(std::make_shared<const Map>()) {}
+
+  std::shared_ptr<Value> Find(const std::string& name) const {
+    const auto map =
+        std::atomic_load_explicit(&map_, std::memory_order_acquire);
+    const auto it = map->find(name);
+    return it != map->end() ? it->second : nullptr;
+  }
+  void Insert(const std::string& name, std::shared_ptr<Value> value) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    auto map = std::make_shared<Map>(*std::atomic_load(&map_));
+    map->emplace(name, std::move(value));
+    std::atomic_store_explicit(&map_,
+                               std::shared_ptr<const Map>(std::move(map)),
+                               std::memory_order_release);
+  }
+
+ private:
+  std::shared_ptr<const Map> map_;
+  std::mutex writeMutex_{};
+};
+
+/*!
+ * @brief TextureRegistryを同じ形で呼ぶ
+ */
+class RegistryMap {
+ public:
+  std::shared_ptr<Value> Find(const std::string& name) const {
+    return registry_.Find(name);
+  }
+  void Insert(const std::string& name, std::shared_ptr<Value> value) {
+    registry_.Insert(name, std::move(value));
+  }
+
+ private:
+  dxapp::TextureRegistry<Value> registry_{};
+};
+
+constexpr int KeyCount = 512;
+
+/*!
+ * @brief readerCount個のスレッドで検索し、1秒あたりの回数を返す
+ */
+template <class Table>
+double MeasureLookups(unsigned int readerCount, int durationMs) {
+  Table table{};
+  std::vector<std::string> names{};
+  for (int i = 0; i < KeyCount; ++i) {
+    names.push_back("Assets/texture" + std::to_string(i) + ".png");
+    table.Insert(names.back(), std::make_shared<Value>(Value{i}));
+  }
+
+  std::atomic<bool> stop{false};
+  std::atomic<std::uint64_t> total{0};
+  std::vector<std::thread> threads{};
+  for (unsigned int t = 0; t < readerCount; ++t) {
+    threads.emplace_back([&, t]() {
+      std::uint64_t count = 0;
+      std::uint64_t sum = 0;
+      std::uint32_t seed = t + 1;
+      while (!stop.load(std::memory_order_relaxed)) {
+        for (int i = 0; i < 64; ++i) {
+          seed = seed * 1664525u + 1013904223u;
+          const auto value = table.Find(names[(seed >> 8) % KeyCount]);
+          sum += value ? value->id : 0;
+        }
+        count += 64;
+      }
+      total += count + (sum == 0 ? 1 : 0);
+    });
+  }
+
+  // 書く側はロードが終わるたびに登録するくらいの間隔で書く
+  const dxapp::test::Stopwatch stopwatch{};
+  int inserted = 0;
+  while (stopwatch.milliseconds() < durationMs) {
+    table.Insert("Assets/loaded" + std::to_string(inserted++) + ".png",
+                 std::make_shared<Value>(Value{inserted}));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  stop = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return total.load() / (stopwatch.milliseconds() / 1000.0);
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  const auto durationMs = argc > 1 ? std::atoi(argv[1]) : 500;
+  const auto maxThreads =
+      argc > 2 ? static_cast<unsigned int>(std::atoi(argv[2]))
+               : std::max(1u, std::thread::hardware_concurrency());
+
+  std::printf("lookups per second (million), 1 writer inserting every 1 ms\n");
+  std::printf("%8s %14s %14s %14s\n", "readers", "mutex", "atomic_load",
+              "TextureRegistry");
+  for (unsigned int readers = 1; readers <= maxThreads; readers *= 2) {
+    const auto mutexRate = MeasureLookups<MutexMap>(readers, durationMs);
+    const auto atomicRate =
+        MeasureLookups<AtomicSharedPtrMap>(readers, durationMs);
+    const auto registryRate = MeasureLookups<RegistryMap>(readers, durationMs);
+    std::printf("%8u %14.1f %14.1f %14.1f\n", readers, mutexRate / 1e6,
+                atomicRate / 1e6, registryRate / 1e6);
+  }
+  return 0;
+}
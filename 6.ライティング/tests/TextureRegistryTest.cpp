@@ -0,0 +1,206 @@
+﻿// TextureRegistryを複数のスレッドから読み書きして壊れないことを確かめる
+// 読む側は値が生きていて中身が名前と合っていること、
+// 書く側は古い表を読まれていない分だけ消していることを見る
+// ThreadSanitizerやAddressSanitizerを付けて動かすと、解放済みの表を読んでいないかもわかる
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TestCommon.hpp"
+#include "TextureRegistry.hpp"
+
+namespace {
+using dxapp::TextureRegistry;
+
+//! 登録する値。消えた後に触ると生きている数が合わなくなる
+struct Value {
+  explicit Value(int id) : id(id) { ++alive; }
+  ~Value() {
+    --alive;
+    id = -1;
+  }
+  int id;
+  static std::atomic<int> alive;
+};
+std::atomic<int> Value::alive{0};
+
+std::string Name(int id) { return "texture" + std::to_string(id); }
+
+/*!
+ * @brief 1スレッドでの登録・検索・書き換え
+ */
+void TestSingleThread() {
+  TextureRegistry<Value> registry{};
+  TEST_CHECK(registry.Find("missing") == nullptr);
+  TEST_CHECK_EQUAL(registry.size(), 0u);
+
+  TEST_CHECK(registry.Insert("a", std::make_shared<Value>(1)));
+  TEST_CHECK(!registry.Insert("a", std::make_shared<Value>(2)));
+  TEST_CHECK_EQUAL(registry.size(), 1u);
+  TEST_CHECK_EQUAL(registry.Find("a")->id, 1);
+
+  // 引いた値は表から消えても持っている間は生きている
+  auto held = registry.Find("a");
+  registry.Modify([](TextureRegistry<Value>::Map& map) { map.erase("a"); });
+  TEST_CHECK(registry.Find("a") == nullptr);
+  TEST_CHECK_EQUAL(held->id, 1);
+
+  // 読んでいるスレッドがいなければ古い表はすぐ消える
+  TEST_CHECK_EQUAL(registry.retiredCount(), 0u);
+
+  int count = 0;
+  registry.Insert("b", std::make_shared<Value>(3));
+  registry.Insert("c", std::make_shared<Value>(4));
+  registry.ForEach([&count](const std::string&,
+                            const std::shared_ptr<Value>&) { ++count; });
+  TEST_CHECK_EQUAL(count, 2);
+
+  // Readの中の表は書き換えの後も消えない
+  registry.Read([&registry](const TextureRegistry<Value>::Map& map) {
+    registry.Insert("d", std::make_shared<Value>(5));
+    TEST_CHECK_EQUAL(map.size(), 2u);
+    TEST_CHECK_EQUAL(registry.retiredCount(), 1u);
+    return 0;
+  });
+  registry.Insert("e", std::make_shared<Value>(6));
+  TEST_CHECK_EQUAL(registry.retiredCount(), 0u);
+}
+
+/*!
+ * @brief 読むスレッドと書くスレッドを同時に動かす
+ * @details 書く側はidを登録・削除し続け、読む側は見つけた値のidが
+ *          名前と一致することを確かめる
+ */
+void TestConcurrentReadWrite() {
+  constexpr int KeyCount = 256;
+  constexpr int WriteCount = 20000;
+  const auto readerCount = std::max(4u, std::thread::hardware_concurrency());
+
+  {
+    TextureRegistry<Value> registry{};
+    for (int i = 0; i < KeyCount; i += 2) {
+      registry.Insert(Name(i), std::make_shared<Value>(i));
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> mismatches{0};
+    std::atomic<std::uint64_t> lookups{0};
+    std::vector<std::thread> readers{};
+    for (unsigned int t = 0; t < readerCount; ++t) {
+      readers.emplace_back([&, t]() {
+        std::uint64_t count = 0;
+        std::uint32_t seed = t * 7919u + 1;
+        while (!stop.load(std::memory_order_relaxed)) {
+          seed = seed * 1664525u + 1013904223u;
+          const auto id = static_cast<int>((seed >> 8) % KeyCount);
+          const auto value = registry.Find(Name(id));
+          if (value && value->id != id) {
+            ++mismatches;
+          }
+          if ((count & 63) == 0) {
+            registry.Read([&](const TextureRegistry<Value>::Map& map) {
+              for (const auto& [name, v] : map) {
+                if (name != Name(v->id)) {
+                  ++mismatches;
+                }
+              }
+              return 0;
+            });
+          }
+          ++count;
+        }
+        lookups += count;
+      });
+    }
+
+    // 書く側は2つ。登録と削除を混ぜる
+    std::vector<std::thread> writers{};
+    for (int w = 0; w < 2; ++w) {
+      writers.emplace_back([&, w]() {
+        for (int i = 0; i < WriteCount; ++i) {
+          const auto id = (i * 2 + w * 37) % KeyCount;
+          if (i % 3 == 0) {
+            registry.Modify([id](TextureRegistry<Value>::Map& map) {
+              map.erase(Name(id));
+            });
+          } else {
+            registry.Insert(Name(id), std::make_shared<Value>(id));
+          }
+        }
+      });
+    }
+    for (auto& writer : writers) {
+      writer.join();
+    }
+    stop = true;
+    for (auto& reader : readers) {
+      reader.join();
+    }
+
+    TEST_CHECK_EQUAL(mismatches.load(), 0);
+    TEST_CHECK(lookups.load() > 0);
+    // 残っている古い表は読んでいたスレッドの数より多くならない
+    TEST_CHECK(registry.retiredCount() <= dxapp::registry::MaxReaderThreads);
+    registry.Insert("last", std::make_shared<Value>(0));
+    TEST_CHECK_EQUAL(registry.retiredCount(), 0u);
+    std::printf("  %u readers, %llu lookups during %d writes\n", readerCount,
+                static_cast<unsigned long long>(lookups.load()),
+                WriteCount * 2);
+  }
+  // 表を消したら値も全部消える
+  TEST_CHECK_EQUAL(Value::alive.load(), 0);
+}
+
+/*!
+ * @brief スロットより多いスレッドが読んでも壊れない
+ * @details スロットのないスレッドは書く側と排他で読む
+ */
+void TestMoreThreadsThanSlots() {
+  TextureRegistry<Value> registry{};
+  registry.Insert("a", std::make_shared<Value>(1));
+
+  constexpr auto ThreadCount = dxapp::registry::MaxReaderThreads + 8;
+  std::atomic<int> found{0};
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads{};
+  for (std::size_t t = 0; t < ThreadCount; ++t) {
+    threads.emplace_back([&]() {
+      // 全員がスロットを持ったまま読むように、そろうまで待つ
+      registry.Find("a");
+      ++ready;
+      while (!go.load()) {
+        std::this_thread::yield();
+      }
+      for (int i = 0; i < 1000; ++i) {
+        const auto value = registry.Find("a");
+        if (value && value->id == 1) {
+          ++found;
+        }
+        if (i % 100 == 0) {
+          registry.Insert("b" + std::to_string(i), std::make_shared<Value>(i));
+        }
+      }
+    });
+  }
+  while (ready.load() < static_cast<int>(ThreadCount)) {
+    std::this_thread::yield();
+  }
+  go = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  TEST_CHECK_EQUAL(found.load(), static_cast<int>(ThreadCount * 1000));
+}
+}  // namespace
+
+int main() {
+  TestSingleThread();
+  TestConcurrentReadWrite();
+  TestMoreThreadsThanSlots();
+  return dxapp::test::Finish("TextureRegistryTest");
+}
@@ -0,0 +1,268 @@
+// TextureResidencyのミップ常駐の判断を確かめる
+// カメラが並んだテクスチャの横を通り過ぎる動きを作り、TextureManagerと同じく
+// 毎フレーム RequestMip -> Update -> BeginFrame の順で呼ぶ。
+// 返ってきた変化を写しに当てて状態とずれないこと、常駐バイト数が予算を
+// 超えないこと、カメラが止まったらミップの要求が落ち着くことを見る
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "TestCommon.hpp"
+#include "TextureResidency.hpp"
+
+namespace {
+using dxapp::ResidencyChange;
+using dxapp::TextureResidency;
+
+constexpr std::uint32_t TextureSize = 2048;
+constexpr std::uint32_t StandardMips = 6;  //!< 2048から64までを個別に持つ
+constexpr std::uint64_t TailBytes = 64 * 1024;
+constexpr std::uint64_t MiB = 1024 * 1024;
+
+/*!
+ * @brief 2048x2048のRGBAテクスチャのミップごとのバイト数
+ */
+std::vector<std::uint64_t> MipBytes() {
+  std::vector<std::uint64_t> bytes{};
+  for (std::uint32_t m = 0; m < StandardMips; ++m) {
+    const std::uint64_t size = TextureSize >> m;
+    bytes.push_back(size * size * 4);
+  }
+  return bytes;
+}
+
+/*!
+ * @brief mip以上を常駐させたときのバイト数
+ */
+std::uint64_t BytesFrom(std::uint32_t mip) {
+  const auto bytes = MipBytes();
+  std::uint64_t total = TailBytes;
+  for (auto m = mip; m < bytes.size(); ++m) {
+    total += bytes[m];
+  }
+  return total;
+}
+
+/*!
+ * @brief 登録とミップテール、必要なミップの計算
+ */
+void TestRegisterAndRequiredMip() {
+  TextureResidency residency(64 * MiB);
+  const auto id = residency.Register(MipBytes(), TailBytes);
+  TEST_CHECK_EQUAL(residency.residentMip(id), StandardMips);
+  TEST_CHECK_EQUAL(residency.residentBytes(), TailBytes);
+
+  // 要求がなければ何もロードしない
+  TEST_CHECK(residency.Update().empty());
+
+  // テクセルとピクセルが1対1になるミップ
+  TEST_CHECK(TextureResidency::ComputeRequiredMip(1024, 1024.0f) == 0.0f);
+  TEST_CHECK(TextureResidency::ComputeRequiredMip(1024, 256.0f) == 2.0f);
+  TEST_CHECK(TextureResidency::ComputeRequiredMip(1024, 4096.0f) == 0.0f);
+  TEST_CHECK(TextureResidency::ComputeRequiredMip(1024, 0.5f) == 10.0f);
+  TEST_CHECK(TextureResidency::ComputeRequiredMip(0, 100.0f) == 0.0f);
+
+  // 解除したIDは使いまわされ、テールの分も返る
+  residency.Unregister(id);
+  TEST_CHECK_EQUAL(residency.residentBytes(), 0u);
+  TEST_CHECK_EQUAL(residency.Register(MipBytes(), TailBytes), id);
+}
+
+/*!
+ * @brief ロードは1回に1段ずつ進み、使われなくなったらテールまで戻る
+ */
+void TestLoadStepsAndEviction() {
+  TextureResidency residency(64 * MiB);
+  const auto id = residency.Register(MipBytes(), TailBytes);
+
+  for (std::uint32_t step = 0; step < StandardMips; ++step) {
+    residency.RequestMip(id, 0.0f);
+    const auto changes = residency.Update();
+    residency.BeginFrame();
+    TEST_CHECK_EQUAL(changes.size(), 1u);
+    if (!changes.empty()) {
+      TEST_CHECK_EQUAL(changes[0].oldMip, StandardMips - step);
+      TEST_CHECK_EQUAL(changes[0].newMip, StandardMips - step - 1);
+    }
+  }
+  TEST_CHECK_EQUAL(residency.residentMip(id), 0u);
+  TEST_CHECK_EQUAL(residency.residentBytes(), BytesFrom(0));
+
+  // 粗いミップで足りるようになったら細かい方はすぐに捨てる
+  residency.RequestMip(id, 2.7f);
+  const auto changes = residency.Update();
+  residency.BeginFrame();
+  TEST_CHECK_EQUAL(changes.size(), 1u);
+  TEST_CHECK_EQUAL(residency.residentMip(id), 2u);
+  TEST_CHECK_EQUAL(residency.residentBytes(), BytesFrom(2));
+
+  // 少し見えないだけなら持っておき、しばらく使われなければテールだけにする
+  for (std::uint32_t frame = 0; frame < TextureResidency::EvictAfterFrames;
+       ++frame) {
+    TEST_CHECK(residency.Update().empty());
+    residency.BeginFrame();
+  }
+  TEST_CHECK_EQUAL(residency.residentMip(id), 2u);
+  residency.Update();
+  TEST_CHECK_EQUAL(residency.residentMip(id), StandardMips);
+  TEST_CHECK_EQUAL(residency.residentBytes(), TailBytes);
+}
+
+/*!
+ * @brief カメラの動きを流して、予算と変化の整合を毎フレーム確かめる
+ */
+class CameraTrace {
+ public:
+  static constexpr std::uint32_t TextureCount = 48;
+  static constexpr float Spacing = 10.0f;    //!< テクスチャの間隔
+  static constexpr float ViewRange = 60.0f;  //!< これより遠いものは描かない
+  static constexpr std::uint32_t MaxLoads = 4;
+
+  explicit CameraTrace(std::uint64_t budgetBytes) : residency_(budgetBytes) {
+    for (std::uint32_t i = 0; i < TextureCount; ++i) {
+      ids_.push_back(residency_.Register(MipBytes(), TailBytes));
+      mirror_.push_back(StandardMips);
+    }
+  }
+
+  TextureResidency& residency() { return residency_; }
+
+  /*!
+   * @brief 1フレーム進める
+   * @param[in] cameraX カメラの位置。テクスチャはx軸上に並ぶ
+   * @return 常駐が変わったテクスチャの数
+   */
+  std::size_t Frame(float cameraX) {
+    requested_.assign(TextureCount, StandardMips);
+    for (std::uint32_t i = 0; i < TextureCount; ++i) {
+      const auto distance = std::abs(i * Spacing - cameraX);
+      if (distance > ViewRange) {
+        continue;
+      }
+      // 近いほど画面上で大きい。1つのテクスチャを2回描くこともある
+      const auto pixels = 4096.0f / (1.0f + distance * 0.25f);
+      const auto mip = TextureResidency::ComputeRequiredMip(TextureSize, pixels);
+      residency_.RequestMip(ids_[i], mip);
+      residency_.RequestMip(ids_[i], mip + 1.0f);
+      requested_[i] = std::min(StandardMips, static_cast<std::uint32_t>(mip));
+    }
+
+    const auto changes = residency_.Update(MaxLoads);
+    residency_.BeginFrame();
+    Check(changes);
+    return changes.size();
+  }
+
+  //! 最後のフレームで要求したミップ
+  std::uint32_t requested(std::uint32_t i) const { return requested_[i]; }
+
+  //! 最後のフレームで要求したミップを全部常駐させたときのバイト数
+  std::uint64_t requestedBytes() const {
+    std::uint64_t total = 0;
+    for (const auto mip : requested_) {
+      total += BytesFrom(mip);
+    }
+    return total;
+  }
+
+  std::uint32_t residentMip(std::uint32_t i) const {
+    return residency_.residentMip(ids_[i]);
+  }
+
+  //! 一番多く常駐したバイト数
+  std::uint64_t peakBytes() const { return peakBytes_; }
+
+ private:
+  /*!
+   * @brief 変化を写しに当て、状態と予算を確かめる
+   */
+  void Check(const std::vector<ResidencyChange>& changes) {
+    std::uint32_t loads = 0;
+    std::vector<bool> loaded(TextureCount, false);
+    for (const auto& change : changes) {
+      TEST_CHECK(change.id < TextureCount);
+      if (change.id >= TextureCount) {
+        continue;
+      }
+      TEST_CHECK_EQUAL(change.oldMip, mirror_[change.id]);
+      TEST_CHECK(change.oldMip != change.newMip);
+      if (change.newMip < change.oldMip) {
+        // ロードは1段ずつ、1つのテクスチャに1回まで
+        TEST_CHECK_EQUAL(change.newMip + 1, change.oldMip);
+        TEST_CHECK(!loaded[change.id]);
+        loaded[change.id] = true;
+        ++loads;
+      }
+      mirror_[change.id] = change.newMip;
+    }
+    TEST_CHECK(loads <= MaxLoads);
+
+    std::uint64_t total = 0;
+    for (std::uint32_t i = 0; i < TextureCount; ++i) {
+      TEST_CHECK_EQUAL(residency_.residentMip(ids_[i]), mirror_[i]);
+      total += BytesFrom(mirror_[i]);
+    }
+    TEST_CHECK_EQUAL(residency_.residentBytes(), total);
+    TEST_CHECK(total <= residency_.budgetBytes());
+    peakBytes_ = std::max(peakBytes_, total);
+  }
+
+  TextureResidency residency_;
+  std::vector<std::uint32_t> ids_{};
+  std::vector<std::uint32_t> mirror_{};     //!< 変化から作った常駐ミップ
+  std::vector<std::uint32_t> requested_{};  //!< 最後のフレームの要求
+  std::uint64_t peakBytes_{0};
+};
+
+/*!
+ * @brief 予算の足りない中をカメラが動き、止まったら落ち着く
+ */
+void TestCameraTrace() {
+  CameraTrace trace(64 * MiB);
+  const auto end = CameraTrace::TextureCount * CameraTrace::Spacing;
+
+  // 通り過ぎる。予算を使い切るところまで行き、超えないことをFrameで見る
+  for (float x = 0.0f; x < end; x += 0.75f) {
+    trace.Frame(x);
+  }
+  TEST_CHECK(trace.peakBytes() > 48 * MiB);
+
+  // 止まると、予算内では要求より細かいミップは持たず、変化もなくなる
+  const float stopX = end * 0.5f;
+  std::size_t lateChanges = 0;
+  for (int frame = 0; frame < 200; ++frame) {
+    const auto changes = trace.Frame(stopX);
+    if (frame >= 100) {
+      lateChanges += changes;
+    }
+  }
+  TEST_CHECK_EQUAL(lateChanges, 0u);
+  TEST_CHECK(trace.requestedBytes() > trace.residency().budgetBytes());
+  for (std::uint32_t i = 0; i < CameraTrace::TextureCount; ++i) {
+    TEST_CHECK(trace.residentMip(i) >= trace.requested(i));
+  }
+
+  // 予算を増やせば要求どおりのミップまでロードが進む
+  trace.residency().SetBudget(512 * MiB);
+  for (int frame = 0; frame < 100; ++frame) {
+    trace.Frame(stopX);
+  }
+  TEST_CHECK(trace.requestedBytes() <= trace.residency().budgetBytes());
+  for (std::uint32_t i = 0; i < CameraTrace::TextureCount; ++i) {
+    TEST_CHECK_EQUAL(trace.residentMip(i), trace.requested(i));
+  }
+
+  // 予算を減らしたら、次のUpdateですぐに予算内まで捨てる
+  trace.residency().SetBudget(32 * MiB);
+  trace.Frame(stopX);
+  TEST_CHECK(trace.residency().residentBytes() <= 32 * MiB);
+}
+}  // namespace
+
+int main() {
+  TestRegisterAndRequiredMip();
+  TestLoadStepsAndEviction();
+  TestCameraTrace();
+  return dxapp::test::Finish("TextureResidencyTest");
+}
@@ -0,0 +1,520 @@
+﻿#include "BlockCompressor.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <vector>
+
+// x64なら必ずSSE2まで使える。インデックス探索を4ピクセルずつやる
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define DXAPP_COOKER_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace dxapp {
+namespace cooker {
+
+namespace {
+/*!
+ * @brief 1ブロック分のピクセルをチャンネルごとに並べたもの
+ * @details SIMDで4ピクセルずつ処理しやすいようにSoAにしている
+ */
+struct BlockPixels {
+  alignas(16) float ch[4][16];  //!< [チャンネル][ピクセル]
+};
+
+void LoadBlock(const std::uint8_t rgba[64], BlockPixels& px) {
+  for (int i = 0; i < 16; ++i) {
+    for (int c = 0; c < 4; ++c) {
+      px.ch[c][i] = rgba[i * 4 + c];
+    }
+  }
+}
+
+/*!
+ * @brief 各ピクセルに一番近いパレットの色を探す
+ * @param[in] px ピクセル
+ * @param[in] palette パレット(RGBA)
+ * @param[in] paletteSize パレットの色数
+ * @param[in] channels 比べるチャンネル数(3ならアルファを無視)
+ * @param[out] indices 選んだパレットの番号
+ * @return 二乗誤差の合計
+ */
+float FindIndices(const BlockPixels& px, const float (*palette)[4],
+                  int paletteSize, int channels, int indices[16]) {
+#if DXAPP_COOKER_USE_SSE2
+  float total = 0.0f;
+  for (int i = 0; i < 16; i += 4) {
+    auto best = _mm_set1_ps(std::numeric_limits<float>::max());
+    auto bestIndex = _mm_setzero_si128();
+    for (int k = 0; k < paletteSize; ++k) {
+      auto dist = _mm_setzero_ps();
+      for (int c = 0; c < channels; ++c) {
+        const auto d = _mm_sub_ps(_mm_load_ps(&px.ch[c][i]),
+                                  _mm_set1_ps(palette[k][c]));
+        dist = _mm_add_ps(dist, _mm_mul_ps(d, d));
+      }
+      // 小さくなったレーンだけ番号を差し替える
+      const auto closer = _mm_castps_si128(_mm_cmplt_ps(dist, best));
+      bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)),
+                               _mm_andnot_si128(closer, bestIndex));
+      best = _mm_min_ps(dist, best);
+    }
+    alignas(16) float err[4];
+    _mm_store_ps(err, best);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(indices + i), bestIndex);
+    total += err[0] + err[1] + err[2] + err[3];
+  }
+  return total;
+#else
+  float total = 0.0f;
+  for (int i = 0; i < 16; ++i) {
+    float best = std::numeric_limits<float>::max();
+    int bestIndex = 0;
+    for (int k = 0; k < paletteSize; ++k) {
+      float dist = 0.0f;
+      for (int c = 0; c < channels; ++c) {
+        const float d = px.ch[c][i] - palette[k][c];
+        dist += d * d;
+      }
+      if (dist < best) {
+        best = dist;
+        bestIndex = k;
+      }
+    }
+    indices[i] = bestIndex;
+    total += best;
+  }
+  return total;
+#endif
+}
+
+/*!
+ * @brief 主成分分析で色の分布の端を求める
+ * @details 分布の主軸に投影して、一番外側の2点を端点にする
+ */
+void PrincipalEndpoints(const BlockPixels& px, int channels, float e0[4],
+                        float e1[4]) {
+  float mean[4]{};
+  for (int c = 0; c < channels; ++c) {
+    for (int i = 0; i < 16; ++i) {
+      mean[c] += px.ch[c][i];
+    }
+    mean[c] /= 16.0f;
+  }
+
+  float cov[4][4]{};
+  for (int i = 0; i < 16; ++i) {
+    float d[4]{};
+    for (int c = 0; c < channels; ++c) {
+      d[c] = px.ch[c][i] - mean[c];
+    }
+    for (int a = 0; a < channels; ++a) {
+      for (int b = 0; b < channels; ++b) {
+        cov[a][b] += d[a] * d[b];
+      }
+    }
+  }
+
+  // べき乗法。初期値は範囲の対角線
+  float axis[4]{};
+  for (int c = 0; c < channels; ++c) {
+    const auto range = std::minmax_element(px.ch[c], px.ch[c] + 16);
+    axis[c] = *range.second - *range.first;
+  }
+  for (int iter = 0; iter < 8; ++iter) {
+    float next[4]{};
+    float len = 0.0f;
+    for (int a = 0; a < channels; ++a) {
+      for (int b = 0; b < channels; ++b) {
+        next[a] += cov[a][b] * axis[b];
+      }
+      len = std::max(len, std::abs(next[a]));
+    }
+    if (len < 1e-6f) {
+      break;
+    }
+    for (int c = 0; c < channels; ++c) {
+      axis[c] = next[c] / len;
+    }
+  }
+
+  float len2 = 0.0f;
+  for (int c = 0; c < channels; ++c) {
+    len2 += axis[c] * axis[c];
+  }
+  if (len2 < 1e-6f) {
+    // 単色ブロック
+    std::copy(mean, mean + 4, e0);
+    std::copy(mean, mean + 4, e1);
+    return;
+  }
+
+  float tmin = std::numeric_limits<float>::max();
+  float tmax = std::numeric_limits<float>::lowest();
+  for (int i = 0; i < 16; ++i) {
+    float t = 0.0f;
+    for (int c = 0; c < channels; ++c) {
+      t += (px.ch[c][i] - mean[c]) * axis[c];
+    }
+    tmin = std::min(tmin, t);
+    tmax = std::max(tmax, t);
+  }
+  for (int c = 0; c < channels; ++c) {
+    e0[c] = std::clamp(mean[c] + axis[c] * tmin / len2, 0.0f, 255.0f);
+    e1[c] = std::clamp(mean[c] + axis[c] * tmax / len2, 0.0f, 255.0f);
+  }
+}
+
+/*!
+ * @brief インデックスを固定して端点を最小二乗法で求めなおす
+ * @param[in] weights インデックスごとのe1側の重み
+ * @return 解けなかったらfalse
+ */
+bool RefineEndpoints(const BlockPixels& px, int channels,
+                     const int indices[16], const float* weights, float e0[4],
+                     float e1[4]) {
+  float a = 0.0f, b = 0.0f, c = 0.0f;
+  float x0[4]{}, x1[4]{};
+  for (int i = 0; i < 16; ++i) {
+    const float t = weights[indices[i]];
+    const float s = 1.0f - t;
+    a += s * s;
+    b += s * t;
+    c += t * t;
+    for (int ch = 0; ch < channels; ++ch) {
+      x0[ch] += s * px.ch[ch][i];
+      x1[ch] += t * px.ch[ch][i];
+    }
+  }
+  const float det = a * c - b * b;
+  if (std::abs(det) < 1e-6f) {
+    return false;
+  }
+  for (int ch = 0; ch < channels; ++ch) {
+    e0[ch] = std::clamp((c * x0[ch] - b * x1[ch]) / det, 0.0f, 255.0f);
+    e1[ch] = std::clamp((a * x1[ch] - b * x0[ch]) / det, 0.0f, 255.0f);
+  }
+  return true;
+}
+
+//-------------------------------------------------------------------
+// BC1
+//-------------------------------------------------------------------
+inline std::uint16_t To565(const float c[4]) {
+  const auto r = static_cast<std::uint16_t>(std::lround(c[0] * 31.0f / 255.0f));
+  const auto g = static_cast<std::uint16_t>(std::lround(c[1] * 63.0f / 255.0f));
+  const auto b = static_cast<std::uint16_t>(std::lround(c[2] * 31.0f / 255.0f));
+  return static_cast<std::uint16_t>((r << 11) | (g << 5) | b);
+}
+
+inline void From565(std::uint16_t v, float c[4]) {
+  const int r = (v >> 11) & 31;
+  const int g = (v >> 5) & 63;
+  const int b = v & 31;
+  c[0] = static_cast<float>((r << 3) | (r >> 2));
+  c[1] = static_cast<float>((g << 2) | (g >> 4));
+  c[2] = static_cast<float>((b << 3) | (b >> 2));
+  c[3] = 255.0f;
+}
+
+// 4色モードのパレットの並び(0:c0, 1:c1, 2:2/3c0+1/3c1, 3:1/3c0+2/3c1)
+constexpr float BC1Weights[4]{0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+/*!
+ * @brief 量子化済みの端点でパレットを作ってインデックスを決める
+ */
+float EvaluateBC1(const BlockPixels& px, std::uint16_t c0, std::uint16_t c1,
+                  int indices[16]) {
+  float palette[4][4];
+  From565(c0, palette[0]);
+  From565(c1, palette[1]);
+  for (int k = 2; k < 4; ++k) {
+    for (int c = 0; c < 3; ++c) {
+      palette[k][c] = palette[0][c] +
+                      (palette[1][c] - palette[0][c]) * BC1Weights[k];
+    }
+    palette[k][3] = 255.0f;
+  }
+  return FindIndices(px, palette, 4, 3, indices);
+}
+
+/*!
+ * @brief BC1のカラーブロック。BC3のカラー部分にも使う
+ */
+void EncodeColorBlock(const BlockPixels& px, std::uint8_t* dst) {
+  float e0[4], e1[4];
+  PrincipalEndpoints(px, 3, e0, e1);
+
+  auto c0 = To565(e1);
+  auto c1 = To565(e0);
+  int indices[16];
+  float error = EvaluateBC1(px, c0, c1, indices);
+
+  // 1回だけ最小二乗法で詰める
+  {
+    float r0[4], r1[4];
+    if (RefineEndpoints(px, 3, indices, BC1Weights, r0, r1)) {
+      const auto n0 = To565(r0);
+      const auto n1 = To565(r1);
+      int refined[16];
+      const float refinedError = EvaluateBC1(px, n0, n1, refined);
+      if (refinedError < error) {
+        c0 = n0;
+        c1 = n1;
+        error = refinedError;
+        std::copy(refined, refined + 16, indices);
+      }
+    }
+  }
+
+  // c0 > c1 でないと3色モードになってしまう
+  if (c0 < c1) {
+    std::swap(c0, c1);
+    for (auto& i : indices) {
+      i ^= 1;
+    }
+  } else if (c0 == c1) {
+    std::fill(indices, indices + 16, 0);
+  }
+
+  std::uint32_t bits = 0;
+  for (int i = 0; i < 16; ++i) {
+    bits |= static_cast<std::uint32_t>(indices[i]) << (i * 2);
+  }
+  dst[0] = static_cast<std::uint8_t>(c0 & 0xFF);
+  dst[1] = static_cast<std::uint8_t>(c0 >> 8);
+  dst[2] = static_cast<std::uint8_t>(c1 & 0xFF);
+  dst[3] = static_cast<std::uint8_t>(c1 >> 8);
+  for (int i = 0; i < 4; ++i) {
+    dst[4 + i] = static_cast<std::uint8_t>(bits >> (i * 8));
+  }
+}
+
+/*!
+ * @brief BC4のアルファブロック(BC3の前半)
+ * @details 8段階モードだけ使う。等間隔なので近いインデックスは計算で出せる
+ */
+void EncodeAlphaBlock(const std::uint8_t rgba[64], std::uint8_t* dst) {
+  int amin = 255, amax = 0;
+  for (int i = 0; i < 16; ++i) {
+    amin = std::min<int>(amin, rgba[i * 4 + 3]);
+    amax = std::max<int>(amax, rgba[i * 4 + 3]);
+  }
+  dst[0] = static_cast<std::uint8_t>(amax);
+  dst[1] = static_cast<std::uint8_t>(amin);
+
+  std::uint64_t bits = 0;
+  if (amax != amin) {
+    const int range = amax - amin;
+    for (int i = 0; i < 16; ++i) {
+      // t=7が最大値(インデックス0)、t=0が最小値(インデックス1)
+      const int t = ((rgba[i * 4 + 3] - amin) * 14 + range) / (range * 2);
+      const int index = t == 7 ? 0 : t == 0 ? 1 : 8 - t;
+      bits |= static_cast<std::uint64_t>(index) << (i * 3);
+    }
+  }
+  for (int i = 0; i < 6; ++i) {
+    dst[2 + i] = static_cast<std::uint8_t>(bits >> (i * 8));
+  }
+}
+
+//-------------------------------------------------------------------
+// BC7(モード6)
+//-------------------------------------------------------------------
+constexpr int BC7Weights[16]{0,  4,  9,  13, 17, 21, 26, 30,
+                             34, 38, 43, 47, 51, 55, 60, 64};
+
+/*!
+ * @brief 端点を7bit + Pビットに量子化
+ * @details Pビットは4チャンネル共通なので誤差が小さい方を選ぶ
+ */
+void QuantizeBC7Endpoint(const float e[4], int q[4], int& pbit) {
+  float bestError = std::numeric_limits<float>::max();
+  for (int p = 0; p < 2; ++p) {
+    int cand[4];
+    float error = 0.0f;
+    for (int c = 0; c < 4; ++c) {
+      cand[c] = std::clamp(static_cast<int>(std::lround((e[c] - p) / 2.0f)),
+                           0, 127);
+      const float d = e[c] - static_cast<float>(cand[c] * 2 + p);
+      error += d * d;
+    }
+    if (error < bestError) {
+      bestError = error;
+      std::copy(cand, cand + 4, q);
+      pbit = p;
+    }
+  }
+}
+
+float EvaluateBC7(const BlockPixels& px, const int q0[4], int p0,
+                  const int q1[4], int p1, int indices[16]) {
+  float palette[16][4];
+  for (int k = 0; k < 16; ++k) {
+    for (int c = 0; c < 4; ++c) {
+      const int a = q0[c] * 2 + p0;
+      const int b = q1[c] * 2 + p1;
+      palette[k][c] = static_cast<float>(
+          ((64 - BC7Weights[k]) * a + BC7Weights[k] * b + 32) >> 6);
+    }
+  }
+  return FindIndices(px, palette, 16, 4, indices);
+}
+
+/*!
+ * @brief 下位ビットから詰めていくビットライタ
+ */
+class BitWriter {
+ public:
+  explicit BitWriter(std::uint8_t* dst) : dst_(dst) { std::memset(dst, 0, 16); }
+  void Write(std::uint32_t value, int bits) {
+    for (int i = 0; i < bits; ++i, ++pos_) {
+      dst_[pos_ >> 3] |= static_cast<std::uint8_t>(((value >> i) & 1)
+                                                   << (pos_ & 7));
+    }
+  }
+
+ private:
+  std::uint8_t* dst_;
+  int pos_{0};
+};
+}  // namespace
+
+void EncodeBC1Block(const std::uint8_t rgba[64], std::uint8_t* dst) {
+  BlockPixels px;
+  LoadBlock(rgba, px);
+  EncodeColorBlock(px, dst);
+}
+
+void EncodeBC3Block(const std::uint8_t rgba[64], std::uint8_t* dst) {
+  BlockPixels px;
+  LoadBlock(rgba, px);
+  EncodeAlphaBlock(rgba, dst);
+  EncodeColorBlock(px, dst + 8);
+}
+
+void EncodeBC7Block(const std::uint8_t rgba[64], std::uint8_t* dst) {
+  BlockPixels px;
+  LoadBlock(rgba, px);
+
+  float e0[4], e1[4];
+  PrincipalEndpoints(px, 4, e0, e1);
+
+  int q0[4], q1[4], p0 = 0, p1 = 0;
+  QuantizeBC7Endpoint(e0, q0, p0);
+  QuantizeBC7Endpoint(e1, q1, p1);
+  int indices[16];
+  float error = EvaluateBC7(px, q0, p0, q1, p1, indices);
+
+  // 1回だけ最小二乗法で詰める
+  {
+    float weights[16];
+    for (int k = 0; k < 16; ++k) {
+      weights[k] = BC7Weights[k] / 64.0f;
+    }
+    float r0[4], r1[4];
+    if (RefineEndpoints(px, 4, indices, weights, r0, r1)) {
+      int n0[4], n1[4], np0 = 0, np1 = 0;
+      QuantizeBC7Endpoint(r0, n0, np0);
+      QuantizeBC7Endpoint(r1, n1, np1);
+      int refined[16];
+      const float refinedError = EvaluateBC7(px, n0, np0, n1, np1, refined);
+      if (refinedError < error) {
+        std::copy(n0, n0 + 4, q0);
+        std::copy(n1, n1 + 4, q1);
+        p0 = np0;
+        p1 = np1;
+        std::copy(refined, refined + 16, indices);
+      }
+    }
+  }
+
+  // 先頭ピクセルのインデックスは最上位ビットが0でないといけない
+  if (indices[0] >= 8) {
+    std::swap(q0, q1);
+    std::swap(p0, p1);
+    for (auto& i : indices) {
+      i = 15 - i;
+    }
+  }
+
+  BitWriter writer(dst);
+  writer.Write(1 << 6, 7);  // モード6
+  for (int c = 0; c < 4; ++c) {
+    writer.Write(static_cast<std::uint32_t>(q0[c]), 7);
+    writer.Write(static_cast<std::uint32_t>(q1[c]), 7);
+  }
+  writer.Write(static_cast<std::uint32_t>(p0), 1);
+  writer.Write(static_cast<std::uint32_t>(p1), 1);
+  writer.Write(static_cast<std::uint32_t>(indices[0]), 3);
+  for (int i = 1; i < 16; ++i) {
+    writer.Write(static_cast<std::uint32_t>(indices[i]), 4);
+  }
+}
+
+std::size_t CompressedSize(std::uint32_t width, std::uint32_t height,
+                           BlockFormat format) {
+  const std::size_t bw = (std::max(width, 1u) + 3) / 4;
+  const std::size_t bh = (std::max(height, 1u) + 3) / 4;
+  return bw * bh * BlockBytes(format);
+}
+
+void CompressImage(const std::uint8_t* rgba, std::uint32_t width,
+                   std::uint32_t height, std::size_t rowPitch,
+                   BlockFormat format, std::uint8_t* dst,
+                   unsigned int threadCount) {
+  const std::uint32_t blocksX = (width + 3) / 4;
+  const std::uint32_t blocksY = (height + 3) / 4;
+  const auto blockBytes = BlockBytes(format);
+  const auto encode = format == BlockFormat::BC1   ? EncodeBC1Block
+                      : format == BlockFormat::BC3 ? EncodeBC3Block
+                                                   : EncodeBC7Block;
+
+  // ブロックの行は独立しているので取り合いで処理する
+  std::atomic<std::uint32_t> nextRow{0};
+  auto worker = [&]() {
+    std::uint8_t block[64];
+    for (;;) {
+      const auto by = nextRow.fetch_add(1);
+      if (by >= blocksY) {
+        return;
+      }
+      auto out = dst + std::size_t(by) * blocksX * blockBytes;
+      for (std::uint32_t bx = 0; bx < blocksX; ++bx) {
+        for (std::uint32_t y = 0; y < 4; ++y) {
+          const auto sy = std::min(by * 4 + y, height - 1);
+          for (std::uint32_t x = 0; x < 4; ++x) {
+            const auto sx = std::min(bx * 4 + x, width - 1);
+            std::memcpy(block + (y * 4 + x) * 4,
+                        rgba + sy * rowPitch + std::size_t(sx) * 4, 4);
+          }
+        }
+        encode(block, out);
+        out += blockBytes;
+      }
+    }
+  };
+
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threadCount = std::min(threadCount, blocksY);
+  if (threadCount <= 1) {
+    worker();
+    return;
+  }
+  std::vector<std::thread> threads{};
+  for (unsigned int i = 0; i < threadCount; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+}  // namespace cooker
+}  // namespace dxapp
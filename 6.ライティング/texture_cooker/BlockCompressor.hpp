@@ -0,0 +1,71 @@
+﻿#pragma once
+// テクスチャのブロック圧縮(BC1/BC3/BC7)
+// クッカーはビルドマシンでも動かすので標準ライブラリだけで書いている
+#include <cstddef>
+#include <cstdint>
+
+namespace dxapp {
+namespace cooker {
+
+/*!
+ * @brief 圧縮フォーマット
+ */
+enum class BlockFormat {
+  BC1,  //!< RGB 4bpp。アルファなし
+  BC3,  //!< RGBA 8bpp。BC1のカラー + BC4のアルファ
+  BC7,  //!< RGBA 8bpp。モード6のみ使う高画質版
+};
+
+/*!
+ * @brief 1ブロック(4x4)のバイト数
+ */
+constexpr std::size_t BlockBytes(BlockFormat format) {
+  return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+/*!
+ * @brief 4x4ピクセルをBC1に圧縮
+ * @param[in] rgba 16ピクセル分のRGBA8(行優先)
+ * @param[out] dst 8バイト
+ */
+void EncodeBC1Block(const std::uint8_t rgba[64], std::uint8_t* dst);
+
+/*!
+ * @brief 4x4ピクセルをBC3に圧縮
+ * @param[in] rgba 16ピクセル分のRGBA8(行優先)
+ * @param[out] dst 16バイト
+ */
+void EncodeBC3Block(const std::uint8_t rgba[64], std::uint8_t* dst);
+
+/*!
+ * @brief 4x4ピクセルをBC7(モード6)に圧縮
+ * @param[in] rgba 16ピクセル分のRGBA8(行優先)
+ * @param[out] dst 16バイト
+ */
+void EncodeBC7Block(const std::uint8_t rgba[64], std::uint8_t* dst);
+
+/*!
+ * @brief 画像全体を圧縮
+ * @details ブロックの行単位でスレッドに振り分ける。
+ *          4の倍数でない端のブロックは端のピクセルを繰り返して埋める
+ * @param[in] rgba RGBA8の画像
+ * @param[in] width 幅
+ * @param[in] height 高さ
+ * @param[in] rowPitch 1行のバイト数
+ * @param[in] format 圧縮フォーマット
+ * @param[out] dst 出力先。CompressedSizeバイト必要
+ * @param[in] threadCount 使うスレッド数。0ならハードウェアに合わせる
+ */
+void CompressImage(const std::uint8_t* rgba, std::uint32_t width,
+                   std::uint32_t height, std::size_t rowPitch,
+                   BlockFormat format, std::uint8_t* dst,
+                   unsigned int threadCount = 0);
+
+/*!
+ * @brief 圧縮後のバイト数
+ */
+std::size_t CompressedSize(std::uint32_t width, std::uint32_t height,
+                           BlockFormat format);
+
+}  // namespace cooker
+}  // namespace dxapp
@@ -0,0 +1,137 @@
+﻿#include "DdsWriter.hpp"
+
+#include <fstream>
+
+namespace dxapp {
+namespace cooker {
+
+namespace {
+// DDSTextureLoader12.cppのヘッダと同じ並び
+constexpr std::uint32_t DdsMagic = 0x20534444;  // "DDS "
+
+constexpr std::uint32_t DdsHeaderFlagsTexture = 0x00001007;  // CAPS|HEIGHT|WIDTH|PIXELFORMAT
+constexpr std::uint32_t DdsHeaderFlagsMipmap = 0x00020000;
+constexpr std::uint32_t DdsHeaderFlagsLinearSize = 0x00080000;
+constexpr std::uint32_t DdsHeaderFlagsPitch = 0x00000008;
+constexpr std::uint32_t DdsFourCC = 0x00000004;
+constexpr std::uint32_t DdsSurfaceFlagsTexture = 0x00001000;
+constexpr std::uint32_t DdsSurfaceFlagsMipmap = 0x00400008;  // COMPLEX|MIPMAP
+constexpr std::uint32_t DdsDimensionTexture2D = 3;
+constexpr std::uint32_t DdsAlphaModeStraight = 1;
+
+struct DdsPixelFormat {
+  std::uint32_t size;
+  std::uint32_t flags;
+  std::uint32_t fourCC;
+  std::uint32_t rgbBitCount;
+  std::uint32_t rBitMask;
+  std::uint32_t gBitMask;
+  std::uint32_t bBitMask;
+  std::uint32_t aBitMask;
+};
+
+struct DdsHeader {
+  std::uint32_t size;
+  std::uint32_t flags;
+  std::uint32_t height;
+  std::uint32_t width;
+  std::uint32_t pitchOrLinearSize;
+  std::uint32_t depth;
+  std::uint32_t mipMapCount;
+  std::uint32_t reserved1[11];
+  DdsPixelFormat ddspf;
+  std::uint32_t caps;
+  std::uint32_t caps2;
+  std::uint32_t caps3;
+  std::uint32_t caps4;
+  std::uint32_t reserved2;
+};
+
+struct DdsHeaderDxt10 {
+  std::uint32_t dxgiFormat;
+  std::uint32_t resourceDimension;
+  std::uint32_t miscFlag;
+  std::uint32_t arraySize;
+  std::uint32_t miscFlags2;
+};
+
+static_assert(sizeof(DdsHeader) == 124, "DDS Header size mismatch");
+static_assert(sizeof(DdsHeaderDxt10) == 20, "DDS DX10 Extended Header size mismatch");
+
+constexpr std::uint32_t MakeFourCC(char a, char b, char c, char d) {
+  return std::uint32_t(std::uint8_t(a)) | (std::uint32_t(std::uint8_t(b)) << 8) |
+         (std::uint32_t(std::uint8_t(c)) << 16) |
+         (std::uint32_t(std::uint8_t(d)) << 24);
+}
+
+bool IsCompressed(DdsFormat format) {
+  return format != DdsFormat::R8G8B8A8_UNORM &&
+         format != DdsFormat::R8G8B8A8_UNORM_SRGB;
+}
+}  // namespace
+
+bool SerializeDds(DdsFormat format, const std::vector<DdsMip>& mips,
+                  std::vector<std::uint8_t>& out) {
+  out.clear();
+  if (mips.empty()) {
+    return false;
+  }
+
+  DdsHeader header{};
+  header.size = sizeof(DdsHeader);
+  header.flags = DdsHeaderFlagsTexture | DdsHeaderFlagsMipmap;
+  header.height = mips[0].height;
+  header.width = mips[0].width;
+  header.mipMapCount = static_cast<std::uint32_t>(mips.size());
+  if (IsCompressed(format)) {
+    header.flags |= DdsHeaderFlagsLinearSize;
+    header.pitchOrLinearSize = static_cast<std::uint32_t>(mips[0].data.size());
+  } else {
+    header.flags |= DdsHeaderFlagsPitch;
+    header.pitchOrLinearSize = mips[0].width * 4;
+  }
+  header.ddspf.size = sizeof(DdsPixelFormat);
+  header.ddspf.flags = DdsFourCC;
+  header.ddspf.fourCC = MakeFourCC('D', 'X', '1', '0');
+  header.caps = DdsSurfaceFlagsTexture;
+  if (mips.size() > 1) {
+    header.caps |= DdsSurfaceFlagsMipmap;
+  }
+
+  DdsHeaderDxt10 dxt10{};
+  dxt10.dxgiFormat = static_cast<std::uint32_t>(format);
+  dxt10.resourceDimension = DdsDimensionTexture2D;
+  dxt10.arraySize = 1;
+  dxt10.miscFlags2 = DdsAlphaModeStraight;
+
+  auto append = [&out](const void* data, std::size_t size) {
+    const auto bytes = static_cast<const std::uint8_t*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+  };
+  append(&DdsMagic, sizeof(DdsMagic));
+  append(&header, sizeof(header));
+  append(&dxt10, sizeof(dxt10));
+  // ミップは大きい順にすき間なく並べる
+  for (const auto& mip : mips) {
+    append(mip.data.data(), mip.data.size());
+  }
+  return true;
+}
+
+bool WriteDds(const std::filesystem::path& path, DdsFormat format,
+              const std::vector<DdsMip>& mips) {
+  std::vector<std::uint8_t> dds{};
+  if (!SerializeDds(format, mips, dds)) {
+    return false;
+  }
+  std::ofstream outfile(path, std::ios::binary);
+  if (!outfile) {
+    return false;
+  }
+  outfile.write(reinterpret_cast<const char*>(dds.data()),
+                static_cast<std::streamsize>(dds.size()));
+  return static_cast<bool>(outfile);
+}
+
+}  // namespace cooker
+}  // namespace dxapp
@@ -0,0 +1,60 @@
+﻿#pragma once
+// クックしたテクスチャをDDSで書き出す
+// ランタイムはTextureManager::LoadDDSTextureFromFileでそのまま読める
+// LZコンテナ(.ddz)に入れたものも同じ関数で読める
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace dxapp {
+namespace cooker {
+
+/*!
+ * @brief DDSに書くフォーマット
+ * @details 値はDXGI_FORMATと同じ。ツールはWindowsのヘッダに依存させない
+ */
+enum class DdsFormat : std::uint32_t {
+  R8G8B8A8_UNORM = 28,
+  R8G8B8A8_UNORM_SRGB = 29,
+  BC1_UNORM = 71,
+  BC1_UNORM_SRGB = 72,
+  BC3_UNORM = 77,
+  BC3_UNORM_SRGB = 78,
+  BC7_UNORM = 98,
+  BC7_UNORM_SRGB = 99,
+};
+
+/*!
+ * @brief ミップ1段分のデータ
+ */
+struct DdsMip {
+  std::uint32_t width{0};             //!< 幅
+  std::uint32_t height{0};            //!< 高さ
+  std::vector<std::uint8_t> data{};   //!< ピクセルかブロックの並び
+};
+
+/*!
+ * @brief 2DテクスチャのDDSファイルの中身をメモリに作る
+ * @details WriteDdsと同じ並び。LZコンテナに入れるときに使う
+ * @param[in] format フォーマット
+ * @param[in] mips ミップチェーン
+ * @param[out] out DDSファイルの中身
+ * @return 成否
+ */
+bool SerializeDds(DdsFormat format, const std::vector<DdsMip>& mips,
+                  std::vector<std::uint8_t>& out);
+
+/*!
+ * @brief 2Dテクスチャをミップチェーンごとに書き出す
+ * @details DX10拡張ヘッダ付きで書く。mips[0]が一番大きいミップ
+ * @param[in] path 出力先
+ * @param[in] format フォーマット
+ * @param[in] mips ミップチェーン
+ * @return 成否
+ */
+bool WriteDds(const std::filesystem::path& path, DdsFormat format,
+              const std::vector<DdsMip>& mips);
+
+}  // namespace cooker
+}  // namespace dxapp
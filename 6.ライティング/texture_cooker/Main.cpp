@@ -0,0 +1,375 @@
+﻿// テクスチャクッカー
+// PNGからミップチェーン付きのブロック圧縮DDSを作るコマンドラインツール
+//
+// 使い方:
+//   texture_cooker [-f auto|bc1|bc3|bc7|rgba] [-o 出力先] [-j スレッド数]
+//                  [--srgb] [--no-mips] [--atlas 名前 [--gutter 幅]]
+//                  [--compress] [--premultiply] 入力.png...
+//
+// 例: texture_cooker -f auto -o Assets/Cooked Assets/bricks.png Assets/grass.png
+//
+// --atlasを付けると入力をまとめて1枚のアトラスにする。
+// 名前.ddsと、各テクスチャのUVの変換(オフセットとスケール)を書いた
+// 名前.atlas.txtを出力する。詰める効率と時間も表示する
+//
+// --compressを付けるとDDSをチャンクごとにLZ圧縮して.ddzに書く。
+// ランタイムは展開をチャンク単位で並列に行う
+//
+// --premultiplyを付けるとRGBにアルファを掛けてから縮小する(乗算済みアルファ)
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "../d3d12_game/LzContainer.hpp"
+#include "../d3d12_game/MipGenerator.hpp"
+#include "../d3d12_game/PixelConvert.hpp"
+#include "../d3d12_game/PngDecoder.hpp"
+#include "../d3d12_game/TexturePacker.hpp"
+#include "BlockCompressor.hpp"
+#include "DdsWriter.hpp"
+
+namespace {
+using namespace dxapp;
+
+//! 出力フォーマットの指定
+enum class OutputFormat {
+  Auto,  //!< アルファがあればBC3、なければBC1
+  BC1,
+  BC3,
+  BC7,
+  RGBA,  //!< 圧縮しない
+};
+
+//! コマンドラインのオプション
+struct Options {
+  OutputFormat format{OutputFormat::Auto};
+  std::filesystem::path outputDir{"."};
+  unsigned int threadCount{0};  //!< 0ならハードウェアに合わせる
+  bool srgb{false};
+  bool generateMips{true};
+  std::string atlasName{};    //!< 空でなければアトラスにまとめる
+  std::uint32_t gutter{4};    //!< アトラスの余白のピクセル数
+  bool compress{false};       //!< LZコンテナ(.ddz)に入れるか
+  bool premultiply{false};    //!< RGBにアルファを掛けておくか
+  std::vector<std::filesystem::path> inputs{};
+};
+
+//! アトラスの最大の幅・高さ
+constexpr std::uint32_t MaxAtlasSize = 8192;
+
+//! アトラスの配置の単位。2^4なのでmip4までは隣が混ざらない
+constexpr std::uint32_t AtlasAlignment = 16;
+constexpr std::size_t AtlasMipLevels = 5;
+
+void PrintUsage() {
+  std::printf(
+      "usage: texture_cooker [-f auto|bc1|bc3|bc7|rgba] [-o dir] [-j threads]"
+      " [--srgb] [--no-mips] [--atlas name [--gutter pixels]]"
+      " [--compress] [--premultiply] input.png...\n");
+}
+
+bool ParseOptions(int argc, char* argv[], Options& options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (arg == "-f" && hasValue) {
+      const std::string value = argv[++i];
+      if (value == "auto") {
+        options.format = OutputFormat::Auto;
+      } else if (value == "bc1") {
+        options.format = OutputFormat::BC1;
+      } else if (value == "bc3") {
+        options.format = OutputFormat::BC3;
+      } else if (value == "bc7") {
+        options.format = OutputFormat::BC7;
+      } else if (value == "rgba") {
+        options.format = OutputFormat::RGBA;
+      } else {
+        return false;
+      }
+    } else if (arg == "-o" && hasValue) {
+      options.outputDir = argv[++i];
+    } else if (arg == "-j" && hasValue) {
+      options.threadCount = static_cast<unsigned int>(std::stoul(argv[++i]));
+    } else if (arg == "--srgb") {
+      options.srgb = true;
+    } else if (arg == "--no-mips") {
+      options.generateMips = false;
+    } else if (arg == "--atlas" && hasValue) {
+      options.atlasName = argv[++i];
+    } else if (arg == "--gutter" && hasValue) {
+      options.gutter = static_cast<std::uint32_t>(std::stoul(argv[++i]));
+    } else if (arg == "--compress") {
+      options.compress = true;
+    } else if (arg == "--premultiply") {
+      options.premultiply = true;
+    } else if (!arg.empty() && arg[0] == '-') {
+      return false;
+    } else {
+      options.inputs.emplace_back(arg);
+    }
+  }
+  return !options.inputs.empty();
+}
+
+bool HasAlpha(const std::vector<std::uint8_t>& pixels) {
+  for (std::size_t i = 3; i < pixels.size(); i += 4) {
+    if (pixels[i] != 255) {
+      return true;
+    }
+  }
+  return false;
+}
+
+cooker::DdsFormat ToDdsFormat(OutputFormat format, bool srgb) {
+  using cooker::DdsFormat;
+  switch (format) {
+    case OutputFormat::BC1:
+      return srgb ? DdsFormat::BC1_UNORM_SRGB : DdsFormat::BC1_UNORM;
+    case OutputFormat::BC3:
+      return srgb ? DdsFormat::BC3_UNORM_SRGB : DdsFormat::BC3_UNORM;
+    case OutputFormat::BC7:
+      return srgb ? DdsFormat::BC7_UNORM_SRGB : DdsFormat::BC7_UNORM;
+    default:
+      return srgb ? DdsFormat::R8G8B8A8_UNORM_SRGB
+                  : DdsFormat::R8G8B8A8_UNORM;
+  }
+}
+
+/*!
+ * @brief mip0からミップチェーンを作る
+ * @details --srgbならリニアで平均する。--premultiplyならmip0にアルファを
+ *          掛けてから縮小するので、透明な部分の色がにじまない
+ * @param[in,out] levels levels[0]にmip0を入れて呼ぶ
+ * @param[in] maxLevels 作る段数の上限(mip0を含む)
+ */
+void AppendMips(std::vector<mip::MipLevel>& levels, std::size_t maxLevels,
+                const Options& options) {
+  if (options.premultiply) {
+    auto& mip0 = levels[0].pixels;
+    pixel::PremultiplyAlpha(mip0.data(), mip0.data(), mip0.size() / 4);
+  }
+  if (!options.generateMips) {
+    return;
+  }
+  std::vector<mip::MipLevel> mips{};
+  mip::GenerateMipChain(levels[0].pixels.data(), levels[0].width,
+                        levels[0].height, levels[0].rowPitch(), options.srgb,
+                        mips, options.threadCount);
+  if (mips.size() + 1 > maxLevels) {
+    mips.resize(maxLevels - 1);
+  }
+  std::move(std::begin(mips), std::end(mips), std::back_inserter(levels));
+}
+
+/*!
+ * @brief ミップチェーンを圧縮してDDSに書き出す
+ * @param[in,out] output 出力先。LZコンテナにするときは拡張子を.ddzに変える
+ * @param[out] sourceBytes 圧縮前のバイト数
+ * @param[out] cookedBytes 圧縮後のバイト数(LZコンテナならファイルの大きさ)
+ */
+bool WriteCooked(const std::vector<mip::MipLevel>& levels,
+                 OutputFormat format, const Options& options,
+                 std::filesystem::path& output, std::size_t& sourceBytes,
+                 std::size_t& cookedBytes) {
+  if (format == OutputFormat::Auto) {
+    format = HasAlpha(levels[0].pixels) ? OutputFormat::BC3 : OutputFormat::BC1;
+  }
+
+  // ミップごとに圧縮。圧縮の中でブロックの行をスレッドに振り分ける
+  std::vector<cooker::DdsMip> mips(levels.size());
+  sourceBytes = 0;
+  cookedBytes = 0;
+  for (std::size_t i = 0; i < levels.size(); ++i) {
+    const auto& level = levels[i];
+    auto& mip = mips[i];
+    mip.width = level.width;
+    mip.height = level.height;
+    if (format == OutputFormat::RGBA) {
+      mip.data = level.pixels;
+    } else {
+      const auto blockFormat = format == OutputFormat::BC1
+                                   ? cooker::BlockFormat::BC1
+                                   : format == OutputFormat::BC3
+                                         ? cooker::BlockFormat::BC3
+                                         : cooker::BlockFormat::BC7;
+      mip.data.resize(
+          cooker::CompressedSize(level.width, level.height, blockFormat));
+      cooker::CompressImage(level.pixels.data(), level.width, level.height,
+                            level.rowPitch(), blockFormat, mip.data.data(),
+                            options.threadCount);
+    }
+    sourceBytes += level.pixels.size();
+    cookedBytes += mip.data.size();
+  }
+
+  if (!options.compress) {
+    if (!cooker::WriteDds(output, ToDdsFormat(format, options.srgb), mips)) {
+      std::fprintf(stderr, "%s: failed to write\n", output.string().c_str());
+      return false;
+    }
+    return true;
+  }
+
+  // DDSの中身をそのままチャンクに分けて圧縮する
+  std::vector<std::uint8_t> dds{};
+  output.replace_extension(".ddz");
+  if (!cooker::SerializeDds(ToDdsFormat(format, options.srgb), mips, dds) ||
+      !lz::WriteContainer(output, dds.data(), dds.size(), lz::DefaultChunkSize,
+                          options.threadCount)) {
+    std::fprintf(stderr, "%s: failed to write\n", output.string().c_str());
+    return false;
+  }
+  std::error_code ec;
+  cookedBytes =
+      static_cast<std::size_t>(std::filesystem::file_size(output, ec));
+  return true;
+}
+
+/*!
+ * @brief 1ファイルをクックする
+ */
+bool Cook(const std::filesystem::path& input, const Options& options) {
+  const auto start = std::chrono::steady_clock::now();
+
+  png::Image image{};
+  std::string error{};
+  if (!png::DecodeFromFile(input, image, &error)) {
+    std::fprintf(stderr, "%s: %s\n", input.string().c_str(), error.c_str());
+    return false;
+  }
+
+  // ミップチェーンは1x1まで作る
+  std::vector<mip::MipLevel> levels(1);
+  levels[0].width = image.width;
+  levels[0].height = image.height;
+  levels[0].pixels = std::move(image.pixels);
+  AppendMips(levels, mip::CountMips(image.width, image.height), options);
+
+  auto output = options.outputDir / input.filename();
+  output.replace_extension(".dds");
+  std::size_t sourceBytes = 0;
+  std::size_t cookedBytes = 0;
+  if (!WriteCooked(levels, options.format, options, output, sourceBytes,
+                   cookedBytes)) {
+    return false;
+  }
+
+  const auto ms = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  std::printf("%s -> %s (%ux%u, %zu mips, %zu -> %zu bytes, %.1f ms)\n",
+              input.string().c_str(), output.string().c_str(), levels[0].width,
+              levels[0].height, levels.size(), sourceBytes, cookedBytes, ms);
+  return true;
+}
+
+/*!
+ * @brief 全部の入力を1枚のアトラスにしてクックする
+ * @details 配置の単位をそろえてあるので、AtlasMipLevels段までは
+ *          隣のテクスチャが混ざらない。それより小さいミップは作らない
+ */
+bool CookAtlas(const Options& options) {
+  const auto start = std::chrono::steady_clock::now();
+
+  std::vector<png::Image> images{};
+  const auto results =
+      png::DecodeFiles(options.inputs, images, options.threadCount);
+  std::vector<pack::TextureDesc> sizes(images.size());
+  for (std::size_t i = 0; i < images.size(); ++i) {
+    if (!results[i]) {
+      std::fprintf(stderr, "%s: failed to decode\n",
+                   options.inputs[i].string().c_str());
+      return false;
+    }
+    sizes[i] = {images[i].width, images[i].height, 0};
+  }
+
+  const auto packStart = std::chrono::steady_clock::now();
+  pack::AtlasLayout layout{};
+  if (!pack::PackAtlas(sizes, MaxAtlasSize, options.gutter, AtlasAlignment,
+                       layout)) {
+    std::fprintf(stderr, "%s: does not fit in %ux%u\n",
+                 options.atlasName.c_str(), MaxAtlasSize, MaxAtlasSize);
+    return false;
+  }
+  const auto packMs = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - packStart)
+                          .count();
+
+  std::vector<mip::MipLevel> levels(1);
+  levels[0].width = layout.width;
+  levels[0].height = layout.height;
+  levels[0].pixels.assign(levels[0].rowPitch() * layout.height, 0);
+  for (std::size_t i = 0; i < images.size(); ++i) {
+    pack::BlitWithGutter(images[i].pixels.data(), images[i].rowPitch(),
+                         levels[0].pixels.data(), levels[0].rowPitch(),
+                         layout.rects[i], options.gutter);
+  }
+  AppendMips(levels, AtlasMipLevels, options);
+
+  auto output = options.outputDir / (options.atlasName + ".dds");
+  std::size_t sourceBytes = 0;
+  std::size_t cookedBytes = 0;
+  if (!WriteCooked(levels, options.format, options, output, sourceBytes,
+                   cookedBytes)) {
+    return false;
+  }
+
+  // マテリアルのUV変換に使う値: uv' = uv * scale + offset
+  const auto layoutPath =
+      options.outputDir / (options.atlasName + ".atlas.txt");
+  std::ofstream layoutFile(layoutPath);
+  if (!layoutFile) {
+    std::fprintf(stderr, "%s: failed to write\n", layoutPath.string().c_str());
+    return false;
+  }
+  layoutFile << "# name offsetU offsetV scaleU scaleV\n";
+  for (std::size_t i = 0; i < images.size(); ++i) {
+    const auto& rect = layout.rects[i];
+    layoutFile << options.inputs[i].stem().string() << ' '
+               << double(rect.x) / layout.width << ' '
+               << double(rect.y) / layout.height << ' '
+               << double(rect.width) / layout.width << ' '
+               << double(rect.height) / layout.height << '\n';
+  }
+
+  const auto ms = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  std::printf(
+      "%s (%zu textures, %ux%u, efficiency %.1f%%, pack %.3f ms, "
+      "%zu -> %zu bytes, %.1f ms)\n",
+      output.string().c_str(), images.size(), layout.width, layout.height,
+      layout.efficiency * 100.0, packMs, sourceBytes, cookedBytes, ms);
+  return true;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options{};
+  if (!ParseOptions(argc, argv, options)) {
+    PrintUsage();
+    return 1;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(options.outputDir, ec);
+
+  if (!options.atlasName.empty()) {
+    return CookAtlas(options) ? 0 : 1;
+  }
+
+  int failed = 0;
+  for (const auto& input : options.inputs) {
+    if (!Cook(input, options)) {
+      ++failed;
+    }
+  }
+  return failed == 0 ? 0 : 1;
+}